@@ -0,0 +1,278 @@
+//-------------------------------------------------------------------
+//
+// clip_alloc_bench
+//
+// Plays small generated Y4M clips through a headless SoftwarePlayer and
+// counts the heap allocations of all its threads per loop of a clip and
+// per switch to the next clip, after a warm-up that lets the threads'
+// buffers grow. Fails if a loop allocates at all, if a switch takes more
+// than --max-switch=N allocations, or if a media item's arena reports an
+// overrun or a leak (checked in debug builds).
+//
+// It then loops a clip with a loop cache: every pass after the first must
+// replay all frames from the store, allocating nothing. Last it loops the
+// clip capped at half its rate: the player must read only the frames the
+// cap presents, leaving the sink none to drop, and allocate nothing.
+//
+// The C library's FILE buffers come from malloc and are not counted.
+//
+//-------------------------------------------------------------------
+
+#include "SoftwarePlayer.h"
+#include "CountingAllocator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+static const uint32_t CLIP_COUNT = 3;
+static const uint32_t CLIP_WIDTH = 64;
+static const uint32_t CLIP_HEIGHT = 36;
+static const uint32_t CLIP_FPS = 100;
+static const uint32_t CLIP_FRAMES = 10;		// Of the first clip; each next one has 5 more
+static const uint32_t WARMUP_LOOPS = 3;
+static const uint32_t DEFAULT_LOOPS = 20;
+static const uint32_t DEFAULT_SWITCHES = 12;
+static const uint64_t DEFAULT_MAX_SWITCH_ALLOCATIONS = 4;
+static const size_t LOOP_CACHE_BUDGET = 4 << 20;
+static const int EVENT_TIMEOUT_SECONDS = 10;
+
+// Records the player's events for the main thread, which drives it the
+// way the app does: it loops a clip by seeking to the start when it ends.
+class BenchHost : public ISoftwarePlayerHost
+{
+public:
+	BenchHost() : m_cEnded(0), m_cPrepared(0), m_cFirstFrames(0), m_cErrors(0) {}
+
+	void PresentFrame(const FrameBuffer*) override {}
+	void OnStateChanged(SOFTWARE_PLAYER_STATE state) override
+	{
+		if (state == SOFTWARE_PLAYER_PLAYING)
+			Signal(&m_cFirstFrames);
+	}
+	void OnEnded() override { Signal(&m_cEnded); }
+	void OnError() override { Signal(&m_cErrors); }
+	void OnPrepared(bool bSucceeded) override
+	{
+		if (!bSucceeded)
+			Signal(&m_cErrors);
+		Signal(&m_cPrepared);
+	}
+
+	// Waits for *pCount to pass nCount; false on timeout or an error.
+	bool WaitFor(const uint32_t* pCount, uint32_t nCount)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		bool bSignaled = m_cv.wait_for(lock, std::chrono::seconds(EVENT_TIMEOUT_SECONDS),
+			[this, pCount, nCount] { return *pCount > nCount || m_cErrors; });
+		return bSignaled && !m_cErrors;
+	}
+
+	uint32_t Get(const uint32_t* pCount)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return *pCount;
+	}
+
+	uint32_t					m_cEnded;
+	uint32_t					m_cPrepared;
+	uint32_t					m_cFirstFrames;
+	uint32_t					m_cErrors;
+
+private:
+	void Signal(uint32_t* pCount)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			(*pCount)++;
+		}
+		m_cv.notify_all();
+	}
+
+	std::mutex					m_mutex;
+	std::condition_variable		m_cv;
+};
+
+// Writes a 4:2:0 clip of cFrames frames whose FRAME lines carry a
+// parameter, as some encoders write them.
+static bool WriteClip(const std::string& path, uint32_t nClip, uint32_t cFrames)
+{
+	FILE* fp = fopen(path.c_str(), "wb");
+	if (!fp)
+		return false;
+	fprintf(fp, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", CLIP_WIDTH, CLIP_HEIGHT, CLIP_FPS);
+	size_t cbFrame = CLIP_WIDTH * CLIP_HEIGHT * 3 / 2;
+	uint8_t* pFrame = (uint8_t*)malloc(cbFrame);
+	for (uint32_t n = 0; pFrame && n < cFrames; n++) {
+		memset(pFrame, (int)(16 + (nClip * 40 + n * 7) % 200), cbFrame);
+		fprintf(fp, n % 2 ? "FRAME Ixyz\n" : "FRAME\n");
+		fwrite(pFrame, 1, cbFrame, fp);
+	}
+	free(pFrame);
+	return fclose(fp) == 0 && pFrame;
+}
+
+static void RemoveClips()
+{
+	for (uint32_t i = 0; i < CLIP_COUNT; i++) {
+		char szPath[64];
+		snprintf(szPath, sizeof(szPath), "clip_alloc_bench_%u.y4m", i);
+		remove(szPath);
+	}
+}
+
+// One loop: seek to the start, then wait for the end.
+static bool PlayLoop(SoftwarePlayer* pPlayer, BenchHost* pHost)
+{
+	uint32_t cEnded = pHost->Get(&pHost->m_cEnded);
+	return pPlayer->SetPosition(0) && pHost->WaitFor(&pHost->m_cEnded, cEnded);
+}
+
+// One switch: open the next clip on the open thread, switch to it and
+// wait for its first frame.
+static bool SwitchClip(SoftwarePlayer* pPlayer, BenchHost* pHost, const std::wstring& path)
+{
+	uint32_t cPrepared = pHost->Get(&pHost->m_cPrepared);
+	uint32_t cFirstFrames = pHost->Get(&pHost->m_cFirstFrames);
+	pPlayer->Prepare(path);
+	if (!pHost->WaitFor(&pHost->m_cPrepared, cPrepared) || !pPlayer->SwitchToPrepared())
+		return false;
+	return pHost->WaitFor(&pHost->m_cFirstFrames, cFirstFrames);
+}
+
+// Loops a clip of cFrames frames with the loop cache on: the first pass
+// fills the store, later ones are served from it.
+static bool RunLoopCache(const std::wstring& path, uint32_t cFrames, uint32_t cLoops)
+{
+	BenchHost host;
+	SoftwarePlayer* pPlayer = new SoftwarePlayer(&host, SoftwarePlayerConfig());
+	pPlayer->SetLoopCacheBudget(LOOP_CACHE_BUDGET);
+	bool bPlayed = pPlayer->Open(path) && host.WaitFor(&host.m_cEnded, 0);
+	for (uint32_t i = 0; bPlayed && i < WARMUP_LOOPS; i++)
+		bPlayed = PlayLoop(pPlayer, &host);
+
+	uint64_t cAllocations = GetAllocationCount();
+	for (uint32_t i = 0; bPlayed && i < cLoops; i++)
+		bPlayed = PlayLoop(pPlayer, &host);
+	uint64_t cLoopAllocations = GetAllocationCount() - cAllocations;
+	FrameStoreStats stats = pPlayer->GetLoopCacheStats();
+	delete pPlayer;
+
+	bool bPassed = bPlayed && cLoopAllocations == 0 && stats.cFrames == cFrames && stats.cMisses == cFrames &&
+		stats.cHits >= (uint64_t)cFrames * (WARMUP_LOOPS + cLoops);
+	printf("loop cache: %u of %u frames stored, %llu hits, %llu misses, %.2f allocations per loop: %s\n",
+		stats.cFrames, cFrames, (unsigned long long)stats.cHits, (unsigned long long)stats.cMisses,
+		(double)cLoopAllocations / cLoops, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+// Loops a clip of cFrames frames capped at half its rate; frames are
+// counted as they reach the sink.
+static bool RunRateCap(const std::wstring& path, uint32_t cFrames, uint32_t cLoops)
+{
+	BenchHost host;
+	SoftwarePlayer* pPlayer = new SoftwarePlayer(&host, SoftwarePlayerConfig());
+	FrameRate cap = { CLIP_FPS / 2, 1 };
+	pPlayer->SetMaxFrameRate(cap);
+	bool bPlayed = pPlayer->Open(path) && host.WaitFor(&host.m_cEnded, 0);
+	for (uint32_t i = 0; bPlayed && i < WARMUP_LOOPS; i++)
+		bPlayed = PlayLoop(pPlayer, &host);
+
+	FrameSinkStats before = pPlayer->GetSinkStats();
+	uint64_t cAllocations = GetAllocationCount();
+	for (uint32_t i = 0; bPlayed && i < cLoops; i++)
+		bPlayed = PlayLoop(pPlayer, &host);
+	uint64_t cLoopAllocations = GetAllocationCount() - cAllocations;
+	FrameSinkStats after = pPlayer->GetSinkStats();
+	delete pPlayer;
+
+	uint64_t cQueued = after.cQueued - before.cQueued;
+	bool bPassed = bPlayed && cLoopAllocations == 0 && after.cDecimated == 0 &&
+		cQueued == (uint64_t)(cFrames + 1) / 2 * cLoops;
+	printf("rate cap %u -> %u fps: %.2f of %u frames read per loop, %llu dropped by the cap, "
+		"%.2f allocations per loop: %s\n", CLIP_FPS, cap.nNum, (double)cQueued / cLoops, cFrames,
+		(unsigned long long)after.cDecimated, (double)cLoopAllocations / cLoops, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t cLoops = DEFAULT_LOOPS;
+	uint32_t cSwitches = DEFAULT_SWITCHES;
+	uint64_t cMaxSwitch = DEFAULT_MAX_SWITCH_ALLOCATIONS;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--loops=", 8) == 0)
+			cLoops = atoi(argv[i] + 8) > 0 ? atoi(argv[i] + 8) : 1;
+		else if (strncmp(argv[i], "--switches=", 11) == 0)
+			cSwitches = atoi(argv[i] + 11) > 0 ? atoi(argv[i] + 11) : 1;
+		else if (strncmp(argv[i], "--max-switch=", 13) == 0)
+			cMaxSwitch = strtoull(argv[i] + 13, NULL, 10);
+		else {
+			fprintf(stderr, "usage: clip_alloc_bench [--loops=N] [--switches=N] [--max-switch=N]\n");
+			return 2;
+		}
+	}
+
+	std::wstring paths[CLIP_COUNT];
+	for (uint32_t i = 0; i < CLIP_COUNT; i++) {
+		char szPath[64];
+		snprintf(szPath, sizeof(szPath), "clip_alloc_bench_%u.y4m", i);
+		if (!WriteClip(szPath, i, CLIP_FRAMES + i * 5)) {
+			fprintf(stderr, "cannot write %s\n", szPath);
+			return 2;
+		}
+		paths[i] = std::wstring(szPath, szPath + strlen(szPath));
+	}
+
+	BenchHost host;
+	SoftwarePlayer* pPlayer = new SoftwarePlayer(&host, SoftwarePlayerConfig());
+	bool bPlayed = pPlayer->Open(paths[0]) && host.WaitFor(&host.m_cEnded, 0);
+
+	// Warm-up: the decode threads' buffers, the open thread's path and the
+	// item slots grow to what the clips need.
+	for (uint32_t i = 0; bPlayed && i < WARMUP_LOOPS; i++)
+		bPlayed = PlayLoop(pPlayer, &host);
+	for (uint32_t i = 1; bPlayed && i <= CLIP_COUNT; i++)
+		bPlayed = SwitchClip(pPlayer, &host, paths[i % CLIP_COUNT]);
+
+	uint64_t cAllocations = GetAllocationCount();
+	for (uint32_t i = 0; bPlayed && i < cLoops; i++)
+		bPlayed = PlayLoop(pPlayer, &host);
+	uint64_t cLoopAllocations = GetAllocationCount() - cAllocations;
+
+	ArenaStats before = pPlayer->GetItemArenaStats();
+	cAllocations = GetAllocationCount();
+	for (uint32_t i = 0; bPlayed && i < cSwitches; i++)
+		bPlayed = SwitchClip(pPlayer, &host, paths[(i + 1) % CLIP_COUNT]);
+	uint64_t cSwitchAllocations = GetAllocationCount() - cAllocations;
+
+	pPlayer->Shutdown();
+	ArenaStats after = pPlayer->GetItemArenaStats();
+	delete pPlayer;
+	if (!bPlayed) {
+		printf("playback: FAILED\n");
+		RemoveClips();
+		return 1;
+	}
+
+	double fPerLoop = (double)cLoopAllocations / cLoops;
+	double fPerSwitch = (double)cSwitchAllocations / cSwitches;
+	double fChunksPerSwitch = (double)(after.cChunks - before.cChunks) / cSwitches;
+	bool bLoopsPassed = cLoopAllocations == 0;
+	bool bSwitchesPassed = fPerSwitch <= (double)cMaxSwitch;
+	bool bArenasPassed = after.cOverruns == 0 && after.cLeaks == 0 && after.cBadDeletes == 0;
+	printf("loops: %u, %.2f allocations per loop: %s\n", cLoops, fPerLoop, bLoopsPassed ? "ok" : "FAILED");
+	printf("switches: %u, %.2f allocations per switch (at most %llu), %.2f of them arena chunks: %s\n", cSwitches,
+		fPerSwitch, (unsigned long long)cMaxSwitch, fChunksPerSwitch, bSwitchesPassed ? "ok" : "FAILED");
+	printf("media item arenas: %llu released, %llu overruns, %llu leaks, %llu bad deletes: %s\n",
+		(unsigned long long)after.cResets, (unsigned long long)after.cOverruns, (unsigned long long)after.cLeaks,
+		(unsigned long long)after.cBadDeletes, bArenasPassed ? "ok" : "FAILED");
+	bool bCachePassed = RunLoopCache(paths[0], CLIP_FRAMES, cLoops);
+	bool bCapPassed = RunRateCap(paths[0], CLIP_FRAMES, cLoops);
+	RemoveClips();
+	return bLoopsPassed && bSwitchesPassed && bArenasPassed && bCachePassed && bCapPassed ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+//-------------------------------------------------------------------
+//
+// config_bench
+//
+// Times parsing configs of 10, 1000 and 100000 clips, or of the
+// --config=PATH file, and scanning them for JSON tokens only, which is
+// the floor a parse cannot go below. Prints the ms and MB/s of each per
+// pass, over --passes=N passes.
+//
+// Fails if a config does not parse, or if a generated one does not
+// give back every clip with its start time and the other settings.
+//
+//-------------------------------------------------------------------
+
+#include "WallpaperConfig.h"
+#include "FileUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const uint32_t DEFAULT_PASSES = 20;
+static const size_t CLIP_COUNTS[] = { 10, 1000, 100000 };
+
+// The generated config parsed: its clips start a minute apart, from
+// midnight, and it sets a 30 fps cap and turns monitor 1 off.
+static bool CheckGenerated(const std::string& text, size_t cClips)
+{
+	WallpaperConfig config;
+	ConfigError error;
+	if (!ParseWallpaperConfig(text.data(), text.size(), WallpaperConfig(), &config, &error))
+		return false;
+	bool bPassed = config.clips.size() == cClips && config.fMaxFps == 30.0f &&
+		config.playlist.order == PLAYLIST_SHUFFLE && config.power[POWER_STATE_SAVER].bPause &&
+		config.monitors.size() == 2 && !config.monitors[1].bEnabled;
+	for (size_t c = 0; bPassed && c < cClips; c++) {
+		char szName[32];
+		snprintf(szName, sizeof(szName), "clip%06u.mp4", (unsigned)c);
+		const PlaylistItem& item = config.clips[c];
+		bPassed = item.nStartOfDay == (int32_t)(c % (24 * 60)) * 60 &&
+			item.path.size() > strlen(szName) && ToUtf8(item.path).find(szName) != std::string::npos;
+	}
+	return bPassed;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t cPasses = DEFAULT_PASSES;
+	std::string configPath;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--passes=", 9) == 0)
+			cPasses = atoi(argv[i] + 9) > 0 ? atoi(argv[i] + 9) : 1;
+		else if (strncmp(argv[i], "--config=", 9) == 0)
+			configPath = argv[i] + 9;
+		else {
+			fprintf(stderr, "usage: config_bench [--passes=N] [--config=PATH]\n");
+			return 2;
+		}
+	}
+
+	std::vector<std::string> names, texts;
+	if (!configPath.empty()) {
+		MappedFile file;
+		if (!file.Open(FromUtf8(configPath.data(), configPath.size()))) {
+			fprintf(stderr, "cannot read %s\n", configPath.c_str());
+			return 2;
+		}
+		names.push_back(configPath);
+		texts.push_back(std::string((const char*)file.GetData(), file.GetSize()));
+	}
+	else {
+		for (size_t i = 0; i < sizeof(CLIP_COUNTS) / sizeof(CLIP_COUNTS[0]); i++) {
+			names.push_back(std::to_string(CLIP_COUNTS[i]) + " clips");
+			texts.push_back(MakeBenchConfig(CLIP_COUNTS[i]));
+		}
+	}
+
+	bool bPassed = true;
+	printf("%-14s %10s %8s %10s %9s %10s %9s\n", "config", "KB", "tokens", "parse ms", "MB/s", "scan ms", "MB/s");
+	for (size_t i = 0; i < texts.size(); i++) {
+		ConfigBenchResult result;
+		if (!RunConfigBench(texts[i], WallpaperConfig(), cPasses, &result)) {
+			printf("%-14s (%u,%u): %s\n", names[i].c_str(), result.error.nLine, result.error.nColumn,
+				result.error.pszMessage ? result.error.pszMessage : "");
+			bPassed = false;
+			continue;
+		}
+		printf("%-14s %10.1f %8u %10.3f %9.1f %10.3f %9.1f\n", names[i].c_str(), result.cbText / 1024.0,
+			result.cTokens, result.fParseMs, result.fParseMs > 0.0 ? result.cbText / result.fParseMs / 1e3 : 0.0,
+			result.fScanMs, result.fScanMs > 0.0 ? result.cbText / result.fScanMs / 1e3 : 0.0);
+		if (configPath.empty() && !CheckGenerated(texts[i], CLIP_COUNTS[i])) {
+			printf("%-14s parsed to the wrong settings\n", names[i].c_str());
+			bPassed = false;
+		}
+	}
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+//-------------------------------------------------------------------
+//
+// control_bench
+//
+// Round-trips control requests as the control pipe serves them: encoded
+// by the client, sent over a Unix-domain socket pair, decoded by a
+// ControlConnection on the transport thread, handed to an owner thread
+// standing in for the window thread, dispatched and replied back over
+// the socket. Prints the microseconds per request for batches of 1, 8
+// and 64 requests per write, then without the socket and with the codec
+// alone to show what each layer costs. Fails if a reply is missing or
+// not OK.
+//
+//-------------------------------------------------------------------
+
+#include "ControlProtocol.h"
+#include "ControlHarness.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+static const uint32_t DEFAULT_REQUESTS = 20000;
+
+class NullTarget : public IControlTarget
+{
+public:
+	int32_t Open(const std::wstring&) override { return CONTROL_S_OK; }
+	int32_t Pause() override { return CONTROL_S_OK; }
+	int32_t Resume() override { return CONTROL_S_OK; }
+	int32_t Seek(HNSTIME) override { return CONTROL_S_OK; }
+	int32_t SetRate(float) override { return CONTROL_S_OK; }
+	int32_t SetVolume(float) override { return CONTROL_S_OK; }
+	int32_t QueryStats(ControlStats* pStats) override { pStats->cClips = 1; return CONTROL_S_OK; }
+};
+
+// A batch of cBatch requests cycling through the commands.
+static void EncodeBatch(uint32_t cBatch, std::vector<uint8_t>* pStream)
+{
+	static const CONTROL_COMMAND commands[] = { CONTROL_COMMAND_SEEK, CONTROL_COMMAND_SET_VOLUME,
+		CONTROL_COMMAND_QUERY_STATS, CONTROL_COMMAND_PAUSE, CONTROL_COMMAND_RESUME };
+	pStream->clear();
+	for (uint32_t i = 0; i < cBatch; i++) {
+		ControlMessage request;
+		request.command = commands[i % (sizeof(commands) / sizeof(commands[0]))];
+		request.nSeq = i;
+		request.hnsValue = HNS_PER_SECOND;
+		request.fValue = 0.5f;
+		EncodeControlMessage(request, pStream);
+	}
+}
+
+// False unless the replies are all cBatch replies of the batch, OK.
+static bool CheckReplies(const std::vector<ControlMessage>& replies, uint32_t cBatch)
+{
+	if (replies.size() != cBatch)
+		return false;
+	for (uint32_t i = 0; i < cBatch; i++) {
+		if (!replies[i].bReply || replies[i].nSeq != i || replies[i].nStatus != CONTROL_S_OK)
+			return false;
+	}
+	return true;
+}
+
+// Decodes the replies of one batch and checks them.
+static bool CheckReplies(const std::vector<uint8_t>& stream, uint32_t cBatch)
+{
+	ControlDecoder decoder;
+	decoder.Feed(stream.data(), stream.size());
+	std::vector<ControlMessage> replies;
+	ControlMessage reply;
+	while (decoder.Next(&reply) == CONTROL_DECODE_MESSAGE)
+		replies.push_back(reply);
+	return CheckReplies(replies, cBatch);
+}
+
+static double Elapsed(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t cRequests = DEFAULT_REQUESTS;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--requests=", 11) == 0)
+			cRequests = atoi(argv[i] + 11) > 0 ? atoi(argv[i] + 11) : 1;
+		else {
+			fprintf(stderr, "usage: control_bench [--requests=N]\n");
+			return 2;
+		}
+	}
+
+	NullTarget target;
+	OwnerThread owner(&target);
+	ControlDispatcher dispatcher(&target);
+	std::vector<uint8_t> stream, replies;
+	bool bPassed = true;
+
+	printf("%-10s %6s %12s %12s\n", "path", "batch", "requests", "us/request");
+	const uint32_t batches[] = { 1, 8, 64 };
+	for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+		uint32_t cBatch = batches[b];
+		uint32_t cRounds = (cRequests + cBatch - 1) / cBatch;
+		EncodeBatch(cBatch, &stream);
+
+		// Over the socket and through the owner thread, as the pipe serves
+		// a client.
+		{
+			ControlSocketServer server(&owner, 5000);
+			ControlDecoder decoder;
+			std::vector<ControlMessage> decoded;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (uint32_t r = 0; r < cRounds; r++) {
+				decoded.clear();
+				bPassed &= SendControlStream(server.GetClient(), stream, stream.size()) &&
+					ReceiveControlReplies(server.GetClient(), &decoder, cBatch, &decoded) &&
+					CheckReplies(decoded, cBatch);
+			}
+			printf("%-10s %6u %12u %12.2f\n", "socket", cBatch, cRounds * cBatch, Elapsed(start) / (cRounds * cBatch));
+			server.Stop();
+			bPassed &= server.IsStreamValid();
+		}
+
+		// Through the owner thread without the socket.
+		ControlConnection connection(&owner, 5000);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (uint32_t r = 0; r < cRounds; r++) {
+			replies.clear();
+			bPassed &= connection.OnReceive(stream.data(), stream.size(), &replies) && CheckReplies(replies, cBatch);
+		}
+		printf("%-10s %6u %12u %12.2f\n", "connection", cBatch, cRounds * cBatch, Elapsed(start) / (cRounds * cBatch));
+
+		// The codec and dispatch alone, on one thread.
+		ControlDecoder decoder;
+		start = std::chrono::steady_clock::now();
+		for (uint32_t r = 0; r < cRounds; r++) {
+			replies.clear();
+			bPassed &= dispatcher.OnReceive(&decoder, stream.data(), stream.size(), &replies) &&
+				CheckReplies(replies, cBatch);
+		}
+		printf("%-10s %6u %12u %12.2f\n", "codec", cBatch, cRounds * cBatch, Elapsed(start) / (cRounds * cBatch));
+	}
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+//-------------------------------------------------------------------
+//
+// decode_bench
+//
+// Decodes a Y4M clip to BGRA on 1, 2, 4... threads up to one per core
+// (or --max-threads=N), as --bench-decode does in the app, and prints
+// the frames per second and per core. The clip is --clip=PATH, or a
+// 1080p 4:2:0 one of --frames=N frames it writes first. Fails if the
+// clip cannot be decoded.
+//
+//-------------------------------------------------------------------
+
+#include "SoftwarePlayer.h"
+#include "FileUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const uint32_t DEFAULT_FRAMES = 60;
+static const uint32_t DEFAULT_PASSES = 3;
+static const uint32_t CLIP_WIDTH = 1920;
+static const uint32_t CLIP_HEIGHT = 1080;
+static const char CLIP_PATH[] = "decode_bench.y4m";
+
+// A clip whose frames differ, so no pass decodes the same bytes twice
+// in a row.
+static bool WriteClip(const char* pszPath, uint32_t cFrames)
+{
+	FILE* fp = fopen(pszPath, "wb");
+	if (!fp)
+		return false;
+	fprintf(fp, "YUV4MPEG2 W%u H%u F30:1 Ip A1:1 C420jpeg\n", CLIP_WIDTH, CLIP_HEIGHT);
+	std::vector<uint8_t> frame(CLIP_WIDTH * CLIP_HEIGHT * 3 / 2);
+	bool bOk = true;
+	for (uint32_t n = 0; bOk && n < cFrames; n++) {
+		for (size_t i = 0; i < frame.size(); i++)
+			frame[i] = (uint8_t)(16 + (i * 7 + n * 13) % 224);
+		bOk = fprintf(fp, "FRAME\n") > 0 && fwrite(frame.data(), 1, frame.size(), fp) == frame.size();
+	}
+	return fclose(fp) == 0 && bOk;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t cFrames = DEFAULT_FRAMES;
+	uint32_t cPasses = DEFAULT_PASSES;
+	uint32_t cMaxThreads = std::thread::hardware_concurrency();
+	std::string clip;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--frames=", 9) == 0)
+			cFrames = atoi(argv[i] + 9) > 0 ? atoi(argv[i] + 9) : 1;
+		else if (strncmp(argv[i], "--passes=", 9) == 0)
+			cPasses = atoi(argv[i] + 9) > 0 ? atoi(argv[i] + 9) : 1;
+		else if (strncmp(argv[i], "--max-threads=", 14) == 0)
+			cMaxThreads = (uint32_t)atoi(argv[i] + 14);
+		else if (strncmp(argv[i], "--clip=", 7) == 0)
+			clip = argv[i] + 7;
+		else {
+			fprintf(stderr, "usage: decode_bench [--frames=N] [--passes=N] [--max-threads=N] [--clip=PATH]\n");
+			return 2;
+		}
+	}
+	cMaxThreads = cMaxThreads < 1 ? 1 : cMaxThreads;
+
+	bool bWritten = clip.empty();
+	if (bWritten) {
+		clip = CLIP_PATH;
+		if (!WriteClip(clip.c_str(), cFrames)) {
+			fprintf(stderr, "cannot write %s\n", clip.c_str());
+			return 2;
+		}
+	}
+	std::wstring path = FromUtf8(clip.data(), clip.size());
+
+	bool bPassed = true;
+	printf("%7s %10s %10s %10s %10s\n", "threads", "frames", "seconds", "fps", "fps/core");
+	// 1, 2, 4... and then the maximum.
+	for (uint32_t cThreads = 1;; cThreads = cThreads * 2 < cMaxThreads ? cThreads * 2 : cMaxThreads) {
+		DecodeBenchResult result;
+		if (!RunDecodeBench(path, cThreads, cPasses, &result)) {
+			printf("%s: not a Y4M clip\n", clip.c_str());
+			bPassed = false;
+			break;
+		}
+		printf("%7u %10llu %10.2f %10.1f %10.1f\n", result.cThreads, (unsigned long long)result.cFrames,
+			result.fSeconds, result.fFramesPerSecond, result.fFramesPerSecondPerCore);
+		if (cThreads == cMaxThreads)
+			break;
+	}
+
+	if (bWritten)
+		remove(CLIP_PATH);
+	return bPassed ? 0 : 1;
+}
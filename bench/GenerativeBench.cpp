@@ -0,0 +1,71 @@
+//-------------------------------------------------------------------
+//
+// generative_bench
+//
+// Renders each generative effect headless at 1080p and 4K on 1, 2, 4...
+// threads up to one per core (or --max-threads=N), and prints the
+// ms per frame and the share of tiles rendered per frame. Fails if the
+// last frame differs between thread counts.
+//
+//-------------------------------------------------------------------
+
+#include "GenerativeRenderer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t DEFAULT_FRAMES = 30;
+
+struct BenchSize
+{
+	const char*	pszName;
+	uint32_t	cx;
+	uint32_t	cy;
+};
+
+static const BenchSize s_sizes[] = {
+	{ "1080p", 1920, 1080 },
+	{ "4K", 3840, 2160 },
+};
+
+int main(int argc, char** argv)
+{
+	uint32_t cFrames = DEFAULT_FRAMES;
+	uint32_t cMaxThreads = std::thread::hardware_concurrency();
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--frames=", 9) == 0)
+			cFrames = atoi(argv[i] + 9) > 0 ? atoi(argv[i] + 9) : 1;
+		else if (strncmp(argv[i], "--max-threads=", 14) == 0)
+			cMaxThreads = (uint32_t)atoi(argv[i] + 14);
+		else {
+			fprintf(stderr, "usage: generative_bench [--frames=N] [--max-threads=N]\n");
+			return 2;
+		}
+	}
+	cMaxThreads = cMaxThreads < 1 ? 1 : cMaxThreads > GENERATIVE_MAX_THREADS ? GENERATIVE_MAX_THREADS : cMaxThreads;
+
+	printf("%-10s %-6s %7s %11s %8s  (%s kernels, %u frames at %u fps)\n", "effect", "size", "threads", "ms/frame",
+		"tiles", GetKernelIsaName(GetKernelIsa()), cFrames, GENERATIVE_DEFAULT_FPS);
+	bool bPassed = true;
+	for (int e = 0; e < GENERATIVE_EFFECT_COUNT; e++) {
+		for (size_t s = 0; s < sizeof(s_sizes) / sizeof(s_sizes[0]); s++) {
+			// 1, 2, 4... and then the maximum.
+			uint64_t nChecksum = 0;
+			for (uint32_t cThreads = 1;; cThreads = cThreads * 2 < cMaxThreads ? cThreads * 2 : cMaxThreads) {
+				GenerativeBenchResult result;
+				if (!RunGenerativeBench((GENERATIVE_EFFECT)e, s_sizes[s].cx, s_sizes[s].cy, cThreads, cFrames, &result)) {
+					bPassed = false;
+					break;
+				}
+				bool bSame = cThreads == 1 || result.nChecksum == nChecksum;
+				nChecksum = result.nChecksum;
+				bPassed &= bSame;
+				printf("%-10s %-6s %7u %11.2f %7.1f%%%s\n", GetGenerativeEffectName(result.effect), s_sizes[s].pszName,
+					result.cThreads, result.fFrameMs, result.fDirtyShare * 100, bSame ? "" : "  MISMATCH");
+				if (cThreads == cMaxThreads)
+					break;
+			}
+		}
+	}
+	return bPassed ? 0 : 1;
+}
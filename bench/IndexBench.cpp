@@ -0,0 +1,229 @@
+//-------------------------------------------------------------------
+//
+// index_bench
+//
+// Times the container index of an MP4 clip: building it from the
+// sample tables, saving it, mapping it back and looking up keyframes
+// at random times in the mapping. The clip is --clip=PATH, or one it
+// writes first: sample tables of --frames=N frames at 30 fps with a
+// keyframe every 2 seconds and a composition offset on every frame, as
+// an encoder using B-frames writes, over dummy media data.
+//
+// Fails if the index does not map back, or if a lookup in it does not
+// return the last keyframe at or before the time; for the written clip
+// also if a keyframe is not where it was written.
+//
+//-------------------------------------------------------------------
+
+#include "ContainerIndex.h"
+#include "Mp4Writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const uint32_t DEFAULT_FRAMES = 216000;		// 2 hours
+static const uint32_t DEFAULT_LOOKUPS = 1000000;
+static const uint32_t CHECKED_LOOKUPS = 10000;
+static const uint32_t CLIP_TIMESCALE = 30000;
+static const uint32_t CLIP_FRAME_TICKS = 1000;		// 30 fps
+static const uint32_t CLIP_OFFSET_TICKS = 2000;		// Composition offset of every frame
+static const uint32_t CLIP_GOP = 60;
+static const uint32_t CLIP_KEYFRAME_BYTES = 64;
+static const uint32_t CLIP_FRAME_BYTES = 16;
+static const char CLIP_PATH[] = "index_bench.mp4";
+
+static uint32_t GetSampleSize(uint32_t nFrame)
+{
+	return nFrame % CLIP_GOP ? CLIP_FRAME_BYTES : CLIP_KEYFRAME_BYTES;
+}
+
+// ftyp, then mdat with a chunk per GOP, then the moov with the tables
+// of one video track.
+static bool WriteClip(const char* pszPath, uint32_t cFrames)
+{
+	std::vector<uint8_t> head;
+	size_t nBox = BeginBox(&head, "ftyp");
+	head.insert(head.end(), "isom", "isom" + 4);
+	PutBE32(&head, 0x200);
+	head.insert(head.end(), "isomavc1", "isomavc1" + 8);
+	EndBox(&head, nBox);
+	uint64_t cbData = 0;
+	for (uint32_t n = 0; n < cFrames; n++)
+		cbData += GetSampleSize(n);
+	PutBE32(&head, (uint32_t)(8 + cbData));
+	head.insert(head.end(), "mdat", "mdat" + 4);
+
+	std::vector<uint8_t> moov;
+	size_t nMoov = BeginBox(&moov, "moov");
+	size_t nTrak = BeginBox(&moov, "trak");
+	size_t nMdia = BeginBox(&moov, "mdia");
+	nBox = BeginBox(&moov, "mdhd", true);
+	PutBE32(&moov, 0);
+	PutBE32(&moov, 0);
+	PutBE32(&moov, CLIP_TIMESCALE);
+	PutBE32(&moov, cFrames * CLIP_FRAME_TICKS);
+	PutBE32(&moov, 0x55C40000);		// Language und
+	EndBox(&moov, nBox);
+	nBox = BeginBox(&moov, "hdlr", true);
+	PutBE32(&moov, 0);
+	moov.insert(moov.end(), "vide", "vide" + 4);
+	for (int i = 0; i < 4; i++)
+		PutBE32(&moov, 0);
+	EndBox(&moov, nBox);
+	size_t nMinf = BeginBox(&moov, "minf");
+	size_t nStbl = BeginBox(&moov, "stbl");
+
+	nBox = BeginBox(&moov, "stts", true);
+	PutBE32(&moov, 1);
+	PutBE32(&moov, cFrames);
+	PutBE32(&moov, CLIP_FRAME_TICKS);
+	EndBox(&moov, nBox);
+	nBox = BeginBox(&moov, "ctts", true);
+	PutBE32(&moov, 1);
+	PutBE32(&moov, cFrames);
+	PutBE32(&moov, CLIP_OFFSET_TICKS);
+	EndBox(&moov, nBox);
+	uint32_t cGops = (cFrames + CLIP_GOP - 1) / CLIP_GOP;
+	nBox = BeginBox(&moov, "stss", true);
+	PutBE32(&moov, cGops);
+	for (uint32_t g = 0; g < cGops; g++)
+		PutBE32(&moov, g * CLIP_GOP + 1);
+	EndBox(&moov, nBox);
+	nBox = BeginBox(&moov, "stsz", true);
+	PutBE32(&moov, 0);
+	PutBE32(&moov, cFrames);
+	for (uint32_t n = 0; n < cFrames; n++)
+		PutBE32(&moov, GetSampleSize(n));
+	EndBox(&moov, nBox);
+	nBox = BeginBox(&moov, "stsc", true);
+	PutBE32(&moov, cFrames % CLIP_GOP ? 2 : 1);
+	PutBE32(&moov, 1);
+	PutBE32(&moov, CLIP_GOP);
+	PutBE32(&moov, 1);
+	if (cFrames % CLIP_GOP) {
+		PutBE32(&moov, cGops);
+		PutBE32(&moov, cFrames % CLIP_GOP);
+		PutBE32(&moov, 1);
+	}
+	EndBox(&moov, nBox);
+	nBox = BeginBox(&moov, "stco", true);
+	PutBE32(&moov, cGops);
+	uint64_t nOffset = head.size();
+	for (uint32_t n = 0; n < cFrames; n++) {
+		if (n % CLIP_GOP == 0)
+			PutBE32(&moov, (uint32_t)nOffset);
+		nOffset += GetSampleSize(n);
+	}
+	EndBox(&moov, nBox);
+
+	EndBox(&moov, nStbl);
+	EndBox(&moov, nMinf);
+	EndBox(&moov, nMdia);
+	EndBox(&moov, nTrak);
+	EndBox(&moov, nMoov);
+
+	FILE* fp = fopen(pszPath, "wb");
+	if (!fp)
+		return false;
+	bool bOk = fwrite(head.data(), 1, head.size(), fp) == head.size();
+	std::vector<uint8_t> data(CLIP_GOP * CLIP_KEYFRAME_BYTES, 0);
+	for (uint64_t cbLeft = cbData; bOk && cbLeft > 0;) {
+		size_t cb = cbLeft < data.size() ? (size_t)cbLeft : data.size();
+		bOk = fwrite(data.data(), 1, cb, fp) == cb;
+		cbLeft -= cb;
+	}
+	bOk = bOk && fwrite(moov.data(), 1, moov.size(), fp) == moov.size();
+	return fclose(fp) == 0 && bOk;
+}
+
+static HNSTIME GetKeyframeTime(uint32_t nGop)
+{
+	return ((HNSTIME)nGop * CLIP_GOP * CLIP_FRAME_TICKS + CLIP_OFFSET_TICKS) * HNS_PER_SECOND / CLIP_TIMESCALE;
+}
+
+// Maps the saved index again and checks lookups at times of their own,
+// and, for the written clip, every keyframe.
+static bool CheckIndex(const std::wstring& source, const std::wstring& indexPath, bool bWritten, uint32_t cFrames)
+{
+	FileInfo info;
+	ContainerIndex index;
+	if (!GetFileInfo(source, &info) || !index.Map(indexPath, info) || index.IsEmpty())
+		return false;
+	bool bPassed = true;
+	size_t cKeyframes = index.GetKeyframeCount();
+	uint64_t nState = 1;
+	for (uint32_t i = 0; i < CHECKED_LOOKUPS; i++) {
+		nState = nState * 6364136223846793005ull + 1442695040888963407ull;
+		HNSTIME hnsTime = (HNSTIME)((nState >> 11) % (uint64_t)(index.GetDuration() + 1));
+		size_t nFound = index.FindKeyframe(hnsTime);
+		bPassed &= nFound < cKeyframes && (index.GetKeyframe(nFound).hnsTime <= hnsTime || nFound == 0) &&
+			(nFound + 1 == cKeyframes || index.GetKeyframe(nFound + 1).hnsTime > hnsTime);
+	}
+	if (!bWritten)
+		return bPassed;
+
+	uint32_t cGops = (cFrames + CLIP_GOP - 1) / CLIP_GOP;
+	bPassed &= index.GetFrameCount() == cFrames && cKeyframes == cGops && index.StartsWithKeyframe();
+	uint64_t nOffset = 0;
+	for (uint32_t g = 0; bPassed && g < cGops; g++) {
+		const IndexKeyframe& keyframe = index.GetKeyframe(g);
+		uint32_t cGopFrames = g + 1 < cGops || cFrames % CLIP_GOP == 0 ? CLIP_GOP : cFrames % CLIP_GOP;
+		uint64_t cbGop = CLIP_KEYFRAME_BYTES + (uint64_t)(cGopFrames - 1) * CLIP_FRAME_BYTES;
+		bPassed &= keyframe.hnsTime == GetKeyframeTime(g) && keyframe.nFrame == g * CLIP_GOP &&
+			keyframe.cFrames == cGopFrames && keyframe.nEndOffset - keyframe.nOffset == cbGop &&
+			(g == 0 || keyframe.nOffset == nOffset);
+		nOffset = keyframe.nEndOffset;
+	}
+	return bPassed;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t cFrames = DEFAULT_FRAMES;
+	uint32_t cLookups = DEFAULT_LOOKUPS;
+	std::string clip;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--frames=", 9) == 0)
+			cFrames = atoi(argv[i] + 9) > 0 ? atoi(argv[i] + 9) : 1;
+		else if (strncmp(argv[i], "--lookups=", 10) == 0)
+			cLookups = atoi(argv[i] + 10) > 0 ? atoi(argv[i] + 10) : 1;
+		else if (strncmp(argv[i], "--clip=", 7) == 0)
+			clip = argv[i] + 7;
+		else {
+			fprintf(stderr, "usage: index_bench [--frames=N] [--lookups=N] [--clip=PATH]\n");
+			return 2;
+		}
+	}
+
+	bool bWritten = clip.empty();
+	if (bWritten) {
+		clip = CLIP_PATH;
+		if (!WriteClip(clip.c_str(), cFrames)) {
+			fprintf(stderr, "cannot write %s\n", clip.c_str());
+			return 2;
+		}
+	}
+	std::wstring source = FromUtf8(clip.data(), clip.size());
+	std::wstring indexPath = ContainerIndex::GetIndexPath(L".", source);
+
+	IndexBenchResult result;
+	bool bPassed = RunIndexBench(source, indexPath, cLookups, &result);
+	if (!bPassed)
+		printf("%s: no MP4 sample tables to index\n", clip.c_str());
+	else {
+		printf("%10s %10s %10s %10s %10s %10s\n", "frames", "keyframes", "build ms", "save ms", "map ms",
+			"lookup ns");
+		printf("%10u %10u %10.2f %10.2f %10.3f %10.1f\n", result.cFrames, (unsigned)result.cKeyframes,
+			result.fBuildMs, result.fSaveMs, result.fMapMs, result.fLookupNs);
+		bPassed = result.bMapped && CheckIndex(source, indexPath, bWritten, cFrames);
+		if (!bPassed)
+			printf("index does not map back or finds the wrong keyframes\n");
+	}
+
+	RemoveFile(indexPath);
+	if (bWritten)
+		RemoveFile(source);
+	return bPassed ? 0 : 1;
+}
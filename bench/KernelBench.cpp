@@ -0,0 +1,50 @@
+//-------------------------------------------------------------------
+//
+// kernel_bench
+//
+// Runs the pixel kernels (color conversion, scaling, blending and the
+// plasma effect) on every instruction set this CPU has (scalar, SSE2, AVX2)
+// over a --width=N x --height=N synthetic picture, 1080p by default,
+// --passes=N times, and prints the output Mpixel/s of each, as
+// --bench-kernels does in the app. Fails if a SIMD kernel's output
+// differs from the scalar kernel's.
+//
+//-------------------------------------------------------------------
+
+#include "ColorKernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t DEFAULT_WIDTH = 1920;
+static const uint32_t DEFAULT_HEIGHT = 1080;
+static const uint32_t DEFAULT_PASSES = 20;
+
+int main(int argc, char** argv)
+{
+	uint32_t cx = DEFAULT_WIDTH, cy = DEFAULT_HEIGHT;
+	uint32_t cPasses = DEFAULT_PASSES;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--width=", 8) == 0)
+			cx = atoi(argv[i] + 8) > 0 ? atoi(argv[i] + 8) : 2;
+		else if (strncmp(argv[i], "--height=", 9) == 0)
+			cy = atoi(argv[i] + 9) > 0 ? atoi(argv[i] + 9) : 2;
+		else if (strncmp(argv[i], "--passes=", 9) == 0)
+			cPasses = atoi(argv[i] + 9) > 0 ? atoi(argv[i] + 9) : 1;
+		else {
+			fprintf(stderr, "usage: kernel_bench [--width=N] [--height=N] [--passes=N]\n");
+			return 2;
+		}
+	}
+
+	KernelBenchResult results[KERNEL_ISA_COUNT * 8];
+	size_t cResults = RunKernelBench(cx, cy, cPasses, results, sizeof(results) / sizeof(results[0]));
+	bool bPassed = cResults > 0;
+	printf("%-16s %-7s %12s  (%ux%u, %u passes)\n", "kernel", "isa", "Mpixel/s", cx, cy, cPasses);
+	for (size_t i = 0; i < cResults; i++) {
+		bPassed &= results[i].bExact;
+		printf("%-16s %-7s %12.1f%s\n", results[i].pszKernel, GetKernelIsaName(results[i].isa),
+			results[i].fMegapixelsPerSecond, results[i].bExact ? "" : "  MISMATCH");
+	}
+	return bPassed ? 0 : 1;
+}
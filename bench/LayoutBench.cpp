@@ -0,0 +1,133 @@
+//-------------------------------------------------------------------
+//
+// layout_bench
+//
+// Times the re-layout the app runs when a display is plugged in or
+// removed. For each count of 1 to --monitors=N (8) monitors, a hot-plug
+// sequence plugs monitors into a row one at a time, up to that count,
+// and unplugs them again, solving the layout of a 1080p clip after each
+// step. The row mixes 1080p, 1440p at 150% and portrait monitors. Runs
+// each sequence --passes=N times in span, physical span and clone layout
+// and prints the us per re-layout of each.
+//
+// Fails if a layout does not solve, or does not give every monitor one
+// viewport inside its rectangle.
+//
+//-------------------------------------------------------------------
+
+#include "MonitorLayout.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+static const uint32_t DEFAULT_MONITORS = 8;
+static const uint32_t DEFAULT_PASSES = 2000;
+static const LAYOUT_MODE LAYOUTS[] = { LAYOUT_SPAN, LAYOUT_SPAN_PHYSICAL, LAYOUT_CLONE };
+
+// Monitor n of the row, top-aligned right of monitor n - 1.
+static MonitorDesc MakeMonitor(uint32_t n, int32_t left)
+{
+	MonitorDesc monitor;
+	int32_t cx = 1920, cy = 1080;
+	monitor.nDpi = 96;
+	if (n % 3 == 1) {
+		cx = 2560;
+		cy = 1440;
+		monitor.nDpi = 144;
+	}
+	else if (n % 3 == 2) {
+		cx = 1080;
+		cy = 1920;
+	}
+	monitor.rcMonitor.left = left;
+	monitor.rcMonitor.top = 0;
+	monitor.rcMonitor.right = left + cx;
+	monitor.rcMonitor.bottom = cy;
+	return monitor;
+}
+
+// Fill covers every monitor in each layout, so each gets one viewport,
+// in order.
+static bool CheckViewports(const MonitorDesc* pMonitors, size_t cMonitors, const std::vector<Viewport>& viewports)
+{
+	if (viewports.size() != cMonitors)
+		return false;
+	for (size_t i = 0; i < cMonitors; i++) {
+		const LayoutRect& rcDest = viewports[i].rcDest;
+		const LayoutRect& rcMonitor = pMonitors[i].rcMonitor;
+		if (viewports[i].nMonitor != i || rcDest.left < rcMonitor.left || rcDest.top < rcMonitor.top ||
+			rcDest.right > rcMonitor.right || rcDest.bottom > rcMonitor.bottom)
+			return false;
+	}
+	return true;
+}
+
+// Runs the sequence up to cMonitors cPasses times and returns the us per
+// re-layout, or a negative value if a layout is wrong.
+static double RunSequence(LAYOUT_MODE layout, const std::vector<MonitorDesc>& row, size_t cMonitors, uint32_t cPasses,
+	uint32_t* pcLayouts)
+{
+	LayoutParams params;
+	params.cxSource = 1920;
+	params.cySource = 1080;
+	params.layout = layout;
+	params.scale = SCALE_FILL;
+
+	std::vector<size_t> steps;
+	for (size_t c = 1; c <= cMonitors; c++)
+		steps.push_back(c);
+	for (size_t c = cMonitors - 1; c >= 1; c--)
+		steps.push_back(c);
+	*pcLayouts = (uint32_t)steps.size();
+
+	std::vector<Viewport> viewports;
+	bool bPassed = true;
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t p = 0; p < cPasses; p++) {
+		for (size_t s = 0; s < steps.size(); s++)
+			bPassed &= SolveMonitorLayout(params, row.data(), steps[s], &viewports) &&
+				(p > 0 || CheckViewports(row.data(), steps[s], viewports));
+	}
+	double fSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return bPassed ? fSeconds * 1e6 / ((double)cPasses * steps.size()) : -1.0;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t cMonitors = DEFAULT_MONITORS;
+	uint32_t cPasses = DEFAULT_PASSES;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--monitors=", 11) == 0)
+			cMonitors = atoi(argv[i] + 11) > 0 ? atoi(argv[i] + 11) : 1;
+		else if (strncmp(argv[i], "--passes=", 9) == 0)
+			cPasses = atoi(argv[i] + 9) > 0 ? atoi(argv[i] + 9) : 1;
+		else {
+			fprintf(stderr, "usage: layout_bench [--monitors=N] [--passes=N]\n");
+			return 2;
+		}
+	}
+
+	std::vector<MonitorDesc> row;
+	int32_t left = 0;
+	for (uint32_t n = 0; n < cMonitors; n++) {
+		row.push_back(MakeMonitor(n, left));
+		left = row.back().rcMonitor.right;
+	}
+
+	bool bPassed = true;
+	printf("%-9s %10s %10s %10s %10s\n", "monitors", "layouts", "span us", "phys us", "clone us");
+	for (size_t c = 1; c <= cMonitors; c++) {
+		uint32_t cLayouts = 0;
+		double fUs[sizeof(LAYOUTS) / sizeof(LAYOUTS[0])];
+		for (size_t l = 0; l < sizeof(LAYOUTS) / sizeof(LAYOUTS[0]); l++) {
+			fUs[l] = RunSequence(LAYOUTS[l], row, c, cPasses, &cLayouts);
+			bPassed &= fUs[l] >= 0.0;
+		}
+		printf("%-9zu %10u %10.3f %10.3f %10.3f\n", c, cLayouts, fUs[0], fUs[1], fUs[2]);
+	}
+	if (!bPassed)
+		printf("a layout did not solve or did not give each monitor a viewport inside it\n");
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+//-------------------------------------------------------------------
+//
+// quality_sim
+//
+// Replays load traces through the quality controller on QualityModel's
+// simulated machine, as --simulate-quality does in the app: the
+// built-in traces, or --trace=PATH of "SECONDS LOAD" lines with its
+// timeline of rungs. Prints the CPU and the dropped and late frames of
+// adapting against holding the top rung, on the ladder of clips played
+// from the transcode cache with --prescaled. Fails if adapting drops
+// more frames than holding the top rung.
+//
+// The results depend on the model only, so they are the same on every
+// machine.
+//
+//-------------------------------------------------------------------
+
+#include "QualitySimulator.h"
+#include "FileUtil.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+int main(int argc, char** argv)
+{
+	bool bPrescaled = false;
+	std::string tracePath;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--trace=", 8) == 0)
+			tracePath = argv[i] + 8;
+		else if (strcmp(argv[i], "--prescaled") == 0)
+			bPrescaled = true;
+		else {
+			fprintf(stderr, "usage: quality_sim [--trace=PATH] [--prescaled]\n");
+			return 2;
+		}
+	}
+
+	std::vector<LoadTrace> traces;
+	if (tracePath.empty())
+		traces = GetBuiltInLoadTraces();
+	else {
+		LoadTrace trace;
+		if (!LoadLoadTrace(FromUtf8(tracePath.data(), tracePath.size()), &trace)) {
+			fprintf(stderr, "load trace not readable: %s\n", tracePath.c_str());
+			return 2;
+		}
+		traces.push_back(trace);
+	}
+
+	QualityConfig config;
+	config.rungs = GetDefaultQualityLadder(bPrescaled);
+	QualitySimulator simulator(config, QualityModel());
+	bool bPassed = true;
+	for (size_t i = 0; i < traces.size(); i++) {
+		printf("%s", simulator.Report(traces[i], !tracePath.empty()).c_str());
+		QualitySimResult adaptive = simulator.Run(traces[i], false, NULL);
+		QualitySimResult fixed = simulator.Run(traces[i], true, NULL);
+		if (adaptive.fDropped > fixed.fDropped) {
+			printf("%s: adapting drops more frames than the top rung\n", traces[i].name.c_str());
+			bPassed = false;
+		}
+	}
+	return bPassed ? 0 : 1;
+}
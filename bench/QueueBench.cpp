@@ -0,0 +1,54 @@
+//-------------------------------------------------------------------
+//
+// queue_bench
+//
+// Pushes player-sized event records from 1, 2, 4... producer threads up
+// to one per core (or --max-producers=N) to one consumer, through the
+// lock-free EventQueue and through a deque behind a mutex, each for
+// --ms=N of wall-clock time, and prints the events per second of both.
+// Fails if a record was lost or arrived out of order.
+//
+//-------------------------------------------------------------------
+
+#include "EventQueue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+static const uint32_t DEFAULT_MS = 1000;
+
+int main(int argc, char** argv)
+{
+	uint32_t nMs = DEFAULT_MS;
+	uint32_t cMaxProducers = std::thread::hardware_concurrency();
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--ms=", 5) == 0)
+			nMs = atoi(argv[i] + 5) > 0 ? atoi(argv[i] + 5) : 1;
+		else if (strncmp(argv[i], "--max-producers=", 16) == 0)
+			cMaxProducers = (uint32_t)atoi(argv[i] + 16);
+		else {
+			fprintf(stderr, "usage: queue_bench [--ms=N] [--max-producers=N]\n");
+			return 2;
+		}
+	}
+	cMaxProducers = cMaxProducers < 1 ? 1 : cMaxProducers;
+
+	printf("%9s %14s %14s %12s %6s\n", "producers", "M events/s", "mutex M/s", "queue full", "lost");
+	bool bPassed = true;
+	// 1, 2, 4... and then the maximum.
+	for (uint32_t cProducers = 1;; cProducers = cProducers * 2 < cMaxProducers ? cProducers * 2 : cMaxProducers) {
+		EventQueueBenchResult result;
+		if (!RunEventQueueBench(cProducers, (HNSTIME)nMs * HNS_PER_MSEC, &result)) {
+			bPassed = false;
+			break;
+		}
+		bPassed &= result.cLost == 0;
+		printf("%9u %14.1f %14.1f %12llu %6llu\n", result.cProducers, result.fQueueEventsPerSecond / 1e6,
+			result.fMutexEventsPerSecond / 1e6, (unsigned long long)result.cQueueFull,
+			(unsigned long long)result.cLost);
+		if (cProducers == cMaxProducers)
+			break;
+	}
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,265 @@
+//-------------------------------------------------------------------
+//
+// ring_bench
+//
+// Publishes --width=N x --height=N frames at --fps=N through a frame
+// ring in named shared memory, as the broker does, to 1, 2, 4... reader
+// processes (up to --max-readers=N) forked from the bench, each count
+// for --ms=N of wall-clock time. A reader opens the ring by name and
+// presents every frame it can: it reads each pixel of the newest frame
+// out of the ring, paced by the frames' due times as the session's
+// player is. Prints the frames per second the writer published and each
+// reader presented, the frames readers skipped and the reads they lost
+// to the writer, and the private bytes of a reader process, which the
+// frames, kept in the shared ring, do not add to.
+//
+// Fails if a reader accepts a frame mixing two publishes, or if a reader
+// cannot attach.
+//
+// Linux only: the private bytes come from /proc/self/smaps_rollup.
+//
+//-------------------------------------------------------------------
+
+#include "FrameRing.h"
+#include "FileUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const uint32_t DEFAULT_MS = 3000;
+static const uint32_t DEFAULT_MAX_READERS = 16;
+static const uint32_t DEFAULT_WIDTH = 1920;
+static const uint32_t DEFAULT_HEIGHT = 1080;
+static const uint32_t DEFAULT_FPS = 60;
+static const uint32_t RING_SLOTS = 3;
+
+// What a reader process sends back through its pipe when the writer
+// lets go of the ring.
+struct ReaderResult
+{
+	bool		bAttached;
+	uint64_t	cFrames;
+	uint64_t	cSkipped;
+	uint64_t	cTorn;
+	uint64_t	cMixed;			// Frames accepted that mixed two publishes
+	uint64_t	cbPrivate;
+	double		fSeconds;		// From the first frame to the last
+};
+
+// Private_Clean + Private_Dirty of the process: the pages no other
+// process maps. 0 where smaps_rollup is missing.
+static uint64_t GetPrivateBytes()
+{
+	FILE* fp = fopen("/proc/self/smaps_rollup", "r");
+	if (!fp)
+		return 0;
+	uint64_t cbPrivate = 0;
+	char szLine[256];
+	while (fgets(szLine, sizeof(szLine), fp)) {
+		unsigned long long cKb;
+		if (sscanf(szLine, "Private_Clean: %llu kB", &cKb) == 1 || sscanf(szLine, "Private_Dirty: %llu kB", &cKb) == 1)
+			cbPrivate += cKb * 1024;
+	}
+	fclose(fp);
+	return cbPrivate;
+}
+
+// Every pixel of frame n holds n; a frame mixing two publishes does not
+// sum to its number times its pixels. Summing reads the whole frame, as
+// scaling it to the screen would.
+static bool IsWhole(const RingFrame& frame)
+{
+	uint64_t nSum = 0;
+	for (uint32_t y = 0; y < frame.cy; y++) {
+		const uint32_t* pRow = (const uint32_t*)(frame.pData + y * frame.cbStride);
+		for (uint32_t x = 0; x < frame.cx; x++)
+			nSum += pRow[x];
+	}
+	return nSum == (uint64_t)(uint32_t)frame.nFrame * frame.cx * frame.cy;
+}
+
+static void RunReader(const std::wstring& name, uint32_t nReaderId, int fd)
+{
+	ReaderResult result = ReaderResult();
+	SharedMemory memory;
+	FrameRingReader reader;
+	result.bAttached = memory.Open(name) && reader.Attach(memory.GetData(), memory.GetSize(), nReaderId);
+	HNSTIME hnsFirst = 0, hnsLast = 0;
+	while (result.bAttached && reader.IsWriterAlive()) {
+		HNSTIME hnsNow = GetRingTime();
+		HNSTIME hnsDue = reader.GetNextDue();
+		if (hnsDue > hnsNow) {
+			std::this_thread::sleep_for(std::chrono::microseconds((hnsDue - hnsNow) / 10));
+			continue;
+		}
+		RingFrame frame;
+		if (!reader.BeginRead(&frame)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		bool bWhole = IsWhole(frame);
+		if (reader.EndRead(frame)) {
+			result.cMixed += !bWhole;
+			hnsLast = GetRingTime();
+			hnsFirst = hnsFirst ? hnsFirst : hnsLast;
+		}
+		reader.Heartbeat();
+	}
+	FrameRingReaderStats stats = reader.GetStats();
+	result.cFrames = stats.cFrames;
+	result.cSkipped = stats.cSkipped;
+	result.cTorn = stats.cTorn;
+	result.cbPrivate = GetPrivateBytes();
+	result.fSeconds = (double)(hnsLast - hnsFirst) / HNS_PER_SECOND;
+	_exit(write(fd, &result, sizeof(result)) == (ssize_t)sizeof(result) ? 0 : 1);
+}
+
+struct RingBenchRun
+{
+	double		fWriterFps;
+	double		fReaderFps;		// Mean over the readers
+	uint64_t	cSkipped;		// All readers together
+	uint64_t	cTorn;
+	uint64_t	cMixed;
+	uint64_t	cbPrivate;		// Mean over the readers
+	uint32_t	cAttached;
+};
+
+static bool RunRing(const FrameRingConfig& config, uint32_t nFps, uint32_t cReaders, uint32_t nMs,
+	RingBenchRun* pRun)
+{
+	std::string clip = "ring_bench/" + std::to_string(getpid());
+	std::wstring name = GetFrameRingName(FromUtf8(clip.data(), clip.size()));
+	SharedMemory memory;
+	FrameRingWriter writer;
+	if (!memory.Create(name, GetFrameRingSize(config)) ||
+		!writer.Attach(memory.GetData(), memory.GetSize(), config, 1))
+		return false;
+
+	std::vector<pid_t> pids;
+	std::vector<int> fds;
+	for (uint32_t i = 0; i < cReaders; i++) {
+		int pipes[2];
+		if (pipe(pipes) != 0)
+			break;
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(pipes[0]);
+			RunReader(name, 100 + i, pipes[1]);
+		}
+		close(pipes[1]);
+		if (pid < 0) {
+			close(pipes[0]);
+			break;
+		}
+		pids.push_back(pid);
+		fds.push_back(pipes[0]);
+	}
+
+	// Paced to the frame rate, catching up after a late frame.
+	HNSTIME hnsFrame = HNS_PER_SECOND / nFps;
+	HNSTIME hnsStart = GetRingTime();
+	HNSTIME hnsEnd = hnsStart + (HNSTIME)nMs * HNS_PER_MSEC;
+	bool bPassed = true;
+	for (uint64_t n = 0; bPassed; n++) {
+		HNSTIME hnsDue = hnsStart + (HNSTIME)n * hnsFrame;
+		HNSTIME hnsNow = GetRingTime();
+		if (hnsDue >= hnsEnd)
+			break;
+		if (hnsDue > hnsNow)
+			std::this_thread::sleep_for(std::chrono::microseconds((hnsDue - hnsNow) / 10));
+		size_t cbStride;
+		uint8_t* pData = writer.BeginFrame(&cbStride);
+		if (!pData) {
+			bPassed = false;
+			break;
+		}
+		uint32_t nValue = (uint32_t)(writer.GetPublishedCount() + 1);
+		for (uint32_t y = 0; y < config.cyMax; y++) {
+			uint32_t* pRow = (uint32_t*)(pData + y * cbStride);
+			for (uint32_t x = 0; x < config.cxMax; x++)
+				pRow[x] = nValue;
+		}
+		bPassed = writer.EndFrame(config.cxMax, config.cyMax, (HNSTIME)n * hnsFrame, hnsFrame);
+	}
+	double fSeconds = (double)(GetRingTime() - hnsStart) / HNS_PER_SECOND;
+	*pRun = RingBenchRun();
+	pRun->fWriterFps = writer.GetPublishedCount() / fSeconds;
+	writer.Detach();
+
+	for (size_t i = 0; i < pids.size(); i++) {
+		ReaderResult result;
+		int nStatus = 0;
+		bool bRead = read(fds[i], &result, sizeof(result)) == (ssize_t)sizeof(result);
+		close(fds[i]);
+		if (waitpid(pids[i], &nStatus, 0) != pids[i] || !bRead || !result.bAttached)
+			continue;
+		pRun->cAttached++;
+		pRun->fReaderFps += result.fSeconds > 0.0 ? (result.cFrames - 1) / result.fSeconds : 0.0;
+		pRun->cSkipped += result.cSkipped;
+		pRun->cTorn += result.cTorn;
+		pRun->cMixed += result.cMixed;
+		pRun->cbPrivate += result.cbPrivate;
+	}
+	if (pRun->cAttached) {
+		pRun->fReaderFps /= pRun->cAttached;
+		pRun->cbPrivate /= pRun->cAttached;
+	}
+	return bPassed && pRun->cAttached == cReaders;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t nMs = DEFAULT_MS;
+	uint32_t cMaxReaders = DEFAULT_MAX_READERS;
+	FrameRingConfig config = { RING_SLOTS, DEFAULT_WIDTH, DEFAULT_HEIGHT };
+	uint32_t nFps = DEFAULT_FPS;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--ms=", 5) == 0)
+			nMs = atoi(argv[i] + 5) > 0 ? atoi(argv[i] + 5) : 1;
+		else if (strncmp(argv[i], "--max-readers=", 14) == 0)
+			cMaxReaders = atoi(argv[i] + 14) > 0 ? atoi(argv[i] + 14) : 1;
+		else if (strncmp(argv[i], "--width=", 8) == 0)
+			config.cxMax = atoi(argv[i] + 8) > 0 ? atoi(argv[i] + 8) : 1;
+		else if (strncmp(argv[i], "--height=", 9) == 0)
+			config.cyMax = atoi(argv[i] + 9) > 0 ? atoi(argv[i] + 9) : 1;
+		else if (strncmp(argv[i], "--fps=", 6) == 0)
+			nFps = atoi(argv[i] + 6) > 0 ? atoi(argv[i] + 6) : 1;
+		else {
+			fprintf(stderr, "usage: ring_bench [--ms=N] [--max-readers=N] [--width=N] [--height=N] [--fps=N]\n");
+			return 2;
+		}
+	}
+	cMaxReaders = cMaxReaders < MAX_RING_READERS ? cMaxReaders : MAX_RING_READERS;
+
+	printf("%ux%u at %u fps, %u slots: %.1f MB of shared memory\n", config.cxMax, config.cyMax, nFps,
+		config.cSlots, GetFrameRingSize(config) / 1048576.0);
+	printf("%7s %11s %11s %9s %7s %12s\n", "readers", "writer fps", "reader fps", "skipped", "torn",
+		"private KB");
+	bool bPassed = true;
+	// 1, 2, 4... and then the maximum.
+	for (uint32_t cReaders = 1;; cReaders = cReaders * 2 < cMaxReaders ? cReaders * 2 : cMaxReaders) {
+		RingBenchRun run;
+		if (!RunRing(config, nFps, cReaders, nMs, &run)) {
+			printf("%7u readers: a reader did not attach or the writer lost the ring\n", cReaders);
+			bPassed = false;
+			break;
+		}
+		printf("%7u %11.1f %11.1f %9llu %7llu %12.0f\n", cReaders, run.fWriterFps, run.fReaderFps,
+			(unsigned long long)run.cSkipped, (unsigned long long)run.cTorn, run.cbPrivate / 1024.0);
+		if (run.cMixed) {
+			printf("%7u readers: %llu frames accepted that mixed two publishes\n", cReaders,
+				(unsigned long long)run.cMixed);
+			bPassed = false;
+		}
+		if (cReaders == cMaxReaders)
+			break;
+	}
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,267 @@
+//-------------------------------------------------------------------
+//
+// session_bench
+//
+// Replays the built-in playback sessions through SessionSimulator and
+// reports, per simulated hour, the wakeups of the app's thread, the
+// heap allocations and the CPU time the playback logic took. With
+// --baseline=PATH it fails if the wakeups or allocations regressed past
+// the tolerance stored with the baseline; --write-baseline=PATH stores
+// the results.
+//
+// Wakeups and allocations are deterministic. CPU time depends on the
+// machine, the build and its load, so it is the least of several runs
+// and only reported; --gate-cpu fails on it too, against a baseline
+// written by the same build on the same machine.
+//
+//-------------------------------------------------------------------
+
+#include "SessionSimulator.h"
+#include "CountingAllocator.h"
+#include "JsonReader.h"
+#include "FileUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+static const int DEFAULT_RUNS = 5;		// Timed batches of each session; the fastest counts
+static const double MIN_BATCH_SECONDS = 0.02;	// A batch repeats a session for at least this long
+
+struct SessionCost
+{
+	std::string	name;
+	double		fWakeups;		// Per simulated hour
+	double		fAllocations;
+	double		fKilobytes;		// Allocated
+	double		fCpuMs;
+};
+
+struct Tolerance
+{
+	double		fWakeups;		// Allowed growth, 0.1 = 10%
+	double		fAllocations;
+	double		fCpu;
+	double		fCpuSlackMs;	// Allowed on top, for the clock's resolution
+
+	Tolerance() : fWakeups(0.02), fAllocations(0.10), fCpu(2.0), fCpuSlackMs(0.01)
+	{
+	}
+};
+
+static double GetCpuSeconds()
+{
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+//-----------------------------------------------------------------------------
+// MeasureSession
+//-----------------------------------------------------------------------------
+
+static SessionCost MeasureSession(const SessionScenario& scenario, int cRuns)
+{
+	SessionSimulator simulator;
+	SessionCost cost;
+	cost.name = scenario.name;
+
+	uint64_t cAllocations = GetAllocationCount();
+	uint64_t cbAllocated = GetAllocatedBytes();
+	SessionSimResult result = simulator.Run(scenario);
+	cAllocations = GetAllocationCount() - cAllocations;
+	cbAllocated = GetAllocatedBytes() - cbAllocated;
+
+	double fHours = (double)result.hnsSimulated / (3600.0 * HNS_PER_SECOND);
+	cost.fWakeups = result.cWakeups / fHours;
+	cost.fAllocations = cAllocations / fHours;
+	cost.fKilobytes = cbAllocated / 1024.0 / fHours;
+
+	// A session takes less than the resolution of the CPU clock, so it is
+	// timed in batches of repeated runs.
+	double fStart = GetCpuSeconds();
+	simulator.Run(scenario);
+	double fOnce = GetCpuSeconds() - fStart;
+	int cBatch = fOnce >= MIN_BATCH_SECONDS ? 1 : (int)(MIN_BATCH_SECONDS / (fOnce > 1e-6 ? fOnce : 1e-6)) + 1;
+
+	double fBest = -1.0;
+	for (int i = 0; i < cRuns; i++) {
+		fStart = GetCpuSeconds();
+		for (int n = 0; n < cBatch; n++)
+			simulator.Run(scenario);
+		double fSeconds = (GetCpuSeconds() - fStart) / cBatch;
+		if (fBest < 0.0 || fSeconds < fBest)
+			fBest = fSeconds;
+	}
+	cost.fCpuMs = fBest * 1000.0 / fHours;
+
+	printf("%-16s %9.1f wakeups/h  %5u loops  %4u missed  %8.1f allocs/h %8.1f KiB/h %8.3f ms CPU/h\n",
+		cost.name.c_str(), cost.fWakeups, result.cLoops, result.cMissedLoops, cost.fAllocations,
+		cost.fKilobytes, cost.fCpuMs);
+	return cost;
+}
+
+
+//********************* Baseline **********************//
+
+static bool ReadNumber(JsonReader& reader, double* pfValue)
+{
+	return reader.Next() == JSON_TOKEN_NUMBER && reader.GetNumber(pfValue);
+}
+
+//-----------------------------------------------------------------------------
+// LoadBaseline
+//
+// { "tolerance": { "wakeups": F, "allocations": F, "cpu": F, "cpuSlackMs": F },
+//   "sessions": { "NAME": { "wakeups": F, "allocations": F, "cpuMs": F }, ... } }
+//
+// Members not known are skipped.
+//-----------------------------------------------------------------------------
+
+static bool LoadBaseline(const char* pszPath, std::vector<SessionCost>* pSessions, Tolerance* pTolerance)
+{
+	MappedFile file;
+	if (!file.Open(FromUtf8(pszPath, strlen(pszPath)))) {
+		fprintf(stderr, "%s: cannot be read\n", pszPath);
+		return false;
+	}
+
+	JsonReader reader((const char*)file.GetData(), file.GetSize());
+	bool bValid = reader.Next() == JSON_TOKEN_BEGIN_OBJECT;
+	while (bValid && reader.Next() == JSON_TOKEN_KEY) {
+		if (reader.IsKey("tolerance") && reader.Next() == JSON_TOKEN_BEGIN_OBJECT) {
+			while (bValid && reader.Next() == JSON_TOKEN_KEY) {
+				if (reader.IsKey("wakeups"))
+					bValid = ReadNumber(reader, &pTolerance->fWakeups);
+				else if (reader.IsKey("allocations"))
+					bValid = ReadNumber(reader, &pTolerance->fAllocations);
+				else if (reader.IsKey("cpu"))
+					bValid = ReadNumber(reader, &pTolerance->fCpu);
+				else if (reader.IsKey("cpuSlackMs"))
+					bValid = ReadNumber(reader, &pTolerance->fCpuSlackMs);
+				else
+					bValid = reader.Skip();
+			}
+		}
+		else if (reader.IsKey("sessions") && reader.Next() == JSON_TOKEN_BEGIN_OBJECT) {
+			while (bValid && reader.Next() == JSON_TOKEN_KEY) {
+				SessionCost cost;
+				cost.name.assign(reader.GetText(), reader.GetTextLength());
+				cost.fWakeups = cost.fAllocations = cost.fKilobytes = cost.fCpuMs = -1.0;
+				bValid = reader.Next() == JSON_TOKEN_BEGIN_OBJECT;
+				while (bValid && reader.Next() == JSON_TOKEN_KEY) {
+					if (reader.IsKey("wakeups"))
+						bValid = ReadNumber(reader, &cost.fWakeups);
+					else if (reader.IsKey("allocations"))
+						bValid = ReadNumber(reader, &cost.fAllocations);
+					else if (reader.IsKey("cpuMs"))
+						bValid = ReadNumber(reader, &cost.fCpuMs);
+					else
+						bValid = reader.Skip();
+				}
+				pSessions->push_back(cost);
+			}
+		}
+		else {
+			bValid = reader.Skip();
+		}
+		bValid = bValid && reader.GetToken() != JSON_TOKEN_ERROR;
+	}
+	if (!bValid || reader.GetToken() != JSON_TOKEN_END_OBJECT) {
+		fprintf(stderr, "%s:%u: %s\n", pszPath, reader.GetLine(), reader.GetError() ? reader.GetError() : "unexpected value");
+		return false;
+	}
+	return true;
+}
+
+static bool WriteBaseline(const char* pszPath, const std::vector<SessionCost>& sessions, const Tolerance& tolerance)
+{
+	FILE* fp = FileOpen(FromUtf8(pszPath, strlen(pszPath)), "w");
+	if (!fp) {
+		fprintf(stderr, "%s: cannot be written\n", pszPath);
+		return false;
+	}
+	fprintf(fp, "// Cost per simulated hour of the built-in sessions. Generated by\n"
+		"// session_bench --write-baseline; ctest fails past the tolerances, on\n"
+		"// CPU time only with --gate-cpu.\n{\n");
+	fprintf(fp, "  \"tolerance\": { \"wakeups\": %.2f, \"allocations\": %.2f, \"cpu\": %.2f, \"cpuSlackMs\": %.3f },\n",
+		tolerance.fWakeups, tolerance.fAllocations, tolerance.fCpu, tolerance.fCpuSlackMs);
+	fprintf(fp, "  \"sessions\": {\n");
+	for (size_t i = 0; i < sessions.size(); i++) {
+		fprintf(fp, "    \"%s\": { \"wakeups\": %.1f, \"allocations\": %.1f, \"cpuMs\": %.3f }%s\n",
+			sessions[i].name.c_str(), sessions[i].fWakeups, sessions[i].fAllocations, sessions[i].fCpuMs,
+			i + 1 < sessions.size() ? "," : "");
+	}
+	fprintf(fp, "  }\n}\n");
+	return fclose(fp) == 0;
+}
+
+// Fails a measured value that grew past the baseline's tolerance.
+static bool CheckMetric(const SessionCost& cost, const char* pszMetric, double fValue, double fBaseline,
+	double fTolerance, double fSlack)
+{
+	if (fBaseline < 0.0)
+		return true;
+	double fLimit = fBaseline * (1.0 + fTolerance) + fSlack;
+	if (fValue <= fLimit)
+		return true;
+	printf("REGRESSION %s: %s %.3f per hour, baseline %.3f, limit %.3f\n", cost.name.c_str(), pszMetric,
+		fValue, fBaseline, fLimit);
+	return false;
+}
+
+
+int main(int argc, char** argv)
+{
+	const char* pszBaseline = NULL;
+	const char* pszWrite = NULL;
+	int cRuns = DEFAULT_RUNS;
+	bool bGateCpu = false;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--baseline=", 11) == 0)
+			pszBaseline = argv[i] + 11;
+		else if (strncmp(argv[i], "--write-baseline=", 17) == 0)
+			pszWrite = argv[i] + 17;
+		else if (strncmp(argv[i], "--runs=", 7) == 0)
+			cRuns = atoi(argv[i] + 7) > 0 ? atoi(argv[i] + 7) : 1;
+		else if (strcmp(argv[i], "--gate-cpu") == 0)
+			bGateCpu = true;
+		else {
+			fprintf(stderr, "usage: session_bench [--baseline=PATH] [--write-baseline=PATH] [--runs=N] [--gate-cpu]\n");
+			return 2;
+		}
+	}
+
+	std::vector<SessionCost> baseline;
+	Tolerance tolerance;
+	if (pszBaseline && !LoadBaseline(pszBaseline, &baseline, &tolerance))
+		return 2;
+
+	std::vector<SessionScenario> scenarios = GetBuiltInSessions();
+	std::vector<SessionCost> costs;
+	for (size_t i = 0; i < scenarios.size(); i++)
+		costs.push_back(MeasureSession(scenarios[i], cRuns));
+
+	bool bPassed = true;
+	for (size_t i = 0; i < costs.size(); i++) {
+		const SessionCost& cost = costs[i];
+		for (size_t j = 0; j < baseline.size(); j++) {
+			if (baseline[j].name != cost.name)
+				continue;
+			bPassed &= CheckMetric(cost, "wakeups", cost.fWakeups, baseline[j].fWakeups, tolerance.fWakeups, 0.0);
+			// One allocation an hour of slack, so a session without any can gain one.
+			bPassed &= CheckMetric(cost, "allocations", cost.fAllocations, baseline[j].fAllocations,
+				tolerance.fAllocations, 1.0);
+			if (bGateCpu) {
+				bPassed &= CheckMetric(cost, "CPU ms", cost.fCpuMs, baseline[j].fCpuMs, tolerance.fCpu,
+					tolerance.fCpuSlackMs);
+			}
+		}
+	}
+
+	if (pszWrite && !WriteBaseline(pszWrite, costs, tolerance))
+		return 2;
+	if (pszBaseline)
+		printf(bPassed ? "no regression against %s\n" : "regressed against %s\n", pszBaseline);
+	return bPassed ? 0 : 1;
+}
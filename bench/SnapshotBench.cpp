@@ -0,0 +1,53 @@
+//-------------------------------------------------------------------
+//
+// snapshot_bench
+//
+// Publishes a player-sized state block through a StateSnapshot from one
+// writer thread against 1, 2, 4... reader threads up to one per core
+// (or --max-readers=N), each count for --ms=N of wall-clock time, and
+// prints the writes and reads per second. Fails if a read saw fields
+// of two versions.
+//
+//-------------------------------------------------------------------
+
+#include "StateSnapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+static const uint32_t DEFAULT_MS = 1000;
+
+int main(int argc, char** argv)
+{
+	uint32_t nMs = DEFAULT_MS;
+	uint32_t cMaxReaders = std::thread::hardware_concurrency();
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--ms=", 5) == 0)
+			nMs = atoi(argv[i] + 5) > 0 ? atoi(argv[i] + 5) : 1;
+		else if (strncmp(argv[i], "--max-readers=", 14) == 0)
+			cMaxReaders = (uint32_t)atoi(argv[i] + 14);
+		else {
+			fprintf(stderr, "usage: snapshot_bench [--ms=N] [--max-readers=N]\n");
+			return 2;
+		}
+	}
+	cMaxReaders = cMaxReaders < 1 ? 1 : cMaxReaders;
+
+	printf("%7s %14s %14s %12s\n", "readers", "M writes/s", "M reads/s", "torn reads");
+	bool bPassed = true;
+	// 1, 2, 4... and then the maximum.
+	for (uint32_t cReaders = 1;; cReaders = cReaders * 2 < cMaxReaders ? cReaders * 2 : cMaxReaders) {
+		SnapshotBenchResult result;
+		if (!RunSnapshotBench(cReaders, (HNSTIME)nMs * HNS_PER_MSEC, &result)) {
+			bPassed = false;
+			break;
+		}
+		bPassed &= result.cTorn == 0;
+		printf("%7u %14.1f %14.1f %12llu\n", result.cReaders, result.fWritesPerSecond / 1e6,
+			result.fReadsPerSecond / 1e6, (unsigned long long)result.cTorn);
+		if (cReaders == cMaxReaders)
+			break;
+	}
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+//-------------------------------------------------------------------
+//
+// startup_bench
+//
+// Runs the app's startup graph with each stage sleeping for the latency
+// it has on a cold start, and the first frame coming a fixed time after
+// the open, as --bench-startup does in the app with the real stages.
+// Each of --runs=N runs takes the graph once with the media stages on a
+// worker, as the app starts, and once with every stage on the main
+// thread one after the other, as it started before. Prints the time to
+// first frame of both and the stage trace of the last pipelined run.
+//
+// Fails if a stage fails, or if the pipelined start is not faster than
+// the serial one in the median run.
+//
+//-------------------------------------------------------------------
+
+#include "StartupPipeline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const uint32_t DEFAULT_RUNS = 5;
+static const int FIRST_FRAME_MS = 25;		// From the open to the first frame
+
+struct BenchStage
+{
+	const char*		pszName;
+	STARTUP_THREAD	thread;
+	int				nMs;
+};
+
+// The app's stages, in the order it adds them.
+enum { COM, SHELL, WINDOW, MF_STARTUP, OPEN_SOURCE, PLAYER, OPEN, STAGE_COUNT };
+
+static const BenchStage s_stages[STAGE_COUNT] = {
+	{ "com", STARTUP_THREAD_MAIN, 5 },
+	{ "shell", STARTUP_THREAD_MAIN, 40 },
+	{ "window", STARTUP_THREAD_MAIN, 20 },
+	{ "mf-startup", STARTUP_THREAD_WORKER, 60 },
+	{ "open-source", STARTUP_THREAD_WORKER, 140 },
+	{ "player", STARTUP_THREAD_MAIN, 15 },
+	{ "open", STARTUP_THREAD_MAIN, 30 },
+};
+
+static const int s_dependencies[][2] = {
+	{ WINDOW, SHELL },
+	{ OPEN_SOURCE, MF_STARTUP },
+	{ PLAYER, COM },
+	{ PLAYER, WINDOW },
+	{ PLAYER, MF_STARTUP },
+	{ OPEN, PLAYER },
+	{ OPEN, OPEN_SOURCE },
+};
+
+static void SleepMs(int nMs)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(nMs));
+}
+
+// Time to first frame in ms, or -1 if a stage failed. bSerial runs every
+// stage on the main thread.
+static double RunStartup(bool bSerial, std::string* pReport)
+{
+	StartupPipeline pipeline;
+	for (size_t i = 0; i < STAGE_COUNT; i++) {
+		int nMs = s_stages[i].nMs;
+		pipeline.AddStage(s_stages[i].pszName, bSerial ? STARTUP_THREAD_MAIN : s_stages[i].thread, [nMs]() {
+			SleepMs(nMs);
+			return true;
+		});
+	}
+	for (size_t i = 0; i < sizeof(s_dependencies) / sizeof(s_dependencies[0]); i++)
+		pipeline.AddDependency(s_dependencies[i][0], s_dependencies[i][1]);
+
+	HNSTIME hnsStart = pipeline.Now();
+	if (!pipeline.Run())
+		return -1.0;
+	SleepMs(FIRST_FRAME_MS);
+	pipeline.Mark("first-frame");
+	if (pReport)
+		pipeline.FormatReport(pReport);
+	return (double)(pipeline.GetMarks().back().hnsTime - hnsStart) / HNS_PER_MSEC;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t cRuns = DEFAULT_RUNS;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--runs=", 7) == 0)
+			cRuns = atoi(argv[i] + 7) > 0 ? atoi(argv[i] + 7) : 1;
+		else {
+			fprintf(stderr, "usage: startup_bench [--runs=N]\n");
+			return 2;
+		}
+	}
+
+	bool bPassed = true;
+	std::vector<double> serial, pipelined;
+	std::string report;
+	printf("%4s %12s %14s\n", "run", "serial ms", "pipelined ms");
+	for (uint32_t n = 0; n < cRuns; n++) {
+		serial.push_back(RunStartup(true, NULL));
+		pipelined.push_back(RunStartup(false, &report));
+		bPassed &= serial.back() >= 0.0 && pipelined.back() >= 0.0;
+		printf("%4u %12.1f %14.1f\n", n + 1, serial.back(), pipelined.back());
+	}
+	std::sort(serial.begin(), serial.end());
+	std::sort(pipelined.begin(), pipelined.end());
+	double fSerial = serial[cRuns / 2], fPipelined = pipelined[cRuns / 2];
+	printf("%4s %12.1f %14.1f\n\n%s", "med", fSerial, fPipelined, report.c_str());
+	return bPassed && fPipelined < fSerial ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+//-------------------------------------------------------------------
+//
+// stats_bench
+//
+// Measures what PlaybackStats costs the hot paths that record into it:
+// nanoseconds per Record and Count when disabled, on a private writer
+// slot, and on the shared slot with several threads contending, and a
+// whole RecordFrame. Also times a Query and a CSV dump, which readers
+// pay. Fails if the enabled runs lose samples.
+//
+//-------------------------------------------------------------------
+
+#include "PlaybackStats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static const uint32_t DEFAULT_SAMPLES = 10000000;
+static const uint32_t CONTENDED_THREADS = 4;
+
+static double Elapsed(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Records cSamples values on the calling thread; returns ns per sample.
+static double RecordLoop(PlaybackStats* pStats, uint32_t cSamples)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t n = 0; n < cSamples; n++)
+		pStats->Record(STATS_METRIC_DECODE_TIME, n & 0xFFFF);
+	return Elapsed(start) / cSamples;
+}
+
+static double CountLoop(PlaybackStats* pStats, uint32_t cSamples)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t n = 0; n < cSamples; n++)
+		pStats->Count(STATS_COUNTER_PLAYER_EVENTS);
+	return Elapsed(start) / cSamples;
+}
+
+static double FrameLoop(PlaybackStats* pStats, uint32_t cSamples)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t n = 0; n < cSamples; n++) {
+		HNSTIME hns = (HNSTIME)n * 166667;
+		pStats->RecordFrame(hns, hns + 20000 + (n & 0x3FFF), hns + 166667, hns + 166667 + (n & 0xFFFF));
+	}
+	return Elapsed(start) / cSamples;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t cSamples = DEFAULT_SAMPLES;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--samples=", 10) == 0)
+			cSamples = atoi(argv[i] + 10) > 0 ? atoi(argv[i] + 10) : 1;
+		else {
+			fprintf(stderr, "usage: stats_bench [--samples=N]\n");
+			return 2;
+		}
+	}
+
+	PlaybackStats stats;
+	bool bPassed = true;
+	printf("%-22s %12s %10s\n", "case", "samples", "ns/sample");
+
+	// This thread records first, so it owns a private slot.
+	printf("%-22s %12u %10.2f\n", "record disabled", cSamples, RecordLoop(&stats, cSamples));
+	printf("%-22s %12u %10.2f\n", "count disabled", cSamples, CountLoop(&stats, cSamples));
+	stats.Enable(true);
+	printf("%-22s %12u %10.2f\n", "record private", cSamples, RecordLoop(&stats, cSamples));
+	printf("%-22s %12u %10.2f\n", "count private", cSamples, CountLoop(&stats, cSamples));
+	printf("%-22s %12u %10.2f\n", "record frame", cSamples, FrameLoop(&stats, cSamples));
+
+	// Enough threads that the last ones share a slot; each reports its own
+	// time, the worst is printed.
+	stats.Reset();
+	uint32_t cThreads = PlaybackStats::WRITER_COUNT + CONTENDED_THREADS;
+	std::vector<double> times(cThreads);
+	std::vector<std::thread> threads;
+	for (uint32_t t = 0; t < cThreads; t++)
+		threads.push_back(std::thread([&stats, &times, t, cSamples]() { times[t] = RecordLoop(&stats, cSamples); }));
+	double fWorst = 0;
+	for (uint32_t t = 0; t < cThreads; t++) {
+		threads[t].join();
+		fWorst = times[t] > fWorst ? times[t] : fWorst;
+	}
+	printf("%-22s %12u %10.2f\n", "record contended", cSamples * cThreads, fWorst);
+
+	StatsSummary summary;
+	bPassed &= stats.Query(STATS_METRIC_DECODE_TIME, &summary) && summary.cSamples == (uint64_t)cSamples * cThreads;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bPassed &= stats.Query(STATS_METRIC_DECODE_TIME, &summary);
+	printf("%-22s %12u %10.0f\n", "query", 1, Elapsed(start));
+	std::string text;
+	start = std::chrono::steady_clock::now();
+	FormatStatsCsv(stats, &text);
+	printf("%-22s %12u %10.0f\n", "csv dump", 1, Elapsed(start));
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+//-------------------------------------------------------------------
+//
+// transcode_bench
+//
+// Prepares a clip in the transcode cache and plays it from the cache
+// and from the source, as --prepare does in the app with Media
+// Foundation, with Y4M at both ends so it runs anywhere. The source is a
+// --width=N x --height=N clip (1080p) at --fps=N (60) of --frames=N
+// frames it writes first; the target is a --desktop-width=N x
+// --desktop-height=N desktop (720p) at the cache's rate cap. Preparing
+// reads each frame the cap keeps, point-samples its planes down to the
+// cached frame size, writes it and commits the entry with its index. A
+// play decodes every frame of a clip to BGRA on one thread. Prints the
+// prepare time, each play's time and ms per frame, and the plays after
+// which the prepare has paid for itself.
+//
+// Fails if the committed entry is not found fresh or does not hold the
+// frames its index lists, or if playing the cached copy is not faster.
+//
+//-------------------------------------------------------------------
+
+#include "TranscodeCache.h"
+#include "SoftwarePlayer.h"
+#include "Y4MSource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+static const uint32_t DEFAULT_FRAMES = 120;
+static const uint32_t DEFAULT_WIDTH = 1920;
+static const uint32_t DEFAULT_HEIGHT = 1080;
+static const uint32_t DEFAULT_FPS = 60;
+static const uint32_t DEFAULT_DESKTOP_WIDTH = 1280;
+static const uint32_t DEFAULT_DESKTOP_HEIGHT = 720;
+static const char CLIP_PATH[] = "transcode_bench.y4m";
+
+// A clip whose frames differ, so no play decodes the same bytes twice
+// in a row.
+static bool WriteClip(const char* pszPath, uint32_t cx, uint32_t cy, uint32_t nFps, uint32_t cFrames)
+{
+	FILE* fp = fopen(pszPath, "wb");
+	if (!fp)
+		return false;
+	fprintf(fp, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", cx, cy, nFps);
+	std::vector<uint8_t> frame((size_t)cx * cy * 3 / 2);
+	bool bOk = true;
+	for (uint32_t n = 0; bOk && n < cFrames; n++) {
+		for (size_t i = 0; i < frame.size(); i++)
+			frame[i] = (uint8_t)(16 + (i * 7 + n * 13) % 224);
+		bOk = fprintf(fp, "FRAME\n") > 0 && fwrite(frame.data(), 1, frame.size(), fp) == frame.size();
+	}
+	return fclose(fp) == 0 && bOk;
+}
+
+static void ScalePlane(const uint8_t* pSrc, uint32_t cxSrc, uint32_t cySrc, uint8_t* pDst, uint32_t cxDst,
+	uint32_t cyDst)
+{
+	for (uint32_t y = 0; y < cyDst; y++) {
+		const uint8_t* pRow = pSrc + (size_t)((uint64_t)y * cySrc / cyDst) * cxSrc;
+		for (uint32_t x = 0; x < cxDst; x++)
+			*pDst++ = pRow[(uint64_t)x * cxSrc / cxDst];
+	}
+}
+
+// Transcodes a 4:2:0 Y4M source into the cache entry for target and
+// commits it. The cached frames are all keyframes, like Y4M's.
+static bool Prepare(TranscodeCache* pCache, const std::wstring& source, const CacheTarget& target,
+	CacheIndex* pIndex)
+{
+	Y4MSource reader;
+	if (!reader.Open(source) || reader.GetFormat().chroma != Y4M_CHROMA_420)
+		return false;
+	const Y4MFormat& format = reader.GetFormat();
+	FramePacer pacer;
+	pacer.SetRates(format.rate, target.maxRate);
+
+	*pIndex = CacheIndex();
+	pIndex->source = source;
+	pIndex->target = target;
+	pIndex->rate = pacer.IsDecimating() ? target.maxRate : format.rate;
+	GetCacheFrameSize(format.cx, format.cy, target, &pIndex->cx, &pIndex->cy);
+	if (!GetFileInfo(source, &pIndex->sourceInfo))
+		return false;
+
+	std::wstring temp = pCache->GetTempPath(source, target);
+	FILE* fp = FileOpen(temp, "wb");
+	if (!fp)
+		return false;
+	uint32_t cx = pIndex->cx, cy = pIndex->cy;
+	fprintf(fp, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C420jpeg\n", cx, cy, pIndex->rate.nNum, pIndex->rate.nDen);
+	std::vector<uint8_t> raw(format.cbFrame), scaled((size_t)cx * cy * 3 / 2);
+	const uint8_t* pCb = raw.data() + (size_t)format.cx * format.cy;
+	const uint8_t* pCr = pCb + (size_t)format.cxChroma * format.cyChroma;
+	uint8_t* pScaledCb = scaled.data() + (size_t)cx * cy;
+	uint8_t* pScaledCr = pScaledCb + (size_t)(cx / 2) * (cy / 2);
+	bool bOk = true;
+	for (uint64_t n = 0; bOk && n < reader.GetFrameCount(); n++) {
+		if (pacer.IsDecimating() && !pacer.ShouldPresent(n))
+			continue;
+		bOk = reader.ReadFrame(n, raw.data());
+		ScalePlane(raw.data(), format.cx, format.cy, scaled.data(), cx, cy);
+		ScalePlane(pCb, format.cxChroma, format.cyChroma, pScaledCb, cx / 2, cy / 2);
+		ScalePlane(pCr, format.cxChroma, format.cyChroma, pScaledCr, cx / 2, cy / 2);
+		bOk = bOk && fprintf(fp, "FRAME\n") > 0 && fwrite(scaled.data(), 1, scaled.size(), fp) == scaled.size();
+
+		uint64_t nCached = pIndex->frames.size();
+		HNSTIME hnsTime = (HNSTIME)(nCached * HNS_PER_SECOND * pIndex->rate.nDen / pIndex->rate.nNum);
+		HNSTIME hnsEnd = (HNSTIME)((nCached + 1) * HNS_PER_SECOND * pIndex->rate.nDen / pIndex->rate.nNum);
+		CacheFrame frame = { hnsTime, hnsEnd - hnsTime, true };
+		pIndex->frames.push_back(frame);
+	}
+	bOk = fclose(fp) == 0 && bOk;
+	if (!bOk || !pCache->Commit(temp, pIndex)) {
+		RemoveFile(temp);
+		return false;
+	}
+	return true;
+}
+
+static bool Play(const std::wstring& path, DecodeBenchResult* pResult)
+{
+	return RunDecodeBench(path, 1, 1, pResult) && pResult->cFrames > 0;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t cFrames = DEFAULT_FRAMES;
+	uint32_t cx = DEFAULT_WIDTH, cy = DEFAULT_HEIGHT, nFps = DEFAULT_FPS;
+	CacheTarget target;
+	target.cxDesktop = DEFAULT_DESKTOP_WIDTH;
+	target.cyDesktop = DEFAULT_DESKTOP_HEIGHT;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--frames=", 9) == 0)
+			cFrames = atoi(argv[i] + 9) > 0 ? atoi(argv[i] + 9) : 1;
+		else if (strncmp(argv[i], "--width=", 8) == 0)
+			cx = atoi(argv[i] + 8) > 1 ? atoi(argv[i] + 8) & ~1 : 2;
+		else if (strncmp(argv[i], "--height=", 9) == 0)
+			cy = atoi(argv[i] + 9) > 1 ? atoi(argv[i] + 9) & ~1 : 2;
+		else if (strncmp(argv[i], "--fps=", 6) == 0)
+			nFps = atoi(argv[i] + 6) > 0 ? atoi(argv[i] + 6) : 1;
+		else if (strncmp(argv[i], "--desktop-width=", 16) == 0)
+			target.cxDesktop = atoi(argv[i] + 16) > 0 ? atoi(argv[i] + 16) : 1;
+		else if (strncmp(argv[i], "--desktop-height=", 17) == 0)
+			target.cyDesktop = atoi(argv[i] + 17) > 0 ? atoi(argv[i] + 17) : 1;
+		else {
+			fprintf(stderr, "usage: transcode_bench [--frames=N] [--width=N] [--height=N] [--fps=N] "
+				"[--desktop-width=N] [--desktop-height=N]\n");
+			return 2;
+		}
+	}
+	if (!WriteClip(CLIP_PATH, cx, cy, nFps, cFrames)) {
+		fprintf(stderr, "cannot write %s\n", CLIP_PATH);
+		return 2;
+	}
+	TranscodeCache cache(L".");
+	std::wstring source = FromUtf8(CLIP_PATH, strlen(CLIP_PATH));
+
+	// The first play finds no entry and decodes the source; preparing
+	// once lets every later play decode the cached copy.
+	bool bPassed = true;
+	CacheIndex index, found;
+	DecodeBenchResult sourcePlay = DecodeBenchResult(), cachedPlay = DecodeBenchResult();
+	auto start = std::chrono::steady_clock::now();
+	bool bPrepared = !cache.FindFresh(source, target, &found) && Prepare(&cache, source, target, &index);
+	double fPrepare = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::wstring media = cache.GetMediaPath(source, target);
+	Y4MSource cached;
+	if (!bPrepared || !cache.FindFresh(source, target, &found) || !cached.Open(media) ||
+		cached.GetFrameCount() != found.frames.size()) {
+		printf("the clip could not be prepared, or its entry is not fresh or does not match its index\n");
+		bPassed = false;
+	}
+	cached.Close();
+	if (bPassed && (!Play(source, &sourcePlay) || !Play(media, &cachedPlay))) {
+		printf("a play could not decode its clip\n");
+		bPassed = false;
+	}
+
+	if (bPassed) {
+		printf("source %ux%u at %u fps, %u frames; cached %ux%u at %.2f fps, %zu frames, %.1f MB\n", cx, cy, nFps,
+			cFrames, found.cx, found.cy, (double)found.rate.nNum / found.rate.nDen, found.frames.size(),
+			found.cbMedia / 1048576.0);
+		printf("%-18s %10s %10s\n", "", "seconds", "ms/frame");
+		printf("%-18s %10.3f %10.2f\n", "prepare", fPrepare, fPrepare * 1000.0 / cFrames);
+		printf("%-18s %10.3f %10.2f\n", "play from source", sourcePlay.fSeconds,
+			sourcePlay.fSeconds * 1000.0 / sourcePlay.cFrames);
+		printf("%-18s %10.3f %10.2f\n", "play from cache", cachedPlay.fSeconds,
+			cachedPlay.fSeconds * 1000.0 / cachedPlay.cFrames);
+		double fSaved = sourcePlay.fSeconds - cachedPlay.fSeconds;
+		if (fSaved > 0.0)
+			printf("pays back after %.1f plays\n", fPrepare / fSaved);
+		else {
+			printf("playing the cached copy saves nothing\n");
+			bPassed = false;
+		}
+	}
+
+	cache.Remove(source, target);
+	RemoveFile(cache.GetTempPath(source, target));
+	remove(CLIP_PATH);
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,215 @@
+//-------------------------------------------------------------------
+//
+// wakeup_bench
+//
+// Runs an EventLoop as the app's window thread runs in steady playback,
+// for --seconds=N of wall-clock time: a one-shot loop deadline each
+// --clip-ms=N, at which a player thread posts a burst of events as
+// MFPlay does when a clip wraps, the stats sampling timer each second
+// with tolerance, and the overlay clock ticking at each second. Prints
+// the wakeups per minute by cause, as --bench-wakeups does in the app,
+// against the 240 a loop polling every 250 ms takes.
+//
+// Fails if a posted event is lost, or if the loop wakes as often as
+// polling would.
+//
+//-------------------------------------------------------------------
+
+#include "EventLoop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static const uint32_t DEFAULT_SECONDS = 60;
+static const uint32_t DEFAULT_CLIP_MS = 10000;
+static const HNSTIME STATS_PERIOD = HNS_PER_SECOND;
+static const HNSTIME TIMER_TOLERANCE = 100 * HNS_PER_MSEC;
+static const double POLLING_WAKEUPS_PER_MIN = 60000.0 / 250;
+
+// Timers as the app numbers them.
+static const uint32_t IDT_LOOP = 1;
+static const uint32_t IDT_STATS = 4;
+static const uint32_t IDT_BENCH = 7;
+static const uint32_t IDT_OVERLAY = 8;
+
+// Events the player posts when a clip wraps: ended, position set,
+// started, state.
+static const uint32_t PLAYER_EVENT_COUNT = 4;
+
+// Posts a burst of player events for every wrap it is told about.
+class BenchPlayer
+{
+public:
+	explicit BenchPlayer(EventLoop* pLoop) : m_pLoop(pLoop), m_cWraps(0), m_bStop(false),
+		m_thread(&BenchPlayer::Run, this)
+	{
+	}
+
+	~BenchPlayer()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_bStop = true;
+		}
+		m_cv.notify_one();
+		m_thread.join();
+	}
+
+	void Wrap()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_cWraps++;
+		}
+		m_cv.notify_one();
+	}
+
+private:
+	void Run()
+	{
+		uint64_t cPosted = 0;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;) {
+			m_cv.wait(lock, [this, cPosted]() { return m_bStop || m_cWraps > cPosted; });
+			if (m_cWraps == cPosted)
+				return;
+			cPosted++;
+			lock.unlock();
+			for (uint32_t nEvent = 0; nEvent < PLAYER_EVENT_COUNT; nEvent++)
+				m_pLoop->Post(nEvent, cPosted);
+			lock.lock();
+		}
+	}
+
+	EventLoop*				m_pLoop;
+	uint64_t				m_cWraps;
+	bool					m_bStop;
+	std::mutex				m_mutex;
+	std::condition_variable	m_cv;
+	std::thread				m_thread;		// Last, so it starts with the rest set
+};
+
+class BenchHandler : public IEventHandler
+{
+public:
+	BenchHandler(EventLoop* pLoop, HNSTIME hnsClip) : m_pLoop(pLoop), m_pPlayer(NULL), m_hnsClip(hnsClip),
+		m_cWraps(0)
+	{
+		memset(m_nLatest, 0, sizeof(m_nLatest));
+	}
+
+	void Start(BenchPlayer* pPlayer, HNSTIME hnsDuration)
+	{
+		m_pPlayer = pPlayer;
+		m_pLoop->SetTimer(IDT_BENCH, hnsDuration);
+		m_pLoop->SetTimer(IDT_LOOP, m_hnsClip);
+		m_pLoop->SetPeriodicTimer(IDT_STATS, STATS_PERIOD, TIMER_TOLERANCE);
+		TickOverlay();
+	}
+
+	void OnEvent(uint32_t nEvent, uint64_t nValue, uint64_t) override
+	{
+		if (nEvent < PLAYER_EVENT_COUNT)
+			m_nLatest[nEvent] = nValue;
+	}
+
+	void OnHandle(EVENT_HANDLE) override {}
+
+	void OnTimer(uint32_t nTimer) override
+	{
+		switch (nTimer) {
+		case IDT_LOOP:
+			m_cWraps++;
+			m_pPlayer->Wrap();
+			m_pLoop->SetTimer(IDT_LOOP, m_hnsClip);
+			break;
+		case IDT_OVERLAY:
+			TickOverlay();
+			break;
+		case IDT_BENCH:
+			m_pLoop->Quit(0);
+			break;
+		}
+	}
+
+	void OnInput() override {}
+
+	// Every event of every burst arrived, with the value of the last wrap.
+	bool IsComplete() const
+	{
+		for (uint32_t nEvent = 0; nEvent < PLAYER_EVENT_COUNT; nEvent++) {
+			if (m_nLatest[nEvent] != m_cWraps)
+				return false;
+		}
+		return true;
+	}
+
+	uint64_t GetWraps() const { return m_cWraps; }
+
+private:
+	// At the next whole second of the loop's clock, as the app's overlay
+	// clock ticks at the next second of the local time.
+	void TickOverlay()
+	{
+		HNSTIME hnsNow = m_pLoop->GetTime();
+		m_pLoop->SetTimer(IDT_OVERLAY, HNS_PER_SECOND - hnsNow % HNS_PER_SECOND);
+	}
+
+	EventLoop*		m_pLoop;
+	BenchPlayer*	m_pPlayer;
+	HNSTIME			m_hnsClip;
+	uint64_t		m_cWraps;
+	uint64_t		m_nLatest[PLAYER_EVENT_COUNT];
+};
+
+int main(int argc, char** argv)
+{
+	uint32_t cSeconds = DEFAULT_SECONDS;
+	uint32_t nClipMs = DEFAULT_CLIP_MS;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--seconds=", 10) == 0)
+			cSeconds = atoi(argv[i] + 10) > 0 ? atoi(argv[i] + 10) : 1;
+		else if (strncmp(argv[i], "--clip-ms=", 10) == 0)
+			nClipMs = atoi(argv[i] + 10) > 0 ? atoi(argv[i] + 10) : 1;
+		else {
+			fprintf(stderr, "usage: wakeup_bench [--seconds=N] [--clip-ms=N]\n");
+			return 2;
+		}
+	}
+
+	EventLoop loop;
+	BenchHandler handler(&loop, (HNSTIME)nClipMs * HNS_PER_MSEC);
+	loop.SetHandler(&handler);
+	if (!loop.Initialize()) {
+		fprintf(stderr, "cannot initialize the event loop\n");
+		return 2;
+	}
+	{
+		BenchPlayer player(&loop);
+		loop.ResetStats();
+		handler.Start(&player, (HNSTIME)cSeconds * HNS_PER_SECOND);
+		loop.Run();
+	}
+	EventLoopStats stats;
+	loop.GetStats(&stats);
+
+	// The last burst may have been posted after the loop quit.
+	loop.RunOnce(0);
+	bool bComplete = handler.IsComplete();
+
+	double fMinutes = (double)stats.hnsElapsed / (60 * HNS_PER_SECOND);
+	double fWakeups = stats.cWakeups / fMinutes;
+	printf("%.1f s of playback, %llu clip wraps: %.1f wakeups/min, polling every 250 ms %.1f/min\n",
+		fMinutes * 60.0, (unsigned long long)handler.GetWraps(), fWakeups, POLLING_WAKEUPS_PER_MIN);
+	printf("  timers %.1f/min, posted events %.1f/min, handles %.1f/min, idle %.1f/min\n",
+		stats.cTimerWakeups / fMinutes, stats.cPostWakeups / fMinutes, stats.cHandleWakeups / fMinutes,
+		stats.cIdleWakeups / fMinutes);
+	printf("  %llu posts coalesced into %llu events, %llu timers fired\n", (unsigned long long)stats.cPosts,
+		(unsigned long long)stats.cEvents, (unsigned long long)stats.cTimers);
+	if (!bComplete)
+		printf("player events lost\n");
+	return bComplete && fWakeups < POLLING_WAKEUPS_PER_MIN ? 0 : 1;
+}
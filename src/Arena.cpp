@@ -0,0 +1,206 @@
+#include "Arena.h"
+
+static const size_t GUARD_SIZE = 16;		// Bytes behind each allocation of a checked arena
+static const uint8_t GUARD_BYTE = 0xFD;
+static const uint8_t FREED_BYTE = 0xDD;
+
+static size_t AlignUp(size_t n, size_t cbAlign)
+{
+	return (n + cbAlign - 1) & ~(cbAlign - 1);
+}
+
+//-----------------------------------------------------------------------------
+// Constructor / destructor
+//
+// No memory is taken until the first allocation.
+//-----------------------------------------------------------------------------
+
+Arena::Arena(size_t cbChunk) : m_cbChunk(cbChunk ? cbChunk : DEFAULT_CHUNK_SIZE), m_bCheck(ARENA_CHECK_DEFAULT),
+m_pChunks(nullptr), m_pFinalizers(nullptr), m_pLastGuarded(nullptr)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+Arena::~Arena()
+{
+	Release();
+}
+
+bool Arena::SetChecking(bool bCheck)
+{
+	if (m_stats.cAllocations)
+		return bCheck == m_bCheck;
+	m_bCheck = bCheck;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// AddChunk
+//
+// Makes a chunk with room for cbMin bytes at any alignment. Chunks are
+// taken with operator new, so allocation counters see them.
+//-----------------------------------------------------------------------------
+
+bool Arena::AddChunk(size_t cbMin)
+{
+	size_t cbSize = cbMin + MAX_ALIGN > m_cbChunk ? cbMin + MAX_ALIGN : m_cbChunk;
+	Chunk* pChunk = (Chunk*)::operator new(sizeof(Chunk) + cbSize, std::nothrow);
+	if (!pChunk)
+		return false;
+	pChunk->pNext = m_pChunks;
+	pChunk->cbSize = cbSize;
+	pChunk->cbUsed = 0;
+	m_pChunks = pChunk;
+	m_stats.cbReserved += cbSize;
+	m_stats.cChunks++;
+	return true;
+}
+
+void Arena::FreeChunks()
+{
+	while (m_pChunks) {
+		Chunk* pNext = m_pChunks->pNext;
+		::operator delete(m_pChunks);
+		m_pChunks = pNext;
+	}
+	m_stats.cbReserved = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Allocate
+//
+// Carves from the current chunk, or a new one when it has no room; the
+// rest of a full chunk is left unused until the reset. A checked
+// allocation has a Guarded header right before it and the guard bytes
+// right behind it.
+//-----------------------------------------------------------------------------
+
+void* Arena::Allocate(size_t cb, size_t cbAlign)
+{
+	if (!cbAlign || cbAlign > MAX_ALIGN || (cbAlign & (cbAlign - 1)) || cb > (size_t)-1 / 2)
+		return nullptr;
+	if (cbAlign < sizeof(void*))
+		cbAlign = sizeof(void*);
+
+	size_t cbHeader = m_bCheck ? sizeof(Guarded) : 0;
+	size_t cbTrailer = m_bCheck ? GUARD_SIZE : 0;
+	for (int nTry = 0; nTry < 2; nTry++) {
+		if (m_pChunks) {
+			uintptr_t nBase = (uintptr_t)(m_pChunks + 1);
+			uintptr_t nStart = nBase + m_pChunks->cbUsed;
+			uintptr_t nData = AlignUp(nStart + cbHeader, cbAlign);
+			size_t cbEnd = (size_t)(nData - nBase) + cb + cbTrailer;
+			if (cbEnd <= m_pChunks->cbSize) {
+				m_stats.cbUsed += cbEnd - m_pChunks->cbUsed;
+				m_pChunks->cbUsed = cbEnd;
+				m_stats.cAllocations++;
+				if (m_bCheck) {
+					Guarded* pGuarded = (Guarded*)(nData - sizeof(Guarded));
+					pGuarded->pPrev = m_pLastGuarded;
+					pGuarded->cb = cb;
+					m_pLastGuarded = pGuarded;
+					memset((void*)(nData + cb), GUARD_BYTE, GUARD_SIZE);
+				}
+				return (void*)nData;
+			}
+		}
+		if (!AddChunk(cbHeader + cb + cbTrailer))
+			return nullptr;
+	}
+	return nullptr;
+}
+
+void* Arena::AllocateObject(size_t cb, size_t cbAlign, void (*pfnDestroy)(void*))
+{
+	Finalizer* pFinalizer = nullptr;
+	if (pfnDestroy) {
+		pFinalizer = (Finalizer*)Allocate(sizeof(Finalizer), alignof(Finalizer));
+		if (!pFinalizer)
+			return nullptr;
+	}
+	void* p = Allocate(cb, cbAlign);
+	if (p && pFinalizer) {
+		pFinalizer->pfnDestroy = pfnDestroy;
+		pFinalizer->pObject = p;
+		pFinalizer->pNext = m_pFinalizers;
+		m_pFinalizers = pFinalizer;
+	}
+	return p;
+}
+
+//-----------------------------------------------------------------------------
+// Check
+//-----------------------------------------------------------------------------
+
+bool Arena::Check()
+{
+	bool bIntact = true;
+	for (Guarded* pGuarded = m_pLastGuarded; pGuarded; pGuarded = pGuarded->pPrev) {
+		const uint8_t* pGuard = (const uint8_t*)(pGuarded + 1) + pGuarded->cb;
+		for (size_t i = 0; i < GUARD_SIZE; i++) {
+			if (pGuard[i] != GUARD_BYTE) {
+				m_stats.cOverruns++;
+				bIntact = false;
+				break;
+			}
+		}
+	}
+	return bIntact;
+}
+
+//-----------------------------------------------------------------------------
+// Clear
+//
+// Destructors run before the guards are checked, so an object that
+// overruns another while being destroyed is caught too.
+//-----------------------------------------------------------------------------
+
+void Arena::Clear()
+{
+	while (m_pFinalizers) {
+		Finalizer* pFinalizer = m_pFinalizers;
+		m_pFinalizers = pFinalizer->pNext;
+		pFinalizer->pfnDestroy(pFinalizer->pObject);
+	}
+
+	if (m_bCheck) {
+		Check();
+		for (Chunk* pChunk = m_pChunks; pChunk; pChunk = pChunk->pNext)
+			memset(pChunk + 1, FREED_BYTE, pChunk->cbUsed);
+	}
+	m_pLastGuarded = nullptr;
+	m_stats.cbUsed = 0;
+	m_stats.cAllocations = 0;
+	m_stats.cResets++;
+}
+
+//-----------------------------------------------------------------------------
+// Reset
+//
+// Several chunks become one of their total size, so the next fill of the
+// same size is carved from a single chunk without touching the heap.
+//-----------------------------------------------------------------------------
+
+void Arena::Reset()
+{
+	Clear();
+	if (m_pChunks && m_pChunks->pNext) {
+		size_t cbTotal = m_stats.cbReserved;
+		FreeChunks();
+		m_cbChunk = cbTotal > m_cbChunk ? cbTotal : m_cbChunk;
+		AddChunk(cbTotal - MAX_ALIGN);
+	}
+	else if (m_pChunks)
+		m_pChunks->cbUsed = 0;
+}
+
+void Arena::Release()
+{
+	Clear();
+	FreeChunks();
+}
+
+ArenaStats Arena::GetStats() const
+{
+	return m_stats;
+}
@@ -0,0 +1,251 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+// Arenas check their allocations by default in debug builds.
+#ifdef _DEBUG
+const bool ARENA_CHECK_DEFAULT = true;
+#else
+const bool ARENA_CHECK_DEFAULT = false;
+#endif
+
+struct ArenaStats
+{
+	size_t		cbUsed;			// Carved since the last reset, padding included
+	size_t		cbReserved;		// Held in chunks
+	uint64_t	cAllocations;	// Since the last reset
+	uint64_t	cChunks;		// Chunks taken from the heap since the arena was created
+	uint64_t	cResets;		// Resets and releases
+	uint64_t	cOverruns;		// Allocations found written past their end (checked arenas)
+	uint64_t	cLeaks;			// Pool objects never deleted
+	uint64_t	cBadDeletes;	// Pool deletes of objects that were not live (checked arenas)
+};
+
+
+//-------------------------------------------------------------------
+//
+// Arena class
+//
+// Region allocator for everything that lives as long as one thing, such
+// as a media item: allocations are carved from large chunks and all
+// released at once by Reset, which also runs the destructors of objects
+// made with New, newest first. There is no per-allocation free.
+//
+// Reset keeps the memory. An arena that had to grow past its first
+// chunk swaps its chunks for one of their total size, so the next item
+// of the same size is carved from it without touching the heap.
+//
+// A checked arena puts a guard behind every allocation and verifies it
+// on Check and Reset, fills released memory with 0xDD, and has its pools
+// check their deletes; the counts are in the stats. Not thread-safe.
+//
+//-------------------------------------------------------------------
+
+class Arena
+{
+public:
+	static const size_t DEFAULT_CHUNK_SIZE = 16 * 1024;
+	static const size_t MAX_ALIGN = 64;
+
+	explicit Arena(size_t cbChunk = DEFAULT_CHUNK_SIZE);
+	~Arena();
+
+	// Fails unless the arena is empty.
+	bool SetChecking(bool bCheck);
+	bool IsChecking() const { return m_bCheck; }
+
+	// cb bytes aligned to cbAlign, a power of 2 up to MAX_ALIGN. NULL if
+	// the heap is out of memory.
+	void* Allocate(size_t cb, size_t cbAlign = 2 * sizeof(void*));
+
+	// Constructs a T whose destructor runs on Reset.
+	template <typename T, typename... Args>
+	T* New(Args&&... args)
+	{
+		void* p = AllocateObject(sizeof(T), alignof(T),
+			std::is_trivially_destructible<T>::value ? nullptr : &Destroy<T>);
+		return p ? new (p) T(std::forward<Args>(args)...) : nullptr;
+	}
+
+	// Array of c zeroed Ts.
+	template <typename T>
+	T* NewArray(size_t c)
+	{
+		static_assert(std::is_trivial<T>::value, "Arena::NewArray needs a trivial type");
+		if (c > (size_t)-1 / sizeof(T))
+			return nullptr;
+		void* p = Allocate(c * sizeof(T), alignof(T));
+		if (p)
+			memset(p, 0, c * sizeof(T));
+		return (T*)p;
+	}
+
+	// Destroys the objects and releases every allocation at once.
+	void Reset();
+
+	// Resets and gives the memory back to the heap.
+	void Release();
+
+	// Verifies every guard of a checked arena; false if one was overrun.
+	bool Check();
+
+	// Reported by pools.
+	void CountLeaks(uint64_t cLeaks) { m_stats.cLeaks += cLeaks; }
+	void CountBadDelete() { m_stats.cBadDeletes++; }
+
+	ArenaStats GetStats() const;
+
+private:
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+	struct Chunk
+	{
+		Chunk*		pNext;
+		size_t		cbSize;			// Bytes after the header
+		size_t		cbUsed;
+	};
+
+	struct Finalizer
+	{
+		Finalizer*	pNext;
+		void		(*pfnDestroy)(void*);
+		void*		pObject;
+	};
+
+	// In front of each allocation of a checked arena.
+	struct Guarded
+	{
+		Guarded*	pPrev;
+		size_t		cb;
+	};
+
+	template <typename T>
+	static void Destroy(void* p) { ((T*)p)->~T(); }
+
+	void* AllocateObject(size_t cb, size_t cbAlign, void (*pfnDestroy)(void*));
+	void Clear();
+	bool AddChunk(size_t cbMin);
+	void FreeChunks();
+
+	size_t		m_cbChunk;
+	bool		m_bCheck;
+	Chunk*		m_pChunks;			// Current chunk first
+	Finalizer*	m_pFinalizers;		// Newest first
+	Guarded*	m_pLastGuarded;
+	ArenaStats	m_stats;
+};
+
+
+//-------------------------------------------------------------------
+//
+// ObjectPool class
+//
+// Typed pool of T slots carved from an arena, a batch at a time. Deleted
+// objects go on a free list for the next New, so an object that is made
+// and dropped over and over costs no allocation after the first batch.
+// The slots go with the arena's memory; the pool must be destroyed or
+// cleared before the arena resets.
+//
+// Objects still live when the pool goes are counted as leaks in the
+// arena's stats and not destroyed. In a checked arena deletes of objects
+// that are not live are counted and ignored, and freed slots are filled
+// with 0xDD. Not thread-safe.
+//
+//-------------------------------------------------------------------
+
+template <typename T>
+class ObjectPool
+{
+public:
+	ObjectPool(Arena* pArena, size_t cBatch = 4) : m_pArena(pArena), m_pFree(nullptr), m_cBatch(cBatch ? cBatch : 1),
+		m_cLive(0), m_cSlots(0)
+	{
+	}
+
+	~ObjectPool() { Clear(); }
+
+	template <typename... Args>
+	T* New(Args&&... args)
+	{
+		if (!m_pFree && !Grow())
+			return nullptr;
+		Slot* pSlot = m_pFree;
+		m_pFree = pSlot->pNextFree;
+		pSlot->nState = SLOT_LIVE;
+		m_cLive++;
+		return new (&pSlot->storage) T(std::forward<Args>(args)...);
+	}
+
+	void Delete(T* p)
+	{
+		if (!p)
+			return;
+		Slot* pSlot = reinterpret_cast<Slot*>(p);
+		if (m_pArena->IsChecking() && pSlot->nState != SLOT_LIVE) {
+			m_pArena->CountBadDelete();
+			return;
+		}
+		p->~T();
+		if (m_pArena->IsChecking())
+			memset(&pSlot->storage, 0xDD, sizeof(pSlot->storage));
+		pSlot->nState = SLOT_FREE;
+		pSlot->pNextFree = m_pFree;
+		m_pFree = pSlot;
+		m_cLive--;
+	}
+
+	// Forgets every slot, counting the objects still live as leaks. Call
+	// before the arena resets if the pool outlives it.
+	void Clear()
+	{
+		if (m_cLive)
+			m_pArena->CountLeaks(m_cLive);
+		m_pFree = nullptr;
+		m_cLive = 0;
+		m_cSlots = 0;
+	}
+
+	size_t GetLiveCount() const { return m_cLive; }
+	size_t GetSlotCount() const { return m_cSlots; }
+
+private:
+	ObjectPool(const ObjectPool&);
+	ObjectPool& operator=(const ObjectPool&);
+
+	static const uint32_t SLOT_FREE = 0x45455246;	// "FREE"
+	static const uint32_t SLOT_LIVE = 0x4556494C;	// "LIVE"
+
+	// The object comes first, so a T* is its slot.
+	struct Slot
+	{
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type	storage;
+		Slot*		pNextFree;
+		uint32_t	nState;
+	};
+
+	bool Grow()
+	{
+		Slot* pSlots = (Slot*)m_pArena->Allocate(m_cBatch * sizeof(Slot), alignof(Slot));
+		if (!pSlots)
+			return false;
+		for (size_t i = m_cBatch; i-- > 0; ) {
+			pSlots[i].nState = SLOT_FREE;
+			pSlots[i].pNextFree = m_pFree;
+			m_pFree = &pSlots[i];
+		}
+		m_cSlots += m_cBatch;
+		return true;
+	}
+
+	Arena*		m_pArena;
+	Slot*		m_pFree;
+	size_t		m_cBatch;			// Slots carved at a time
+	size_t		m_cLive;
+	size_t		m_cSlots;
+};
@@ -0,0 +1,431 @@
+#include "pch.h"
+#include "LiveWallpaper.h"
+#include "ClipCache.h"
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mfreadwrite.h>
+#include <codecapi.h>
+#include <strmif.h>
+#include <chrono>
+
+#pragma comment(lib, "mfplat.lib")
+#pragma comment(lib, "mfreadwrite.lib")
+#pragma comment(lib, "mfuuid.lib")
+
+// Bits per pixel of the cached variant. Plenty for H.264 at desktop size;
+// the copy is for decoding cost, not for saving space.
+static const double CACHE_BITS_PER_PIXEL = 0.15;
+
+ClipCache::ClipCache() :
+	m_bStop(false),
+	m_bCancel(false),
+	m_nScaleDown(1)
+{
+}
+
+ClipCache::~ClipCache()
+{
+	Stop();
+}
+
+//-----------------------------------------------------------------------------
+// Start
+//
+// Sets the cache directory and target and starts the background thread.
+//-----------------------------------------------------------------------------
+
+bool ClipCache::Start(const std::wstring& directory, const CacheTarget& target)
+{
+	Stop();
+	if (directory.empty() || !CreateDirectories(directory))
+		return false;
+
+	m_cache.SetDirectory(directory);
+	m_target = target;
+	m_bStop = false;
+	m_bCancel = false;
+	m_thread = std::thread(&ClipCache::WorkerThread, this);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Stop
+//
+// Abandons the transcode in progress, whose partial file is removed, and
+// waits for the background thread.
+//-----------------------------------------------------------------------------
+
+void ClipCache::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStop = true;
+		m_queue.clear();
+	}
+	m_bCancel = true;
+	m_cv.notify_all();
+	if (m_thread.joinable())
+		m_thread.join();
+	m_cache.SetDirectory(std::wstring());
+}
+
+//-----------------------------------------------------------------------------
+// Resolve
+//-----------------------------------------------------------------------------
+
+std::wstring ClipCache::Resolve(const WCHAR* sURL)
+{
+	std::wstring url(sURL ? sURL : L"");
+	if (!IsEnabled() || !IsCacheable(url))
+		return url;
+
+	uint32_t nScaleDown = m_nScaleDown;
+	CacheTarget target = GetScaledTarget(nScaleDown);
+	CacheIndex index;
+	if (m_cache.FindFresh(url, target, &index))
+		return m_cache.GetMediaPath(url, target);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_bStop && m_seen.insert(m_cache.GetMediaPath(url, target)).second) {
+			QueuedClip clip = { url, target };
+			m_queue.push_back(clip);
+			m_cv.notify_one();
+		}
+	}
+
+	for (nScaleDown /= 2; nScaleDown >= 1; nScaleDown /= 2) {
+		CacheTarget larger = GetScaledTarget(nScaleDown);
+		if (m_cache.FindFresh(url, larger, &index))
+			return m_cache.GetMediaPath(url, larger);
+	}
+	return url;
+}
+
+CacheTarget ClipCache::GetScaledTarget(uint32_t nScaleDown) const
+{
+	CacheTarget target = m_target;
+	if (nScaleDown > 1 && target.cxDesktop && target.cyDesktop) {
+		target.cxDesktop = target.cxDesktop / nScaleDown > 2 ? target.cxDesktop / nScaleDown : 2;
+		target.cyDesktop = target.cyDesktop / nScaleDown > 2 ? target.cyDesktop / nScaleDown : 2;
+	}
+	return target;
+}
+
+// Local files only, and not files of the cache itself.
+bool ClipCache::IsCacheable(const std::wstring& url) const
+{
+	if (url.empty() || url.find(L"://") != std::wstring::npos)
+		return false;
+	const std::wstring& directory = m_cache.GetDirectory();
+	if (url.size() > directory.size() && _wcsnicmp(url.c_str(), directory.c_str(), directory.size()) == 0)
+		return false;
+	FileInfo info;
+	return GetFileInfo(url, &info);
+}
+
+//-----------------------------------------------------------------------------
+// WorkerThread
+//
+// Transcodes queued clips one at a time at background priority, which
+// also lowers its I/O priority so playback keeps reading first.
+//-----------------------------------------------------------------------------
+
+void ClipCache::WorkerThread()
+{
+	SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+	HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	bool bMFStarted = SUCCEEDED(MFStartup(MF_VERSION, MFSTARTUP_LITE));
+
+	for (;;) {
+		QueuedClip clip;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cv.wait(lock, [this] { return m_bStop || !m_queue.empty(); });
+			if (m_bStop)
+				break;
+			clip = m_queue.front();
+			m_queue.pop_front();
+		}
+
+		// A clip cached fine may be queued again once it changes.
+		CacheIndex index;
+		if (bMFStarted && !m_cache.FindFresh(clip.source, clip.target, &index) &&
+			SUCCEEDED(Transcode(clip.source, clip.target, &index))) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_seen.erase(m_cache.GetMediaPath(clip.source, clip.target));
+		}
+	}
+
+	if (bMFStarted)
+		MFShutdown();
+	if (SUCCEEDED(hrCom))
+		CoUninitialize();
+	SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+}
+
+//-----------------------------------------------------------------------------
+// Prepare
+//-----------------------------------------------------------------------------
+
+HRESULT ClipCache::Prepare(const std::wstring& source, TranscodeResult* pResult)
+{
+	if (!IsEnabled())
+		return E_UNEXPECTED;
+
+	auto start = std::chrono::steady_clock::now();
+	CacheIndex index;
+	HRESULT hr = Transcode(source, m_target, &index);
+	if (SUCCEEDED(hr) && pResult) {
+		pResult->cx = index.cx;
+		pResult->cy = index.cy;
+		pResult->cFrames = index.frames.size();
+		pResult->fSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Transcode
+//
+// The source reader decodes the first video stream to NV12, scaled to
+// the cache frame size by its video processor. Frames over the rate cap
+// are dropped the way FramePacer spreads them, and the rest are re-timed
+// evenly at the capped rate and encoded to H.264 Main with a keyframe
+// every nGopFrames. Audio is not kept; wallpapers play muted.
+//
+// The encoder writes to the entry's temp file, which Commit publishes
+// together with the index.
+//-----------------------------------------------------------------------------
+
+HRESULT ClipCache::Transcode(const std::wstring& source, const CacheTarget& target, CacheIndex* pIndex)
+{
+	const DWORD dwVideo = (DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM;
+
+	IMFAttributes* pReaderAttributes = NULL;
+	IMFAttributes* pWriterAttributes = NULL;
+	IMFSourceReader* pReader = NULL;
+	IMFSinkWriter* pWriter = NULL;
+	IMFMediaType* pNativeType = NULL;
+	IMFMediaType* pDecodedType = NULL;
+	IMFMediaType* pEncodedType = NULL;
+	ICodecAPI* pCodec = NULL;
+	DWORD nStream = 0;
+	UINT32 cxSource = 0, cySource = 0;
+	FrameRate sourceRate = { 30, 1 };
+	bool bWriting = false;
+
+	// Taken before reading, so a source that changes during the transcode
+	// leaves an entry that is already stale.
+	pIndex->source = source;
+	pIndex->target = target;
+	if (!GetFileInfo(source, &pIndex->sourceInfo))
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+	std::wstring temp = m_cache.GetTempPath(source, target);
+
+	HRESULT hr = MFCreateAttributes(&pReaderAttributes, 1);
+	if (SUCCEEDED(hr))
+		hr = pReaderAttributes->SetUINT32(MF_SOURCE_READER_ENABLE_ADVANCED_VIDEO_PROCESSING, TRUE);
+	if (SUCCEEDED(hr))
+		hr = MFCreateSourceReaderFromURL(source.c_str(), pReaderAttributes, &pReader);
+	if (SUCCEEDED(hr))
+		hr = pReader->SetStreamSelection((DWORD)MF_SOURCE_READER_ALL_STREAMS, FALSE);
+	if (SUCCEEDED(hr))
+		hr = pReader->SetStreamSelection(dwVideo, TRUE);
+	if (SUCCEEDED(hr))
+		hr = pReader->GetNativeMediaType(dwVideo, 0, &pNativeType);
+	if (SUCCEEDED(hr))
+		hr = MFGetAttributeSize(pNativeType, MF_MT_FRAME_SIZE, &cxSource, &cySource);
+	if (SUCCEEDED(hr)) {
+		UINT32 nNum = 0, nDen = 0;
+		if (SUCCEEDED(MFGetAttributeRatio(pNativeType, MF_MT_FRAME_RATE, &nNum, &nDen)) && nNum && nDen) {
+			sourceRate.nNum = nNum;
+			sourceRate.nDen = nDen;
+		}
+	}
+
+	FramePacer pacer;
+	pacer.SetRates(sourceRate, target.maxRate);
+	pIndex->rate = pacer.IsDecimating() ? target.maxRate : sourceRate;
+	GetCacheFrameSize(cxSource, cySource, target, &pIndex->cx, &pIndex->cy);
+
+	// Decoded and encoder input type.
+	if (SUCCEEDED(hr))
+		hr = MFCreateMediaType(&pDecodedType);
+	if (SUCCEEDED(hr))
+		hr = pDecodedType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+	if (SUCCEEDED(hr))
+		hr = pDecodedType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12);
+	if (SUCCEEDED(hr))
+		hr = pDecodedType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+	if (SUCCEEDED(hr))
+		hr = MFSetAttributeSize(pDecodedType, MF_MT_FRAME_SIZE, pIndex->cx, pIndex->cy);
+	if (SUCCEEDED(hr))
+		hr = MFSetAttributeRatio(pDecodedType, MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+	if (SUCCEEDED(hr))
+		hr = MFSetAttributeRatio(pDecodedType, MF_MT_FRAME_RATE, pIndex->rate.nNum, pIndex->rate.nDen);
+	if (SUCCEEDED(hr))
+		hr = pReader->SetCurrentMediaType(dwVideo, NULL, pDecodedType);
+
+	// Encoded type.
+	if (SUCCEEDED(hr))
+		hr = MFCreateMediaType(&pEncodedType);
+	if (SUCCEEDED(hr))
+		hr = pEncodedType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+	if (SUCCEEDED(hr))
+		hr = pEncodedType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_H264);
+	if (SUCCEEDED(hr))
+		hr = pEncodedType->SetUINT32(MF_MT_AVG_BITRATE,
+			(UINT32)(pIndex->cx * pIndex->cy * FrameRateToDouble(pIndex->rate) * CACHE_BITS_PER_PIXEL));
+	if (SUCCEEDED(hr))
+		hr = pEncodedType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+	if (SUCCEEDED(hr))
+		hr = pEncodedType->SetUINT32(MF_MT_MPEG2_PROFILE, eAVEncH264VProfile_Main);
+	if (SUCCEEDED(hr))
+		hr = MFSetAttributeSize(pEncodedType, MF_MT_FRAME_SIZE, pIndex->cx, pIndex->cy);
+	if (SUCCEEDED(hr))
+		hr = MFSetAttributeRatio(pEncodedType, MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+	if (SUCCEEDED(hr))
+		hr = MFSetAttributeRatio(pEncodedType, MF_MT_FRAME_RATE, pIndex->rate.nNum, pIndex->rate.nDen);
+
+	// Writer; no throttling, the transcode runs as fast as it can.
+	if (SUCCEEDED(hr))
+		hr = MFCreateAttributes(&pWriterAttributes, 1);
+	if (SUCCEEDED(hr))
+		hr = pWriterAttributes->SetUINT32(MF_SINK_WRITER_DISABLE_THROTTLING, TRUE);
+	if (SUCCEEDED(hr))
+		hr = MFCreateSinkWriterFromURL(temp.c_str(), NULL, pWriterAttributes, &pWriter);
+	if (SUCCEEDED(hr))
+		hr = pWriter->AddStream(pEncodedType, &nStream);
+	if (SUCCEEDED(hr))
+		hr = pWriter->SetInputMediaType(nStream, pDecodedType, NULL);
+
+	// The GOP size is a hint some encoders ignore; the index then marks
+	// keyframes the encoder may not have made, and seeks start earlier.
+	if (SUCCEEDED(hr) && SUCCEEDED(pWriter->GetServiceForStream(nStream, GUID_NULL, IID_PPV_ARGS(&pCodec)))) {
+		VARIANT var;
+		VariantInit(&var);
+		var.vt = VT_UI4;
+		var.ulVal = target.nGopFrames;
+		pCodec->SetValue(&CODECAPI_AVEncMPVGOPSize, &var);
+	}
+
+	if (SUCCEEDED(hr))
+		hr = pWriter->BeginWriting();
+	bWriting = SUCCEEDED(hr);
+
+	const FrameRate& rate = pIndex->rate;
+	const HNSTIME hnsFrame = (HNSTIME)(HNS_PER_SECOND * rate.nDen / rate.nNum);
+	const uint32_t nGop = target.nGopFrames ? target.nGopFrames : 1;
+	pIndex->frames.clear();
+
+	while (SUCCEEDED(hr)) {
+		DWORD dwFlags = 0;
+		LONGLONG hnsTime = 0;
+		IMFSample* pSample = NULL;
+		hr = pReader->ReadSample(dwVideo, 0, NULL, &dwFlags, &hnsTime, &pSample);
+		if (SUCCEEDED(hr) && m_bCancel)
+			hr = E_ABORT;
+		if (FAILED(hr) || (dwFlags & MF_SOURCE_READERF_ENDOFSTREAM)) {
+			SafeRelease(&pSample);
+			break;
+		}
+		if (pSample == NULL)
+			continue;
+
+		uint64_t nFrame = hnsTime > 0 ? (uint64_t)(((HNSTIME)hnsTime * sourceRate.nNum +
+			HNS_PER_SECOND * sourceRate.nDen / 2) / (HNS_PER_SECOND * sourceRate.nDen)) : 0;
+		if (pacer.ShouldPresent(nFrame)) {
+			uint64_t nOut = pIndex->frames.size();
+			CacheFrame frame;
+			frame.hnsTime = (HNSTIME)(nOut * HNS_PER_SECOND * rate.nDen / rate.nNum);
+			frame.hnsDuration = hnsFrame;
+			frame.bKeyframe = nOut % nGop == 0;
+			hr = pSample->SetSampleTime(frame.hnsTime);
+			if (SUCCEEDED(hr))
+				hr = pSample->SetSampleDuration(frame.hnsDuration);
+			if (SUCCEEDED(hr))
+				hr = pWriter->WriteSample(nStream, pSample);
+			if (SUCCEEDED(hr))
+				pIndex->frames.push_back(frame);
+		}
+		SafeRelease(&pSample);
+	}
+
+	if (SUCCEEDED(hr) && pIndex->frames.empty())
+		hr = MF_E_INVALIDSTREAMNUMBER;
+	if (bWriting && SUCCEEDED(hr))
+		hr = pWriter->Finalize();
+
+	SafeRelease(&pCodec);
+	SafeRelease(&pWriter);		// Closes the temp file
+	SafeRelease(&pEncodedType);
+	SafeRelease(&pDecodedType);
+	SafeRelease(&pNativeType);
+	SafeRelease(&pReader);
+	SafeRelease(&pWriterAttributes);
+	SafeRelease(&pReaderAttributes);
+
+	if (SUCCEEDED(hr) && !m_cache.Commit(temp, pIndex))
+		hr = E_FAIL;
+	if (FAILED(hr))
+		RemoveFile(temp);
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// MeasureDecode
+//
+// Decodes to NV12 at the native size, like the players, with the reader
+// on the calling thread so only decoding is timed.
+//-----------------------------------------------------------------------------
+
+HRESULT ClipCache::MeasureDecode(const WCHAR* sURL, uint64_t* pcFrames, double* pfSeconds)
+{
+	const DWORD dwVideo = (DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM;
+	IMFAttributes* pAttributes = NULL;
+	IMFSourceReader* pReader = NULL;
+	IMFMediaType* pType = NULL;
+	uint64_t cFrames = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	HRESULT hr = MFCreateAttributes(&pAttributes, 1);
+	if (SUCCEEDED(hr))
+		hr = pAttributes->SetUINT32(MF_SOURCE_READER_ENABLE_VIDEO_PROCESSING, TRUE);
+	if (SUCCEEDED(hr))
+		hr = MFCreateSourceReaderFromURL(sURL, pAttributes, &pReader);
+	if (SUCCEEDED(hr))
+		hr = pReader->SetStreamSelection((DWORD)MF_SOURCE_READER_ALL_STREAMS, FALSE);
+	if (SUCCEEDED(hr))
+		hr = pReader->SetStreamSelection(dwVideo, TRUE);
+	if (SUCCEEDED(hr))
+		hr = MFCreateMediaType(&pType);
+	if (SUCCEEDED(hr))
+		hr = pType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+	if (SUCCEEDED(hr))
+		hr = pType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12);
+	if (SUCCEEDED(hr))
+		hr = pReader->SetCurrentMediaType(dwVideo, NULL, pType);
+
+	while (SUCCEEDED(hr)) {
+		DWORD dwFlags = 0;
+		LONGLONG hnsTime = 0;
+		IMFSample* pSample = NULL;
+		hr = pReader->ReadSample(dwVideo, 0, NULL, &dwFlags, &hnsTime, &pSample);
+		if (pSample)
+			cFrames++;
+		SafeRelease(&pSample);
+		if (dwFlags & MF_SOURCE_READERF_ENDOFSTREAM)
+			break;
+	}
+
+	SafeRelease(&pType);
+	SafeRelease(&pReader);
+	SafeRelease(&pAttributes);
+
+	if (pcFrames)
+		*pcFrames = cFrames;
+	if (pfSeconds)
+		*pfSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return hr;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "TranscodeCache.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+
+// Result of a transcode into the cache.
+struct TranscodeResult
+{
+	uint32_t	cx;				// Frame size of the cached variant
+	uint32_t	cy;
+	uint64_t	cFrames;
+	double		fSeconds;		// Wall time of the transcode
+};
+
+
+//-------------------------------------------------------------------
+//
+// ClipCache class
+//
+// Keeps wallpaper-optimized copies of local clips: scaled down to the
+// desktop, capped in frame rate and encoded as H.264 with a short GOP,
+// which is cheap to decode and to seek back to the start of.
+//
+// Resolve hands the players the cached copy of a clip when a fresh one
+// exists. Otherwise it returns the clip itself and queues it for a
+// background thread, which transcodes at background priority so the
+// next play of the clip finds it.
+//
+// With a scale-down set, Resolve asks for a variant at that fraction of
+// the desktop size instead, and falls back to the larger variants that
+// are fresh while it is transcoded.
+//
+// Resolve may be called from any thread.
+//
+//-------------------------------------------------------------------
+
+class ClipCache
+{
+public:
+	ClipCache();
+	~ClipCache();
+
+	// Turns the cache on, in a directory that is created if missing.
+	bool Start(const std::wstring& directory, const CacheTarget& target);
+	void Stop();
+	bool IsEnabled() const { return m_cache.IsEnabled(); }
+	const CacheTarget& GetTarget() const { return m_target; }
+
+	// Path to open for a clip: its cached copy if fresh, else the clip.
+	std::wstring Resolve(const WCHAR* sURL);
+
+	// Variant Resolve asks for: 1/n of the desktop size, n a power of 2.
+	void SetScaleDown(uint32_t nScaleDown) { m_nScaleDown = nScaleDown ? nScaleDown : 1; }
+	uint32_t GetScaleDown() const { return m_nScaleDown; }
+
+	// Transcodes a clip into the cache on the calling thread, fresh or not.
+	// Needs COM and Media Foundation started.
+	HRESULT Prepare(const std::wstring& source, TranscodeResult* pResult);
+
+	// Path of the cached copy of a clip, whether it exists or not.
+	std::wstring GetCachedPath(const std::wstring& source) const { return m_cache.GetMediaPath(source, m_target); }
+
+	// Decodes every video frame of a clip as fast as it can, which is
+	// what playing it once costs.
+	static HRESULT MeasureDecode(const WCHAR* sURL, uint64_t* pcFrames, double* pfSeconds);
+
+private:
+	struct QueuedClip
+	{
+		std::wstring	source;
+		CacheTarget		target;
+	};
+
+	CacheTarget GetScaledTarget(uint32_t nScaleDown) const;
+	HRESULT Transcode(const std::wstring& source, const CacheTarget& target, CacheIndex* pIndex);
+	void WorkerThread();
+	bool IsCacheable(const std::wstring& url) const;
+
+	TranscodeCache				m_cache;
+	CacheTarget					m_target;
+	std::mutex					m_mutex;		// Guards the queue
+	std::condition_variable		m_cv;
+	std::deque<QueuedClip>		m_queue;
+	std::set<std::wstring>		m_seen;			// Variants queued once, so a failing clip is not retried
+	std::atomic<uint32_t>		m_nScaleDown;
+	bool						m_bStop;
+	std::atomic<bool>			m_bCancel;		// Abandons the transcode in progress
+	std::thread					m_thread;
+};
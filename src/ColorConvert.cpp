@@ -0,0 +1,52 @@
+#include "ColorConvert.h"
+#include "ColorKernels.h"
+
+
+static int Fixed(double f)
+{
+	return (int)(f * (1 << COEF_BITS) + (f < 0.0 ? -0.5 : 0.5));
+}
+
+//-----------------------------------------------------------------------------
+// GetCoefficients
+//
+// R = Y + (2 - 2Kr) V, B = Y + (2 - 2Kb) U and G from the luma equation,
+// with studio range expanded to full range.
+//-----------------------------------------------------------------------------
+
+static ColorCoefficients GetCoefficients(COLOR_MATRIX matrix, bool bFullRange)
+{
+	double kr = matrix == COLOR_MATRIX_BT709 ? 0.2126 : 0.299;
+	double kb = matrix == COLOR_MATRIX_BT709 ? 0.0722 : 0.114;
+	double kg = 1.0 - kr - kb;
+	double fY = bFullRange ? 1.0 : 255.0 / 219.0;
+	double fC = bFullRange ? 1.0 : 255.0 / 224.0;
+
+	ColorCoefficients coef;
+	coef.nYOffset = bFullRange ? 0 : 16;
+	coef.nY = Fixed(fY);
+	coef.nRV = Fixed(fC * (2.0 - 2.0 * kr));
+	coef.nGU = Fixed(fC * (2.0 - 2.0 * kb) * kb / kg);
+	coef.nGV = Fixed(fC * (2.0 - 2.0 * kr) * kr / kg);
+	coef.nBU = Fixed(fC * (2.0 - 2.0 * kb));
+	return coef;
+}
+
+void ConvertYCbCrToBGRA(const YCbCrImage& src, uint32_t yBegin, uint32_t yEnd, uint8_t* pDst, size_t cbDstStride)
+{
+	const ColorCoefficients coef = GetCoefficients(src.matrix, src.bFullRange);
+	const ColorKernelTable& kernels = GetColorKernels();
+	if (yEnd > src.cy)
+		yEnd = src.cy;
+
+	YCbCrRow row;
+	row.cx = src.cx;
+	row.nShiftX = src.nShiftX;
+	row.cbChromaStep = src.bInterleaved ? 2 : 1;
+	for (uint32_t y = yBegin; y < yEnd; y++) {
+		row.pY = src.pY + y * src.cbStrideY;
+		row.pCb = src.pCb ? src.pCb + (y >> src.nShiftY) * src.cbStrideC : NULL;
+		row.pCr = src.pCb ? (src.bInterleaved ? row.pCb + 1 : src.pCr + (y >> src.nShiftY) * src.cbStrideC) : NULL;
+		kernels.pfnConvertRow(row, coef, pDst + y * cbDstStride);
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+
+// YCbCr to RGB matrix of the source.
+enum COLOR_MATRIX
+{
+	COLOR_MATRIX_BT601 = 0,		// SD
+	COLOR_MATRIX_BT709			// HD
+};
+
+// 8-bit YCbCr picture. The chroma planes are subsampled by 1 << nShiftX
+// horizontally and 1 << nShiftY vertically; without chroma planes the
+// picture is grayscale. NV12 keeps Cb and Cr interleaved in one plane.
+struct YCbCrImage
+{
+	const uint8_t*	pY;
+	const uint8_t*	pCb;		// NULL = grayscale
+	const uint8_t*	pCr;
+	size_t			cbStrideY;
+	size_t			cbStrideC;
+	uint32_t		cx;
+	uint32_t		cy;
+	uint32_t		nShiftX;
+	uint32_t		nShiftY;
+	COLOR_MATRIX	matrix;
+	bool			bFullRange;	// 0-255 instead of studio range 16-235
+	bool			bInterleaved;	// CbCr pairs at pCb, pCr = pCb + 1 (NV12)
+};
+
+
+//-------------------------------------------------------------------
+// ConvertYCbCrToBGRA
+//
+// Converts rows [yBegin, yEnd) of src to 32-bit BGRA with opaque alpha.
+// Row y is written to pDst + y * cbDstStride, so disjoint row ranges can
+// be converted on separate threads into the same picture. Runs on the
+// kernels GetKernelIsa() selects.
+//-------------------------------------------------------------------
+
+void ConvertYCbCrToBGRA(const YCbCrImage& src, uint32_t yBegin, uint32_t yEnd, uint8_t* pDst, size_t cbDstStride);
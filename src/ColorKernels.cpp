@@ -0,0 +1,395 @@
+#include "ColorKernels.h"
+#include "ColorConvert.h"
+#include "ImageScaler.h"
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#if COLOR_KERNELS_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+
+static inline uint8_t Clamp8(int n)
+{
+	return (uint8_t)(n < 0 ? 0 : n > 255 ? 255 : n);
+}
+
+
+//********************* Scalar reference kernels **********************//
+
+void ConvertRowScalar(const YCbCrRow& row, const ColorCoefficients& coef, uint32_t xBegin, uint8_t* pOut)
+{
+	const int nRound = 1 << (COEF_BITS - 1);
+	pOut += (size_t)xBegin * 4;
+	for (uint32_t x = xBegin; x < row.cx; x++) {
+		size_t nChroma = (size_t)(x >> row.nShiftX) * row.cbChromaStep;
+		int nY = (row.pY[x] - coef.nYOffset) * coef.nY + nRound;
+		int nU = row.pCb ? row.pCb[nChroma] - 128 : 0;
+		int nV = row.pCr ? row.pCr[nChroma] - 128 : 0;
+		pOut[0] = Clamp8((nY + nU * coef.nBU) >> COEF_BITS);
+		pOut[1] = Clamp8((nY - nU * coef.nGU - nV * coef.nGV) >> COEF_BITS);
+		pOut[2] = Clamp8((nY + nV * coef.nRV) >> COEF_BITS);
+		pOut[3] = 255;
+		pOut += 4;
+	}
+}
+
+void BlendRowsScalar(const uint8_t* pA, const uint8_t* pB, uint32_t nWeightB, int16_t* pOut, size_t cValues)
+{
+	const int nWeightA = (1 << BILINEAR_BITS) - (int)nWeightB;
+	for (size_t i = 0; i < cValues; i++)
+		pOut[i] = (int16_t)(pA[i] * nWeightA + pB[i] * (int)nWeightB);
+}
+
+void BlendColumnsScalar(const int16_t* pRow, const BilinearTap* pTaps, uint32_t cxDst, uint8_t* pOut)
+{
+	const int nRound = 1 << (2 * BILINEAR_BITS - 1);
+	for (uint32_t x = 0; x < cxDst; x++) {
+		const int16_t* p = pRow + (size_t)pTaps[x].x0 * 4;
+		int nWeightB = (int)pTaps[x].nWeight;
+		int nWeightA = (1 << BILINEAR_BITS) - nWeightB;
+		for (int c = 0; c < 4; c++)
+			pOut[c] = Clamp8((p[c] * nWeightA + p[c + 4] * nWeightB + nRound) >> (2 * BILINEAR_BITS));
+		pOut += 4;
+	}
+}
+
+void AccumulateRowScalar(const uint8_t* pSrc, uint32_t* pSum, size_t cValues)
+{
+	for (size_t i = 0; i < cValues; i++)
+		pSum[i] += pSrc[i];
+}
+
+void AreaColumnsScalar(const uint32_t* pSum, const AreaTap* pTaps, const uint32_t* pRecip, uint32_t cxDst, uint8_t* pOut)
+{
+	const uint64_t nRound = 1ull << (AREA_BITS - 1);
+	for (uint32_t x = 0; x < cxDst; x++) {
+		const uint32_t* p = pSum + (size_t)pTaps[x].x0 * 4;
+		uint32_t sum[4] = {};
+		for (uint32_t i = 0; i < pTaps[x].cx; i++, p += 4) {
+			for (int c = 0; c < 4; c++)
+				sum[c] += p[c];
+		}
+		for (int c = 0; c < 4; c++) {
+			uint64_t n = ((uint64_t)sum[c] * pRecip[x] + nRound) >> AREA_BITS;
+			pOut[c] = (uint8_t)(n > 255 ? 255 : n);
+		}
+		pOut += 4;
+	}
+}
+
+// (t + 128) / 255 for t up to 255 * 255, in 16-bit steps the SIMD
+// kernels repeat.
+static inline uint32_t Div255(uint32_t t)
+{
+	t += 128;
+	return (t + (t >> 8)) >> 8;
+}
+
+void BlendOverScalar(const uint8_t* pSrc, uint8_t* pDst, uint32_t cx)
+{
+	for (uint32_t x = 0; x < cx; x++, pSrc += 4, pDst += 4) {
+		uint32_t nInverse = 255 - pSrc[3];
+		for (int c = 0; c < 4; c++) {
+			uint32_t n = pSrc[c] + Div255(pDst[c] * nInverse);
+			pDst[c] = (uint8_t)(n > 255 ? 255 : n);
+		}
+	}
+}
+
+void PlasmaRowScalar(const uint8_t* pA, const uint8_t* pB, uint32_t nBase, const PlasmaPalette& palette, uint32_t cx,
+	uint8_t* pOut)
+{
+	for (uint32_t x = 0; x < cx; x++, pOut += 4) {
+		int nValue2 = 2 * (int)(pA[x] + pB[x] + nBase);
+		for (int c = 0; c < 3; c++) {
+			int w = ((nValue2 + palette.nPhase[c]) & 511) - 256;
+			int n = 255 - (w < 0 ? -w : w);
+			pOut[c] = (uint8_t)(n < 0 ? 0 : n);
+		}
+		pOut[3] = 255;
+	}
+}
+
+static void ConvertRowReference(const YCbCrRow& row, const ColorCoefficients& coef, uint8_t* pOut)
+{
+	ConvertRowScalar(row, coef, 0, pOut);
+}
+
+
+//********************* Dispatch **********************//
+
+//-----------------------------------------------------------------------------
+// DetectIsas
+//
+// Bit per supported KERNEL_ISA. AVX2 also needs the OS to save the YMM
+// registers.
+//-----------------------------------------------------------------------------
+
+static uint32_t DetectIsas()
+{
+	uint32_t nIsas = 1u << KERNEL_ISA_SCALAR;
+#if COLOR_KERNELS_X86
+	unsigned int regs[4] = {};
+#if defined(_MSC_VER)
+	__cpuid((int*)regs, 1);
+#else
+	__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+	if (regs[3] & (1u << 26))
+		nIsas |= 1u << KERNEL_ISA_SSE2;
+
+	bool bOsYmm = false;
+	if (regs[2] & (1u << 27)) {		// OSXSAVE
+#if defined(_MSC_VER)
+		bOsYmm = (_xgetbv(0) & 6) == 6;
+#else
+		unsigned int nLow = 0, nHigh = 0;
+		__asm__("xgetbv" : "=a"(nLow), "=d"(nHigh) : "c"(0));
+		bOsYmm = (nLow & 6) == 6;
+#endif
+	}
+
+	unsigned int ext[4] = {};
+#if defined(_MSC_VER)
+	__cpuidex((int*)ext, 7, 0);
+#else
+	__get_cpuid_count(7, 0, &ext[0], &ext[1], &ext[2], &ext[3]);
+#endif
+	if (bOsYmm && (ext[1] & (1u << 5)) && (nIsas & (1u << KERNEL_ISA_SSE2)))
+		nIsas |= 1u << KERNEL_ISA_AVX2;
+#endif
+	return nIsas;
+}
+
+struct KernelDispatch
+{
+	uint32_t						nIsas;
+	ColorKernelTable				tables[KERNEL_ISA_COUNT];
+	std::atomic<KERNEL_ISA>			isa;
+
+	KernelDispatch() : nIsas(DetectIsas()), isa(KERNEL_ISA_SCALAR)
+	{
+		ColorKernelTable& scalar = tables[KERNEL_ISA_SCALAR];
+		scalar.pfnConvertRow = ConvertRowReference;
+		scalar.pfnBlendRows = BlendRowsScalar;
+		scalar.pfnBlendColumns = BlendColumnsScalar;
+		scalar.pfnAccumulateRow = AccumulateRowScalar;
+		scalar.pfnAreaColumns = AreaColumnsScalar;
+		scalar.pfnBlendOver = BlendOverScalar;
+		scalar.pfnPlasmaRow = PlasmaRowScalar;
+		tables[KERNEL_ISA_SSE2] = scalar;
+		tables[KERNEL_ISA_AVX2] = scalar;
+#if COLOR_KERNELS_X86
+		GetSSE2Kernels(&tables[KERNEL_ISA_SSE2]);
+		tables[KERNEL_ISA_AVX2] = tables[KERNEL_ISA_SSE2];
+		GetAVX2Kernels(&tables[KERNEL_ISA_AVX2]);
+#endif
+		for (int i = KERNEL_ISA_COUNT - 1; i >= 0; i--) {
+			if (nIsas & (1u << i)) {
+				isa = (KERNEL_ISA)i;
+				break;
+			}
+		}
+	}
+};
+
+static KernelDispatch& GetDispatch()
+{
+	static KernelDispatch s_dispatch;
+	return s_dispatch;
+}
+
+const ColorKernelTable& GetColorKernels()
+{
+	KernelDispatch& dispatch = GetDispatch();
+	return dispatch.tables[dispatch.isa.load(std::memory_order_relaxed)];
+}
+
+KERNEL_ISA GetKernelIsa()
+{
+	return GetDispatch().isa;
+}
+
+bool IsKernelIsaSupported(KERNEL_ISA isa)
+{
+	return isa >= 0 && isa < KERNEL_ISA_COUNT && (GetDispatch().nIsas & (1u << isa)) != 0;
+}
+
+bool SetKernelIsa(KERNEL_ISA isa)
+{
+	if (!IsKernelIsaSupported(isa))
+		return false;
+	GetDispatch().isa = isa;
+	return true;
+}
+
+const char* GetKernelIsaName(KERNEL_ISA isa)
+{
+	switch (isa) {
+	case KERNEL_ISA_SCALAR:
+		return "scalar";
+	case KERNEL_ISA_SSE2:
+		return "sse2";
+	case KERNEL_ISA_AVX2:
+		return "avx2";
+	default:
+		return "?";
+	}
+}
+
+
+//********************* Benchmark **********************//
+
+enum BENCH_KERNEL
+{
+	BENCH_KERNEL_I420 = 0,
+	BENCH_KERNEL_NV12,
+	BENCH_KERNEL_BILINEAR,
+	BENCH_KERNEL_AREA,
+	BENCH_KERNEL_BLEND_OVER,
+	BENCH_KERNEL_PLASMA,
+	BENCH_KERNEL_COUNT
+};
+
+static const char* const s_benchKernels[BENCH_KERNEL_COUNT] = {
+	"i420-bgra", "nv12-bgra", "scale-bilinear", "scale-area", "blend-over", "plasma"
+};
+
+// Runs one kernel over the bench picture into pOut.
+static void RunBenchKernel(BENCH_KERNEL kernel, const std::vector<uint8_t>& planes, const std::vector<uint8_t>& nv12,
+	const std::vector<uint8_t>& bgra, const std::vector<uint8_t>& over, uint32_t cx, uint32_t cy, BGRAScaler* pScalers,
+	uint8_t* pOut)
+{
+	uint32_t cxChroma = (cx + 1) / 2, cyChroma = (cy + 1) / 2;
+	YCbCrImage image = YCbCrImage();
+	image.pY = kernel == BENCH_KERNEL_NV12 ? nv12.data() : planes.data();
+	image.cbStrideY = cx;
+	image.cx = cx;
+	image.cy = cy;
+	image.nShiftX = 1;
+	image.nShiftY = 1;
+	image.matrix = COLOR_MATRIX_BT709;
+
+	switch (kernel) {
+	case BENCH_KERNEL_I420:
+		image.pCb = planes.data() + (size_t)cx * cy;
+		image.pCr = image.pCb + (size_t)cxChroma * cyChroma;
+		image.cbStrideC = cxChroma;
+		ConvertYCbCrToBGRA(image, 0, cy, pOut, (size_t)cx * 4);
+		break;
+	case BENCH_KERNEL_NV12:
+		image.pCb = nv12.data() + (size_t)cx * cy;
+		image.pCr = image.pCb + 1;
+		image.cbStrideC = (size_t)cxChroma * 2;
+		image.bInterleaved = true;
+		ConvertYCbCrToBGRA(image, 0, cy, pOut, (size_t)cx * 4);
+		break;
+	case BENCH_KERNEL_BILINEAR:
+		pScalers[0].Scale(bgra.data(), (size_t)cx * 4, pOut, (size_t)pScalers[0].GetOutputWidth() * 4);
+		break;
+	case BENCH_KERNEL_AREA:
+		pScalers[1].Scale(bgra.data(), (size_t)cx * 4, pOut, (size_t)pScalers[1].GetOutputWidth() * 4);
+		break;
+	case BENCH_KERNEL_BLEND_OVER:
+		GetColorKernels().pfnBlendOver(over.data(), pOut, cx * cy);
+		break;
+	case BENCH_KERNEL_PLASMA:
+	{
+		static const PlasmaPalette palette = { { 0, 170, 340 } };
+		for (uint32_t y = 0; y < cy; y++) {
+			GetColorKernels().pfnPlasmaRow(planes.data() + (size_t)y * cx, nv12.data() + (size_t)y * cx, y & 255,
+				palette, cx, pOut + (size_t)y * cx * 4);
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+size_t RunKernelBench(uint32_t cx, uint32_t cy, uint32_t cPasses, KernelBenchResult* pResults, size_t cMaxResults)
+{
+	if (cx < 3 || cy < 3)
+		return 0;
+	if (!cPasses)
+		cPasses = 1;
+
+	// Deterministic noise, so every byte path is exercised.
+	uint32_t nSeed = 12345;
+	size_t cbPlanes = (size_t)cx * cy + (size_t)((cx + 1) / 2) * ((cy + 1) / 2) * 2;
+	std::vector<uint8_t> planes(cbPlanes), nv12(cbPlanes), bgra((size_t)cx * cy * 4);
+	std::vector<uint8_t> over(bgra.size()), under(bgra.size());
+	for (size_t i = 0; i < cbPlanes; i++) {
+		nSeed = nSeed * 1664525 + 1013904223;
+		planes[i] = (uint8_t)(nSeed >> 24);
+		nv12[i] = (uint8_t)(nSeed >> 16);
+	}
+	for (size_t i = 0; i < bgra.size(); i++) {
+		nSeed = nSeed * 1664525 + 1013904223;
+		bgra[i] = (uint8_t)(nSeed >> 24);
+		under[i] = (uint8_t)(nSeed >> 16);
+	}
+
+	// The blend's source is premultiplied, with some transparent and some
+	// opaque pixels.
+	for (size_t i = 0; i < over.size(); i += 4) {
+		uint32_t nAlpha = bgra[i + 3] < 32 ? 0 : bgra[i + 3] > 224 ? 255 : bgra[i + 3];
+		for (int c = 0; c < 3; c++)
+			over[i + c] = (uint8_t)(bgra[i + c] * nAlpha / 255);
+		over[i + 3] = (uint8_t)nAlpha;
+	}
+
+	uint32_t cxDst = cx * 2 / 3, cyDst = cy * 2 / 3;
+	BGRAScaler scalers[2];
+	scalers[0].Init(cx, cy, cxDst, cyDst, SCALE_FILTER_BILINEAR);
+	scalers[1].Init(cx, cy, cxDst, cyDst, SCALE_FILTER_AREA);
+
+	const KERNEL_ISA isaSaved = GetKernelIsa();
+	std::vector<uint8_t> reference((size_t)cx * cy * 4), output(reference.size());
+	size_t cResults = 0;
+
+	for (int k = 0; k < BENCH_KERNEL_COUNT; k++) {
+		BENCH_KERNEL kernel = (BENCH_KERNEL)k;
+		bool bScale = kernel == BENCH_KERNEL_BILINEAR || kernel == BENCH_KERNEL_AREA;
+		uint64_t cPixels = bScale ? (uint64_t)cxDst * cyDst : (uint64_t)cx * cy;
+
+		// The blend works in place over the picture under it.
+		bool bInPlace = kernel == BENCH_KERNEL_BLEND_OVER;
+		SetKernelIsa(KERNEL_ISA_SCALAR);
+		if (bInPlace)
+			memcpy(reference.data(), under.data(), under.size());
+		RunBenchKernel(kernel, planes, nv12, bgra, over, cx, cy, scalers, reference.data());
+
+		for (int i = 0; i < KERNEL_ISA_COUNT && cResults < cMaxResults; i++) {
+			if (!SetKernelIsa((KERNEL_ISA)i))
+				continue;
+			if (bInPlace)
+				memcpy(output.data(), under.data(), under.size());
+			else
+				memset(output.data(), 0, output.size());
+			RunBenchKernel(kernel, planes, nv12, bgra, over, cx, cy, scalers, output.data());
+			bool bExact = memcmp(output.data(), reference.data(), (size_t)cPixels * 4) == 0;
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (uint32_t n = 0; n < cPasses; n++)
+				RunBenchKernel(kernel, planes, nv12, bgra, over, cx, cy, scalers, output.data());
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+			KernelBenchResult& result = pResults[cResults++];
+			result.pszKernel = s_benchKernels[k];
+			result.isa = (KERNEL_ISA)i;
+			result.fMegapixelsPerSecond = elapsed.count() > 0.0 ? cPixels * cPasses / elapsed.count() / 1e6 : 0.0;
+			result.bExact = bExact;
+		}
+	}
+
+	SetKernelIsa(isaSaved);
+	return cResults;
+}
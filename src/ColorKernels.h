@@ -0,0 +1,158 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define COLOR_KERNELS_X86 1
+#endif
+
+// Instruction set of the pixel kernels.
+enum KERNEL_ISA
+{
+	KERNEL_ISA_SCALAR = 0,		// Reference, every CPU
+	KERNEL_ISA_SSE2,
+	KERNEL_ISA_AVX2,
+	KERNEL_ISA_COUNT
+};
+
+// Best instruction set of this CPU, unless SetKernelIsa picked another.
+KERNEL_ISA GetKernelIsa();
+
+// Forces the kernels of an instruction set, e.g. the scalar reference.
+// Returns false if the CPU does not support it.
+bool SetKernelIsa(KERNEL_ISA isa);
+bool IsKernelIsaSupported(KERNEL_ISA isa);
+const char* GetKernelIsaName(KERNEL_ISA isa);
+
+
+struct KernelBenchResult
+{
+	const char*	pszKernel;
+	KERNEL_ISA	isa;
+	double		fMegapixelsPerSecond;	// Output pixels
+	bool		bExact;					// Output identical to the scalar kernel
+};
+
+//-------------------------------------------------------------------
+// RunKernelBench
+//
+// Runs every kernel on every supported instruction set cPasses times
+// over a cx x cy synthetic picture; the scalers shrink it to 2/3 and the
+// blend draws a translucent picture over it. Fills up to cMaxResults
+// results and returns their number.
+//-------------------------------------------------------------------
+
+size_t RunKernelBench(uint32_t cx, uint32_t cy, uint32_t cPasses, KernelBenchResult* pResults, size_t cMaxResults);
+
+
+//********************* Kernel interface **********************//
+
+// Fixed-point YCbCr to RGB coefficients, scaled by 1 << COEF_BITS.
+static const int COEF_BITS = 13;
+
+struct ColorCoefficients
+{
+	int		nYOffset;
+	int		nY;			// Luma scale
+	int		nRV;		// Cr to red
+	int		nGU;		// Cb to green
+	int		nGV;		// Cr to green
+	int		nBU;		// Cb to blue
+};
+
+// One row of a YCbCr picture. Chroma sample x >> nShiftX is at
+// pCb[(x >> nShiftX) * cbChromaStep]; NV12 has pCr = pCb + 1 and a step
+// of 2.
+struct YCbCrRow
+{
+	const uint8_t*	pY;
+	const uint8_t*	pCb;		// NULL = grayscale
+	const uint8_t*	pCr;
+	uint32_t		cx;
+	uint32_t		nShiftX;
+	uint32_t		cbChromaStep;
+};
+
+// Bilinear weights are out of 1 << BILINEAR_BITS, so a vertical blend of
+// two bytes fits a signed 16-bit value.
+static const int BILINEAR_BITS = 7;
+
+// Output pixel of a bilinear row: source pixels x0 and x0 + 1.
+struct BilinearTap
+{
+	uint32_t	x0;
+	uint32_t	nWeight;	// Of pixel x0 + 1
+};
+
+// Output pixel of an area row: the sum of cx source pixels from x0.
+struct AreaTap
+{
+	uint32_t	x0;
+	uint32_t	cx;
+};
+
+// Area averages are sums times a reciprocal scaled by 1 << AREA_BITS.
+static const int AREA_BITS = 20;
+
+// Plasma palette: channel c of value v is a triangle wave of 2v shifted
+// by nPhase[c], 0-511, in B, G, R order.
+struct PlasmaPalette
+{
+	uint16_t	nPhase[3];
+};
+
+//-------------------------------------------------------------------
+//
+// ColorKernelTable struct
+//
+// Row kernels of one instruction set. Every variant produces the same
+// bytes as the scalar one; only the speed differs.
+//
+//   ConvertRow      YCbCr row to BGRA.
+//   BlendRows       pOut[i] = pA[i] * (128 - nWeightB) + pB[i] * nWeightB
+//                   for cValues bytes.
+//   BlendColumns    Blended row (4 values per pixel plus one padding
+//                   pixel) to cxDst BGRA pixels.
+//   AccumulateRow   pSum[i] += pSrc[i] for cValues bytes.
+//   AreaColumns     Column sums to cxDst BGRA pixels, pixel x scaled
+//                   by pRecip[x].
+//   BlendOver       Premultiplied BGRA pSrc over pDst in place, cx
+//                   pixels: d = min(255, s + d * (255 - sA) / 255),
+//                   the division rounded.
+//   PlasmaRow       cx opaque BGRA pixels of v = pA[x] + pB[x] + nBase,
+//                   nBase up to 255: channel c is
+//                   max(0, 255 - |((2v + nPhase[c]) & 511) - 256|).
+//
+//-------------------------------------------------------------------
+
+struct ColorKernelTable
+{
+	void (*pfnConvertRow)(const YCbCrRow& row, const ColorCoefficients& coef, uint8_t* pOut);
+	void (*pfnBlendRows)(const uint8_t* pA, const uint8_t* pB, uint32_t nWeightB, int16_t* pOut, size_t cValues);
+	void (*pfnBlendColumns)(const int16_t* pRow, const BilinearTap* pTaps, uint32_t cxDst, uint8_t* pOut);
+	void (*pfnAccumulateRow)(const uint8_t* pSrc, uint32_t* pSum, size_t cValues);
+	void (*pfnAreaColumns)(const uint32_t* pSum, const AreaTap* pTaps, const uint32_t* pRecip, uint32_t cxDst, uint8_t* pOut);
+	void (*pfnBlendOver)(const uint8_t* pSrc, uint8_t* pDst, uint32_t cx);
+	void (*pfnPlasmaRow)(const uint8_t* pA, const uint8_t* pB, uint32_t nBase, const PlasmaPalette& palette,
+		uint32_t cx, uint8_t* pOut);
+};
+
+// Kernels of the selected instruction set.
+const ColorKernelTable& GetColorKernels();
+
+// Scalar reference kernels. The SIMD kernels finish their rows with them,
+// starting at the first pixel or value they did not handle.
+void ConvertRowScalar(const YCbCrRow& row, const ColorCoefficients& coef, uint32_t xBegin, uint8_t* pOut);
+void BlendRowsScalar(const uint8_t* pA, const uint8_t* pB, uint32_t nWeightB, int16_t* pOut, size_t cValues);
+void BlendColumnsScalar(const int16_t* pRow, const BilinearTap* pTaps, uint32_t cxDst, uint8_t* pOut);
+void AccumulateRowScalar(const uint8_t* pSrc, uint32_t* pSum, size_t cValues);
+void AreaColumnsScalar(const uint32_t* pSum, const AreaTap* pTaps, const uint32_t* pRecip, uint32_t cxDst, uint8_t* pOut);
+void BlendOverScalar(const uint8_t* pSrc, uint8_t* pDst, uint32_t cx);
+void PlasmaRowScalar(const uint8_t* pA, const uint8_t* pB, uint32_t nBase, const PlasmaPalette& palette, uint32_t cx,
+	uint8_t* pOut);
+
+#if COLOR_KERNELS_X86
+void GetSSE2Kernels(ColorKernelTable* pTable);
+void GetAVX2Kernels(ColorKernelTable* pTable);
+#endif
@@ -0,0 +1,262 @@
+#include "ColorKernels.h"
+
+#if COLOR_KERNELS_X86
+
+// The kernels below are built for AVX2 and only called on CPUs that have
+// it. Library headers stay above, so no inline library code is built
+// for AVX2 and shared with other files.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#include <immintrin.h>
+
+
+//-----------------------------------------------------------------------------
+// StoreBGRA
+//
+// Clamps 16 pixels of 16-bit B, G and R to bytes and stores them as BGRA
+// with opaque alpha. Packing works per 128-bit lane, so the two halves
+// are put back in order at the end.
+//-----------------------------------------------------------------------------
+
+static inline void StoreBGRA(__m256i b, __m256i g, __m256i r, uint8_t* pOut)
+{
+	__m256i bg = _mm256_packus_epi16(b, g);						// Per lane: B x8, G x8
+	__m256i ra = _mm256_packus_epi16(r, _mm256_set1_epi16(255));
+	bg = _mm256_unpacklo_epi8(bg, _mm256_srli_si256(bg, 8));
+	ra = _mm256_unpacklo_epi8(ra, _mm256_srli_si256(ra, 8));
+	__m256i lo = _mm256_unpacklo_epi16(bg, ra);					// Pixels 0-3, 8-11
+	__m256i hi = _mm256_unpackhi_epi16(bg, ra);					// Pixels 4-7, 12-15
+	_mm256_storeu_si256((__m256i*)pOut, _mm256_permute2x128_si256(lo, hi, 0x20));
+	_mm256_storeu_si256((__m256i*)(pOut + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+// (a * ca + b * cb) >> COEF_BITS for 16 pairs, plus an already paired
+// term; unpack and pack both work per lane, so the order is kept.
+static inline __m256i Combine(__m256i a, __m256i b, __m256i coefs, __m256i c, __m256i d, __m256i coefsCD)
+{
+	__m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), coefs),
+		_mm256_madd_epi16(_mm256_unpacklo_epi16(c, d), coefsCD));
+	__m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), coefs),
+		_mm256_madd_epi16(_mm256_unpackhi_epi16(c, d), coefsCD));
+	return _mm256_packs_epi32(_mm256_srai_epi32(lo, COEF_BITS), _mm256_srai_epi32(hi, COEF_BITS));
+}
+
+static inline __m256i Coefs(int a, int b)
+{
+	return _mm256_set1_epi32((int)(((uint32_t)b << 16) | (uint16_t)a));
+}
+
+static inline __m128i LoadLow64(const uint8_t* p)
+{
+	return _mm_loadl_epi64((const __m128i*)p);
+}
+
+//-----------------------------------------------------------------------------
+// ConvertRowAVX2
+//
+// 16 pixels per step, the same terms as the scalar kernel. The rounding
+// constant rides in a madd pair with 1, like the SSE2 green channel.
+//-----------------------------------------------------------------------------
+
+static void ConvertRowAVX2(const YCbCrRow& row, const ColorCoefficients& coef, uint8_t* pOut)
+{
+	const bool bGray = !row.pCb;
+	const bool bFull = row.pCb && row.nShiftX == 0 && row.cbChromaStep == 1;
+	const bool bHalf = row.pCb && row.nShiftX == 1 && row.cbChromaStep == 1;
+	const bool bNV12 = row.pCb && row.nShiftX == 1 && row.cbChromaStep == 2;
+	if (!bGray && !bFull && !bHalf && !bNV12) {
+		ConvertRowScalar(row, coef, 0, pOut);
+		return;
+	}
+
+	const int nRound = 1 << (COEF_BITS - 1);
+	const __m256i yOffset = _mm256_set1_epi16((short)coef.nYOffset);
+	const __m256i cOffset = _mm256_set1_epi16(128);
+	const __m256i one = _mm256_set1_epi16(1);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i coefB = Coefs(coef.nY, coef.nBU);
+	const __m256i coefR = Coefs(coef.nY, coef.nRV);
+	const __m256i coefG = Coefs(coef.nY, -coef.nGU);
+	const __m256i coefRound = Coefs(0, nRound);
+	const __m256i coefGV = Coefs(-coef.nGV, nRound);
+
+	uint32_t x = 0;
+	for (; x + 16 <= row.cx; x += 16) {
+		__m256i y = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(row.pY + x)));
+		y = _mm256_sub_epi16(y, yOffset);
+
+		__m256i u = zero, v = zero;
+		if (bFull) {
+			u = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(row.pCb + x)));
+			v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(row.pCr + x)));
+			u = _mm256_sub_epi16(u, cOffset);
+			v = _mm256_sub_epi16(v, cOffset);
+		}
+		else if (bHalf) {
+			__m128i cb = LoadLow64(row.pCb + x / 2);
+			__m128i cr = LoadLow64(row.pCr + x / 2);
+			u = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(cb, cb)), cOffset);
+			v = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(cr, cr)), cOffset);
+		}
+		else if (bNV12) {
+			__m256i uv = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(row.pCb + x)));
+			u = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(uv, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+			v = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(uv, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+			u = _mm256_sub_epi16(u, cOffset);
+			v = _mm256_sub_epi16(v, cOffset);
+		}
+
+		__m256i b = Combine(y, u, coefB, zero, one, coefRound);
+		__m256i r = Combine(y, v, coefR, zero, one, coefRound);
+		__m256i g = Combine(y, u, coefG, v, one, coefGV);
+		StoreBGRA(b, g, r, pOut + (size_t)x * 4);
+	}
+	ConvertRowScalar(row, coef, x, pOut);
+}
+
+static void BlendRowsAVX2(const uint8_t* pA, const uint8_t* pB, uint32_t nWeightB, int16_t* pOut, size_t cValues)
+{
+	const __m256i weightA = _mm256_set1_epi16((short)((1 << BILINEAR_BITS) - nWeightB));
+	const __m256i weightB = _mm256_set1_epi16((short)nWeightB);
+
+	size_t i = 0;
+	for (; i + 16 <= cValues; i += 16) {
+		__m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pA + i)));
+		__m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pB + i)));
+		__m256i n = _mm256_add_epi16(_mm256_mullo_epi16(a, weightA), _mm256_mullo_epi16(b, weightB));
+		_mm256_storeu_si256((__m256i*)(pOut + i), n);
+	}
+	BlendRowsScalar(pA + i, pB + i, nWeightB, pOut + i, cValues - i);
+}
+
+// Two taps, one per lane, paired for madd: B0 B1 G0 G1 R0 R1 A0 A1.
+static inline __m256i BlendTaps(const int16_t* pRow, const BilinearTap& tap0, const BilinearTap& tap1, __m256i round)
+{
+	__m128i p0 = _mm_loadu_si128((const __m128i*)(pRow + (size_t)tap0.x0 * 4));
+	__m128i p1 = _mm_loadu_si128((const __m128i*)(pRow + (size_t)tap1.x0 * 4));
+	__m256i p = _mm256_inserti128_si256(_mm256_castsi128_si256(p0), p1, 1);
+	p = _mm256_unpacklo_epi16(p, _mm256_srli_si256(p, 8));
+	__m128i w0 = _mm_set1_epi32((int)((tap0.nWeight << 16) | ((1 << BILINEAR_BITS) - tap0.nWeight)));
+	__m128i w1 = _mm_set1_epi32((int)((tap1.nWeight << 16) | ((1 << BILINEAR_BITS) - tap1.nWeight)));
+	__m256i weights = _mm256_inserti128_si256(_mm256_castsi128_si256(w0), w1, 1);
+	return _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(p, weights), round), 2 * BILINEAR_BITS);
+}
+
+static void BlendColumnsAVX2(const int16_t* pRow, const BilinearTap* pTaps, uint32_t cxDst, uint8_t* pOut)
+{
+	const __m256i round = _mm256_set1_epi32(1 << (2 * BILINEAR_BITS - 1));
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 0, 4, 1, 5);
+
+	uint32_t x = 0;
+	for (; x + 4 <= cxDst; x += 4) {
+		__m256i p01 = BlendTaps(pRow, pTaps[x], pTaps[x + 1], round);
+		__m256i p23 = BlendTaps(pRow, pTaps[x + 2], pTaps[x + 3], round);
+		__m256i p = _mm256_packs_epi32(p01, p23);	// Lanes: pixels 0 2 | 1 3
+		p = _mm256_packus_epi16(p, p);
+		p = _mm256_permutevar8x32_epi32(p, order);
+		_mm_storeu_si128((__m128i*)(pOut + (size_t)x * 4), _mm256_castsi256_si128(p));
+	}
+	BlendColumnsScalar(pRow, pTaps + x, cxDst - x, pOut + (size_t)x * 4);
+}
+
+static void AccumulateRowAVX2(const uint8_t* pSrc, uint32_t* pSum, size_t cValues)
+{
+	size_t i = 0;
+	for (; i + 32 <= cValues; i += 32) {
+		__m256i* p = (__m256i*)(pSum + i);
+		for (int j = 0; j < 4; j++) {
+			__m256i s = _mm256_cvtepu8_epi32(LoadLow64(pSrc + i + j * 8));
+			_mm256_storeu_si256(p + j, _mm256_add_epi32(_mm256_loadu_si256(p + j), s));
+		}
+	}
+	AccumulateRowScalar(pSrc + i, pSum + i, cValues - i);
+}
+
+// 8 pixels per step, as BlendOverSSE2. Unpacking and packing both work
+// per 128-bit lane, so the pixels stay in order.
+static void BlendOverAVX2(const uint8_t* pSrc, uint8_t* pDst, uint32_t cx)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_set1_epi8(-1);
+	const __m256i alphas = _mm256_set1_epi32((int)0xFF000000);
+	const __m256i round = _mm256_set1_epi16(128);
+
+	uint32_t x = 0;
+	for (; x + 8 <= cx; x += 8) {
+		__m256i s = _mm256_loadu_si256((const __m256i*)(pSrc + (size_t)x * 4));
+		if (_mm256_testz_si256(s, s))
+			continue;
+		__m256i* p = (__m256i*)(pDst + (size_t)x * 4);
+		if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(s, alphas), alphas)) == 0xFFFFFFFFu) {
+			_mm256_storeu_si256(p, s);
+			continue;
+		}
+
+		__m256i a = _mm256_srli_epi32(s, 24);
+		a = _mm256_or_si256(a, _mm256_slli_epi32(a, 8));
+		a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+		__m256i inverse = _mm256_xor_si256(a, ones);
+
+		__m256i d = _mm256_loadu_si256(p);
+		__m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(inverse, zero));
+		__m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(inverse, zero));
+		lo = _mm256_add_epi16(lo, round);
+		hi = _mm256_add_epi16(hi, round);
+		lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+		hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+		_mm256_storeu_si256(p, _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+	}
+	BlendOverScalar(pSrc + (size_t)x * 4, pDst + (size_t)x * 4, cx - x);
+}
+
+// 16 pixels per step, as PlasmaRowSSE2.
+static inline __m256i PlasmaWave(__m256i v2, int nPhase)
+{
+	__m256i w = _mm256_sub_epi16(
+		_mm256_and_si256(_mm256_add_epi16(v2, _mm256_set1_epi16((short)nPhase)), _mm256_set1_epi16(511)),
+		_mm256_set1_epi16(256));
+	return _mm256_sub_epi16(_mm256_set1_epi16(255), _mm256_abs_epi16(w));
+}
+
+static void PlasmaRowAVX2(const uint8_t* pA, const uint8_t* pB, uint32_t nBase, const PlasmaPalette& palette,
+	uint32_t cx, uint8_t* pOut)
+{
+	const __m256i base = _mm256_set1_epi16((short)nBase);
+
+	uint32_t x = 0;
+	for (; x + 16 <= cx; x += 16) {
+		__m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pA + x)));
+		__m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pB + x)));
+		__m256i v = _mm256_add_epi16(_mm256_add_epi16(a, b), base);
+		v = _mm256_add_epi16(v, v);
+		StoreBGRA(PlasmaWave(v, palette.nPhase[0]), PlasmaWave(v, palette.nPhase[1]),
+			PlasmaWave(v, palette.nPhase[2]), pOut + (size_t)x * 4);
+	}
+	PlasmaRowScalar(pA + x, pB + x, nBase, palette, cx - x, pOut + (size_t)x * 4);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+// Runs on any CPU, so it is built without AVX2. The area column pass
+// stays on the SSE2 kernel: it reduces 4 channels at a time, which a
+// 256-bit register does not speed up.
+void GetAVX2Kernels(ColorKernelTable* pTable)
+{
+	pTable->pfnConvertRow = ConvertRowAVX2;
+	pTable->pfnBlendRows = BlendRowsAVX2;
+	pTable->pfnBlendColumns = BlendColumnsAVX2;
+	pTable->pfnAccumulateRow = AccumulateRowAVX2;
+	pTable->pfnBlendOver = BlendOverAVX2;
+	pTable->pfnPlasmaRow = PlasmaRowAVX2;
+}
+
+#endif
@@ -0,0 +1,291 @@
+#include "ColorKernels.h"
+
+#if COLOR_KERNELS_X86
+#include <string.h>
+#include <emmintrin.h>
+
+
+//-----------------------------------------------------------------------------
+// StoreBGRA
+//
+// Clamps 8 pixels of 16-bit B, G and R to bytes and stores them as BGRA
+// with opaque alpha.
+//-----------------------------------------------------------------------------
+
+static inline void StoreBGRA(__m128i b, __m128i g, __m128i r, uint8_t* pOut)
+{
+	__m128i bg = _mm_packus_epi16(b, g);						// B0..B7 G0..G7
+	__m128i ra = _mm_packus_epi16(r, _mm_set1_epi16(255));	// R0..R7 A0..A7
+	bg = _mm_unpacklo_epi8(bg, _mm_srli_si128(bg, 8));
+	ra = _mm_unpacklo_epi8(ra, _mm_srli_si128(ra, 8));
+	_mm_storeu_si128((__m128i*)pOut, _mm_unpacklo_epi16(bg, ra));
+	_mm_storeu_si128((__m128i*)(pOut + 16), _mm_unpackhi_epi16(bg, ra));
+}
+
+// (a * ca + b * cb + nRound) >> COEF_BITS for 8 pairs, as 16-bit values.
+static inline __m128i Combine(__m128i a, __m128i b, __m128i coefs, __m128i round)
+{
+	__m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), coefs), round);
+	__m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), coefs), round);
+	return _mm_packs_epi32(_mm_srai_epi32(lo, COEF_BITS), _mm_srai_epi32(hi, COEF_BITS));
+}
+
+static inline __m128i Coefs(int a, int b)
+{
+	return _mm_set1_epi32((int)(((uint32_t)b << 16) | (uint16_t)a));
+}
+
+static inline __m128i LoadLow32(const uint8_t* p)
+{
+	int n;
+	memcpy(&n, p, sizeof(n));
+	return _mm_cvtsi32_si128(n);
+}
+
+//-----------------------------------------------------------------------------
+// ConvertRowSSE2
+//
+// 8 pixels per step. The pair sums are the scalar expressions term for
+// term, and packing clamps like Clamp8, so the bytes match exactly.
+// Uncommon chroma layouts go to the scalar kernel.
+//-----------------------------------------------------------------------------
+
+static void ConvertRowSSE2(const YCbCrRow& row, const ColorCoefficients& coef, uint8_t* pOut)
+{
+	const bool bGray = !row.pCb;
+	const bool bFull = row.pCb && row.nShiftX == 0 && row.cbChromaStep == 1;
+	const bool bHalf = row.pCb && row.nShiftX == 1 && row.cbChromaStep == 1;
+	const bool bNV12 = row.pCb && row.nShiftX == 1 && row.cbChromaStep == 2;
+	if (!bGray && !bFull && !bHalf && !bNV12) {
+		ConvertRowScalar(row, coef, 0, pOut);
+		return;
+	}
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i yOffset = _mm_set1_epi16((short)coef.nYOffset);
+	const __m128i cOffset = _mm_set1_epi16(128);
+	const __m128i round = _mm_set1_epi32(1 << (COEF_BITS - 1));
+	const __m128i coefB = Coefs(coef.nY, coef.nBU);
+	const __m128i coefR = Coefs(coef.nY, coef.nRV);
+	const __m128i coefG = Coefs(coef.nY, -coef.nGU);
+	const __m128i coefGV = Coefs(-coef.nGV, 1 << (COEF_BITS - 1));
+	const __m128i one = _mm_set1_epi16(1);
+
+	uint32_t x = 0;
+	for (; x + 8 <= row.cx; x += 8) {
+		__m128i y = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(row.pY + x)), zero);
+		y = _mm_sub_epi16(y, yOffset);
+
+		__m128i u = zero, v = zero;
+		if (bFull) {
+			u = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(row.pCb + x)), zero), cOffset);
+			v = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(row.pCr + x)), zero), cOffset);
+		}
+		else if (bHalf) {
+			u = LoadLow32(row.pCb + x / 2);
+			v = LoadLow32(row.pCr + x / 2);
+			u = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(u, u), zero), cOffset);
+			v = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(v, v), zero), cOffset);
+		}
+		else if (bNV12) {
+			__m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(row.pCb + x)), zero);
+			u = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+			v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+			u = _mm_sub_epi16(u, cOffset);
+			v = _mm_sub_epi16(v, cOffset);
+		}
+
+		__m128i b = Combine(y, u, coefB, round);
+		__m128i r = Combine(y, v, coefR, round);
+
+		// G = (Y * nY - U * nGU) + (V * -nGV + 1 * nRound)
+		__m128i glo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(y, u), coefG),
+			_mm_madd_epi16(_mm_unpacklo_epi16(v, one), coefGV));
+		__m128i ghi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(y, u), coefG),
+			_mm_madd_epi16(_mm_unpackhi_epi16(v, one), coefGV));
+		__m128i g = _mm_packs_epi32(_mm_srai_epi32(glo, COEF_BITS), _mm_srai_epi32(ghi, COEF_BITS));
+
+		StoreBGRA(b, g, r, pOut + (size_t)x * 4);
+	}
+	ConvertRowScalar(row, coef, x, pOut);
+}
+
+static void BlendRowsSSE2(const uint8_t* pA, const uint8_t* pB, uint32_t nWeightB, int16_t* pOut, size_t cValues)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i weightA = _mm_set1_epi16((short)((1 << BILINEAR_BITS) - nWeightB));
+	const __m128i weightB = _mm_set1_epi16((short)nWeightB);
+
+	size_t i = 0;
+	for (; i + 16 <= cValues; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(pA + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(pB + i));
+		__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), weightA),
+			_mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), weightB));
+		__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), weightA),
+			_mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), weightB));
+		_mm_storeu_si128((__m128i*)(pOut + i), lo);
+		_mm_storeu_si128((__m128i*)(pOut + i + 8), hi);
+	}
+	BlendRowsScalar(pA + i, pB + i, nWeightB, pOut + i, cValues - i);
+}
+
+// Channels of a tap's two pixels, paired for madd: B0 B1 G0 G1 R0 R1 A0 A1.
+static inline __m128i BlendTap(const int16_t* pRow, const BilinearTap& tap, __m128i round)
+{
+	__m128i p = _mm_loadu_si128((const __m128i*)(pRow + (size_t)tap.x0 * 4));
+	p = _mm_unpacklo_epi16(p, _mm_srli_si128(p, 8));
+	__m128i weights = _mm_set1_epi32((int)((tap.nWeight << 16) | ((1 << BILINEAR_BITS) - tap.nWeight)));
+	return _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(p, weights), round), 2 * BILINEAR_BITS);
+}
+
+static void BlendColumnsSSE2(const int16_t* pRow, const BilinearTap* pTaps, uint32_t cxDst, uint8_t* pOut)
+{
+	const __m128i round = _mm_set1_epi32(1 << (2 * BILINEAR_BITS - 1));
+
+	uint32_t x = 0;
+	for (; x + 2 <= cxDst; x += 2) {
+		__m128i p0 = BlendTap(pRow, pTaps[x], round);
+		__m128i p1 = BlendTap(pRow, pTaps[x + 1], round);
+		__m128i p = _mm_packs_epi32(p0, p1);
+		_mm_storel_epi64((__m128i*)(pOut + (size_t)x * 4), _mm_packus_epi16(p, p));
+	}
+	BlendColumnsScalar(pRow, pTaps + x, cxDst - x, pOut + (size_t)x * 4);
+}
+
+static void AccumulateRowSSE2(const uint8_t* pSrc, uint32_t* pSum, size_t cValues)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	size_t i = 0;
+	for (; i + 16 <= cValues; i += 16) {
+		__m128i s = _mm_loadu_si128((const __m128i*)(pSrc + i));
+		__m128i lo = _mm_unpacklo_epi8(s, zero);
+		__m128i hi = _mm_unpackhi_epi8(s, zero);
+		__m128i* p = (__m128i*)(pSum + i);
+		_mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), _mm_unpacklo_epi16(lo, zero)));
+		_mm_storeu_si128(p + 1, _mm_add_epi32(_mm_loadu_si128(p + 1), _mm_unpackhi_epi16(lo, zero)));
+		_mm_storeu_si128(p + 2, _mm_add_epi32(_mm_loadu_si128(p + 2), _mm_unpacklo_epi16(hi, zero)));
+		_mm_storeu_si128(p + 3, _mm_add_epi32(_mm_loadu_si128(p + 3), _mm_unpackhi_epi16(hi, zero)));
+	}
+	AccumulateRowScalar(pSrc + i, pSum + i, cValues - i);
+}
+
+//-----------------------------------------------------------------------------
+// AreaColumnsSSE2
+//
+// One pixel (4 channel sums) per step. The 64-bit products of
+// _mm_mul_epu32 match the scalar uint64_t arithmetic.
+//-----------------------------------------------------------------------------
+
+static void AreaColumnsSSE2(const uint32_t* pSum, const AreaTap* pTaps, const uint32_t* pRecip, uint32_t cxDst, uint8_t* pOut)
+{
+	const __m128i round = _mm_set1_epi64x(1ll << (AREA_BITS - 1));
+
+	for (uint32_t x = 0; x < cxDst; x++) {
+		const __m128i* p = (const __m128i*)(pSum + (size_t)pTaps[x].x0 * 4);
+		__m128i sum = _mm_setzero_si128();
+		for (uint32_t i = 0; i < pTaps[x].cx; i++)
+			sum = _mm_add_epi32(sum, _mm_loadu_si128(p + i));
+
+		__m128i recip = _mm_set1_epi32((int)pRecip[x]);
+		__m128i even = _mm_srli_epi64(_mm_add_epi64(_mm_mul_epu32(sum, recip), round), AREA_BITS);
+		__m128i odd = _mm_srli_epi64(_mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(sum, 32), recip), round), AREA_BITS);
+		__m128i n = _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+		n = _mm_packs_epi32(n, n);
+		int nPixel = _mm_cvtsi128_si32(_mm_packus_epi16(n, n));
+		memcpy(pOut + (size_t)x * 4, &nPixel, sizeof(nPixel));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// BlendOverSSE2
+//
+// 4 pixels per step, in the scalar kernel's 16-bit arithmetic. Steps of
+// clear pixels leave the destination as it is, and opaque ones copy the
+// source, which is what the arithmetic gives for them.
+//-----------------------------------------------------------------------------
+
+static inline __m128i ScaleByInverse(__m128i d, __m128i inverse, __m128i round)
+{
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(d, inverse), round);
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static void BlendOverSSE2(const uint8_t* pSrc, uint8_t* pDst, uint32_t cx)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi8(-1);
+	const __m128i alphas = _mm_set1_epi32((int)0xFF000000);
+	const __m128i round = _mm_set1_epi16(128);
+
+	uint32_t x = 0;
+	for (; x + 4 <= cx; x += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i*)(pSrc + (size_t)x * 4));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(s, zero)) == 0xFFFF)
+			continue;
+		__m128i* p = (__m128i*)(pDst + (size_t)x * 4);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(s, alphas), alphas)) == 0xFFFF) {
+			_mm_storeu_si128(p, s);
+			continue;
+		}
+
+		// 255 - alpha in all 4 bytes of each pixel
+		__m128i a = _mm_srli_epi32(s, 24);
+		a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+		a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+		__m128i inverse = _mm_xor_si128(a, ones);
+
+		__m128i d = _mm_loadu_si128(p);
+		__m128i lo = ScaleByInverse(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(inverse, zero), round);
+		__m128i hi = ScaleByInverse(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(inverse, zero), round);
+		_mm_storeu_si128(p, _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+	}
+	BlendOverScalar(pSrc + (size_t)x * 4, pDst + (size_t)x * 4, cx - x);
+}
+
+//-----------------------------------------------------------------------------
+// PlasmaRowSSE2
+//
+// 8 pixels per step in 16-bit lanes; packing saturates the wave's -1 at
+// a phase of 0 to 0, as the scalar kernel clamps it.
+//-----------------------------------------------------------------------------
+
+static inline __m128i PlasmaWave(__m128i v2, int nPhase)
+{
+	__m128i w = _mm_sub_epi16(_mm_and_si128(_mm_add_epi16(v2, _mm_set1_epi16((short)nPhase)), _mm_set1_epi16(511)),
+		_mm_set1_epi16(256));
+	w = _mm_max_epi16(w, _mm_sub_epi16(_mm_setzero_si128(), w));
+	return _mm_sub_epi16(_mm_set1_epi16(255), w);
+}
+
+static void PlasmaRowSSE2(const uint8_t* pA, const uint8_t* pB, uint32_t nBase, const PlasmaPalette& palette,
+	uint32_t cx, uint8_t* pOut)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i base = _mm_set1_epi16((short)nBase);
+
+	uint32_t x = 0;
+	for (; x + 8 <= cx; x += 8) {
+		__m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(pA + x)), zero);
+		__m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(pB + x)), zero);
+		__m128i v = _mm_add_epi16(_mm_add_epi16(a, b), base);
+		v = _mm_add_epi16(v, v);
+		StoreBGRA(PlasmaWave(v, palette.nPhase[0]), PlasmaWave(v, palette.nPhase[1]), PlasmaWave(v, palette.nPhase[2]),
+			pOut + (size_t)x * 4);
+	}
+	PlasmaRowScalar(pA + x, pB + x, nBase, palette, cx - x, pOut + (size_t)x * 4);
+}
+
+void GetSSE2Kernels(ColorKernelTable* pTable)
+{
+	pTable->pfnConvertRow = ConvertRowSSE2;
+	pTable->pfnBlendRows = BlendRowsSSE2;
+	pTable->pfnBlendColumns = BlendColumnsSSE2;
+	pTable->pfnAccumulateRow = AccumulateRowSSE2;
+	pTable->pfnAreaColumns = AreaColumnsSSE2;
+	pTable->pfnBlendOver = BlendOverSSE2;
+	pTable->pfnPlasmaRow = PlasmaRowSSE2;
+}
+
+#endif
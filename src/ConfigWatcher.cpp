@@ -0,0 +1,53 @@
+#include "pch.h"
+#include "ConfigWatcher.h"
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+ConfigWatcher::ConfigWatcher() : m_hChange(NULL)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+
+ConfigWatcher::~ConfigWatcher()
+{
+	Stop();
+}
+
+HRESULT ConfigWatcher::Start(const std::wstring& path)
+{
+	if (m_hChange)
+		return S_OK;
+
+	WCHAR szFull[MAX_PATH];
+	LPWSTR pszName = NULL;
+	DWORD cchFull = GetFullPathNameW(path.c_str(), ARRAYSIZE(szFull), szFull, &pszName);
+	if (!cchFull || cchFull >= ARRAYSIZE(szFull) || !pszName)
+		return HRESULT_FROM_WIN32(ERROR_BAD_PATHNAME);
+	*pszName = L'\0';
+
+	HANDLE hChange = FindFirstChangeNotificationW(szFull, FALSE,
+		FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+	if (hChange == INVALID_HANDLE_VALUE)
+		return HRESULT_FROM_WIN32(GetLastError());
+	m_hChange = hChange;
+	return S_OK;
+}
+
+void ConfigWatcher::Stop()
+{
+	if (m_hChange) {
+		FindCloseChangeNotification(m_hChange);
+		m_hChange = NULL;
+	}
+}
+
+bool ConfigWatcher::Rearm()
+{
+	return m_hChange && FindNextChangeNotification(m_hChange);
+}
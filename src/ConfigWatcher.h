@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+
+
+//-------------------------------------------------------------------
+//
+// ConfigWatcher class
+//
+// Watches the directory of the config file for a file in it being
+// written, created or renamed, which covers editors that save by
+// replacing the file. The change handle is signaled on a change and is
+// waited on by the app's event loop, so watching takes no thread. Saves
+// take several writes, so the app should let them settle before it
+// reads the file again.
+//
+//-------------------------------------------------------------------
+
+class ConfigWatcher
+{
+public:
+	ConfigWatcher();
+	~ConfigWatcher();
+
+	HRESULT Start(const std::wstring& path);
+	void Stop();
+
+	// Signaled when the directory changed; NULL while not started.
+	HANDLE GetHandle() const { return m_hChange; }
+
+	// The handle was signaled: waits for the next change.
+	bool Rearm();
+
+private:
+	HANDLE		m_hChange;		// Change notification of the directory
+};
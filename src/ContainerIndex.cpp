@@ -0,0 +1,601 @@
+#include "ContainerIndex.h"
+#include <algorithm>
+#include <chrono>
+#include <stddef.h>
+#include <string.h>
+
+// Index file layout version; files of another version are rebuilt.
+static const uint32_t INDEX_MAGIC = 0x58574C4C;		// "LLWX"
+static const uint32_t INDEX_VERSION = 1;
+static const uint32_t MAX_INDEX_FRAMES = 1u << 28;
+static const uint64_t MAX_MOVIE_BYTES = 256ull << 20;	// Sample tables of days of video
+
+// Header of an index file, followed by the keyframes. Fields are in the
+// byte order of the machine that wrote it; another one fails the magic
+// check and rebuilds.
+struct IndexHeader
+{
+	uint32_t	nMagic;
+	uint32_t	nVersion;
+	uint64_t	cbSource;
+	int64_t		nSourceModified;
+	int64_t		hnsDuration;
+	uint32_t	cFrames;
+	uint32_t	cKeyframes;
+	uint32_t	nReserved;
+	uint32_t	nChecksum;		// FNV-1a of the header bytes before it
+};
+
+static_assert(sizeof(IndexKeyframe) == 32, "IndexKeyframe is stored as is");
+static_assert(sizeof(IndexHeader) % 8 == 0, "Keyframes follow the header aligned");
+
+static uint32_t Checksum(const void* pData, size_t cb)
+{
+	const uint8_t* p = (const uint8_t*)pData;
+	uint32_t nHash = 0x811C9DC5;
+	for (size_t i = 0; i < cb; i++) {
+		nHash ^= p[i];
+		nHash *= 0x01000193;
+	}
+	return nHash;
+}
+
+static bool ByTime(const IndexKeyframe& a, const IndexKeyframe& b)
+{
+	return a.hnsTime < b.hnsTime;
+}
+
+
+//********************* MP4 boxes **********************//
+
+static constexpr uint32_t BoxType(char a, char b, char c, char d)
+{
+	return (uint32_t)(uint8_t)a << 24 | (uint32_t)(uint8_t)b << 16 | (uint32_t)(uint8_t)c << 8 | (uint8_t)d;
+}
+
+static uint32_t GetBE32(const uint8_t* p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint64_t GetBE64(const uint8_t* p)
+{
+	return (uint64_t)GetBE32(p) << 32 | GetBE32(p + 4);
+}
+
+// Payload of a box.
+struct Box
+{
+	uint32_t		type;
+	const uint8_t*	p;
+	size_t			cb;
+};
+
+// Reads the box at *pp and moves past it. False at the end of the
+// parent or at a box that does not fit in it.
+static bool NextBox(const uint8_t** pp, const uint8_t* pEnd, Box* pBox)
+{
+	const uint8_t* p = *pp;
+	if (pEnd - p < 8)
+		return false;
+	uint64_t cbBox = GetBE32(p);
+	size_t cbHeader = 8;
+	if (cbBox == 1) {
+		if (pEnd - p < 16)
+			return false;
+		cbBox = GetBE64(p + 8);
+		cbHeader = 16;
+	}
+	else if (cbBox == 0) {
+		cbBox = (uint64_t)(pEnd - p);
+	}
+	if (cbBox < cbHeader || cbBox > (uint64_t)(pEnd - p))
+		return false;
+
+	pBox->type = GetBE32(p + 4);
+	pBox->p = p + cbHeader;
+	pBox->cb = (size_t)cbBox - cbHeader;
+	*pp = p + (size_t)cbBox;
+	return true;
+}
+
+// First child of a type; *pBox is left alone if there is none.
+static bool FindBox(const Box& parent, uint32_t type, Box* pBox)
+{
+	const uint8_t* p = parent.p;
+	const uint8_t* pEnd = parent.p + parent.cb;
+	Box box;
+	while (NextBox(&p, pEnd, &box)) {
+		if (box.type == type) {
+			*pBox = box;
+			return true;
+		}
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// ReadMovie
+//
+// Reads the payload of the top-level moov box, wherever it is in the
+// file; the media data around it is skipped, not read.
+//-----------------------------------------------------------------------------
+
+static bool ReadMovie(FILE* fp, uint64_t cbFile, std::vector<uint8_t>* pMovie)
+{
+	uint64_t nOffset = 0;
+	while (nOffset + 8 <= cbFile) {
+		uint8_t header[16];
+		if (!FileSeek(fp, nOffset) || fread(header, 1, 8, fp) != 8)
+			return false;
+		uint64_t cbBox = GetBE32(header);
+		uint64_t cbHeader = 8;
+		if (cbBox == 1) {
+			if (fread(header + 8, 1, 8, fp) != 8)
+				return false;
+			cbBox = GetBE64(header + 8);
+			cbHeader = 16;
+		}
+		else if (cbBox == 0) {
+			cbBox = cbFile - nOffset;
+		}
+		if (cbBox < cbHeader || cbBox > cbFile - nOffset)
+			return false;
+
+		if (GetBE32(header + 4) == BoxType('m', 'o', 'o', 'v')) {
+			if (cbBox - cbHeader > MAX_MOVIE_BYTES)
+				return false;
+			pMovie->resize((size_t)(cbBox - cbHeader));
+			return fread(pMovie->data(), 1, pMovie->size(), fp) == pMovie->size();
+		}
+		nOffset += cbBox;
+	}
+	return false;
+}
+
+// Sample tables of a track; a type of 0 marks a missing box.
+struct SampleTables
+{
+	uint32_t	nTimescale;
+	Box			stts;		// Decode time deltas
+	Box			ctts;		// Presentation time offsets
+	Box			stss;		// Keyframes
+	Box			stsz;		// Sample sizes, or stz2
+	Box			stsc;		// Samples per chunk
+	Box			stco;		// Chunk offsets, or co64
+};
+
+//-----------------------------------------------------------------------------
+// FindVideoTrack
+//
+// moov/trak/mdia with a 'vide' handler; its mdhd has the timescale and
+// minf/stbl the sample tables. Fails for fragmented files (moov/mvex),
+// whose samples are described in the fragments instead.
+//-----------------------------------------------------------------------------
+
+static bool FindVideoTrack(const std::vector<uint8_t>& movie, SampleTables* pTables)
+{
+	Box moov = { BoxType('m', 'o', 'o', 'v'), movie.data(), movie.size() };
+	Box box;
+	if (FindBox(moov, BoxType('m', 'v', 'e', 'x'), &box))
+		return false;
+
+	const uint8_t* p = moov.p;
+	const uint8_t* pEnd = moov.p + moov.cb;
+	Box trak;
+	while (NextBox(&p, pEnd, &trak)) {
+		Box mdia, hdlr, mdhd, minf, stbl;
+		if (trak.type != BoxType('t', 'r', 'a', 'k') || !FindBox(trak, BoxType('m', 'd', 'i', 'a'), &mdia) ||
+			!FindBox(mdia, BoxType('h', 'd', 'l', 'r'), &hdlr) || hdlr.cb < 12 ||
+			GetBE32(hdlr.p + 8) != BoxType('v', 'i', 'd', 'e'))
+			continue;
+		if (!FindBox(mdia, BoxType('m', 'd', 'h', 'd'), &mdhd) || !FindBox(mdia, BoxType('m', 'i', 'n', 'f'), &minf) ||
+			!FindBox(minf, BoxType('s', 't', 'b', 'l'), &stbl))
+			return false;
+
+		// Version 1 has 64-bit creation and modification times.
+		size_t nTimescaleAt = mdhd.cb > 0 && mdhd.p[0] == 1 ? 20 : 12;
+		if (mdhd.cb < nTimescaleAt + 4)
+			return false;
+		pTables->nTimescale = GetBE32(mdhd.p + nTimescaleAt);
+
+		memset(&pTables->ctts, 0, sizeof(pTables->ctts));
+		memset(&pTables->stss, 0, sizeof(pTables->stss));
+		FindBox(stbl, BoxType('c', 't', 't', 's'), &pTables->ctts);
+		FindBox(stbl, BoxType('s', 't', 's', 's'), &pTables->stss);
+		return pTables->nTimescale != 0 &&
+			FindBox(stbl, BoxType('s', 't', 't', 's'), &pTables->stts) &&
+			(FindBox(stbl, BoxType('s', 't', 's', 'z'), &pTables->stsz) ||
+				FindBox(stbl, BoxType('s', 't', 'z', '2'), &pTables->stsz)) &&
+			FindBox(stbl, BoxType('s', 't', 's', 'c'), &pTables->stsc) &&
+			(FindBox(stbl, BoxType('s', 't', 'c', 'o'), &pTables->stco) ||
+				FindBox(stbl, BoxType('c', 'o', '6', '4'), &pTables->stco));
+	}
+	return false;
+}
+
+// Entry count of a full box whose entries of cbEntry bytes follow the
+// count; 0 if the box is missing or too short for them.
+static uint32_t GetEntryCount(const Box& box, size_t cbEntry)
+{
+	if (!box.type || box.cb < 8)
+		return 0;
+	uint32_t cEntries = GetBE32(box.p + 4);
+	return (box.cb - 8) / cbEntry >= cEntries ? cEntries : 0;
+}
+
+//-----------------------------------------------------------------------------
+// SampleSizes
+//
+// stsz with a size for all samples or one per sample, or the compact
+// stz2 with 4, 8 or 16 bits per sample.
+//-----------------------------------------------------------------------------
+
+struct SampleSizes
+{
+	const uint8_t*	pTable;
+	uint32_t		cbFixed;		// Size of every sample, 0 = per sample
+	uint32_t		nFieldBits;		// Bits per entry of the table
+	uint32_t		cSamples;
+
+	bool Init(const Box& box)
+	{
+		if (box.cb < 12)
+			return false;
+		cSamples = GetBE32(box.p + 8);
+		pTable = box.p + 12;
+		if (box.type == BoxType('s', 't', 'z', '2')) {
+			cbFixed = 0;
+			nFieldBits = box.p[7];
+			if (nFieldBits != 4 && nFieldBits != 8 && nFieldBits != 16)
+				return false;
+		}
+		else {
+			cbFixed = GetBE32(box.p + 4);
+			nFieldBits = cbFixed ? 0 : 32;
+		}
+		return cSamples <= MAX_INDEX_FRAMES && (uint64_t)cSamples * nFieldBits <= (uint64_t)(box.cb - 12) * 8;
+	}
+
+	uint32_t Get(uint32_t nSample) const
+	{
+		switch (nFieldBits) {
+		case 0:		return cbFixed;
+		case 4:		return nSample & 1 ? pTable[nSample / 2] & 0xF : pTable[nSample / 2] >> 4;
+		case 8:		return pTable[nSample];
+		case 16:	return (uint32_t)pTable[nSample * 2] << 8 | pTable[nSample * 2 + 1];
+		default:	return GetBE32(pTable + (size_t)nSample * 4);
+		}
+	}
+};
+
+
+//********************* Build and save **********************//
+
+ContainerIndex::ContainerIndex() :
+	m_source(),
+	m_pKeyframes(NULL),
+	m_cKeyframes(0),
+	m_cFrames(0),
+	m_hnsDuration(0)
+{
+}
+
+void ContainerIndex::Clear()
+{
+	m_file.Close();
+	m_built.clear();
+	m_source = FileInfo();
+	m_pKeyframes = NULL;
+	m_cKeyframes = 0;
+	m_cFrames = 0;
+	m_hnsDuration = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Build
+//
+// One pass over the samples in decode order: stts gives each decode time
+// and ctts the offset to its presentation time, stsc and stco place the
+// chunks and stsz the samples within them. Without stss every sample is
+// a keyframe.
+//-----------------------------------------------------------------------------
+
+bool ContainerIndex::Build(const std::wstring& source)
+{
+	Clear();
+
+	FileInfo info;
+	std::vector<uint8_t> movie;
+	if (!GetFileInfo(source, &info))
+		return false;
+	FILE* fp = FileOpen(source, "rb");
+	if (!fp)
+		return false;
+	bool bRead = ReadMovie(fp, info.cbSize, &movie);
+	fclose(fp);
+
+	SampleTables tables;
+	SampleSizes sizes;
+	if (!bRead || !FindVideoTrack(movie, &tables) || !sizes.Init(tables.stsz) || sizes.cSamples == 0)
+		return false;
+
+	const bool b64 = tables.stco.type == BoxType('c', 'o', '6', '4');
+	const uint32_t cTimes = GetEntryCount(tables.stts, 8);
+	const uint32_t cOffsets = GetEntryCount(tables.ctts, 8);
+	const uint32_t cSync = GetEntryCount(tables.stss, 4);
+	const uint32_t cRuns = GetEntryCount(tables.stsc, 12);
+	const uint32_t cChunks = GetEntryCount(tables.stco, b64 ? 8 : 4);
+	if (cTimes == 0 || cRuns == 0 || cChunks == 0)
+		return false;
+
+	const uint8_t* pTimes = tables.stts.p + 8;
+	const uint8_t* pOffsets = tables.ctts.type ? tables.ctts.p + 8 : NULL;
+	const uint8_t* pSync = tables.stss.type ? tables.stss.p + 8 : NULL;
+	const uint8_t* pRuns = tables.stsc.p + 8;
+	const uint8_t* pChunks = tables.stco.p + 8;
+
+	uint32_t nTime = 0, cTimeLeft = GetBE32(pTimes), nTimeDelta = GetBE32(pTimes + 4);
+	uint32_t nOffset = 0, cOffsetLeft = pOffsets ? GetBE32(pOffsets) : 0;
+	uint32_t nSync = 0;
+	uint32_t nRun = 0, nChunk = 0, cChunkLeft = 0;
+	uint64_t nFilePos = 0;
+	int64_t nDecodeTime = 0;
+
+	std::vector<IndexKeyframe> keyframes;
+	for (uint32_t nSample = 0; nSample < sizes.cSamples; nSample++) {
+		// Next chunk when this one is used up; the run of the chunk is
+		// the last stsc entry starting at or before it.
+		while (cChunkLeft == 0) {
+			if (nChunk >= cChunks)
+				return false;
+			nChunk++;
+			while (nRun + 1 < cRuns && GetBE32(pRuns + (size_t)(nRun + 1) * 12) <= nChunk)
+				nRun++;
+			cChunkLeft = GetBE32(pRuns + (size_t)nRun * 12 + 4);
+			nFilePos = b64 ? GetBE64(pChunks + (size_t)(nChunk - 1) * 8) : GetBE32(pChunks + (size_t)(nChunk - 1) * 4);
+		}
+		uint64_t nSampleOffset = nFilePos;
+		nFilePos += sizes.Get(nSample);
+		cChunkLeft--;
+
+		while (cTimeLeft == 0 && nTime + 1 < cTimes) {
+			nTime++;
+			cTimeLeft = GetBE32(pTimes + (size_t)nTime * 8);
+			nTimeDelta = GetBE32(pTimes + (size_t)nTime * 8 + 4);
+		}
+		while (pOffsets && cOffsetLeft == 0 && nOffset + 1 < cOffsets) {
+			nOffset++;
+			cOffsetLeft = GetBE32(pOffsets + (size_t)nOffset * 8);
+		}
+		int64_t nPresentTime = nDecodeTime;
+		if (pOffsets && cOffsetLeft > 0) {
+			nPresentTime += (int32_t)GetBE32(pOffsets + (size_t)nOffset * 8 + 4);
+			cOffsetLeft--;
+		}
+		nDecodeTime += nTimeDelta;
+		if (cTimeLeft > 0)
+			cTimeLeft--;
+
+		// stss lists sample numbers from 1, in increasing order.
+		bool bKeyframe = !pSync;
+		while (pSync && nSync < cSync && GetBE32(pSync + (size_t)nSync * 4) < nSample + 1)
+			nSync++;
+		if (pSync && nSync < cSync && GetBE32(pSync + (size_t)nSync * 4) == nSample + 1)
+			bKeyframe = true;
+
+		// Samples before the first keyframe cannot be decoded on their own.
+		if (bKeyframe) {
+			IndexKeyframe keyframe;
+			keyframe.hnsTime = nPresentTime * HNS_PER_SECOND / tables.nTimescale;
+			keyframe.nOffset = nSampleOffset;
+			keyframe.nEndOffset = nFilePos;
+			keyframe.nFrame = nSample;
+			keyframe.cFrames = 0;
+			keyframes.push_back(keyframe);
+		}
+		if (!keyframes.empty()) {
+			IndexKeyframe& gop = keyframes.back();
+			gop.cFrames++;
+			if (nFilePos > gop.nEndOffset)
+				gop.nEndOffset = nFilePos;
+		}
+	}
+	if (keyframes.empty())
+		return false;
+
+	// Presentation order of keyframes follows decode order in every file
+	// seen so far; sorting keeps lookups right for any other.
+	if (!std::is_sorted(keyframes.begin(), keyframes.end(), ByTime))
+		std::stable_sort(keyframes.begin(), keyframes.end(), ByTime);
+
+	m_built.swap(keyframes);
+	m_source = info;
+	m_pKeyframes = m_built.data();
+	m_cKeyframes = m_built.size();
+	m_cFrames = sizes.cSamples;
+	m_hnsDuration = nDecodeTime * HNS_PER_SECOND / tables.nTimescale;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Save
+//
+// Written next to the index and moved over it in one step, so Map never
+// sees a partial file.
+//-----------------------------------------------------------------------------
+
+bool ContainerIndex::Save(const std::wstring& path) const
+{
+	if (IsEmpty())
+		return false;
+
+	IndexHeader header;
+	memset(&header, 0, sizeof(header));
+	header.nMagic = INDEX_MAGIC;
+	header.nVersion = INDEX_VERSION;
+	header.cbSource = m_source.cbSize;
+	header.nSourceModified = m_source.nModified;
+	header.hnsDuration = m_hnsDuration;
+	header.cFrames = m_cFrames;
+	header.cKeyframes = (uint32_t)m_cKeyframes;
+	header.nChecksum = Checksum(&header, offsetof(IndexHeader, nChecksum));
+
+	std::wstring temp = path + L".part";
+	FILE* fp = FileOpen(temp, "wb");
+	if (!fp)
+		return false;
+	bool bOk = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+		fwrite(m_pKeyframes, sizeof(IndexKeyframe), m_cKeyframes, fp) == m_cKeyframes;
+	bOk = fclose(fp) == 0 && bOk;
+	if (!bOk || !MoveFileReplace(temp, path)) {
+		RemoveFile(temp);
+		return false;
+	}
+	return true;
+}
+
+
+//********************* Map and look up **********************//
+
+//-----------------------------------------------------------------------------
+// Map
+//
+// Checks the header only, so opening costs the same for any number of
+// keyframes; the keyframes are read from the mapping when looked up.
+//-----------------------------------------------------------------------------
+
+bool ContainerIndex::Map(const std::wstring& path, const FileInfo& info)
+{
+	Clear();
+	if (!m_file.Open(path))
+		return false;
+
+	IndexHeader header;
+	if (m_file.GetSize() < sizeof(header)) {
+		m_file.Close();
+		return false;
+	}
+	memcpy(&header, m_file.GetData(), sizeof(header));
+	if (header.nMagic != INDEX_MAGIC || header.nVersion != INDEX_VERSION ||
+		header.nChecksum != Checksum(&header, offsetof(IndexHeader, nChecksum)) ||
+		header.cbSource != info.cbSize || header.nSourceModified != info.nModified ||
+		header.cKeyframes == 0 || header.cKeyframes > MAX_INDEX_FRAMES ||
+		m_file.GetSize() != sizeof(header) + (size_t)header.cKeyframes * sizeof(IndexKeyframe)) {
+		m_file.Close();
+		return false;
+	}
+
+	m_source = info;
+	m_pKeyframes = (const IndexKeyframe*)(m_file.GetData() + sizeof(header));
+	m_cKeyframes = header.cKeyframes;
+	m_cFrames = header.cFrames;
+	m_hnsDuration = header.hnsDuration;
+	return true;
+}
+
+bool ContainerIndex::Open(const std::wstring& source, const std::wstring& path)
+{
+	FileInfo info;
+	if (!GetFileInfo(source, &info))
+		return false;
+	if (Map(path, info))
+		return true;
+	if (!Build(source))
+		return false;
+	Save(path);
+	return true;
+}
+
+size_t ContainerIndex::FindKeyframe(HNSTIME hnsTime) const
+{
+	size_t nLow = 0, nHigh = m_cKeyframes;
+	while (nHigh - nLow > 1) {
+		size_t nMid = (nLow + nHigh) / 2;
+		if (m_pKeyframes[nMid].hnsTime <= hnsTime)
+			nLow = nMid;
+		else
+			nHigh = nMid;
+	}
+	return nLow;
+}
+
+bool ContainerIndex::StartsWithKeyframe() const
+{
+	return m_cKeyframes > 0 && m_pKeyframes[0].nFrame == 0;
+}
+
+//-----------------------------------------------------------------------------
+// GetIndexPath
+//
+// <directory>/<16 hex digits of FNV-1a over the normalized path>.lwx.
+//-----------------------------------------------------------------------------
+
+std::wstring ContainerIndex::GetIndexPath(const std::wstring& directory, const std::wstring& source)
+{
+	uint64_t nHash = 0xCBF29CE484222325ull;
+	std::wstring normal = NormalizePath(source);
+	for (size_t i = 0; i < normal.size(); i++) {
+		uint16_t c = (uint16_t)normal[i];
+		nHash ^= c & 0xFF;
+		nHash *= 0x100000001B3ull;
+		nHash ^= c >> 8;
+		nHash *= 0x100000001B3ull;
+	}
+
+	static const wchar_t s_hex[] = L"0123456789abcdef";
+	std::wstring path(directory);
+	if (!path.empty() && path[path.size() - 1] != L'\\' && path[path.size() - 1] != L'/')
+#ifdef _WIN32
+		path += L'\\';
+#else
+		path += L'/';
+#endif
+	for (int i = 60; i >= 0; i -= 4)
+		path += s_hex[(nHash >> i) & 0xF];
+	path += L".lwx";
+	return path;
+}
+
+
+//********************* Benchmark **********************//
+
+bool RunIndexBench(const std::wstring& source, const std::wstring& indexPath, uint32_t cLookups,
+	IndexBenchResult* pResult)
+{
+	typedef std::chrono::steady_clock Clock;
+	auto ms = [](Clock::time_point a, Clock::time_point b) {
+		return std::chrono::duration<double, std::milli>(b - a).count();
+	};
+
+	ContainerIndex index;
+	FileInfo info;
+	Clock::time_point start = Clock::now();
+	bool bBuilt = GetFileInfo(source, &info) && index.Build(source);
+	Clock::time_point built = Clock::now();
+	if (!bBuilt)
+		return false;
+	pResult->cFrames = index.GetFrameCount();
+	pResult->cKeyframes = index.GetKeyframeCount();
+	bool bSaved = index.Save(indexPath);
+	Clock::time_point saved = Clock::now();
+	pResult->bMapped = bSaved && index.Map(indexPath, info);
+	Clock::time_point mapped = Clock::now();
+
+	// Lookups at spread-out times, so the search does not stay in cache.
+	HNSTIME hnsDuration = index.GetDuration() > 0 ? index.GetDuration() : 1;
+	uint64_t nState = 0x9E3779B97F4A7C15ull;
+	volatile size_t nFound = 0;
+	for (uint32_t i = 0; pResult->bMapped && i < cLookups; i++) {
+		nState = nState * 6364136223846793005ull + 1442695040888963407ull;
+		nFound = index.FindKeyframe((HNSTIME)((nState >> 11) % (uint64_t)hnsDuration));
+	}
+	(void)nFound;
+	Clock::time_point looked = Clock::now();
+
+	pResult->fBuildMs = ms(start, built);
+	pResult->fSaveMs = ms(built, saved);
+	pResult->fMapMs = ms(saved, mapped);
+	pResult->fLookupNs = cLookups ? ms(mapped, looked) * 1e6 / cLookups : 0.0;
+	return true;
+}
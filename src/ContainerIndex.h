@@ -0,0 +1,108 @@
+#pragma once
+#include "PlaybackClock.h"
+#include "FileUtil.h"
+#include <string>
+#include <vector>
+
+
+// A keyframe of the video track and the group of pictures it starts.
+// Stored as is in index files, which are mapped and searched in place.
+struct IndexKeyframe
+{
+	HNSTIME		hnsTime;		// Presentation time
+	uint64_t	nOffset;		// File offset of the keyframe sample
+	uint64_t	nEndOffset;		// End of the last sample of the GOP in the file
+	uint32_t	nFrame;			// Decode order number of the keyframe
+	uint32_t	cFrames;		// Frames in the GOP, the keyframe included
+};
+
+
+//-------------------------------------------------------------------
+//
+// ContainerIndex class
+//
+// Keyframes of the first video track of an MP4 or MOV file, with their
+// times, byte offsets and GOP boundaries, taken from the sample tables.
+//
+// Build parses the file once and Save writes the result to a compact
+// file, which Map later opens without reading it: lookups touch only the
+// pages a binary search needs. Open does both, building when the index
+// file is missing or the source changed since.
+//
+// Times are media times, before any edit list. Fragmented files have no
+// sample tables and are not indexed.
+//
+// Read-only once built or mapped; lookups may run on any thread.
+//
+//-------------------------------------------------------------------
+
+class ContainerIndex
+{
+public:
+	ContainerIndex();
+
+	bool Build(const std::wstring& source);
+	bool Save(const std::wstring& path) const;
+
+	// Maps an index file written for the source as described by info.
+	bool Map(const std::wstring& path, const FileInfo& info);
+
+	// Maps the index at path, first building and saving it if it is
+	// missing or stale.
+	bool Open(const std::wstring& source, const std::wstring& path);
+
+	void Clear();
+
+	bool IsEmpty() const { return m_cKeyframes == 0; }
+	bool IsMapped() const { return m_file.IsOpen(); }
+	size_t GetKeyframeCount() const { return m_cKeyframes; }
+	const IndexKeyframe& GetKeyframe(size_t nKeyframe) const { return m_pKeyframes[nKeyframe]; }
+	uint32_t GetFrameCount() const { return m_cFrames; }
+	HNSTIME GetDuration() const { return m_hnsDuration; }
+
+	// Keyframe to start decoding at to show hnsTime: the last one at or
+	// before it, or the first. 0 for an empty index.
+	size_t FindKeyframe(HNSTIME hnsTime) const;
+
+	// The first frame in decode order is a keyframe at the start of the
+	// clip, so a loop can restart there without decoding anything else.
+	bool StartsWithKeyframe() const;
+
+	// Index file of a source in a directory.
+	static std::wstring GetIndexPath(const std::wstring& directory, const std::wstring& source);
+
+private:
+	ContainerIndex(const ContainerIndex&);
+	ContainerIndex& operator=(const ContainerIndex&);
+
+	FileInfo					m_source;		// Source size and time when built
+	std::vector<IndexKeyframe>	m_built;		// Keyframes of Build
+	MappedFile					m_file;			// Keyframes of Map
+	const IndexKeyframe*		m_pKeyframes;	// Either of the two, in time order
+	size_t						m_cKeyframes;
+	uint32_t					m_cFrames;
+	HNSTIME						m_hnsDuration;
+};
+
+
+struct IndexBenchResult
+{
+	uint32_t	cFrames;
+	size_t		cKeyframes;
+	double		fBuildMs;
+	double		fSaveMs;
+	double		fMapMs;
+	double		fLookupNs;		// Per FindKeyframe in the mapping
+	bool		bMapped;		// The saved index mapped back; lookups ran
+};
+
+//-------------------------------------------------------------------
+// RunIndexBench
+//
+// Builds the index of source, saves it to indexPath and maps it back,
+// timing each, then times cLookups FindKeyframe calls at times spread
+// over the clip. False if the source has no sample tables to index.
+//-------------------------------------------------------------------
+
+bool RunIndexBench(const std::wstring& source, const std::wstring& indexPath, uint32_t cLookups,
+	IndexBenchResult* pResult);
@@ -0,0 +1,335 @@
+#include "pch.h"
+#include "ControlPipe.h"
+#include <sddl.h>
+#include <strsafe.h>
+
+
+static const DWORD PIPE_BUFFER_SIZE = 4096;
+
+// A command that takes longer than this on the window thread fails.
+static const UINT DISPATCH_TIMEOUT_MS = 5000;
+
+
+//-----------------------------------------------------------------------------
+// GetTokenUserSid
+//-----------------------------------------------------------------------------
+
+static HRESULT GetTokenUserSid(HANDLE hToken, std::vector<BYTE>* pSid)
+{
+	DWORD cbUser = 0;
+	GetTokenInformation(hToken, TokenUser, NULL, 0, &cbUser);
+	if (cbUser == 0)
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	std::vector<BYTE> user(cbUser);
+	if (!GetTokenInformation(hToken, TokenUser, user.data(), cbUser, &cbUser))
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	PSID pUserSid = ((TOKEN_USER*)user.data())->User.Sid;
+	pSid->resize(GetLengthSid(pUserSid));
+	return CopySid((DWORD)pSid->size(), pSid->data(), pUserSid) ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+}
+
+// User of a process, opened for query only.
+static HRESULT GetProcessUserSid(HANDLE hProcess, std::vector<BYTE>* pSid)
+{
+	HANDLE hToken = NULL;
+	if (!OpenProcessToken(hProcess, TOKEN_QUERY, &hToken))
+		return HRESULT_FROM_WIN32(GetLastError());
+	HRESULT hr = GetTokenUserSid(hToken, pSid);
+	CloseHandle(hToken);
+	return hr;
+}
+
+void GetControlPipeName(WCHAR* pszName, size_t cchName)
+{
+	DWORD dwSession = 0;
+	ProcessIdToSessionId(GetCurrentProcessId(), &dwSession);
+	StringCchPrintfW(pszName, cchName, L"\\\\.\\pipe\\LiveWallpaper-%u", dwSession);
+}
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+ControlPipeServer::ControlPipeServer() : m_hWnd(NULL), m_hPipe(INVALID_HANDLE_VALUE), m_hThread(NULL),
+	m_dwSession(0), m_bStop(FALSE)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+
+ControlPipeServer::~ControlPipeServer()
+{
+	Stop();
+}
+
+//-----------------------------------------------------------------------------
+// Start
+//
+// Creates the pipe before the thread starts, so that a name already
+// taken fails here. The DACL grants the current user alone; the pipe
+// is created as the first instance of its name, and fails if another
+// process already serves it.
+//-----------------------------------------------------------------------------
+
+HRESULT ControlPipeServer::Start(HWND hWnd)
+{
+	if (m_hThread)
+		return S_OK;
+
+	HRESULT hr = GetProcessUserSid(GetCurrentProcess(), &m_userSid);
+	if (FAILED(hr))
+		return hr;
+	if (!ProcessIdToSessionId(GetCurrentProcessId(), &m_dwSession))
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	LPWSTR pszSid = NULL;
+	if (!ConvertSidToStringSidW(m_userSid.data(), &pszSid))
+		return HRESULT_FROM_WIN32(GetLastError());
+	WCHAR szSddl[256];
+	hr = StringCchPrintfW(szSddl, ARRAYSIZE(szSddl), L"D:P(A;;GA;;;%s)", pszSid);
+	LocalFree(pszSid);
+	if (FAILED(hr))
+		return hr;
+
+	SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, FALSE };
+	if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(szSddl, SDDL_REVISION_1,
+		&sa.lpSecurityDescriptor, NULL))
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	WCHAR szName[64];
+	GetControlPipeName(szName, ARRAYSIZE(szName));
+	m_hPipe = CreateNamedPipeW(szName, PIPE_ACCESS_DUPLEX | FILE_FLAG_FIRST_PIPE_INSTANCE,
+		PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+		1, PIPE_BUFFER_SIZE, PIPE_BUFFER_SIZE, 0, &sa);
+	DWORD dwError = GetLastError();
+	LocalFree(sa.lpSecurityDescriptor);
+	if (m_hPipe == INVALID_HANDLE_VALUE)
+		return HRESULT_FROM_WIN32(dwError);
+
+	m_hWnd = hWnd;
+	m_bStop = FALSE;
+	m_hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+	if (!m_hThread) {
+		hr = HRESULT_FROM_WIN32(GetLastError());
+		CloseHandle(m_hPipe);
+		m_hPipe = INVALID_HANDLE_VALUE;
+		return hr;
+	}
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Stop
+//
+// The thread blocks in ConnectNamedPipe or ReadFile; both are cancelled
+// until it notices the stop flag. Requests still queued to the window
+// keep their calls alive until it handles them.
+//-----------------------------------------------------------------------------
+
+void ControlPipeServer::Stop()
+{
+	if (!m_hThread)
+		return;
+	InterlockedExchange(&m_bStop, TRUE);
+	do {
+		CancelSynchronousIo(m_hThread);
+	} while (WaitForSingleObject(m_hThread, 50) == WAIT_TIMEOUT);
+	CloseHandle(m_hThread);
+	m_hThread = NULL;
+	CloseHandle(m_hPipe);
+	m_hPipe = INVALID_HANDLE_VALUE;
+}
+
+//-----------------------------------------------------------------------------
+// ThreadProc
+//
+// Serves clients one after another on the same pipe instance. Closing
+// it between clients would free the name for anyone to create.
+//-----------------------------------------------------------------------------
+
+DWORD WINAPI ControlPipeServer::ThreadProc(LPVOID lpParameter)
+{
+	ControlPipeServer* pThis = (ControlPipeServer*)lpParameter;
+
+	while (!pThis->m_bStop) {
+		if (ConnectNamedPipe(pThis->m_hPipe, NULL) || GetLastError() == ERROR_PIPE_CONNECTED) {
+			if (!pThis->m_bStop && pThis->IsClientAllowed())
+				pThis->Serve();
+			FlushFileBuffers(pThis->m_hPipe);
+		}
+		else if (GetLastError() != ERROR_OPERATION_ABORTED && GetLastError() != ERROR_NO_DATA)
+			return 1;
+		DisconnectNamedPipe(pThis->m_hPipe);
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// IsClientAllowed
+//
+// The DACL already keeps other users out; this also turns away clients
+// of another session of the same user, and checks the identity of the
+// connected client's token rather than trusting the DACL alone.
+//-----------------------------------------------------------------------------
+
+bool ControlPipeServer::IsClientAllowed()
+{
+	ULONG ulSession = 0;
+	if (!GetNamedPipeClientSessionId(m_hPipe, &ulSession) || ulSession != m_dwSession)
+		return false;
+
+	if (!ImpersonateNamedPipeClient(m_hPipe))
+		return false;
+	HANDLE hToken = NULL;
+	BOOL bOpened = OpenThreadToken(GetCurrentThread(), TOKEN_QUERY, TRUE, &hToken);
+	if (!RevertToSelf())
+		ExitProcess(1);		// Never go on under the client's identity
+	if (!bOpened)
+		return false;
+
+	std::vector<BYTE> clientSid;
+	HRESULT hr = GetTokenUserSid(hToken, &clientSid);
+	CloseHandle(hToken);
+	return SUCCEEDED(hr) && EqualSid(clientSid.data(), m_userSid.data());
+}
+
+//-----------------------------------------------------------------------------
+// Serve
+//
+// Reads requests until the client disconnects or sends a malformed
+// stream, and writes a reply for each.
+//-----------------------------------------------------------------------------
+
+void ControlPipeServer::Serve()
+{
+	ControlConnection connection(this, DISPATCH_TIMEOUT_MS);
+	std::vector<uint8_t> replies;
+	BYTE buffer[PIPE_BUFFER_SIZE];
+	DWORD cbRead = 0;
+
+	while (!m_bStop && ReadFile(m_hPipe, buffer, sizeof(buffer), &cbRead, NULL) && cbRead > 0) {
+		replies.clear();
+		bool bValid = connection.OnReceive(buffer, cbRead, &replies);
+
+		DWORD cbWritten = 0;
+		if (!replies.empty() &&
+			!WriteFile(m_hPipe, replies.data(), (DWORD)replies.size(), &cbWritten, NULL))
+			break;
+		if (!bValid)
+			break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Post
+//
+// The window's reference is released by its WM_APP_CONTROL handler, so
+// the call outlives a wait that timed out.
+//-----------------------------------------------------------------------------
+
+bool ControlPipeServer::Post(ControlCall* pCall)
+{
+	pCall->AddRef();
+	if (PostMessageW(m_hWnd, WM_APP_CONTROL, 0, (LPARAM)pCall))
+		return true;
+	pCall->Release();
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// CheckServerIdentity
+//
+// Requests go only to a server of our own session and user, in case
+// another process got hold of the name.
+//-----------------------------------------------------------------------------
+
+static HRESULT CheckServerIdentity(HANDLE hPipe)
+{
+	DWORD dwSession = 0;
+	ULONG ulServerSession = 0, ulServerProcess = 0;
+	if (!ProcessIdToSessionId(GetCurrentProcessId(), &dwSession) ||
+		!GetNamedPipeServerSessionId(hPipe, &ulServerSession) ||
+		!GetNamedPipeServerProcessId(hPipe, &ulServerProcess))
+		return HRESULT_FROM_WIN32(GetLastError());
+	if (ulServerSession != dwSession)
+		return E_ACCESSDENIED;
+
+	HANDLE hServer = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, ulServerProcess);
+	if (!hServer)
+		return HRESULT_FROM_WIN32(GetLastError());
+	std::vector<BYTE> serverSid, userSid;
+	HRESULT hr = GetProcessUserSid(hServer, &serverSid);
+	CloseHandle(hServer);
+	if (SUCCEEDED(hr))
+		hr = GetProcessUserSid(GetCurrentProcess(), &userSid);
+	if (SUCCEEDED(hr) && !EqualSid(serverSid.data(), userSid.data()))
+		hr = E_ACCESSDENIED;
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// CallControlPipe
+//-----------------------------------------------------------------------------
+
+HRESULT CallControlPipe(const std::vector<ControlMessage>& requests, std::vector<ControlMessage>* pReplies,
+	DWORD dwTimeout)
+{
+	pReplies->clear();
+
+	WCHAR szName[64];
+	GetControlPipeName(szName, ARRAYSIZE(szName));
+	if (!WaitNamedPipeW(szName, dwTimeout))
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	// The server may only identify us, not act as us.
+	HANDLE hPipe = CreateFileW(szName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+		SECURITY_SQOS_PRESENT | SECURITY_IDENTIFICATION, NULL);
+	if (hPipe == INVALID_HANDLE_VALUE)
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	HRESULT hr = CheckServerIdentity(hPipe);
+	if (FAILED(hr)) {
+		CloseHandle(hPipe);
+		return hr;
+	}
+
+	std::vector<uint8_t> buffer;
+	for (size_t i = 0; i < requests.size(); i++) {
+		ControlMessage request = requests[i];
+		request.nSeq = (uint32_t)i;
+		request.bReply = false;
+		EncodeControlMessage(request, &buffer);
+	}
+
+	DWORD cbWritten = 0;
+	if (!WriteFile(hPipe, buffer.data(), (DWORD)buffer.size(), &cbWritten, NULL))
+		hr = HRESULT_FROM_WIN32(GetLastError());
+
+	ControlDecoder decoder;
+	BYTE chunk[PIPE_BUFFER_SIZE];
+	while (SUCCEEDED(hr) && pReplies->size() < requests.size()) {
+		ControlMessage reply;
+		CONTROL_DECODE result = decoder.Next(&reply);
+		if (result == CONTROL_DECODE_MESSAGE) {
+			pReplies->push_back(reply);
+			continue;
+		}
+		if (result == CONTROL_DECODE_ERROR) {
+			hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+			break;
+		}
+		DWORD cbRead = 0;
+		if (!ReadFile(hPipe, chunk, sizeof(chunk), &cbRead, NULL) || cbRead == 0) {
+			hr = HRESULT_FROM_WIN32(ERROR_BROKEN_PIPE);
+			break;
+		}
+		decoder.Feed(chunk, cbRead);
+	}
+
+	CloseHandle(hPipe);
+	return hr;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "ControlProtocol.h"
+
+
+// Private window message posted by the pipe thread for every request.
+// lparam = ControlCall*, with a reference the handler must release
+static const UINT WM_APP_CONTROL = WM_APP + 7;
+
+
+//-------------------------------------------------------------------
+//
+// ControlPipeServer class
+//
+// Serves the control protocol on a named pipe of the current session.
+// One client is served at a time on a background thread; each decoded
+// request is posted to the player window as WM_APP_CONTROL, so commands
+// run on the window thread.
+//
+// The pipe has a single instance, created as the first one of its name
+// and kept for the server's lifetime, so no other process can take the
+// name over. Only the current user can open it, and clients of another
+// session or user are dropped before anything they send is read.
+//
+//-------------------------------------------------------------------
+
+class ControlPipeServer : private IControlOwner
+{
+public:
+	ControlPipeServer();
+	~ControlPipeServer();
+
+	HRESULT Start(HWND hWnd);
+	void Stop();
+
+private:
+	static DWORD WINAPI ThreadProc(LPVOID lpParameter);
+	bool IsClientAllowed();
+	void Serve();
+	bool Post(ControlCall* pCall) override;
+
+	HWND				m_hWnd;
+	HANDLE				m_hPipe;
+	HANDLE				m_hThread;
+	DWORD				m_dwSession;
+	std::vector<BYTE>	m_userSid;
+	volatile LONG		m_bStop;
+};
+
+
+// Name of the control pipe of the current session.
+void GetControlPipeName(WCHAR* pszName, size_t cchName);
+
+//-------------------------------------------------------------------
+// CallControlPipe
+//
+// Sends requests to a running instance and waits for their replies.
+// Fails if no instance serves the pipe within dwTimeout milliseconds,
+// or if the pipe is served by another session or user.
+//-------------------------------------------------------------------
+
+HRESULT CallControlPipe(const std::vector<ControlMessage>& requests, std::vector<ControlMessage>* pReplies,
+	DWORD dwTimeout);
@@ -0,0 +1,417 @@
+#include "ControlProtocol.h"
+#include <string.h>
+#include <chrono>
+
+
+static const size_t HEADER_SIZE = 12;
+static const size_t STATS_SIZE = 56;
+static const uint16_t FLAG_REPLY = 0x0001;
+
+// Drop consumed bytes once they make up this much of the buffer.
+static const size_t COMPACT_THRESHOLD = 4096;
+
+//-----------------------------------------------------------------------------
+// Little-endian writers and readers
+//-----------------------------------------------------------------------------
+
+static void Put16(std::vector<uint8_t>* p, uint16_t v)
+{
+	p->push_back((uint8_t)v);
+	p->push_back((uint8_t)(v >> 8));
+}
+
+static void Put32(std::vector<uint8_t>* p, uint32_t v)
+{
+	Put16(p, (uint16_t)v);
+	Put16(p, (uint16_t)(v >> 16));
+}
+
+static void Put64(std::vector<uint8_t>* p, uint64_t v)
+{
+	Put32(p, (uint32_t)v);
+	Put32(p, (uint32_t)(v >> 32));
+}
+
+static void PutFloat(std::vector<uint8_t>* p, float f)
+{
+	uint32_t v;
+	memcpy(&v, &f, sizeof(v));
+	Put32(p, v);
+}
+
+static uint16_t Get16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t Get32(const uint8_t* p)
+{
+	return (uint32_t)Get16(p) | ((uint32_t)Get16(p + 2) << 16);
+}
+
+static uint64_t Get64(const uint8_t* p)
+{
+	return (uint64_t)Get32(p) | ((uint64_t)Get32(p + 4) << 32);
+}
+
+static float GetFloat(const uint8_t* p)
+{
+	uint32_t v = Get32(p);
+	float f;
+	memcpy(&f, &v, sizeof(f));
+	return f;
+}
+
+// wchar_t is UTF-16 on Windows and UTF-32 elsewhere.
+static void PutText(std::vector<uint8_t>* p, const std::wstring& text)
+{
+	for (size_t i = 0; i < text.size(); i++) {
+		uint32_t c = (uint32_t)text[i];
+		if (c > 0xFFFF) {
+			c -= 0x10000;
+			Put16(p, (uint16_t)(0xD800 + (c >> 10)));
+			Put16(p, (uint16_t)(0xDC00 + (c & 0x3FF)));
+		}
+		else {
+			Put16(p, (uint16_t)c);
+		}
+	}
+}
+
+static void GetText(const uint8_t* p, size_t cb, std::wstring* pText)
+{
+	pText->clear();
+	pText->reserve(cb / 2);
+	for (size_t i = 0; i + 1 < cb; i += 2) {
+		uint32_t c = Get16(p + i);
+		if (sizeof(wchar_t) > 2 && c >= 0xD800 && c < 0xDC00 && i + 3 < cb) {
+			uint32_t lo = Get16(p + i + 2);
+			if (lo >= 0xDC00 && lo < 0xE000) {
+				c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+				i += 2;
+			}
+		}
+		pText->push_back((wchar_t)c);
+	}
+}
+
+static bool HasStats(const ControlMessage& msg)
+{
+	return msg.bReply && msg.command == CONTROL_COMMAND_QUERY_STATS && msg.nStatus == CONTROL_S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// EncodeControlMessage
+//-----------------------------------------------------------------------------
+
+void EncodeControlMessage(const ControlMessage& msg, std::vector<uint8_t>* pBuffer)
+{
+	size_t nHeader = pBuffer->size();
+	Put32(pBuffer, 0);	// Body size, patched below
+	Put16(pBuffer, (uint16_t)msg.command);
+	Put16(pBuffer, msg.bReply ? FLAG_REPLY : 0);
+	Put32(pBuffer, msg.nSeq);
+
+	if (msg.bReply) {
+		Put32(pBuffer, (uint32_t)msg.nStatus);
+		if (HasStats(msg)) {
+			const ControlStats& s = msg.stats;
+			Put32(pBuffer, s.nState);
+			Put32(pBuffer, s.nMode);
+			Put64(pBuffer, (uint64_t)s.hnsPosition);
+			Put64(pBuffer, (uint64_t)s.hnsDuration);
+			PutFloat(pBuffer, s.fRate);
+			PutFloat(pBuffer, s.fVolume);
+			Put32(pBuffer, s.cLoops);
+			Put32(pBuffer, s.cMissedLoops);
+			Put64(pBuffer, (uint64_t)s.hnsSeekLatency);
+			Put32(pBuffer, s.nClip);
+			Put32(pBuffer, s.cClips);
+		}
+	}
+	else {
+		switch (msg.command) {
+		case CONTROL_COMMAND_OPEN:
+			PutText(pBuffer, msg.text);
+			break;
+		case CONTROL_COMMAND_SEEK:
+			Put64(pBuffer, (uint64_t)msg.hnsValue);
+			break;
+		case CONTROL_COMMAND_SET_RATE:
+		case CONTROL_COMMAND_SET_VOLUME:
+			PutFloat(pBuffer, msg.fValue);
+			break;
+		default:
+			break;
+		}
+	}
+
+	uint32_t cbBody = (uint32_t)(pBuffer->size() - nHeader - HEADER_SIZE);
+	uint8_t* p = pBuffer->data() + nHeader;
+	p[0] = (uint8_t)cbBody;
+	p[1] = (uint8_t)(cbBody >> 8);
+	p[2] = (uint8_t)(cbBody >> 16);
+	p[3] = (uint8_t)(cbBody >> 24);
+}
+
+//-----------------------------------------------------------------------------
+// ControlDecoder
+//-----------------------------------------------------------------------------
+
+ControlDecoder::ControlDecoder() : m_nOffset(0), m_bError(false)
+{
+}
+
+void ControlDecoder::Feed(const void* pData, size_t cbData)
+{
+	if (m_bError)
+		return;
+	if (m_nOffset >= COMPACT_THRESHOLD && m_nOffset * 2 >= m_buffer.size()) {
+		m_buffer.erase(m_buffer.begin(), m_buffer.begin() + m_nOffset);
+		m_nOffset = 0;
+	}
+	const uint8_t* p = (const uint8_t*)pData;
+	m_buffer.insert(m_buffer.end(), p, p + cbData);
+}
+
+void ControlDecoder::Reset()
+{
+	m_buffer.clear();
+	m_nOffset = 0;
+	m_bError = false;
+}
+
+//-----------------------------------------------------------------------------
+// Next
+//
+// Bodies must have the exact size of their command. Requests with an
+// unknown command are returned with their body skipped, so the dispatcher
+// can reject them and the stream stays in sync.
+//-----------------------------------------------------------------------------
+
+CONTROL_DECODE ControlDecoder::Next(ControlMessage* pMsg)
+{
+	if (m_bError)
+		return CONTROL_DECODE_ERROR;
+	if (m_buffer.size() - m_nOffset < HEADER_SIZE)
+		return CONTROL_DECODE_NEED_MORE;
+
+	const uint8_t* p = m_buffer.data() + m_nOffset;
+	uint32_t cbBody = Get32(p);
+	if (cbBody > CONTROL_MAX_BODY) {
+		m_bError = true;
+		return CONTROL_DECODE_ERROR;
+	}
+	if (m_buffer.size() - m_nOffset < HEADER_SIZE + cbBody)
+		return CONTROL_DECODE_NEED_MORE;
+
+	ControlMessage msg;
+	msg.command = (CONTROL_COMMAND)Get16(p + 4);
+	msg.bReply = (Get16(p + 6) & FLAG_REPLY) != 0;
+	msg.nSeq = Get32(p + 8);
+
+	const uint8_t* pBody = p + HEADER_SIZE;
+	bool bValid = true;
+	if (msg.bReply) {
+		bValid = cbBody >= 4;
+		if (bValid) {
+			msg.nStatus = (int32_t)Get32(pBody);
+			if (HasStats(msg)) {
+				bValid = cbBody == 4 + STATS_SIZE;
+				if (bValid) {
+					const uint8_t* s = pBody + 4;
+					msg.stats.nState = Get32(s);
+					msg.stats.nMode = Get32(s + 4);
+					msg.stats.hnsPosition = (HNSTIME)Get64(s + 8);
+					msg.stats.hnsDuration = (HNSTIME)Get64(s + 16);
+					msg.stats.fRate = GetFloat(s + 24);
+					msg.stats.fVolume = GetFloat(s + 28);
+					msg.stats.cLoops = Get32(s + 32);
+					msg.stats.cMissedLoops = Get32(s + 36);
+					msg.stats.hnsSeekLatency = (HNSTIME)Get64(s + 40);
+					msg.stats.nClip = Get32(s + 48);
+					msg.stats.cClips = Get32(s + 52);
+				}
+			}
+		}
+	}
+	else {
+		switch (msg.command) {
+		case CONTROL_COMMAND_OPEN:
+			bValid = cbBody % 2 == 0;
+			if (bValid)
+				GetText(pBody, cbBody, &msg.text);
+			break;
+		case CONTROL_COMMAND_PAUSE:
+		case CONTROL_COMMAND_RESUME:
+		case CONTROL_COMMAND_QUERY_STATS:
+			bValid = cbBody == 0;
+			break;
+		case CONTROL_COMMAND_SEEK:
+			bValid = cbBody == 8;
+			if (bValid)
+				msg.hnsValue = (HNSTIME)Get64(pBody);
+			break;
+		case CONTROL_COMMAND_SET_RATE:
+		case CONTROL_COMMAND_SET_VOLUME:
+			bValid = cbBody == 4;
+			if (bValid)
+				msg.fValue = GetFloat(pBody);
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (!bValid) {
+		m_bError = true;
+		return CONTROL_DECODE_ERROR;
+	}
+
+	m_nOffset += HEADER_SIZE + cbBody;
+	if (m_nOffset == m_buffer.size()) {
+		m_buffer.clear();
+		m_nOffset = 0;
+	}
+	*pMsg = msg;
+	return CONTROL_DECODE_MESSAGE;
+}
+
+//-----------------------------------------------------------------------------
+// ControlDispatcher
+//-----------------------------------------------------------------------------
+
+ControlDispatcher::ControlDispatcher(IControlTarget* pTarget) : m_pTarget(pTarget), m_cDispatched(0)
+{
+}
+
+void ControlDispatcher::Dispatch(const ControlMessage& request, ControlMessage* pReply)
+{
+	*pReply = ControlMessage();
+	pReply->command = request.command;
+	pReply->nSeq = request.nSeq;
+	pReply->bReply = true;
+	m_cDispatched++;
+
+	if (request.bReply) {
+		pReply->nStatus = CONTROL_E_INVALIDARG;
+		return;
+	}
+
+	switch (request.command) {
+	case CONTROL_COMMAND_OPEN:
+		pReply->nStatus = request.text.empty() ? CONTROL_E_INVALIDARG : m_pTarget->Open(request.text);
+		break;
+	case CONTROL_COMMAND_PAUSE:
+		pReply->nStatus = m_pTarget->Pause();
+		break;
+	case CONTROL_COMMAND_RESUME:
+		pReply->nStatus = m_pTarget->Resume();
+		break;
+	case CONTROL_COMMAND_SEEK:
+		pReply->nStatus = request.hnsValue < 0 ? CONTROL_E_INVALIDARG : m_pTarget->Seek(request.hnsValue);
+		break;
+	case CONTROL_COMMAND_SET_RATE:
+		// Rejects NaN as well.
+		pReply->nStatus = !(request.fValue > 0.0f) ? CONTROL_E_INVALIDARG : m_pTarget->SetRate(request.fValue);
+		break;
+	case CONTROL_COMMAND_SET_VOLUME:
+		pReply->nStatus = !(request.fValue >= 0.0f && request.fValue <= 1.0f) ? CONTROL_E_INVALIDARG :
+			m_pTarget->SetVolume(request.fValue);
+		break;
+	case CONTROL_COMMAND_QUERY_STATS:
+		pReply->nStatus = m_pTarget->QueryStats(&pReply->stats);
+		break;
+	default:
+		pReply->nStatus = CONTROL_E_NOTIMPL;
+		break;
+	}
+}
+
+bool ControlDispatcher::OnReceive(ControlDecoder* pDecoder, const void* pData, size_t cbData,
+	std::vector<uint8_t>* pReplies)
+{
+	pDecoder->Feed(pData, cbData);
+
+	ControlMessage request, reply;
+	CONTROL_DECODE result;
+	while ((result = pDecoder->Next(&request)) == CONTROL_DECODE_MESSAGE) {
+		Dispatch(request, &reply);
+		EncodeControlMessage(reply, pReplies);
+	}
+	return result != CONTROL_DECODE_ERROR;
+}
+
+//-----------------------------------------------------------------------------
+// ControlCall
+//-----------------------------------------------------------------------------
+
+ControlCall::ControlCall(const ControlMessage& request) : m_cRef(1), m_bCompleted(false), m_request(request)
+{
+}
+
+void ControlCall::AddRef()
+{
+	m_cRef.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ControlCall::Release()
+{
+	if (m_cRef.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		delete this;
+}
+
+void ControlCall::Complete(const ControlMessage& reply)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_reply = reply;
+	m_bCompleted = true;
+	m_completed.notify_all();
+}
+
+bool ControlCall::Wait(uint32_t nTimeoutMs, ControlMessage* pReply)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	if (!m_completed.wait_for(lock, std::chrono::milliseconds(nTimeoutMs), [this] { return m_bCompleted; }))
+		return false;
+	*pReply = m_reply;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// ControlConnection
+//-----------------------------------------------------------------------------
+
+ControlConnection::ControlConnection(IControlOwner* pOwner, uint32_t nTimeoutMs) :
+	m_pOwner(pOwner), m_nTimeoutMs(nTimeoutMs), m_cTimeouts(0)
+{
+}
+
+bool ControlConnection::OnReceive(const void* pData, size_t cbData, std::vector<uint8_t>* pReplies)
+{
+	m_decoder.Feed(pData, cbData);
+
+	ControlMessage request, reply;
+	CONTROL_DECODE result;
+	while ((result = m_decoder.Next(&request)) == CONTROL_DECODE_MESSAGE) {
+		ControlCall* pCall = new ControlCall(request);
+		int32_t nStatus = CONTROL_S_OK;
+		if (!m_pOwner->Post(pCall))
+			nStatus = CONTROL_E_FAIL;
+		else if (!pCall->Wait(m_nTimeoutMs, &reply)) {
+			nStatus = CONTROL_E_TIMEOUT;
+			m_cTimeouts++;
+		}
+		pCall->Release();
+
+		if (nStatus != CONTROL_S_OK) {
+			reply = ControlMessage();
+			reply.command = request.command;
+			reply.nSeq = request.nSeq;
+			reply.bReply = true;
+			reply.nStatus = nStatus;
+		}
+		EncodeControlMessage(reply, pReplies);
+	}
+	return result != CONTROL_DECODE_ERROR;
+}
@@ -0,0 +1,262 @@
+#pragma once
+#include "PlaybackClock.h"
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+// Commands of the control protocol. Values are part of the wire format;
+// the type is as wide as the wire field, so unknown commands are values
+// of it too.
+enum CONTROL_COMMAND : uint16_t
+{
+	CONTROL_COMMAND_OPEN = 1,		// text = clip path
+	CONTROL_COMMAND_PAUSE,
+	CONTROL_COMMAND_RESUME,
+	CONTROL_COMMAND_SEEK,			// hnsValue = position
+	CONTROL_COMMAND_SET_RATE,		// fValue = rate
+	CONTROL_COMMAND_SET_VOLUME,		// fValue = volume, 0..1
+	CONTROL_COMMAND_QUERY_STATS		// reply carries stats
+};
+
+// Reply status codes. They match the HRESULTs of the same name, so a
+// Windows target can return its HRESULTs as they are.
+const int32_t CONTROL_S_OK = 0;
+const int32_t CONTROL_E_FAIL = (int32_t)0x80004005;
+const int32_t CONTROL_E_NOTIMPL = (int32_t)0x80004001;
+const int32_t CONTROL_E_INVALIDARG = (int32_t)0x80070057;
+const int32_t CONTROL_E_TIMEOUT = (int32_t)0x800705B4;		// HRESULT_FROM_WIN32(ERROR_TIMEOUT)
+
+// Largest message body accepted by the decoder.
+const uint32_t CONTROL_MAX_BODY = 64 * 1024;
+
+// Player state reported by QUERY_STATS.
+enum CONTROL_STATE
+{
+	CONTROL_STATE_STOPPED = 0,
+	CONTROL_STATE_PLAYING,
+	CONTROL_STATE_PAUSED
+};
+
+struct ControlStats
+{
+	uint32_t	nState;			// CONTROL_STATE
+	uint32_t	nMode;			// Governor mode
+	HNSTIME		hnsPosition;
+	HNSTIME		hnsDuration;
+	float		fRate;
+	float		fVolume;
+	uint32_t	cLoops;
+	uint32_t	cMissedLoops;	// Loops wrapped late, by the end of playback
+	HNSTIME		hnsSeekLatency;
+	uint32_t	nClip;			// Index of the current clip
+	uint32_t	cClips;
+};
+
+struct ControlMessage
+{
+	CONTROL_COMMAND	command;
+	uint32_t		nSeq;		// Echoed in the reply
+	bool			bReply;
+	int32_t			nStatus;	// Replies only
+	HNSTIME			hnsValue;
+	float			fValue;
+	std::wstring	text;
+	ControlStats	stats;		// QUERY_STATS replies only
+
+	ControlMessage() : command(CONTROL_COMMAND_QUERY_STATS), nSeq(0), bReply(false), nStatus(CONTROL_S_OK),
+		hnsValue(0), fValue(0.0f), stats()
+	{
+	}
+};
+
+
+//-------------------------------------------------------------------
+// EncodeControlMessage
+//
+// Appends one framed message to pBuffer. Every message is a 12 byte
+// header (body size, command, flags, sequence number, little-endian)
+// followed by the command's body. Text is sent as UTF-16.
+//-------------------------------------------------------------------
+
+void EncodeControlMessage(const ControlMessage& msg, std::vector<uint8_t>* pBuffer);
+
+
+enum CONTROL_DECODE
+{
+	CONTROL_DECODE_NEED_MORE = 0,	// No complete message buffered
+	CONTROL_DECODE_MESSAGE,			// A message was returned
+	CONTROL_DECODE_ERROR			// Malformed stream; the connection should be dropped
+};
+
+//-------------------------------------------------------------------
+//
+// ControlDecoder class
+//
+// Splits a byte stream into messages. Bytes are fed as they arrive, in
+// chunks of any size; Next() returns the complete messages one by one.
+//
+//-------------------------------------------------------------------
+
+class ControlDecoder
+{
+public:
+	ControlDecoder();
+
+	void Feed(const void* pData, size_t cbData);
+	CONTROL_DECODE Next(ControlMessage* pMsg);
+	void Reset();
+
+	size_t GetBufferedSize() const { return m_buffer.size() - m_nOffset; }
+
+private:
+	std::vector<uint8_t>	m_buffer;
+	size_t					m_nOffset;	// Start of the first undecoded message
+	bool					m_bError;
+};
+
+
+//-------------------------------------------------------------------
+//
+// IControlTarget interface
+//
+// What the commands act on. Each method returns a status code.
+//
+//-------------------------------------------------------------------
+
+class IControlTarget
+{
+public:
+	virtual ~IControlTarget() {}
+
+	virtual int32_t Open(const std::wstring& path) = 0;
+	virtual int32_t Pause() = 0;
+	virtual int32_t Resume() = 0;
+	virtual int32_t Seek(HNSTIME hnsPosition) = 0;
+	virtual int32_t SetRate(float fRate) = 0;
+	virtual int32_t SetVolume(float fVolume) = 0;
+	virtual int32_t QueryStats(ControlStats* pStats) = 0;
+};
+
+
+//-------------------------------------------------------------------
+//
+// ControlDispatcher class
+//
+// Applies requests to an IControlTarget and builds their replies. It
+// knows nothing of the transport: a transport decodes requests, calls
+// Dispatch() on the thread that owns the target and sends the replies.
+//
+//-------------------------------------------------------------------
+
+class ControlDispatcher
+{
+public:
+	explicit ControlDispatcher(IControlTarget* pTarget);
+
+	void Dispatch(const ControlMessage& request, ControlMessage* pReply);
+
+	// Decodes requests from a received chunk, dispatches them and appends
+	// the encoded replies. Returns false if the stream is malformed.
+	bool OnReceive(ControlDecoder* pDecoder, const void* pData, size_t cbData, std::vector<uint8_t>* pReplies);
+
+	uint32_t GetDispatchCount() const { return m_cDispatched; }
+
+private:
+	IControlTarget*	m_pTarget;
+	uint32_t		m_cDispatched;
+};
+
+
+//-------------------------------------------------------------------
+//
+// ControlCall class
+//
+// One request handed from a transport thread to the thread that owns
+// the target, and its reply. It is reference counted so that either
+// side can give up on it: a transport that stops waiting releases its
+// reference, and the owner still completes and releases its own when
+// it gets to the request, without touching the transport's stack.
+//
+//-------------------------------------------------------------------
+
+class ControlCall
+{
+public:
+	// Starts with one reference, the caller's.
+	explicit ControlCall(const ControlMessage& request);
+
+	void AddRef();
+	void Release();
+
+	const ControlMessage& GetRequest() const { return m_request; }
+
+	// Owner thread: stores the reply and wakes the transport.
+	void Complete(const ControlMessage& reply);
+
+	// Transport thread: waits up to nTimeoutMs for the reply. Returns
+	// false if the call was not completed in time.
+	bool Wait(uint32_t nTimeoutMs, ControlMessage* pReply);
+
+private:
+	~ControlCall() {}
+
+	std::atomic<long>		m_cRef;
+	std::mutex				m_lock;
+	std::condition_variable	m_completed;
+	bool					m_bCompleted;
+	ControlMessage			m_request;
+	ControlMessage			m_reply;
+};
+
+
+//-------------------------------------------------------------------
+//
+// IControlOwner interface
+//
+// Hands a call to the thread that owns the target. On success the
+// owner takes a reference of its own: it must Dispatch() the request,
+// Complete() the call and Release() it, however late.
+//
+//-------------------------------------------------------------------
+
+class IControlOwner
+{
+public:
+	virtual ~IControlOwner() {}
+
+	virtual bool Post(ControlCall* pCall) = 0;
+};
+
+
+//-------------------------------------------------------------------
+//
+// ControlConnection class
+//
+// The server side of one client connection on a transport thread:
+// decodes the requests received, runs each on the owner's thread and
+// encodes the replies. A request the owner does not answer in time is
+// replied CONTROL_E_TIMEOUT, and one it cannot be handed CONTROL_E_FAIL.
+//
+//-------------------------------------------------------------------
+
+class ControlConnection
+{
+public:
+	ControlConnection(IControlOwner* pOwner, uint32_t nTimeoutMs);
+
+	// Appends the encoded replies to the requests completed by this chunk.
+	// Returns false if the stream is malformed.
+	bool OnReceive(const void* pData, size_t cbData, std::vector<uint8_t>* pReplies);
+
+	uint32_t GetTimeoutCount() const { return m_cTimeouts; }
+
+private:
+	IControlOwner*	m_pOwner;
+	uint32_t		m_nTimeoutMs;
+	ControlDecoder	m_decoder;
+	uint32_t		m_cTimeouts;
+};
@@ -0,0 +1,107 @@
+#include "DesktopHostTracker.h"
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+DesktopHostTracker::DesktopHostTracker(IWindowTree* pTree, const HostTrackerConfig& config) :
+	m_pTree(pTree), m_config(config), m_hHost(0), m_hProgman(0), m_bStale(true), m_hnsRetry(-1),
+	m_hnsRetryDelay(0)
+{
+	m_stats = HostTrackerStats();
+}
+
+bool DesktopHostTracker::Attach(bool bSpawn)
+{
+	m_hHost = Resolve(bSpawn);
+	m_bStale = m_hHost == 0;
+	m_hnsRetry = -1;
+	m_hnsRetryDelay = 0;
+	return m_hHost != 0;
+}
+
+//-----------------------------------------------------------------------------
+// Check
+//
+// Two liveness queries while the host is valid. A lookup that finds no
+// host schedules the next one; until then Check() reports HOST_LOST
+// without touching the window tree.
+//-----------------------------------------------------------------------------
+
+HOST_CHECK DesktopHostTracker::Check(HNSTIME hnsNow)
+{
+	m_stats.cChecks++;
+	if (!m_bStale && m_hHost && m_pTree->IsAlive(m_hHost) && m_pTree->IsAlive(m_hProgman))
+		return HOST_OK;
+	if (m_hnsRetry >= 0 && hnsNow < m_hnsRetry)
+		return HOST_LOST;
+
+	HostWindow hOld = m_hHost;
+	m_hHost = Resolve(true);
+	if (!m_hHost) {
+		m_bStale = true;
+		m_hnsRetryDelay = m_hnsRetryDelay ? m_hnsRetryDelay * 2 : m_config.hnsMinRetry;
+		if (m_hnsRetryDelay > m_config.hnsMaxRetry)
+			m_hnsRetryDelay = m_config.hnsMaxRetry;
+		m_hnsRetry = hnsNow + m_hnsRetryDelay;
+		return HOST_LOST;
+	}
+
+	m_bStale = false;
+	m_hnsRetry = -1;
+	m_hnsRetryDelay = 0;
+	if (m_hHost == hOld)
+		return HOST_OK;
+	m_stats.cReattaches++;
+	return HOST_CHANGED;
+}
+
+void DesktopHostTracker::Invalidate()
+{
+	m_bStale = true;
+	m_hnsRetry = -1;
+	m_hnsRetryDelay = 0;
+}
+
+void DesktopHostTracker::OnWindowDestroyed(HostWindow hWnd)
+{
+	if (hWnd && (hWnd == m_hHost || hWnd == m_hProgman))
+		Invalidate();
+}
+
+//-----------------------------------------------------------------------------
+// Resolve
+//
+// On Windows 11 24H2 and later the WorkerW is a child of Progman. Before
+// that it is the top-level WorkerW right after the window holding the
+// desktop icons (SHELLDLL_DefView), which is Progman or another WorkerW.
+// Only windows of these classes are visited, not the whole tree.
+//-----------------------------------------------------------------------------
+
+HostWindow DesktopHostTracker::Resolve(bool bSpawn)
+{
+	m_stats.cResolves++;
+	m_hProgman = Find(0, 0, L"Progman");
+	if (!m_hProgman)
+		return 0;
+	if (bSpawn)
+		m_pTree->SpawnWorker(m_hProgman);
+
+	HostWindow hHost = Find(m_hProgman, 0, L"WorkerW");
+	if (hHost)
+		return hHost;
+
+	HostWindow hIcons = Find(m_hProgman, 0, L"SHELLDLL_DefView") ? m_hProgman : 0;
+	for (HostWindow hWorker = 0; !hIcons && (hWorker = Find(0, hWorker, L"WorkerW")) != 0; ) {
+		if (Find(hWorker, 0, L"SHELLDLL_DefView"))
+			hIcons = hWorker;
+	}
+	return hIcons ? Find(0, hIcons, L"WorkerW") : 0;
+}
+
+HostWindow DesktopHostTracker::Find(HostWindow hParent, HostWindow hAfter, const wchar_t* pszClass)
+{
+	m_stats.cQueries++;
+	return m_pTree->FindClass(hParent, hAfter, pszClass);
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "PlaybackClock.h"
+#include <stdint.h>
+
+
+// Window handle as the tracker sees it, 0 = no window.
+typedef uintptr_t HostWindow;
+
+// Result of DesktopHostTracker::Check().
+enum HOST_CHECK
+{
+	HOST_OK = 0,		// The cached host is still valid
+	HOST_CHANGED,		// A new host was found; the wallpaper must move to it
+	HOST_LOST			// No host yet, e.g. while Explorer restarts; retry at GetDeadline()
+};
+
+struct HostTrackerConfig
+{
+	HNSTIME	hnsMinRetry;	// First retry delay after the host was lost
+	HNSTIME	hnsMaxRetry;	// Retry delays double up to this
+
+	HostTrackerConfig() : hnsMinRetry(250 * HNS_PER_MSEC), hnsMaxRetry(8 * HNS_PER_SECOND)
+	{
+	}
+};
+
+struct HostTrackerStats
+{
+	uint32_t	cChecks;		// Check() calls
+	uint32_t	cResolves;		// Lookups of the host from the window tree
+	uint32_t	cQueries;		// IWindowTree::FindClass() calls made by the lookups
+	uint32_t	cReattaches;	// Times the host changed
+};
+
+
+//-------------------------------------------------------------------
+//
+// IWindowTree interface
+//
+// The window queries the tracker needs, so it runs against the desktop
+// or against a fake tree.
+//
+//-------------------------------------------------------------------
+
+class IWindowTree
+{
+public:
+	virtual ~IWindowTree() {}
+
+	// Next window of class pszClass after hAfter in z-order, among the
+	// children of hParent. hParent 0 searches the top-level windows,
+	// hAfter 0 starts at the first window.
+	virtual HostWindow FindClass(HostWindow hParent, HostWindow hAfter, const wchar_t* pszClass) = 0;
+
+	virtual bool IsAlive(HostWindow hWnd) = 0;
+
+	// Asks Program Manager to create the WorkerW behind the desktop icons.
+	virtual void SpawnWorker(HostWindow hProgman) = 0;
+};
+
+
+//-------------------------------------------------------------------
+//
+// DesktopHostTracker class
+//
+// Finds the WorkerW window the wallpaper is drawn into and keeps it.
+// Check() only asks whether the cached windows are alive; the lookup
+// runs again after Invalidate() (the shell restarted) or once a cached
+// window is gone, and walks only the Progman and WorkerW windows.
+//
+// While no host can be found, lookups are retried with a doubling delay.
+//
+//-------------------------------------------------------------------
+
+class DesktopHostTracker
+{
+public:
+	DesktopHostTracker(IWindowTree* pTree, const HostTrackerConfig& config);
+
+	// Looks up the host now. bSpawn has Progman create the WorkerW first.
+	// Returns false if there is none.
+	bool Attach(bool bSpawn);
+
+	// Validates the cached host and looks it up again if needed.
+	HOST_CHECK Check(HNSTIME hnsNow);
+
+	// Forces a lookup on the next Check().
+	void Invalidate();
+
+	// A window was destroyed; invalidates if it is the host or Progman.
+	void OnWindowDestroyed(HostWindow hWnd);
+
+	HostWindow GetHost() const { return m_hHost; }
+	HostWindow GetProgman() const { return m_hProgman; }
+
+	// Time of the next lookup while the host is lost, -1 otherwise.
+	HNSTIME GetDeadline() const { return m_hnsRetry; }
+
+	const HostTrackerStats& GetStats() const { return m_stats; }
+
+private:
+	HostWindow Resolve(bool bSpawn);
+	HostWindow Find(HostWindow hParent, HostWindow hAfter, const wchar_t* pszClass);
+
+	IWindowTree*		m_pTree;
+	HostTrackerConfig	m_config;
+	HostWindow			m_hHost;
+	HostWindow			m_hProgman;
+	bool				m_bStale;		// Look up the host on the next check
+	HNSTIME				m_hnsRetry;		// Next lookup while lost, -1 = none
+	HNSTIME				m_hnsRetryDelay;
+	HostTrackerStats	m_stats;
+};
@@ -0,0 +1,372 @@
+#include "EventLoop.h"
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+EventLoop::EventLoop() : m_pHandler(nullptr), m_bQuit(false), m_nExitCode(0), m_cHandles(0), m_fPending(0),
+m_cPosts(0)
+{
+#ifdef _WIN32
+	m_hWake = NULL;
+#else
+	m_nEpoll = m_nWake = -1;
+#endif
+	for (uint32_t i = 0; i < EVENT_LOOP_MAX_TIMERS; i++) {
+		m_timers[i].hnsDue = -1;
+		m_timers[i].hnsTolerance = 0;
+		m_timers[i].hnsPeriod = 0;
+	}
+	for (uint32_t i = 0; i < EVENT_LOOP_MAX_EVENTS; i++) {
+		m_slots[i].nValue.store(0, std::memory_order_relaxed);
+		m_slots[i].fSeen.store(0, std::memory_order_relaxed);
+	}
+	ResetStats();
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+
+EventLoop::~EventLoop()
+{
+#ifdef _WIN32
+	if (m_hWake)
+		CloseHandle(m_hWake);
+#else
+	if (m_nWake >= 0)
+		close(m_nWake);
+	if (m_nEpoll >= 0)
+		close(m_nEpoll);
+#endif
+}
+
+bool EventLoop::Initialize()
+{
+#ifdef _WIN32
+	if (!m_hWake)
+		m_hWake = CreateEventW(NULL, FALSE, FALSE, NULL);
+	return m_hWake != NULL;
+#else
+	if (m_nEpoll >= 0)
+		return true;
+	m_nEpoll = epoll_create1(EPOLL_CLOEXEC);
+	m_nWake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = m_nWake;
+	if (m_nEpoll >= 0 && m_nWake >= 0 && epoll_ctl(m_nEpoll, EPOLL_CTL_ADD, m_nWake, &event) == 0)
+		return true;
+	if (m_nWake >= 0)
+		close(m_nWake);
+	if (m_nEpoll >= 0)
+		close(m_nEpoll);
+	m_nWake = m_nEpoll = -1;
+	return false;
+#endif
+}
+
+bool EventLoop::AddHandle(EVENT_HANDLE hObject)
+{
+	if (m_cHandles == EVENT_LOOP_MAX_HANDLES)
+		return false;
+#ifndef _WIN32
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = (int)hObject;
+	if (m_nEpoll < 0 || epoll_ctl(m_nEpoll, EPOLL_CTL_ADD, (int)hObject, &event) != 0)
+		return false;
+#endif
+	m_handles[m_cHandles++] = hObject;
+	return true;
+}
+
+void EventLoop::RemoveHandle(EVENT_HANDLE hObject)
+{
+	for (size_t i = 0; i < m_cHandles; i++) {
+		if (m_handles[i] != hObject)
+			continue;
+#ifndef _WIN32
+		epoll_ctl(m_nEpoll, EPOLL_CTL_DEL, (int)hObject, NULL);
+#endif
+		m_handles[i] = m_handles[--m_cHandles];
+		return;
+	}
+}
+
+void EventLoop::SetTimer(uint32_t nTimer, HNSTIME hnsDelay, HNSTIME hnsTolerance)
+{
+	Timer& timer = m_timers[nTimer];
+	timer.hnsDue = GetTime() + (hnsDelay > 0 ? hnsDelay : 0);
+	timer.hnsTolerance = hnsTolerance > 0 ? hnsTolerance : 0;
+	timer.hnsPeriod = 0;
+}
+
+void EventLoop::SetPeriodicTimer(uint32_t nTimer, HNSTIME hnsPeriod, HNSTIME hnsTolerance)
+{
+	SetTimer(nTimer, hnsPeriod, hnsTolerance);
+	m_timers[nTimer].hnsPeriod = hnsPeriod > 0 ? hnsPeriod : 1;
+}
+
+void EventLoop::KillTimer(uint32_t nTimer)
+{
+	m_timers[nTimer].hnsDue = -1;
+}
+
+bool EventLoop::IsTimerSet(uint32_t nTimer) const
+{
+	return m_timers[nTimer].hnsDue >= 0;
+}
+
+//-----------------------------------------------------------------------------
+// Post
+//
+// The value and its seen bit are stored before the pending bit is set,
+// so the loop never finds the bit without them. Only the post that sets
+// the first pending bit wakes the loop; the others ride on its wakeup.
+//-----------------------------------------------------------------------------
+
+void EventLoop::Post(uint32_t nEvent, uint64_t nValue)
+{
+	Slot& slot = m_slots[nEvent];
+	m_cPosts.fetch_add(1, std::memory_order_relaxed);
+	slot.nValue.store(nValue, std::memory_order_relaxed);
+	slot.fSeen.fetch_or(1ull << (nValue & 63), std::memory_order_relaxed);
+	if (m_fPending.fetch_or(1u << nEvent, std::memory_order_acq_rel) == 0)
+		Wake();
+}
+
+int EventLoop::Run()
+{
+	m_bQuit = false;
+	while (!m_bQuit)
+		RunOnce(-1);
+	return m_nExitCode;
+}
+
+void EventLoop::Quit(int nExitCode)
+{
+	m_bQuit = true;
+	m_nExitCode = nExitCode;
+}
+
+void EventLoop::RunOnce(HNSTIME hnsMaxWait)
+{
+	bool bInput = false;
+	int nHandle = Wait(GetWaitTime(GetTime(), hnsMaxWait), &bInput);
+	m_stats.cWakeups++;
+
+	bool bPosted = DispatchEvents();
+	if (nHandle >= 0 && !m_bQuit) {
+		m_stats.cHandleWakeups++;
+		if (m_pHandler)
+			m_pHandler->OnHandle(m_handles[nHandle]);
+	}
+	bool bTimers = !m_bQuit && FireTimers();
+	if (bInput && !m_bQuit) {
+		m_stats.cInputWakeups++;
+		if (m_pHandler)
+			m_pHandler->OnInput();
+	}
+	if (bPosted)
+		m_stats.cPostWakeups++;
+	if (bTimers)
+		m_stats.cTimerWakeups++;
+	if (!bPosted && !bTimers && nHandle < 0 && !bInput)
+		m_stats.cIdleWakeups++;
+}
+
+HNSTIME EventLoop::GetTime() const
+{
+	return std::chrono::duration_cast<std::chrono::duration<HNSTIME, std::ratio<1, HNS_PER_SECOND>>>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void EventLoop::GetStats(EventLoopStats* pStats) const
+{
+	*pStats = m_stats;
+	pStats->hnsElapsed = GetTime() - m_hnsStatsStart;
+	pStats->cPosts = m_cPosts.load(std::memory_order_relaxed);
+}
+
+void EventLoop::ResetStats()
+{
+	m_stats = EventLoopStats();
+	m_cPosts.store(0, std::memory_order_relaxed);
+	m_hnsStatsStart = GetTime();
+}
+
+//-----------------------------------------------------------------------------
+// GetWaitTime
+//
+// Waits until the earliest time a timer must fire, its due time plus its
+// tolerance, so timers that are due by then fire together. Pending posts
+// of before Initialize did not wake anything, so they do not wait.
+//-----------------------------------------------------------------------------
+
+HNSTIME EventLoop::GetWaitTime(HNSTIME hnsNow, HNSTIME hnsMaxWait) const
+{
+	if (m_fPending.load(std::memory_order_relaxed))
+		return 0;
+	HNSTIME hnsWait = hnsMaxWait;
+	for (uint32_t i = 0; i < EVENT_LOOP_MAX_TIMERS; i++) {
+		const Timer& timer = m_timers[i];
+		if (timer.hnsDue < 0)
+			continue;
+		HNSTIME hnsLatest = timer.hnsDue + timer.hnsTolerance - hnsNow;
+		if (hnsLatest < 0)
+			hnsLatest = 0;
+		if (hnsWait < 0 || hnsLatest < hnsWait)
+			hnsWait = hnsLatest;
+	}
+	return hnsWait;
+}
+
+//-----------------------------------------------------------------------------
+// DispatchEvents
+//
+// Hands over every pending event in id order. A post that lands between
+// taking the pending bits and reading its slot sets its bit again, so
+// the event may come once more with the same value; a repeat whose seen
+// bits were already taken is dropped.
+//-----------------------------------------------------------------------------
+
+bool EventLoop::DispatchEvents()
+{
+	uint32_t fPending = m_fPending.exchange(0, std::memory_order_acquire);
+	if (!fPending)
+		return false;
+	for (uint32_t nEvent = 0; fPending && !m_bQuit; nEvent++, fPending >>= 1) {
+		if (!(fPending & 1))
+			continue;
+		Slot& slot = m_slots[nEvent];
+		uint64_t fSeen = slot.fSeen.exchange(0, std::memory_order_acquire);
+		uint64_t nValue = slot.nValue.load(std::memory_order_relaxed);
+		if (!fSeen)
+			continue;
+		m_stats.cEvents++;
+		if (m_pHandler)
+			m_pHandler->OnEvent(nEvent, nValue, fSeen | 1ull << (nValue & 63));
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// FireTimers
+//
+// Fires every timer that is due, earliest first, so a handler that sets
+// another timer sees the order it would have without the tolerance.
+//-----------------------------------------------------------------------------
+
+bool EventLoop::FireTimers()
+{
+	bool bFired = false;
+	HNSTIME hnsNow = GetTime();
+	while (!m_bQuit) {
+		uint32_t nTimer = EVENT_LOOP_MAX_TIMERS;
+		for (uint32_t i = 0; i < EVENT_LOOP_MAX_TIMERS; i++) {
+			const Timer& timer = m_timers[i];
+			if (timer.hnsDue >= 0 && timer.hnsDue <= hnsNow &&
+				(nTimer == EVENT_LOOP_MAX_TIMERS || timer.hnsDue < m_timers[nTimer].hnsDue))
+				nTimer = i;
+		}
+		if (nTimer == EVENT_LOOP_MAX_TIMERS)
+			break;
+
+		Timer& timer = m_timers[nTimer];
+		if (timer.hnsPeriod) {
+			timer.hnsDue += timer.hnsPeriod;
+			if (timer.hnsDue <= hnsNow)
+				timer.hnsDue += (hnsNow - timer.hnsDue) / timer.hnsPeriod * timer.hnsPeriod + timer.hnsPeriod;
+		}
+		else {
+			timer.hnsDue = -1;
+		}
+		bFired = true;
+		m_stats.cTimers++;
+		if (m_pHandler)
+			m_pHandler->OnTimer(nTimer);
+	}
+	return bFired;
+}
+
+//-----------------------------------------------------------------------------
+// Wait
+//
+// Blocks until a post, a waitable object, window messages or the timeout.
+// Returns the index of a signaled object, or -1. Timeouts round up to
+// the next millisecond, so a timer is never found not yet due after it.
+//-----------------------------------------------------------------------------
+
+int EventLoop::Wait(HNSTIME hnsTimeout, bool* pbInput)
+{
+	*pbInput = false;
+#ifdef _WIN32
+	DWORD dwTimeout = hnsTimeout < 0 ? INFINITE : (DWORD)((hnsTimeout + HNS_PER_MSEC - 1) / HNS_PER_MSEC);
+	HANDLE handles[EVENT_LOOP_MAX_HANDLES + 1];
+	DWORD cHandles = 0;
+	if (m_hWake)
+		handles[cHandles++] = m_hWake;
+	DWORD nFirst = cHandles;
+	for (size_t i = 0; i < m_cHandles; i++)
+		handles[cHandles++] = (HANDLE)m_handles[i];
+
+	// Messages that arrived before the wait but were not read yet count as
+	// input too; the handler reads them all.
+	DWORD dwResult = MsgWaitForMultipleObjectsEx(cHandles, handles, dwTimeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+	if (dwResult == WAIT_OBJECT_0 + cHandles) {
+		*pbInput = true;
+		return -1;
+	}
+	// The wait reports the first object only; pump messages waiting
+	// behind it too, so a busy object cannot starve the window.
+	*pbInput = HIWORD(GetQueueStatus(QS_ALLINPUT)) != 0;
+	if (dwResult >= WAIT_OBJECT_0 + nFirst && dwResult < WAIT_OBJECT_0 + cHandles)
+		return (int)(dwResult - WAIT_OBJECT_0 - nFirst);
+	return -1;
+#else
+	if (m_nEpoll < 0)
+		return -1;
+	int nTimeout = hnsTimeout < 0 ? -1 : (int)((hnsTimeout + HNS_PER_MSEC - 1) / HNS_PER_MSEC);
+	epoll_event events[EVENT_LOOP_MAX_HANDLES + 1];
+	int cEvents = epoll_wait(m_nEpoll, events, (int)(EVENT_LOOP_MAX_HANDLES + 1), nTimeout);
+	int nHandle = -1;
+	for (int i = 0; i < cEvents; i++) {
+		if (events[i].data.fd == m_nWake) {
+			uint64_t nCount;
+			while (read(m_nWake, &nCount, sizeof(nCount)) == sizeof(nCount))
+				;
+			continue;
+		}
+		// One object per wakeup; the others are still ready on the next.
+		for (size_t n = 0; nHandle < 0 && n < m_cHandles; n++) {
+			if (m_handles[n] == (EVENT_HANDLE)events[i].data.fd)
+				nHandle = (int)n;
+		}
+	}
+	return nHandle;
+#endif
+}
+
+void EventLoop::Wake()
+{
+#ifdef _WIN32
+	if (m_hWake)
+		SetEvent(m_hWake);
+#else
+	// Fails only when the counter is full, and then it is set anyway.
+	uint64_t nCount = 1;
+	if (m_nWake >= 0 && write(m_nWake, &nCount, sizeof(nCount)) < 0)
+		return;
+#endif
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include "PlaybackClock.h"
+#include <stddef.h>
+#include <atomic>
+
+
+// Waitable object: a HANDLE on Windows, a file descriptor elsewhere.
+typedef intptr_t EVENT_HANDLE;
+
+const size_t	EVENT_LOOP_MAX_HANDLES = 16;	// Waitable objects added with AddHandle
+const uint32_t	EVENT_LOOP_MAX_EVENTS = 32;		// Event ids of Post
+const uint32_t	EVENT_LOOP_MAX_TIMERS = 16;		// Timer ids of SetTimer
+
+// Counters of an event loop since it was created or last reset. One
+// wakeup may count under several causes.
+struct EventLoopStats
+{
+	HNSTIME		hnsElapsed;			// Time covered
+	uint64_t	cWakeups;			// Returns from the wait
+	uint64_t	cTimerWakeups;		// Wakeups that fired a timer
+	uint64_t	cPostWakeups;		// Wakeups that handled posted events
+	uint64_t	cHandleWakeups;		// Wakeups for a signaled waitable object
+	uint64_t	cInputWakeups;		// Wakeups for window messages
+	uint64_t	cIdleWakeups;		// Wakeups that found nothing to do
+	uint64_t	cPosts;				// Post calls
+	uint64_t	cEvents;			// Events handled, after coalescing
+	uint64_t	cTimers;			// Timers fired
+};
+
+
+//-------------------------------------------------------------------
+//
+// IEventHandler interface
+//
+// Receives what an event loop waited for, on the loop's thread. Each
+// wakeup hands over posted events first, then the signaled object, then
+// the timers that are due, then window messages.
+//
+//-------------------------------------------------------------------
+
+class IEventHandler
+{
+public:
+	virtual ~IEventHandler() {}
+
+	// Posts of nEvent since the last call. nValue is the latest value;
+	// fSeen has bit (value % 64) set for every value posted, so a handler
+	// of a small enumeration knows which values were passed over.
+	virtual void OnEvent(uint32_t nEvent, uint64_t nValue, uint64_t fSeen) = 0;
+
+	virtual void OnHandle(EVENT_HANDLE hObject) = 0;
+	virtual void OnTimer(uint32_t nTimer) = 0;
+
+	// Window messages are waiting; only called on Windows. The handler
+	// pumps them, and calls Quit on WM_QUIT.
+	virtual void OnInput() = 0;
+};
+
+
+//-------------------------------------------------------------------
+//
+// EventLoop class
+//
+// Waits for posted events, waitable objects, timers and, on Windows,
+// window messages in a single wait, MsgWaitForMultipleObjectsEx there
+// and epoll with an eventfd on Linux, and hands them to its handler.
+//
+// Posts are coalesced: an event posted again before it is handled is
+// handled once, with its latest value, and only the first post of a
+// batch wakes the loop. Timers carry a tolerance, so timers due close
+// together fire on the same wakeup instead of one each.
+//
+// Post is thread-safe; everything else is called on the loop's thread.
+//
+//-------------------------------------------------------------------
+
+class EventLoop
+{
+public:
+	EventLoop();
+	~EventLoop();
+
+	// Creates the wait objects. Posts made before succeed, and are
+	// handled once the loop runs.
+	bool Initialize();
+
+	void SetHandler(IEventHandler* pHandler) { m_pHandler = pHandler; }
+
+	// Waitable objects are watched while added. The loop does not reset
+	// them: a handler that does not leaves the loop spinning.
+	bool AddHandle(EVENT_HANDLE hObject);
+	void RemoveHandle(EVENT_HANDLE hObject);
+
+	// One-shot timer nTimer, due hnsDelay from now, replacing the timer if
+	// it is set. It may fire up to hnsTolerance late, to share a wakeup.
+	void SetTimer(uint32_t nTimer, HNSTIME hnsDelay, HNSTIME hnsTolerance = 0);
+
+	// Timer due every hnsPeriod; a period that was missed entirely is
+	// skipped rather than fired late.
+	void SetPeriodicTimer(uint32_t nTimer, HNSTIME hnsPeriod, HNSTIME hnsTolerance = 0);
+	void KillTimer(uint32_t nTimer);
+	bool IsTimerSet(uint32_t nTimer) const;
+
+	// Thread-safe. Hands nEvent, below EVENT_LOOP_MAX_EVENTS, to the
+	// handler on the loop's thread.
+	void Post(uint32_t nEvent, uint64_t nValue = 0);
+
+	// Runs until Quit is called, and returns its code.
+	int Run();
+	void Quit(int nExitCode);
+	bool IsQuitting() const { return m_bQuit; }
+
+	// Waits once, at most hnsMaxWait (-1 = until something happens), and
+	// hands over what it waited for.
+	void RunOnce(HNSTIME hnsMaxWait);
+
+	// Monotonic time timers are due against.
+	HNSTIME GetTime() const;
+
+	void GetStats(EventLoopStats* pStats) const;
+	void ResetStats();
+
+private:
+	EventLoop(const EventLoop&);
+	EventLoop& operator=(const EventLoop&);
+
+	struct Timer
+	{
+		HNSTIME		hnsDue;			// -1 = not set
+		HNSTIME		hnsTolerance;
+		HNSTIME		hnsPeriod;		// 0 = one-shot
+	};
+
+	struct Slot
+	{
+		std::atomic<uint64_t>	nValue;
+		std::atomic<uint64_t>	fSeen;
+	};
+
+	HNSTIME GetWaitTime(HNSTIME hnsNow, HNSTIME hnsMaxWait) const;
+	bool DispatchEvents();
+	bool FireTimers();
+	int Wait(HNSTIME hnsTimeout, bool* pbInput);
+	void Wake();
+
+	IEventHandler*		m_pHandler;
+	bool				m_bQuit;
+	int					m_nExitCode;
+	Timer				m_timers[EVENT_LOOP_MAX_TIMERS];
+	EVENT_HANDLE		m_handles[EVENT_LOOP_MAX_HANDLES];
+	size_t				m_cHandles;
+	Slot				m_slots[EVENT_LOOP_MAX_EVENTS];
+	std::atomic<uint32_t>	m_fPending;		// Bit per event id with posts not handled yet
+	std::atomic<uint64_t>	m_cPosts;
+	EventLoopStats		m_stats;
+	HNSTIME				m_hnsStatsStart;
+#ifdef _WIN32
+	void*				m_hWake;		// Auto-reset event set by the first post of a batch
+#else
+	int					m_nEpoll;
+	int					m_nWake;		// eventfd written by the first post of a batch
+#endif
+};
@@ -0,0 +1,145 @@
+#include "EventQueue.h"
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const size_t BENCH_CAPACITY = 1024;
+static const size_t BENCH_BATCH = 64;		// Records the consumer takes per drain
+
+// Record of the size the players post: producer and sequence number,
+// so the consumer sees records that are lost or out of order.
+struct BenchEvent
+{
+	uint32_t	nProducer;
+	uint32_t	nType;
+	uint64_t	nSeq;
+	HNSTIME		hnsTime;
+	uint64_t	nValue;
+};
+
+// Baseline: a deque behind a mutex, bounded like EventQueue.
+class MutexQueue
+{
+public:
+	bool Push(const BenchEvent& item)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_items.size() >= BENCH_CAPACITY)
+			return false;
+		m_items.push_back(item);
+		return true;
+	}
+
+	size_t Drain(BenchEvent* pItems, size_t cMax)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		size_t cItems = 0;
+		for (; cItems < cMax && !m_items.empty(); cItems++) {
+			pItems[cItems] = m_items.front();
+			m_items.pop_front();
+		}
+		return cItems;
+	}
+
+private:
+	std::mutex				m_mutex;
+	std::deque<BenchEvent>	m_items;
+};
+
+//-----------------------------------------------------------------------------
+// RunQueue
+//
+// Events the consumer took in hnsDuration. Producers stop when it is
+// over; the consumer then takes what is left, so the sequence check
+// covers every record pushed.
+//-----------------------------------------------------------------------------
+
+template <typename Q>
+static double RunQueue(Q* pQueue, uint32_t cProducers, HNSTIME hnsDuration, uint64_t* pcFull, uint64_t* pcLost)
+{
+	std::atomic<bool> bStop(false);
+	std::atomic<uint32_t> cRunning(cProducers);
+	std::vector<uint64_t> cPushed(cProducers, 0), cFull(cProducers, 0);
+	std::vector<std::thread> producers;
+	for (uint32_t i = 0; i < cProducers; i++) {
+		producers.push_back(std::thread([pQueue, &bStop, &cRunning, &cPushed, &cFull, i]() {
+			BenchEvent event = {};
+			event.nProducer = i;
+			uint64_t cThreadFull = 0;
+			while (!bStop.load(std::memory_order_relaxed)) {
+				event.nSeq++;
+				event.hnsTime = (HNSTIME)event.nSeq;
+				while (!pQueue->Push(event)) {
+					cThreadFull++;
+					std::this_thread::yield();
+				}
+			}
+			cPushed[i] = event.nSeq;
+			cFull[i] = cThreadFull;
+			cRunning.fetch_sub(1, std::memory_order_release);
+		}));
+	}
+
+	std::vector<uint64_t> nLast(cProducers, 0);
+	uint64_t cLost = 0, cTaken = 0, cInWindow = 0, cDrains = 0;
+	BenchEvent batch[BENCH_BATCH];
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point end = start + std::chrono::microseconds(hnsDuration / 10);
+	std::chrono::duration<double> elapsed(0.0);
+	for (;;) {
+		bool bDone = cRunning.load(std::memory_order_acquire) == 0;
+		size_t cItems = pQueue->Drain(batch, BENCH_BATCH);
+		for (size_t n = 0; n < cItems; n++) {
+			const BenchEvent& event = batch[n];
+			if (event.nProducer >= cProducers || event.nSeq != nLast[event.nProducer] + 1)
+				cLost++;
+			else
+				nLast[event.nProducer] = event.nSeq;
+		}
+		cTaken += cItems;
+		if (!bStop.load(std::memory_order_relaxed) && (++cDrains & 15) == 0 &&
+			std::chrono::steady_clock::now() >= end) {
+			elapsed = std::chrono::steady_clock::now() - start;
+			cInWindow = cTaken;
+			bStop.store(true, std::memory_order_relaxed);
+		}
+		if (!cItems) {
+			if (bDone)
+				break;
+			std::this_thread::yield();
+		}
+	}
+	for (size_t i = 0; i < producers.size(); i++)
+		producers[i].join();
+
+	for (uint32_t i = 0; i < cProducers; i++) {
+		if (nLast[i] != cPushed[i])
+			cLost++;
+		*pcFull += cFull[i];
+	}
+	*pcLost += cLost;
+	return elapsed.count() > 0.0 ? cInWindow / elapsed.count() : 0.0;
+}
+
+
+bool RunEventQueueBench(uint32_t cProducers, HNSTIME hnsDuration, EventQueueBenchResult* pResult)
+{
+	if (hnsDuration <= 0 || cProducers == 0)
+		return false;
+
+	pResult->cProducers = cProducers;
+	pResult->cQueueFull = 0;
+	pResult->cLost = 0;
+
+	EventQueue<BenchEvent, BENCH_CAPACITY>* pQueue = new EventQueue<BenchEvent, BENCH_CAPACITY>();
+	pResult->fQueueEventsPerSecond = RunQueue(pQueue, cProducers, hnsDuration, &pResult->cQueueFull, &pResult->cLost);
+	delete pQueue;
+
+	uint64_t cMutexFull = 0;
+	MutexQueue* pMutexQueue = new MutexQueue();
+	pResult->fMutexEventsPerSecond = RunQueue(pMutexQueue, cProducers, hnsDuration, &cMutexFull, &pResult->cLost);
+	delete pMutexQueue;
+	return true;
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include "PlaybackClock.h"
+#include <stddef.h>
+#include <atomic>
+#include <type_traits>
+
+
+//-------------------------------------------------------------------
+//
+// EventQueue class
+//
+// Fixed-capacity queue of small trivially copyable records, pushed by
+// any number of threads and popped by one, without a lock or a heap
+// allocation after construction.
+//
+// Each cell carries a sequence number that says whose turn it is. A
+// producer claims the next cell by advancing the tail with a compare-
+// exchange once the cell's sequence shows the consumer freed it, fills
+// it and releases the sequence; the consumer takes cells in order while
+// their sequence shows them filled and hands them back a lap ahead. A
+// full queue fails the push instead of waiting.
+//
+// A producer stopped between claiming a cell and filling it holds back
+// the records behind it; Pop then reports the queue empty rather than
+// waiting, and the records come out once that producer finishes.
+//
+//-------------------------------------------------------------------
+
+template <typename T, size_t CAPACITY>
+class EventQueue
+{
+	static_assert(std::is_trivially_copyable<T>::value, "EventQueue needs a trivially copyable type");
+	static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "EventQueue capacity must be a power of 2");
+
+public:
+	EventQueue() : m_nTail(0), m_nHead(0)
+	{
+		for (size_t i = 0; i < CAPACITY; i++)
+			m_cells[i].nSeq.store(i, std::memory_order_relaxed);
+	}
+
+	// Thread-safe. False if the queue is full.
+	bool Push(const T& item)
+	{
+		size_t nPos = m_nTail.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell& cell = m_cells[nPos & (CAPACITY - 1)];
+			size_t nSeq = cell.nSeq.load(std::memory_order_acquire);
+			intptr_t nDiff = (intptr_t)nSeq - (intptr_t)nPos;
+			if (nDiff == 0) {
+				if (m_nTail.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (nDiff < 0) {
+				return false;
+			}
+			else {
+				nPos = m_nTail.load(std::memory_order_relaxed);
+			}
+		}
+		Cell& cell = m_cells[nPos & (CAPACITY - 1)];
+		cell.item = item;
+		cell.nSeq.store(nPos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer thread only. False if no record is ready.
+	bool Pop(T* pItem)
+	{
+		Cell& cell = m_cells[m_nHead & (CAPACITY - 1)];
+		if (cell.nSeq.load(std::memory_order_acquire) != m_nHead + 1)
+			return false;
+		*pItem = cell.item;
+		cell.nSeq.store(m_nHead + CAPACITY, std::memory_order_release);
+		m_nHead++;
+		return true;
+	}
+
+	// Consumer thread only. Pops up to cMax records into pItems and
+	// returns how many.
+	size_t Drain(T* pItems, size_t cMax)
+	{
+		size_t cItems = 0;
+		while (cItems < cMax && Pop(&pItems[cItems]))
+			cItems++;
+		return cItems;
+	}
+
+	static size_t GetCapacity() { return CAPACITY; }
+
+private:
+	EventQueue(const EventQueue&);
+	EventQueue& operator=(const EventQueue&);
+
+	struct Cell
+	{
+		std::atomic<size_t>	nSeq;		// Position it is free for; position + 1 once filled
+		T					item;
+	};
+
+	// Producers and the consumer keep to their own 64 byte lines.
+	std::atomic<size_t>	m_nTail;		// Next position to claim
+	char				m_padTail[64 - sizeof(std::atomic<size_t>)];
+	size_t				m_nHead;		// Next position to pop
+	char				m_padHead[64 - sizeof(size_t)];
+	Cell				m_cells[CAPACITY];
+};
+
+
+struct EventQueueBenchResult
+{
+	uint32_t	cProducers;
+	double		fQueueEventsPerSecond;		// EventQueue, all producers together
+	double		fMutexEventsPerSecond;		// std::deque behind a std::mutex
+	uint64_t	cQueueFull;					// Pushes retried because the queue was full
+	uint64_t	cLost;						// Records missing or out of order; must be 0
+};
+
+//-------------------------------------------------------------------
+// RunEventQueueBench
+//
+// cProducers threads push player-sized event records as fast as they
+// can to one consumer that drains them in batches, for hnsDuration of
+// wall-clock time each, through an EventQueue and through a deque
+// behind a mutex, and checks that every record arrived in order.
+//-------------------------------------------------------------------
+
+bool RunEventQueueBench(uint32_t cProducers, HNSTIME hnsDuration, EventQueueBenchResult* pResult);
@@ -0,0 +1,372 @@
+#include "FileUtil.h"
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <wctype.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <sddl.h>
+#pragma comment(lib, "advapi32.lib")
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+FILE* FileOpen(const std::wstring& path, const char* pszMode)
+{
+#ifdef _WIN32
+	std::wstring mode;
+	for (const char* p = pszMode; *p; p++)
+		mode.push_back((wchar_t)*p);
+	FILE* fp = NULL;
+	return _wfopen_s(&fp, path.c_str(), mode.c_str()) == 0 ? fp : NULL;
+#else
+	return fopen(ToUtf8(path).c_str(), pszMode);
+#endif
+}
+
+bool FileSeek(FILE* fp, uint64_t nOffset)
+{
+#ifdef _WIN32
+	return _fseeki64(fp, (__int64)nOffset, SEEK_SET) == 0;
+#else
+	return fseeko(fp, (off_t)nOffset, SEEK_SET) == 0;
+#endif
+}
+
+bool GetFileInfo(const std::wstring& path, FileInfo* pInfo)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_wstat64(path.c_str(), &st) != 0 || !(st.st_mode & _S_IFREG))
+		return false;
+#else
+	struct stat st;
+	if (stat(ToUtf8(path).c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+		return false;
+#endif
+	pInfo->cbSize = (uint64_t)st.st_size;
+	pInfo->nModified = (int64_t)st.st_mtime;
+	return true;
+}
+
+bool MoveFileReplace(const std::wstring& from, const std::wstring& to)
+{
+#ifdef _WIN32
+	return MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+	return rename(ToUtf8(from).c_str(), ToUtf8(to).c_str()) == 0;
+#endif
+}
+
+bool RemoveFile(const std::wstring& path)
+{
+#ifdef _WIN32
+	return _wremove(path.c_str()) == 0;
+#else
+	return remove(ToUtf8(path).c_str()) == 0;
+#endif
+}
+
+// Parents that cannot be created, like a drive or share root, are
+// skipped; only the last directory has to exist in the end.
+bool CreateDirectories(const std::wstring& path)
+{
+	bool bExists = false;
+	for (size_t nPos = 0; nPos != std::wstring::npos; ) {
+		nPos = path.find_first_of(L"\\/", nPos + 1);
+		std::wstring dir = path.substr(0, nPos);
+		if (dir.empty() || dir[dir.size() - 1] == L'\\' || dir[dir.size() - 1] == L'/')
+			continue;
+#ifdef _WIN32
+		bExists = CreateDirectoryW(dir.c_str(), NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+		bExists = mkdir(ToUtf8(dir).c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+	}
+	return bExists;
+}
+
+std::string ToUtf8(const std::wstring& text)
+{
+	std::string utf8;
+	for (size_t i = 0; i < text.size(); i++) {
+		uint32_t c = (uint32_t)text[i];
+		if (c >= 0xD800 && c < 0xDC00 && i + 1 < text.size()) {
+			uint32_t nLow = (uint32_t)text[i + 1];
+			if (nLow >= 0xDC00 && nLow < 0xE000) {
+				c = 0x10000 + ((c - 0xD800) << 10) + (nLow - 0xDC00);
+				i++;
+			}
+		}
+		if (c < 0x80) {
+			utf8.push_back((char)c);
+		}
+		else if (c < 0x800) {
+			utf8.push_back((char)(0xC0 | c >> 6));
+			utf8.push_back((char)(0x80 | (c & 0x3F)));
+		}
+		else if (c < 0x10000) {
+			utf8.push_back((char)(0xE0 | c >> 12));
+			utf8.push_back((char)(0x80 | (c >> 6 & 0x3F)));
+			utf8.push_back((char)(0x80 | (c & 0x3F)));
+		}
+		else {
+			utf8.push_back((char)(0xF0 | c >> 18));
+			utf8.push_back((char)(0x80 | (c >> 12 & 0x3F)));
+			utf8.push_back((char)(0x80 | (c >> 6 & 0x3F)));
+			utf8.push_back((char)(0x80 | (c & 0x3F)));
+		}
+	}
+	return utf8;
+}
+
+std::wstring FromUtf8(const char* pText, size_t cchText)
+{
+	std::wstring text;
+	const unsigned char* p = (const unsigned char*)pText;
+	const unsigned char* pEnd = p + cchText;
+	while (p < pEnd) {
+		uint32_t c = *p++;
+		size_t cTrail = c >= 0xF0 && c < 0xF5 ? 3 : c >= 0xE0 && c < 0xF0 ? 2 : c >= 0xC2 && c < 0xE0 ? 1 : 0;
+		if (c >= 0x80 && !cTrail) {
+			c = 0xFFFD;
+		}
+		else if (cTrail) {
+			c &= 0x3F >> cTrail;
+			size_t i = 0;
+			for (; i < cTrail && p < pEnd && (*p & 0xC0) == 0x80; i++)
+				c = c << 6 | (*p++ & 0x3F);
+			// Truncated, overlong, surrogate or past U+10FFFF.
+			static const uint32_t s_nMin[] = { 0, 0x80, 0x800, 0x10000 };
+			if (i < cTrail || c < s_nMin[cTrail] || (c >= 0xD800 && c < 0xE000) || c > 0x10FFFF)
+				c = 0xFFFD;
+		}
+		if (c >= 0x10000 && sizeof(wchar_t) == 2) {
+			text.push_back((wchar_t)(0xD800 + ((c - 0x10000) >> 10)));
+			text.push_back((wchar_t)(0xDC00 + ((c - 0x10000) & 0x3FF)));
+		}
+		else {
+			text.push_back((wchar_t)c);
+		}
+	}
+	return text;
+}
+
+std::wstring NormalizePath(const std::wstring& path)
+{
+	std::wstring normal(path);
+#ifdef _WIN32
+	for (size_t i = 0; i < normal.size(); i++) {
+		normal[i] = (wchar_t)towlower(normal[i]);
+		if (normal[i] == L'/')
+			normal[i] = L'\\';
+	}
+#endif
+	return normal;
+}
+
+
+//********************* MappedFile **********************//
+
+MappedFile::MappedFile() :
+	m_pData(NULL),
+	m_cbData(0)
+#ifdef _WIN32
+	, m_hMapping(NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+//-----------------------------------------------------------------------------
+// Open
+//
+// Empty files cannot be mapped and fail like missing ones. The file
+// handle is closed at once; the mapping keeps the file open.
+//-----------------------------------------------------------------------------
+
+bool MappedFile::Open(const std::wstring& path)
+{
+	Close();
+#ifdef _WIN32
+	HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(hFile, &size) && size.QuadPart > 0 && (uint64_t)size.QuadPart <= SIZE_MAX) {
+		m_hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_hMapping) {
+			m_pData = (const uint8_t*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+			m_cbData = (size_t)size.QuadPart;
+		}
+	}
+	CloseHandle(hFile);
+#else
+	int fd = open(ToUtf8(path).c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED) {
+			m_pData = (const uint8_t*)p;
+			m_cbData = (size_t)st.st_size;
+		}
+	}
+	close(fd);
+#endif
+	if (!m_pData)
+		Close();
+	return m_pData != NULL;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (m_pData)
+		UnmapViewOfFile(m_pData);
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+	m_hMapping = NULL;
+#else
+	if (m_pData)
+		munmap((void*)m_pData, m_cbData);
+#endif
+	m_pData = NULL;
+	m_cbData = 0;
+}
+
+
+//********************* SharedMemory **********************//
+
+SharedMemory::SharedMemory() :
+	m_pData(NULL),
+	m_cbData(0),
+	m_bCreated(false)
+#ifdef _WIN32
+	, m_hMapping(NULL)
+#endif
+{
+}
+
+SharedMemory::~SharedMemory()
+{
+	Close();
+}
+
+//-----------------------------------------------------------------------------
+// Create
+//
+// A block that already exists keeps its contents and its size, which must
+// cover cb.
+//-----------------------------------------------------------------------------
+
+bool SharedMemory::Create(const std::wstring& name, size_t cb, bool bAllUsers)
+{
+	Close();
+	if (cb == 0)
+		return false;
+#ifdef _WIN32
+	// System and administrators full control, signed-in users read and write.
+	SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, FALSE };
+	if (bAllUsers && !ConvertStringSecurityDescriptorToSecurityDescriptorW(L"D:(A;;GA;;;SY)(A;;GA;;;BA)(A;;GRGW;;;AU)",
+		SDDL_REVISION_1, &sa.lpSecurityDescriptor, NULL))
+		return false;
+	m_hMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, bAllUsers ? &sa : NULL, PAGE_READWRITE,
+		(DWORD)((uint64_t)cb >> 32), (DWORD)cb, name.c_str());
+	LocalFree(sa.lpSecurityDescriptor);
+	if (!m_hMapping)
+		return false;
+	m_bCreated = GetLastError() != ERROR_ALREADY_EXISTS;
+	m_pData = (uint8_t*)MapViewOfFile(m_hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+	MEMORY_BASIC_INFORMATION info;
+	if (m_pData && VirtualQuery(m_pData, &info, sizeof(info)) == sizeof(info))
+		m_cbData = info.RegionSize;
+#else
+	m_name = "/" + ToUtf8(name);
+	int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	m_bCreated = fd >= 0;
+	if (m_bCreated && bAllUsers)
+		fchmod(fd, 0666);
+	if (fd < 0 && errno == EEXIST)
+		fd = shm_open(m_name.c_str(), O_RDWR, 0600);
+	if (fd < 0)
+		return false;
+	off_t cbFile = 0;
+	struct stat st;
+	if (m_bCreated)
+		cbFile = ftruncate(fd, (off_t)cb) == 0 ? (off_t)cb : 0;
+	else if (fstat(fd, &st) == 0)
+		cbFile = st.st_size;
+	if (cbFile > 0) {
+		void* p = mmap(NULL, (size_t)cbFile, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED) {
+			m_pData = (uint8_t*)p;
+			m_cbData = (size_t)cbFile;
+		}
+	}
+	close(fd);
+#endif
+	if (!m_pData || m_cbData < cb)
+		Close();
+	return m_pData != NULL;
+}
+
+bool SharedMemory::Open(const std::wstring& name)
+{
+	Close();
+#ifdef _WIN32
+	m_hMapping = OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, name.c_str());
+	if (!m_hMapping)
+		return false;
+	m_pData = (uint8_t*)MapViewOfFile(m_hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+	MEMORY_BASIC_INFORMATION info;
+	if (m_pData && VirtualQuery(m_pData, &info, sizeof(info)) == sizeof(info))
+		m_cbData = info.RegionSize;
+#else
+	int fd = shm_open(("/" + ToUtf8(name)).c_str(), O_RDWR, 0600);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void* p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED) {
+			m_pData = (uint8_t*)p;
+			m_cbData = (size_t)st.st_size;
+		}
+	}
+	close(fd);
+#endif
+	if (!m_pData)
+		Close();
+	return m_pData != NULL;
+}
+
+void SharedMemory::Close()
+{
+#ifdef _WIN32
+	if (m_pData)
+		UnmapViewOfFile(m_pData);
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+	m_hMapping = NULL;
+#else
+	if (m_pData)
+		munmap(m_pData, m_cbData);
+	if (m_bCreated)
+		shm_unlink(m_name.c_str());
+	m_name.clear();
+#endif
+	m_pData = NULL;
+	m_cbData = 0;
+	m_bCreated = false;
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+
+// Size and last write time of a file.
+struct FileInfo
+{
+	uint64_t	cbSize;
+	int64_t		nModified;	// Seconds since 1970
+};
+
+//-------------------------------------------------------------------
+// File helpers
+//
+// Paths are wide everywhere in the player; outside Windows they are
+// handed to the C library as UTF-8.
+//-------------------------------------------------------------------
+
+// Opens a file; pszMode as for fopen.
+FILE* FileOpen(const std::wstring& path, const char* pszMode);
+
+// Moves to a byte offset, also past 2 GB.
+bool FileSeek(FILE* fp, uint64_t nOffset);
+
+bool GetFileInfo(const std::wstring& path, FileInfo* pInfo);
+
+// Moves a file over another one, replacing it in one step.
+bool MoveFileReplace(const std::wstring& from, const std::wstring& to);
+
+bool RemoveFile(const std::wstring& path);
+
+// Creates a directory and any missing parents.
+bool CreateDirectories(const std::wstring& path);
+
+std::string ToUtf8(const std::wstring& text);
+
+// Invalid sequences become U+FFFD.
+std::wstring FromUtf8(const char* pText, size_t cchText);
+
+// Path in the form two paths to one file compare equal in: on Windows
+// lowercase with backslashes, elsewhere as is.
+std::wstring NormalizePath(const std::wstring& path);
+
+
+//-------------------------------------------------------------------
+//
+// MappedFile class
+//
+// Read-only view of a whole file. The pages are read in by the system
+// as they are touched, and stay shared with other opens of the file.
+//
+//-------------------------------------------------------------------
+
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const std::wstring& path);
+	void Close();
+
+	bool IsOpen() const { return m_pData != NULL; }
+	const uint8_t* GetData() const { return m_pData; }
+	size_t GetSize() const { return m_cbData; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const uint8_t*	m_pData;
+	size_t			m_cbData;
+#ifdef _WIN32
+	void*			m_hMapping;
+#endif
+};
+
+
+//-------------------------------------------------------------------
+//
+// SharedMemory class
+//
+// Named block of memory that other processes open by the same name.
+// On Windows the name may carry a Global\ or Local\ prefix; elsewhere it
+// is a POSIX shared memory name without the leading slash.
+//
+// The block is zero-filled when created and lives while any process has
+// it open; on POSIX systems the creator also removes the name on Close.
+//
+//-------------------------------------------------------------------
+
+class SharedMemory
+{
+public:
+	SharedMemory();
+	~SharedMemory();
+
+	// Creates the block, or opens it if it exists with at least cb bytes.
+	// bAllUsers opens a new block to every signed-in user, not only the
+	// creator's account.
+	bool Create(const std::wstring& name, size_t cb, bool bAllUsers = false);
+
+	// Opens an existing block at its full size.
+	bool Open(const std::wstring& name);
+	void Close();
+
+	bool IsOpen() const { return m_pData != NULL; }
+	bool IsCreated() const { return m_bCreated; }
+	uint8_t* GetData() const { return m_pData; }
+	size_t GetSize() const { return m_cbData; }
+
+private:
+	SharedMemory(const SharedMemory&);
+	SharedMemory& operator=(const SharedMemory&);
+
+	uint8_t*		m_pData;
+	size_t			m_cbData;
+	bool			m_bCreated;		// This process made the block
+#ifdef _WIN32
+	void*			m_hMapping;
+#else
+	std::string		m_name;
+#endif
+};
@@ -0,0 +1,357 @@
+#include "pch.h"
+#include "LiveWallpaper.h"
+#include "FrameBroker.h"
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mfreadwrite.h>
+#include <strsafe.h>
+#include <chrono>
+
+#pragma comment(lib, "mfplat.lib")
+#pragma comment(lib, "mfreadwrite.lib")
+#pragma comment(lib, "mfuuid.lib")
+
+// A broker this far behind the clock restarts its schedule instead of
+// publishing the missed frames in a burst.
+static const HNSTIME BROKER_MAX_LAG = HNS_PER_SECOND;
+static const HNSTIME BROKER_READER_SCAN = HNS_PER_SECOND;	// Refresh of the reader list for reports
+
+FrameBroker::FrameBroker() :
+	m_cx(0),
+	m_cy(0),
+	m_bStop(false),
+	m_bStopped(true),
+	m_cPublished(0),
+	m_cLoops(0),
+	m_cReported(0),
+	m_hnsReported(0)
+{
+}
+
+FrameBroker::~FrameBroker()
+{
+	Stop();
+}
+
+//-----------------------------------------------------------------------------
+// GetRingName
+//
+// Every session names the clip's ring the same way, whatever path form it
+// was given the clip in.
+//-----------------------------------------------------------------------------
+
+std::wstring FrameBroker::GetRingName(const std::wstring& clip, bool bGlobal)
+{
+	WCHAR szPath[MAX_PATH];
+	DWORD cch = GetFullPathNameW(clip.c_str(), ARRAYSIZE(szPath), szPath, NULL);
+	std::wstring path = cch > 0 && cch < ARRAYSIZE(szPath) ? std::wstring(szPath) : clip;
+	return (bGlobal ? L"Global\\" : L"Local\\") + GetFrameRingName(path);
+}
+
+//-----------------------------------------------------------------------------
+// Start
+//
+// The ring is sized for the decoded frames. Another broker that still
+// holds the ring's lease keeps it, and Start fails.
+//-----------------------------------------------------------------------------
+
+HRESULT FrameBroker::Start(const std::wstring& clip)
+{
+	Stop();
+
+	IMFSourceReader* pReader = NULL;
+	HRESULT hr = OpenReader(clip, &pReader, &m_cx, &m_cy);
+	if (FAILED(hr))
+		return hr;
+
+	FrameRingConfig config = { BROKER_RING_SLOTS, m_cx, m_cy };
+	size_t cbRing = GetFrameRingSize(config);
+	m_ringName = GetRingName(clip, true);
+	if (!m_memory.Create(m_ringName, cbRing, true)) {
+		m_ringName = GetRingName(clip, false);
+		if (!m_memory.Create(m_ringName, cbRing, true))
+			hr = HRESULT_FROM_WIN32(GetLastError() ? GetLastError() : ERROR_NOT_ENOUGH_MEMORY);
+	}
+	if (SUCCEEDED(hr) && !m_writer.Attach(m_memory.GetData(), m_memory.GetSize(), config, GetCurrentProcessId()))
+		hr = HRESULT_FROM_WIN32(ERROR_BUSY);
+	if (FAILED(hr)) {
+		m_memory.Close();
+		SafeRelease(&pReader);
+		return hr;
+	}
+
+	m_bStop = false;
+	m_bStopped = false;
+	m_cPublished = 0;
+	m_cLoops = 0;
+	m_cReported = 0;
+	m_hnsReported = GetRingTime();
+	m_thread = std::thread(&FrameBroker::PublishThread, this, pReader);
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Stop
+//
+// Gives up the ring's lease, so the readers see the broker gone at once
+// rather than after the lease runs out.
+//-----------------------------------------------------------------------------
+
+void FrameBroker::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStop = true;
+	}
+	m_cv.notify_all();
+	if (m_thread.joinable())
+		m_thread.join();
+	m_writer.Detach();
+	m_memory.Close();
+	m_bStopped = true;
+}
+
+std::string FrameBroker::GetReport()
+{
+	HNSTIME hnsNow = GetRingTime();
+	uint64_t cPublished = m_cPublished;
+	double fSeconds = (double)(hnsNow - m_hnsReported) / HNS_PER_SECOND;
+	double fFps = fSeconds > 0 ? (cPublished - m_cReported) / fSeconds : 0.0;
+	m_cReported = cPublished;
+	m_hnsReported = hnsNow;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	char line[256];
+	StringCbPrintfA(line, sizeof(line), "%ux%u at %.1f fps, %llu frames, %llu loops, %u readers\n", m_cx, m_cy, fFps,
+		(unsigned long long)cPublished, (unsigned long long)m_cLoops.load(), (unsigned)m_readers.size());
+	std::string report(line);
+	for (size_t i = 0; i < m_readers.size(); i++) {
+		const FrameRingReaderStats& stats = m_readers[i];
+		StringCbPrintfA(line, sizeof(line), "  process %u: %llu shown, %llu skipped, %llu torn\n", stats.nReaderId,
+			(unsigned long long)stats.cFrames, (unsigned long long)stats.cSkipped, (unsigned long long)stats.cTorn);
+		report += line;
+	}
+	return report;
+}
+
+//-----------------------------------------------------------------------------
+// OpenReader
+//
+// The source reader's video processor converts to RGB32, which is BGRA in
+// memory, and scales clips larger than BROKER_MAX_WIDTH x
+// BROKER_MAX_HEIGHT down to fit.
+//-----------------------------------------------------------------------------
+
+HRESULT FrameBroker::OpenReader(const std::wstring& clip, IMFSourceReader** ppReader, UINT32* pcx, UINT32* pcy)
+{
+	const DWORD dwVideo = (DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM;
+
+	IMFAttributes* pAttributes = NULL;
+	IMFSourceReader* pReader = NULL;
+	IMFMediaType* pNativeType = NULL;
+	IMFMediaType* pType = NULL;
+	UINT32 cx = 0, cy = 0;
+
+	HRESULT hr = MFCreateAttributes(&pAttributes, 1);
+	if (SUCCEEDED(hr))
+		hr = pAttributes->SetUINT32(MF_SOURCE_READER_ENABLE_ADVANCED_VIDEO_PROCESSING, TRUE);
+	if (SUCCEEDED(hr))
+		hr = MFCreateSourceReaderFromURL(clip.c_str(), pAttributes, &pReader);
+	if (SUCCEEDED(hr))
+		hr = pReader->SetStreamSelection((DWORD)MF_SOURCE_READER_ALL_STREAMS, FALSE);
+	if (SUCCEEDED(hr))
+		hr = pReader->SetStreamSelection(dwVideo, TRUE);
+	if (SUCCEEDED(hr))
+		hr = pReader->GetNativeMediaType(dwVideo, 0, &pNativeType);
+	if (SUCCEEDED(hr))
+		hr = MFGetAttributeSize(pNativeType, MF_MT_FRAME_SIZE, &cx, &cy);
+	if (SUCCEEDED(hr) && (cx == 0 || cy == 0))
+		hr = MF_E_INVALIDMEDIATYPE;
+
+	if (SUCCEEDED(hr) && (cx > BROKER_MAX_WIDTH || cy > BROKER_MAX_HEIGHT)) {
+		if ((uint64_t)cx * BROKER_MAX_HEIGHT >= (uint64_t)cy * BROKER_MAX_WIDTH) {
+			cy = (UINT32)((uint64_t)cy * BROKER_MAX_WIDTH / cx);
+			cx = BROKER_MAX_WIDTH;
+		}
+		else {
+			cx = (UINT32)((uint64_t)cx * BROKER_MAX_HEIGHT / cy);
+			cy = BROKER_MAX_HEIGHT;
+		}
+		cx = cx > 2 ? cx & ~1u : 2;
+		cy = cy > 2 ? cy & ~1u : 2;
+	}
+
+	if (SUCCEEDED(hr))
+		hr = MFCreateMediaType(&pType);
+	if (SUCCEEDED(hr))
+		hr = pType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+	if (SUCCEEDED(hr))
+		hr = pType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_RGB32);
+	if (SUCCEEDED(hr))
+		hr = pType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+	if (SUCCEEDED(hr))
+		hr = MFSetAttributeSize(pType, MF_MT_FRAME_SIZE, cx, cy);
+	if (SUCCEEDED(hr))
+		hr = MFSetAttributeRatio(pType, MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+	if (SUCCEEDED(hr))
+		hr = pReader->SetCurrentMediaType(dwVideo, NULL, pType);
+
+	if (SUCCEEDED(hr)) {
+		*ppReader = pReader;
+		pReader = NULL;
+		*pcx = cx;
+		*pcy = cy;
+	}
+	SafeRelease(&pType);
+	SafeRelease(&pNativeType);
+	SafeRelease(&pReader);
+	SafeRelease(&pAttributes);
+	return hr;
+}
+
+// Sleeps until hnsDue, renewing the ring's lease on the way. False once
+// Stop is called or the lease is lost.
+bool FrameBroker::WaitUntil(HNSTIME hnsDue)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		if (m_bStop)
+			return false;
+		HNSTIME hnsNow = GetRingTime();
+		if (hnsNow >= hnsDue)
+			return true;
+		HNSTIME hnsWait = hnsDue - hnsNow < RING_WRITER_TIMEOUT / 4 ? hnsDue - hnsNow : RING_WRITER_TIMEOUT / 4;
+		m_cv.wait_for(lock, std::chrono::microseconds(hnsWait / 10));
+		if (GetRingTime() < hnsDue && !m_writer.Heartbeat())
+			return false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// PublishThread
+//
+// Publishes each frame when it is due on the system clock and starts the
+// clip over at the end. Runs until Stop, a read error, or another broker
+// taking the ring over.
+//-----------------------------------------------------------------------------
+
+void FrameBroker::PublishThread(IMFSourceReader* pReader)
+{
+	const DWORD dwVideo = (DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM;
+	HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	HNSTIME hnsPassStart = GetRingTime();	// System time of clip time 0 in this pass
+	HNSTIME hnsPassEnd = 0;					// Clip time the last frame of this pass ends at
+	HNSTIME hnsScanned = 0;
+	bool bPassHasFrames = false;
+	HRESULT hr = S_OK;
+
+	for (;;) {
+		DWORD dwFlags = 0;
+		LONGLONG hnsTime = 0;
+		IMFSample* pSample = NULL;
+		hr = pReader->ReadSample(dwVideo, 0, NULL, &dwFlags, &hnsTime, &pSample);
+		if (FAILED(hr))
+			break;
+
+		if (dwFlags & MF_SOURCE_READERF_ENDOFSTREAM) {
+			SafeRelease(&pSample);
+			if (!bPassHasFrames)
+				break;
+			PROPVARIANT var;
+			PropVariantInit(&var);
+			var.vt = VT_I8;
+			var.hVal.QuadPart = 0;
+			hr = pReader->SetCurrentPosition(GUID_NULL, var);
+			if (FAILED(hr))
+				break;
+			hnsPassStart += hnsPassEnd;
+			hnsPassEnd = 0;
+			bPassHasFrames = false;
+			m_cLoops++;
+			continue;
+		}
+		if (pSample == NULL)
+			continue;
+
+		LONGLONG hnsDuration = 0;
+		if (FAILED(pSample->GetSampleDuration(&hnsDuration)) || hnsDuration <= 0)
+			hnsDuration = HNS_PER_SECOND / 30;
+		if (hnsTime + hnsDuration > hnsPassEnd)
+			hnsPassEnd = hnsTime + hnsDuration;
+		bPassHasFrames = true;
+
+		HNSTIME hnsDue = hnsPassStart + hnsTime;
+		HNSTIME hnsNow = GetRingTime();
+		if (hnsNow - hnsDue > BROKER_MAX_LAG) {
+			hnsPassStart = hnsNow - hnsTime;
+			hnsDue = hnsNow;
+		}
+		bool bPublished = WaitUntil(hnsDue) && SUCCEEDED(PublishSample(pSample, hnsTime, hnsDuration));
+		SafeRelease(&pSample);
+		if (!bPublished)
+			break;
+		m_cPublished++;
+
+		if (hnsDue - hnsScanned >= BROKER_READER_SCAN) {
+			FrameRingReaderStats readers[MAX_RING_READERS];
+			uint32_t cReaders = m_writer.GetReaders(readers, MAX_RING_READERS);
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_readers.assign(readers, readers + cReaders);
+			hnsScanned = hnsDue;
+		}
+	}
+
+	SafeRelease(&pReader);
+	if (SUCCEEDED(hrCom))
+		CoUninitialize();
+	m_bStopped = true;
+}
+
+//-----------------------------------------------------------------------------
+// PublishSample
+//
+// Copies the decoded rows straight into the ring slot. A 2D buffer gives
+// its real pitch; a plain one is packed.
+//-----------------------------------------------------------------------------
+
+HRESULT FrameBroker::PublishSample(IMFSample* pSample, HNSTIME hnsTime, HNSTIME hnsDuration)
+{
+	IMFMediaBuffer* pBuffer = NULL;
+	IMF2DBuffer* p2DBuffer = NULL;
+	BYTE* pScan0 = NULL;
+	LONG lPitch = 0;
+	bool b2D = false;
+
+	HRESULT hr = pSample->GetBufferByIndex(0, &pBuffer);
+	if (SUCCEEDED(hr) && SUCCEEDED(pBuffer->QueryInterface(IID_PPV_ARGS(&p2DBuffer))))
+		b2D = SUCCEEDED(hr = p2DBuffer->Lock2D(&pScan0, &lPitch));
+	else if (SUCCEEDED(hr)) {
+		DWORD cbCurrent = 0;
+		hr = pBuffer->Lock(&pScan0, NULL, &cbCurrent);
+		lPitch = (LONG)(m_cx * 4);
+		if (SUCCEEDED(hr) && cbCurrent < (DWORD)lPitch * m_cy) {
+			pBuffer->Unlock();
+			hr = MF_E_BUFFERTOOSMALL;
+		}
+	}
+
+	if (SUCCEEDED(hr)) {
+		size_t cbStride = 0;
+		uint8_t* pDst = m_writer.BeginFrame(&cbStride);
+		if (pDst) {
+			for (UINT32 y = 0; y < m_cy; y++)
+				memcpy(pDst + y * cbStride, pScan0 + (ptrdiff_t)y * lPitch, (size_t)m_cx * 4);
+		}
+		if (b2D)
+			p2DBuffer->Unlock2D();
+		else
+			pBuffer->Unlock();
+		if (!pDst || !m_writer.EndFrame(m_cx, m_cy, hnsTime, hnsDuration))
+			hr = HRESULT_FROM_WIN32(ERROR_BUSY);
+	}
+
+	SafeRelease(&p2DBuffer);
+	SafeRelease(&pBuffer);
+	return hr;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <mfidl.h>
+#include <mfreadwrite.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FrameRing.h"
+#include "FileUtil.h"
+
+
+const uint32_t	BROKER_RING_SLOTS = 6;		// Frame times a reader has to present before it is overtaken
+const uint32_t	BROKER_MAX_WIDTH = 1920;	// Larger clips are scaled down to fit, which bounds the ring
+const uint32_t	BROKER_MAX_HEIGHT = 1080;
+
+
+//-------------------------------------------------------------------
+//
+// FrameBroker class
+//
+// Decodes one clip for every session of a host: the frames are converted
+// to BGRA by the source reader and published into a FrameRing in shared
+// memory when they are due, looping the clip, and SharedFramePlayer
+// instances present them. The clip is decoded once however many
+// sessions show it.
+//
+// The ring lives in the Global\ namespace when the process may create
+// objects there, e.g. as a service or an administrator, so every session
+// sees it; otherwise in the session's own namespace.
+//
+//-------------------------------------------------------------------
+
+class FrameBroker
+{
+public:
+	FrameBroker();
+	~FrameBroker();
+
+	// Opens the clip and starts publishing it. Needs COM and Media
+	// Foundation started.
+	HRESULT Start(const std::wstring& clip);
+	void Stop();
+
+	// The publishing thread stopped, e.g. another broker took the ring.
+	bool IsStopped() const { return m_bStopped; }
+
+	// Frame rate since the last report and the readers attached.
+	std::string GetReport();
+
+	// Shared memory name of a clip's ring in the global or session namespace.
+	static std::wstring GetRingName(const std::wstring& clip, bool bGlobal);
+
+private:
+	HRESULT OpenReader(const std::wstring& clip, IMFSourceReader** ppReader, UINT32* pcx, UINT32* pcy);
+	void PublishThread(IMFSourceReader* pReader);
+	HRESULT PublishSample(IMFSample* pSample, HNSTIME hnsTime, HNSTIME hnsDuration);
+	bool WaitUntil(HNSTIME hnsDue);
+
+	SharedMemory				m_memory;
+	FrameRingWriter				m_writer;
+	std::wstring				m_ringName;
+	UINT32						m_cx;			// Decoded frame size
+	UINT32						m_cy;
+
+	// Guarded by m_mutex.
+	std::mutex					m_mutex;
+	std::condition_variable		m_cv;
+	bool						m_bStop;
+	std::vector<FrameRingReaderStats>	m_readers;	// As of the last scan of the publishing thread
+
+	std::atomic<bool>			m_bStopped;
+	std::atomic<uint64_t>		m_cPublished;
+	std::atomic<uint64_t>		m_cLoops;
+	uint64_t					m_cReported;	// m_cPublished at the last report
+	HNSTIME						m_hnsReported;
+	std::thread					m_thread;
+};
@@ -0,0 +1,138 @@
+#include "FramePacer.h"
+#include <math.h>
+
+
+static uint64_t Gcd(uint64_t a, uint64_t b)
+{
+	while (b) {
+		uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+FrameRate FrameRateFromDouble(double fps)
+{
+	FrameRate rate = { 0, 1 };
+	if (fps <= 0.0)
+		return rate;
+
+	// NTSC rates (23.976, 29.97, 59.94, ...) are N * 1000 / 1001.
+	double ntsc = fps * 1001.0 / 1000.0;
+	if (fabs(ntsc - floor(ntsc + 0.5)) < 0.005 && fabs(fps - floor(fps + 0.5)) > 0.005) {
+		rate.nNum = (uint32_t)floor(ntsc + 0.5) * 1000;
+		rate.nDen = 1001;
+		return rate;
+	}
+
+	uint64_t nNum = (uint64_t)floor(fps * 1000.0 + 0.5);
+	uint64_t nGcd = Gcd(nNum, 1000);
+	rate.nNum = (uint32_t)(nNum / nGcd);
+	rate.nDen = (uint32_t)(1000 / nGcd);
+	return rate;
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+FramePacer::FramePacer() : m_nMul(1), m_nDiv(1), m_bDecimate(false)
+{
+	m_source.nNum = m_target.nNum = 0;
+	m_source.nDen = m_target.nDen = 1;
+}
+
+//-----------------------------------------------------------------------------
+// SetRates
+//
+// Output tick k is at source frame position k * (Snum * Tden) / (Sden * Tnum),
+// kept as a reduced integer ratio so the pattern never drifts.
+//-----------------------------------------------------------------------------
+
+void FramePacer::SetRates(const FrameRate& source, const FrameRate& target)
+{
+	m_source = source;
+	m_target = target;
+	m_nMul = m_nDiv = 1;
+	m_bDecimate = false;
+
+	if (!source.nNum || !source.nDen || !target.nNum || !target.nDen)
+		return;
+
+	uint64_t nMul = (uint64_t)source.nDen * target.nNum;
+	uint64_t nDiv = (uint64_t)source.nNum * target.nDen;
+	if (nMul >= nDiv)
+		return;
+
+	uint64_t nGcd = Gcd(nMul, nDiv);
+	m_nMul = nMul / nGcd;
+	m_nDiv = nDiv / nGcd;
+	m_bDecimate = true;
+}
+
+//-----------------------------------------------------------------------------
+// GetFrameForTick
+//
+// Source frame nearest to the time of output tick nTick.
+//-----------------------------------------------------------------------------
+
+uint64_t FramePacer::GetFrameForTick(uint64_t nTick) const
+{
+	if (!m_bDecimate)
+		return nTick;
+	return (nTick * m_nDiv + m_nMul / 2) / m_nMul;
+}
+
+uint64_t FramePacer::GetOutputTick(uint64_t nFrame) const
+{
+	if (!m_bDecimate)
+		return nFrame;
+	return nFrame * m_nMul / m_nDiv;
+}
+
+//-----------------------------------------------------------------------------
+// ShouldPresent
+//
+// Tick k shows frame round(k * div / mul), so frame n can only belong to
+// tick floor(n * mul / div) or the one after it.
+//-----------------------------------------------------------------------------
+
+bool FramePacer::ShouldPresent(uint64_t nFrame) const
+{
+	if (!m_bDecimate)
+		return true;
+	uint64_t nTick = GetOutputTick(nFrame);
+	return GetFrameForTick(nTick) == nFrame || GetFrameForTick(nTick + 1) == nFrame;
+}
+
+uint32_t FramePacer::GetStride(uint64_t nFrame) const
+{
+	uint32_t cStride = 1;
+	while (!ShouldPresent(nFrame + cStride - 1))
+		cStride++;
+	return cStride;
+}
+
+//-----------------------------------------------------------------------------
+// GetSourceFrame
+//
+// Rounded to the nearest frame, so container timestamps rounded to their
+// own time base still map to their frame.
+//-----------------------------------------------------------------------------
+
+uint64_t FramePacer::GetSourceFrame(HNSTIME hnsTime) const
+{
+	if (!m_source.nNum || !m_source.nDen || hnsTime <= 0)
+		return 0;
+	uint64_t nScale = (uint64_t)m_source.nDen * HNS_PER_SECOND;
+	return ((uint64_t)hnsTime * m_source.nNum + nScale / 2) / nScale;
+}
+
+HNSTIME FramePacer::GetSourceTime(uint64_t nFrame) const
+{
+	if (!m_source.nNum)
+		return 0;
+	return (HNSTIME)(nFrame * m_source.nDen * HNS_PER_SECOND / m_source.nNum);
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "PlaybackClock.h"
+#include <stdint.h>
+
+
+// Frame rate as a ratio, e.g. 60000/1001 for 59.94 fps. A zero numerator
+// means no rate (no cap).
+struct FrameRate
+{
+	uint32_t	nNum;
+	uint32_t	nDen;
+};
+
+inline double FrameRateToDouble(const FrameRate& rate)
+{
+	return rate.nDen ? (double)rate.nNum / rate.nDen : 0.0;
+}
+
+// Closest ratio for a frame rate given in fps, with NTSC rates made exact.
+FrameRate FrameRateFromDouble(double fps);
+
+
+//-------------------------------------------------------------------
+//
+// FramePacer class
+//
+// Chooses which source frames to present so that a source rate is shown
+// at a lower target rate with motion as even as possible. Output tick k
+// shows the source frame nearest to time k / target; all other source
+// frames are dropped.
+//
+// 60 -> 30 keeps every second frame, 59.94 -> 24 alternates gaps of 2
+// and 3 frames, 50 -> 20 alternates 2 and 3.
+//
+//-------------------------------------------------------------------
+
+class FramePacer
+{
+public:
+	FramePacer();
+
+	// Target of zero, or a target not below the source, presents everything.
+	void SetRates(const FrameRate& source, const FrameRate& target);
+	const FrameRate& GetSourceRate() const { return m_source; }
+	const FrameRate& GetTargetRate() const { return m_target; }
+	bool IsDecimating() const { return m_bDecimate; }
+
+	// True if source frame nFrame is presented.
+	bool ShouldPresent(uint64_t nFrame) const;
+
+	// Last output tick at or before source frame nFrame.
+	uint64_t GetOutputTick(uint64_t nFrame) const;
+
+	// Source frame presented at output tick nTick.
+	uint64_t GetFrameForTick(uint64_t nTick) const;
+
+	// Source frames from nFrame up to the next presented one, including it.
+	// The frames before it can be skipped entirely.
+	uint32_t GetStride(uint64_t nFrame) const;
+
+	// Source frame starting nearest hnsTime, and the start of a source
+	// frame. 0 without a source rate.
+	uint64_t GetSourceFrame(HNSTIME hnsTime) const;
+	HNSTIME GetSourceTime(uint64_t nFrame) const;
+
+private:
+	FrameRate	m_source;
+	FrameRate	m_target;
+	uint64_t	m_nMul;		// Output ticks per source frame = m_nMul / m_nDiv
+	uint64_t	m_nDiv;
+	bool		m_bDecimate;
+};
@@ -0,0 +1,158 @@
+#include "FramePool.h"
+#include <stdlib.h>
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+FramePool::FramePool(uint32_t cSlots, size_t cbFrame) : m_cbFrame(0), m_bAborted(false)
+{
+	m_stats = FramePoolStats();
+	Configure(cSlots, cbFrame);
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+
+FramePool::~FramePool()
+{
+	FreeBuffers();
+}
+
+bool FramePool::Configure(uint32_t cSlots, size_t cbFrame)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_free.size() != m_slots.size())
+		return false;
+
+	FreeBuffers();
+	m_slots.resize(cSlots);
+	m_free.clear();
+	m_free.reserve(cSlots);
+	m_cbFrame = cbFrame;
+	for (uint32_t i = 0; i < cSlots; i++) {
+		FrameBuffer& frame = m_slots[i];
+		frame = FrameBuffer();
+		frame.nSlot = i;
+		frame.pData = cbFrame ? (uint8_t*)malloc(cbFrame) : NULL;
+		frame.cbData = frame.pData ? cbFrame : 0;
+		m_free.push_back(cSlots - 1 - i);
+	}
+	return true;
+}
+
+void FramePool::SetRecycle(FrameRecycleFunc func)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_recycle = func;
+}
+
+FrameBuffer* FramePool::Acquire()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_free.empty() ? NULL : TakeFree();
+}
+
+FrameBuffer* FramePool::AcquireWait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_free.empty() && !m_bAborted) {
+		m_stats.cWaits++;
+		m_cvFree.wait(lock, [this] { return !m_free.empty() || m_bAborted; });
+	}
+	return m_bAborted ? NULL : TakeFree();
+}
+
+//-----------------------------------------------------------------------------
+// Release
+//
+// The recycle callback runs outside the lock; it may release COM objects.
+//-----------------------------------------------------------------------------
+
+void FramePool::Release(FrameBuffer* pFrame)
+{
+	if (!pFrame)
+		return;
+
+	FrameRecycleFunc recycle;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		recycle = m_recycle;
+	}
+	if (recycle && pFrame->pSurface)
+		recycle(pFrame);
+	pFrame->pSurface = NULL;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_free.push_back(pFrame->nSlot);
+	m_cvFree.notify_one();
+}
+
+bool FramePool::GrowFrame(FrameBuffer* pFrame, size_t cbFrame)
+{
+	if (pFrame->cbData >= cbFrame)
+		return true;
+	uint8_t* pData = (uint8_t*)realloc(pFrame->pData, cbFrame);
+	if (!pData)
+		return false;
+	pFrame->pData = pData;
+	pFrame->cbData = cbFrame;
+	return true;
+}
+
+void FramePool::Abort()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_bAborted = true;
+	m_cvFree.notify_all();
+}
+
+void FramePool::Resume()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_bAborted = false;
+}
+
+uint32_t FramePool::GetFreeCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return (uint32_t)m_free.size();
+}
+
+FramePoolStats FramePool::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+// Called with the lock held and a free slot available.
+FrameBuffer* FramePool::TakeFree()
+{
+	FrameBuffer* pFrame = &m_slots[m_free.back()];
+	m_free.pop_back();
+	m_stats.cAcquired++;
+	uint32_t cInUse = (uint32_t)(m_slots.size() - m_free.size());
+	if (cInUse > m_stats.cPeakInUse)
+		m_stats.cPeakInUse = cInUse;
+
+	uint8_t* pData = pFrame->pData;
+	size_t cbData = pFrame->cbData;
+	uint32_t nSlot = pFrame->nSlot;
+	*pFrame = FrameBuffer();
+	pFrame->nSlot = nSlot;
+	pFrame->pData = pData;
+	pFrame->cbData = cbData;
+	return pFrame;
+}
+
+void FramePool::FreeBuffers()
+{
+	for (size_t i = 0; i < m_slots.size(); i++) {
+		free(m_slots[i].pData);
+		m_slots[i].pData = NULL;
+	}
+	m_slots.clear();
+	m_free.clear();
+}
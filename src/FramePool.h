@@ -0,0 +1,97 @@
+#pragma once
+#include "PlaybackClock.h"
+#include <stddef.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+
+// One decoded frame in flight between the decoder and the screen.
+struct FrameBuffer
+{
+	uint32_t	nSlot;			// Index in the pool
+	uint32_t	nEpoch;			// Sink epoch the frame was decoded in
+	HNSTIME		hnsTime;		// Presentation time in the clip
+	HNSTIME		hnsDuration;
+	HNSTIME		hnsDecodeStart;	// System times around the decode, for stats
+	HNSTIME		hnsDecoded;
+	HNSTIME		hnsDue;			// System time the frame was due, set when it is shown
+	uint8_t*	pData;			// Pixels owned by the pool, NULL if the pool has no CPU buffers
+	size_t		cbData;
+	uint32_t	cx;				// Layout of the pixels in pData, set by the decoder
+	uint32_t	cy;
+	size_t		cbStride;
+	void*		pSurface;		// Platform surface, e.g. a decoder sample; released by the recycle callback
+};
+
+struct FramePoolStats
+{
+	uint64_t	cAcquired;
+	uint64_t	cWaits;			// Acquires that had to wait for a free slot
+	uint32_t	cPeakInUse;
+};
+
+// Called for a frame going back to the pool, to let go of its surface.
+typedef std::function<void(FrameBuffer*)> FrameRecycleFunc;
+
+
+//-------------------------------------------------------------------
+//
+// FramePool class
+//
+// Fixed set of frame buffers recycled between the decoder and the
+// presenter, so nothing is allocated per frame. Each slot can own a CPU
+// buffer of cbFrame bytes and carries an opaque surface for GPU paths.
+//
+// A decoder that runs ahead blocks in AcquireWait() until the presenter
+// releases a frame, which bounds the frames in flight. Thread-safe.
+//
+//-------------------------------------------------------------------
+
+class FramePool
+{
+public:
+	FramePool(uint32_t cSlots, size_t cbFrame);
+	~FramePool();
+
+	// Reallocates the slots. Fails while frames are out.
+	bool Configure(uint32_t cSlots, size_t cbFrame);
+
+	void SetRecycle(FrameRecycleFunc func);
+
+	// Takes a free frame, NULL if there is none.
+	FrameBuffer* Acquire();
+
+	// Takes a free frame, waiting for one. Returns NULL once Abort() is called.
+	FrameBuffer* AcquireWait();
+
+	void Release(FrameBuffer* pFrame);
+
+	// Grows the CPU buffer of a frame the caller holds to at least cbFrame
+	// bytes. Buffers never shrink, so clips of different sizes share the
+	// pool and a steady clip allocates nothing.
+	bool GrowFrame(FrameBuffer* pFrame, size_t cbFrame);
+
+	// Wakes AcquireWait() callers with NULL until Resume().
+	void Abort();
+	void Resume();
+
+	uint32_t GetSlotCount() const { return (uint32_t)m_slots.size(); }
+	uint32_t GetFreeCount() const;
+	size_t GetFrameSize() const { return m_cbFrame; }
+	FramePoolStats GetStats() const;
+
+private:
+	FrameBuffer* TakeFree();
+	void FreeBuffers();
+
+	std::vector<FrameBuffer>	m_slots;
+	std::vector<uint32_t>		m_free;			// Free slot indices
+	size_t						m_cbFrame;
+	bool						m_bAborted;
+	FrameRecycleFunc			m_recycle;
+	FramePoolStats				m_stats;
+	mutable std::mutex			m_mutex;
+	std::condition_variable		m_cvFree;
+};
@@ -0,0 +1,501 @@
+#include "FrameRing.h"
+#include "FileUtil.h"
+#include <atomic>
+#include <chrono>
+
+// Ring layout version; a ring of another version is laid out anew.
+static const uint32_t RING_MAGIC = 0x524E574C;		// "LWNR"
+static const uint32_t RING_VERSION = 1;
+static const size_t RING_DATA_OFFSET = 8192;		// Pixels of slot 0, past the header
+static const size_t RING_SLOT_ALIGN = 4096;
+static const size_t RING_ROW_ALIGN = 64;
+static const HNSTIME RING_LEASE_UNIT = HNS_PER_SECOND / 8;	// Lease expiry resolution
+static const uint32_t RING_READ_TRIES = 4;			// Reads of a slot overtaken before BeginRead gives up
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+	"ring atomics are shared between processes and must not take locks");
+
+
+//********************* Layout **********************//
+
+// The shared memory starts zero-filled, which is a valid value of every
+// atomic below. Each slot and reader entry has a cache line of its own.
+struct RingSlot
+{
+	std::atomic<uint64_t>	nSeq;			// 2n - 1 while frame n is written, 2n once it is out
+	std::atomic<int64_t>	hnsTime;
+	std::atomic<int64_t>	hnsDuration;
+	std::atomic<int64_t>	hnsPublished;
+	std::atomic<uint32_t>	cx;
+	std::atomic<uint32_t>	cy;
+	uint8_t					reserved[24];
+};
+
+struct RingReaderEntry
+{
+	std::atomic<uint64_t>	nLease;			// Reader id and lease expiry, 0 = free
+	std::atomic<uint64_t>	cFrames;		// Stats as of the reader's last heartbeat
+	std::atomic<uint64_t>	cSkipped;
+	std::atomic<uint64_t>	cTorn;
+	uint8_t					reserved[32];
+};
+
+struct RingHeader
+{
+	std::atomic<uint32_t>	nMagic;			// Stored last, once the shape below is written
+	uint32_t				nVersion;
+	uint32_t				cSlots;
+	uint32_t				cxMax;
+	uint32_t				cyMax;
+	uint32_t				reserved0;
+	uint64_t				cbStride;
+	uint64_t				cbSlot;
+	uint8_t					reserved1[24];
+
+	std::atomic<uint64_t>	nWriterLease;	// Writer id and lease expiry
+	std::atomic<uint64_t>	nPublished;		// Newest frame out, 0 = none yet
+	std::atomic<uint32_t>	nGeneration;	// Writers the ring has had
+	uint8_t					reserved2[44];
+
+	RingSlot				slots[MAX_RING_SLOTS];
+	RingReaderEntry			readers[MAX_RING_READERS];
+};
+
+static_assert(sizeof(RingSlot) == 64 && sizeof(RingReaderEntry) == 64, "ring entries are one cache line");
+static_assert(sizeof(RingHeader) <= RING_DATA_OFFSET, "ring header overlaps the pixels");
+
+static size_t AlignUp(size_t cb, size_t cbAlign)
+{
+	return (cb + cbAlign - 1) / cbAlign * cbAlign;
+}
+
+static size_t GetRowStride(uint32_t cx)
+{
+	return AlignUp((size_t)cx * 4, RING_ROW_ALIGN);
+}
+
+static size_t GetSlotSize(uint32_t cx, uint32_t cy)
+{
+	return AlignUp(GetRowStride(cx) * cy, RING_SLOT_ALIGN);
+}
+
+size_t GetFrameRingSize(const FrameRingConfig& config)
+{
+	return RING_DATA_OFFSET + (size_t)config.cSlots * GetSlotSize(config.cxMax, config.cyMax);
+}
+
+//-----------------------------------------------------------------------------
+// GetFrameRingName
+//
+// LiveWallpaper.Ring.<16 hex digits of FNV-1a over the normalized path>,
+// so every session playing a clip finds the same ring.
+//-----------------------------------------------------------------------------
+
+std::wstring GetFrameRingName(const std::wstring& clip)
+{
+	uint64_t nHash = 0xCBF29CE484222325ull;
+	std::wstring normal = NormalizePath(clip);
+	for (size_t i = 0; i < normal.size(); i++) {
+		uint16_t c = (uint16_t)normal[i];
+		nHash = (nHash ^ (c & 0xFF)) * 0x100000001B3ull;
+		nHash = (nHash ^ (c >> 8)) * 0x100000001B3ull;
+	}
+
+	static const wchar_t s_hex[] = L"0123456789abcdef";
+	std::wstring name(L"LiveWallpaper.Ring.");
+	for (int i = 60; i >= 0; i -= 4)
+		name += s_hex[(nHash >> i) & 0xF];
+	return name;
+}
+
+// steady_clock is system-wide on the platforms the ring runs on: QPC on
+// Windows and CLOCK_MONOTONIC elsewhere.
+HNSTIME GetRingTime()
+{
+	return (HNSTIME)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count() * 10;
+}
+
+
+//********************* Leases **********************//
+
+// A lease word holds the holder's id in the high half and the time it
+// runs out, in RING_LEASE_UNITs, in the low half. Taking and renewing are
+// compare-exchanges, so two holders never both believe they have it.
+
+static uint64_t MakeLease(uint32_t nId, HNSTIME hnsExpiry)
+{
+	return (uint64_t)nId << 32 | (uint32_t)(hnsExpiry / RING_LEASE_UNIT);
+}
+
+static uint32_t GetLeaseId(uint64_t nLease)
+{
+	return (uint32_t)(nLease >> 32);
+}
+
+static bool LeaseRuns(uint64_t nLease, HNSTIME hnsNow)
+{
+	uint32_t nNow = (uint32_t)(hnsNow / RING_LEASE_UNIT);
+	return GetLeaseId(nLease) != 0 && (int32_t)((uint32_t)nLease - nNow) > 0;
+}
+
+
+//********************* FrameRingWriter **********************//
+
+FrameRingWriter::FrameRingWriter() :
+	m_pRing(NULL),
+	m_pSlots(NULL),
+	m_nLease(0),
+	m_hnsRenewed(0),
+	m_nFrame(0)
+{
+}
+
+FrameRingWriter::~FrameRingWriter()
+{
+	Detach();
+}
+
+//-----------------------------------------------------------------------------
+// Attach
+//
+// The lease is taken first, so of two writers starting at once only one
+// touches the layout. A ring of another shape is laid out again behind a
+// cleared magic; its readers notice and attach anew. Frame numbers carry
+// on across writers, so a reader's last frame stays comparable.
+//-----------------------------------------------------------------------------
+
+bool FrameRingWriter::Attach(void* pMemory, size_t cbMemory, const FrameRingConfig& config, uint32_t nWriterId)
+{
+	Detach();
+	if (!pMemory || nWriterId == 0 || config.cSlots < 2 || config.cSlots > MAX_RING_SLOTS ||
+		config.cxMax == 0 || config.cyMax == 0 || cbMemory < GetFrameRingSize(config))
+		return false;
+
+	RingHeader* pRing = (RingHeader*)pMemory;
+	HNSTIME hnsNow = GetRingTime();
+	uint64_t nOld = pRing->nWriterLease.load(std::memory_order_acquire);
+	if (LeaseRuns(nOld, hnsNow) && GetLeaseId(nOld) != nWriterId)
+		return false;
+	uint64_t nLease = MakeLease(nWriterId, hnsNow + RING_WRITER_TIMEOUT);
+	if (!pRing->nWriterLease.compare_exchange_strong(nOld, nLease, std::memory_order_acq_rel))
+		return false;
+
+	bool bSameShape = pRing->nMagic.load(std::memory_order_acquire) == RING_MAGIC && pRing->nVersion == RING_VERSION &&
+		pRing->cSlots == config.cSlots && pRing->cxMax == config.cxMax && pRing->cyMax == config.cyMax;
+	if (!bSameShape) {
+		pRing->nMagic.exchange(0, std::memory_order_acq_rel);
+		pRing->nVersion = RING_VERSION;
+		pRing->cSlots = config.cSlots;
+		pRing->cxMax = config.cxMax;
+		pRing->cyMax = config.cyMax;
+		pRing->cbStride = GetRowStride(config.cxMax);
+		pRing->cbSlot = GetSlotSize(config.cxMax, config.cyMax);
+		for (uint32_t i = 0; i < MAX_RING_SLOTS; i++)
+			pRing->slots[i].nSeq.store(0, std::memory_order_relaxed);
+		pRing->nMagic.store(RING_MAGIC, std::memory_order_release);
+	}
+	pRing->nGeneration.fetch_add(1, std::memory_order_relaxed);
+
+	m_pRing = pRing;
+	m_pSlots = (uint8_t*)pMemory + RING_DATA_OFFSET;
+	m_nLease = nLease;
+	m_hnsRenewed = hnsNow;
+	m_nFrame = 0;
+	return true;
+}
+
+void FrameRingWriter::Detach()
+{
+	if (m_pRing) {
+		uint64_t nLease = m_nLease;
+		m_pRing->nWriterLease.compare_exchange_strong(nLease, 0, std::memory_order_acq_rel);
+	}
+	m_pRing = NULL;
+	m_pSlots = NULL;
+	m_nFrame = 0;
+}
+
+bool FrameRingWriter::RenewLease(HNSTIME hnsNow)
+{
+	uint64_t nOld = m_nLease;
+	uint64_t nLease = MakeLease(GetLeaseId(m_nLease), hnsNow + RING_WRITER_TIMEOUT);
+	if (!m_pRing->nWriterLease.compare_exchange_strong(nOld, nLease, std::memory_order_acq_rel)) {
+		// Another writer took the ring while this one stalled; it is theirs.
+		m_pRing = NULL;
+		m_pSlots = NULL;
+		return false;
+	}
+	m_nLease = nLease;
+	m_hnsRenewed = hnsNow;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// BeginFrame
+//
+// Marks the slot odd before any pixel changes. The mark is an exchange,
+// not a store, so its acquire half keeps the pixel stores after it for a
+// reader that checks the sequence again; no fence is needed, which
+// ThreadSanitizer does not model.
+//-----------------------------------------------------------------------------
+
+uint8_t* FrameRingWriter::BeginFrame(size_t* pcbStride)
+{
+	if (!m_pRing)
+		return NULL;
+	m_nFrame = m_pRing->nPublished.load(std::memory_order_relaxed) + 1;
+	uint32_t nSlot = (uint32_t)(m_nFrame % m_pRing->cSlots);
+	m_pRing->slots[nSlot].nSeq.exchange(2 * m_nFrame - 1, std::memory_order_acq_rel);
+	*pcbStride = (size_t)m_pRing->cbStride;
+	return m_pSlots + nSlot * (size_t)m_pRing->cbSlot;
+}
+
+bool FrameRingWriter::EndFrame(uint32_t cx, uint32_t cy, HNSTIME hnsTime, HNSTIME hnsDuration)
+{
+	if (!m_pRing || m_nFrame == 0)
+		return false;
+	HNSTIME hnsNow = GetRingTime();
+	RingSlot& slot = m_pRing->slots[m_nFrame % m_pRing->cSlots];
+	slot.hnsTime.store(hnsTime, std::memory_order_relaxed);
+	slot.hnsDuration.store(hnsDuration, std::memory_order_relaxed);
+	slot.hnsPublished.store(hnsNow, std::memory_order_relaxed);
+	slot.cx.store(cx < m_pRing->cxMax ? cx : m_pRing->cxMax, std::memory_order_relaxed);
+	slot.cy.store(cy < m_pRing->cyMax ? cy : m_pRing->cyMax, std::memory_order_relaxed);
+	slot.nSeq.store(2 * m_nFrame, std::memory_order_release);
+	m_pRing->nPublished.store(m_nFrame, std::memory_order_release);
+	m_nFrame = 0;
+
+	if (hnsNow - m_hnsRenewed >= RING_WRITER_TIMEOUT / 8)
+		return RenewLease(hnsNow);
+	return true;
+}
+
+bool FrameRingWriter::Heartbeat()
+{
+	return m_pRing && RenewLease(GetRingTime());
+}
+
+uint64_t FrameRingWriter::GetPublishedCount() const
+{
+	return m_pRing ? m_pRing->nPublished.load(std::memory_order_relaxed) : 0;
+}
+
+uint32_t FrameRingWriter::GetReaders(FrameRingReaderStats* pStats, uint32_t cMax) const
+{
+	if (!m_pRing)
+		return 0;
+	HNSTIME hnsNow = GetRingTime();
+	uint32_t cReaders = 0;
+	for (uint32_t i = 0; i < MAX_RING_READERS && cReaders < cMax; i++) {
+		const RingReaderEntry& entry = m_pRing->readers[i];
+		uint64_t nLease = entry.nLease.load(std::memory_order_acquire);
+		if (!LeaseRuns(nLease, hnsNow))
+			continue;
+		FrameRingReaderStats& stats = pStats[cReaders++];
+		stats.nReaderId = GetLeaseId(nLease);
+		stats.cFrames = entry.cFrames.load(std::memory_order_relaxed);
+		stats.cSkipped = entry.cSkipped.load(std::memory_order_relaxed);
+		stats.cTorn = entry.cTorn.load(std::memory_order_relaxed);
+	}
+	return cReaders;
+}
+
+
+//********************* FrameRingReader **********************//
+
+FrameRingReader::FrameRingReader() :
+	m_pRing(NULL),
+	m_pSlots(NULL),
+	m_cbStride(0),
+	m_cbSlot(0),
+	m_nReaderId(0),
+	m_nEntry(-1),
+	m_nLease(0),
+	m_hnsRenewed(0),
+	m_nLastFrame(0),
+	m_hnsNextDue(0)
+{
+	m_config = FrameRingConfig();
+	m_stats = FrameRingReaderStats();
+}
+
+FrameRingReader::~FrameRingReader()
+{
+	Detach();
+}
+
+//-----------------------------------------------------------------------------
+// Attach
+//
+// The shape is taken once; every read checks it against the ring, and the
+// pixel pointers never leave the cbMemory bytes checked here.
+//-----------------------------------------------------------------------------
+
+bool FrameRingReader::Attach(void* pMemory, size_t cbMemory, uint32_t nReaderId)
+{
+	Detach();
+	RingHeader* pRing = (RingHeader*)pMemory;
+	if (!pRing || nReaderId == 0 || cbMemory < RING_DATA_OFFSET ||
+		pRing->nMagic.load(std::memory_order_acquire) != RING_MAGIC || pRing->nVersion != RING_VERSION)
+		return false;
+
+	FrameRingConfig config;
+	config.cSlots = pRing->cSlots;
+	config.cxMax = pRing->cxMax;
+	config.cyMax = pRing->cyMax;
+	if (config.cSlots < 2 || config.cSlots > MAX_RING_SLOTS || config.cxMax == 0 || config.cyMax == 0 ||
+		pRing->cbStride != GetRowStride(config.cxMax) || pRing->cbSlot != GetSlotSize(config.cxMax, config.cyMax) ||
+		cbMemory < GetFrameRingSize(config))
+		return false;
+
+	m_pRing = pRing;
+	m_pSlots = (const uint8_t*)pMemory + RING_DATA_OFFSET;
+	m_config = config;
+	m_cbStride = (size_t)pRing->cbStride;
+	m_cbSlot = (size_t)pRing->cbSlot;
+	m_nReaderId = nReaderId;
+	m_nLastFrame = 0;
+	m_hnsNextDue = 0;
+	m_stats = FrameRingReaderStats();
+	m_stats.nReaderId = nReaderId;
+	Register(GetRingTime());
+	return true;
+}
+
+void FrameRingReader::Detach()
+{
+	if (m_pRing && m_nEntry >= 0) {
+		uint64_t nLease = m_nLease;
+		m_pRing->readers[m_nEntry].nLease.compare_exchange_strong(nLease, 0, std::memory_order_acq_rel);
+	}
+	m_pRing = NULL;
+	m_pSlots = NULL;
+	m_nEntry = -1;
+}
+
+// Takes the first entry whose lease ran out, the reader's own included.
+bool FrameRingReader::Register(HNSTIME hnsNow)
+{
+	m_nEntry = -1;
+	m_hnsRenewed = hnsNow;
+	uint64_t nLease = MakeLease(m_nReaderId, hnsNow + RING_READER_TIMEOUT);
+	for (uint32_t i = 0; i < MAX_RING_READERS; i++) {
+		RingReaderEntry& entry = m_pRing->readers[i];
+		uint64_t nOld = entry.nLease.load(std::memory_order_relaxed);
+		if (LeaseRuns(nOld, hnsNow) || !entry.nLease.compare_exchange_strong(nOld, nLease, std::memory_order_acq_rel))
+			continue;
+		entry.cFrames.store(m_stats.cFrames, std::memory_order_relaxed);
+		entry.cSkipped.store(m_stats.cSkipped, std::memory_order_relaxed);
+		entry.cTorn.store(m_stats.cTorn, std::memory_order_relaxed);
+		m_nEntry = (int)i;
+		m_nLease = nLease;
+		return true;
+	}
+	return false;
+}
+
+void FrameRingReader::Heartbeat()
+{
+	if (!m_pRing)
+		return;
+	HNSTIME hnsNow = GetRingTime();
+	if (hnsNow - m_hnsRenewed < RING_READER_TIMEOUT / 8)
+		return;
+	if (m_nEntry < 0) {
+		Register(hnsNow);
+		return;
+	}
+
+	RingReaderEntry& entry = m_pRing->readers[m_nEntry];
+	entry.cFrames.store(m_stats.cFrames, std::memory_order_relaxed);
+	entry.cSkipped.store(m_stats.cSkipped, std::memory_order_relaxed);
+	entry.cTorn.store(m_stats.cTorn, std::memory_order_relaxed);
+	uint64_t nOld = m_nLease;
+	uint64_t nLease = MakeLease(m_nReaderId, hnsNow + RING_READER_TIMEOUT);
+	if (entry.nLease.compare_exchange_strong(nOld, nLease, std::memory_order_acq_rel)) {
+		m_nLease = nLease;
+		m_hnsRenewed = hnsNow;
+	}
+	else {
+		// The lease ran out while this reader was stalled and the entry
+		// went to another reader.
+		Register(hnsNow);
+	}
+}
+
+bool FrameRingReader::IsWriterAlive() const
+{
+	return m_pRing && LeaseRuns(m_pRing->nWriterLease.load(std::memory_order_acquire), GetRingTime());
+}
+
+//-----------------------------------------------------------------------------
+// BeginRead
+//
+// A slot whose sequence is not the published one was overtaken between
+// the two loads; a newer frame is out by then, so the read starts over.
+//-----------------------------------------------------------------------------
+
+bool FrameRingReader::BeginRead(RingFrame* pFrame, bool bRepeat)
+{
+	if (!m_pRing)
+		return false;
+	if (m_pRing->nMagic.load(std::memory_order_acquire) != RING_MAGIC || m_pRing->cSlots != m_config.cSlots ||
+		m_pRing->cxMax != m_config.cxMax || m_pRing->cyMax != m_config.cyMax) {
+		Detach();
+		return false;
+	}
+
+	for (uint32_t nTry = 0; nTry < RING_READ_TRIES; nTry++) {
+		uint64_t nFrame = m_pRing->nPublished.load(std::memory_order_acquire);
+		if (nFrame == 0 || (nFrame == m_nLastFrame && !bRepeat))
+			return false;
+		uint32_t nSlot = (uint32_t)(nFrame % m_config.cSlots);
+		const RingSlot& slot = m_pRing->slots[nSlot];
+		if (slot.nSeq.load(std::memory_order_acquire) != 2 * nFrame)
+			continue;
+
+		uint32_t cx = slot.cx.load(std::memory_order_relaxed);
+		uint32_t cy = slot.cy.load(std::memory_order_relaxed);
+		pFrame->nFrame = nFrame;
+		pFrame->hnsTime = slot.hnsTime.load(std::memory_order_relaxed);
+		pFrame->hnsDuration = slot.hnsDuration.load(std::memory_order_relaxed);
+		pFrame->hnsPublished = slot.hnsPublished.load(std::memory_order_relaxed);
+		pFrame->cx = cx < m_config.cxMax ? cx : m_config.cxMax;
+		pFrame->cy = cy < m_config.cyMax ? cy : m_config.cyMax;
+		pFrame->cbStride = m_cbStride;
+		pFrame->pData = m_pSlots + nSlot * m_cbSlot;
+		pFrame->nSlot = nSlot;
+		return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// EndRead
+//
+// The second look at the sequence adds 0 to it with release, which keeps
+// the caller's pixel loads before it without a fence: if any of them saw
+// a pixel of a newer frame, the sequence has moved on too. The add does
+// not change the slot, so a reader still holds nothing the writer waits
+// for; it only costs the reader the slot's cache line once per frame.
+//-----------------------------------------------------------------------------
+
+bool FrameRingReader::EndRead(const RingFrame& frame)
+{
+	if (!m_pRing)
+		return false;
+	if (m_pRing->slots[frame.nSlot].nSeq.fetch_add(0, std::memory_order_release) != 2 * frame.nFrame) {
+		m_stats.cTorn++;
+		return false;
+	}
+
+	if (frame.nFrame != m_nLastFrame) {
+		if (m_nLastFrame != 0 && frame.nFrame > m_nLastFrame + 1)
+			m_stats.cSkipped += frame.nFrame - m_nLastFrame - 1;
+		m_stats.cFrames++;
+		m_nLastFrame = frame.nFrame;
+	}
+	m_hnsNextDue = frame.hnsPublished + frame.hnsDuration;
+	return true;
+}
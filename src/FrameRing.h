@@ -0,0 +1,186 @@
+#pragma once
+#include "PlaybackClock.h"
+#include <stddef.h>
+#include <string>
+
+
+const uint32_t	MAX_RING_SLOTS = 8;
+const uint32_t	MAX_RING_READERS = 64;
+const HNSTIME	RING_WRITER_TIMEOUT = 2 * HNS_PER_SECOND;	// Writer lease: a writer silent this long is gone
+const HNSTIME	RING_READER_TIMEOUT = 5 * HNS_PER_SECOND;	// Reader lease: its registration is free again after this
+
+// Shape of a ring: cSlots frames of up to cxMax x cyMax BGRA pixels.
+struct FrameRingConfig
+{
+	uint32_t	cSlots;
+	uint32_t	cxMax;
+	uint32_t	cyMax;
+};
+
+// A published frame as a reader sees it. The pixels stay in the ring.
+struct RingFrame
+{
+	uint64_t		nFrame;			// Publish number, from 1
+	HNSTIME			hnsTime;		// Presentation time in the clip
+	HNSTIME			hnsDuration;
+	HNSTIME			hnsPublished;	// System time the writer published it
+	uint32_t		cx;
+	uint32_t		cy;
+	size_t			cbStride;
+	const uint8_t*	pData;
+	uint32_t		nSlot;
+};
+
+struct FrameRingReaderStats
+{
+	uint32_t	nReaderId;
+	uint64_t	cFrames;		// Frames read intact
+	uint64_t	cSkipped;		// Frames published between two reads, never read
+	uint64_t	cTorn;			// Reads the writer overwrote while they ran
+};
+
+// Bytes of shared memory a ring of this shape takes.
+size_t GetFrameRingSize(const FrameRingConfig& config);
+
+// Name of the shared memory of a clip's ring, without a namespace prefix.
+std::wstring GetFrameRingName(const std::wstring& clip);
+
+// Monotonic system time shared by the processes of a ring.
+HNSTIME GetRingTime();
+
+// Layout of a ring in shared memory, private to FrameRing.cpp.
+struct RingHeader;
+
+//-------------------------------------------------------------------
+//
+// FrameRingWriter class
+//
+// Producer side of a frame ring in shared memory: one writer process
+// publishes decoded frames that any number of reader processes present.
+//
+// Each slot carries a sequence number that is odd while the slot is
+// written, so readers find out without locks whether the frame they read
+// was overwritten under them. Nothing the writer does waits for a
+// reader: a slow reader skips frames and a crashed one holds nothing.
+//
+// The writer holds a lease it renews as it publishes. A writer started
+// while the ring's lease has run out takes the ring over, keeping its
+// frame numbers, so readers carry on with the new writer.
+//
+// Not thread-safe; one thread writes.
+//
+//-------------------------------------------------------------------
+
+class FrameRingWriter
+{
+public:
+	FrameRingWriter();
+	~FrameRingWriter();
+
+	// Lays the ring out in pMemory, or takes over a ring of the same shape.
+	// Fails while another writer's lease runs. nWriterId is not 0.
+	bool Attach(void* pMemory, size_t cbMemory, const FrameRingConfig& config, uint32_t nWriterId);
+
+	// Gives up the lease, so readers see the writer gone at once.
+	void Detach();
+	bool IsAttached() const { return m_pRing != NULL; }
+
+	// Slot for the next frame; fill cyMax rows of cbStride bytes at most.
+	uint8_t* BeginFrame(size_t* pcbStride);
+
+	// Publishes the frame of the last BeginFrame. False if the lease was
+	// lost to another writer, which then owns the ring.
+	bool EndFrame(uint32_t cx, uint32_t cy, HNSTIME hnsTime, HNSTIME hnsDuration);
+
+	// Renews the lease while no frames are published. False if it was lost.
+	bool Heartbeat();
+
+	uint64_t GetPublishedCount() const;
+
+	// Readers whose lease runs, up to cMax of them. Returns their count.
+	uint32_t GetReaders(FrameRingReaderStats* pStats, uint32_t cMax) const;
+
+private:
+	FrameRingWriter(const FrameRingWriter&);
+	FrameRingWriter& operator=(const FrameRingWriter&);
+
+	bool RenewLease(HNSTIME hnsNow);
+
+	RingHeader*			m_pRing;
+	uint8_t*			m_pSlots;		// Pixels of slot 0
+	uint64_t			m_nLease;		// Lease word as last stored
+	HNSTIME				m_hnsRenewed;
+	uint64_t			m_nFrame;		// Frame of the open BeginFrame, 0 = none
+};
+
+
+//-------------------------------------------------------------------
+//
+// FrameRingReader class
+//
+// Consumer side of a frame ring. BeginRead returns the newest frame in
+// place; the caller scales or copies it straight out of the ring and then
+// asks EndRead whether the writer overwrote the slot meanwhile, in which
+// case it drops what it made. With a few slots a reader has several
+// frame times for that before it can be overtaken.
+//
+// Readers register in a table of the ring under a lease of their own,
+// which Heartbeat renews; the writer reports them. A reader that crashes
+// leaves its entry to expire.
+//
+// Not thread-safe; one thread reads.
+//
+//-------------------------------------------------------------------
+
+class FrameRingReader
+{
+public:
+	FrameRingReader();
+	~FrameRingReader();
+
+	// Checks the ring laid out in pMemory and registers as nReaderId,
+	// which is not 0. Reading works without a free registration.
+	bool Attach(void* pMemory, size_t cbMemory, uint32_t nReaderId);
+	void Detach();
+	bool IsAttached() const { return m_pRing != NULL; }
+
+	// The writer's lease runs.
+	bool IsWriterAlive() const;
+
+	// Newest published frame, if it is newer than the last one read intact
+	// or bRepeat is set. False once the writer laid the ring out anew.
+	bool BeginRead(RingFrame* pFrame, bool bRepeat = false);
+
+	// The frame was not overwritten since BeginRead; only then is what
+	// was read from pFrame->pData valid.
+	bool EndRead(const RingFrame& frame);
+
+	// Renews the registration, registering again if it expired.
+	void Heartbeat();
+
+	// System time the next frame should be out: the last frame read
+	// intact plus its duration. 0 before the first frame.
+	HNSTIME GetNextDue() const { return m_hnsNextDue; }
+
+	uint32_t GetSlotCount() const { return m_config.cSlots; }
+	FrameRingReaderStats GetStats() const { return m_stats; }
+
+private:
+	FrameRingReader(const FrameRingReader&);
+	FrameRingReader& operator=(const FrameRingReader&);
+
+	bool Register(HNSTIME hnsNow);
+
+	RingHeader*				m_pRing;
+	const uint8_t*			m_pSlots;
+	FrameRingConfig			m_config;		// Shape at Attach, checked on every read
+	size_t					m_cbStride;
+	size_t					m_cbSlot;
+	uint32_t				m_nReaderId;
+	int						m_nEntry;		// Registration, -1 = none
+	uint64_t				m_nLease;
+	HNSTIME					m_hnsRenewed;
+	uint64_t				m_nLastFrame;	// Last frame read intact
+	HNSTIME					m_hnsNextDue;
+	FrameRingReaderStats	m_stats;
+};
@@ -0,0 +1,316 @@
+#include "FrameSink.h"
+#include <math.h>
+#include <chrono>
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+FrameSink::FrameSink(FramePool* pPool) : m_pPool(pPool), m_pStats(nullptr), m_pCurrent(nullptr),
+	m_pPresenting(nullptr), m_nEpoch(0), m_hnsBasePos(0), m_hnsBaseSys(0), m_fRate(1.0f), m_bRunning(false),
+	m_bPreroll(true), m_bEndOfStream(false), m_bSignaled(false)
+{
+	m_stats = FrameSinkStats();
+	m_queue.reserve(pPool->GetSlotCount());
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+
+FrameSink::~FrameSink()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	ReleaseQueueLocked();
+	m_pPool->Release(m_pCurrent);
+}
+
+void FrameSink::SetRates(const FrameRate& source, const FrameRate& cap)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pacer.SetRates(source, cap);
+}
+
+void FrameSink::Start(HNSTIME hnsNow)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_bRunning)
+		return;
+	m_hnsBaseSys = hnsNow;
+	m_bRunning = true;
+	m_bSignaled = true;
+	m_cvWork.notify_all();
+}
+
+void FrameSink::Pause(HNSTIME hnsNow)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_bRunning)
+		return;
+	m_hnsBasePos = PositionLocked(hnsNow);
+	m_hnsBaseSys = hnsNow;
+	m_bRunning = false;
+	m_bSignaled = true;
+	m_cvWork.notify_all();
+}
+
+bool FrameSink::IsRunning() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_bRunning;
+}
+
+void FrameSink::SetRate(float fRate, HNSTIME hnsNow)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_hnsBasePos = PositionLocked(hnsNow);
+	m_hnsBaseSys = hnsNow;
+	m_fRate = fRate;
+	m_bSignaled = true;
+	m_cvWork.notify_all();
+}
+
+float FrameSink::GetRate() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_fRate;
+}
+
+HNSTIME FrameSink::GetPosition(HNSTIME hnsNow) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return PositionLocked(hnsNow);
+}
+
+uint32_t FrameSink::Flush(HNSTIME hnsPosition)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stats.cFlushed += m_queue.size();
+	ReleaseQueueLocked();
+	m_nEpoch++;
+	m_hnsBasePos = hnsPosition;
+	m_bPreroll = true;
+	m_bEndOfStream = false;
+	m_bSignaled = true;
+	m_cvWork.notify_all();
+	return m_nEpoch;
+}
+
+uint32_t FrameSink::GetEpoch() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_nEpoch;
+}
+
+//-----------------------------------------------------------------------------
+// BeginFrame
+//
+// The decoder sets nEpoch to the epoch of the flush its read position
+// follows, and the times of the frame, before queueing it.
+//-----------------------------------------------------------------------------
+
+FrameBuffer* FrameSink::BeginFrame()
+{
+	return m_pPool->AcquireWait();
+}
+
+void FrameSink::CancelFrame(FrameBuffer* pFrame)
+{
+	m_pPool->Release(pFrame);
+}
+
+//-----------------------------------------------------------------------------
+// QueueFrame
+//
+// Stale frames, frames ending before a seek target and frames the cap
+// skips go back to the pool at once and never reach the presenter.
+//-----------------------------------------------------------------------------
+
+void FrameSink::QueueFrame(FrameBuffer* pFrame)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (pFrame->nEpoch != m_nEpoch ||
+		(m_bPreroll && pFrame->hnsTime + pFrame->hnsDuration <= m_hnsBasePos)) {
+		m_stats.cFlushed++;
+		m_pPool->Release(pFrame);
+		return;
+	}
+
+	if (m_pacer.IsDecimating()) {
+		if (!m_pacer.ShouldPresent(m_pacer.GetSourceFrame(pFrame->hnsTime))) {
+			if (m_pStats)
+				m_pStats->Record(STATS_METRIC_DECODE_TIME, pFrame->hnsDecoded - pFrame->hnsDecodeStart);
+			m_stats.cDecimated++;
+			m_pPool->Release(pFrame);
+			return;
+		}
+	}
+
+	m_queue.push_back(pFrame);
+	m_stats.cQueued++;
+	m_bSignaled = true;
+	m_cvWork.notify_all();
+}
+
+void FrameSink::EndOfStream(uint32_t nEpoch)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (nEpoch != m_nEpoch)
+		return;
+	m_bEndOfStream = true;
+	m_bSignaled = true;
+	m_cvWork.notify_all();
+}
+
+//-----------------------------------------------------------------------------
+// Update
+//
+// After a flush the first frame is shown at once, even while paused, and
+// the clock restarts from its time.
+//-----------------------------------------------------------------------------
+
+FrameBuffer* FrameSink::Update(HNSTIME hnsNow)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_queue.empty())
+		return NULL;
+
+	FrameBuffer* pFrame = NULL;
+	if (m_bPreroll) {
+		pFrame = m_queue.front();
+		m_queue.erase(m_queue.begin());
+		m_bPreroll = false;
+		m_hnsBasePos = pFrame->hnsTime;
+		m_hnsBaseSys = hnsNow;
+		pFrame->hnsDue = hnsNow;
+	}
+	else {
+		if (!m_bRunning || m_fRate <= 0.0f)
+			return NULL;
+		HNSTIME hnsPosition = PositionLocked(hnsNow);
+		while (!m_queue.empty() && m_queue.front()->hnsTime <= hnsPosition) {
+			if (pFrame) {
+				m_stats.cLate++;
+				DropLocked(pFrame);
+			}
+			pFrame = m_queue.front();
+			m_queue.erase(m_queue.begin());
+			pFrame->hnsDue = DueLocked(pFrame->hnsTime);
+		}
+		if (!pFrame)
+			return NULL;
+	}
+
+	// The shown frame replaced before it was presented counts as dropped.
+	if (m_pPresenting && m_pStats)
+		m_pStats->RecordFrame(m_pPresenting->hnsDecodeStart, m_pPresenting->hnsDecoded, m_pPresenting->hnsDue, -1);
+	m_pPool->Release(m_pCurrent);
+	m_pCurrent = m_pPresenting = pFrame;
+	return pFrame;
+}
+
+void FrameSink::OnPresented(HNSTIME hnsPresented)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	FrameBuffer* pFrame = m_pPresenting;
+	if (!pFrame)
+		return;
+	if (m_pStats)
+		m_pStats->RecordFrame(pFrame->hnsDecodeStart, pFrame->hnsDecoded, pFrame->hnsDue, hnsPresented);
+	m_stats.cShown++;
+	m_pPresenting = NULL;
+}
+
+FrameBuffer* FrameSink::GetCurrent() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pCurrent;
+}
+
+HNSTIME FrameSink::GetNextDeadline(HNSTIME hnsNow) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_queue.empty())
+		return -1;
+	if (m_bPreroll)
+		return hnsNow;
+	if (!m_bRunning || m_fRate <= 0.0f)
+		return -1;
+	HNSTIME hnsDue = DueLocked(m_queue.front()->hnsTime);
+	return hnsDue < hnsNow ? hnsNow : hnsDue;
+}
+
+bool FrameSink::IsEnded(HNSTIME hnsNow) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_bEndOfStream || !m_queue.empty() || m_bPreroll)
+		return false;
+	return !m_pCurrent || PositionLocked(hnsNow) >= m_pCurrent->hnsTime + m_pCurrent->hnsDuration;
+}
+
+void FrameSink::Wait(HNSTIME hnsTimeout)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (hnsTimeout < 0)
+		m_cvWork.wait(lock, [this] { return m_bSignaled; });
+	else
+		m_cvWork.wait_for(lock, std::chrono::microseconds(hnsTimeout / 10), [this] { return m_bSignaled; });
+	m_bSignaled = false;
+}
+
+void FrameSink::Wake()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_bSignaled = true;
+	m_cvWork.notify_all();
+}
+
+void FrameSink::Abort()
+{
+	m_pPool->Abort();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	ReleaseQueueLocked();
+	m_pPool->Release(m_pCurrent);
+	m_pCurrent = m_pPresenting = NULL;
+	m_bSignaled = true;
+	m_cvWork.notify_all();
+}
+
+FrameSinkStats FrameSink::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+// Position of the clock; it holds while paused and until the first
+// frame after a flush is shown.
+HNSTIME FrameSink::PositionLocked(HNSTIME hnsNow) const
+{
+	if (!m_bRunning || m_bPreroll)
+		return m_hnsBasePos;
+	return m_hnsBasePos + (HNSTIME)((hnsNow - m_hnsBaseSys) * (double)m_fRate);
+}
+
+// System time the clock reaches hnsTime, rounded up so that the
+// position is there by then. In double: a float loses whole ticks past
+// 2^24 of them, under two seconds into a clip.
+HNSTIME FrameSink::DueLocked(HNSTIME hnsTime) const
+{
+	return m_hnsBaseSys + (HNSTIME)ceil((hnsTime - m_hnsBasePos) / (double)m_fRate);
+}
+
+void FrameSink::DropLocked(FrameBuffer* pFrame)
+{
+	if (m_pStats)
+		m_pStats->RecordFrame(pFrame->hnsDecodeStart, pFrame->hnsDecoded, pFrame->hnsDue, -1);
+	m_pPool->Release(pFrame);
+}
+
+void FrameSink::ReleaseQueueLocked()
+{
+	for (size_t i = 0; i < m_queue.size(); i++)
+		m_pPool->Release(m_queue[i]);
+	m_queue.clear();
+}
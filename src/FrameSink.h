@@ -0,0 +1,118 @@
+#pragma once
+#include "FramePool.h"
+#include "FramePacer.h"
+#include "PlaybackStats.h"
+
+
+struct FrameSinkStats
+{
+	uint64_t	cQueued;
+	uint64_t	cShown;
+	uint64_t	cLate;			// Dropped because a later frame was already due
+	uint64_t	cDecimated;		// Dropped by the frame rate cap
+	uint64_t	cFlushed;		// Dropped by a seek
+};
+
+
+//-------------------------------------------------------------------
+//
+// FrameSink class
+//
+// Schedules decoded frames against its own presentation clock. The
+// decoder queues frames from the pool; the presenter calls Update() at
+// GetNextDeadline() and shows the frame it returns. The shown frame is
+// held until the next one replaces it, so it can be presented again.
+//
+// Of several frames due at once only the last is shown. Frames the
+// frame rate cap would skip are returned to the pool when queued. After
+// a flush the clock waits for the first new frame, so seek and decode
+// latency do not turn into dropped frames.
+//
+// Thread-safe: the decoder and the presenter run on their own threads.
+//
+//-------------------------------------------------------------------
+
+class FrameSink
+{
+public:
+	explicit FrameSink(FramePool* pPool);
+	~FrameSink();
+
+	// Optional collector of decode times, lateness and dropped frames.
+	void SetStats(PlaybackStats* pStats) { m_pStats = pStats; }
+
+	// Source frame rate and cap; a zero cap shows every frame.
+	void SetRates(const FrameRate& source, const FrameRate& cap);
+
+	// Clock, in system time
+	void Start(HNSTIME hnsNow);
+	void Pause(HNSTIME hnsNow);
+	bool IsRunning() const;
+	void SetRate(float fRate, HNSTIME hnsNow);
+	float GetRate() const;
+	HNSTIME GetPosition(HNSTIME hnsNow) const;
+
+	// Drops the queued frames and moves the clock to hnsPosition. Frames
+	// from before the flush are dropped when queued; the shown frame stays
+	// until a new one replaces it. Returns the new epoch.
+	uint32_t Flush(HNSTIME hnsPosition);
+	uint32_t GetEpoch() const;
+
+	// Decoder side. BeginFrame waits for a free frame; NULL after Abort().
+	FrameBuffer* BeginFrame();
+	void CancelFrame(FrameBuffer* pFrame);
+	void QueueFrame(FrameBuffer* pFrame);
+
+	// The decoder read the last frame of epoch nEpoch.
+	void EndOfStream(uint32_t nEpoch);
+
+	// Presenter side. Returns the frame to show now, or NULL to keep the
+	// current one. The frame stays valid until the next Update or Abort.
+	FrameBuffer* Update(HNSTIME hnsNow);
+
+	// The frame returned by Update() reached the screen.
+	void OnPresented(HNSTIME hnsPresented);
+
+	// Frame on screen, for repainting. Call on the presenter thread.
+	FrameBuffer* GetCurrent() const;
+
+	// System time the next frame is due, -1 if none is queued or the
+	// clock is paused.
+	HNSTIME GetNextDeadline(HNSTIME hnsNow) const;
+
+	// The stream ended and its last frame has run its duration.
+	bool IsEnded(HNSTIME hnsNow) const;
+
+	// Waits up to hnsTimeout for a frame, a flush or Wake().
+	void Wait(HNSTIME hnsTimeout);
+	void Wake();
+
+	// Releases every frame and wakes both sides; BeginFrame returns NULL.
+	void Abort();
+
+	FrameSinkStats GetStats() const;
+
+private:
+	HNSTIME PositionLocked(HNSTIME hnsNow) const;
+	HNSTIME DueLocked(HNSTIME hnsTime) const;
+	void DropLocked(FrameBuffer* pFrame);
+	void ReleaseQueueLocked();
+
+	FramePool*					m_pPool;
+	PlaybackStats*				m_pStats;
+	FramePacer					m_pacer;
+	std::vector<FrameBuffer*>	m_queue;		// Presentation order
+	FrameBuffer*				m_pCurrent;		// Shown frame
+	FrameBuffer*				m_pPresenting;	// Returned by Update, not yet presented
+	uint32_t					m_nEpoch;
+	HNSTIME						m_hnsBasePos;	// Clock: position at m_hnsBaseSys
+	HNSTIME						m_hnsBaseSys;
+	float						m_fRate;
+	bool						m_bRunning;
+	bool						m_bPreroll;		// Show the next frame at once and re-base the clock
+	bool						m_bEndOfStream;
+	bool						m_bSignaled;
+	FrameSinkStats				m_stats;
+	mutable std::mutex			m_mutex;
+	std::condition_variable		m_cvWork;
+};
@@ -0,0 +1,255 @@
+#include "FrameStore.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+FrameStore::FrameStore(size_t cbBudget, FRAMESTORE_POLICY policy) : m_cbBudget(cbBudget),
+m_policy(policy), m_nHead(NIL), m_nTail(NIL), m_cClipFrames(0)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+
+FrameStore::~FrameStore()
+{
+	Clear();
+}
+
+size_t FrameStore::GetFrameCost(size_t cbData)
+{
+	return cbData;
+}
+
+size_t FrameStore::GetTableCost(size_t cEntries)
+{
+	return cEntries * sizeof(Entry);
+}
+
+//-----------------------------------------------------------------------------
+// Insert
+//
+// Stores a copy of the frame, evicting others first if the policy
+// allows it.
+//-----------------------------------------------------------------------------
+
+bool FrameStore::Insert(uint32_t nFrame, HNSTIME hnsTime, uint32_t nFlags, const void* pData, size_t cbData)
+{
+	if (Contains(nFrame))
+		return false;
+	if (!HasRoom(nFrame, cbData)) {
+		m_stats.cRejected++;
+		return false;
+	}
+
+	uint8_t* pBuffer = (uint8_t*)malloc(cbData ? cbData : 1);
+	if (!pBuffer) {
+		m_stats.cRejected++;
+		return false;
+	}
+	memcpy(pBuffer, pData, cbData);
+	return Adopt(nFrame, hnsTime, nFlags, pBuffer, cbData);
+}
+
+//-----------------------------------------------------------------------------
+// Adopt
+//
+// A frame past the end of the table grows it first, and the growth is
+// charged with the frame.
+//-----------------------------------------------------------------------------
+
+bool FrameStore::Adopt(uint32_t nFrame, HNSTIME hnsTime, uint32_t nFlags, uint8_t* pBuffer, size_t cbData)
+{
+	if (Contains(nFrame)) {
+		free(pBuffer);
+		return false;
+	}
+	if (!HasRoom(nFrame, cbData)) {
+		free(pBuffer);
+		m_stats.cRejected++;
+		return false;
+	}
+
+	size_t cbTable = GetTableCost(m_entries.capacity());
+	size_t cbGrowth = GetTableCost(GetTableEntries(nFrame)) - cbTable;
+	MakeRoom(GetFrameCost(cbData) + cbGrowth);
+	if (nFrame >= m_entries.size()) {
+		Entry empty = { { nullptr, 0, 0, 0 }, nullptr, NIL, NIL };
+		m_entries.reserve(GetTableEntries(nFrame));
+		m_entries.resize((size_t)nFrame + 1, empty);
+	}
+
+	Entry& e = m_entries[nFrame];
+	e.pBuffer = pBuffer;
+	e.frame.pData = pBuffer;
+	e.frame.cbData = cbData;
+	e.frame.hnsTime = hnsTime;
+	e.frame.nFlags = nFlags;
+	PushFront(nFrame);
+
+	m_stats.cFrames++;
+	m_stats.cbInUse += GetFrameCost(cbData) + GetTableCost(m_entries.capacity()) - cbTable;
+	if (m_stats.cbInUse > m_stats.cbPeak)
+		m_stats.cbPeak = m_stats.cbInUse;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// HasRoom
+//
+// Under FRAMESTORE_EVICT_LRU every stored frame can make way, but the
+// table cannot.
+//-----------------------------------------------------------------------------
+
+bool FrameStore::HasRoom(uint32_t nFrame, size_t cbData) const
+{
+	size_t cbTable = GetTableCost(m_entries.capacity());
+	size_t cbCost = GetFrameCost(cbData) + GetTableCost(GetTableEntries(nFrame)) - cbTable;
+	if (m_policy == FRAMESTORE_KEEP_PREFIX)
+		return m_stats.cbInUse + cbCost <= m_cbBudget;
+	return cbTable + cbCost <= m_cbBudget;
+}
+
+const StoredFrame* FrameStore::Lookup(uint32_t nFrame)
+{
+	if (!Contains(nFrame)) {
+		m_stats.cMisses++;
+		return nullptr;
+	}
+	m_stats.cHits++;
+	if (m_policy == FRAMESTORE_EVICT_LRU && m_nHead != nFrame) {
+		Unlink(nFrame);
+		PushFront(nFrame);
+	}
+	return &m_entries[nFrame].frame;
+}
+
+bool FrameStore::Contains(uint32_t nFrame) const
+{
+	return nFrame < m_entries.size() && m_entries[nFrame].pBuffer != nullptr;
+}
+
+bool FrameStore::IsComplete() const
+{
+	return m_cClipFrames > 0 && m_stats.cFrames == m_cClipFrames;
+}
+
+//-----------------------------------------------------------------------------
+// SetBudget
+//
+// Shrinking the budget evicts from the LRU tail (the newest frames under
+// FRAMESTORE_KEEP_PREFIX) until the store fits again.
+//-----------------------------------------------------------------------------
+
+void FrameStore::SetBudget(size_t cbBudget)
+{
+	m_cbBudget = cbBudget;
+	while (m_stats.cbInUse > m_cbBudget && m_nTail != NIL) {
+		uint32_t nVictim = m_nTail;
+		if (m_policy == FRAMESTORE_KEEP_PREFIX)
+			nVictim = m_nHead;
+		Evict(nVictim);
+	}
+	if (m_stats.cFrames == 0)
+		ReleaseTable();
+}
+
+void FrameStore::Clear()
+{
+	for (size_t i = 0; i < m_entries.size(); i++)
+		free(m_entries[i].pBuffer);
+	ReleaseTable();
+	m_nHead = m_nTail = NIL;
+	m_stats.cFrames = 0;
+	m_stats.cbInUse = 0;
+}
+
+// Frees the table once no frame is left in it.
+void FrameStore::ReleaseTable()
+{
+	m_stats.cbInUse -= GetTableCost(m_entries.capacity());
+	std::vector<Entry>().swap(m_entries);
+}
+
+void FrameStore::ResetCounters()
+{
+	m_stats.cbPeak = m_stats.cbInUse;
+	m_stats.cHits = 0;
+	m_stats.cMisses = 0;
+	m_stats.cEvictions = 0;
+	m_stats.cRejected = 0;
+}
+
+void FrameStore::Unlink(uint32_t nFrame)
+{
+	Entry& e = m_entries[nFrame];
+	if (e.nPrev != NIL)
+		m_entries[e.nPrev].nNext = e.nNext;
+	else
+		m_nHead = e.nNext;
+	if (e.nNext != NIL)
+		m_entries[e.nNext].nPrev = e.nPrev;
+	else
+		m_nTail = e.nPrev;
+	e.nPrev = e.nNext = NIL;
+}
+
+void FrameStore::PushFront(uint32_t nFrame)
+{
+	Entry& e = m_entries[nFrame];
+	e.nPrev = NIL;
+	e.nNext = m_nHead;
+	if (m_nHead != NIL)
+		m_entries[m_nHead].nPrev = nFrame;
+	m_nHead = nFrame;
+	if (m_nTail == NIL)
+		m_nTail = nFrame;
+}
+
+void FrameStore::Evict(uint32_t nFrame)
+{
+	Entry& e = m_entries[nFrame];
+	Unlink(nFrame);
+	m_stats.cbInUse -= GetFrameCost(e.frame.cbData);
+	m_stats.cFrames--;
+	m_stats.cEvictions++;
+	free(e.pBuffer);
+	e.pBuffer = nullptr;
+	e.frame.pData = nullptr;
+	e.frame.cbData = 0;
+}
+
+// Entries the table needs to hold nFrame: what it holds if that is
+// enough, else the clip's frame count once known, else twice as many,
+// so a store filled frame by frame copies its table a few times only.
+size_t FrameStore::GetTableEntries(uint32_t nFrame) const
+{
+	size_t cEntries = m_entries.capacity();
+	if (nFrame < cEntries)
+		return cEntries;
+	if (nFrame < m_cClipFrames)
+		return m_cClipFrames;
+	return cEntries * 2 > nFrame ? cEntries * 2 : (size_t)nFrame + 1;
+}
+
+//-----------------------------------------------------------------------------
+// MakeRoom
+//
+// Returns true if cbCost more bytes fit in the budget, evicting LRU
+// frames when the policy allows it.
+//-----------------------------------------------------------------------------
+
+bool FrameStore::MakeRoom(size_t cbCost)
+{
+	if (m_policy == FRAMESTORE_EVICT_LRU) {
+		while (m_stats.cbInUse + cbCost > m_cbBudget && m_nTail != NIL)
+			Evict(m_nTail);
+	}
+	return m_stats.cbInUse + cbCost <= m_cbBudget;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include "PlaybackClock.h"
+#include <stddef.h>
+#include <vector>
+
+
+// Eviction policy of the frame store once the byte budget is reached.
+enum FRAMESTORE_POLICY
+{
+	// Keep the frames that are already stored and refuse new ones. A looping
+	// clip is read cyclically, which is the worst case for LRU; keeping a
+	// fixed prefix gives a stable hit rate of budget / clip size instead.
+	FRAMESTORE_KEEP_PREFIX = 0,
+
+	// Evict the least recently used frames to make room.
+	FRAMESTORE_EVICT_LRU
+};
+
+struct FrameStoreStats
+{
+	size_t		cbInUse;		// Bytes held, including the frame table
+	size_t		cbPeak;			// High-water mark of cbInUse
+	uint32_t	cFrames;		// Frames held
+	uint64_t	cHits;
+	uint64_t	cMisses;
+	uint64_t	cEvictions;
+	uint64_t	cRejected;		// Frames refused because of the budget
+};
+
+struct StoredFrame
+{
+	const uint8_t*	pData;
+	size_t			cbData;
+	HNSTIME			hnsTime;
+	uint32_t		nFlags;
+};
+
+
+//-------------------------------------------------------------------
+//
+// FrameStore class
+//
+// Byte-budgeted in-memory store of the frames of one clip, indexed by
+// frame number. Filled during the first pass through the clip and
+// replayed on the following ones.
+//
+// The budget covers the frames' bytes and the table indexing them,
+// which holds an entry for every frame number up to the highest stored
+// and is sized to the clip once SetFrameCount is known.
+//
+// Not thread-safe; the owner serializes access.
+//
+//-------------------------------------------------------------------
+
+class FrameStore
+{
+public:
+	FrameStore(size_t cbBudget, FRAMESTORE_POLICY policy);
+	~FrameStore();
+
+	// Copies the frame into the store. Returns false if it was refused
+	// (over budget) or is already stored.
+	bool Insert(uint32_t nFrame, HNSTIME hnsTime, uint32_t nFlags, const void* pData, size_t cbData);
+
+	// As Insert, but takes over pBuffer, a malloc block of cbData bytes,
+	// instead of copying it; frees it if the frame is refused. Lets the
+	// caller fill the frame in place without holding its lock.
+	bool Adopt(uint32_t nFrame, HNSTIME hnsTime, uint32_t nFlags, uint8_t* pBuffer, size_t cbData);
+
+	// True if a frame of cbData bytes would be stored, counting the
+	// evictions the policy allows.
+	bool HasRoom(uint32_t nFrame, size_t cbData) const;
+
+	// Looks up a stored frame; counts a hit or a miss. The returned
+	// StoredFrame stays valid until the next Insert, Adopt, SetBudget or
+	// Clear; its pData until the frame is evicted, which only SetBudget
+	// and Clear do under FRAMESTORE_KEEP_PREFIX.
+	const StoredFrame* Lookup(uint32_t nFrame);
+
+	bool Contains(uint32_t nFrame) const;
+
+	// Number of frames in the clip, once known (end of the first pass).
+	void SetFrameCount(uint32_t cFrames) { m_cClipFrames = cFrames; }
+	uint32_t GetFrameCount() const { return m_cClipFrames; }
+
+	// True when every frame of the clip is stored.
+	bool IsComplete() const;
+
+	void SetBudget(size_t cbBudget);
+	size_t GetBudget() const { return m_cbBudget; }
+	FRAMESTORE_POLICY GetPolicy() const { return m_policy; }
+
+	void Clear();
+	void ResetCounters();
+	const FrameStoreStats& GetStats() const { return m_stats; }
+
+	// Bytes charged against the budget for a frame of cbData bytes, not
+	// counting its entry in the frame table.
+	static size_t GetFrameCost(size_t cbData);
+
+	// Bytes the frame table takes for cEntries frame numbers.
+	static size_t GetTableCost(size_t cEntries);
+
+private:
+	static const uint32_t NIL = 0xFFFFFFFF;
+
+	struct Entry
+	{
+		StoredFrame	frame;
+		uint8_t*	pBuffer;
+		uint32_t	nPrev;		// LRU list, most recent at the head
+		uint32_t	nNext;
+	};
+
+	void Unlink(uint32_t nFrame);
+	void PushFront(uint32_t nFrame);
+	void Evict(uint32_t nFrame);
+	size_t GetTableEntries(uint32_t nFrame) const;
+	bool MakeRoom(size_t cbCost);
+	void ReleaseTable();
+
+	std::vector<Entry>	m_entries;
+	size_t				m_cbBudget;
+	FRAMESTORE_POLICY	m_policy;
+	uint32_t			m_nHead;
+	uint32_t			m_nTail;
+	uint32_t			m_cClipFrames;
+	FrameStoreStats		m_stats;
+};
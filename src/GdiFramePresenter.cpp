@@ -0,0 +1,193 @@
+#include "pch.h"
+#include "LiveWallpaper.h"
+#include "GdiFramePresenter.h"
+#include <math.h>
+
+
+const size_t	MAX_OVERLAY_DIRTY = 8;		// Rectangles PresentOverlay copies at most, per viewport
+
+GdiFramePresenter::GdiFramePresenter(HWND hwndVideo) : m_hwndVideo(hwndVideo), m_bClear(true), m_pOverlay(nullptr)
+{
+}
+
+void GdiFramePresenter::SetViewports(const Viewport* pViewports, size_t cViewports)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_viewports.assign(pViewports, pViewports + cViewports);
+	m_bClear = true;
+}
+
+void GdiFramePresenter::Invalidate()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_bClear = true;
+}
+
+void GdiFramePresenter::SetOverlay(OverlayCompositor* pOverlay)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pOverlay = pOverlay;
+}
+
+// Copies cx x cy top-down BGRA pixels 1:1, from column xSrc of pRows.
+static void DrawPixels(HDC hdc, int xDest, int yDest, const uint8_t* pRows, LONG nRowPixels, int xSrc, int cx, int cy)
+{
+	BITMAPINFO bmi = {};
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = nRowPixels;
+	bmi.bmiHeader.biHeight = -cy;		// Top-down rows
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = 32;
+	bmi.bmiHeader.biCompression = BI_RGB;
+	StretchDIBits(hdc, xDest, yDest, cx, cy, xSrc, 0, cx, cy, pRows, &bmi, DIB_RGB_COLORS, SRCCOPY);
+}
+
+//-----------------------------------------------------------------------------
+// Present
+//
+// Each viewport's part of the frame is scaled to its monitor with the SIMD
+// scaler, area-filtered when it shrinks, and copied 1:1. The area outside
+// the viewports is only painted black after the layout changed or the
+// window asked for a repaint.
+//
+// The overlay is composed over the scaler's output; a viewport shown 1:1
+// is copied out of the frame first, which belongs to the player. Without
+// one, such a viewport copies only the frame's dirty rectangles.
+//-----------------------------------------------------------------------------
+
+void GdiFramePresenter::Present(const FrameBuffer* pFrame, const LayoutRect* pDirty, size_t cDirty)
+{
+	std::lock_guard<std::mutex> present(m_presentMutex);
+	bool bClear = false;
+	OverlayCompositor* pOverlay = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_drawViewports.assign(m_viewports.begin(), m_viewports.end());
+		bClear = m_bClear;
+		m_bClear = false;
+		pOverlay = m_pOverlay;
+	}
+	if (pOverlay && pOverlay->IsEmpty())
+		pOverlay = nullptr;
+
+	HDC hdc = GetDC(m_hwndVideo);
+	if (!hdc)
+		return;
+
+	RECT rcClient;
+	GetClientRect(m_hwndVideo, &rcClient);
+	if (bClear)
+		FillRect(hdc, &rcClient, (HBRUSH)GetStockObject(BLACK_BRUSH));
+
+	if (m_drawViewports.empty()) {
+		Viewport view = {};
+		view.rcSource.right = pFrame->cx;
+		view.rcSource.bottom = pFrame->cy;
+		view.rcDest.right = Width(rcClient);
+		view.rcDest.bottom = Height(rcClient);
+		m_drawViewports.push_back(view);
+	}
+	if (m_scalers.size() < m_drawViewports.size())
+		m_scalers.resize(m_drawViewports.size());
+
+	for (size_t i = 0; i < m_drawViewports.size(); i++) {
+		const Viewport& view = m_drawViewports[i];
+		ViewportScaler& scaler = m_scalers[i];
+		scaler.bComposed = false;
+		int xSrc = (int)floor(view.rcSource.left), ySrc = (int)floor(view.rcSource.top);
+		int xSrcEnd = (int)ceil(view.rcSource.right), ySrcEnd = (int)ceil(view.rcSource.bottom);
+		xSrc = xSrc > 0 ? xSrc : 0;
+		ySrc = ySrc > 0 ? ySrc : 0;
+		int cxSrc = (xSrcEnd < (int)pFrame->cx ? xSrcEnd : (int)pFrame->cx) - xSrc;
+		int cySrc = (ySrcEnd < (int)pFrame->cy ? ySrcEnd : (int)pFrame->cy) - ySrc;
+		int cxDst = view.rcDest.right - view.rcDest.left;
+		int cyDst = view.rcDest.bottom - view.rcDest.top;
+		if (cxSrc <= 0 || cySrc <= 0 || cxDst <= 0 || cyDst <= 0)
+			continue;
+
+		const uint8_t* pPixels = pFrame->pData + ySrc * pFrame->cbStride + (size_t)xSrc * 4;
+		LONG nRowPixels = (LONG)(pFrame->cbStride / 4);
+		bool bScale = cxSrc != cxDst || cySrc != cyDst;
+		if (pDirty && !bScale && !pOverlay && !bClear) {
+			for (size_t n = 0; n < cDirty; n++) {
+				int left = pDirty[n].left > xSrc ? pDirty[n].left : xSrc;
+				int top = pDirty[n].top > ySrc ? pDirty[n].top : ySrc;
+				int right = pDirty[n].right < xSrc + cxSrc ? pDirty[n].right : xSrc + cxSrc;
+				int bottom = pDirty[n].bottom < ySrc + cySrc ? pDirty[n].bottom : ySrc + cySrc;
+				if (left < right && top < bottom) {
+					DrawPixels(hdc, view.rcDest.left + left - xSrc, view.rcDest.top + top - ySrc,
+						pFrame->pData + top * pFrame->cbStride, nRowPixels, left, right - left, bottom - top);
+				}
+			}
+			continue;
+		}
+		if (bScale || pOverlay) {
+			size_t cbRow = (size_t)cxDst * 4;
+			scaler.pixels.resize(cbRow * cyDst);
+			if (bScale) {
+				if (!scaler.scaler.Matches(cxSrc, cySrc, cxDst, cyDst, SCALE_FILTER_AREA))
+					scaler.scaler.Init(cxSrc, cySrc, cxDst, cyDst, SCALE_FILTER_AREA);
+				scaler.scaler.Scale(pPixels, pFrame->cbStride, scaler.pixels.data(), cbRow);
+			}
+			else {
+				for (int y = 0; y < cyDst; y++)
+					memcpy(scaler.pixels.data() + y * cbRow, pPixels + y * pFrame->cbStride, cbRow);
+			}
+			if (pOverlay) {
+				LayoutRect dirty[MAX_OVERLAY_DIRTY];
+				pOverlay->Compose(&scaler.overlay, scaler.pixels.data(), cbRow, cxDst, cyDst, true, dirty,
+					MAX_OVERLAY_DIRTY);
+				scaler.bComposed = true;
+			}
+			pPixels = scaler.pixels.data();
+			nRowPixels = cxDst;
+		}
+		DrawPixels(hdc, view.rcDest.left, view.rcDest.top, pPixels, nRowPixels, 0, cxDst, cyDst);
+	}
+
+	ReleaseDC(m_hwndVideo, hdc);
+}
+
+//-----------------------------------------------------------------------------
+// PresentOverlay
+//
+// Composes the overlay's changes into the pixels each viewport kept and
+// copies the rectangles that changed. Viewports that showed their last
+// frame without the overlay wait for the next frame.
+//-----------------------------------------------------------------------------
+
+void GdiFramePresenter::PresentOverlay()
+{
+	std::lock_guard<std::mutex> present(m_presentMutex);
+	OverlayCompositor* pOverlay = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		pOverlay = m_pOverlay;
+	}
+	if (!pOverlay)
+		return;
+
+	HDC hdc = GetDC(m_hwndVideo);
+	if (!hdc)
+		return;
+
+	for (size_t i = 0; i < m_drawViewports.size() && i < m_scalers.size(); i++) {
+		ViewportScaler& scaler = m_scalers[i];
+		if (!scaler.bComposed)
+			continue;
+		const Viewport& view = m_drawViewports[i];
+		int cxDst = view.rcDest.right - view.rcDest.left;
+		int cyDst = view.rcDest.bottom - view.rcDest.top;
+		size_t cbRow = (size_t)cxDst * 4;
+		LayoutRect dirty[MAX_OVERLAY_DIRTY];
+		size_t cDirty = pOverlay->Compose(&scaler.overlay, scaler.pixels.data(), cbRow, cxDst, cyDst, false, dirty,
+			MAX_OVERLAY_DIRTY);
+		for (size_t n = 0; n < cDirty; n++) {
+			const LayoutRect& rc = dirty[n];
+			DrawPixels(hdc, view.rcDest.left + rc.left, view.rcDest.top + rc.top, scaler.pixels.data() + rc.top * cbRow,
+				cxDst, rc.left, rc.right - rc.left, rc.bottom - rc.top);
+		}
+	}
+
+	ReleaseDC(m_hwndVideo, hdc);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <mutex>
+#include <vector>
+#include "MonitorLayout.h"
+#include "FramePool.h"
+#include "ImageScaler.h"
+#include "OverlayCompositor.h"
+
+
+//-------------------------------------------------------------------
+//
+// GdiFramePresenter class
+//
+// Draws CPU frames of BGRA pixels into a window with GDI: each viewport's
+// part of the frame is scaled to its monitor with BGRAScaler and copied
+// 1:1. Players that produce frames in memory share it.
+//
+// With an overlay, the widgets are composed over each viewport's pixels,
+// which are kept; PresentOverlay then redraws and copies only what the
+// widgets changed, e.g. once a second for a clock, without a new frame.
+//
+// SetViewports, SetOverlay, Invalidate and PresentOverlay may be called
+// from any thread; Present is called from one thread at a time.
+//
+//-------------------------------------------------------------------
+
+class GdiFramePresenter
+{
+public:
+	explicit GdiFramePresenter(HWND hwndVideo);
+
+	// Viewports of a monitor layout; none stretches the frame over the window.
+	void SetViewports(const Viewport* pViewports, size_t cViewports);
+
+	// Paints the window black before the next frame.
+	void Invalidate();
+
+	// Widgets to draw over the frames, nullptr for none. The compositor
+	// outlives the presenter or is set back to nullptr first.
+	void SetOverlay(OverlayCompositor* pOverlay);
+
+	void Present(const FrameBuffer* pFrame) { Present(pFrame, nullptr, 0); }
+
+	// Presents a frame of which only the cDirty rectangles of pDirty changed
+	// since the frame presented last; nullptr for all of it. Viewports shown
+	// 1:1 without an overlay copy only those, unless the window is painted
+	// black first.
+	void Present(const FrameBuffer* pFrame, const LayoutRect* pDirty, size_t cDirty);
+
+	// Draws the overlay's changes over the last frame presented.
+	void PresentOverlay();
+
+private:
+	HWND					m_hwndVideo;
+
+	std::mutex				m_mutex;		// Guards m_viewports, m_bClear and m_pOverlay
+	std::vector<Viewport>	m_viewports;
+	bool					m_bClear;		// Paint the window black before the next frame
+	OverlayCompositor*		m_pOverlay;
+
+	// Guarded by m_presentMutex: Present's state, kept for PresentOverlay.
+	std::mutex				m_presentMutex;
+	std::vector<Viewport>	m_drawViewports;	// Present's copy
+
+	// Scaler and output of each viewport
+	struct ViewportScaler
+	{
+		BGRAScaler				scaler;
+		std::vector<uint8_t>	pixels;
+		OverlayTarget			overlay;
+		bool					bComposed;	// pixels hold the last frame with the overlay
+	};
+	std::vector<ViewportScaler>	m_scalers;
+};
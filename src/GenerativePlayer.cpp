@@ -0,0 +1,418 @@
+#include "pch.h"
+#include "LiveWallpaper.h"
+#include "GenerativePlayer.h"
+#include <chrono>
+#include <new>
+
+// Longest the render thread sleeps while paused or with nothing open.
+static const HNSTIME GENERATIVE_IDLE_INTERVAL = 100 * HNS_PER_MSEC;
+
+// Dirty rectangles handed to the presenter per frame; more are merged.
+static const size_t MAX_PRESENT_RECTS = 32;
+
+// Render threads: half the cores, so a wallpaper leaves the rest to the
+// applications in front of it.
+static uint32_t GetRenderThreadCount()
+{
+	uint32_t cCores = std::thread::hardware_concurrency();
+	return cCores > 1 ? (cCores + 1) / 2 : 1;
+}
+
+
+//-----------------------------------------------------------------------------
+// CreateInstance
+//-----------------------------------------------------------------------------
+
+HRESULT GenerativePlayer::CreateInstance(PlayerEventQueue* pEvents, HWND hwndVideo, GenerativePlayer** ppPlayer)
+{
+	GenerativePlayer* pPlayer = new (std::nothrow)GenerativePlayer(pEvents, hwndVideo);
+	if (!pPlayer)
+		return E_OUTOFMEMORY;
+	*ppPlayer = pPlayer;
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+GenerativePlayer::GenerativePlayer(PlayerEventQueue* pEvents, HWND hwndVideo) : m_cRef(1), m_pEvents(pEvents),
+m_pStats(nullptr), m_hwndVideo(hwndVideo), m_presenter(hwndVideo), m_pending(GENERATIVE_EFFECT_PLASMA),
+m_bPending(false), m_prepared(GENERATIVE_EFFECT_PLASMA), m_bPrepared(false), m_state(MFP_MEDIAPLAYER_STATE_EMPTY),
+m_bRedraw(false), m_bFirstFrame(false), m_bStop(false), m_hnsMinInterval(0), m_fRate(1.0f), m_hnsPosition(0)
+{
+	m_szVideo.cx = 0;
+	m_szVideo.cy = 0;
+	m_thread = std::thread(&GenerativePlayer::RenderThread, this);
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+
+GenerativePlayer::~GenerativePlayer()
+{
+	Shutdown();
+}
+
+ULONG GenerativePlayer::AddRef()
+{
+	return InterlockedIncrement(&m_cRef);
+}
+
+ULONG GenerativePlayer::Release()
+{
+	ULONG uCount = InterlockedDecrement(&m_cRef);
+	if (uCount == 0)
+	{
+		delete this;
+	}
+	return uCount;
+}
+
+// Frames are rendered at the window's size, so viewports showing the
+// frame 1:1 get partial copies; a window not sized yet gets the virtual
+// screen's.
+SIZE GenerativePlayer::GetWindowSize()
+{
+	RECT rc = {};
+	GetClientRect(m_hwndVideo, &rc);
+	SIZE sz = { rc.right - rc.left, rc.bottom - rc.top };
+	if (sz.cx <= 0 || sz.cy <= 0) {
+		sz.cx = GetSystemMetrics(SM_CXVIRTUALSCREEN);
+		sz.cy = GetSystemMetrics(SM_CYVIRTUALSCREEN);
+	}
+	return sz;
+}
+
+HRESULT GenerativePlayer::OpenURL(const WCHAR* sURL)
+{
+	GENERATIVE_EFFECT effect;
+	if (!FindGenerativeEffect(sURL, &effect))
+		return MF_E_UNSUPPORTED_FORMAT;
+	SIZE szVideo = GetWindowSize();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending = effect;
+		m_bPending = true;
+		m_szVideo = szVideo;
+		m_state = MFP_MEDIAPLAYER_STATE_PLAYING;
+		m_bFirstFrame = true;
+	}
+	m_cv.notify_all();
+	return S_OK;
+}
+
+// Nothing to load: the effect is set up when it is switched to.
+HRESULT GenerativePlayer::PrepareURL(const WCHAR* sURL)
+{
+	GENERATIVE_EFFECT effect = GENERATIVE_EFFECT_PLASMA;
+	HRESULT hr = FindGenerativeEffect(sURL, &effect) ? S_OK : MF_E_UNSUPPORTED_FORMAT;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_prepared = effect;
+		m_bPrepared = SUCCEEDED(hr);
+	}
+	NotifyPrepared(hr);
+	return S_OK;
+}
+
+bool GenerativePlayer::IsPrepared()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_bPrepared;
+}
+
+HRESULT GenerativePlayer::SwitchToPrepared()
+{
+	SIZE szVideo = GetWindowSize();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_bPrepared)
+			return MF_E_INVALIDREQUEST;
+		m_pending = m_prepared;
+		m_bPending = true;
+		m_bPrepared = false;
+		m_szVideo = szVideo;
+		m_bFirstFrame = true;
+	}
+	m_cv.notify_all();
+	return S_OK;
+}
+
+void GenerativePlayer::CancelPrepared()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_bPrepared = false;
+}
+
+HRESULT GenerativePlayer::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStop = true;
+		m_state = MFP_MEDIAPLAYER_STATE_SHUTDOWN;
+		m_bPending = false;
+		m_bPrepared = false;
+	}
+	m_cv.notify_all();
+	if (m_thread.joinable())
+		m_thread.join();
+	return S_OK;
+}
+
+MFP_MEDIAPLAYER_STATE GenerativePlayer::GetState() noexcept
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_state;
+}
+
+bool GenerativePlayer::Play() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_state == MFP_MEDIAPLAYER_STATE_EMPTY || m_state == MFP_MEDIAPLAYER_STATE_SHUTDOWN)
+			return false;
+		m_state = MFP_MEDIAPLAYER_STATE_PLAYING;
+	}
+	m_cv.notify_all();
+	NotifyState(MFP_MEDIAPLAYER_STATE_PLAYING);
+	return true;
+}
+
+// The animation holds where it is and nothing is rendered.
+bool GenerativePlayer::Pause() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_state == MFP_MEDIAPLAYER_STATE_EMPTY || m_state == MFP_MEDIAPLAYER_STATE_SHUTDOWN)
+			return false;
+		m_state = MFP_MEDIAPLAYER_STATE_PAUSED;
+	}
+	NotifyState(MFP_MEDIAPLAYER_STATE_PAUSED);
+	return true;
+}
+
+bool GenerativePlayer::Stop() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_state == MFP_MEDIAPLAYER_STATE_EMPTY || m_state == MFP_MEDIAPLAYER_STATE_SHUTDOWN)
+			return false;
+		m_state = MFP_MEDIAPLAYER_STATE_STOPPED;
+	}
+	NotifyState(MFP_MEDIAPLAYER_STATE_STOPPED);
+	return true;
+}
+
+float GenerativePlayer::GetRate() noexcept
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_fRate;
+}
+
+// Any positive rate: it only scales the animation's time.
+bool GenerativePlayer::SetRate(float fRate) noexcept
+{
+	if (!(fRate > 0.0f))
+		return false;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_fRate = fRate;
+	}
+	NotifyRate();
+	return true;
+}
+
+HRESULT GenerativePlayer::SetMaxFrameRate(float fFps)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_hnsMinInterval = fFps > 0.0f ? (HNSTIME)(HNS_PER_SECOND / fFps) : 0;
+	}
+	m_cv.notify_all();
+	return S_OK;
+}
+
+// The animation has no timeline to seek in.
+HRESULT GenerativePlayer::CanSeek(BOOL* pbCanSeek)
+{
+	*pbCanSeek = FALSE;
+	return S_OK;
+}
+
+HRESULT GenerativePlayer::GetCurrentPosition(MFTIME* phnsPosition)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_state == MFP_MEDIAPLAYER_STATE_EMPTY)
+		return MF_E_INVALIDREQUEST;
+	*phnsPosition = m_hnsPosition;
+	return S_OK;
+}
+
+HRESULT GenerativePlayer::GetVideoSize(SIZE* pszVideo)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_szVideo.cx == 0)
+		return MF_E_INVALIDREQUEST;
+	*pszVideo = m_szVideo;
+	return S_OK;
+}
+
+HRESULT GenerativePlayer::SetViewports(const Viewport* pViewports, size_t cViewports, const SIZE& szSource)
+{
+	if (szSource.cx <= 0 || szSource.cy <= 0)
+		return E_INVALIDARG;
+	m_presenter.SetViewports(pViewports, cViewports);
+	UpdateVideo();
+	return S_OK;
+}
+
+void GenerativePlayer::UpdateVideo()
+{
+	m_presenter.Invalidate();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bRedraw = true;
+	}
+	m_cv.notify_all();
+}
+
+// The frame on screen is drawn again, with the overlay.
+HRESULT GenerativePlayer::SetOverlay(OverlayCompositor* pOverlay)
+{
+	m_presenter.SetOverlay(pOverlay);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bRedraw = true;
+	}
+	m_cv.notify_all();
+	return S_OK;
+}
+
+HNSTIME GenerativePlayer::Now()
+{
+	return (HNSTIME)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count() * 10;
+}
+
+
+//********************* Render thread **********************//
+
+//-----------------------------------------------------------------------------
+// PresentFrame
+//
+// Draws the renderer's frame; bFull: all of it, otherwise only the tiles
+// the last Render changed.
+//-----------------------------------------------------------------------------
+
+void GenerativePlayer::PresentFrame(HNSTIME hnsTime, bool bFull)
+{
+	FrameBuffer frame = {};
+	frame.hnsTime = hnsTime;
+	frame.hnsDuration = HNS_PER_SECOND / GENERATIVE_DEFAULT_FPS;
+	frame.pData = (uint8_t*)m_renderer.GetPixels();
+	frame.cx = m_renderer.GetWidth();
+	frame.cy = m_renderer.GetHeight();
+	frame.cbStride = m_renderer.GetStride();
+	if (bFull) {
+		m_presenter.Present(&frame);
+	}
+	else {
+		LayoutRect dirty[MAX_PRESENT_RECTS];
+		m_presenter.Present(&frame, dirty, m_renderer.GetDirtyRects(dirty, MAX_PRESENT_RECTS));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// RenderThread
+//
+// Renders a frame whenever one is due while playing, advancing the
+// animation by the time since the last one at the rate, and presents the
+// tiles that changed. Paused, the animation's time stands still and the
+// frame is only drawn again when the window needs it.
+//-----------------------------------------------------------------------------
+
+void GenerativePlayer::RenderThread()
+{
+	bool bOpen = false;
+	HNSTIME hnsAnimation = 0;
+	HNSTIME hnsLastFrame = 0;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_bStop) {
+		bool bPending = m_bPending;
+		GENERATIVE_EFFECT effect = m_pending;
+		SIZE szVideo = m_szVideo;
+		m_bPending = false;
+		bool bPlaying = m_state == MFP_MEDIAPLAYER_STATE_PLAYING;
+		bool bRedraw = m_bRedraw;
+		m_bRedraw = false;
+		HNSTIME hnsMinInterval = m_hnsMinInterval;
+		float fRate = m_fRate;
+		lock.unlock();
+
+		bool bFull = bRedraw;
+		if (bPending) {
+			GenerativeConfig config;
+			config.effect = effect;
+			config.cx = (uint32_t)szVideo.cx;
+			config.cy = (uint32_t)szVideo.cy;
+			config.cThreads = GetRenderThreadCount();
+			config.nSeed = GetTickCount();
+			bOpen = m_renderer.Init(config);
+			if (!bOpen)
+				NotifyError(E_OUTOFMEMORY);
+			hnsAnimation = 0;
+			hnsLastFrame = 0;
+			bFull = true;
+		}
+
+		HNSTIME hnsInterval = HNS_PER_SECOND / GENERATIVE_DEFAULT_FPS;
+		if (hnsMinInterval > hnsInterval)
+			hnsInterval = hnsMinInterval;
+		HNSTIME hnsWait = GENERATIVE_IDLE_INTERVAL;
+		HNSTIME hnsNow = Now();
+		if (bOpen && bPlaying) {
+			HNSTIME hnsDue = hnsLastFrame + hnsInterval;
+			if (bFull || hnsLastFrame == 0 || hnsNow >= hnsDue) {
+				if (hnsLastFrame != 0)
+					hnsAnimation += (HNSTIME)((hnsNow - hnsLastFrame) * fRate);
+				HNSTIME hnsStart = hnsNow;
+				uint32_t cRendered = m_renderer.Render(hnsAnimation);
+				HNSTIME hnsRendered = Now();
+				if (cRendered > 0 || bFull) {
+					PresentFrame(hnsAnimation, bFull);
+					if (m_pStats)
+						m_pStats->RecordFrame(hnsStart, hnsRendered, hnsLastFrame ? hnsDue : hnsStart, Now());
+				}
+				hnsLastFrame = hnsNow;
+
+				bool bFirstFrame = false;
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					m_hnsPosition = hnsAnimation;
+					bFirstFrame = m_bFirstFrame;
+					m_bFirstFrame = false;
+				}
+				if (bFirstFrame)
+					NotifyState(MFP_MEDIAPLAYER_STATE_PLAYING);
+				hnsDue = hnsNow + hnsInterval;
+			}
+			hnsNow = Now();
+			hnsWait = hnsDue > hnsNow ? hnsDue - hnsNow : 0;
+		}
+		else {
+			// Resume from where the animation stopped, not from the pause.
+			hnsLastFrame = 0;
+			if (bOpen && bFull) {
+				if (bPending)
+					m_renderer.Render(hnsAnimation);
+				PresentFrame(hnsAnimation, true);
+			}
+		}
+
+		lock.lock();
+		if (!m_bStop && !m_bRedraw && !m_bPending && hnsWait > 0)
+			m_cv.wait_for(lock, std::chrono::microseconds(hnsWait / 10));
+	}
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "WallpaperPlayer.h"
+#include "GdiFramePresenter.h"
+#include "GenerativeRenderer.h"
+
+
+//-------------------------------------------------------------------
+//
+// GenerativePlayer class
+//
+// IWallpaperPlayer that plays no file: its clips are the names of
+// GenerativeRenderer effects ("plasma", "noise", "gradient",
+// "particles"), rendered on the CPU at the size of the video window and
+// drawn with GDI. Needs neither codecs nor a GPU.
+//
+// A render thread renders a frame every 1 / GENERATIVE_DEFAULT_FPS
+// seconds, or less often under a frame rate cap, and copies only the
+// tiles that changed when the frame is shown 1:1. The animation's time
+// advances while playing, at the rate; it never ends and cannot seek.
+//
+//-------------------------------------------------------------------
+
+class GenerativePlayer : public IWallpaperPlayer
+{
+public:
+	static HRESULT CreateInstance(PlayerEventQueue* pEvents, HWND hwndVideo, GenerativePlayer** ppPlayer);
+
+	STDMETHODIMP_(ULONG) AddRef() override;
+	STDMETHODIMP_(ULONG) Release() override;
+
+	// Fails if sURL names no effect.
+	HRESULT OpenURL(const WCHAR* sURL) override;
+	HRESULT OpenSource(IMFMediaSource*, const WCHAR*) override { return E_NOTIMPL; }
+
+	// There are no files to read, cache or index.
+	void SetLoopCacheBudget(size_t) override {}
+	void SetClipCache(ClipCache*) override {}
+	void SetIndexDirectory(const WCHAR*) override {}
+
+	void SetStats(PlaybackStats* pStats) override { m_pStats = pStats; }
+
+	HRESULT PrepareURL(const WCHAR* sURL) override;
+	bool IsPrepared() override;
+	HRESULT SwitchToPrepared() override;
+	void CancelPrepared() override;
+
+	HRESULT Shutdown() override;
+	MFP_MEDIAPLAYER_STATE GetState() noexcept override;
+	bool Play() noexcept override;
+	bool Pause() noexcept override;
+	bool Stop() noexcept override;
+	float GetVolume() noexcept override { return 0.0f; }
+	bool SetVolume(float fVolume) noexcept override { return fVolume == 0.0f; }
+	bool GetMute() noexcept override { return true; }
+	bool SetMute(bool bMute) noexcept override { return bMute; }
+	float GetRate() noexcept override;
+	bool SetRate(float fRate) noexcept override;
+
+	// Renders less often than GENERATIVE_DEFAULT_FPS if fFps is lower.
+	HRESULT SetMaxFrameRate(float fFps) override;
+
+	// Seeking
+	HRESULT GetDuration(MFTIME*) override { return MF_E_INVALIDREQUEST; }
+	HRESULT CanSeek(BOOL* pbCanSeek) override;
+	HRESULT GetCurrentPosition(MFTIME *phnsPosition) override;
+	HRESULT SetPosition(MFTIME) override { return MF_E_INVALIDREQUEST; }
+
+	// Video
+	HRESULT GetVideoSize(SIZE* pszVideo) override;
+	HRESULT SetViewports(const Viewport* pViewports, size_t cViewports, const SIZE& szSource) override;
+	void UpdateVideo() override;
+	HRESULT SetOverlay(OverlayCompositor* pOverlay) override;
+	void UpdateOverlay() override { m_presenter.PresentOverlay(); }
+
+	static HNSTIME Now();
+
+protected:
+	GenerativePlayer(PlayerEventQueue* pEvents, HWND hwndVideo);
+	virtual ~GenerativePlayer();
+
+	// NotifyState: Notifies the application when the state changes.
+	void NotifyState(MFP_MEDIAPLAYER_STATE state)
+	{
+		m_pEvents->Post(PLAYER_EVENT_STATE, (uint32_t)state);
+	}
+
+	// NotifyError: Notifies the application when an error occurs.
+	void NotifyError(HRESULT hr)
+	{
+		if (m_pStats)
+			m_pStats->Count(STATS_COUNTER_PLAYER_ERRORS);
+		m_pEvents->Post(PLAYER_EVENT_ERROR, 0, hr);
+	}
+
+	// NotifyRate: Notifies the application when the playback rate changed.
+	void NotifyRate()
+	{
+		m_pEvents->Post(PLAYER_EVENT_RATE);
+	}
+
+	// NotifyPrepared: Notifies the application when the prepared clip is ready or failed.
+	void NotifyPrepared(HRESULT hr)
+	{
+		m_pEvents->Post(PLAYER_EVENT_PREPARED, 0, hr);
+	}
+
+private:
+	SIZE GetWindowSize();
+	void RenderThread();
+	void PresentFrame(HNSTIME hnsTime, bool bFull);
+
+	long						m_cRef;			// Reference count
+	PlayerEventQueue*			m_pEvents;		// App queue to receive events.
+	PlaybackStats*				m_pStats;
+	HWND						m_hwndVideo;
+	GdiFramePresenter			m_presenter;
+
+	// Guarded by m_mutex.
+	std::mutex					m_mutex;
+	std::condition_variable		m_cv;
+	GENERATIVE_EFFECT			m_pending;		// Effect for the render thread to switch to
+	bool						m_bPending;
+	GENERATIVE_EFFECT			m_prepared;
+	bool						m_bPrepared;
+	MFP_MEDIAPLAYER_STATE		m_state;
+	bool						m_bRedraw;		// Present the current frame again
+	bool						m_bFirstFrame;	// Report PLAYING at the next frame shown
+	bool						m_bStop;
+	HNSTIME						m_hnsMinInterval;	// From the frame rate cap, 0 = none
+	float						m_fRate;
+	SIZE						m_szVideo;		// Of the effect rendered, or about to be
+	HNSTIME						m_hnsPosition;	// Animation time of the frame shown
+
+	// Render thread only.
+	GenerativeRenderer			m_renderer;
+
+	std::thread					m_thread;
+};
@@ -0,0 +1,777 @@
+#include "GenerativeRenderer.h"
+#include <math.h>
+#include <string.h>
+#include <chrono>
+
+static const double PI = 3.14159265358979323846;
+
+static const char* const s_effectNames[GENERATIVE_EFFECT_COUNT] = {
+	"plasma", "noise", "gradient", "particles"
+};
+
+const char* GetGenerativeEffectName(GENERATIVE_EFFECT effect)
+{
+	return effect >= 0 && effect < GENERATIVE_EFFECT_COUNT ? s_effectNames[effect] : "?";
+}
+
+bool FindGenerativeEffect(const std::wstring& name, GENERATIVE_EFFECT* pEffect)
+{
+	for (int i = 0; i < GENERATIVE_EFFECT_COUNT; i++) {
+		const char* psz = s_effectNames[i];
+		size_t n = 0;
+		for (; n < name.size() && psz[n]; n++) {
+			wchar_t ch = name[n];
+			if (ch >= L'A' && ch <= L'Z')
+				ch = (wchar_t)(ch - L'A' + L'a');
+			if (ch != (wchar_t)psz[n])
+				break;
+		}
+		if (n == name.size() && !psz[n]) {
+			*pEffect = (GENERATIVE_EFFECT)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static inline double Seconds(HNSTIME hnsTime)
+{
+	return (double)hnsTime / HNS_PER_SECOND;
+}
+
+static inline uint8_t RoundByte(double f)
+{
+	return (uint8_t)(f <= 0.0 ? 0 : f >= 255.0 ? 255 : (int)(f + 0.5));
+}
+
+static inline uint32_t PackColor(const double rgb[3])
+{
+	return (uint32_t)RoundByte(rgb[2]) | ((uint32_t)RoundByte(rgb[1]) << 8) | ((uint32_t)RoundByte(rgb[0]) << 16) |
+		0xFF000000u;
+}
+
+// Writes an 0xAARRGGBB color to a BGRA pixel.
+static inline void StoreColor(uint32_t nColor, uint8_t* p)
+{
+	p[0] = (uint8_t)nColor;
+	p[1] = (uint8_t)(nColor >> 8);
+	p[2] = (uint8_t)(nColor >> 16);
+	p[3] = (uint8_t)(nColor >> 24);
+}
+
+// Red, green and blue, 0-255, of a hue in turns at a saturation and value.
+static void HueColor(double fHue, double fSaturation, double fValue, double rgb[3])
+{
+	for (int c = 0; c < 3; c++) {
+		double f = fHue + (double)(2 - c) / 3.0;		// Red, green, blue a third of a turn apart
+		f -= floor(f);
+		double fWave = fabs(f * 6.0 - 3.0) - 1.0;
+		fWave = fWave < 0.0 ? 0.0 : fWave > 1.0 ? 1.0 : fWave;
+		rgb[c] = 255.0 * fValue * (1.0 - fSaturation + fSaturation * fWave);
+	}
+}
+
+static inline double Smoothstep(double f)
+{
+	return f * f * (3.0 - 2.0 * f);
+}
+
+// Well-mixed 32 bits of a lattice point or particle.
+static inline uint32_t Hash(uint32_t a, uint32_t b, uint32_t c)
+{
+	uint32_t h = a * 0x9E3779B1u ^ b * 0x85EBCA77u ^ c * 0xC2B2AE3Du;
+	h ^= h >> 15;
+	h *= 0x2C1B3C6Du;
+	h ^= h >> 12;
+	h *= 0x297A2D39u;
+	h ^= h >> 15;
+	return h;
+}
+
+// Fills the tiles' flags that rc, clipped to the frame, touches.
+static void MarkTiles(int32_t left, int32_t top, int32_t right, int32_t bottom, uint32_t cx, uint32_t cy,
+	uint32_t cTileColumns, uint8_t* pDirty)
+{
+	left = left > 0 ? left : 0;
+	top = top > 0 ? top : 0;
+	right = right < (int32_t)cx ? right : (int32_t)cx;
+	bottom = bottom < (int32_t)cy ? bottom : (int32_t)cy;
+	if (left >= right || top >= bottom)
+		return;
+	for (uint32_t ty = top / GENERATIVE_TILE_SIZE; ty <= (uint32_t)(bottom - 1) / GENERATIVE_TILE_SIZE; ty++) {
+		for (uint32_t tx = left / GENERATIVE_TILE_SIZE; tx <= (uint32_t)(right - 1) / GENERATIVE_TILE_SIZE; tx++)
+			pDirty[ty * cTileColumns + tx] = 1;
+	}
+}
+
+
+//********************* Effects **********************//
+
+//-------------------------------------------------------------------
+//
+// PlasmaEffect class
+//
+// v(x, y) = X(x) + D(x + y) + Y(y), three sine tables of up to 84 each
+// computed once per frame, through the triangle wave palette of the
+// pfnPlasmaRow kernel; the waves and the palette's phases move with
+// time. Every pixel changes every frame.
+//
+//-------------------------------------------------------------------
+
+class PlasmaEffect : public GenerativeEffect
+{
+public:
+	bool Init(uint32_t cx, uint32_t cy, uint32_t cTileColumns, uint32_t nSeed) override
+	{
+		(void)cTileColumns;
+		(void)nSeed;
+		m_cx = cx;
+		m_cy = cy;
+		m_xWave.resize(cx);
+		m_yWave.resize(cy);
+		m_diagonal.resize((size_t)cx + cy);
+		return true;
+	}
+
+	void BeginFrame(HNSTIME hnsTime, HNSTIME hnsLast, bool bFirst, uint8_t* pDirty) override
+	{
+		if (!bFirst && hnsTime == hnsLast)
+			return;
+		memset(pDirty, 1, ((m_cx + GENERATIVE_TILE_SIZE - 1) / GENERATIVE_TILE_SIZE) *
+			((m_cy + GENERATIVE_TILE_SIZE - 1) / GENERATIVE_TILE_SIZE));
+
+		// Wave lengths scale with the height, so any size shows the same picture.
+		double t = Seconds(hnsTime), fScale = 2.0 * PI / m_cy;
+		for (uint32_t x = 0; x < m_cx; x++)
+			m_xWave[x] = RoundByte(42.0 + 42.0 * sin(x * fScale * 1.3 + t * 0.55));
+		for (uint32_t y = 0; y < m_cy; y++)
+			m_yWave[y] = RoundByte(42.0 + 42.0 * sin(y * fScale * 1.7 - t * 0.4));
+		for (size_t i = 0; i < m_diagonal.size(); i++)
+			m_diagonal[i] = RoundByte(42.0 + 42.0 * sin(i * fScale * 0.9 + t * 0.3));
+
+		static const double s_speeds[3] = { 0.05, 0.07, 0.11 };	// Palette turns per second, B, G, R
+		for (int c = 0; c < 3; c++)
+			m_palette.nPhase[c] = (uint16_t)(((int64_t)(t * s_speeds[c] * 512.0) + c * 170) & 511);
+	}
+
+	void RenderTile(const LayoutRect& rc, uint8_t* pPixels, size_t cbStride, uint8_t*) override
+	{
+		const ColorKernelTable& kernels = GetColorKernels();
+		uint32_t cx = (uint32_t)(rc.right - rc.left);
+		for (int32_t y = rc.top; y < rc.bottom; y++, pPixels += cbStride) {
+			kernels.pfnPlasmaRow(m_xWave.data() + rc.left, m_diagonal.data() + y + rc.left, m_yWave[y], m_palette,
+				cx, pPixels);
+		}
+	}
+
+private:
+	uint32_t				m_cx;
+	uint32_t				m_cy;
+	std::vector<uint8_t>	m_xWave;
+	std::vector<uint8_t>	m_yWave;
+	std::vector<uint8_t>	m_diagonal;	// By x + y
+	PlasmaPalette			m_palette;
+};
+
+//-------------------------------------------------------------------
+//
+// NoiseEffect class
+//
+// Value noise: a lattice of random colors one cell apart, cross-faded
+// to the next random lattice every NOISE_PERIOD seconds and drifting
+// sideways. Each frame the lattice under the screen is computed once;
+// tiles upscale it with the bilinear row kernels, through smoothstep
+// weights so the cells do not show. Every pixel changes every frame.
+//
+//-------------------------------------------------------------------
+
+class NoiseEffect : public GenerativeEffect
+{
+public:
+	bool Init(uint32_t cx, uint32_t cy, uint32_t cTileColumns, uint32_t nSeed) override
+	{
+		(void)cTileColumns;
+		m_cx = cx;
+		m_cy = cy;
+		m_nSeed = nSeed;
+		m_cell = cy / 6 > 16 ? cy / 6 : 16;
+		m_cxLattice = cx / m_cell + 3;
+		m_cyLattice = cy / m_cell + 3;
+		m_lattice.resize((size_t)m_cxLattice * m_cyLattice * 4);
+		m_xTaps.resize(cx);
+		m_yTaps.resize(cy);
+		return true;
+	}
+
+	// A blended row of the lattice, plus the padding pixel of pfnBlendColumns.
+	size_t GetScratchSize() const override { return ((size_t)m_cxLattice + 1) * 4 * sizeof(int16_t); }
+
+	void BeginFrame(HNSTIME hnsTime, HNSTIME hnsLast, bool bFirst, uint8_t* pDirty) override
+	{
+		if (!bFirst && hnsTime == hnsLast)
+			return;
+		memset(pDirty, 1, ((m_cx + GENERATIVE_TILE_SIZE - 1) / GENERATIVE_TILE_SIZE) *
+			((m_cy + GENERATIVE_TILE_SIZE - 1) / GENERATIVE_TILE_SIZE));
+
+		double t = Seconds(hnsTime);
+		double fPeriods = t / NOISE_PERIOD;
+		uint32_t nPeriod = (uint32_t)(int64_t)floor(fPeriods);
+		double fFade = Smoothstep(fPeriods - floor(fPeriods));
+
+		// The screen's origin in lattice space.
+		double xOrigin = t * m_cell * 0.06, yOrigin = t * m_cell * 0.025;
+		int64_t xCell = (int64_t)floor(xOrigin / m_cell), yCell = (int64_t)floor(yOrigin / m_cell);
+		double xOffset = xOrigin - (double)xCell * m_cell, yOffset = yOrigin - (double)yCell * m_cell;
+
+		uint8_t* p = m_lattice.data();
+		for (uint32_t ly = 0; ly < m_cyLattice; ly++) {
+			for (uint32_t lx = 0; lx < m_cxLattice; lx++, p += 4) {
+				double from[3], to[3];
+				GetColor((uint32_t)(xCell + lx), (uint32_t)(yCell + ly), nPeriod, from);
+				GetColor((uint32_t)(xCell + lx), (uint32_t)(yCell + ly), nPeriod + 1, to);
+				for (int c = 0; c < 3; c++)
+					p[2 - c] = RoundByte(from[c] + (to[c] - from[c]) * fFade);
+				p[3] = 255;
+			}
+		}
+		SetTaps(xOffset, m_xTaps.data(), m_cx);
+		SetTaps(yOffset, m_yTaps.data(), m_cy);
+	}
+
+	void RenderTile(const LayoutRect& rc, uint8_t* pPixels, size_t cbStride, uint8_t* pScratch) override
+	{
+		const ColorKernelTable& kernels = GetColorKernels();
+		int16_t* pRow = (int16_t*)pScratch;
+		uint32_t cx = (uint32_t)(rc.right - rc.left);
+		uint32_t lxBegin = m_xTaps[rc.left].x0, lxEnd = m_xTaps[rc.right - 1].x0 + 2;
+		size_t cbLatticeRow = (size_t)m_cxLattice * 4;
+		for (int32_t y = rc.top; y < rc.bottom; y++, pPixels += cbStride) {
+			const BilinearTap& tap = m_yTaps[y];
+			const uint8_t* pA = m_lattice.data() + tap.x0 * cbLatticeRow + (size_t)lxBegin * 4;
+			kernels.pfnBlendRows(pA, pA + cbLatticeRow, tap.nWeight, pRow + (size_t)lxBegin * 4,
+				(size_t)(lxEnd - lxBegin) * 4);
+			kernels.pfnBlendColumns(pRow, m_xTaps.data() + rc.left, cx, pPixels);
+		}
+	}
+
+private:
+	static const double NOISE_PERIOD;
+
+	// Deep blues and violets with some teal, from the point's hash.
+	void GetColor(uint32_t lx, uint32_t ly, uint32_t nPeriod, double rgb[3]) const
+	{
+		uint32_t h = Hash(lx, ly, nPeriod ^ m_nSeed * 0x01000193u);
+		HueColor(0.5 + (h & 0xFF) / 255.0 * 0.35, 0.55 + ((h >> 8) & 0xFF) / 255.0 * 0.4,
+			0.15 + ((h >> 16) & 0xFF) / 255.0 * 0.6, rgb);
+	}
+
+	// Lattice point and weight of each pixel, a fraction of a cell in.
+	void SetTaps(double fOffset, BilinearTap* pTaps, uint32_t c) const
+	{
+		for (uint32_t i = 0; i < c; i++) {
+			double f = (i + fOffset) / m_cell;
+			double fCell = floor(f);
+			pTaps[i].x0 = (uint32_t)fCell;
+			pTaps[i].nWeight = (uint32_t)(Smoothstep(f - fCell) * (1 << BILINEAR_BITS) + 0.5);
+		}
+	}
+
+	uint32_t				m_cx;
+	uint32_t				m_cy;
+	uint32_t				m_nSeed;
+	uint32_t				m_cell;			// Pixels between lattice points
+	uint32_t				m_cxLattice;
+	uint32_t				m_cyLattice;
+	std::vector<uint8_t>	m_lattice;		// BGRA, of this frame
+	std::vector<BilinearTap>	m_xTaps;
+	std::vector<BilinearTap>	m_yTaps;	// x0 is the lattice row
+};
+
+const double NoiseEffect::NOISE_PERIOD = 6.0;
+
+//-------------------------------------------------------------------
+//
+// GradientEffect class
+//
+// A vertical gradient between two hues a third of a turn apart that go
+// round the color wheel every few minutes, with a slow wave in its
+// midpoint. It moves in steps of GRADIENT_STEP, which change a color by
+// a level or so: the frames between steps render nothing, and a step
+// renders only the rows of tiles where a row's color changed.
+//
+//-------------------------------------------------------------------
+
+class GradientEffect : public GenerativeEffect
+{
+public:
+	bool Init(uint32_t cx, uint32_t cy, uint32_t cTileColumns, uint32_t nSeed) override
+	{
+		m_cx = cx;
+		m_cy = cy;
+		m_cTileColumns = cTileColumns;
+		m_fHue = (nSeed % 360) / 360.0;
+		m_colors.resize(cy);
+		m_lastColors.resize(cy);
+		return true;
+	}
+
+	void BeginFrame(HNSTIME hnsTime, HNSTIME hnsLast, bool bFirst, uint8_t* pDirty) override
+	{
+		(void)hnsLast;
+		double t = Seconds(hnsTime - hnsTime % GRADIENT_STEP);
+		double top[3], bottom[3];
+		HueColor(m_fHue + t / 240.0, 0.65, 0.5, top);
+		HueColor(m_fHue + t / 240.0 + 0.33, 0.7, 0.3, bottom);
+		for (uint32_t y = 0; y < m_cy; y++) {
+			double f = (double)y / m_cy;
+			f += 0.08 * sin(2.0 * PI * (f * 1.3 + t / 50.0));
+			f = f < 0.0 ? 0.0 : f > 1.0 ? 1.0 : f;
+			double rgb[3];
+			for (int c = 0; c < 3; c++)
+				rgb[c] = top[c] + (bottom[c] - top[c]) * f;
+			m_colors[y] = PackColor(rgb);
+		}
+
+		for (uint32_t y = 0; y < m_cy; y += GENERATIVE_TILE_SIZE) {
+			uint32_t cRows = m_cy - y < GENERATIVE_TILE_SIZE ? m_cy - y : GENERATIVE_TILE_SIZE;
+			if (bFirst || memcmp(&m_colors[y], &m_lastColors[y], cRows * sizeof(uint32_t)) != 0)
+				memset(pDirty + (size_t)(y / GENERATIVE_TILE_SIZE) * m_cTileColumns, 1, m_cTileColumns);
+		}
+		m_lastColors.assign(m_colors.begin(), m_colors.end());
+	}
+
+	void RenderTile(const LayoutRect& rc, uint8_t* pPixels, size_t cbStride, uint8_t*) override
+	{
+		for (int32_t y = rc.top; y < rc.bottom; y++, pPixels += cbStride) {
+			uint8_t pixel[4];
+			StoreColor(m_colors[y], pixel);
+			for (int32_t x = 0; x < rc.right - rc.left; x++)
+				memcpy(pPixels + (size_t)x * 4, pixel, 4);
+		}
+	}
+
+private:
+	static const HNSTIME GRADIENT_STEP = HNS_PER_SECOND / 2;
+
+	uint32_t				m_cx;
+	uint32_t				m_cy;
+	uint32_t				m_cTileColumns;
+	double					m_fHue;			// Of the top at time 0, in turns
+	std::vector<uint32_t>	m_colors;		// Per row, 0xAARRGGBB
+	std::vector<uint32_t>	m_lastColors;	// Of the frame before
+};
+
+//-------------------------------------------------------------------
+//
+// ParticlesEffect class
+//
+// Soft discs rising slowly and swaying over a still dark gradient. Each
+// disc is a premultiplied sprite blended with the pfnBlendOver kernel,
+// and moves on a path that is a function of time. Only the tiles under
+// the discs that moved, at their old and new places, are rendered.
+//
+//-------------------------------------------------------------------
+
+class ParticlesEffect : public GenerativeEffect
+{
+public:
+	bool Init(uint32_t cx, uint32_t cy, uint32_t cTileColumns, uint32_t nSeed) override
+	{
+		m_cx = cx;
+		m_cy = cy;
+		m_cTileColumns = cTileColumns;
+
+		m_background.resize(cy);
+		for (uint32_t y = 0; y < cy; y++) {
+			double f = (double)y / cy, rgb[3];
+			HueColor(0.62 + 0.08 * f, 0.7, 0.12 + 0.16 * f, rgb);
+			m_background[y] = PackColor(rgb);
+		}
+
+		// Sprites of a few sizes and hues, shared by the particles.
+		m_sprites.resize(PARTICLE_SPRITES);
+		size_t cbSprites = 0;
+		for (uint32_t i = 0; i < PARTICLE_SPRITES; i++) {
+			Sprite& sprite = m_sprites[i];
+			uint32_t nRadius = cy * (6 + 4 * (i % 4)) / 1000;
+			nRadius = nRadius > 3 ? nRadius : 3;
+			sprite.cSize = 2 * nRadius + 1;
+			sprite.offset = cbSprites;
+			cbSprites += (size_t)sprite.cSize * sprite.cSize * 4;
+		}
+		m_spritePixels.resize(cbSprites);
+		for (uint32_t i = 0; i < PARTICLE_SPRITES; i++)
+			DrawSprite(m_sprites[i], Hash(i, nSeed, 7));
+
+		uint32_t cParticles = (uint32_t)((uint64_t)cx * cy / 40000);
+		cParticles = cParticles < 16 ? 16 : cParticles > 1024 ? 1024 : cParticles;
+		m_particles.resize(cParticles);
+		for (uint32_t i = 0; i < cParticles; i++) {
+			Particle& particle = m_particles[i];
+			uint32_t h = Hash(i, nSeed, 11), h2 = Hash(i, nSeed, 13);
+			particle.nSprite = h % PARTICLE_SPRITES;
+			particle.x0 = (double)(h2 & 0xFFFF) / 0xFFFF * cx;
+			particle.y0 = (double)(h2 >> 16) / 0xFFFF * cy;
+			particle.fSpeed = cy * (0.008 + 0.03 * ((h >> 8) & 0xFF) / 255.0);
+			particle.fSway = cy * 0.02 * ((h >> 16) & 0xFF) / 255.0;
+			particle.fSwayRate = 0.2 + 0.5 * (h >> 24) / 255.0;
+		}
+		m_rects.resize(cParticles);
+		m_lastRects.resize(cParticles);
+		return true;
+	}
+
+	void BeginFrame(HNSTIME hnsTime, HNSTIME hnsLast, bool bFirst, uint8_t* pDirty) override
+	{
+		(void)hnsLast;
+		double t = Seconds(hnsTime);
+		for (size_t i = 0; i < m_particles.size(); i++) {
+			const Particle& particle = m_particles[i];
+			int32_t cSize = (int32_t)m_sprites[particle.nSprite].cSize;
+
+			// Rises and wraps from the top to below the bottom edge.
+			double fSpan = (double)m_cy + cSize;
+			double y = particle.y0 - particle.fSpeed * t;
+			y -= floor(y / fSpan) * fSpan;
+			double x = particle.x0 + particle.fSway * sin(t * particle.fSwayRate + i);
+
+			LayoutRect& rc = m_rects[i];
+			rc.left = (int32_t)floor(x) - cSize / 2;
+			rc.top = (int32_t)floor(y) - cSize;
+			rc.right = rc.left + cSize;
+			rc.bottom = rc.top + cSize;
+
+			const LayoutRect& last = m_lastRects[i];
+			if (bFirst || rc.left != last.left || rc.top != last.top) {
+				MarkTiles(rc.left, rc.top, rc.right, rc.bottom, m_cx, m_cy, m_cTileColumns, pDirty);
+				if (!bFirst)
+					MarkTiles(last.left, last.top, last.right, last.bottom, m_cx, m_cy, m_cTileColumns, pDirty);
+			}
+		}
+		if (bFirst)
+			memset(pDirty, 1, (size_t)m_cTileColumns * ((m_cy + GENERATIVE_TILE_SIZE - 1) / GENERATIVE_TILE_SIZE));
+		m_lastRects.assign(m_rects.begin(), m_rects.end());
+	}
+
+	void RenderTile(const LayoutRect& rc, uint8_t* pPixels, size_t cbStride, uint8_t*) override
+	{
+		uint8_t* pRow = pPixels;
+		for (int32_t y = rc.top; y < rc.bottom; y++, pRow += cbStride) {
+			uint8_t pixel[4];
+			StoreColor(m_background[y], pixel);
+			for (int32_t x = 0; x < rc.right - rc.left; x++)
+				memcpy(pRow + (size_t)x * 4, pixel, 4);
+		}
+
+		// In a fixed order, so overlapping discs blend the same in every tile.
+		const ColorKernelTable& kernels = GetColorKernels();
+		for (size_t i = 0; i < m_particles.size(); i++) {
+			const LayoutRect& disc = m_rects[i];
+			int32_t left = disc.left > rc.left ? disc.left : rc.left;
+			int32_t right = disc.right < rc.right ? disc.right : rc.right;
+			int32_t top = disc.top > rc.top ? disc.top : rc.top;
+			int32_t bottom = disc.bottom < rc.bottom ? disc.bottom : rc.bottom;
+			if (left >= right || top >= bottom)
+				continue;
+			const Sprite& sprite = m_sprites[m_particles[i].nSprite];
+			const uint8_t* pSprite = m_spritePixels.data() + sprite.offset;
+			for (int32_t y = top; y < bottom; y++) {
+				kernels.pfnBlendOver(pSprite + ((size_t)(y - disc.top) * sprite.cSize + (left - disc.left)) * 4,
+					pPixels + (size_t)(y - rc.top) * cbStride + (size_t)(left - rc.left) * 4, (uint32_t)(right - left));
+			}
+		}
+	}
+
+private:
+	static const uint32_t PARTICLE_SPRITES = 8;
+
+	struct Sprite
+	{
+		size_t		offset;		// In m_spritePixels
+		uint32_t	cSize;		// Width and height
+	};
+
+	struct Particle
+	{
+		uint32_t	nSprite;
+		double		x0;			// Center at time 0
+		double		y0;			// Bottom at time 0
+		double		fSpeed;		// Pixels per second upwards
+		double		fSway;		// Pixels either side
+		double		fSwayRate;	// Radians per second
+	};
+
+	// A disc whose alpha falls off smoothly to its edge, premultiplied.
+	void DrawSprite(const Sprite& sprite, uint32_t nHash)
+	{
+		double rgb[3];
+		HueColor(0.45 + 0.5 * (nHash & 0xFF) / 255.0, 0.45, 1.0, rgb);
+		double fRadius = sprite.cSize / 2.0;
+		uint8_t* p = m_spritePixels.data() + sprite.offset;
+		for (uint32_t y = 0; y < sprite.cSize; y++) {
+			for (uint32_t x = 0; x < sprite.cSize; x++, p += 4) {
+				double dx = (x + 0.5 - fRadius) / fRadius, dy = (y + 0.5 - fRadius) / fRadius;
+				double f = 1.0 - (dx * dx + dy * dy);
+				double fAlpha = f > 0.0 ? 0.85 * f * f : 0.0;
+				uint8_t nAlpha = RoundByte(255.0 * fAlpha);
+				for (int c = 0; c < 3; c++)
+					p[2 - c] = (uint8_t)(RoundByte(rgb[c]) * nAlpha / 255);
+				p[3] = nAlpha;
+			}
+		}
+	}
+
+	uint32_t				m_cx;
+	uint32_t				m_cy;
+	uint32_t				m_cTileColumns;
+	std::vector<uint32_t>	m_background;	// Per row, 0xAARRGGBB
+	std::vector<Sprite>		m_sprites;
+	std::vector<uint8_t>	m_spritePixels;
+	std::vector<Particle>	m_particles;
+	std::vector<LayoutRect>	m_rects;		// Of this frame
+	std::vector<LayoutRect>	m_lastRects;	// Of the frame before
+};
+
+static GenerativeEffect* CreateEffect(GENERATIVE_EFFECT effect)
+{
+	switch (effect) {
+	case GENERATIVE_EFFECT_PLASMA:
+		return new PlasmaEffect();
+	case GENERATIVE_EFFECT_NOISE:
+		return new NoiseEffect();
+	case GENERATIVE_EFFECT_GRADIENT:
+		return new GradientEffect();
+	case GENERATIVE_EFFECT_PARTICLES:
+		return new ParticlesEffect();
+	default:
+		return nullptr;
+	}
+}
+
+
+//********************* Renderer **********************//
+
+GenerativeRenderer::GenerativeRenderer() : m_cx(0), m_cy(0), m_cTileColumns(0), m_cTileRows(0), m_cDirty(0),
+m_cbScratch(0), m_hnsLast(0), m_bFirst(true), m_nGeneration(0), m_cBusy(0), m_bStop(false), m_nNextTile(0)
+{
+}
+
+GenerativeRenderer::~GenerativeRenderer()
+{
+	StopWorkers();
+}
+
+void GenerativeRenderer::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStop = true;
+	}
+	m_cvWork.notify_all();
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i].join();
+	m_threads.clear();
+	m_bStop = false;
+}
+
+bool GenerativeRenderer::Init(const GenerativeConfig& config)
+{
+	StopWorkers();
+	m_pEffect.reset(CreateEffect(config.effect));
+	if (!m_pEffect || config.cx == 0 || config.cy == 0)
+		return false;
+
+	m_cx = config.cx;
+	m_cy = config.cy;
+	m_cTileColumns = (m_cx + GENERATIVE_TILE_SIZE - 1) / GENERATIVE_TILE_SIZE;
+	m_cTileRows = (m_cy + GENERATIVE_TILE_SIZE - 1) / GENERATIVE_TILE_SIZE;
+	if (!m_pEffect->Init(m_cx, m_cy, m_cTileColumns, config.nSeed))
+		return false;
+
+	uint32_t cTiles = m_cTileColumns * m_cTileRows;
+	m_pixels.assign((size_t)m_cx * m_cy * 4, 0);
+	m_dirty.assign(cTiles, 0);
+	m_dirtyTiles.assign(cTiles, 0);
+	m_cDirty = 0;
+	m_hnsLast = 0;
+	m_bFirst = true;
+
+	uint32_t cThreads = config.cThreads ? config.cThreads : std::thread::hardware_concurrency();
+	cThreads = cThreads < 1 ? 1 : cThreads > GENERATIVE_MAX_THREADS ? GENERATIVE_MAX_THREADS : cThreads;
+	cThreads = cThreads < cTiles ? cThreads : cTiles;
+	m_cbScratch = (m_pEffect->GetScratchSize() + 63) & ~(size_t)63;
+	m_scratch.assign(m_cbScratch * cThreads, 0);
+
+	m_nGeneration = 0;
+	m_cBusy = 0;
+	for (uint32_t i = 1; i < cThreads; i++)
+		m_threads.push_back(std::thread(&GenerativeRenderer::WorkerThread, this, i));
+	return true;
+}
+
+LayoutRect GenerativeRenderer::GetTileRect(uint32_t nTile) const
+{
+	LayoutRect rc;
+	rc.left = (int32_t)((nTile % m_cTileColumns) * GENERATIVE_TILE_SIZE);
+	rc.top = (int32_t)((nTile / m_cTileColumns) * GENERATIVE_TILE_SIZE);
+	rc.right = rc.left + (int32_t)GENERATIVE_TILE_SIZE < (int32_t)m_cx ? rc.left + (int32_t)GENERATIVE_TILE_SIZE : (int32_t)m_cx;
+	rc.bottom = rc.top + (int32_t)GENERATIVE_TILE_SIZE < (int32_t)m_cy ? rc.top + (int32_t)GENERATIVE_TILE_SIZE : (int32_t)m_cy;
+	return rc;
+}
+
+void GenerativeRenderer::RenderTiles(uint8_t* pScratch)
+{
+	size_t cbStride = GetStride();
+	for (;;) {
+		uint32_t n = m_nNextTile.fetch_add(1, std::memory_order_relaxed);
+		if (n >= m_cDirty)
+			break;
+		LayoutRect rc = GetTileRect(m_dirtyTiles[n]);
+		m_pEffect->RenderTile(rc, m_pixels.data() + rc.top * cbStride + (size_t)rc.left * 4, cbStride, pScratch);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Render
+//
+// The effect prepares the frame and flags its changed tiles on this
+// thread; the workers and this thread then render the flagged tiles.
+// A frame of one tile, or a renderer of one thread, wakes no one.
+//-----------------------------------------------------------------------------
+
+uint32_t GenerativeRenderer::Render(HNSTIME hnsTime)
+{
+	if (!m_pEffect || m_pixels.empty())
+		return 0;
+
+	memset(m_dirty.data(), 0, m_dirty.size());
+	m_pEffect->BeginFrame(hnsTime, m_hnsLast, m_bFirst, m_dirty.data());
+	m_hnsLast = hnsTime;
+	m_bFirst = false;
+	m_cDirty = 0;
+	for (uint32_t i = 0; i < (uint32_t)m_dirty.size(); i++) {
+		if (m_dirty[i])
+			m_dirtyTiles[m_cDirty++] = i;
+	}
+	m_nNextTile.store(0, std::memory_order_relaxed);
+
+	if (m_cDirty > 1 && !m_threads.empty()) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_nGeneration++;
+			m_cBusy = (uint32_t)m_threads.size();
+		}
+		m_cvWork.notify_all();
+		RenderTiles(m_scratch.data());
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cvDone.wait(lock, [this] { return m_cBusy == 0; });
+	}
+	else {
+		RenderTiles(m_scratch.data());
+	}
+	return m_cDirty;
+}
+
+void GenerativeRenderer::WorkerThread(uint32_t nWorker)
+{
+	uint8_t* pScratch = m_scratch.data() + m_cbScratch * nWorker;
+	uint64_t nGeneration = 0;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		m_cvWork.wait(lock, [&] { return m_bStop || m_nGeneration != nGeneration; });
+		if (m_bStop)
+			break;
+		nGeneration = m_nGeneration;
+		lock.unlock();
+		RenderTiles(pScratch);
+		lock.lock();
+		if (--m_cBusy == 0)
+			m_cvDone.notify_one();
+	}
+}
+
+GenerativeFrameStats GenerativeRenderer::GetFrameStats() const
+{
+	GenerativeFrameStats stats;
+	stats.cTiles = (uint32_t)m_dirty.size();
+	stats.cDirtyTiles = m_cDirty;
+	return stats;
+}
+
+size_t GenerativeRenderer::GetDirtyRects(LayoutRect* pDirty, size_t cMaxDirty) const
+{
+	size_t cDirty = 0;
+	for (uint32_t n = 0; n < m_cDirty && cMaxDirty > 0;) {
+		// A run of dirty tiles in one row of tiles.
+		uint32_t nTile = m_dirtyTiles[n], nEnd = n + 1;
+		while (nEnd < m_cDirty && m_dirtyTiles[nEnd] == m_dirtyTiles[nEnd - 1] + 1 &&
+			m_dirtyTiles[nEnd] % m_cTileColumns != 0)
+			nEnd++;
+		LayoutRect rc = GetTileRect(nTile);
+		rc.right = GetTileRect(m_dirtyTiles[nEnd - 1]).right;
+		n = nEnd;
+
+		bool bMerged = false;
+		for (size_t i = 0; i < cDirty && !bMerged; i++) {
+			LayoutRect& prior = pDirty[i];
+			if (prior.left == rc.left && prior.right == rc.right && prior.bottom == rc.top) {
+				prior.bottom = rc.bottom;
+				bMerged = true;
+			}
+		}
+		if (bMerged)
+			continue;
+		if (cDirty < cMaxDirty) {
+			pDirty[cDirty++] = rc;
+		}
+		else {
+			LayoutRect& last = pDirty[cDirty - 1];
+			last.left = rc.left < last.left ? rc.left : last.left;
+			last.top = rc.top < last.top ? rc.top : last.top;
+			last.right = rc.right > last.right ? rc.right : last.right;
+			last.bottom = rc.bottom > last.bottom ? rc.bottom : last.bottom;
+		}
+	}
+	return cDirty;
+}
+
+
+//********************* Benchmark **********************//
+
+bool RunGenerativeBench(GENERATIVE_EFFECT effect, uint32_t cx, uint32_t cy, uint32_t cThreads, uint32_t cFrames,
+	GenerativeBenchResult* pResult)
+{
+	GenerativeConfig config;
+	config.effect = effect;
+	config.cx = cx;
+	config.cy = cy;
+	config.cThreads = cThreads;
+	GenerativeRenderer renderer;
+	if (!renderer.Init(config))
+		return false;
+	if (!cFrames)
+		cFrames = 1;
+
+	const HNSTIME hnsFrame = HNS_PER_SECOND / GENERATIVE_DEFAULT_FPS;
+	renderer.Render(0);
+	uint64_t cDirty = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t i = 1; i <= cFrames; i++)
+		cDirty += renderer.Render(i * hnsFrame);
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	// FNV-1a
+	uint64_t nChecksum = 14695981039346656037ull;
+	const uint8_t* p = renderer.GetPixels();
+	for (size_t i = 0; i < (size_t)cx * cy * 4; i++)
+		nChecksum = (nChecksum ^ p[i]) * 1099511628211ull;
+
+	pResult->effect = effect;
+	pResult->cx = cx;
+	pResult->cy = cy;
+	pResult->cThreads = renderer.GetThreadCount();
+	pResult->fFrameMs = elapsed.count() / cFrames;
+	pResult->fDirtyShare = (double)cDirty / ((double)renderer.GetFrameStats().cTiles * cFrames);
+	pResult->nChecksum = nChecksum;
+	return true;
+}
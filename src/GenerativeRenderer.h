@@ -0,0 +1,185 @@
+#pragma once
+#include "ColorKernels.h"
+#include "MonitorLayout.h"
+#include "PlaybackClock.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+const uint32_t	GENERATIVE_TILE_SIZE = 64;			// Tiles are squares of this many pixels, smaller at the edges
+const uint32_t	GENERATIVE_DEFAULT_FPS = 15;		// Frames per second of a generative wallpaper
+const uint32_t	GENERATIVE_MAX_THREADS = 64;
+
+enum GENERATIVE_EFFECT
+{
+	GENERATIVE_EFFECT_PLASMA = 0,		// Sums of moving sine waves through a cycling palette
+	GENERATIVE_EFFECT_NOISE,			// A drifting field of smoothly interpolated random colors
+	GENERATIVE_EFFECT_GRADIENT,			// A vertical gradient whose colors shift over minutes
+	GENERATIVE_EFFECT_PARTICLES,		// Soft discs drifting over a still background
+	GENERATIVE_EFFECT_COUNT
+};
+
+const char* GetGenerativeEffectName(GENERATIVE_EFFECT effect);
+
+// Effect of a name such as "plasma", in any case; false if there is none.
+bool FindGenerativeEffect(const std::wstring& name, GENERATIVE_EFFECT* pEffect);
+
+struct GenerativeConfig
+{
+	GENERATIVE_EFFECT	effect;
+	uint32_t			cx;
+	uint32_t			cy;
+	uint32_t			cThreads;		// 0 = one per core, up to GENERATIVE_MAX_THREADS
+	uint32_t			nSeed;			// Of the noise lattice and the particles
+
+	GenerativeConfig() : effect(GENERATIVE_EFFECT_PLASMA), cx(0), cy(0), cThreads(0), nSeed(1) {}
+};
+
+
+//-------------------------------------------------------------------
+//
+// GenerativeEffect interface
+//
+// One animation of a GenerativeRenderer. Its pixels are a function of
+// the time alone, so a tile rendered at a time is the same whichever
+// thread renders it and whatever was rendered before.
+//
+//-------------------------------------------------------------------
+
+class GenerativeEffect
+{
+public:
+	virtual ~GenerativeEffect() {}
+
+	// Sets the effect up for a cx x cy frame split into tiles, cTileColumns
+	// per row; every allocation happens here.
+	virtual bool Init(uint32_t cx, uint32_t cy, uint32_t cTileColumns, uint32_t nSeed) = 0;
+
+	// Bytes of scratch memory each rendering thread needs.
+	virtual size_t GetScratchSize() const { return 0; }
+
+	// Prepares the frame at hnsTime on the calling thread and sets the
+	// flag of every tile whose pixels differ from those at hnsLast, the
+	// time of the frame before. bFirst: there was none.
+	virtual void BeginFrame(HNSTIME hnsTime, HNSTIME hnsLast, bool bFirst, uint8_t* pDirty) = 0;
+
+	// Renders a tile of the frame prepared by BeginFrame into pPixels,
+	// which point at the tile's top left pixel. Runs on several threads
+	// at once, each with its own scratch.
+	virtual void RenderTile(const LayoutRect& rc, uint8_t* pPixels, size_t cbStride, uint8_t* pScratch) = 0;
+};
+
+
+struct GenerativeFrameStats
+{
+	uint32_t	cTiles;
+	uint32_t	cDirtyTiles;	// Rendered by the last Render
+};
+
+
+//-------------------------------------------------------------------
+//
+// GenerativeRenderer class
+//
+// Renders a procedural animation into a BGRA frame of its own on the
+// CPU, without a GPU or shaders. The frame is split into tiles of
+// GENERATIVE_TILE_SIZE pixels; each Render asks the effect which tiles
+// change and renders only those, spread over a set of worker threads
+// and the calling thread, which take the next tile from a shared
+// counter. The effects' inner loops run on the SIMD row kernels of
+// GetColorKernels().
+//
+// Rendering is deterministic: any thread count, instruction set or
+// sequence of earlier frames gives the same pixels for a time.
+// Render allocates nothing; the workers stop with the renderer.
+//
+// One thread at a time calls Render and reads the frame.
+//
+//-------------------------------------------------------------------
+
+class GenerativeRenderer
+{
+public:
+	GenerativeRenderer();
+	~GenerativeRenderer();
+
+	// Allocates the frame, sets the effect up and starts the workers.
+	bool Init(const GenerativeConfig& config);
+
+	// Renders the frame at hnsTime; returns the number of tiles rendered.
+	uint32_t Render(HNSTIME hnsTime);
+
+	const uint8_t* GetPixels() const { return m_pixels.data(); }
+	size_t GetStride() const { return (size_t)m_cx * 4; }
+	uint32_t GetWidth() const { return m_cx; }
+	uint32_t GetHeight() const { return m_cy; }
+	uint32_t GetThreadCount() const { return (uint32_t)m_threads.size() + 1; }
+	GenerativeFrameStats GetFrameStats() const;
+
+	// Rectangles covering the tiles the last Render changed: runs of
+	// neighboring tiles in a row of tiles, merged with the same run in the
+	// rows below. Writes up to cMaxDirty, merging the rest into the last
+	// one, and returns their number.
+	size_t GetDirtyRects(LayoutRect* pDirty, size_t cMaxDirty) const;
+
+private:
+	void StopWorkers();
+	void WorkerThread(uint32_t nWorker);
+	void RenderTiles(uint8_t* pScratch);
+	LayoutRect GetTileRect(uint32_t nTile) const;
+
+	std::unique_ptr<GenerativeEffect>	m_pEffect;
+	uint32_t				m_cx;
+	uint32_t				m_cy;
+	uint32_t				m_cTileColumns;
+	uint32_t				m_cTileRows;
+	std::vector<uint8_t>	m_pixels;
+	std::vector<uint8_t>	m_dirty;		// Per tile, set by the effect
+	std::vector<uint32_t>	m_dirtyTiles;	// Indexes of the tiles to render, m_cDirty of them
+	uint32_t				m_cDirty;
+	std::vector<uint8_t>	m_scratch;		// Per thread, m_cbScratch each
+	size_t					m_cbScratch;
+	HNSTIME					m_hnsLast;
+	bool					m_bFirst;		// Nothing rendered yet
+
+	// The workers wait for a new m_nGeneration, then take tiles from
+	// m_nNextTile; the last one done wakes Render.
+	std::mutex				m_mutex;
+	std::condition_variable	m_cvWork;
+	std::condition_variable	m_cvDone;
+	uint64_t				m_nGeneration;
+	uint32_t				m_cBusy;		// Workers still rendering the generation
+	bool					m_bStop;
+	std::atomic<uint32_t>	m_nNextTile;
+	std::vector<std::thread>	m_threads;
+};
+
+
+//********************* Benchmark **********************//
+
+struct GenerativeBenchResult
+{
+	GENERATIVE_EFFECT	effect;
+	uint32_t			cx;
+	uint32_t			cy;
+	uint32_t			cThreads;
+	double				fFrameMs;		// Render per frame, at GENERATIVE_DEFAULT_FPS steps
+	double				fDirtyShare;	// Of the tiles, rendered per frame
+	uint64_t			nChecksum;		// Of the last frame, the same for every thread count
+};
+
+//-------------------------------------------------------------------
+// RunGenerativeBench
+//
+// Renders cFrames frames of an effect, one GENERATIVE_DEFAULT_FPS frame
+// time apart, at cx x cy on cThreads threads, after a first full frame
+// that is not counted.
+//-------------------------------------------------------------------
+
+bool RunGenerativeBench(GENERATIVE_EFFECT effect, uint32_t cx, uint32_t cy, uint32_t cThreads, uint32_t cFrames,
+	GenerativeBenchResult* pResult);
@@ -0,0 +1,277 @@
+#include "pch.h"
+#include "GovernorSignals.h"
+#include <shellapi.h>
+#include <wtsapi32.h>
+#include <dwmapi.h>
+
+#pragma comment(lib, "wtsapi32.lib")
+#pragma comment(lib, "dwmapi.lib")
+
+
+HWND GovernorSignals::s_hWndNotify = NULL;
+
+// Monitors tracked by the occlusion scan.
+static const int MAX_MONITORS = 16;
+
+struct OcclusionScan
+{
+	HMONITOR	hMonitors[MAX_MONITORS];
+	int			cCovered;
+};
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+GovernorSignals::GovernorSignals(PlaybackGovernor* pGovernor) : m_pGovernor(pGovernor),
+m_hWnd(NULL), m_hAcDc(NULL), m_hSaver(NULL), m_hForegroundHook(NULL), m_hMinimizeHook(NULL),
+m_bSession(false)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+
+GovernorSignals::~GovernorSignals()
+{
+	Unregister();
+}
+
+HNSTIME GovernorSignals::GetTime()
+{
+	return (HNSTIME)GetTickCount64() * HNS_PER_MSEC;
+}
+
+//-----------------------------------------------------------------------------
+// Register
+//
+// Subscribes hWnd to session and power notifications and hooks foreground
+// changes. Windows sends the current power state right after registering.
+//-----------------------------------------------------------------------------
+
+bool GovernorSignals::Register(HWND hWnd)
+{
+	m_hWnd = hWnd;
+	s_hWndNotify = hWnd;
+	m_pGovernor->Reset(GetTime());
+
+	m_bSession = WTSRegisterSessionNotification(hWnd, NOTIFY_FOR_THIS_SESSION) != FALSE;
+	m_hAcDc = RegisterPowerSettingNotification(hWnd, &GUID_ACDC_POWER_SOURCE, DEVICE_NOTIFY_WINDOW_HANDLE);
+	m_hSaver = RegisterPowerSettingNotification(hWnd, &GUID_POWER_SAVING_STATUS, DEVICE_NOTIFY_WINDOW_HANDLE);
+
+	m_hForegroundHook = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, NULL,
+		WinEventProc, 0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+	m_hMinimizeHook = SetWinEventHook(EVENT_SYSTEM_MINIMIZESTART, EVENT_SYSTEM_MINIMIZEEND, NULL,
+		WinEventProc, 0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+
+	CheckForeground();
+	return m_bSession && m_hAcDc && m_hForegroundHook;
+}
+
+void GovernorSignals::Unregister()
+{
+	if (m_hForegroundHook) {
+		UnhookWinEvent(m_hForegroundHook);
+		m_hForegroundHook = NULL;
+	}
+	if (m_hMinimizeHook) {
+		UnhookWinEvent(m_hMinimizeHook);
+		m_hMinimizeHook = NULL;
+	}
+	if (m_hAcDc) {
+		UnregisterPowerSettingNotification(m_hAcDc);
+		m_hAcDc = NULL;
+	}
+	if (m_hSaver) {
+		UnregisterPowerSettingNotification(m_hSaver);
+		m_hSaver = NULL;
+	}
+	if (m_bSession) {
+		WTSUnRegisterSessionNotification(m_hWnd);
+		m_bSession = false;
+	}
+	if (m_hWnd)
+		KillTimer(m_hWnd, IDT_GOVERNOR);
+	s_hWndNotify = NULL;
+}
+
+bool GovernorSignals::OnMessage(UINT message, WPARAM wParam, LPARAM lParam)
+{
+	switch (message) {
+	case WM_WTSSESSION_CHANGE:
+		switch (wParam) {
+		case WTS_SESSION_LOCK:
+		case WTS_CONSOLE_DISCONNECT:
+		case WTS_REMOTE_DISCONNECT:
+			return Feed(GOVERNOR_SIGNAL_SESSION_LOCKED, true);
+		case WTS_SESSION_UNLOCK:
+		case WTS_CONSOLE_CONNECT:
+		case WTS_REMOTE_CONNECT:
+			return Feed(GOVERNOR_SIGNAL_SESSION_LOCKED, false);
+		}
+		break;
+
+	case WM_POWERBROADCAST:
+		if (wParam == PBT_POWERSETTINGCHANGE) {
+			POWERBROADCAST_SETTING* pSetting = (POWERBROADCAST_SETTING*)lParam;
+			if (pSetting->DataLength < sizeof(DWORD))
+				break;
+			DWORD dwValue = *(DWORD*)pSetting->Data;
+			if (IsEqualGUID(pSetting->PowerSetting, GUID_ACDC_POWER_SOURCE))
+				return Feed(GOVERNOR_SIGNAL_ON_BATTERY, dwValue != PoAc);
+			if (IsEqualGUID(pSetting->PowerSetting, GUID_POWER_SAVING_STATUS))
+				return Feed(GOVERNOR_SIGNAL_BATTERY_SAVER, dwValue != 0);
+		}
+		break;
+
+	case WM_APP_FOREGROUND:
+		return CheckForeground();
+
+	case WM_TIMER:
+		if (wParam == IDT_GOVERNOR) {
+			KillTimer(m_hWnd, IDT_GOVERNOR);
+			bool bChanged = m_pGovernor->Advance(GetTime());
+			ArmDeadline();
+			return bChanged;
+		}
+		break;
+	}
+	return false;
+}
+
+bool GovernorSignals::Feed(GOVERNOR_SIGNAL signal, bool bActive)
+{
+	if (m_pGovernor->IsSignalActive(signal) == bActive)
+		return false;
+
+	GovernorEvent event = { GetTime(), signal, bActive };
+	bool bChanged = m_pGovernor->OnEvent(event);
+	ArmDeadline();
+	return bChanged;
+}
+
+//-----------------------------------------------------------------------------
+// ArmDeadline
+//
+// Arms the one-shot timer for the pending governor change, if any.
+//-----------------------------------------------------------------------------
+
+void GovernorSignals::ArmDeadline()
+{
+	HNSTIME hnsDeadline = m_pGovernor->GetDeadline();
+	if (hnsDeadline < 0) {
+		KillTimer(m_hWnd, IDT_GOVERNOR);
+		return;
+	}
+
+	HNSTIME hnsDelay = hnsDeadline - GetTime();
+	UINT uElapse = hnsDelay > 0 ? (UINT)((hnsDelay + HNS_PER_MSEC - 1) / HNS_PER_MSEC) : 0;
+	if (uElapse < USER_TIMER_MINIMUM)
+		uElapse = USER_TIMER_MINIMUM;
+	SetTimer(m_hWnd, IDT_GOVERNOR, uElapse, NULL);
+}
+
+//-----------------------------------------------------------------------------
+// EnumCoveringProc
+//
+// Marks the monitor of every visible top-level window that is maximized
+// or covers its whole monitor. Windows are enumerated top to bottom.
+//-----------------------------------------------------------------------------
+
+static BOOL CALLBACK EnumCoveringProc(HWND hWnd, LPARAM lParam)
+{
+	OcclusionScan* pScan = (OcclusionScan*)lParam;
+
+	if (!IsWindowVisible(hWnd) || IsIconic(hWnd))
+		return TRUE;
+	if (GetWindowLongPtr(hWnd, GWL_EXSTYLE) & WS_EX_TOOLWINDOW)
+		return TRUE;
+
+	// Suspended store apps and windows on other virtual desktops are cloaked.
+	DWORD dwCloaked = 0;
+	if (SUCCEEDED(DwmGetWindowAttribute(hWnd, DWMWA_CLOAKED, &dwCloaked, sizeof(dwCloaked))) && dwCloaked)
+		return TRUE;
+
+	HMONITOR hMonitor = MonitorFromWindow(hWnd, MONITOR_DEFAULTTONULL);
+	if (!hMonitor)
+		return TRUE;
+
+	bool bCovers = IsZoomed(hWnd) != FALSE;
+	if (!bCovers) {
+		MONITORINFO mi = { sizeof(mi) };
+		RECT rc;
+		if (GetMonitorInfo(hMonitor, &mi) && GetWindowRect(hWnd, &rc))
+			bCovers = rc.left <= mi.rcMonitor.left && rc.top <= mi.rcMonitor.top &&
+				rc.right >= mi.rcMonitor.right && rc.bottom >= mi.rcMonitor.bottom;
+	}
+	if (!bCovers)
+		return TRUE;
+
+	// The desktop itself covers every monitor.
+	WCHAR szClass[32];
+	if (GetClassNameW(hWnd, szClass, ARRAYSIZE(szClass)) &&
+		(wcscmp(szClass, L"Progman") == 0 || wcscmp(szClass, L"WorkerW") == 0))
+		return TRUE;
+
+	for (int i = 0; i < pScan->cCovered; i++) {
+		if (pScan->hMonitors[i] == hMonitor)
+			return TRUE;
+	}
+	if (pScan->cCovered < MAX_MONITORS)
+		pScan->hMonitors[pScan->cCovered++] = hMonitor;
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// CheckForeground
+//
+// Re-evaluates the fullscreen and occlusion signals after the foreground
+// window changed or a window was minimized or restored.
+//-----------------------------------------------------------------------------
+
+bool GovernorSignals::CheckForeground()
+{
+	bool bChanged = false;
+
+	QUERY_USER_NOTIFICATION_STATE state = QUNS_ACCEPTS_NOTIFICATIONS;
+	if (SUCCEEDED(SHQueryUserNotificationState(&state))) {
+		bool bFullscreen = state == QUNS_BUSY || state == QUNS_RUNNING_D3D_FULL_SCREEN ||
+			state == QUNS_PRESENTATION_MODE;
+		bChanged |= Feed(GOVERNOR_SIGNAL_FULLSCREEN, bFullscreen);
+	}
+
+	OcclusionScan scan = { { 0 }, 0 };
+	EnumWindows(EnumCoveringProc, (LPARAM)&scan);
+	int cMonitors = GetSystemMetrics(SM_CMONITORS);
+	bChanged |= Feed(GOVERNOR_SIGNAL_OCCLUDED, cMonitors > 0 && scan.cCovered >= cMonitors);
+
+	return bChanged;
+}
+
+//-----------------------------------------------------------------------------
+// WinEventProc
+//
+// Out-of-context hook, called on this thread from the message loop. The
+// check is deferred to a posted message so bursts of events coalesce.
+//-----------------------------------------------------------------------------
+
+void CALLBACK GovernorSignals::WinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd,
+	LONG idObject, LONG idChild, DWORD idEventThread, DWORD dwmsEventTime)
+{
+	UNREFERENCED_PARAMETER(hWinEventHook);
+	UNREFERENCED_PARAMETER(event);
+	UNREFERENCED_PARAMETER(hwnd);
+	UNREFERENCED_PARAMETER(idObject);
+	UNREFERENCED_PARAMETER(idChild);
+	UNREFERENCED_PARAMETER(idEventThread);
+	UNREFERENCED_PARAMETER(dwmsEventTime);
+
+	if (!s_hWndNotify)
+		return;
+
+	MSG msg;
+	if (!PeekMessage(&msg, s_hWndNotify, WM_APP_FOREGROUND, WM_APP_FOREGROUND, PM_NOREMOVE))
+		PostMessage(s_hWndNotify, WM_APP_FOREGROUND, 0, 0);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "PlaybackGovernor.h"
+
+
+// Private window message posted when the foreground window changed.
+static const UINT WM_APP_FOREGROUND = WM_APP + 4;
+
+// Timer of the pending governor change.
+static const UINT_PTR IDT_GOVERNOR = 2;
+
+
+//-------------------------------------------------------------------
+//
+// GovernorSignals class
+//
+// Collects the Windows session, power, fullscreen and occlusion
+// notifications for the player window and feeds them to a
+// PlaybackGovernor as timestamped signal changes.
+//
+//-------------------------------------------------------------------
+
+class GovernorSignals
+{
+public:
+	explicit GovernorSignals(PlaybackGovernor* pGovernor);
+	~GovernorSignals();
+
+	bool Register(HWND hWnd);
+	void Unregister();
+
+	// Handles WM_WTSSESSION_CHANGE, WM_POWERBROADCAST, WM_APP_FOREGROUND and
+	// the IDT_GOVERNOR timer. Returns true if the governor mode changed.
+	bool OnMessage(UINT message, WPARAM wParam, LPARAM lParam);
+
+	static HNSTIME GetTime();
+
+private:
+	bool Feed(GOVERNOR_SIGNAL signal, bool bActive);
+	bool CheckForeground();
+	void ArmDeadline();
+
+	static void CALLBACK WinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd,
+		LONG idObject, LONG idChild, DWORD idEventThread, DWORD dwmsEventTime);
+
+	PlaybackGovernor*	m_pGovernor;
+	HWND				m_hWnd;
+	HPOWERNOTIFY		m_hAcDc;
+	HPOWERNOTIFY		m_hSaver;
+	HWINEVENTHOOK		m_hForegroundHook;
+	HWINEVENTHOOK		m_hMinimizeHook;
+	bool				m_bSession;
+
+	static HWND			s_hWndNotify;
+};
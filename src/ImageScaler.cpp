@@ -0,0 +1,131 @@
+#include "ImageScaler.h"
+#include <string.h>
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+BGRAScaler::BGRAScaler() : m_cxSrc(0), m_cySrc(0), m_cxDst(0), m_cyDst(0), m_filter(SCALE_FILTER_BILINEAR),
+m_bArea(false), m_cyBoxMin(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+// GetBilinearTaps
+//
+// Maps output pixel centers to the source: tap x blends source pixels x0
+// and x0 + 1. Past the last source pixel the weight is 0.
+//-----------------------------------------------------------------------------
+
+static void GetBilinearTaps(uint32_t cSrc, uint32_t cDst, std::vector<BilinearTap>* pTaps)
+{
+	const int64_t nHalf = 1 << 15;
+	pTaps->resize(cDst);
+	for (uint32_t i = 0; i < cDst; i++) {
+		int64_t nPos = ((int64_t)(2 * i + 1) * cSrc << 16) / (2 * (int64_t)cDst) - nHalf;
+		if (nPos < 0)
+			nPos = 0;
+		BilinearTap& tap = (*pTaps)[i];
+		tap.x0 = (uint32_t)(nPos >> 16);
+		tap.nWeight = (uint32_t)(((nPos & 0xFFFF) + (1 << (15 - BILINEAR_BITS))) >> (16 - BILINEAR_BITS));
+		if (tap.x0 >= cSrc - 1) {
+			tap.x0 = cSrc - 1;
+			tap.nWeight = 0;
+		}
+	}
+}
+
+// Box of output pixel i: source pixels [i * cSrc / cDst, (i + 1) * cSrc / cDst).
+static void GetAreaTaps(uint32_t cSrc, uint32_t cDst, std::vector<AreaTap>* pTaps)
+{
+	pTaps->resize(cDst);
+	for (uint32_t i = 0; i < cDst; i++) {
+		uint32_t n0 = (uint32_t)((uint64_t)i * cSrc / cDst);
+		uint32_t n1 = (uint32_t)((uint64_t)(i + 1) * cSrc / cDst);
+		(*pTaps)[i].x0 = n0;
+		(*pTaps)[i].cx = n1 - n0;
+	}
+}
+
+bool BGRAScaler::Init(uint32_t cxSrc, uint32_t cySrc, uint32_t cxDst, uint32_t cyDst, SCALE_FILTER filter)
+{
+	m_cxDst = 0;
+	if (!cxSrc || !cySrc || !cxDst || !cyDst)
+		return false;
+
+	m_cxSrc = cxSrc;
+	m_cySrc = cySrc;
+	m_cyDst = cyDst;
+	m_filter = filter;
+	m_bArea = filter == SCALE_FILTER_AREA && cxDst <= cxSrc && cyDst <= cySrc;
+
+	if (m_bArea) {
+		GetAreaTaps(cxSrc, cxDst, &m_boxX);
+		GetAreaTaps(cySrc, cyDst, &m_boxY);
+
+		// Box heights are cySrc / cyDst or one more.
+		m_cyBoxMin = cySrc / cyDst;
+		m_recip.resize((size_t)cxDst * 2);
+		for (uint32_t h = 0; h < 2; h++) {
+			for (uint32_t x = 0; x < cxDst; x++) {
+				uint64_t n = (uint64_t)m_boxX[x].cx * (m_cyBoxMin + h);
+				m_recip[h * cxDst + x] = (uint32_t)(((1ull << AREA_BITS) + n / 2) / n);
+			}
+		}
+		m_sums.resize((size_t)cxSrc * 4);
+	}
+	else {
+		GetBilinearTaps(cxSrc, cxDst, &m_tapsX);
+		GetBilinearTaps(cySrc, cyDst, &m_tapsY);
+		m_blend.resize((size_t)(cxSrc + 1) * 4);
+	}
+	m_cxDst = cxDst;
+	return true;
+}
+
+bool BGRAScaler::Matches(uint32_t cxSrc, uint32_t cySrc, uint32_t cxDst, uint32_t cyDst, SCALE_FILTER filter) const
+{
+	return m_cxDst == cxDst && m_cyDst == cyDst && m_cxSrc == cxSrc && m_cySrc == cySrc && m_filter == filter;
+}
+
+void BGRAScaler::Scale(const uint8_t* pSrc, size_t cbSrcStride, uint8_t* pDst, size_t cbDstStride)
+{
+	if (!m_cxDst)
+		return;
+	if (m_bArea)
+		ScaleArea(pSrc, cbSrcStride, pDst, cbDstStride);
+	else
+		ScaleBilinear(pSrc, cbSrcStride, pDst, cbDstStride);
+}
+
+void BGRAScaler::ScaleBilinear(const uint8_t* pSrc, size_t cbSrcStride, uint8_t* pDst, size_t cbDstStride)
+{
+	const ColorKernelTable& kernels = GetColorKernels();
+	const size_t cValues = (size_t)m_cxSrc * 4;
+	int16_t* pBlend = m_blend.data();
+
+	for (uint32_t y = 0; y < m_cyDst; y++) {
+		const BilinearTap& tap = m_tapsY[y];
+		uint32_t y1 = tap.x0 + 1 < m_cySrc ? tap.x0 + 1 : tap.x0;
+		kernels.pfnBlendRows(pSrc + tap.x0 * cbSrcStride, pSrc + y1 * cbSrcStride, tap.nWeight, pBlend, cValues);
+		memcpy(pBlend + cValues, pBlend + cValues - 4, 4 * sizeof(int16_t));
+		kernels.pfnBlendColumns(pBlend, m_tapsX.data(), m_cxDst, pDst + y * cbDstStride);
+	}
+}
+
+void BGRAScaler::ScaleArea(const uint8_t* pSrc, size_t cbSrcStride, uint8_t* pDst, size_t cbDstStride)
+{
+	const ColorKernelTable& kernels = GetColorKernels();
+	const size_t cValues = (size_t)m_cxSrc * 4;
+	uint32_t* pSums = m_sums.data();
+
+	for (uint32_t y = 0; y < m_cyDst; y++) {
+		const AreaTap& box = m_boxY[y];
+		memset(pSums, 0, cValues * sizeof(uint32_t));
+		for (uint32_t i = 0; i < box.cx; i++)
+			kernels.pfnAccumulateRow(pSrc + (box.x0 + i) * cbSrcStride, pSums, cValues);
+		const uint32_t* pRecip = m_recip.data() + (box.cx - m_cyBoxMin) * m_cxDst;
+		kernels.pfnAreaColumns(pSums, m_boxX.data(), pRecip, m_cxDst, pDst + y * cbDstStride);
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "ColorKernels.h"
+#include <vector>
+
+
+enum SCALE_FILTER
+{
+	SCALE_FILTER_BILINEAR = 0,
+	SCALE_FILTER_AREA			// Box average when neither axis grows, else bilinear
+};
+
+
+//-------------------------------------------------------------------
+//
+// BGRAScaler class
+//
+// Resizes 32-bit BGRA pictures of one size to another, e.g. a decoded
+// frame to the monitor it is shown on. Init computes the filter taps
+// once; Scale then runs the row kernels of GetKernelIsa() with no
+// allocations.
+//
+// Bilinear samples pixel centers with 7-bit weights. Area averages the
+// source pixels each output pixel covers, rounded to whole pixels, and
+// is the better filter for large reductions.
+//
+// One Scale call at a time.
+//
+//-------------------------------------------------------------------
+
+class BGRAScaler
+{
+public:
+	BGRAScaler();
+
+	// Returns false if a size is zero.
+	bool Init(uint32_t cxSrc, uint32_t cySrc, uint32_t cxDst, uint32_t cyDst, SCALE_FILTER filter);
+
+	bool IsInitialized() const { return m_cxDst != 0; }
+	bool Matches(uint32_t cxSrc, uint32_t cySrc, uint32_t cxDst, uint32_t cyDst, SCALE_FILTER filter) const;
+	uint32_t GetOutputWidth() const { return m_cxDst; }
+	uint32_t GetOutputHeight() const { return m_cyDst; }
+
+	void Scale(const uint8_t* pSrc, size_t cbSrcStride, uint8_t* pDst, size_t cbDstStride);
+
+private:
+	void ScaleBilinear(const uint8_t* pSrc, size_t cbSrcStride, uint8_t* pDst, size_t cbDstStride);
+	void ScaleArea(const uint8_t* pSrc, size_t cbSrcStride, uint8_t* pDst, size_t cbDstStride);
+
+	uint32_t					m_cxSrc;
+	uint32_t					m_cySrc;
+	uint32_t					m_cxDst;
+	uint32_t					m_cyDst;
+	SCALE_FILTER				m_filter;
+	bool						m_bArea;		// Area filter in effect
+
+	std::vector<BilinearTap>	m_tapsX;		// Bilinear columns
+	std::vector<BilinearTap>	m_tapsY;		// Bilinear rows: source row and weight of the next
+	std::vector<AreaTap>		m_boxX;			// Area columns
+	std::vector<AreaTap>		m_boxY;			// Area rows
+	std::vector<uint32_t>		m_recip;		// Area reciprocals, cxDst per box height from m_cyBoxMin
+	uint32_t					m_cyBoxMin;
+	std::vector<int16_t>		m_blend;		// Bilinear row, plus a padding pixel
+	std::vector<uint32_t>		m_sums;			// Area column sums
+};
@@ -0,0 +1,452 @@
+#include "JsonReader.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+static int HexDigit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+// Code unit of a \uXXXX escape, whose four digits the scanner checked.
+static uint32_t ReadHex4(const char* p)
+{
+	return (uint32_t)(HexDigit(p[0]) << 12 | HexDigit(p[1]) << 8 | HexDigit(p[2]) << 4 | HexDigit(p[3]));
+}
+
+//-----------------------------------------------------------------------------
+// Unescape
+//
+// Resolves the escapes of a scanned string into pOut, as much as fits in
+// cchOut bytes, and returns the full length. Unpaired surrogates become
+// U+FFFD.
+//-----------------------------------------------------------------------------
+
+static size_t Unescape(const char* p, size_t cch, char* pOut, size_t cchOut)
+{
+	const char* pEnd = p + cch;
+	size_t n = 0;
+	while (p < pEnd) {
+		if (*p != '\\') {
+			if (n < cchOut)
+				pOut[n] = *p;
+			n++;
+			p++;
+			continue;
+		}
+		p++;
+		char c = *p++;
+		if (c != 'u') {
+			switch (c) {
+			case 'b': c = '\b'; break;
+			case 'f': c = '\f'; break;
+			case 'n': c = '\n'; break;
+			case 'r': c = '\r'; break;
+			case 't': c = '\t'; break;
+			}
+			if (n < cchOut)
+				pOut[n] = c;
+			n++;
+			continue;
+		}
+
+		uint32_t nCode = ReadHex4(p);
+		p += 4;
+		if (nCode >= 0xD800 && nCode < 0xDC00 && pEnd - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+			uint32_t nLow = ReadHex4(p + 2);
+			if (nLow >= 0xDC00 && nLow < 0xE000) {
+				nCode = 0x10000 + ((nCode - 0xD800) << 10) + (nLow - 0xDC00);
+				p += 6;
+			}
+		}
+		if (nCode >= 0xD800 && nCode < 0xE000)
+			nCode = 0xFFFD;
+
+		char utf8[4];
+		size_t cchCode;
+		if (nCode < 0x80) {
+			utf8[0] = (char)nCode;
+			cchCode = 1;
+		}
+		else if (nCode < 0x800) {
+			utf8[0] = (char)(0xC0 | nCode >> 6);
+			utf8[1] = (char)(0x80 | (nCode & 0x3F));
+			cchCode = 2;
+		}
+		else if (nCode < 0x10000) {
+			utf8[0] = (char)(0xE0 | nCode >> 12);
+			utf8[1] = (char)(0x80 | (nCode >> 6 & 0x3F));
+			utf8[2] = (char)(0x80 | (nCode & 0x3F));
+			cchCode = 3;
+		}
+		else {
+			utf8[0] = (char)(0xF0 | nCode >> 18);
+			utf8[1] = (char)(0x80 | (nCode >> 12 & 0x3F));
+			utf8[2] = (char)(0x80 | (nCode >> 6 & 0x3F));
+			utf8[3] = (char)(0x80 | (nCode & 0x3F));
+			cchCode = 4;
+		}
+		for (size_t i = 0; i < cchCode; i++, n++) {
+			if (n < cchOut)
+				pOut[n] = utf8[i];
+		}
+	}
+	return n;
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+JsonReader::JsonReader(const char* pText, size_t cchText) :
+	m_p(pText),
+	m_pEnd(pText + cchText),
+	m_pLineStart(pText),
+	m_pToken(pText),
+	m_cchToken(0),
+	m_nLine(1),
+	m_token(JSON_TOKEN_NONE),
+	m_expect(EXPECT_VALUE),
+	m_bEscaped(false),
+	m_pszError(NULL),
+	m_nDepth(0)
+{
+	// UTF-8 byte order mark, as some editors write it.
+	if (cchText >= 3 && memcmp(pText, "\xEF\xBB\xBF", 3) == 0) {
+		m_p += 3;
+		m_pLineStart = m_p;
+	}
+}
+
+JSON_TOKEN JsonReader::Next()
+{
+	if (m_token == JSON_TOKEN_ERROR || m_token == JSON_TOKEN_END)
+		return m_token;
+
+	for (;;) {
+		if (!SkipSpace())
+			return Fail("unterminated comment");
+		m_pToken = m_p;
+		m_cchToken = 1;
+		if (m_p == m_pEnd) {
+			m_cchToken = 0;
+			if (m_expect != EXPECT_END)
+				return Fail("unexpected end of document");
+			m_token = JSON_TOKEN_END;
+			return m_token;
+		}
+
+		char c = *m_p;
+		bool bClose = c == '}' || c == ']';
+		switch (m_expect) {
+		case EXPECT_END:
+			return Fail("text after the document");
+
+		case EXPECT_COMMA:
+			if (c == ',') {
+				m_p++;
+				m_expect = m_bArray[m_nDepth - 1] ? EXPECT_FIRST_VALUE : EXPECT_FIRST_KEY;
+				continue;
+			}
+			if (!bClose)
+				return Fail(m_bArray[m_nDepth - 1] ? "expected , or ]" : "expected , or }");
+			break;
+
+		case EXPECT_FIRST_KEY:
+			if (c == '"') {
+				if (ScanString(JSON_TOKEN_KEY) == JSON_TOKEN_ERROR)
+					return m_token;
+				const char* pKey = m_pToken;
+				if (!SkipSpace())
+					return Fail("unterminated comment");
+				if (m_p == m_pEnd || *m_p != ':') {
+					m_pToken = m_p;
+					return Fail("expected :");
+				}
+				m_p++;
+				m_pToken = pKey;
+				m_expect = EXPECT_VALUE;
+				return m_token;
+			}
+			if (c != '}')
+				return Fail("expected a key");
+			break;
+
+		case EXPECT_FIRST_VALUE:
+			if (c != ']')
+				return ScanValue();
+			break;
+
+		case EXPECT_VALUE:
+			return ScanValue();
+		}
+
+		// A closing bracket.
+		bool bArray = c == ']';
+		if (m_nDepth == 0 || m_bArray[m_nDepth - 1] != bArray)
+			return Fail("mismatched bracket");
+		m_nDepth--;
+		m_p++;
+		m_token = bArray ? JSON_TOKEN_END_ARRAY : JSON_TOKEN_END_OBJECT;
+		AfterValue();
+		return m_token;
+	}
+}
+
+bool JsonReader::Skip()
+{
+	if (m_token == JSON_TOKEN_KEY)
+		Next();
+	if (m_token != JSON_TOKEN_BEGIN_OBJECT && m_token != JSON_TOKEN_BEGIN_ARRAY)
+		return m_token != JSON_TOKEN_ERROR && m_token != JSON_TOKEN_END;
+
+	size_t nDepth = m_nDepth - 1;
+	while (m_nDepth > nDepth) {
+		JSON_TOKEN token = Next();
+		if (token == JSON_TOKEN_ERROR || token == JSON_TOKEN_END)
+			return false;
+	}
+	return true;
+}
+
+bool JsonReader::IsKey(const char* pszKey) const
+{
+	if (m_token != JSON_TOKEN_KEY)
+		return false;
+	size_t cchKey = strlen(pszKey);
+	if (!m_bEscaped)
+		return m_cchToken == cchKey && memcmp(m_pToken, pszKey, cchKey) == 0;
+
+	char key[128];
+	size_t cch = Unescape(m_pToken, m_cchToken, key, sizeof(key));
+	return cch == cchKey && cch <= sizeof(key) && memcmp(key, pszKey, cch) == 0;
+}
+
+bool JsonReader::GetString(char* pszBuffer, size_t cchBuffer, size_t* pcch) const
+{
+	if (m_token != JSON_TOKEN_KEY && m_token != JSON_TOKEN_STRING)
+		return false;
+	size_t cch = m_cchToken;
+	if (m_bEscaped)
+		cch = Unescape(m_pToken, m_cchToken, pszBuffer, cchBuffer);
+	else if (cch < cchBuffer)
+		memcpy(pszBuffer, m_pToken, cch);
+	if (pcch)
+		*pcch = cch;
+	if (cch >= cchBuffer)
+		return false;
+	pszBuffer[cch] = '\0';
+	return true;
+}
+
+bool JsonReader::GetNumber(double* pfValue) const
+{
+	// The scanner checked the syntax; strtod needs it terminated.
+	char number[64];
+	if (m_token != JSON_TOKEN_NUMBER || m_cchToken >= sizeof(number))
+		return false;
+	memcpy(number, m_pToken, m_cchToken);
+	number[m_cchToken] = '\0';
+	*pfValue = strtod(number, NULL);
+	return true;
+}
+
+uint32_t JsonReader::GetColumn() const
+{
+	uint32_t nColumn = (uint32_t)(m_pToken - m_pLineStart) + 1;
+	if (m_token == JSON_TOKEN_KEY || m_token == JSON_TOKEN_STRING)
+		nColumn--;
+	return nColumn;
+}
+
+//-----------------------------------------------------------------------------
+// SkipSpace
+//
+// Skips white space and comments. Returns false if a comment does not end.
+//-----------------------------------------------------------------------------
+
+bool JsonReader::SkipSpace()
+{
+	while (m_p < m_pEnd) {
+		char c = *m_p;
+		if (c == ' ' || c == '\t' || c == '\r') {
+			m_p++;
+		}
+		else if (c == '\n') {
+			m_p++;
+			m_nLine++;
+			m_pLineStart = m_p;
+		}
+		else if (c == '/' && m_pEnd - m_p >= 2 && m_p[1] == '/') {
+			while (m_p < m_pEnd && *m_p != '\n')
+				m_p++;
+		}
+		else if (c == '/' && m_pEnd - m_p >= 2 && m_p[1] == '*') {
+			// An unterminated comment is reported where it starts.
+			const char* pStart = m_p;
+			const char* pLineStart = m_pLineStart;
+			uint32_t nLine = m_nLine;
+			for (m_p += 2; ; m_p++) {
+				if (m_pEnd - m_p < 2) {
+					m_pToken = pStart;
+					m_pLineStart = pLineStart;
+					m_nLine = nLine;
+					return false;
+				}
+				if (*m_p == '\n') {
+					m_nLine++;
+					m_pLineStart = m_p + 1;
+				}
+				else if (m_p[0] == '*' && m_p[1] == '/') {
+					break;
+				}
+			}
+			m_p += 2;
+		}
+		else {
+			break;
+		}
+	}
+	return true;
+}
+
+JSON_TOKEN JsonReader::ScanValue()
+{
+	char c = *m_p;
+	if (c == '{' || c == '[') {
+		if (m_nDepth == JSON_MAX_DEPTH)
+			return Fail("nested too deep");
+		bool bArray = c == '[';
+		m_bArray[m_nDepth++] = bArray;
+		m_p++;
+		m_expect = bArray ? EXPECT_FIRST_VALUE : EXPECT_FIRST_KEY;
+		m_token = bArray ? JSON_TOKEN_BEGIN_ARRAY : JSON_TOKEN_BEGIN_OBJECT;
+		return m_token;
+	}
+	if (c == '"') {
+		if (ScanString(JSON_TOKEN_STRING) != JSON_TOKEN_ERROR)
+			AfterValue();
+		return m_token;
+	}
+	if (c == '-' || (c >= '0' && c <= '9'))
+		return ScanNumber();
+	if (c == 't')
+		return ScanWord("true", JSON_TOKEN_TRUE);
+	if (c == 'f')
+		return ScanWord("false", JSON_TOKEN_FALSE);
+	if (c == 'n')
+		return ScanWord("null", JSON_TOKEN_NULL);
+	return Fail("expected a value");
+}
+
+//-----------------------------------------------------------------------------
+// ScanString
+//
+// Checks the string at m_p and leaves its text, between the quotes, as
+// the current token. Escapes are only checked here, and resolved when
+// the string is read.
+//-----------------------------------------------------------------------------
+
+JSON_TOKEN JsonReader::ScanString(JSON_TOKEN token)
+{
+	const char* pStart = ++m_p;
+	m_bEscaped = false;
+	while (m_p < m_pEnd && *m_p != '"') {
+		unsigned char c = (unsigned char)*m_p;
+		if (c < 0x20)
+			return Fail("control character in string");
+		if (c == '\\') {
+			m_bEscaped = true;
+			if (++m_p == m_pEnd)
+				break;
+			c = (unsigned char)*m_p;
+			if (c == 'u') {
+				if (m_pEnd - m_p < 5 || HexDigit(m_p[1]) < 0 || HexDigit(m_p[2]) < 0 || HexDigit(m_p[3]) < 0 ||
+					HexDigit(m_p[4]) < 0)
+					return Fail("bad \\u escape");
+				m_p += 4;
+			}
+			else if (!strchr("\"\\/bfnrt", c)) {
+				return Fail("bad escape");
+			}
+		}
+		m_p++;
+	}
+	if (m_p == m_pEnd) {
+		m_pToken = pStart - 1;
+		return Fail("unterminated string");
+	}
+	m_pToken = pStart;
+	m_cchToken = (size_t)(m_p - pStart);
+	m_p++;
+	m_token = token;
+	return m_token;
+}
+
+JSON_TOKEN JsonReader::ScanNumber()
+{
+	const char* pStart = m_p;
+	if (*m_p == '-')
+		m_p++;
+	if (m_p < m_pEnd && *m_p == '0') {
+		m_p++;
+	}
+	else if (m_p < m_pEnd && *m_p >= '1' && *m_p <= '9') {
+		while (m_p < m_pEnd && *m_p >= '0' && *m_p <= '9')
+			m_p++;
+	}
+	else {
+		return Fail("bad number");
+	}
+	if (m_p < m_pEnd && *m_p == '.') {
+		if (++m_p == m_pEnd || *m_p < '0' || *m_p > '9')
+			return Fail("bad number");
+		while (m_p < m_pEnd && *m_p >= '0' && *m_p <= '9')
+			m_p++;
+	}
+	if (m_p < m_pEnd && (*m_p == 'e' || *m_p == 'E')) {
+		if (++m_p < m_pEnd && (*m_p == '+' || *m_p == '-'))
+			m_p++;
+		if (m_p == m_pEnd || *m_p < '0' || *m_p > '9')
+			return Fail("bad number");
+		while (m_p < m_pEnd && *m_p >= '0' && *m_p <= '9')
+			m_p++;
+	}
+	m_pToken = pStart;
+	m_cchToken = (size_t)(m_p - pStart);
+	m_token = JSON_TOKEN_NUMBER;
+	AfterValue();
+	return m_token;
+}
+
+JSON_TOKEN JsonReader::ScanWord(const char* pszWord, JSON_TOKEN token)
+{
+	size_t cch = strlen(pszWord);
+	if ((size_t)(m_pEnd - m_p) < cch || memcmp(m_p, pszWord, cch) != 0)
+		return Fail("expected a value");
+	m_p += cch;
+	m_cchToken = cch;
+	m_token = token;
+	AfterValue();
+	return m_token;
+}
+
+JSON_TOKEN JsonReader::Fail(const char* pszError)
+{
+	m_pszError = pszError;
+	m_cchToken = 0;
+	m_token = JSON_TOKEN_ERROR;
+	return m_token;
+}
+
+void JsonReader::AfterValue()
+{
+	m_expect = m_nDepth ? EXPECT_COMMA : EXPECT_END;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+
+enum JSON_TOKEN
+{
+	JSON_TOKEN_NONE = 0,		// Next() not called yet
+	JSON_TOKEN_BEGIN_OBJECT,
+	JSON_TOKEN_END_OBJECT,
+	JSON_TOKEN_BEGIN_ARRAY,
+	JSON_TOKEN_END_ARRAY,
+	JSON_TOKEN_KEY,				// Member name; its value is the next token
+	JSON_TOKEN_STRING,
+	JSON_TOKEN_NUMBER,
+	JSON_TOKEN_TRUE,
+	JSON_TOKEN_FALSE,
+	JSON_TOKEN_NULL,
+	JSON_TOKEN_END,				// The document ended
+	JSON_TOKEN_ERROR			// Malformed document; every later Next() returns it again
+};
+
+// Deepest nesting of objects and arrays accepted.
+const size_t JSON_MAX_DEPTH = 32;
+
+
+//-------------------------------------------------------------------
+//
+// JsonReader class
+//
+// Pull parser over a JSON document in memory. Next() returns one token
+// at a time; keys, strings and numbers are left in the document and
+// only read through GetString, GetNumber or IsKey, so reading allocates
+// nothing and a value that is not wanted costs one scan.
+//
+// Besides strict JSON, // and /* */ comments and a comma before a
+// closing bracket are accepted, since the documents are edited by hand.
+// The text is UTF-8 and need not be NUL-terminated.
+//
+//-------------------------------------------------------------------
+
+class JsonReader
+{
+public:
+	JsonReader(const char* pText, size_t cchText);
+
+	JSON_TOKEN Next();
+	JSON_TOKEN GetToken() const { return m_token; }
+
+	// Skips the value the current token starts, up to its closing bracket
+	// for an object or array. Call on a key to skip the key's value.
+	// Returns false on a malformed document.
+	bool Skip();
+
+	// Levels of objects and arrays the current token is in.
+	size_t GetDepth() const { return m_nDepth; }
+
+	// Current key compares equal to pszKey, escapes resolved.
+	bool IsKey(const char* pszKey) const;
+
+	// Copies the current key or string, escapes resolved, as UTF-8 with a
+	// terminating NUL. Fails if it does not fit; *pcch gets its length
+	// either way if pcch is not NULL.
+	bool GetString(char* pszBuffer, size_t cchBuffer, size_t* pcch) const;
+
+	// Value of the current number.
+	bool GetNumber(double* pfValue) const;
+
+	// Text of the current token in the document, without the quotes of a
+	// key or string.
+	const char* GetText() const { return m_pToken; }
+	size_t GetTextLength() const { return m_cchToken; }
+
+	// Line (from 1) and column (from 1, in bytes) of the current token, or
+	// of the error. The column of a key or string is its opening quote's.
+	uint32_t GetLine() const { return m_nLine; }
+	uint32_t GetColumn() const;
+	const char* GetError() const { return m_pszError; }
+
+private:
+	enum EXPECT
+	{
+		EXPECT_VALUE,			// At the start or after a colon
+		EXPECT_FIRST_VALUE,		// After [ or a comma in an array: value or ]
+		EXPECT_FIRST_KEY,		// After { or a comma in an object: key or }
+		EXPECT_COMMA,			// After a value: comma or closing bracket
+		EXPECT_END				// After the top-level value
+	};
+
+	bool SkipSpace();
+	JSON_TOKEN ScanValue();
+	JSON_TOKEN ScanString(JSON_TOKEN token);
+	JSON_TOKEN ScanNumber();
+	JSON_TOKEN ScanWord(const char* pszWord, JSON_TOKEN token);
+	JSON_TOKEN Fail(const char* pszError);
+	void AfterValue();
+
+	const char*	m_p;			// Next character to scan
+	const char*	m_pEnd;
+	const char*	m_pLineStart;
+	const char*	m_pToken;
+	size_t		m_cchToken;
+	uint32_t	m_nLine;
+	JSON_TOKEN	m_token;
+	EXPECT		m_expect;
+	bool		m_bEscaped;		// Current string has escapes
+	const char*	m_pszError;
+	size_t		m_nDepth;
+	bool		m_bArray[JSON_MAX_DEPTH];	// Level is an array, not an object
+};
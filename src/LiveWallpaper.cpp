@@ -5,64 +5,391 @@
 #include "framework.h"
 #include "LiveWallpaper.h"
 #include "MFPVideoPlayer.h"
+#include "WallpaperPlayer.h"
+#include "SoftwarePlayer.h"
+#include "ClipCache.h"
+#include "FrameBroker.h"
+#include "ContainerIndex.h"
+#include "ColorKernels.h"
+#include "LoopScheduler.h"
+#include "PlaybackController.h"
+#include "GovernorSignals.h"
+#include "QualitySimulator.h"
+#include "WallpaperConfig.h"
+#include "JsonReader.h"
+#include "Playlist.h"
+#include "ControlPipe.h"
+#include "EventLoop.h"
+#include "PlayerEventQueue.h"
+#include "StateSnapshot.h"
+#include "EventQueue.h"
+#include "ConfigWatcher.h"
+#include "StartupPipeline.h"
+#include "DesktopHostTracker.h"
+#include "OverlayCompositor.h"
+#include "GenerativeRenderer.h"
+#include <mfapi.h>
 #include <strsafe.h>
+#include <psapi.h>
+#include <ShellScalingApi.h>
+#include <ShlObj.h>
+#include <thread>
+#include <vector>
+
+#pragma comment(lib, "shcore.lib")
+#pragma comment(lib, "shell32.lib")
 
 
 #define MAX_LOADSTRING 100
 
-const MFTIME	ONE_SECOND = 10000000;	// One second in hns
-const MFTIME	ONE_MSEC = 1000;		// One msec in hns
+// Timers of g_eventLoop
+const uint32_t	IDT_LOOP = 1;			// One-shot loop deadline timer
+const uint32_t	IDT_PLAYLIST = 3;		// One-shot playlist prefetch/switch timer
+const uint32_t	IDT_STATS = 4;			// Process stats sampling timer
+const uint32_t	IDT_HOST = 5;			// One-shot desktop host lookup retry
+const uint32_t	IDT_CONFIG = 6;			// One-shot config reload once its file settled
+const uint32_t	IDT_BENCH = 7;			// End of --bench-wakeups
+const uint32_t	IDT_OVERLAY = 8;		// One-shot overlay clock tick, at the next second or minute
+
+// Events of g_eventLoop
+const uint32_t	APP_EVENT_PLAYER = 0;	// Records are waiting in g_playerEvents
+const uint32_t	APP_EVENT_LAYOUT = 1;	// The desktop host window moved or resized
+
+const size_t	DEFAULT_LOOP_CACHE_MB = 256;
+const DWORD		CONTROL_TIMEOUT_MS = 2000;	// Wait for a running instance's control pipe
+const UINT		STATS_SAMPLE_MS = 1000;		// Process CPU and working set sampling period
+const UINT		STATS_DUMP_SAMPLES = 10;	// Samples between two stats dumps
+const UINT		HOST_RETRY_MS = 1000;		// Wait before moving to a new desktop host after the old one died
+const uint32_t	BENCH_DECODE_PASSES = 3;	// Passes over each clip in --bench-decode
+const uint32_t	BENCH_KERNEL_PASSES = 20;	// Runs of each kernel over a 1080p picture in --bench-kernels
+const uint32_t	BENCH_INDEX_LOOKUPS = 1000000;	// Keyframe lookups per clip in --bench-index
+const DWORD		BROKER_REPORT_MS = 10000;	// Between two --broker status lines
+const UINT		CONFIG_SETTLE_MS = 200;		// Quiet time after a change of the config file before it is read
+const HNSTIME	TIMER_TOLERANCE = 100 * HNS_PER_MSEC;	// Lateness allowed to timers nobody sees, to share wakeups
+const int		DEFAULT_BENCH_WAKEUPS_SEC = 60;	// Playback --bench-wakeups counts over
+const uint32_t	BENCH_CONFIG_PASSES = 20;	// Parses of each config in --bench-config
+const HNSTIME	BENCH_SNAPSHOT_TIME = HNS_PER_SECOND;	// Run time of each reader count in --bench-snapshot
+const HNSTIME	BENCH_QUEUE_TIME = HNS_PER_SECOND;		// Run time of each queue and producer count in --bench-queue
+const uint32_t	BENCH_OVERLAY_FRAMES = 20;	// Composes of each kind over a 4K frame in --bench-overlay
+const int32_t	OVERLAY_MARGIN = 48;		// Pixels between the overlay widgets and the monitor's edges
+const uint32_t	BENCH_GENERATIVE_FRAMES = 30;	// Frames of each effect, size and thread count in --bench-generative
+
+// Command line options
+struct AppOptions
+{
+	std::vector<PlaylistItem>	clips;	// Video file paths, empty = restore the wallpaper
+	PlaylistConfig	playlist;	// --interval=SEC, --shuffle
+	std::vector<ControlMessage>	commands;	// --pause, --resume, --seek, --rate, --volume, --stats
+	LPCWSTR	pszStatsDump;	// --stats-dump=PATH, NULL = no telemetry
+	bool	bBenchStartup;	// --bench-startup
+	int		nBenchDecode;	// --bench-decode[=THREADS], -1 = off, 0 = one thread per core
+	bool	bBenchKernels;	// --bench-kernels
+	bool	bBenchIndex;	// --bench-index
+	bool	bPrepare;		// --prepare
+	bool	bBroker;		// --broker
+	bool	bAdaptive;		// --adaptive
+	bool	bSimulateQuality;	// --simulate-quality[=TRACE]
+	std::wstring	qualityTrace;	// Load trace to simulate, empty = the built-in ones
+	std::wstring	configPath;	// --config=PATH, empty = none
+	bool	bBenchConfig;	// --bench-config
+	int		nBenchWakeups;	// --bench-wakeups[=SEC], seconds to count over, 0 = off
+	bool	bBenchSnapshot;	// --bench-snapshot
+	bool	bBenchQueue;	// --bench-queue
+	bool	bBenchOverlay;	// --bench-overlay
+	bool	bBenchGenerative;	// --bench-generative
+	bool	bOverlayClock;	// --overlay-clock[=seconds]
+	bool	bOverlaySeconds;
+	std::wstring	overlayText;	// --overlay-text=TEXT, empty = none
+	std::wstring	cacheDir;	// --cache[=DIR], empty = off
+	PLAYER_BACKEND	backend;	// --backend=mfplay|reader|software|shared|generative
+	size_t	cbLoopCache;	// --loop-cache[=MB], 0 = off
+	float	fMaxFps;		// --max-fps=N, 0 = no cap
+	LAYOUT_MODE	layout;		// --layout=span|span-physical|clone
+	SCALE_MODE	scale;		// --scale=fit|fill|stretch
+};
 
 // Global Variables:
 HINSTANCE hInst;						// current instance
 WCHAR szTitle[MAX_LOADSTRING];			// The title bar text
 WCHAR szWindowClass[MAX_LOADSTRING];	// the main window class name
-MFPVideoPlayer* g_pPlayer = nullptr;
-MFTIME g_duration = 0;
+IWallpaperPlayer* g_pPlayer = nullptr;
+AppOptions g_options;
+HWND g_hWorker = NULL;					// Desktop host window (WorkerW)
+HWND g_hWndApp = NULL;					// Hidden top-level window receiving control, power and session messages
+HWND g_hWndVideo = NULL;				// Child of the desktop host the video is drawn into
+UINT g_uTaskbarCreated = 0;				// Broadcast when the shell (re)starts
+HWINEVENTHOOK g_hHostHook = NULL;
+bool g_bUserPaused = false;				// Paused by a control command
+PlaybackStats g_stats;
+StartupPipeline g_startup;				// Created first, so its trace starts at process start
+ClipCache g_clipCache;					// Wallpaper-optimized copies of the clips, off unless --cache
+std::wstring g_indexDirectory;			// Container indexes of the clips, empty = none
+WallpaperConfig g_baseConfig;			// Settings of the command line, which --config overrides
+WallpaperConfig g_config;				// Settings in effect
+ConfigWatcher g_configWatcher;
+EventLoop g_eventLoop;					// Waits for the player, timers, handles and window messages at once
+PlayerEventQueue g_playerEvents(&g_eventLoop, APP_EVENT_PLAYER);	// Events of the player, taken in batches
+OverlayCompositor g_overlay;			// Clock and text over the frames, empty unless --overlay-*
 
-// Forward declarations of functions included in this code module:
-ATOM MyRegisterClass(HINSTANCE hInstance);
-HWND InitWindow(HWND hParent, int nCmdShow, int width, int height);
-LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
-INT_PTR CALLBACK About(HWND, UINT, WPARAM, LPARAM);
-void OnTimer();
-void OnPlayerNotify(MFP_MEDIAPLAYER_STATE state);
-void ShowErrorMessage(HWND hWnd, LPCWSTR lpCaption, HRESULT hrErr);
+//-------------------------------------------------------------------
+// MFPLoopClock
+//
+// IPresentationClock over g_pPlayer. The loop wakeup is a one-shot
+// timer of the event loop.
+//-------------------------------------------------------------------
 
-BOOL CALLBACK EnumWindowsProc(HWND hWnd, LPARAM lParam)
+class MFPLoopClock : public IPresentationClock
 {
-	HWND hwnd = FindWindowEx(hWnd, NULL, L"SHELLDLL_DefView", NULL);
-	if (hwnd) {
-		HWND* ret = (HWND*)lParam;
-		*ret = FindWindowEx(NULL, hWnd, L"WorkerW", NULL);
-		return FALSE;
+public:
+	MFPLoopClock()
+	{
+		QueryPerformanceFrequency(&m_freq);
+	}
+
+	bool GetPosition(HNSTIME* phnsPosition) override
+	{
+		return g_pPlayer && SUCCEEDED(g_pPlayer->GetCurrentPosition(phnsPosition));
 	}
-	return TRUE;
-}
 
-BOOL CALLBACK EnumChildWndProc(HWND hWnd, LPARAM lParam)
+	float GetRate() override
+	{
+		return g_pPlayer ? g_pPlayer->GetRate() : 0.0f;
+	}
+
+	HNSTIME GetSystemTime() override
+	{
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		return now.QuadPart / m_freq.QuadPart * HNS_PER_SECOND +
+			now.QuadPart % m_freq.QuadPart * HNS_PER_SECOND / m_freq.QuadPart;
+	}
+
+	bool SeekToStart() override
+	{
+		return g_pPlayer && SUCCEEDED(g_pPlayer->SetPosition(0));
+	}
+
+	void ArmWakeup(HNSTIME hnsDelay) override
+	{
+		g_eventLoop.SetTimer(IDT_LOOP, hnsDelay);
+	}
+
+	void CancelWakeup() override
+	{
+		g_eventLoop.KillTimer(IDT_LOOP);
+	}
+
+private:
+	LARGE_INTEGER	m_freq;
+};
+
+//-------------------------------------------------------------------
+// MFPClipPlayer
+//
+// IClipPlayer over g_pPlayer. Preparing opens the next media item while
+// the current one keeps playing; the player reports the result as a
+// PLAYER_EVENT_PREPARED through g_playerEvents.
+//-------------------------------------------------------------------
+
+class MFPClipPlayer : public IClipPlayer
 {
-	TCHAR szClassName[100] = { 0 };
-	if (!GetClassNameW(hWnd, szClassName, 100))
-		return TRUE;
-	if (_tcscmp(szClassName, _T("WorkerW")) == 0) {
-		HWND* ret = (HWND*)lParam;
-		*ret = hWnd;
-		return FALSE;
+public:
+	bool Prepare(const std::wstring& path) override
+	{
+		return g_pPlayer && SUCCEEDED(g_pPlayer->PrepareURL(path.c_str()));
 	}
-	return TRUE;
-}
 
-HWND FindWorkerWnd(HWND hProgman)
+	bool IsPrepared() override
+	{
+		return g_pPlayer && g_pPlayer->IsPrepared();
+	}
+
+	bool SwitchToPrepared() override;
+
+	void CancelPrepared() override
+	{
+		if (g_pPlayer)
+			g_pPlayer->CancelPrepared();
+	}
+};
+
+//-------------------------------------------------------------------
+// AppPlaybackTarget
+//
+// IPlaybackTarget over g_pPlayer and the app's pause state.
+//-------------------------------------------------------------------
+
+class AppPlaybackTarget : public IPlaybackTarget
 {
-	if (!hProgman)
-		hProgman = FindWindow(L"Progman", NULL);
-	HWND hWorker = NULL;
-	EnumChildWindows(hProgman, EnumChildWndProc, (LPARAM)&hWorker);
-	if (!hWorker)
-		EnumWindows(EnumWindowsProc, (LPARAM)&hWorker);
-	return hWorker;
-}
+public:
+	bool Play() override
+	{
+		return g_pPlayer && g_pPlayer->Play();
+	}
+
+	bool Pause() override
+	{
+		return g_pPlayer && g_pPlayer->Pause();
+	}
+
+	bool GetDuration(HNSTIME* phnsDuration) override
+	{
+		return g_pPlayer && SUCCEEDED(g_pPlayer->GetDuration(phnsDuration));
+	}
+
+	bool IsPauseWanted() override;
+	void OnFirstFrame() override;
+	void OnClipStarted() override;
+};
+
+//-------------------------------------------------------------------
+// Win32WindowTree
+//
+// IWindowTree over the desktop's window hierarchy.
+//-------------------------------------------------------------------
+
+class Win32WindowTree : public IWindowTree
+{
+public:
+	HostWindow FindClass(HostWindow hParent, HostWindow hAfter, const wchar_t* pszClass) override
+	{
+		return (HostWindow)FindWindowExW((HWND)hParent, (HWND)hAfter, pszClass, NULL);
+	}
+
+	bool IsAlive(HostWindow hWnd) override
+	{
+		return IsWindow((HWND)hWnd) != FALSE;
+	}
+
+	void SpawnWorker(HostWindow hProgman) override
+	{
+		// 0x052C directs Progman to spawn a WorkerW behind the desktop
+		// icons. If it is already there, nothing happens.
+		SendMessageTimeout((HWND)hProgman, 0x052C, NULL, NULL, SMTO_NORMAL, 1000, NULL);
+	}
+};
+
+Win32WindowTree g_windowTree;
+DesktopHostTracker g_host(&g_windowTree, HostTrackerConfig());
+MFPLoopClock g_loopClock;
+LoopScheduler g_loop(&g_loopClock);
+MFPClipPlayer g_clipPlayer;
+PlaylistScheduler g_playlist(&g_clipPlayer, PlaylistConfig());
+AppPlaybackTarget g_playbackTarget;
+PlaybackController g_playback(&g_loop, &g_playlist, &g_playbackTarget);	// Follows the player with the loop and the playlist
+
+static_assert(PLAYER_STATE_STOPPED == (int)MFP_MEDIAPLAYER_STATE_STOPPED && PLAYER_STATE_PLAYING == (int)MFP_MEDIAPLAYER_STATE_PLAYING &&
+	PLAYER_STATE_PAUSED == (int)MFP_MEDIAPLAYER_STATE_PAUSED && PLAYER_STATE_SHUTDOWN == (int)MFP_MEDIAPLAYER_STATE_SHUTDOWN,
+	"PLAYER_STATE must number the states as MFPlay does");
+
+//-------------------------------------------------------------------
+// AppControlTarget
+//
+// Applies control commands from another instance to the running
+// player. Called on the window thread.
+//-------------------------------------------------------------------
+
+class AppControlTarget : public IControlTarget
+{
+public:
+	int32_t Open(const std::wstring& path) override;
+	int32_t Pause() override;
+	int32_t Resume() override;
+	int32_t Seek(HNSTIME hnsPosition) override;
+	int32_t SetRate(float fRate) override;
+	int32_t SetVolume(float fVolume) override;
+	int32_t QueryStats(ControlStats* pStats) override;
+};
+
+//-------------------------------------------------------------------
+// AppConfigTarget
+//
+// Applies a changed config file to the running player, which is never
+// recreated for it. The options it sets are written to g_options, where
+// the rest of the app reads them; g_config holds the new config already.
+//-------------------------------------------------------------------
+
+class AppConfigTarget : public IConfigTarget
+{
+public:
+	void SetPlaylist(const std::vector<PlaylistItem>& clips, const PlaylistConfig& playlist) override;
+	void SetAdaptive(bool bAdaptive) override;
+	void SetFrameRate(float fMaxFps, const PowerProfile* pProfiles) override;
+	void SetLayout(LAYOUT_MODE layout, SCALE_MODE scale, const std::vector<MonitorConfig>& monitors) override;
+	void SetAudio(float fVolume, bool bMute) override;
+};
+
+//-------------------------------------------------------------------
+// AppEventHandler
+//
+// Handles what g_eventLoop waited for: player events, timers, the
+// config watcher and window messages, all on the window thread.
+//-------------------------------------------------------------------
+
+class AppEventHandler : public IEventHandler
+{
+public:
+	AppEventHandler() : m_hAccelTable(NULL) {}
+
+	void SetAccelerators(HACCEL hAccelTable) { m_hAccelTable = hAccelTable; }
+
+	void OnEvent(uint32_t nEvent, uint64_t nValue, uint64_t fSeen) override;
+	void OnHandle(EVENT_HANDLE hObject) override;
+	void OnTimer(uint32_t nTimer) override;
+	void OnInput() override;
+
+private:
+	HACCEL	m_hAccelTable;
+};
+
+AppControlTarget g_controlTarget;
+AppConfigTarget g_configTarget;
+AppEventHandler g_eventHandler;
+ControlDispatcher g_control(&g_controlTarget);
+ControlPipeServer g_controlPipe;
+PlaybackGovernor g_governor = PlaybackGovernor(GovernorConfig());
+GovernorSignals g_signals(&g_governor);
+QualityController g_quality = QualityController(QualityConfig());	// Steps the quality ladder with --adaptive
+
+// Forward declarations of functions included in this code module:
+ATOM MyRegisterClass(HINSTANCE hInstance);
+HWND InitWindow(HWND hParent, int nCmdShow, int width, int height);
+HWND InitAppWindow();
+HRESULT CreatePlayer();
+void ClosePlayer();
+void ReattachHost();
+void OnPlayerEvents();
+void HookHost();
+LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
+INT_PTR CALLBACK About(HWND, UINT, WPARAM, LPARAM);
+void ApplyGovernorMode();
+void ApplyQualityRung();
+float GetMaxFrameRate();
+POWER_STATE GetPowerState();
+bool IsGovernorPaused();
+void UpdateLayout();
+void ArmPlaylistTimer();
+void InitOverlay();
+void TickOverlayClock();
+int32_t GetLocalSecondOfDay();
+bool RunControlCommands();
+void SampleProcessStats();
+void SampleQuality(float fProcessLoad, float fSystemLoad);
+void DumpStats();
+void WriteToConsole(const std::string& text);
+void RunBenchmarks();
+WallpaperConfig GetCommandLineConfig();
+bool LoadConfigFile(WallpaperConfig* pConfig, std::string* pError);
+void ReloadConfig();
+bool StartClipCache();
+std::wstring GetLocalDataDirectory(LPCWSTR pszName);
+std::string RunPrepare();
+std::string RunQualitySimulation();
+void ReportWakeups();
+int RunBroker();
+void CALLBACK HostEventProc(HWINEVENTHOOK, DWORD, HWND, LONG, LONG, DWORD, DWORD);
+void ShowErrorMessage(HWND hWnd, LPCWSTR lpCaption, HRESULT hrErr);
+void ParseCommandLine(int argc, LPWSTR* argv, AppOptions* pOptions);
 
 void RestoreWallPaper()
 {
@@ -82,85 +409,226 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 
 	(void)HeapSetInformation(NULL, HeapEnableTerminationOnCorruption, NULL, 0);
 
-	if (FAILED(CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE))) {
-		return 0;
-	}
-
 	hInst = hInstance; // Store instance handle in our global variable
 
     // Initialize global strings
     LoadStringW(hInstance, IDS_APP_TITLE, szTitle, MAX_LOADSTRING);
     LoadStringW(hInstance, IDC_LIVE_WALLPAPER, szWindowClass, MAX_LOADSTRING);
 
-	HWND hWorker = FindWorkerWnd(NULL);
-	if (hWorker) {
-		HWND hWnd = FindWindowEx(hWorker, NULL, szWindowClass, NULL);
-		if (hWnd) {
-			PostMessage(hWnd, WM_CLOSE, 0, 0);
+	ParseCommandLine(__argc, __wargv, &g_options);
+
+	// Players post to the event loop from their first event on.
+	if (!g_eventLoop.Initialize())
+		return 1;
+	g_eventLoop.SetHandler(&g_eventHandler);
+
+	// The config file overrides the command line; a file that does not
+	// parse is reported and nothing starts.
+	g_baseConfig = GetCommandLineConfig();
+	g_config = g_baseConfig;
+	if (!g_options.configPath.empty()) {
+		std::string error;
+		if (!LoadConfigFile(&g_config, &error)) {
+			WriteToConsole(error);
+			return 1;
 		}
+		ApplyWallpaperConfig(g_baseConfig, g_config, &g_configTarget);
 	}
 
-	if (__argc < 2) {
-		RestoreWallPaper();
+	if (g_options.bBenchKernels || g_options.nBenchDecode >= 0 || g_options.bBenchIndex || g_options.bPrepare ||
+		g_options.bSimulateQuality || g_options.bBenchConfig || g_options.bBenchSnapshot ||
+		g_options.bBenchQueue || g_options.bBenchOverlay || g_options.bBenchGenerative) {
+		RunBenchmarks();
 		return 0;
 	}
+	if (g_options.bBroker)
+		return RunBroker();
+
+	HWND hRunning = FindWindowW(szWindowClass, NULL);
+	if (hRunning) {
+		// Apply a clip change or commands in place; anything else
+		// replaces the running instance.
+		if (RunControlCommands())
+			return 0;
+		PostMessage(hRunning, WM_CLOSE, 0, 0);
+	}
 
-	// Find Program Manager window
-	HWND progman = FindWindow(L"Progman", NULL);
+	if (g_options.clips.empty() && !g_options.commands.empty())
+		return 0;
+	if (g_options.clips.empty()) {
+		RestoreWallPaper();
+		return 0;
+	}
+	if (!g_options.cacheDir.empty() && !StartClipCache())
+		printf("Clip cache not available!\n");
 
-	//SendMessage(progman, SPI_GETTOGGLEKEYS, 4, 0);
+	// Smaller variants of the clips join the ladder when the cache can make them.
+	if (g_options.bAdaptive) {
+		QualityConfig quality;
+		quality.rungs = GetDefaultQualityLadder(g_clipCache.IsEnabled());
+		g_quality = QualityController(quality);
+	}
 
-	// Send 0x052C to Progman. This message directs Progman to spawn a 
-	// WorkerW behind the desktop icons. If it is already there, nothing 
-	// happens.
-	SendMessageTimeout(progman, 0x052C, NULL, NULL, SMTO_NORMAL, 1000, NULL);
+	InitOverlay();
 
-	// We enumerate all Windows, until we find one, that has the SHELLDLL_DefView 
-	// as a child. 
-	// If we found that window, we take its next sibling and assign it to workerw.
-	hWorker = FindWorkerWnd(progman);
-	if (!hWorker) {
-		printf("WorkerW not found!\n");
-		return 1;
+	// The reader backend pre-rolls loops of indexed clips.
+	if (g_options.backend == PLAYER_BACKEND_SOURCE_READER) {
+		g_indexDirectory = GetLocalDataDirectory(L"Index");
+		if (!g_indexDirectory.empty() && !CreateDirectories(g_indexDirectory))
+			g_indexDirectory.clear();
 	}
 
-	RECT rect;
-	GetWindowRect(hWorker, &rect);
-	int width = rect.right - rect.left, height = rect.bottom - rect.top;
+	// Startup stages. Media Foundation starts and the first clip is opened
+	// and probed on worker threads while the shell window is found and the
+	// player window is created.
+	HRESULT hr = S_OK;
+	IMFMediaSource* pSource = NULL;
+	std::wstring sourcePath;
+	bool bMFStarted = false;
 
-    // Perform application initialization:
-	MyRegisterClass(hInstance);
-	HWND hWnd = InitWindow(hWorker, nCmdShow, width, height);
-    if (!hWnd)
-        return 0;
+	g_playlist.SetConfig(g_options.playlist);
+	g_playlist.SetItems(g_options.clips);
+	size_t nFirst = g_playlist.Start(g_loopClock.GetSystemTime(), GetLocalSecondOfDay());
+	LPCWSTR pszFirst = g_options.clips[nFirst].path.c_str();
 
-	HRESULT hr = MFPVideoPlayer::CreateInstance(hWnd, hWnd, &g_pPlayer);
-	if (SUCCEEDED(hr))
-		hr = g_pPlayer->OpenURL(__targv[1]);
-	if (FAILED(hr)) {
-		RestoreWallPaper();
-		return 0;
-	}
+	size_t nCom = g_startup.AddStage("com", STARTUP_THREAD_MAIN, [] {
+		return SUCCEEDED(CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE));
+	});
 
-	SetTimer(hWnd, 1, 250, NULL);
+	size_t nShell = g_startup.AddStage("shell", STARTUP_THREAD_MAIN, [] {
+		// Have Progman spawn the WorkerW behind the desktop icons and find it.
+		if (!g_host.Attach(true))
+			printf("WorkerW not found!\n");
+		g_hWorker = (HWND)g_host.GetHost();
+		return g_hWorker != NULL;
+	});
 
-	// Message loop
-	HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_LIVE_WALLPAPER));
-	MSG msg = {0};
+	size_t nWindow = g_startup.AddStage("window", STARTUP_THREAD_MAIN, [&] {
+		RECT rect;
+		GetWindowRect(g_hWorker, &rect);
+		int width = rect.right - rect.left, height = rect.bottom - rect.top;
 
-	while (GetMessage(&msg, NULL, 0, 0)) {
-		if (!TranslateAccelerator(msg.hwnd, hAccelTable, &msg)) {
-			TranslateMessage(&msg);
-			DispatchMessage(&msg);
+		// Perform application initialization:
+		MyRegisterClass(hInstance);
+		g_hWndApp = InitAppWindow();
+		if (!g_hWndApp)
+			return false;
+		g_hWndVideo = InitWindow(g_hWorker, nCmdShow, width, height);
+		if (!g_hWndVideo)
+			return false;
+
+		g_signals.Register(g_hWndApp);
+		if (FAILED(g_controlPipe.Start(g_hWndApp)))
+			printf("Control pipe not available!\n");
+		if (!g_options.configPath.empty() && SUCCEEDED(g_configWatcher.Start(g_options.configPath)))
+			g_eventLoop.AddHandle((EVENT_HANDLE)g_configWatcher.GetHandle());
+
+		// Move to the new desktop host when Explorer restarts.
+		g_uTaskbarCreated = RegisterWindowMessageW(L"TaskbarCreated");
+		ChangeWindowMessageFilterEx(g_hWndApp, g_uTaskbarCreated, MSGFLT_ALLOW, NULL);
+		HookHost();
+
+		if (g_options.pszStatsDump || g_options.bAdaptive) {
+			g_quality.Reset(g_loopClock.GetSystemTime());
+			g_stats.Enable(true);
+			g_eventLoop.SetPeriodicTimer(IDT_STATS, STATS_SAMPLE_MS * HNS_PER_MSEC, TIMER_TOLERANCE);
 		}
+		g_loop.SetStats(&g_stats);
+		g_playerEvents.SetStats(&g_stats);
+		return true;
+	});
+
+	size_t nMF = g_startup.AddStage("mf-startup", STARTUP_THREAD_WORKER, [&] {
+		bMFStarted = SUCCEEDED(MFStartup(MF_VERSION, MFSTARTUP_LITE));
+		return bMFStarted;
+	});
+
+	// Never fails: without a source the clip is opened by URL instead.
+	// The software and shared backends read their clips themselves, and
+	// the generative backend's clips are effect names. A
+	// missing container index is built here, so the player only maps it.
+	size_t nSource = g_startup.AddStage("open-source", STARTUP_THREAD_WORKER, [&] {
+		if ((g_options.backend == PLAYER_BACKEND_MFPLAY || g_options.backend == PLAYER_BACKEND_SOURCE_READER) &&
+			SUCCEEDED(CoInitializeEx(NULL, COINIT_MULTITHREADED))) {
+			sourcePath = g_clipCache.Resolve(pszFirst);
+			MFPVideoPlayer::ResolveSource(sourcePath.c_str(), g_options.cbLoopCache, &pSource);
+			CoUninitialize();
+		}
+		if (!g_indexDirectory.empty()) {
+			ContainerIndex index;
+			index.Open(sourcePath, ContainerIndex::GetIndexPath(g_indexDirectory, sourcePath));
+		}
+		return true;
+	});
+
+	size_t nPlayer = g_startup.AddStage("player", STARTUP_THREAD_MAIN, [&] {
+		hr = CreatePlayer();
+		return SUCCEEDED(hr);
+	});
+
+	size_t nOpen = g_startup.AddStage("open", STARTUP_THREAD_MAIN, [&] {
+		hr = pSource ? g_pPlayer->OpenSource(pSource, sourcePath.c_str()) : g_pPlayer->OpenURL(pszFirst);
+		if (FAILED(hr))
+			return false;
+		ArmPlaylistTimer();
+		return true;
+	});
+
+	g_startup.AddDependency(nWindow, nShell);
+	g_startup.AddDependency(nSource, nMF);
+	g_startup.AddDependency(nPlayer, nCom);
+	g_startup.AddDependency(nPlayer, nWindow);
+	g_startup.AddDependency(nPlayer, nMF);
+	g_startup.AddDependency(nOpen, nPlayer);
+	g_startup.AddDependency(nOpen, nSource);
+
+	bool bStarted = g_startup.Run();
+	SafeRelease(&pSource);
+	if (!bStarted) {
+		g_controlPipe.Stop();
+		g_eventLoop.RemoveHandle((EVENT_HANDLE)g_configWatcher.GetHandle());
+		g_configWatcher.Stop();
+		g_signals.Unregister();
+		if (g_hHostHook)
+			UnhookWinEvent(g_hHostHook);
+		if (g_pPlayer)
+			g_pPlayer->Shutdown();
+		SafeRelease(&g_pPlayer);
+		g_clipCache.Stop();
+		if (bMFStarted)
+			MFShutdown();
+		if (g_startup.GetStage(nCom).state == STARTUP_STAGE_DONE)
+			CoUninitialize();
+		if (g_startup.GetStage(nShell).state == STARTUP_STAGE_FAILED)
+			return 1;
+		RestoreWallPaper();
+		return 0;
 	}
 
+	// Event loop: window messages, player events, timers and the config
+	// watcher are waited for together.
+	g_eventHandler.SetAccelerators(LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_LIVE_WALLPAPER)));
+	int nExitCode = g_eventLoop.Run();
+
+	g_controlPipe.Stop();
+	g_eventLoop.RemoveHandle((EVENT_HANDLE)g_configWatcher.GetHandle());
+	g_configWatcher.Stop();
+	g_playlist.Stop();
+	if (g_stats.IsEnabled())
+		DumpStats();
+	g_signals.Unregister();
+	if (g_hHostHook)
+		UnhookWinEvent(g_hHostHook);
 	if (g_pPlayer)
 		g_pPlayer->Shutdown();
 	SafeRelease(&g_pPlayer);
+	g_clipCache.Stop();
+	MFShutdown();
+	if (g_options.bBenchStartup || g_options.nBenchWakeups)
+		RestoreWallPaper();
 
 	CoUninitialize();
-    return (int)msg.wParam;
+    return nExitCode;
 }
 
 
@@ -221,6 +689,33 @@ HWND InitWindow(HWND hParent, int nCmdShow, int width, int height)
    return hWnd;
 }
 
+//
+//   FUNCTION: InitAppWindow()
+//
+//   PURPOSE: Creates the hidden top-level window that receives the timers,
+//            player notifications and broadcasts such as TaskbarCreated.
+//
+//   COMMENTS:
+//
+//        It outlives the video window, which Explorer destroys along with
+//        the desktop host when it exits.
+//
+HWND InitAppWindow()
+{
+   return CreateWindowExW(
+	   WS_EX_TOOLWINDOW | WS_EX_NOACTIVATE,
+	   szWindowClass,
+	   szTitle,
+	   WS_POPUP,
+	   0, 0,
+	   0, 0,
+	   NULL,
+	   NULL,
+	   NULL,
+	   NULL
+   );
+}
+
 //
 //  FUNCTION: WndProc(HWND, UINT, WPARAM, LPARAM)
 //
@@ -230,11 +725,21 @@ HWND InitWindow(HWND hParent, int nCmdShow, int width, int height)
 //  WM_PAINT    - Paint the main window
 //  WM_DESTROY  - post a quit message and return
 //
+//  The app window and the video window share this procedure.
 //
 LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
     switch (message) {
 	case WM_DESTROY:
+		if (hWnd == g_hWndVideo) {
+			// The desktop host went away with Explorer: look for the new
+			// one once the old shell is gone.
+			g_hWndVideo = NULL;
+			ClosePlayer();
+			g_host.Invalidate();
+			g_eventLoop.SetTimer(IDT_HOST, HOST_RETRY_MS * HNS_PER_MSEC, TIMER_TOLERANCE);
+			break;
+		}
 		PostQuitMessage(0);
 		break;
 	case WM_COMMAND:
@@ -266,23 +771,166 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 	case WM_ERASEBKGND:
 		return 0;
 	case WM_TIMER:
-		OnTimer();
+	case WM_WTSSESSION_CHANGE:
+	case WM_APP_FOREGROUND:
+		if (g_signals.OnMessage(message, wParam, lParam))
+			ApplyGovernorMode();
 		break;
+	case WM_POWERBROADCAST:
+		if (g_signals.OnMessage(message, wParam, lParam))
+			ApplyGovernorMode();
+		return TRUE;
 
-	case WM_APP_NOTIFY:
-		OnPlayerNotify((MFP_MEDIAPLAYER_STATE)wParam);
-		break;
-	case WM_APP_ERROR:
-		ShowErrorMessage(hWnd, szTitle, (HRESULT)wParam);
-		PostMessage(hWnd, WM_CLOSE, 0, 0);
+	case WM_APP_CONTROL:
+	{
+		// The pipe thread may have stopped waiting; the call is still ours
+		// to complete and release.
+		ControlCall* pCall = (ControlCall*)lParam;
+		ControlMessage reply;
+		g_control.Dispatch(pCall->GetRequest(), &reply);
+		pCall->Complete(reply);
+		pCall->Release();
 		break;
+	}
 
     default:
+		if (g_uTaskbarCreated && message == g_uTaskbarCreated) {
+			g_host.Invalidate();
+			ReattachHost();
+			break;
+		}
         return DefWindowProc(hWnd, message, wParam, lParam);
     }
     return 0;
 }
 
+//
+//  FUNCTION: AppEventHandler::OnEvent
+//
+//  PURPOSE: Handles the player's events and the app's own.
+//
+void AppEventHandler::OnEvent(uint32_t nEvent, uint64_t, uint64_t)
+{
+	switch (nEvent) {
+	case APP_EVENT_PLAYER:
+		OnPlayerEvents();
+		break;
+	case APP_EVENT_LAYOUT:
+		ReattachHost();
+		break;
+	}
+}
+
+//
+//  FUNCTION: OnPlayerEvents()
+//
+//  PURPOSE: Handles the records the player posted since the last call.
+//
+//  COMMENTS:
+//
+//        Each type is handled once per batch, with its latest record, in
+//        type order; MFPlay reports its state on every event it raises,
+//        so most state records are repeats. If records were dropped the
+//        state is read from the player instead.
+//
+void OnPlayerEvents()
+{
+	PlayerEventBatch batch;
+	if (!g_playerEvents.TakeBatch(&batch))
+		return;
+
+	if (batch.fTypes & (1u << PLAYER_EVENT_ERROR)) {
+		// Rendering fails while Explorer tears the host down.
+		if (g_hWndVideo && IsWindow(g_hWorker)) {
+			ShowErrorMessage(g_hWndApp, szTitle, (HRESULT)batch.latest[PLAYER_EVENT_ERROR].hr);
+			PostMessage(g_hWndApp, WM_CLOSE, 0, 0);
+		}
+	}
+	if (batch.fTypes & (1u << PLAYER_EVENT_ENDED))
+		g_playback.OnPlaybackEnded();
+	if (batch.fTypes & (1u << PLAYER_EVENT_RATE))
+		g_playback.OnRateChanged();
+	if (batch.fTypes & (1u << PLAYER_EVENT_PREPARED)) {
+		g_playback.OnPrepared(SUCCEEDED((HRESULT)batch.latest[PLAYER_EVENT_PREPARED].hr), g_loopClock.GetSystemTime());
+		ArmPlaylistTimer();
+	}
+
+	if (batch.cDropped && g_pPlayer) {
+		MFP_MEDIAPLAYER_STATE state = g_pPlayer->GetState();
+		batch.fTypes |= 1u << PLAYER_EVENT_STATE;
+		batch.latest[PLAYER_EVENT_STATE].nState = (uint32_t)state;
+		batch.fStates |= 1ull << state;
+	}
+	if ((batch.fTypes & (1u << PLAYER_EVENT_STATE)) && g_pPlayer)
+		g_playback.OnPlayerState((PLAYER_STATE)batch.latest[PLAYER_EVENT_STATE].nState, batch.fStates);
+}
+
+//
+//  FUNCTION: AppEventHandler::OnHandle
+//
+//  PURPOSE: Handles a change in the directory of the config file.
+//
+void AppEventHandler::OnHandle(EVENT_HANDLE hObject)
+{
+	if (hObject != (EVENT_HANDLE)g_configWatcher.GetHandle())
+		return;
+	if (!g_configWatcher.Rearm()) {
+		g_eventLoop.RemoveHandle(hObject);
+		g_configWatcher.Stop();
+	}
+	// Restarted by every change, so the file is read once a save is done.
+	g_eventLoop.SetTimer(IDT_CONFIG, CONFIG_SETTLE_MS * HNS_PER_MSEC, TIMER_TOLERANCE);
+}
+
+void AppEventHandler::OnTimer(uint32_t nTimer)
+{
+	switch (nTimer) {
+	case IDT_LOOP:
+		g_playback.OnLoopTimer();
+		break;
+	case IDT_STATS:
+		SampleProcessStats();
+		break;
+	case IDT_PLAYLIST:
+		g_playback.OnPlaylistTimer(g_loopClock.GetSystemTime(), GetLocalSecondOfDay());
+		ArmPlaylistTimer();
+		break;
+	case IDT_HOST:
+		ReattachHost();
+		break;
+	case IDT_CONFIG:
+		ReloadConfig();
+		break;
+	case IDT_BENCH:
+		ReportWakeups();
+		PostQuitMessage(0);
+		break;
+	case IDT_OVERLAY:
+		TickOverlayClock();
+		break;
+	}
+}
+
+//
+//  FUNCTION: AppEventHandler::OnInput
+//
+//  PURPOSE: Dispatches the window messages that are waiting.
+//
+void AppEventHandler::OnInput()
+{
+	MSG msg;
+	while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+		if (msg.message == WM_QUIT) {
+			g_eventLoop.Quit((int)msg.wParam);
+			return;
+		}
+		if (!TranslateAccelerator(msg.hwnd, m_hAccelTable, &msg)) {
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+	}
+}
+
 // Message handler for about box.
 INT_PTR CALLBACK About(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
 {
@@ -303,41 +951,1465 @@ INT_PTR CALLBACK About(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
     return (INT_PTR)FALSE;
 }
 
-void OnTimer()
+//
+//  FUNCTION: CreatePlayer()
+//
+//  PURPOSE: Creates the player of the selected backend on the video window.
+//
+HRESULT CreatePlayer()
 {
-	if (g_pPlayer && g_duration > 0) {
-		MFTIME timeNow;
-		if (SUCCEEDED(g_pPlayer->GetCurrentPosition(&timeNow))) {
-			if (timeNow + ONE_MSEC > g_duration)
-				g_pPlayer->SetPosition(0);
-		}
+	HRESULT hr = CreateWallpaperPlayer(g_options.backend, &g_playerEvents, g_hWndVideo, &g_pPlayer);
+	if (FAILED(hr))
+		return hr;
+	g_pPlayer->SetStats(&g_stats);
+	g_pPlayer->SetLoopCacheBudget(g_options.cbLoopCache);
+	g_pPlayer->SetClipCache(g_clipCache.IsEnabled() ? &g_clipCache : NULL);
+	g_pPlayer->SetIndexDirectory(g_indexDirectory.empty() ? NULL : g_indexDirectory.c_str());
+	g_pPlayer->SetMaxFrameRate(GetMaxFrameRate());
+	g_pPlayer->SetVolume(g_config.fVolume);
+	g_pPlayer->SetMute(g_config.bMute);
+	if (!g_overlay.IsEmpty() && FAILED(g_pPlayer->SetOverlay(&g_overlay)))
+		printf("The overlay needs the software or shared backend!\n");
+	return S_OK;
+}
+
+//
+//  FUNCTION: ClosePlayer()
+//
+//  PURPOSE: Stops the loop and the playlist and releases the player.
+//
+void ClosePlayer()
+{
+	g_playback.ResetLoop();
+	g_playlist.Stop();
+	g_eventLoop.KillTimer(IDT_PLAYLIST);
+	if (g_pPlayer)
+		g_pPlayer->Shutdown();
+	SafeRelease(&g_pPlayer);
+}
+
+//
+//  FUNCTION: ReattachHost()
+//
+//  PURPOSE: Validates the desktop host and fits the video window to it,
+//           moving the wallpaper to a new host if the shell changed it.
+//
+//  COMMENTS:
+//
+//        A valid host costs two IsWindow calls. If the video window was
+//        destroyed with the old host, it and the player are created again
+//        and the playlist restarts. While no host exists, the lookup is
+//        retried on IDT_HOST.
+//
+void ReattachHost()
+{
+	g_eventLoop.KillTimer(IDT_HOST);
+	HNSTIME hnsNow = g_loopClock.GetSystemTime();
+	HOST_CHECK check = g_host.Check(hnsNow);
+	if (check == HOST_LOST) {
+		g_eventLoop.SetTimer(IDT_HOST, g_host.GetDeadline() - hnsNow);
+		return;
+	}
+
+	g_hWorker = (HWND)g_host.GetHost();
+	if (check == HOST_CHANGED)
+		HookHost();
+	RECT rcHost;
+	if (!GetWindowRect(g_hWorker, &rcHost))
+		return;
+
+	if (g_hWndVideo) {
+		if (check == HOST_CHANGED)
+			SetParent(g_hWndVideo, g_hWorker);
+		SetWindowPos(g_hWndVideo, NULL, 0, 0, Width(rcHost), Height(rcHost), SWP_NOZORDER | SWP_NOACTIVATE);
+		UpdateLayout();
+		return;
 	}
+
+	// The host found may still be going away with the old shell.
+	g_hWndVideo = InitWindow(g_hWorker, SW_SHOW, Width(rcHost), Height(rcHost));
+	if (!g_hWndVideo) {
+		g_host.Invalidate();
+		g_eventLoop.SetTimer(IDT_HOST, HOST_RETRY_MS * HNS_PER_MSEC, TIMER_TOLERANCE);
+		return;
+	}
+
+	HRESULT hr = CreatePlayer();
+	if (SUCCEEDED(hr)) {
+		size_t nClip = g_playlist.Start(hnsNow, GetLocalSecondOfDay());
+		hr = g_pPlayer->OpenURL(g_options.clips[nClip].path.c_str());
+		ArmPlaylistTimer();
+	}
+	if (FAILED(hr)) {
+		ShowErrorMessage(NULL, szTitle, hr);
+		PostMessage(g_hWndApp, WM_CLOSE, 0, 0);
+	}
+}
+
+//
+//  FUNCTION: HookHost()
+//
+//  PURPOSE: Watches the desktop host for moves and resizes.
+//
+//  COMMENTS:
+//
+//        Explorer resizes the host window to the new virtual screen when
+//        monitors are added, removed or rearranged, which needs a re-layout.
+//
+void HookHost()
+{
+	if (g_hHostHook)
+		UnhookWinEvent(g_hHostHook);
+	DWORD dwShellProcess = 0;
+	GetWindowThreadProcessId(g_hWorker, &dwShellProcess);
+	g_hHostHook = SetWinEventHook(EVENT_OBJECT_LOCATIONCHANGE, EVENT_OBJECT_LOCATIONCHANGE, NULL,
+		HostEventProc, dwShellProcess, 0, WINEVENT_OUTOFCONTEXT);
 }
 
-void OnPlayerNotify(MFP_MEDIAPLAYER_STATE state)
+//
+//  FUNCTION: AppPlaybackTarget::IsPauseWanted()
+//
+//  PURPOSE: A control command, the governor or the power profile holds
+//           playback paused.
+//
+bool AppPlaybackTarget::IsPauseWanted()
 {
-	switch (state) {
-	case MFP_MEDIAPLAYER_STATE_STOPPED:
-		g_pPlayer->Play();
-		break;
-	case MFP_MEDIAPLAYER_STATE_PLAYING:
-		if (!g_duration)
-			g_pPlayer->GetDuration(&g_duration);
-		break;
+	return g_bUserPaused || IsGovernorPaused();
+}
+
+//
+//  FUNCTION: AppPlaybackTarget::OnFirstFrame()
+//
+//  PURPOSE: Ends the startup trace, and starts counting wakeups for
+//           --bench-wakeups.
+//
+void AppPlaybackTarget::OnFirstFrame()
+{
+	g_startup.Mark("first-frame");
+	if (g_options.bBenchStartup) {
+		std::string report;
+		g_startup.FormatReport(&report);
+		WriteToConsole(report);
+		PostQuitMessage(0);
+	}
+	// Count the wakeups of playback from here, without startup's.
+	if (g_options.nBenchWakeups) {
+		g_eventLoop.ResetStats();
+		g_eventLoop.SetTimer(IDT_BENCH, g_options.nBenchWakeups * HNS_PER_SECOND);
 	}
 }
 
-void ShowErrorMessage(HWND hWnd, LPCWSTR lpCaption, HRESULT hrErr)
+void AppPlaybackTarget::OnClipStarted()
 {
-	WCHAR msg[300];
-	LPWSTR lpMessage;
-	DWORD dwLen = FormatMessageW(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM,
-		NULL, (DWORD)hrErr, NULL, (LPWSTR)&lpMessage, NULL, NULL);
-	if (dwLen > 0)
-		StringCbPrintf(msg, sizeof(msg), L"%s (hr=0x%X)", lpMessage, hrErr);
-	else
-		StringCbPrintf(msg, sizeof(msg), L"Playback error! (hr=0x%X)", hrErr);
+	UpdateLayout();
+}
+
+//
+//  FUNCTION: ApplyGovernorMode()
+//
+//  PURPOSE: Pauses or resumes the player after the governor changed mode
+//           or the power profiles changed.
+//
+void ApplyGovernorMode()
+{
+	if (!g_pPlayer)
+		return;
+
+	if (IsGovernorPaused()) {
+		g_pPlayer->Pause();
+		return;
+	}
+	g_pPlayer->SetMaxFrameRate(GetMaxFrameRate());
+	if (!g_bUserPaused)
+		g_pPlayer->Play();
+}
+
+//
+//  FUNCTION: GetPowerState()
+//
+//  PURPOSE: Power profile in effect.
+//
+//  COMMENTS:
+//
+//        The battery profiles take over when the governor downclocks, so
+//        they share its hysteresis.
+//
+POWER_STATE GetPowerState()
+{
+	if (g_governor.GetMode() != GOVERNOR_MODE_DOWNCLOCK)
+		return POWER_STATE_AC;
+	return g_governor.IsSignalActive(GOVERNOR_SIGNAL_BATTERY_SAVER) ? POWER_STATE_SAVER : POWER_STATE_BATTERY;
+}
+
+//
+//  FUNCTION: IsGovernorPaused()
+//
+//  PURPOSE: The governor or the power profile in effect pauses playback.
+//
+bool IsGovernorPaused()
+{
+	return g_governor.GetMode() == GOVERNOR_MODE_PAUSE || g_config.power[GetPowerState()].bPause;
+}
+
+//
+//  FUNCTION: ApplyQualityRung()
+//
+//  PURPOSE: Applies the frame rate cap and the clip variant of the quality
+//           rung after the controller stepped.
+//
+//  COMMENTS:
+//
+//        A rung of another variant size opens the clip again, from its
+//        start, only if that changes the file played: a variant that is
+//        not transcoded yet is queued, and picked up by the next open.
+//
+void ApplyQualityRung()
+{
+	if (!g_pPlayer)
+		return;
+
+	g_pPlayer->SetMaxFrameRate(GetMaxFrameRate());
+
+	uint32_t nScaleDown = g_quality.GetRungInfo().nScaleDown;
+	if (!g_clipCache.IsEnabled() || g_clipCache.GetScaleDown() == nScaleDown)
+		return;
+	const std::wstring& path = g_options.clips[g_playlist.GetCurrent()].path;
+	std::wstring played = g_clipCache.Resolve(path.c_str());
+	g_clipCache.SetScaleDown(nScaleDown);
+	if (g_clipCache.Resolve(path.c_str()) == played)
+		return;
+	g_playback.ResetLoop();
+	g_pPlayer->OpenURL(path.c_str());
+}
+
+//
+//  FUNCTION: GetMaxFrameRate()
+//
+//  PURPOSE: Frame rate cap of --max-fps, the power profile in effect and
+//           the quality rung, whichever is lowest. 0 = none.
+//
+float GetMaxFrameRate()
+{
+	float fMaxFps = g_options.fMaxFps;
+	float fPowerFps = g_config.power[GetPowerState()].fMaxFps;
+	if (fPowerFps > 0.0f && (fMaxFps <= 0.0f || fMaxFps > fPowerFps))
+		fMaxFps = fPowerFps;
+	float fRungFps = g_quality.GetRungInfo().fMaxFps;
+	if (g_options.bAdaptive && fRungFps > 0.0f && (fMaxFps <= 0.0f || fMaxFps > fRungFps))
+		fMaxFps = fRungFps;
+	return fMaxFps;
+}
+
+//
+//  FUNCTION: MFPClipPlayer::SwitchToPrepared()
+//
+//  PURPOSE: Swaps in the prepared clip. The loop restarts with the new
+//           clip's duration once it plays.
+//
+bool MFPClipPlayer::SwitchToPrepared()
+{
+	if (!g_pPlayer)
+		return false;
+	g_playback.ResetLoop();
+	return SUCCEEDED(g_pPlayer->SwitchToPrepared());
+}
+
+int32_t AppControlTarget::Open(const std::wstring& path)
+{
+	if (!g_pPlayer)
+		return E_UNEXPECTED;
+
+	// A missing file would fail asynchronously and close the wallpaper.
+	// Generative clips are effect names, which the player checks itself.
+	if (g_options.backend != PLAYER_BACKEND_GENERATIVE && path.find(L"://") == std::wstring::npos &&
+		GetFileAttributesW(path.c_str()) == INVALID_FILE_ATTRIBUTES)
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	PlaylistItem item;
+	item.path = path;
+	item.nStartOfDay = -1;
+	g_options.clips.assign(1, item);
+	g_playlist.Stop();
+	g_playlist.SetItems(g_options.clips);
+	g_playlist.Start(g_loopClock.GetSystemTime(), GetLocalSecondOfDay());
+	ArmPlaylistTimer();
+
+	g_playback.ResetLoop();
+	return g_pPlayer->OpenURL(path.c_str());
+}
+
+int32_t AppControlTarget::Pause()
+{
+	if (!g_pPlayer)
+		return E_UNEXPECTED;
+	g_bUserPaused = true;
+	return g_pPlayer->Pause() ? S_OK : E_FAIL;
+}
+
+int32_t AppControlTarget::Resume()
+{
+	if (!g_pPlayer)
+		return E_UNEXPECTED;
+	g_bUserPaused = false;
+	ApplyGovernorMode();
+	return S_OK;
+}
+
+int32_t AppControlTarget::Seek(HNSTIME hnsPosition)
+{
+	BOOL bCanSeek = FALSE;
+	if (!g_pPlayer || FAILED(g_pPlayer->CanSeek(&bCanSeek)) || !bCanSeek)
+		return MF_E_INVALIDREQUEST;
+	HRESULT hr = g_pPlayer->SetPosition(hnsPosition);
+	if (SUCCEEDED(hr) && g_loop.IsRunning()) {
+		g_loop.Stop();
+		g_loop.Start();
+	}
+	return hr;
+}
+
+int32_t AppControlTarget::SetRate(float fRate)
+{
+	// The loop is re-armed on WM_APP_RATE once the new rate applies.
+	return g_pPlayer && g_pPlayer->SetRate(fRate) ? S_OK : E_FAIL;
+}
+
+int32_t AppControlTarget::SetVolume(float fVolume)
+{
+	return g_pPlayer && g_pPlayer->SetVolume(fVolume) ? S_OK : E_FAIL;
+}
+
+int32_t AppControlTarget::QueryStats(ControlStats* pStats)
+{
+	if (!g_pPlayer)
+		return E_UNEXPECTED;
+
+	switch (g_pPlayer->GetState()) {
+	case MFP_MEDIAPLAYER_STATE_PLAYING:
+		pStats->nState = CONTROL_STATE_PLAYING;
+		break;
+	case MFP_MEDIAPLAYER_STATE_PAUSED:
+		pStats->nState = CONTROL_STATE_PAUSED;
+		break;
+	default:
+		pStats->nState = CONTROL_STATE_STOPPED;
+		break;
+	}
+	pStats->nMode = (uint32_t)g_governor.GetMode();
+	if (FAILED(g_pPlayer->GetCurrentPosition(&pStats->hnsPosition)))
+		pStats->hnsPosition = 0;
+	pStats->hnsDuration = g_loop.GetDuration();
+	pStats->fRate = g_pPlayer->GetRate();
+	pStats->fVolume = g_pPlayer->GetVolume();
+	pStats->cLoops = g_loop.GetLoopCount();
+	pStats->cMissedLoops = g_loop.GetMissedCount();
+	pStats->hnsSeekLatency = g_loop.GetSeekLatency();
+	pStats->nClip = (uint32_t)g_playlist.GetCurrent();
+	pStats->cClips = (uint32_t)g_playlist.GetItemCount();
+	return S_OK;
+}
+
+//
+//  FUNCTION: AppConfigTarget::SetPlaylist
+//
+//  PURPOSE: Restarts the playlist with new clips or rotation.
+//
+//  COMMENTS:
+//
+//        The clip played goes on if the new playlist starts with it, so
+//        changing only the interval or adding clips does not restart it.
+//
+void AppConfigTarget::SetPlaylist(const std::vector<PlaylistItem>& clips, const PlaylistConfig& playlist)
+{
+	std::wstring played;
+	if (g_pPlayer && g_playlist.GetCurrent() < g_options.clips.size())
+		played = g_options.clips[g_playlist.GetCurrent()].path;
+	g_options.clips = clips;
+	g_options.playlist = playlist;
+	if (!g_pPlayer)
+		return;
+
+	g_playlist.Stop();
+	g_playlist.SetConfig(playlist);
+	g_playlist.SetItems(clips);
+	size_t nClip = g_playlist.Start(g_loopClock.GetSystemTime(), GetLocalSecondOfDay());
+	ArmPlaylistTimer();
+	if (clips[nClip].path == played)
+		return;
+	g_playback.ResetLoop();
+	g_pPlayer->OpenURL(clips[nClip].path.c_str());
+}
+
+//
+//  FUNCTION: AppConfigTarget::SetAdaptive
+//
+//  PURPOSE: Turns the quality ladder on or off. Either way playback starts
+//           over from the top rung.
+//
+void AppConfigTarget::SetAdaptive(bool bAdaptive)
+{
+	g_options.bAdaptive = bAdaptive;
+	if (!g_pPlayer)
+		return;
+
+	QualityConfig quality;
+	quality.rungs = GetDefaultQualityLadder(g_clipCache.IsEnabled());
+	g_quality = QualityController(quality);
+	g_quality.Reset(g_loopClock.GetSystemTime());
+	if (bAdaptive) {
+		g_stats.Enable(true);
+		g_eventLoop.SetPeriodicTimer(IDT_STATS, STATS_SAMPLE_MS * HNS_PER_MSEC, TIMER_TOLERANCE);
+	}
+	else if (!g_options.pszStatsDump) {
+		g_eventLoop.KillTimer(IDT_STATS);
+	}
+	ApplyQualityRung();
+}
+
+void AppConfigTarget::SetFrameRate(float fMaxFps, const PowerProfile* pProfiles)
+{
+	UNREFERENCED_PARAMETER(pProfiles);	// Read from g_config
+	g_options.fMaxFps = fMaxFps;
+	ApplyGovernorMode();
+}
+
+void AppConfigTarget::SetLayout(LAYOUT_MODE layout, SCALE_MODE scale, const std::vector<MonitorConfig>& monitors)
+{
+	UNREFERENCED_PARAMETER(monitors);	// Read from g_config
+	g_options.layout = layout;
+	g_options.scale = scale;
+	UpdateLayout();
+}
+
+void AppConfigTarget::SetAudio(float fVolume, bool bMute)
+{
+	if (!g_pPlayer)
+		return;
+	g_pPlayer->SetVolume(fVolume);
+	g_pPlayer->SetMute(bMute);
+}
+
+//
+//  FUNCTION: RunControlCommands()
+//
+//  PURPOSE: Sends the clip and the commands of the command line to the
+//           running instance.
+//
+//  COMMENTS:
+//
+//        Only a single untimed clip can be opened in place; a playlist,
+//        a config file and the other options need a new instance. Replies
+//        are written to the console the command was started from.
+//
+bool RunControlCommands()
+{
+	const std::vector<PlaylistItem>& clips = g_options.clips;
+	if (clips.size() > 1 || (clips.size() == 1 && clips[0].nStartOfDay >= 0) || !g_options.configPath.empty())
+		return false;
+	if (clips.empty() && g_options.commands.empty())
+		return false;
+
+	std::vector<ControlMessage> requests;
+	if (!clips.empty()) {
+		ControlMessage open;
+		open.command = CONTROL_COMMAND_OPEN;
+		open.text = clips[0].path;
+		requests.push_back(open);
+	}
+	requests.insert(requests.end(), g_options.commands.begin(), g_options.commands.end());
+
+	std::vector<ControlMessage> replies;
+	if (FAILED(CallControlPipe(requests, &replies, CONTROL_TIMEOUT_MS)))
+		return false;
+
+	FILE* fp = NULL;
+	if (AttachConsole(ATTACH_PARENT_PROCESS))
+		freopen_s(&fp, "CONOUT$", "w", stdout);
+	for (size_t i = 0; i < replies.size(); i++) {
+		const ControlMessage& reply = replies[i];
+		if (FAILED(reply.nStatus)) {
+			printf("Command %u failed (hr=0x%X)\n", (unsigned)reply.command, (unsigned)reply.nStatus);
+			continue;
+		}
+		if (reply.command == CONTROL_COMMAND_QUERY_STATS) {
+			const ControlStats& stats = reply.stats;
+			printf("state=%u mode=%u position=%.3f duration=%.3f rate=%.2f volume=%.2f\n",
+				stats.nState, stats.nMode, (double)stats.hnsPosition / HNS_PER_SECOND,
+				(double)stats.hnsDuration / HNS_PER_SECOND, stats.fRate, stats.fVolume);
+			printf("loops=%u missed=%u seek-latency=%.1fms clip=%u/%u\n",
+				stats.cLoops, stats.cMissedLoops, (double)stats.hnsSeekLatency / HNS_PER_MSEC,
+				stats.nClip + 1, stats.cClips);
+		}
+	}
+	if (fp)
+		fclose(fp);
+	return true;
+}
+
+//
+//  FUNCTION: GetCommandLineConfig()
+//
+//  PURPOSE: The settings of the command line, as a config.
+//
+WallpaperConfig GetCommandLineConfig()
+{
+	WallpaperConfig config;
+	config.clips = g_options.clips;
+	config.playlist = g_options.playlist;
+	config.fMaxFps = g_options.fMaxFps;
+	config.layout = g_options.layout;
+	config.scale = g_options.scale;
+	config.bAdaptive = g_options.bAdaptive;
+	return config;
+}
+
+//
+//  FUNCTION: LoadConfigFile(WallpaperConfig*, std::string*)
+//
+//  PURPOSE: Reads the --config file over the command line's settings.
+//
+//  COMMENTS:
+//
+//        The file is parsed straight from its mapping. On failure pError
+//        gets the reason as "PATH(LINE,COLUMN): message".
+//
+bool LoadConfigFile(WallpaperConfig* pConfig, std::string* pError)
+{
+	MappedFile file;
+	if (!file.Open(g_options.configPath)) {
+		*pError = ToUtf8(g_options.configPath) + ": cannot read the config file\n";
+		return false;
+	}
+
+	ConfigError error;
+	if (ParseWallpaperConfig((const char*)file.GetData(), file.GetSize(), g_baseConfig, pConfig, &error))
+		return true;
+	char line[256];
+	StringCbPrintfA(line, sizeof(line), "(%u,%u): %s\n", error.nLine, error.nColumn, error.pszMessage);
+	*pError = ToUtf8(g_options.configPath) + line;
+	return false;
+}
+
+//
+//  FUNCTION: ReloadConfig()
+//
+//  PURPOSE: Reads the --config file again and applies what changed.
+//
+//  COMMENTS:
+//
+//        A file that does not parse, e.g. in the middle of an edit, leaves
+//        the settings as they are. Changes to other files of the directory
+//        also get here, and apply nothing.
+//
+void ReloadConfig()
+{
+	WallpaperConfig config;
+	std::string error;
+	if (!LoadConfigFile(&config, &error)) {
+		printf("%s", error.c_str());
+		return;
+	}
+	WallpaperConfig previous = g_config;
+	g_config = config;
+	ApplyWallpaperConfig(previous, g_config, &g_configTarget);
+}
+
+//
+//  FUNCTION: SampleProcessStats()
+//
+//  PURPOSE: Records the CPU load since the last sample and the working
+//           set, and dumps the stats every STATS_DUMP_SAMPLES samples.
+//
+void SampleProcessStats()
+{
+	static ULONGLONG s_nLastCpu = 0, s_nLastWall = 0;
+	static ULONGLONG s_nLastIdle = 0, s_nLastTotal = 0;
+	static UINT s_cSamples = 0;
+
+	FILETIME ftCreation, ftExit, ftKernel, ftUser, ftNow, ftIdle;
+	float fProcessLoad = 0.0f, fSystemLoad = 0.0f;
+	GetSystemTimeAsFileTime(&ftNow);
+	if (GetProcessTimes(GetCurrentProcess(), &ftCreation, &ftExit, &ftKernel, &ftUser)) {
+		ULONGLONG nCpu = ((ULONGLONG)ftKernel.dwHighDateTime << 32 | ftKernel.dwLowDateTime) +
+			((ULONGLONG)ftUser.dwHighDateTime << 32 | ftUser.dwLowDateTime);
+		ULONGLONG nWall = (ULONGLONG)ftNow.dwHighDateTime << 32 | ftNow.dwLowDateTime;
+		if (s_nLastWall && nWall > s_nLastWall) {
+			g_stats.Record(STATS_METRIC_CPU_LOAD, (int64_t)((nCpu - s_nLastCpu) * 1000 / (nWall - s_nLastWall)));
+			fProcessLoad = (float)(nCpu - s_nLastCpu) / (nWall - s_nLastWall) /
+				GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+		}
+		s_nLastCpu = nCpu;
+		s_nLastWall = nWall;
+	}
+
+	// Kernel time includes the idle time, summed over the cores.
+	if (GetSystemTimes(&ftIdle, &ftKernel, &ftUser)) {
+		ULONGLONG nIdle = (ULONGLONG)ftIdle.dwHighDateTime << 32 | ftIdle.dwLowDateTime;
+		ULONGLONG nTotal = ((ULONGLONG)ftKernel.dwHighDateTime << 32 | ftKernel.dwLowDateTime) +
+			((ULONGLONG)ftUser.dwHighDateTime << 32 | ftUser.dwLowDateTime);
+		if (s_nLastTotal && nTotal > s_nLastTotal)
+			fSystemLoad = 1.0f - (float)(nIdle - s_nLastIdle) / (nTotal - s_nLastTotal);
+		s_nLastIdle = nIdle;
+		s_nLastTotal = nTotal;
+	}
+	if (g_options.bAdaptive)
+		SampleQuality(fProcessLoad, fSystemLoad);
+
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		g_stats.Record(STATS_METRIC_WORKING_SET, (int64_t)(pmc.WorkingSetSize >> 10));
+
+	if (++s_cSamples % STATS_DUMP_SAMPLES == 0)
+		DumpStats();
+}
+
+//
+//  FUNCTION: SampleQuality(float, float)
+//
+//  PURPOSE: Feeds the frames counted since the last sample and the loads
+//           to the quality controller, and applies a new rung.
+//
+void SampleQuality(float fProcessLoad, float fSystemLoad)
+{
+	static uint64_t s_cPresented = 0, s_cDropped = 0, s_cLate = 0;
+
+	uint64_t cPresented = g_stats.GetCounter(STATS_COUNTER_FRAMES_PRESENTED);
+	uint64_t cDropped = g_stats.GetCounter(STATS_COUNTER_FRAMES_DROPPED);
+	uint64_t cLate = g_stats.GetCounter(STATS_COUNTER_FRAMES_LATE);
+	QualitySample sample;
+	sample.hnsTime = g_loopClock.GetSystemTime();
+	sample.cPresented = cPresented - s_cPresented;
+	sample.cDropped = cDropped - s_cDropped;
+	sample.cLate = cLate - s_cLate;
+	sample.fSystemLoad = fSystemLoad;
+	sample.fProcessLoad = fProcessLoad;
+	s_cPresented = cPresented;
+	s_cDropped = cDropped;
+	s_cLate = cLate;
+
+	// Paused or covered, the player shows nothing and costs nothing.
+	if (g_bUserPaused || IsGovernorPaused())
+		sample.cPresented = sample.cDropped = 0;
+	if (g_quality.OnSample(sample))
+		ApplyQualityRung();
+}
+
+//
+//  FUNCTION: DumpStats()
+//
+//  PURPOSE: Writes the stats to the --stats-dump file, as CSV if its name
+//           ends in .csv and as JSON otherwise.
+//
+void DumpStats()
+{
+	LPCWSTR pszPath = g_options.pszStatsDump;
+	if (!pszPath)
+		return;
+
+	std::string text;
+	size_t cchPath = wcslen(pszPath);
+	if (cchPath >= 4 && _wcsicmp(pszPath + cchPath - 4, L".csv") == 0)
+		FormatStatsCsv(g_stats, &text);
+	else
+		FormatStatsJson(g_stats, &text);
+
+	HANDLE hFile = CreateFileW(pszPath, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return;
+	DWORD cbWritten = 0;
+	WriteFile(hFile, text.data(), (DWORD)text.size(), &cbWritten, NULL);
+	CloseHandle(hFile);
+}
+
+//
+//  FUNCTION: WriteToConsole(const std::string&)
+//
+//  PURPOSE: Writes text to the console the app was started from, if any.
+//
+void WriteToConsole(const std::string& text)
+{
+	FILE* fp = NULL;
+	if (!AttachConsole(ATTACH_PARENT_PROCESS) || freopen_s(&fp, "CONOUT$", "w", stdout) != 0)
+		return;
+	fputs(text.c_str(), stdout);
+	fclose(fp);
+}
+
+//
+//  FUNCTION: RunBenchmarks()
+//
+//  PURPOSE: Runs the pixel kernel, CPU decode and clip cache benchmarks the
+//           options ask for and prints the results.
+//
+void RunBenchmarks()
+{
+	std::string report;
+	char line[256];
+
+	if (g_options.bBenchKernels) {
+		KernelBenchResult results[KERNEL_ISA_COUNT * 8];
+		size_t cResults = RunKernelBench(1920, 1080, BENCH_KERNEL_PASSES, results, ARRAYSIZE(results));
+		for (size_t i = 0; i < cResults; i++) {
+			StringCbPrintfA(line, sizeof(line), "%-16s %-7s %9.1f Mpixel/s%s\n", results[i].pszKernel,
+				GetKernelIsaName(results[i].isa), results[i].fMegapixelsPerSecond, results[i].bExact ? "" : "  MISMATCH");
+			report += line;
+		}
+	}
+
+	for (size_t i = 0; g_options.nBenchDecode >= 0 && i < g_options.clips.size(); i++) {
+		DecodeBenchResult result;
+		if (!RunDecodeBench(g_options.clips[i].path, (uint32_t)g_options.nBenchDecode, BENCH_DECODE_PASSES, &result)) {
+			StringCbPrintfA(line, sizeof(line), "clip %u: not a Y4M clip\n", (unsigned)i);
+		}
+		else {
+			StringCbPrintfA(line, sizeof(line), "clip %u: %llu frames on %u threads in %.2f s, %.1f fps, %.1f fps/core\n",
+				(unsigned)i, (unsigned long long)result.cFrames, result.cThreads, result.fSeconds,
+				result.fFramesPerSecond, result.fFramesPerSecondPerCore);
+		}
+		report += line;
+	}
+
+	if (g_options.bBenchIndex)
+		CreateDirectories(GetLocalDataDirectory(L"Index"));
+	for (size_t i = 0; g_options.bBenchIndex && i < g_options.clips.size(); i++) {
+		const std::wstring& path = g_options.clips[i].path;
+		IndexBenchResult result;
+		if (!RunIndexBench(path, ContainerIndex::GetIndexPath(GetLocalDataDirectory(L"Index"), path),
+			BENCH_INDEX_LOOKUPS, &result)) {
+			StringCbPrintfA(line, sizeof(line), "clip %u: no MP4 sample tables to index\n", (unsigned)i);
+		}
+		else {
+			StringCbPrintfA(line, sizeof(line),
+				"clip %u: %u frames, %u keyframes; build %.2f ms, save %.2f ms, map %.3f ms, lookup %.1f ns%s\n",
+				(unsigned)i, result.cFrames, (unsigned)result.cKeyframes, result.fBuildMs, result.fSaveMs,
+				result.fMapMs, result.fLookupNs, result.bMapped ? "" : "  NOT MAPPED");
+		}
+		report += line;
+	}
+
+	if (g_options.bPrepare)
+		report += RunPrepare();
+	if (g_options.bSimulateQuality)
+		report += RunQualitySimulation();
+
+	// The --config file, or generated configs of a growing number of clips.
+	std::vector<std::string> configNames, configTexts;
+	MappedFile configFile;
+	if (g_options.bBenchConfig && !g_options.configPath.empty()) {
+		if (configFile.Open(g_options.configPath)) {
+			configNames.push_back(ToUtf8(g_options.configPath));
+			configTexts.push_back(std::string((const char*)configFile.GetData(), configFile.GetSize()));
+		}
+		else {
+			report += "config not readable: " + ToUtf8(g_options.configPath) + "\n";
+		}
+	}
+	else if (g_options.bBenchConfig) {
+		static const size_t s_cClips[] = { 10, 1000, 100000 };
+		for (size_t i = 0; i < ARRAYSIZE(s_cClips); i++) {
+			StringCbPrintfA(line, sizeof(line), "%u clips", (unsigned)s_cClips[i]);
+			configNames.push_back(line);
+			configTexts.push_back(MakeBenchConfig(s_cClips[i]));
+		}
+	}
+	for (size_t i = 0; i < configTexts.size(); i++) {
+		ConfigBenchResult result;
+		if (!RunConfigBench(configTexts[i], g_baseConfig, BENCH_CONFIG_PASSES, &result)) {
+			StringCbPrintfA(line, sizeof(line), "config %s: (%u,%u): %s\n", configNames[i].c_str(), result.error.nLine,
+				result.error.nColumn, result.error.pszMessage);
+		}
+		else {
+			StringCbPrintfA(line, sizeof(line),
+				"config %s: %.1f KB, %u tokens; parse %.3f ms, %.1f MB/s; scan %.3f ms, %.1f MB/s\n",
+				configNames[i].c_str(), result.cbText / 1024.0, result.cTokens, result.fParseMs,
+				result.fParseMs > 0.0 ? result.cbText / result.fParseMs / 1e3 : 0.0, result.fScanMs,
+				result.fScanMs > 0.0 ? result.cbText / result.fScanMs / 1e3 : 0.0);
+		}
+		report += line;
+	}
+
+	// One writer against a growing number of readers, up to one per core.
+	uint32_t cCores = std::thread::hardware_concurrency();
+	for (uint32_t cReaders = 1; g_options.bBenchSnapshot && (cReaders == 1 || cReaders <= cCores); cReaders *= 2) {
+		SnapshotBenchResult result;
+		if (!RunSnapshotBench(cReaders, BENCH_SNAPSHOT_TIME, &result))
+			break;
+		StringCbPrintfA(line, sizeof(line), "snapshot, %u readers: %7.1f M writes/s %7.1f M reads/s%s\n",
+			result.cReaders, result.fWritesPerSecond / 1e6, result.fReadsPerSecond / 1e6,
+			result.cTorn ? "  TORN READS" : "");
+		report += line;
+	}
+
+	// Producers of player events, up to one per core, against one consumer.
+	for (uint32_t cProducers = 1; g_options.bBenchQueue && (cProducers == 1 || cProducers <= cCores); cProducers *= 2) {
+		EventQueueBenchResult result;
+		if (!RunEventQueueBench(cProducers, BENCH_QUEUE_TIME, &result))
+			break;
+		StringCbPrintfA(line, sizeof(line), "event queue, %u producers: %7.1f M events/s, mutex+deque %7.1f M events/s%s\n",
+			result.cProducers, result.fQueueEventsPerSecond / 1e6, result.fMutexEventsPerSecond / 1e6,
+			result.cLost ? "  LOST EVENTS" : "");
+		report += line;
+	}
+
+	if (g_options.bBenchOverlay) {
+		OverlayBenchResult results[KERNEL_ISA_COUNT];
+		size_t cResults = RunOverlayBench(3840, 2160, BENCH_OVERLAY_FRAMES, results, ARRAYSIZE(results));
+		for (size_t i = 0; i < cResults; i++) {
+			StringCbPrintfA(line, sizeof(line),
+				"overlay %-7s %.1f%% covered: new frame %.3f ms, clock tick %.3f ms, full-frame blend %.3f ms%s\n",
+				GetKernelIsaName(results[i].isa), results[i].fCoverage * 100, results[i].fFrameMs, results[i].fTickMs,
+				results[i].fFullMs, results[i].bExact ? "" : "  MISMATCH");
+			report += line;
+		}
+	}
+
+	// Each effect at 1080p and 4K, on 1, 2, 4... threads up to one per core.
+	static const SIZE s_generativeSizes[] = { { 1920, 1080 }, { 3840, 2160 } };
+	for (int e = 0; g_options.bBenchGenerative && e < GENERATIVE_EFFECT_COUNT; e++) {
+		for (size_t n = 0; n < ARRAYSIZE(s_generativeSizes); n++) {
+			uint64_t nChecksum = 0;
+			for (uint32_t cThreads = 1; cThreads == 1 || cThreads <= cCores; cThreads *= 2) {
+				GenerativeBenchResult result;
+				if (!RunGenerativeBench((GENERATIVE_EFFECT)e, s_generativeSizes[n].cx, s_generativeSizes[n].cy, cThreads,
+					BENCH_GENERATIVE_FRAMES, &result))
+					break;
+				StringCbPrintfA(line, sizeof(line), "%-9s %ux%u, %u threads: %7.2f ms/frame, %5.1f%% of the tiles%s\n",
+					GetGenerativeEffectName(result.effect), result.cx, result.cy, result.cThreads, result.fFrameMs,
+					result.fDirtyShare * 100, cThreads > 1 && result.nChecksum != nChecksum ? "  MISMATCH" : "");
+				report += line;
+				nChecksum = result.nChecksum;
+			}
+		}
+	}
+	WriteToConsole(report);
+}
+
+//
+//  FUNCTION: RunQualitySimulation()
+//
+//  PURPOSE: Replays load traces through the quality controller and reports
+//           the CPU and the dropped and late frames against holding the
+//           top rung, with the timeline of a trace given as a file.
+//
+//  COMMENTS:
+//
+//        The simulated machine is QualityModel's, not this one, so the
+//        results are the same everywhere.
+//
+std::string RunQualitySimulation()
+{
+	QualityConfig config;
+	config.rungs = GetDefaultQualityLadder(!g_options.cacheDir.empty());
+	QualitySimulator simulator(config, QualityModel());
+	if (g_options.qualityTrace.empty()) {
+		std::string report;
+		std::vector<LoadTrace> traces = GetBuiltInLoadTraces();
+		for (size_t i = 0; i < traces.size(); i++)
+			report += simulator.Report(traces[i], false);
+		return report;
+	}
+
+	LoadTrace trace;
+	if (!LoadLoadTrace(g_options.qualityTrace, &trace))
+		return "load trace not readable: " + ToUtf8(g_options.qualityTrace) + "\n";
+	return simulator.Report(trace, true);
+}
+
+//
+//  FUNCTION: ReportWakeups()
+//
+//  PURPOSE: Prints the wakeups of the event loop per minute of playback,
+//           by what woke it, for --bench-wakeups.
+//
+void ReportWakeups()
+{
+	EventLoopStats stats;
+	g_eventLoop.GetStats(&stats);
+	double fMinutes = (double)stats.hnsElapsed / (60 * HNS_PER_SECOND);
+	if (fMinutes <= 0.0)
+		return;
+
+	char line[512];
+	StringCbPrintfA(line, sizeof(line),
+		"event loop: %.1f s of playback, %.1f wakeups/min\n"
+		"  timers %.1f/min, posted events %.1f/min, handles %.1f/min, window messages %.1f/min, idle %.1f/min\n"
+		"  %llu posts coalesced into %llu events, %llu timers fired\n",
+		fMinutes * 60.0, stats.cWakeups / fMinutes, stats.cTimerWakeups / fMinutes, stats.cPostWakeups / fMinutes,
+		stats.cHandleWakeups / fMinutes, stats.cInputWakeups / fMinutes, stats.cIdleWakeups / fMinutes,
+		(unsigned long long)stats.cPosts, (unsigned long long)stats.cEvents, (unsigned long long)stats.cTimers);
+	WriteToConsole(line);
+}
+
+//
+//  FUNCTION: RunBroker()
+//
+//  PURPOSE: Publishes the first clip for the --backend=shared instances of
+//           every session until the process is ended or another broker
+//           takes the clip over.
+//
+int RunBroker()
+{
+	if (g_options.clips.empty())
+		return 1;
+	const std::wstring& path = g_options.clips[0].path;
+	HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	bool bMFStarted = SUCCEEDED(MFStartup(MF_VERSION, MFSTARTUP_LITE));
+
+	FrameBroker broker;
+	HRESULT hr = bMFStarted ? broker.Start(path) : E_FAIL;
+	char line[256];
+	StringCbPrintfA(line, sizeof(line), SUCCEEDED(hr) ? "broker: publishing %s\n" : "broker: cannot publish %s (hr=0x%X)\n",
+		ToUtf8(path).c_str(), (unsigned)hr);
+	WriteToConsole(line);
+	while (SUCCEEDED(hr) && !broker.IsStopped()) {
+		Sleep(BROKER_REPORT_MS);
+		WriteToConsole("broker: " + broker.GetReport());
+	}
+	broker.Stop();
+
+	if (bMFStarted)
+		MFShutdown();
+	if (SUCCEEDED(hrCom))
+		CoUninitialize();
+	return SUCCEEDED(hr) ? 0 : 1;
+}
+
+//
+//  FUNCTION: GetLocalDataDirectory(LPCWSTR)
+//
+//  PURPOSE: %LOCALAPPDATA%\LiveWallpaper\<pszName>, empty if there is no
+//           local app data folder.
+//
+std::wstring GetLocalDataDirectory(LPCWSTR pszName)
+{
+	std::wstring directory;
+	PWSTR pszLocal = NULL;
+	if (SUCCEEDED(SHGetKnownFolderPath(FOLDERID_LocalAppData, 0, NULL, &pszLocal))) {
+		directory = pszLocal;
+		directory += L"\\LiveWallpaper\\";
+		directory += pszName;
+	}
+	CoTaskMemFree(pszLocal);
+	return directory;
+}
+
+//
+//  FUNCTION: StartClipCache()
+//
+//  PURPOSE: Turns on the clip cache for the virtual desktop, capped at
+//           the smaller of the cache rate and --max-fps.
+//
+bool StartClipCache()
+{
+	CacheTarget target;
+	target.cxDesktop = (uint32_t)GetSystemMetrics(SM_CXVIRTUALSCREEN);
+	target.cyDesktop = (uint32_t)GetSystemMetrics(SM_CYVIRTUALSCREEN);
+	if (g_options.fMaxFps > 0.0f && g_options.fMaxFps < DEFAULT_CACHE_MAX_FPS)
+		target.maxRate = FrameRateFromDouble(g_options.fMaxFps);
+	return g_clipCache.Start(g_options.cacheDir, target);
+}
+
+//
+//  FUNCTION: RunPrepare()
+//
+//  PURPOSE: Transcodes every clip into the cache and reports the one-time
+//           cost against the decode time it saves on each play.
+//
+std::string RunPrepare()
+{
+	std::string report;
+	char line[256];
+
+	if (g_options.cacheDir.empty())
+		g_options.cacheDir = GetLocalDataDirectory(L"Cache");
+	HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	bool bMFStarted = SUCCEEDED(MFStartup(MF_VERSION, MFSTARTUP_LITE));
+	if (!bMFStarted || !StartClipCache())
+		report += "clip cache not available\n";
+
+	for (size_t i = 0; g_clipCache.IsEnabled() && i < g_options.clips.size(); i++) {
+		const std::wstring& path = g_options.clips[i].path;
+		TranscodeResult result;
+		uint64_t cSourceFrames = 0, cCachedFrames = 0;
+		double fSourceSeconds = 0.0, fCachedSeconds = 0.0;
+		HRESULT hr = ClipCache::MeasureDecode(path.c_str(), &cSourceFrames, &fSourceSeconds);
+		if (SUCCEEDED(hr))
+			hr = g_clipCache.Prepare(path, &result);
+		if (SUCCEEDED(hr))
+			hr = ClipCache::MeasureDecode(g_clipCache.GetCachedPath(path).c_str(), &cCachedFrames, &fCachedSeconds);
+		if (FAILED(hr)) {
+			StringCbPrintfA(line, sizeof(line), "clip %u: failed (hr=0x%X)\n", (unsigned)i, (unsigned)hr);
+			report += line;
+			continue;
+		}
+
+		// A play of the cached copy saves the difference; the transcode is
+		// paid back after this many plays.
+		double fSaved = fSourceSeconds - fCachedSeconds;
+		StringCbPrintfA(line, sizeof(line),
+			"clip %u: prepared %ux%u, %llu frames in %.2f s; decode %.2f ms/frame source, %.2f ms/frame cached; ",
+			(unsigned)i, result.cx, result.cy, (unsigned long long)result.cFrames, result.fSeconds,
+			cSourceFrames ? fSourceSeconds * 1000.0 / cSourceFrames : 0.0,
+			cCachedFrames ? fCachedSeconds * 1000.0 / cCachedFrames : 0.0);
+		report += line;
+		if (fSaved > 0.0)
+			StringCbPrintfA(line, sizeof(line), "pays back after %.1f plays\n", result.fSeconds / fSaved);
+		else
+			StringCbPrintfA(line, sizeof(line), "no decode saving\n");
+		report += line;
+	}
+
+	g_clipCache.Stop();
+	if (bMFStarted)
+		MFShutdown();
+	if (SUCCEEDED(hrCom))
+		CoUninitialize();
+	return report;
+}
+
+//
+//  FUNCTION: ArmPlaylistTimer()
+//
+//  PURPOSE: Sets the one-shot playlist timer for the next prefetch or switch.
+//
+void ArmPlaylistTimer()
+{
+	HNSTIME hnsDelay = g_playback.GetPlaylistDelay(g_loopClock.GetSystemTime());
+	if (hnsDelay < 0)
+		g_eventLoop.KillTimer(IDT_PLAYLIST);
+	else
+		g_eventLoop.SetTimer(IDT_PLAYLIST, hnsDelay);
+}
+
+//
+//  FUNCTION: InitOverlay()
+//
+//  PURPOSE: Adds the widgets of --overlay-clock and --overlay-text and
+//           starts the clock.
+//
+void InitOverlay()
+{
+	OverlayTextStyle style = GetDefaultOverlayTextStyle();
+	if (!g_options.overlayText.empty()) {
+		OverlayPlacement placement = { OVERLAY_ANCHOR_TOP_LEFT, OVERLAY_MARGIN, OVERLAY_MARGIN };
+		g_overlay.AddText(ToUtf8(g_options.overlayText).c_str(), style, placement);
+	}
+	if (g_options.bOverlayClock) {
+		OverlayPlacement placement = { OVERLAY_ANCHOR_BOTTOM_RIGHT, OVERLAY_MARGIN, OVERLAY_MARGIN };
+		g_overlay.SetTime(GetLocalSecondOfDay());
+		g_overlay.AddClock(g_options.bOverlaySeconds, style, placement);
+		TickOverlayClock();
+	}
+}
+
+//
+//  FUNCTION: TickOverlayClock()
+//
+//  PURPOSE: Sets the overlay clock to the local time, redraws it if it
+//           changed and sets the timer for the next change.
+//
+//  COMMENTS:
+//
+//        Only the clock's pixels are composed and copied again, over the
+//        frame on screen, so a paused or slow clip still shows the time.
+//
+void TickOverlayClock()
+{
+	if (g_overlay.SetTime(GetLocalSecondOfDay()) && g_pPlayer)
+		g_pPlayer->UpdateOverlay();
+
+	SYSTEMTIME st;
+	GetLocalTime(&st);
+	HNSTIME hnsDelay = (1000 - st.wMilliseconds) * HNS_PER_MSEC;
+	if (!g_options.bOverlaySeconds)
+		hnsDelay += (59 - st.wSecond) * HNS_PER_SECOND;
+	g_eventLoop.SetTimer(IDT_OVERLAY, hnsDelay);
+}
+
+int32_t GetLocalSecondOfDay()
+{
+	SYSTEMTIME st;
+	GetLocalTime(&st);
+	return (st.wHour * 60 + st.wMinute) * 60 + st.wSecond;
+}
+
+struct MonitorScan
+{
+	RECT						rcHost;
+	std::vector<MonitorDesc>*	pMonitors;
+	std::vector<std::wstring>*	pDevices;	// Device names for the config's monitor settings
+};
+
+BOOL CALLBACK EnumMonitorsProc(HMONITOR hMonitor, HDC hdc, LPRECT lprcMonitor, LPARAM lParam)
+{
+	UNREFERENCED_PARAMETER(hdc);
+	MonitorScan* pScan = (MonitorScan*)lParam;
+
+	UINT dpiX = 96, dpiY = 96;
+	if (FAILED(GetDpiForMonitor(hMonitor, MDT_EFFECTIVE_DPI, &dpiX, &dpiY)))
+		dpiX = 96;
+
+	// Monitor rectangles relative to the host window.
+	MonitorDesc desc;
+	desc.rcMonitor.left = lprcMonitor->left - pScan->rcHost.left;
+	desc.rcMonitor.top = lprcMonitor->top - pScan->rcHost.top;
+	desc.rcMonitor.right = lprcMonitor->right - pScan->rcHost.left;
+	desc.rcMonitor.bottom = lprcMonitor->bottom - pScan->rcHost.top;
+	desc.nDpi = dpiX;
+	pScan->pMonitors->push_back(desc);
+
+	MONITORINFOEXW info;
+	info.cbSize = sizeof(info);
+	if (!GetMonitorInfoW(hMonitor, &info))
+		info.szDevice[0] = L'\0';
+	pScan->pDevices->push_back(info.szDevice);
+	return TRUE;
+}
+
+//
+//  FUNCTION: UpdateLayout()
+//
+//  PURPOSE: Maps the video onto the monitors with the selected layout.
+//
+//  COMMENTS:
+//
+//        Monitors the config disables stay dark. If the player cannot
+//        show per-monitor viewports, the video is spanned over the host
+//        window instead.
+//
+void UpdateLayout()
+{
+	SIZE szVideo;
+	RECT rcHost;
+	if (!g_pPlayer || !g_hWorker || FAILED(g_pPlayer->GetVideoSize(&szVideo)) ||
+		!GetWindowRect(g_hWorker, &rcHost))
+		return;
+
+	LayoutParams params = { (uint32_t)szVideo.cx, (uint32_t)szVideo.cy, g_options.layout, g_options.scale };
+	std::vector<MonitorDesc> monitors;
+	std::vector<std::wstring> devices;
+	MonitorScan scan = { rcHost, &monitors, &devices };
+	EnumDisplayMonitors(NULL, NULL, EnumMonitorsProc, (LPARAM)&scan);
+
+	std::vector<Viewport> viewports;
+	if (SolveConfiguredLayout(params, monitors.data(), devices.data(), monitors.size(), g_config.monitors,
+		&viewports) &&
+		SUCCEEDED(g_pPlayer->SetViewports(viewports.data(), viewports.size(), szVideo)))
+		return;
+
+	MonitorDesc host;
+	host.rcMonitor.left = host.rcMonitor.top = 0;
+	host.rcMonitor.right = Width(rcHost);
+	host.rcMonitor.bottom = Height(rcHost);
+	host.nDpi = 96;
+	params.layout = LAYOUT_SPAN;
+	if (SolveMonitorLayout(params, &host, 1, &viewports))
+		g_pPlayer->SetViewports(viewports.data(), viewports.size(), szVideo);
+}
+
+//
+//  FUNCTION: HostEventProc
+//
+//  PURPOSE: Posts a re-layout when the desktop host window changed size.
+//
+//  COMMENTS:
+//
+//        A drag or resize raises a burst of these; the event loop folds
+//        them into one re-layout.
+//
+void CALLBACK HostEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd,
+	LONG idObject, LONG idChild, DWORD idEventThread, DWORD dwmsEventTime)
+{
+	UNREFERENCED_PARAMETER(hWinEventHook);
+	UNREFERENCED_PARAMETER(event);
+	UNREFERENCED_PARAMETER(idChild);
+	UNREFERENCED_PARAMETER(idEventThread);
+	UNREFERENCED_PARAMETER(dwmsEventTime);
+
+	if (hwnd != g_hWorker || idObject != OBJID_WINDOW)
+		return;
+
+	g_eventLoop.Post(APP_EVENT_LAYOUT);
+}
+
+//
+//  FUNCTION: ParseCommandLine(int, LPWSTR*, AppOptions*)
+//
+//  PURPOSE: Parses the options and the video file paths.
+//
+//  Each path may end in @HH:MM to start that clip at that local time.
+//
+//  --interval=SEC     Rotate to the next clip every SEC seconds.
+//  --shuffle          Rotate in random order.
+//
+//  Commands for a running instance:
+//
+//  --pause, --resume  Pause or resume playback.
+//  --seek=SEC         Seek to SEC seconds.
+//  --rate=R           Set the playback rate.
+//  --volume=V         Set the volume, 0 to 1.
+//  --stats            Print playback statistics.
+//  --loop-cache[=MB]  Keep clip files up to MB megabytes (default 256) in
+//                     memory while looping. The software backend keeps
+//                     the clip's raw frames instead, as many from the
+//                     start as fit: 256 MB holds 86 frames of 1080p, just
+//                     under 3 s at 30 fps, or 194 of 720p.
+//  --max-fps=N        Present at most N frames per second.
+//  --layout=MODE      span (default), span-physical or clone.
+//  --scale=MODE       fit (default), fill or stretch.
+//  --stats-dump=PATH  Collect playback stats and write them to PATH
+//                     (.csv or JSON) every few seconds.
+//  --bench-startup    Print the startup trace at the first frame and quit.
+//  --backend=NAME     mfplay (default), reader (GPU decode and present),
+//                     software (Y4M clips decoded on the CPU), shared
+//                     (frames of a --broker process on this host) or
+//                     generative (animations rendered on the CPU; the
+//                     clips are effect names: plasma, noise, gradient,
+//                     particles).
+//  --bench-decode[=THREADS]
+//                     Decode the clips on the CPU as fast as possible,
+//                     print frames per second and quit.
+//  --bench-kernels    Print Mpixel/s of each color conversion and scaling
+//                     kernel per instruction set, checked against the
+//                     scalar kernels, and quit.
+//  --cache[=DIR]      Play wallpaper-optimized copies of local clips,
+//                     transcoded in the background into DIR (default
+//                     %LOCALAPPDATA%\LiveWallpaper\Cache).
+//  --prepare          Transcode the clips into the cache now, print the
+//                     cost against decoding the originals and quit.
+//  --bench-index      Print the time to build, save and map the container
+//                     index of each clip and to look up a keyframe, and quit.
+//  --broker           Decode the first clip for every session of the host
+//                     into shared memory, for --backend=shared instances,
+//                     and print its readers every few seconds. Runs until
+//                     it is ended.
+//  --adaptive         Step down to lower frame rates, and with --cache to
+//                     smaller variants of the clips, while frames are
+//                     dropped or the system is loaded; step back up when
+//                     it has room again.
+//  --simulate-quality[=TRACE]
+//                     Replay the built-in load traces or TRACE, lines of
+//                     "SECONDS LOAD", through the adaptive quality ladder,
+//                     print quality and CPU over time and quit.
+//  --config=PATH      Read the clips and settings from the JSON file PATH,
+//                     over those of the command line, and apply its
+//                     changes while running.
+//  --bench-config     Print the time to parse PATH of --config, or of
+//                     generated configs, and quit.
+//  --bench-wakeups[=SEC]
+//                     Play for SEC seconds (default 60) from the first
+//                     frame, print the wakeups of the window thread per
+//                     minute and what caused them, and quit.
+//  --bench-snapshot   Print the reads and writes per second of the player
+//                     state snapshot, with 1, 2, 4... reader threads, and
+//                     quit.
+//  --bench-queue      Print the events per second the player event queue
+//                     and a deque behind a mutex carry from 1, 2, 4...
+//                     producer threads to one consumer, and quit.
+//  --overlay-clock[=seconds]
+//                     Draw the local time, HH:MM or HH:MM:SS, in the
+//                     bottom right corner of every monitor (software,
+//                     shared and generative backends).
+//  --overlay-text=TEXT
+//                     Draw TEXT in the top left corner of every monitor.
+//  --bench-overlay    Print the time to compose the overlay over a new 4K
+//                     frame and for a clock tick, against blending a
+//                     frame-sized layer, per instruction set, and quit.
+//  --bench-generative Print ms per frame of each generative effect at
+//                     1080p and 4K with 1, 2, 4... threads, and quit.
+//
+void ParseCommandLine(int argc, LPWSTR* argv, AppOptions* pOptions)
+{
+	pOptions->clips.clear();
+	pOptions->playlist = PlaylistConfig();
+	pOptions->playlist.nSeed = GetTickCount();
+	pOptions->commands.clear();
+	pOptions->pszStatsDump = NULL;
+	pOptions->bBenchStartup = false;
+	pOptions->nBenchDecode = -1;
+	pOptions->bBenchKernels = false;
+	pOptions->bBenchIndex = false;
+	pOptions->bPrepare = false;
+	pOptions->bBroker = false;
+	pOptions->bAdaptive = false;
+	pOptions->bSimulateQuality = false;
+	pOptions->qualityTrace.clear();
+	pOptions->configPath.clear();
+	pOptions->bBenchConfig = false;
+	pOptions->bBenchSnapshot = false;
+	pOptions->bBenchQueue = false;
+	pOptions->bBenchOverlay = false;
+	pOptions->bBenchGenerative = false;
+	pOptions->bOverlayClock = false;
+	pOptions->bOverlaySeconds = false;
+	pOptions->overlayText.clear();
+	pOptions->nBenchWakeups = 0;
+	pOptions->cacheDir.clear();
+	pOptions->backend = PLAYER_BACKEND_MFPLAY;
+	pOptions->cbLoopCache = 0;
+	pOptions->fMaxFps = 0.0f;
+	pOptions->layout = LAYOUT_SPAN;
+	pOptions->scale = SCALE_FIT;
+
+	for (int i = 1; i < argc; i++) {
+		LPCWSTR arg = argv[i];
+		if (wcsncmp(arg, L"--", 2) != 0) {
+			PlaylistItem item;
+			item.path = arg;
+			item.nStartOfDay = -1;
+			size_t nAt = item.path.rfind(L'@');
+			int nHour = 0, nMinute = 0;
+			if (nAt != std::wstring::npos &&
+				swscanf_s(item.path.c_str() + nAt + 1, L"%d:%d", &nHour, &nMinute) == 2 &&
+				nHour >= 0 && nHour < 24 && nMinute >= 0 && nMinute < 60) {
+				item.nStartOfDay = (nHour * 60 + nMinute) * 60;
+				item.path.resize(nAt);
+			}
+			pOptions->clips.push_back(item);
+			continue;
+		}
+		if (wcscmp(arg, L"--loop-cache") == 0) {
+			pOptions->cbLoopCache = DEFAULT_LOOP_CACHE_MB << 20;
+		}
+		else if (wcsncmp(arg, L"--loop-cache=", 13) == 0) {
+			pOptions->cbLoopCache = (size_t)_wtoi(arg + 13) << 20;
+		}
+		else if (wcsncmp(arg, L"--max-fps=", 10) == 0) {
+			pOptions->fMaxFps = (float)_wtof(arg + 10);
+		}
+		else if (wcsncmp(arg, L"--interval=", 11) == 0) {
+			pOptions->playlist.hnsInterval = (HNSTIME)(_wtof(arg + 11) * HNS_PER_SECOND);
+		}
+		else if (wcscmp(arg, L"--shuffle") == 0) {
+			pOptions->playlist.order = PLAYLIST_SHUFFLE;
+		}
+		else if (wcscmp(arg, L"--pause") == 0 || wcscmp(arg, L"--resume") == 0 || wcscmp(arg, L"--stats") == 0) {
+			ControlMessage cmd;
+			cmd.command = arg[2] == L'p' ? CONTROL_COMMAND_PAUSE :
+				arg[2] == L'r' ? CONTROL_COMMAND_RESUME : CONTROL_COMMAND_QUERY_STATS;
+			pOptions->commands.push_back(cmd);
+		}
+		else if (wcsncmp(arg, L"--seek=", 7) == 0) {
+			ControlMessage cmd;
+			cmd.command = CONTROL_COMMAND_SEEK;
+			cmd.hnsValue = (HNSTIME)(_wtof(arg + 7) * HNS_PER_SECOND);
+			pOptions->commands.push_back(cmd);
+		}
+		else if (wcsncmp(arg, L"--rate=", 7) == 0 || wcsncmp(arg, L"--volume=", 9) == 0) {
+			ControlMessage cmd;
+			bool bRate = arg[2] == L'r';
+			cmd.command = bRate ? CONTROL_COMMAND_SET_RATE : CONTROL_COMMAND_SET_VOLUME;
+			cmd.fValue = (float)_wtof(arg + (bRate ? 7 : 9));
+			pOptions->commands.push_back(cmd);
+		}
+		else if (wcscmp(arg, L"--bench-startup") == 0) {
+			pOptions->bBenchStartup = true;
+		}
+		else if (wcscmp(arg, L"--bench-decode") == 0) {
+			pOptions->nBenchDecode = 0;
+		}
+		else if (wcsncmp(arg, L"--bench-decode=", 15) == 0) {
+			int nThreads = _wtoi(arg + 15);
+			pOptions->nBenchDecode = nThreads > 0 ? nThreads : 0;
+		}
+		else if (wcscmp(arg, L"--bench-kernels") == 0) {
+			pOptions->bBenchKernels = true;
+		}
+		else if (wcscmp(arg, L"--bench-index") == 0) {
+			pOptions->bBenchIndex = true;
+		}
+		else if (wcscmp(arg, L"--cache") == 0) {
+			pOptions->cacheDir = GetLocalDataDirectory(L"Cache");
+		}
+		else if (wcsncmp(arg, L"--cache=", 8) == 0) {
+			pOptions->cacheDir = arg + 8;
+		}
+		else if (wcscmp(arg, L"--prepare") == 0) {
+			pOptions->bPrepare = true;
+		}
+		else if (wcscmp(arg, L"--backend=reader") == 0) {
+			pOptions->backend = PLAYER_BACKEND_SOURCE_READER;
+		}
+		else if (wcscmp(arg, L"--backend=software") == 0) {
+			pOptions->backend = PLAYER_BACKEND_SOFTWARE;
+		}
+		else if (wcscmp(arg, L"--backend=shared") == 0) {
+			pOptions->backend = PLAYER_BACKEND_SHARED;
+		}
+		else if (wcscmp(arg, L"--backend=generative") == 0) {
+			pOptions->backend = PLAYER_BACKEND_GENERATIVE;
+		}
+		else if (wcscmp(arg, L"--broker") == 0) {
+			pOptions->bBroker = true;
+		}
+		else if (wcscmp(arg, L"--adaptive") == 0) {
+			pOptions->bAdaptive = true;
+		}
+		else if (wcscmp(arg, L"--simulate-quality") == 0) {
+			pOptions->bSimulateQuality = true;
+		}
+		else if (wcsncmp(arg, L"--simulate-quality=", 19) == 0) {
+			pOptions->bSimulateQuality = true;
+			pOptions->qualityTrace = arg + 19;
+		}
+		else if (wcsncmp(arg, L"--config=", 9) == 0) {
+			pOptions->configPath = arg + 9;
+		}
+		else if (wcscmp(arg, L"--bench-config") == 0) {
+			pOptions->bBenchConfig = true;
+		}
+		else if (wcscmp(arg, L"--bench-wakeups") == 0) {
+			pOptions->nBenchWakeups = DEFAULT_BENCH_WAKEUPS_SEC;
+		}
+		else if (wcsncmp(arg, L"--bench-wakeups=", 16) == 0) {
+			int nSeconds = _wtoi(arg + 16);
+			pOptions->nBenchWakeups = nSeconds > 0 ? nSeconds : DEFAULT_BENCH_WAKEUPS_SEC;
+		}
+		else if (wcscmp(arg, L"--bench-snapshot") == 0) {
+			pOptions->bBenchSnapshot = true;
+		}
+		else if (wcscmp(arg, L"--bench-queue") == 0) {
+			pOptions->bBenchQueue = true;
+		}
+		else if (wcscmp(arg, L"--bench-overlay") == 0) {
+			pOptions->bBenchOverlay = true;
+		}
+		else if (wcscmp(arg, L"--bench-generative") == 0) {
+			pOptions->bBenchGenerative = true;
+		}
+		else if (wcscmp(arg, L"--overlay-clock") == 0 || wcscmp(arg, L"--overlay-clock=seconds") == 0) {
+			pOptions->bOverlayClock = true;
+			pOptions->bOverlaySeconds = arg[15] == L'=';
+		}
+		else if (wcsncmp(arg, L"--overlay-text=", 15) == 0) {
+			pOptions->overlayText = arg + 15;
+		}
+		else if (wcsncmp(arg, L"--stats-dump=", 13) == 0) {
+			pOptions->pszStatsDump = arg + 13;
+		}
+		else if (wcscmp(arg, L"--layout=span-physical") == 0) {
+			pOptions->layout = LAYOUT_SPAN_PHYSICAL;
+		}
+		else if (wcscmp(arg, L"--layout=clone") == 0) {
+			pOptions->layout = LAYOUT_CLONE;
+		}
+		else if (wcscmp(arg, L"--scale=fill") == 0) {
+			pOptions->scale = SCALE_FILL;
+		}
+		else if (wcscmp(arg, L"--scale=stretch") == 0) {
+			pOptions->scale = SCALE_STRETCH;
+		}
+	}
+}
+
+void ShowErrorMessage(HWND hWnd, LPCWSTR lpCaption, HRESULT hrErr)
+{
+	LPWSTR lpMessage = NULL;
+	DWORD dwLen = FormatMessageW(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM,
+		NULL, (DWORD)hrErr, NULL, (LPWSTR)&lpMessage, NULL, NULL);
+	std::wstring msg = FormatPlaybackError((uint32_t)hrErr, dwLen > 0 ? lpMessage : NULL);
 	LocalFree(lpMessage);
 
-	MessageBoxW(hWnd, msg, lpCaption, MB_ICONSTOP | MB_OK);
+	MessageBoxW(hWnd, msg.c_str(), lpCaption, MB_ICONSTOP | MB_OK);
 }
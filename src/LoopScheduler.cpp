@@ -0,0 +1,238 @@
+#include "LoopScheduler.h"
+
+
+// Initial seek latency estimate before anything was measured.
+static const HNSTIME DEFAULT_SEEK_LATENCY = 50 * HNS_PER_MSEC;
+
+// Default timer slack, one tick of the default system timer.
+static const HNSTIME DEFAULT_TIMER_SLACK = 16 * HNS_PER_MSEC;
+
+// Retry interval while the position cannot be read.
+static const HNSTIME RETRY_INTERVAL = HNS_PER_SECOND;
+
+// Upper bound of the seek latency estimate.
+static const HNSTIME MAX_SEEK_LATENCY = HNS_PER_SECOND;
+
+// Frame duration assumed until the clip's is set.
+static const HNSTIME DEFAULT_FRAME_DURATION = HNS_PER_SECOND / 30;
+
+// The lead time is at most this many frames of the clip.
+static const HNSTIME MAX_LEAD_FRAMES = 3;
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+LoopScheduler::LoopScheduler(IPresentationClock* pClock) : m_pClock(pClock), m_pStats(nullptr),
+m_hnsDuration(0), m_hnsSlack(DEFAULT_TIMER_SLACK), m_hnsFrame(DEFAULT_FRAME_DURATION),
+m_hnsSeekLatency(DEFAULT_SEEK_LATENCY),
+m_hnsSeekIssued(0), m_hnsWakeupDue(-1), m_bRunning(false), m_bMeasure(false), m_cLoops(0), m_cWakeups(0),
+m_cMissed(0)
+{
+}
+
+void LoopScheduler::SetDuration(HNSTIME hnsDuration)
+{
+	m_hnsDuration = hnsDuration;
+	if (m_bRunning)
+		Schedule();
+}
+
+void LoopScheduler::SetTimerSlack(HNSTIME hnsSlack)
+{
+	m_hnsSlack = hnsSlack > 0 ? hnsSlack : 0;
+}
+
+void LoopScheduler::SetFrameDuration(HNSTIME hnsFrame)
+{
+	m_hnsFrame = hnsFrame > 0 ? hnsFrame : DEFAULT_FRAME_DURATION;
+	if (m_bRunning)
+		Schedule();
+}
+
+void LoopScheduler::Start()
+{
+	if (m_bRunning)
+		return;
+	m_bRunning = true;
+	Schedule();
+}
+
+void LoopScheduler::Stop()
+{
+	m_bRunning = false;
+	m_bMeasure = false;
+	m_hnsWakeupDue = -1;
+	m_pClock->CancelWakeup();
+}
+
+void LoopScheduler::OnRateChanged()
+{
+	if (m_bRunning)
+		Schedule();
+}
+
+//-----------------------------------------------------------------------------
+// GetLeadTime
+//
+// How far ahead of the end of the clip the wrap is issued: the seek
+// latency plus the timer slack, bounded by GetMaxLeadTime.
+//-----------------------------------------------------------------------------
+
+HNSTIME LoopScheduler::GetLeadTime() const
+{
+	HNSTIME hnsLead = m_hnsSeekLatency + m_hnsSlack;
+	HNSTIME hnsMax = GetMaxLeadTime();
+	return hnsLead < hnsMax ? hnsLead : hnsMax;
+}
+
+// A few frames, and a quarter of a clip shorter than that.
+HNSTIME LoopScheduler::GetMaxLeadTime() const
+{
+	HNSTIME hnsMax = MAX_LEAD_FRAMES * m_hnsFrame;
+	return hnsMax < m_hnsDuration / 4 ? hnsMax : m_hnsDuration / 4;
+}
+
+//-----------------------------------------------------------------------------
+// OnWakeup
+//
+// Wraps the clip when the deadline is within one timer slack, otherwise
+// re-arms for the remainder (the clock drifted or the rate changed).
+//-----------------------------------------------------------------------------
+
+void LoopScheduler::OnWakeup()
+{
+	m_cWakeups++;
+	if (m_pStats && m_hnsWakeupDue >= 0)
+		m_pStats->Record(STATS_METRIC_TIMER_LATENESS, m_pClock->GetSystemTime() - m_hnsWakeupDue);
+	m_hnsWakeupDue = -1;
+	if (!m_bRunning)
+		return;
+
+	HNSTIME hnsPosition = 0;
+	if (m_bMeasure && m_pClock->GetPosition(&hnsPosition))
+		MeasureSeekLatency(hnsPosition);
+
+	Schedule();
+}
+
+//-----------------------------------------------------------------------------
+// OnPlaybackEnded
+//
+// The end of the clip was reached before the wrap, so the lead time was
+// too short. Move the latency estimate a quarter of the way to the most
+// lead allowed, like a measurement would, and loop from here. The next
+// measurements pull it back down if the seek was slow only once.
+//-----------------------------------------------------------------------------
+
+void LoopScheduler::OnPlaybackEnded()
+{
+	m_cMissed++;
+	if (m_pStats)
+		m_pStats->Count(STATS_COUNTER_MISSED_LOOPS);
+	HNSTIME hnsMax = GetMaxLeadTime();
+	if (m_hnsSeekLatency < hnsMax)
+		m_hnsSeekLatency += (hnsMax - m_hnsSeekLatency + 3) / 4;
+	if (m_hnsDuration > 0)
+		Wrap();
+}
+
+void LoopScheduler::Schedule()
+{
+	if (!m_bRunning || m_hnsDuration <= 0)
+		return;
+
+	HNSTIME hnsPosition = 0;
+	if (!m_pClock->GetPosition(&hnsPosition)) {
+		Arm(RETRY_INTERVAL);
+		return;
+	}
+
+	float fRate = m_pClock->GetRate();
+	if (fRate <= 0.0f) {
+		m_hnsWakeupDue = -1;
+		m_pClock->CancelWakeup();
+		return;
+	}
+
+	HNSTIME hnsRemaining = m_hnsDuration - GetLeadTime() - hnsPosition;
+	if (hnsRemaining <= m_hnsSlack) {
+		Wrap();
+		return;
+	}
+	Arm((HNSTIME)(hnsRemaining / fRate));
+}
+
+//-----------------------------------------------------------------------------
+// Wrap
+//
+// Seeks to the start and arms the deadline of the next pass. Right after
+// the seek the reported position is not reliable yet, so the deadline is
+// computed from position 0 plus the expected seek latency, and the next
+// wakeup measures how long the seek really took. The latency counted
+// leaves the timer slack within the lead time, so even after slow seeks
+// the wakeup comes before the end and measures whether they got fast
+// again.
+//-----------------------------------------------------------------------------
+
+void LoopScheduler::Wrap()
+{
+	if (!m_pClock->SeekToStart()) {
+		Arm(RETRY_INTERVAL);
+		return;
+	}
+	m_cLoops++;
+	if (m_pStats)
+		m_pStats->Count(STATS_COUNTER_LOOPS);
+	m_hnsSeekIssued = m_pClock->GetSystemTime();
+	m_bMeasure = true;
+
+	float fRate = m_pClock->GetRate();
+	if (!m_bRunning || fRate <= 0.0f)
+		return;
+
+	HNSTIME hnsLead = GetLeadTime();
+	HNSTIME hnsRemaining = m_hnsDuration - hnsLead;
+	if (hnsRemaining < m_hnsSlack)
+		hnsRemaining = m_hnsSlack;
+	HNSTIME hnsLatency = hnsLead - m_hnsSlack;
+	if (hnsLatency > m_hnsSeekLatency)
+		hnsLatency = m_hnsSeekLatency;
+	if (hnsLatency < 0)
+		hnsLatency = 0;
+	Arm((HNSTIME)(hnsRemaining / fRate) + hnsLatency);
+}
+
+//-----------------------------------------------------------------------------
+// MeasureSeekLatency
+//
+// The clock should have advanced by (elapsed * rate) since the wrap;
+// whatever is missing was spent seeking. Smoothed with a 1/4 EWMA.
+//-----------------------------------------------------------------------------
+
+void LoopScheduler::MeasureSeekLatency(HNSTIME hnsPosition)
+{
+	m_bMeasure = false;
+
+	float fRate = m_pClock->GetRate();
+	if (fRate <= 0.0f)
+		return;
+
+	HNSTIME hnsElapsed = m_pClock->GetSystemTime() - m_hnsSeekIssued;
+	HNSTIME hnsLatency = hnsElapsed - (HNSTIME)(hnsPosition / fRate);
+	if (hnsLatency < 0)
+		hnsLatency = 0;
+	if (hnsLatency > MAX_SEEK_LATENCY)
+		hnsLatency = MAX_SEEK_LATENCY;
+	if (m_pStats)
+		m_pStats->Record(STATS_METRIC_SEEK_LATENCY, hnsLatency);
+
+	m_hnsSeekLatency += (hnsLatency - m_hnsSeekLatency) / 4;
+}
+
+void LoopScheduler::Arm(HNSTIME hnsDelay)
+{
+	m_hnsWakeupDue = m_pClock->GetSystemTime() + hnsDelay;
+	m_pClock->ArmWakeup(hnsDelay);
+}
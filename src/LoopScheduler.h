@@ -0,0 +1,82 @@
+#pragma once
+#include "PlaybackClock.h"
+#include "PlaybackStats.h"
+
+
+//-------------------------------------------------------------------
+//
+// LoopScheduler class
+//
+// Loops the clip from presentation-clock deadlines instead of polling.
+// A single wakeup is armed just before the end of the clip; when it
+// fires the scheduler seeks back to the start, so the first frames are
+// pre-rolled while the tail of the clip is still on screen.
+//
+// The lead time ahead of the end adapts to the measured seek latency,
+// but never exceeds a few frames: a seek slower than that lets the clip
+// end and wraps from there, holding the last frame rather than dropping
+// the tail.
+//
+//-------------------------------------------------------------------
+
+class LoopScheduler
+{
+public:
+	explicit LoopScheduler(IPresentationClock* pClock);
+
+	void SetDuration(HNSTIME hnsDuration);
+	HNSTIME GetDuration() const { return m_hnsDuration; }
+
+	// Timer resolution of the platform; wakeups may fire this much late.
+	void SetTimerSlack(HNSTIME hnsSlack);
+
+	// Frame duration of the clip, which bounds the lead time; 1/30 s if
+	// it is not known.
+	void SetFrameDuration(HNSTIME hnsFrame);
+
+	// Optional collector of seek latency, wakeup lateness and loop counts.
+	void SetStats(PlaybackStats* pStats) { m_pStats = pStats; }
+
+	// Start: playback is running, arm the next loop deadline. Repeated
+	// calls while running are ignored.
+	// Stop: playback is paused or stopped, cancel any armed wakeup.
+	void Start();
+	void Stop();
+	bool IsRunning() const { return m_bRunning; }
+
+	// The armed wakeup has fired.
+	void OnWakeup();
+
+	// The clip reached its end before the wakeup could wrap it.
+	void OnPlaybackEnded();
+
+	// The playback rate changed; re-arm against the new rate.
+	void OnRateChanged();
+
+	HNSTIME GetLeadTime() const;
+	HNSTIME GetMaxLeadTime() const;
+	HNSTIME GetSeekLatency() const { return m_hnsSeekLatency; }
+	uint32_t GetLoopCount() const { return m_cLoops; }
+	uint32_t GetWakeupCount() const { return m_cWakeups; }
+	uint32_t GetMissedCount() const { return m_cMissed; }
+
+private:
+	void Schedule();
+	void Wrap();
+	void MeasureSeekLatency(HNSTIME hnsPosition);
+	void Arm(HNSTIME hnsDelay);
+
+	IPresentationClock*	m_pClock;
+	PlaybackStats*		m_pStats;
+	HNSTIME		m_hnsDuration;
+	HNSTIME		m_hnsSlack;			// Timer slack
+	HNSTIME		m_hnsFrame;			// Frame duration of the clip
+	HNSTIME		m_hnsSeekLatency;	// Smoothed seek-to-start latency
+	HNSTIME		m_hnsSeekIssued;	// System time of the last wrap
+	HNSTIME		m_hnsWakeupDue;		// System time the armed wakeup is due, -1 = none
+	bool		m_bRunning;
+	bool		m_bMeasure;			// Next wakeup measures seek latency
+	uint32_t	m_cLoops;
+	uint32_t	m_cWakeups;
+	uint32_t	m_cMissed;
+};
@@ -1,9 +1,15 @@
 #include "pch.h"
 #include "LiveWallpaper.h"
+#include "ClipCache.h"
+#include <mfapi.h>
 #include <Shlwapi.h>
 #include <new>
 
 #pragma comment(lib, "mfplay.lib")
+#pragma comment(lib, "mfplat.lib")
+
+// User data of the media items created by PrepareURL.
+static const DWORD_PTR PREPARED_ITEM = 1;
 #pragma comment(lib, "shlwapi.lib")
 
 
@@ -13,11 +19,11 @@
 // Creates an instance of the MFPlayer2 object.
 //-----------------------------------------------------------------------------
 
-HRESULT MFPVideoPlayer::CreateInstance(HWND hwndEvent, HWND hwndVideo, MFPVideoPlayer** ppPlayer)
+HRESULT MFPVideoPlayer::CreateInstance(PlayerEventQueue* pEvents, HWND hwndVideo, MFPVideoPlayer** ppPlayer)
 {
 	HRESULT hr = S_OK;
 
-	MFPVideoPlayer* pPlayer = new (std::nothrow)MFPVideoPlayer(hwndEvent);
+	MFPVideoPlayer* pPlayer = new (std::nothrow)MFPVideoPlayer(pEvents);
 	if (!pPlayer)
 		return E_OUTOFMEMORY;
 
@@ -35,9 +41,11 @@ HRESULT MFPVideoPlayer::CreateInstance(HWND hwndEvent, HWND hwndVideo, MFPVideoP
 // Constructor
 //-----------------------------------------------------------------------------
 
-MFPVideoPlayer::MFPVideoPlayer(HWND hwndEvent) : m_cRef(1), m_pPlayer(nullptr),
-m_hwndEvent(hwndEvent), m_bHasVideo(false), m_caps(0)
+MFPVideoPlayer::MFPVideoPlayer(PlayerEventQueue* pEvents) : m_cRef(1), m_pPlayer(nullptr),
+m_pNextItem(nullptr), m_pOwnedSource(nullptr), m_bPreparing(false), m_pEvents(pEvents), m_bStarted(false), m_cbLoopCache(0), m_pStats(nullptr), m_pClipCache(nullptr), m_fVolume(1.0f), m_bMute(true), m_state()
 {
+	m_state.state = MFP_MEDIAPLAYER_STATE_EMPTY;
+	m_state.fRate = 1.0f;
 }
 
 //-----------------------------------------------------------------------------
@@ -46,7 +54,11 @@ m_hwndEvent(hwndEvent), m_bHasVideo(false), m_caps(0)
 
 MFPVideoPlayer::~MFPVideoPlayer()
 {
+	ShutdownOwnedSource();
+	SafeRelease(&m_pNextItem);
 	SafeRelease(&m_pPlayer);
+	if (m_bStarted)
+		MFShutdown();
 }
 
 //------------------------------------------------------------------------------
@@ -63,6 +75,15 @@ HRESULT MFPVideoPlayer::Initialize(HWND hwndVideo)
 
 	SafeRelease(&m_pPlayer);
 
+	// MFPlay starts Media Foundation by itself; the explicit reference keeps
+	// the platform up for the byte streams created by the loop cache.
+	if (!m_bStarted) {
+		hr = MFStartup(MF_VERSION, MFSTARTUP_LITE);
+		if (FAILED(hr))
+			return hr;
+		m_bStarted = true;
+	}
+
 	hr = MFPCreateMediaPlayer(
 		NULL,
 		FALSE,          // Start playback automatically?
@@ -127,6 +148,21 @@ STDMETHODIMP MFPVideoPlayer::QueryInterface(REFIID riid, void** ppv)
 
 void MFPVideoPlayer::OnMediaPlayerEvent(MFP_EVENT_HEADER* pEventHeader)
 {
+	if (m_pStats) {
+		m_pStats->Count(STATS_COUNTER_PLAYER_EVENTS);
+		if (FAILED(pEventHeader->hrEvent))
+			m_pStats->Count(STATS_COUNTER_PLAYER_ERRORS);
+	}
+	PublishState(pEventHeader);
+
+	// A clip that fails to open in the background does not stop playback.
+	if (FAILED(pEventHeader->hrEvent) && m_bPreparing &&
+		pEventHeader->eEventType == MFP_EVENT_TYPE_MEDIAITEM_CREATED) {
+		m_bPreparing = false;
+		NotifyPrepared(pEventHeader->hrEvent);
+		return;
+	}
+
 	if (FAILED(pEventHeader->hrEvent)) {
 		NotifyError(pEventHeader->hrEvent);
 		return;
@@ -142,10 +178,12 @@ void MFPVideoPlayer::OnMediaPlayerEvent(MFP_EVENT_HEADER* pEventHeader)
 		break;
 
 	case MFP_EVENT_TYPE_RATE_SET:
+		NotifyRate();
 		break;
 
 	case MFP_EVENT_TYPE_PLAYBACK_ENDED:
-		SetPosition(0);
+		// Looping is up to the application.
+		NotifyEnded();
 		__fallthrough;
 	case MFP_EVENT_TYPE_STOP:
 		{
@@ -159,6 +197,78 @@ void MFPVideoPlayer::OnMediaPlayerEvent(MFP_EVENT_HEADER* pEventHeader)
 	NotifyState(pEventHeader->eState);
 }
 
+//-------------------------------------------------------------------
+// PublishState
+//
+// Records what an event changed and publishes the state before the
+// application is notified, so its handler reads the new state. The
+// calls into MFPlay made here are the only ones the queries need.
+//-------------------------------------------------------------------
+
+void MFPVideoPlayer::PublishState(MFP_EVENT_HEADER* pEventHeader)
+{
+	m_state.state = pEventHeader->eState;
+	m_state.cEvents++;
+	if (FAILED(pEventHeader->hrEvent)) {
+		m_state.cErrors++;
+		m_state.hrLastError = pEventHeader->hrEvent;
+		m_snapshot.Publish(m_state);
+		return;
+	}
+
+	bool bSample = false;
+	switch (pEventHeader->eEventType) {
+	case MFP_EVENT_TYPE_MEDIAITEM_SET:
+		{
+			IMFPMediaItem* pItem = MFP_GET_MEDIAITEM_SET_EVENT(pEventHeader)->pMediaItem;
+			BOOL bHasVideo = FALSE, bIsSelected = FALSE;
+			m_state.caps = 0;
+			m_state.bHasVideo = false;
+			if (pItem) {
+				if (FAILED(pItem->GetCharacteristics(&m_state.caps)))
+					m_state.caps = 0;
+				m_state.bHasVideo = SUCCEEDED(pItem->HasVideo(&bHasVideo, &bIsSelected)) && bHasVideo && bIsSelected;
+			}
+
+			PROPVARIANT var;
+			PropVariantInit(&var);
+			m_state.hnsDuration = 0;
+			if (m_pPlayer && SUCCEEDED(m_pPlayer->GetDuration(MFP_POSITIONTYPE_100NS, &var)))
+				m_state.hnsDuration = (HNSTIME)var.uhVal.QuadPart;
+			PropVariantClear(&var);
+			bSample = true;
+		}
+		break;
+
+	case MFP_EVENT_TYPE_RATE_SET:
+		m_state.fRate = MFP_GET_RATE_SET_EVENT(pEventHeader)->flRate;
+		bSample = true;
+		break;
+
+	case MFP_EVENT_TYPE_PLAY:
+	case MFP_EVENT_TYPE_PAUSE:
+	case MFP_EVENT_TYPE_STOP:
+	case MFP_EVENT_TYPE_POSITION_SET:
+	case MFP_EVENT_TYPE_PLAYBACK_ENDED:
+		bSample = true;
+		break;
+	}
+
+	if (bSample && m_pPlayer) {
+		PROPVARIANT var;
+		PropVariantInit(&var);
+		if (SUCCEEDED(m_pPlayer->GetPosition(MFP_POSITIONTYPE_100NS, &var)))
+			m_state.hnsPosition = var.hVal.QuadPart;
+		else if (pEventHeader->eEventType == MFP_EVENT_TYPE_PLAYBACK_ENDED)
+			m_state.hnsPosition = m_state.hnsDuration;
+		else
+			m_state.hnsPosition = 0;
+		m_state.hnsSampled = MFGetSystemTime();
+		PropVariantClear(&var);
+	}
+	m_snapshot.Publish(m_state);
+}
+
 //-------------------------------------------------------------------
 // OpenURL
 //
@@ -166,6 +276,58 @@ void MFPVideoPlayer::OnMediaPlayerEvent(MFP_EVENT_HEADER* pEventHeader)
 //-------------------------------------------------------------------
 
 HRESULT MFPVideoPlayer::OpenURL(const WCHAR* sURL)
+{
+	return CreateMediaItem(sURL, 0);
+}
+
+//-------------------------------------------------------------------
+// PrepareURL
+//
+// Opens a media file in the background. The item is kept aside when
+// it is created, and PLAYER_EVENT_PREPARED is posted.
+//-------------------------------------------------------------------
+
+HRESULT MFPVideoPlayer::PrepareURL(const WCHAR* sURL)
+{
+	CancelPrepared();
+	HRESULT hr = CreateMediaItem(sURL, PREPARED_ITEM);
+	if (SUCCEEDED(hr))
+		m_bPreparing = true;
+	return hr;
+}
+
+//-------------------------------------------------------------------
+// SwitchToPrepared
+//
+// Replaces the current media item with the prepared one. Its source
+// is already resolved and open, so only the decoders are started.
+//-------------------------------------------------------------------
+
+HRESULT MFPVideoPlayer::SwitchToPrepared()
+{
+	if (m_pPlayer == NULL)
+		return E_UNEXPECTED;
+	if (m_pNextItem == NULL)
+		return MF_E_INVALIDREQUEST;
+
+	HRESULT hr = m_pPlayer->SetMediaItem(m_pNextItem);
+	SafeRelease(&m_pNextItem);
+	return hr;
+}
+
+void MFPVideoPlayer::CancelPrepared()
+{
+	m_bPreparing = false;
+	SafeRelease(&m_pNextItem);
+}
+
+//-------------------------------------------------------------------
+// CreateMediaItem
+//
+// Creates a media item for a URL, tagged with dwUserData.
+//-------------------------------------------------------------------
+
+HRESULT MFPVideoPlayer::CreateMediaItem(const WCHAR* sURL, DWORD_PTR dwUserData)
 {
 	HRESULT hr = S_OK;
 
@@ -179,8 +341,24 @@ HRESULT MFPVideoPlayer::OpenURL(const WCHAR* sURL)
 		return E_UNEXPECTED;
 	}
 
+	// Play the wallpaper-optimized copy of the clip if there is a fresh one.
+	std::wstring cached;
+	if (m_pClipCache) {
+		cached = m_pClipCache->Resolve(sURL);
+		sURL = cached.c_str();
+	}
+
+	// With the loop cache on, create the media item from an in-memory copy of
+	// the clip. Clips over the budget are opened from the URL as usual.
+	IMFByteStream* pByteStream = NULL;
+	if (m_cbLoopCache > 0 && SUCCEEDED(CreateCachedByteStream(sURL, m_cbLoopCache, &pByteStream))) {
+		hr = m_pPlayer->CreateMediaItemFromObject(pByteStream, FALSE, dwUserData, NULL);
+		SafeRelease(&pByteStream);
+		return hr;
+	}
+
 	// Create a new media item for this URL.
-	hr = m_pPlayer->CreateMediaItemFromURL(sURL, FALSE, 0, NULL);
+	hr = m_pPlayer->CreateMediaItemFromURL(sURL, FALSE, dwUserData, NULL);
 
 	// The CreateMediaItemFromURL method completes asynchronously. When it does,
 	// MFPlay sends an MFP_EVENT_TYPE_MEDIAITEM_CREATED event.
@@ -188,6 +366,143 @@ HRESULT MFPVideoPlayer::OpenURL(const WCHAR* sURL)
 	return hr;
 }
 
+//-------------------------------------------------------------------
+// ResolveSource
+//
+// Creates the media source of a clip, which opens the file and parses
+// its headers. With a loop cache budget the clip is read into memory
+// first, as OpenURL does.
+//-------------------------------------------------------------------
+
+HRESULT MFPVideoPlayer::ResolveSource(const WCHAR* sURL, size_t cbLoopCache, IMFMediaSource** ppSource)
+{
+	if (sURL == NULL || ppSource == NULL)
+		return E_POINTER;
+
+	IMFSourceResolver* pResolver = NULL;
+	IMFByteStream* pByteStream = NULL;
+	IUnknown* pSource = NULL;
+	MF_OBJECT_TYPE type = MF_OBJECT_INVALID;
+
+	HRESULT hr = MFCreateSourceResolver(&pResolver);
+	if (SUCCEEDED(hr)) {
+		if (cbLoopCache > 0 && SUCCEEDED(CreateCachedByteStream(sURL, cbLoopCache, &pByteStream)))
+			hr = pResolver->CreateObjectFromByteStream(pByteStream, sURL, MF_RESOLUTION_MEDIASOURCE, NULL,
+				&type, &pSource);
+		else
+			hr = pResolver->CreateObjectFromURL(sURL, MF_RESOLUTION_MEDIASOURCE, NULL, &type, &pSource);
+	}
+	if (SUCCEEDED(hr))
+		hr = pSource->QueryInterface(IID_PPV_ARGS(ppSource));
+
+	SafeRelease(&pSource);
+	SafeRelease(&pByteStream);
+	SafeRelease(&pResolver);
+	return hr;
+}
+
+HRESULT MFPVideoPlayer::OpenSource(IMFMediaSource* pSource, const WCHAR*)
+{
+	if (pSource == NULL)
+		return E_POINTER;
+	if (m_pPlayer == NULL)
+		return E_UNEXPECTED;
+
+	HRESULT hr = m_pPlayer->CreateMediaItemFromObject(pSource, FALSE, 0, NULL);
+	if (SUCCEEDED(hr)) {
+		ShutdownOwnedSource();
+		m_pOwnedSource = pSource;
+		m_pOwnedSource->AddRef();
+	}
+	return hr;
+}
+
+//-------------------------------------------------------------------
+// ShutdownOwnedSource
+//
+// MFPlay does not shut down sources created by the application.
+//-------------------------------------------------------------------
+
+void MFPVideoPlayer::ShutdownOwnedSource()
+{
+	if (m_pOwnedSource) {
+		m_pOwnedSource->Shutdown();
+		SafeRelease(&m_pOwnedSource);
+	}
+}
+
+//-------------------------------------------------------------------
+// CreateCachedByteStream
+//
+// Reads a local clip into memory and wraps it in a byte stream, if it
+// fits the loop cache budget.
+//-------------------------------------------------------------------
+
+HRESULT MFPVideoPlayer::CreateCachedByteStream(const WCHAR* sURL, size_t cbBudget, IMFByteStream** ppByteStream)
+{
+	HANDLE hFile = CreateFileW(sURL, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	HRESULT hr = S_OK;
+	HGLOBAL hMem = NULL;
+	IStream* pStream = NULL;
+	IMFByteStream* pByteStream = NULL;
+	IMFAttributes* pAttributes = NULL;
+	while (1) {
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(hFile, &size)) {
+			hr = HRESULT_FROM_WIN32(GetLastError());
+			break;
+		}
+		if ((ULONGLONG)size.QuadPart > cbBudget || (ULONGLONG)size.QuadPart > MAXDWORD) {
+			hr = HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+			break;
+		}
+
+		hMem = GlobalAlloc(GMEM_MOVEABLE, (SIZE_T)size.QuadPart);
+		if (!hMem) {
+			hr = E_OUTOFMEMORY;
+			break;
+		}
+		BYTE* pData = (BYTE*)GlobalLock(hMem);
+		DWORD cbRead = 0;
+		BOOL bRead = ReadFile(hFile, pData, size.LowPart, &cbRead, NULL);
+		GlobalUnlock(hMem);
+		if (!bRead || cbRead != size.LowPart) {
+			hr = bRead ? HRESULT_FROM_WIN32(ERROR_HANDLE_EOF) : HRESULT_FROM_WIN32(GetLastError());
+			break;
+		}
+
+		// The stream owns the memory from here on.
+		hr = CreateStreamOnHGlobal(hMem, TRUE, &pStream);
+		if (FAILED(hr))
+			break;
+		hMem = NULL;
+
+		hr = MFCreateMFByteStreamOnStream(pStream, &pByteStream);
+		if (FAILED(hr))
+			break;
+
+		// The source resolver picks the demuxer from the original file name.
+		if (SUCCEEDED(pByteStream->QueryInterface(IID_PPV_ARGS(&pAttributes))))
+			pAttributes->SetString(MF_BYTESTREAM_ORIGIN_NAME, sURL);
+
+		*ppByteStream = pByteStream;
+		pByteStream = NULL;
+		break;
+	}
+
+	SafeRelease(&pAttributes);
+	SafeRelease(&pByteStream);
+	SafeRelease(&pStream);
+	if (hMem)
+		GlobalFree(hMem);
+	CloseHandle(hFile);
+	return hr;
+}
+
 //-----------------------------------------------------------------------------
 // Shutdown
 //
@@ -199,17 +514,15 @@ HRESULT MFPVideoPlayer::Shutdown()
 	HRESULT hr = S_OK;
 	if (m_pPlayer)
 		hr = m_pPlayer->Shutdown();
+	ShutdownOwnedSource();
 	return hr;
 }
 
 MFP_MEDIAPLAYER_STATE MFPVideoPlayer::GetState() noexcept
 {
-	if (m_pPlayer) {
-		MFP_MEDIAPLAYER_STATE state = MFP_MEDIAPLAYER_STATE_EMPTY;
-		HRESULT hr = m_pPlayer->GetState(&state);
-		if (SUCCEEDED(hr))
-			return state;
-	}
+	MFPPlayerState state;
+	if (m_pPlayer && m_snapshot.Read(&state))
+		return state.state;
 	return MFP_MEDIAPLAYER_STATE_EMPTY;
 }
 
@@ -242,33 +555,45 @@ bool MFPVideoPlayer::Stop() noexcept
 
 float MFPVideoPlayer::GetVolume() noexcept
 {
-	float fVolume = 0.0f;
-	if (m_pPlayer)
-		m_pPlayer->GetVolume(&fVolume);
-	return fVolume;
+	return m_fVolume;
 }
 
+//-----------------------------------------------------------------------------
+// SetVolume / SetMute
+//
+// The settings are kept and given to each media item as it is set, so
+// they also apply to clips opened later.
+//-----------------------------------------------------------------------------
+
 bool MFPVideoPlayer::SetVolume(float fVolume) noexcept
 {
-	if (m_pPlayer) {
-		HRESULT hr = m_pPlayer->SetVolume(fVolume);
-		return SUCCEEDED(hr);
-	}
-	return false;
+	m_fVolume = fVolume;
+	return !m_pPlayer || SUCCEEDED(m_pPlayer->SetVolume(fVolume));
 }
 
 bool MFPVideoPlayer::GetMute() noexcept
 {
-	BOOL bMute = FALSE;
-	if (m_pPlayer)
-		m_pPlayer->GetMute(&bMute);
-	return bMute;
+	return m_bMute;
 }
 
 bool MFPVideoPlayer::SetMute(bool bMute) noexcept
+{
+	m_bMute = bMute;
+	return !m_pPlayer || SUCCEEDED(m_pPlayer->SetMute(bMute));
+}
+
+float MFPVideoPlayer::GetRate() noexcept
+{
+	MFPPlayerState state;
+	if (m_snapshot.Read(&state))
+		return state.fRate;
+	return 1.0f;
+}
+
+bool MFPVideoPlayer::SetRate(float fRate) noexcept
 {
 	if (m_pPlayer) {
-		HRESULT hr = m_pPlayer->SetMute(bMute);
+		HRESULT hr = m_pPlayer->SetRate(fRate);
 		return SUCCEEDED(hr);
 	}
 	return false;
@@ -282,54 +607,53 @@ bool MFPVideoPlayer::SetMute(bool bMute) noexcept
 
 HRESULT MFPVideoPlayer::CanSeek(BOOL *pbCanSeek)
 {
-	*pbCanSeek = ((m_caps & MFP_MEDIAITEM_CAN_SEEK) && !(m_caps  & MFP_MEDIAITEM_HAS_SLOW_SEEK));
+	MFPPlayerState state;
+	MFP_MEDIAITEM_CHARACTERISTICS caps = m_snapshot.Read(&state) ? state.caps : 0;
+	*pbCanSeek = ((caps & MFP_MEDIAITEM_CAN_SEEK) && !(caps & MFP_MEDIAITEM_HAS_SLOW_SEEK));
 	return S_OK;
 }
 
 //-----------------------------------------------------------------------------
 // GetDuration
 //
-// Gets the playback duration.
+// Gets the playback duration of the current media item.
 //-----------------------------------------------------------------------------
 
 HRESULT MFPVideoPlayer::GetDuration(MFTIME *phnsDuration)
 {
-	HRESULT hr = E_FAIL;
-
-	PROPVARIANT var;
-	PropVariantInit(&var);
-	if (m_pPlayer) {
-		hr = m_pPlayer->GetDuration(MFP_POSITIONTYPE_100NS, &var);
-		if (SUCCEEDED(hr)) {
-			*phnsDuration = var.uhVal.QuadPart;
-		}
-	}
-
-	PropVariantClear(&var);
-	return hr;
+	MFPPlayerState state;
+	if (!m_pPlayer || !m_snapshot.Read(&state) || state.hnsDuration <= 0)
+		return E_FAIL;
+	*phnsDuration = state.hnsDuration;
+	return S_OK;
 }
 
 //-----------------------------------------------------------------------------
 // GetCurrentPosition
 // 
-// Gets the current playback position.
+// Estimates the current playback position: the last sampled position,
+// advanced by the time since at the playback rate while playing, and
+// held at the duration.
 //-----------------------------------------------------------------------------
 
 HRESULT MFPVideoPlayer::GetCurrentPosition(MFTIME *phnsPosition)
 {
-	HRESULT hr = E_FAIL;
-
-	PROPVARIANT var;
-	PropVariantInit(&var);
-	if (m_pPlayer) {
-		hr = m_pPlayer->GetPosition(MFP_POSITIONTYPE_100NS, &var);
-		if (SUCCEEDED(hr)) {
-			*phnsPosition = var.hVal.QuadPart;
-		}
+	MFPPlayerState state;
+	if (!m_pPlayer || !m_snapshot.Read(&state) || state.state == MFP_MEDIAPLAYER_STATE_EMPTY)
+		return E_FAIL;
+
+	HNSTIME hnsPosition = state.hnsPosition;
+	if (state.state == MFP_MEDIAPLAYER_STATE_PLAYING) {
+		HNSTIME hnsElapsed = MFGetSystemTime() - state.hnsSampled;
+		if (hnsElapsed > 0)
+			hnsPosition += (HNSTIME)(hnsElapsed * (double)state.fRate);
+		if (state.hnsDuration > 0 && hnsPosition > state.hnsDuration)
+			hnsPosition = state.hnsDuration;
+		if (hnsPosition < 0)
+			hnsPosition = 0;
 	}
-
-	PropVariantClear(&var);
-	return hr;
+	*phnsPosition = hnsPosition;
+	return S_OK;
 }
 
 //-----------------------------------------------------------------------------
@@ -354,6 +678,61 @@ HRESULT MFPVideoPlayer::SetPosition(MFTIME hnsPosition)
 	return hr;
 }
 
+//-----------------------------------------------------------------------------
+// GetVideoSize
+//
+// Gets the native size of the video.
+//-----------------------------------------------------------------------------
+
+HRESULT MFPVideoPlayer::GetVideoSize(SIZE* pszVideo)
+{
+	MFPPlayerState state;
+	if (!m_pPlayer || !m_snapshot.Read(&state) || !state.bHasVideo)
+		return E_FAIL;
+	return m_pPlayer->GetNativeVideoSize(pszVideo, NULL);
+}
+
+//-----------------------------------------------------------------------------
+// SetViewports
+//
+// A viewport covering the whole window is shown by cropping the source;
+// one that is smaller than the window is the letterboxed picture, which
+// MFPlay draws itself when it preserves the aspect ratio.
+//-----------------------------------------------------------------------------
+
+HRESULT MFPVideoPlayer::SetViewports(const Viewport* pViewports, size_t cViewports, const SIZE& szSource)
+{
+	if (!m_pPlayer)
+		return E_UNEXPECTED;
+	if (cViewports != 1 || szSource.cx <= 0 || szSource.cy <= 0)
+		return E_NOTIMPL;
+
+	HWND hwndVideo = NULL;
+	HRESULT hr = m_pPlayer->GetVideoWindow(&hwndVideo);
+	if (FAILED(hr))
+		return hr;
+
+	RECT rcClient;
+	GetClientRect(hwndVideo, &rcClient);
+	const LayoutRect& rcDest = pViewports->rcDest;
+	bool bFills = rcDest.left <= rcClient.left && rcDest.top <= rcClient.top &&
+		rcDest.right >= rcClient.right && rcDest.bottom >= rcClient.bottom;
+
+	MFVideoNormalizedRect nrcSource = { 0.0f, 0.0f, 1.0f, 1.0f };
+	if (bFills) {
+		const SourceRect& rcSource = pViewports->rcSource;
+		nrcSource.left = (float)(rcSource.left / szSource.cx);
+		nrcSource.top = (float)(rcSource.top / szSource.cy);
+		nrcSource.right = (float)(rcSource.right / szSource.cx);
+		nrcSource.bottom = (float)(rcSource.bottom / szSource.cy);
+	}
+
+	hr = m_pPlayer->SetAspectRatioMode(bFills ? MFVideoARMode_None : MFVideoARMode_PreservePicture);
+	if (SUCCEEDED(hr))
+		hr = m_pPlayer->SetVideoSourceRect(&nrcSource);
+	return hr;
+}
+
 //-------------------------------------------------------------------
 // OnMediaItemCreated
 //
@@ -365,22 +744,23 @@ void MFPVideoPlayer::OnMediaItemCreated(MFP_MEDIAITEM_CREATED_EVENT* pEvent)
 {
 	HRESULT hr = S_OK;
 
-	// The media item was created successfully.
-	if (m_pPlayer) {
-		BOOL bHasVideo = FALSE, bIsSelected = FALSE;
-		while (1) {
-			// Check if the media item contains video.
-			hr = pEvent->pMediaItem->HasVideo(&bHasVideo, &bIsSelected);
-			if (FAILED(hr))
-				break;
-
-			m_bHasVideo = (bHasVideo && bIsSelected);
-
-			// Set the media item on the player. This method completes asynchronously.
-			hr = m_pPlayer->SetMediaItem(pEvent->pMediaItem);
-			break;
+	// A prepared item is kept aside until SwitchToPrepared.
+	DWORD_PTR dwUserData = 0;
+	if (SUCCEEDED(pEvent->pMediaItem->GetUserData(&dwUserData)) && dwUserData == PREPARED_ITEM) {
+		if (m_bPreparing) {
+			m_bPreparing = false;
+			SafeRelease(&m_pNextItem);
+			m_pNextItem = pEvent->pMediaItem;
+			m_pNextItem->AddRef();
+			NotifyPrepared(S_OK);
 		}
+		return;
 	}
+
+	// The media item was created successfully. Set it on the player; this
+	// method completes asynchronously, with MFP_EVENT_TYPE_MEDIAITEM_SET.
+	if (m_pPlayer)
+		hr = m_pPlayer->SetMediaItem(pEvent->pMediaItem);
 	if (FAILED(hr)) {
 		NotifyError(hr);
 		//ShowErrorMessage(L"Error playing this file.", hr);
@@ -401,9 +781,17 @@ void MFPVideoPlayer::OnMediaItemSet(MFP_MEDIAITEM_SET_EVENT* pEvent)
 			break;
 
 		if (pEvent->pMediaItem) {
-			hr = pEvent->pMediaItem->GetCharacteristics(&m_caps);
-			if (FAILED(hr))
-				break;
+			// Another clip replaced the one opened with OpenSource.
+			if (m_pOwnedSource) {
+				IUnknown* pObject = NULL;
+				IMFMediaSource* pItemSource = NULL;
+				if (SUCCEEDED(pEvent->pMediaItem->GetObject(&pObject)))
+					pObject->QueryInterface(IID_PPV_ARGS(&pItemSource));
+				if (pItemSource != m_pOwnedSource)
+					ShutdownOwnedSource();
+				SafeRelease(&pItemSource);
+				SafeRelease(&pObject);
+			}
 		}
 
 		hr = m_pPlayer->Play();
@@ -412,7 +800,8 @@ void MFPVideoPlayer::OnMediaItemSet(MFP_MEDIAITEM_SET_EVENT* pEvent)
 			//ShowErrorMessage(L"IMFPMediaPlayer::Play failed.", hr);
 			break;
 		}
-		m_pPlayer->SetMute(TRUE);
+		m_pPlayer->SetMute(m_bMute);
+		m_pPlayer->SetVolume(m_fVolume);
 		return;
 	}
 	if (FAILED(hr)) {
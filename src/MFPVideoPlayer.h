@@ -1,76 +1,177 @@
 #pragma once
-#include <mfplay.h>
-#include <mferror.h>
+#include "WallpaperPlayer.h"
+#include "StateSnapshot.h"
 
 
-// Private window message to notify the application of playback events.
-static const UINT WM_APP_NOTIFY = WM_APP + 1;   // wparam = MFP_MEDIAPLAYER_STATE
-
-// Private window message to notify the application when an error occurs.
-static const UINT WM_APP_ERROR = WM_APP + 2;    // wparam = HRESULT
+// State of an MFPVideoPlayer as of its last MFPlay event.
+struct MFPPlayerState
+{
+	MFP_MEDIAPLAYER_STATE			state;
+	MFP_MEDIAITEM_CHARACTERISTICS	caps;
+	HNSTIME		hnsDuration;	// 0 = unknown
+	HNSTIME		hnsPosition;	// Position at hnsSampled
+	HNSTIME		hnsSampled;		// MFGetSystemTime when the position was read
+	float		fRate;
+	bool		bHasVideo;
+	uint32_t	cEvents;		// MFPlay events since the player was created
+	uint32_t	cErrors;
+	HRESULT		hrLastError;
+};
 
 
 //-------------------------------------------------------------------
 //
 // MediaPlayerCallback class
 // 
-// Implements the callback interface for MFPlay events.
+// IWallpaperPlayer over MFPlay. Implements the callback interface for
+// MFPlay events.
+//
+// Each event updates an MFPPlayerState that is published through a
+// StateSnapshot, so the state, duration, position, rate and seeking
+// queries read it from any thread without a call into MFPlay. The
+// position is extrapolated from the last sample by the rate while
+// playing; every loop seek and state change samples it again.
 //
 //-------------------------------------------------------------------
 
-class MFPVideoPlayer : public IMFPMediaPlayerCallback
+class MFPVideoPlayer : public IMFPMediaPlayerCallback, public IWallpaperPlayer
 {
 public:
-	static HRESULT CreateInstance(HWND hwndEvent, HWND hwndVideo, MFPVideoPlayer** ppPlayer);
+	static HRESULT CreateInstance(PlayerEventQueue* pEvents, HWND hwndVideo, MFPVideoPlayer** ppPlayer);
 
 	// IUnknown methods
-	STDMETHODIMP QueryInterface(REFIID iid, void** ppv);
-	STDMETHODIMP_(ULONG) AddRef();
-	STDMETHODIMP_(ULONG) Release();
+	STDMETHODIMP QueryInterface(REFIID iid, void** ppv) override;
+	STDMETHODIMP_(ULONG) AddRef() override;
+	STDMETHODIMP_(ULONG) Release() override;
 
 	// IMFPMediaPlayerCallback methods
-	void STDMETHODCALLTYPE OnMediaPlayerEvent(MFP_EVENT_HEADER* pEventHeader);
-
-	HRESULT OpenURL(const WCHAR* sURL);
-	HRESULT Shutdown();
-	MFP_MEDIAPLAYER_STATE GetState() noexcept;
-	bool Play() noexcept;
-	bool Pause() noexcept;
-	bool Stop() noexcept;
-	float GetVolume() noexcept;
-	bool SetVolume(float fVolume) noexcept;
-	bool GetMute() noexcept;
-	bool SetMute(bool bMute) noexcept;
+	void STDMETHODCALLTYPE OnMediaPlayerEvent(MFP_EVENT_HEADER* pEventHeader) override;
+
+	HRESULT OpenURL(const WCHAR* sURL) override;
+
+	// Resolves a clip to a media source. Thread-safe and independent of any
+	// player, so a clip can be opened and probed while the player window is
+	// still being created. Needs MFStartup.
+	static HRESULT ResolveSource(const WCHAR* sURL, size_t cbLoopCache, IMFMediaSource** ppSource);
+
+	// Plays a source from ResolveSource. The player shuts it down once
+	// another clip is set or the player shuts down.
+	HRESULT OpenSource(IMFMediaSource* pSource, const WCHAR* sURL) override;
+
+	// Loop cache: clips up to cbBudget bytes are read into memory once and
+	// demuxed from there on every pass. 0 disables it (the default).
+	void SetLoopCacheBudget(size_t cbBudget) override { m_cbLoopCache = cbBudget; }
+
+	// Optional collector of player event and error counts.
+	void SetStats(PlaybackStats* pStats) override { m_pStats = pStats; }
+	void SetClipCache(ClipCache* pCache) override { m_pClipCache = pCache; }
+
+	// MFPlay seeks and restarts the decoder itself; an index would not
+	// speed up its loop.
+	void SetIndexDirectory(const WCHAR*) override {}
+
+	// Prepared media item: opened in the background while the current one
+	// keeps playing, then swapped in with SwitchToPrepared.
+	HRESULT PrepareURL(const WCHAR* sURL) override;
+	bool IsPrepared() override { return m_pNextItem != NULL; }
+	HRESULT SwitchToPrepared() override;
+	void CancelPrepared() override;
+
+	HRESULT Shutdown() override;
+	MFP_MEDIAPLAYER_STATE GetState() noexcept override;
+	bool Play() noexcept override;
+	bool Pause() noexcept override;
+	bool Stop() noexcept override;
+	float GetVolume() noexcept override;
+	bool SetVolume(float fVolume) noexcept override;
+	bool GetMute() noexcept override;
+	bool SetMute(bool bMute) noexcept override;
+	float GetRate() noexcept override;
+	bool SetRate(float fRate) noexcept override;
+
+	// Frame rate cap, 0 = none. MFPlay presents every decoded frame through
+	// its own presenter, so this player cannot decimate.
+	HRESULT SetMaxFrameRate(float fFps) override
+	{
+		return fFps > 0.0f ? E_NOTIMPL : S_OK;
+	}
 
 	// Seeking
-	HRESULT GetDuration(MFTIME *phnsDuration);
-	HRESULT CanSeek(BOOL *pbCanSeek);
-	HRESULT GetCurrentPosition(MFTIME *phnsPosition);
-	HRESULT SetPosition(MFTIME hnsPosition);
-
-	inline void UpdateVideo() {
-		if (m_pPlayer && m_bHasVideo)
+	HRESULT GetDuration(MFTIME *phnsDuration) override;
+	HRESULT CanSeek(BOOL *pbCanSeek) override;
+	HRESULT GetCurrentPosition(MFTIME *phnsPosition) override;
+	HRESULT SetPosition(MFTIME hnsPosition) override;
+
+	// Video
+	HRESULT GetVideoSize(SIZE* pszVideo) override;
+
+	// Shows the viewports of a monitor layout in the video window. MFPlay
+	// draws one picture into one window, so only a single viewport that
+	// fills the window or is letterboxed in it can be shown.
+	HRESULT SetViewports(const Viewport* pViewports, size_t cViewports, const SIZE& szSource) override;
+
+	inline void UpdateVideo() override {
+		MFPPlayerState state;
+		if (m_pPlayer && m_snapshot.Read(&state) && state.bHasVideo)
 			m_pPlayer->UpdateVideo();
 	}
 
+	// MFPlay's presenter draws the frames on the GPU, out of reach of an
+	// overlay.
+	HRESULT SetOverlay(OverlayCompositor* pOverlay) override
+	{
+		return pOverlay ? E_NOTIMPL : S_OK;
+	}
+	void UpdateOverlay() override {}
+
+	// Copies the published state. Wait-free and callable from any thread;
+	// false until the first MFPlay event.
+	bool GetPlayerState(MFPPlayerState* pState) const { return m_snapshot.Read(pState) != 0; }
+
 protected:
-	MFPVideoPlayer(HWND hwndEvent);
+	MFPVideoPlayer(PlayerEventQueue* pEvents);
 	virtual ~MFPVideoPlayer();
 
 	HRESULT Initialize(HWND hwndVideo);
+	HRESULT CreateMediaItem(const WCHAR* sURL, DWORD_PTR dwUserData);
+	static HRESULT CreateCachedByteStream(const WCHAR* sURL, size_t cbBudget, IMFByteStream** ppByteStream);
+	void ShutdownOwnedSource();
 
-	// NotifyState: Notifies the application when the state changes.
+	// NotifyState: Notifies the application when the state changes. The
+	// record carries the clip's characteristics the last event published.
 	void NotifyState(MFP_MEDIAPLAYER_STATE state)
 	{
-		PostMessage(m_hwndEvent, WM_APP_NOTIFY, (WPARAM)state, (LPARAM)0);
+		m_pEvents->Post(PLAYER_EVENT_STATE, (uint32_t)state, S_OK, (uint32_t)m_state.caps);
 	}
 
 	// NotifyError: Notifies the application when an error occurs.
 	void NotifyError(HRESULT hr)
 	{
-		PostMessage(m_hwndEvent, WM_APP_ERROR, (WPARAM)hr, 0);
+		m_pEvents->Post(PLAYER_EVENT_ERROR, 0, hr);
 	}
 
+	// NotifyEnded: Notifies the application when playback reached the end.
+	void NotifyEnded()
+	{
+		m_pEvents->Post(PLAYER_EVENT_ENDED);
+	}
+
+	// NotifyRate: Notifies the application when the playback rate changed.
+	void NotifyRate()
+	{
+		m_pEvents->Post(PLAYER_EVENT_RATE);
+	}
+
+	// NotifyPrepared: Notifies the application when the prepared item is ready or failed.
+	void NotifyPrepared(HRESULT hr)
+	{
+		m_pEvents->Post(PLAYER_EVENT_PREPARED, 0, hr);
+	}
+
+	// Updates the state from an event and publishes it; called on the
+	// MFPlay event thread only, which is the snapshot's one writer.
+	void PublishState(MFP_EVENT_HEADER* pEventHeader);
+
 	// MFPlay event handler functions.
 	void OnMediaItemCreated(MFP_MEDIAITEM_CREATED_EVENT* pEvent);
 	void OnMediaItemSet(MFP_MEDIAITEM_SET_EVENT* pEvent);
@@ -78,7 +179,16 @@ protected:
 private:
 	long					m_cRef;			// Reference count
 	IMFPMediaPlayer*		m_pPlayer;		// The MFPlay player object.
-	HWND					m_hwndEvent;	// App window to receive events.
-	bool					m_bHasVideo;
-	MFP_MEDIAITEM_CHARACTERISTICS	m_caps;
+	IMFPMediaItem*			m_pNextItem;	// Prepared media item
+	IMFMediaSource*			m_pOwnedSource;	// Source passed to OpenSource
+	bool					m_bPreparing;
+	PlayerEventQueue*		m_pEvents;		// App queue to receive events.
+	bool					m_bStarted;		// MFStartup succeeded
+	size_t					m_cbLoopCache;	// Loop cache budget, 0 = off
+	PlaybackStats*			m_pStats;
+	ClipCache*				m_pClipCache;
+	float					m_fVolume;		// Applied to every media item
+	bool					m_bMute;
+	MFPPlayerState			m_state;		// Event thread's copy of the published state
+	StateSnapshot<MFPPlayerState>	m_snapshot;
 };
@@ -0,0 +1,211 @@
+#include "MonitorLayout.h"
+#include <math.h>
+#include <algorithm>
+
+
+// Reference DPI of the physical layout: one unit is 1/96 inch.
+static const double REFERENCE_DPI = 96.0;
+
+struct AreaD
+{
+	double	left;
+	double	top;
+	double	right;
+	double	bottom;
+};
+
+static inline double Width(const AreaD& a) { return a.right - a.left; }
+static inline double Height(const AreaD& a) { return a.bottom - a.top; }
+
+static AreaD ToArea(const LayoutRect& rc)
+{
+	AreaD a = { (double)rc.left, (double)rc.top, (double)rc.right, (double)rc.bottom };
+	return a;
+}
+
+static bool Intersect(const AreaD& a, const AreaD& b, AreaD* pOut)
+{
+	pOut->left = std::max(a.left, b.left);
+	pOut->top = std::max(a.top, b.top);
+	pOut->right = std::min(a.right, b.right);
+	pOut->bottom = std::min(a.bottom, b.bottom);
+	return pOut->left < pOut->right && pOut->top < pOut->bottom;
+}
+
+static double MonitorScale(const MonitorDesc& monitor)
+{
+	return REFERENCE_DPI / (monitor.nDpi ? monitor.nDpi : REFERENCE_DPI);
+}
+
+LayoutRect GetMonitorBounds(const MonitorDesc* pMonitors, size_t cMonitors)
+{
+	LayoutRect rc = { 0, 0, 0, 0 };
+	for (size_t i = 0; i < cMonitors; i++) {
+		const LayoutRect& m = pMonitors[i].rcMonitor;
+		if (i == 0) {
+			rc = m;
+			continue;
+		}
+		rc.left = std::min(rc.left, m.left);
+		rc.top = std::min(rc.top, m.top);
+		rc.right = std::max(rc.right, m.right);
+		rc.bottom = std::max(rc.bottom, m.bottom);
+	}
+	return rc;
+}
+
+//-----------------------------------------------------------------------------
+// PlacePhysical
+//
+// Lays the monitors out by physical size. A monitor that touches an already
+// placed one on its left (or top) edge is attached to that edge, so rows
+// and columns of mixed-DPI monitors stay adjacent; any other monitor keeps
+// its scaled desktop position.
+//-----------------------------------------------------------------------------
+
+static void PlacePhysical(const MonitorDesc* pMonitors, size_t cMonitors, std::vector<AreaD>* pAreas)
+{
+	std::vector<size_t> order(cMonitors);
+	for (size_t i = 0; i < cMonitors; i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [pMonitors](size_t a, size_t b) {
+		const LayoutRect& ra = pMonitors[a].rcMonitor;
+		const LayoutRect& rb = pMonitors[b].rcMonitor;
+		return ra.left != rb.left ? ra.left < rb.left : ra.top < rb.top;
+	});
+
+	std::vector<bool> placed(cMonitors, false);
+	pAreas->assign(cMonitors, AreaD());
+
+	for (size_t k = 0; k < cMonitors; k++) {
+		size_t i = order[k];
+		const LayoutRect& r = pMonitors[i].rcMonitor;
+		double scale = MonitorScale(pMonitors[i]);
+		double x = r.left * scale, y = r.top * scale;
+
+		for (size_t j = 0; j < cMonitors; j++) {
+			if (!placed[j])
+				continue;
+			const LayoutRect& n = pMonitors[j].rcMonitor;
+			const AreaD& an = (*pAreas)[j];
+			double scaleN = MonitorScale(pMonitors[j]);
+			if (n.right == r.left && n.top < r.bottom && r.top < n.bottom) {
+				x = an.right;
+				y = an.top + (r.top - n.top) * scaleN;
+				break;
+			}
+			if (n.bottom == r.top && n.left < r.right && r.left < n.right) {
+				x = an.left + (r.left - n.left) * scaleN;
+				y = an.bottom;
+				break;
+			}
+		}
+
+		AreaD& a = (*pAreas)[i];
+		a.left = x;
+		a.top = y;
+		a.right = x + (r.right - r.left) * scale;
+		a.bottom = y + (r.bottom - r.top) * scale;
+		placed[i] = true;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// PlacePicture
+//
+// Where the picture lands when scaled into area.
+//-----------------------------------------------------------------------------
+
+static AreaD PlacePicture(const LayoutParams& params, const AreaD& area)
+{
+	if (params.scale == SCALE_STRETCH)
+		return area;
+
+	double sx = Width(area) / params.cxSource;
+	double sy = Height(area) / params.cySource;
+	double s = params.scale == SCALE_FILL ? std::max(sx, sy) : std::min(sx, sy);
+	double cx = params.cxSource * s, cy = params.cySource * s;
+
+	AreaD placed;
+	placed.left = area.left + (Width(area) - cx) / 2;
+	placed.top = area.top + (Height(area) - cy) / 2;
+	placed.right = placed.left + cx;
+	placed.bottom = placed.top + cy;
+	return placed;
+}
+
+//-----------------------------------------------------------------------------
+// SolveMonitorLayout
+//
+// Every monitor has a layout area (its rectangle, or its physical
+// rectangle) and a pixel rectangle. The picture is placed in layout
+// space, clipped to each monitor, converted to pixels and rounded; the
+// source rectangle is computed back from the rounded destination so the
+// two always agree.
+//-----------------------------------------------------------------------------
+
+bool SolveMonitorLayout(const LayoutParams& params, const MonitorDesc* pMonitors, size_t cMonitors,
+	std::vector<Viewport>* pViewports)
+{
+	pViewports->clear();
+	if (!params.cxSource || !params.cySource || !cMonitors)
+		return false;
+
+	std::vector<AreaD> areas;
+	if (params.layout == LAYOUT_SPAN_PHYSICAL) {
+		PlacePhysical(pMonitors, cMonitors, &areas);
+	}
+	else {
+		areas.resize(cMonitors);
+		for (size_t i = 0; i < cMonitors; i++)
+			areas[i] = ToArea(pMonitors[i].rcMonitor);
+	}
+
+	AreaD bounds = areas[0];
+	for (size_t i = 1; i < cMonitors; i++) {
+		bounds.left = std::min(bounds.left, areas[i].left);
+		bounds.top = std::min(bounds.top, areas[i].top);
+		bounds.right = std::max(bounds.right, areas[i].right);
+		bounds.bottom = std::max(bounds.bottom, areas[i].bottom);
+	}
+	if (Width(bounds) <= 0 || Height(bounds) <= 0)
+		return false;
+
+	AreaD spanned = PlacePicture(params, bounds);
+
+	for (size_t i = 0; i < cMonitors; i++) {
+		const AreaD& area = areas[i];
+		const AreaD rcPixels = ToArea(pMonitors[i].rcMonitor);
+		if (Width(area) <= 0 || Height(area) <= 0)
+			continue;
+
+		AreaD placed = params.layout == LAYOUT_CLONE ? PlacePicture(params, area) : spanned;
+		AreaD visible;
+		if (!Intersect(area, placed, &visible))
+			continue;
+
+		// Layout space -> pixels of this monitor.
+		double kx = Width(rcPixels) / Width(area);
+		double ky = Height(rcPixels) / Height(area);
+
+		Viewport vp;
+		vp.nMonitor = (uint32_t)i;
+		vp.rcDest.left = (int32_t)floor(rcPixels.left + (visible.left - area.left) * kx + 0.5);
+		vp.rcDest.top = (int32_t)floor(rcPixels.top + (visible.top - area.top) * ky + 0.5);
+		vp.rcDest.right = (int32_t)floor(rcPixels.left + (visible.right - area.left) * kx + 0.5);
+		vp.rcDest.bottom = (int32_t)floor(rcPixels.top + (visible.bottom - area.top) * ky + 0.5);
+		if (vp.rcDest.left >= vp.rcDest.right || vp.rcDest.top >= vp.rcDest.bottom)
+			continue;
+
+		// Rounded pixels -> layout space -> source pixels.
+		double sx = params.cxSource / Width(placed);
+		double sy = params.cySource / Height(placed);
+		vp.rcSource.left = (area.left + (vp.rcDest.left - rcPixels.left) / kx - placed.left) * sx;
+		vp.rcSource.top = (area.top + (vp.rcDest.top - rcPixels.top) / ky - placed.top) * sy;
+		vp.rcSource.right = (area.left + (vp.rcDest.right - rcPixels.left) / kx - placed.left) * sx;
+		vp.rcSource.bottom = (area.top + (vp.rcDest.bottom - rcPixels.top) / ky - placed.top) * sy;
+
+		pViewports->push_back(vp);
+	}
+	return true;
+}
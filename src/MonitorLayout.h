@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+
+// How the clip is laid out over the monitors.
+enum LAYOUT_MODE
+{
+	LAYOUT_SPAN = 0,		// One picture over the bounding box of all monitors
+	LAYOUT_SPAN_PHYSICAL,	// Span with each monitor sized by its DPI, so the picture lines up across mixed DPIs
+	LAYOUT_CLONE			// The whole picture on every monitor
+};
+
+// How the picture is scaled into its target area.
+enum SCALE_MODE
+{
+	SCALE_FIT = 0,			// Whole picture visible, letterboxed
+	SCALE_FILL,				// Area covered, picture cropped
+	SCALE_STRETCH			// Area covered, aspect ratio ignored
+};
+
+// Integer rectangle in pixels, right/bottom exclusive.
+struct LayoutRect
+{
+	int32_t	left;
+	int32_t	top;
+	int32_t	right;
+	int32_t	bottom;
+};
+
+// Rectangle in source pixels, may be fractional.
+struct SourceRect
+{
+	double	left;
+	double	top;
+	double	right;
+	double	bottom;
+};
+
+struct MonitorDesc
+{
+	LayoutRect	rcMonitor;	// Position in the output (desktop host) coordinates
+	uint32_t	nDpi;		// Effective DPI, 0 = 96
+};
+
+struct LayoutParams
+{
+	uint32_t	cxSource;
+	uint32_t	cySource;
+	LAYOUT_MODE	layout;
+	SCALE_MODE	scale;
+};
+
+// One monitor's share of the picture: rcSource of the frame is drawn into
+// rcDest. Monitors that show nothing of the picture get no viewport.
+struct Viewport
+{
+	SourceRect	rcSource;
+	LayoutRect	rcDest;
+	uint32_t	nMonitor;	// Index into the monitor array
+};
+
+
+//-------------------------------------------------------------------
+// SolveMonitorLayout
+//
+// Maps one decoded frame onto cMonitors monitor rectangles. All viewports
+// sample the same frame, so one decode feeds every monitor.
+//
+// Returns false if the source or monitor geometry is empty.
+//-------------------------------------------------------------------
+
+bool SolveMonitorLayout(const LayoutParams& params, const MonitorDesc* pMonitors, size_t cMonitors,
+	std::vector<Viewport>* pViewports);
+
+// Smallest rectangle containing all monitors.
+LayoutRect GetMonitorBounds(const MonitorDesc* pMonitors, size_t cMonitors);
@@ -0,0 +1,626 @@
+#include "OverlayCompositor.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+
+// Built-in font: 7 rows of 5 columns per glyph, the high bit leftmost.
+static const char s_szGlyphs[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ:.%-/+";
+static const uint8_t s_glyphs[][OVERLAY_GLYPH_HEIGHT] = {
+	{ 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },	// 0
+	{ 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },	// 1
+	{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },	// 2
+	{ 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },	// 3
+	{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },	// 4
+	{ 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },	// 5
+	{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },	// 6
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },	// 7
+	{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },	// 8
+	{ 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },	// 9
+	{ 0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11 },	// A
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },	// B
+	{ 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E },	// C
+	{ 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },	// D
+	{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F },	// E
+	{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },	// F
+	{ 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F },	// G
+	{ 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },	// H
+	{ 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },	// I
+	{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },	// J
+	{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },	// K
+	{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },	// L
+	{ 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 },	// M
+	{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },	// N
+	{ 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },	// O
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },	// P
+	{ 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D },	// Q
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },	// R
+	{ 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E },	// S
+	{ 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },	// T
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },	// U
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },	// V
+	{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A },	// W
+	{ 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },	// X
+	{ 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 },	// Y
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F },	// Z
+	{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },	// :
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C },	// .
+	{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },	// %
+	{ 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 },	// -
+	{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },	// /
+	{ 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 },	// +
+};
+
+// Rows of the glyph of ch, or NULL for a blank.
+static const uint8_t* FindGlyph(char ch)
+{
+	if (ch >= 'a' && ch <= 'z')
+		ch = (char)(ch - 'a' + 'A');
+	const char* p = ch ? strchr(s_szGlyphs, ch) : NULL;
+	return p ? s_glyphs[p - s_szGlyphs] : NULL;
+}
+
+// a * b / 255, rounded as the blend kernels round.
+static inline uint32_t Mul255(uint32_t a, uint32_t b)
+{
+	uint32_t t = a * b + 128;
+	return (t + (t >> 8)) >> 8;
+}
+
+// 0xAARRGGBB to a premultiplied BGRA pixel.
+static void Premultiply(uint32_t nColor, uint8_t* pOut)
+{
+	uint32_t nAlpha = nColor >> 24;
+	pOut[0] = (uint8_t)Mul255(nColor & 0xFF, nAlpha);
+	pOut[1] = (uint8_t)Mul255((nColor >> 8) & 0xFF, nAlpha);
+	pOut[2] = (uint8_t)Mul255((nColor >> 16) & 0xFF, nAlpha);
+	pOut[3] = (uint8_t)nAlpha;
+}
+
+static bool Intersects(const LayoutRect& a, const LayoutRect& b)
+{
+	return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+static LayoutRect Union(const LayoutRect& a, const LayoutRect& b)
+{
+	LayoutRect rc = a;
+	rc.left = b.left < rc.left ? b.left : rc.left;
+	rc.top = b.top < rc.top ? b.top : rc.top;
+	rc.right = b.right > rc.right ? b.right : rc.right;
+	rc.bottom = b.bottom > rc.bottom ? b.bottom : rc.bottom;
+	return rc;
+}
+
+// Adds a dirty rectangle, merging it into the last one when they are full.
+static void AddDirty(const LayoutRect& rc, LayoutRect* pDirty, size_t cMaxDirty, size_t* pcDirty)
+{
+	if (!cMaxDirty)
+		return;
+	if (*pcDirty < cMaxDirty)
+		pDirty[(*pcDirty)++] = rc;
+	else
+		pDirty[cMaxDirty - 1] = Union(pDirty[cMaxDirty - 1], rc);
+}
+
+// Copies the pixels of rc between a frame and a backing store.
+static void CopyRect(const LayoutRect& rc, uint8_t* pPixels, size_t cbStride, uint8_t* pBacking, bool bSave)
+{
+	size_t cbRow = (size_t)(rc.right - rc.left) * 4;
+	for (int32_t y = rc.top; y < rc.bottom; y++, pBacking += cbRow) {
+		uint8_t* pRow = pPixels + (size_t)y * cbStride + (size_t)rc.left * 4;
+		if (bSave)
+			memcpy(pBacking, pRow, cbRow);
+		else
+			memcpy(pRow, pBacking, cbRow);
+	}
+}
+
+OverlayTextStyle GetDefaultOverlayTextStyle()
+{
+	OverlayTextStyle style;
+	style.nColor = 0xFFFFFFFF;
+	style.nBackground = 0x80000000;
+	style.nScale = 3;
+	style.cPadding = 6;
+	return style;
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+OverlayCompositor::OverlayCompositor() : m_nSecondOfDay(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+// RenderText
+//
+// Rasterizes pWidget->text: the background box, then each glyph's pixels
+// as the text color blended over it. False if it would be too large.
+//-----------------------------------------------------------------------------
+
+bool OverlayCompositor::RenderText(Widget* pWidget)
+{
+	const OverlayTextStyle& style = pWidget->style;
+	uint64_t cChars = pWidget->text.size();
+	uint64_t cxText = cChars ? cChars * OVERLAY_GLYPH_ADVANCE * style.nScale - style.nScale : 0;
+	uint64_t cx = 2 * (uint64_t)style.cPadding + cxText;
+	uint64_t cy = 2 * (uint64_t)style.cPadding + OVERLAY_GLYPH_HEIGHT * style.nScale;
+	if (cx > OVERLAY_MAX_WIDGET_SIZE || cy > OVERLAY_MAX_WIDGET_SIZE)
+		return false;
+
+	pWidget->cx = (uint32_t)cx;
+	pWidget->cy = (uint32_t)cy;
+	pWidget->surface.resize((size_t)cx * cy * 4);
+
+	uint8_t background[4], ink[4], color[4];
+	Premultiply(style.nBackground, background);
+	Premultiply(style.nColor, color);
+	memcpy(ink, background, sizeof(ink));
+	BlendOverScalar(color, ink, 1);
+
+	uint8_t* pSurface = pWidget->surface.data();
+	for (size_t i = 0; i < (size_t)cx * cy; i++)
+		memcpy(pSurface + i * 4, background, 4);
+
+	for (size_t n = 0; n < cChars; n++) {
+		const uint8_t* pGlyph = FindGlyph(pWidget->text[n]);
+		if (!pGlyph)
+			continue;
+		size_t x0 = style.cPadding + n * OVERLAY_GLYPH_ADVANCE * style.nScale;
+		for (uint32_t row = 0; row < OVERLAY_GLYPH_HEIGHT; row++) {
+			for (uint32_t col = 0; col < OVERLAY_GLYPH_WIDTH; col++) {
+				if (!(pGlyph[row] & (0x10 >> col)))
+					continue;
+				for (uint32_t dy = 0; dy < style.nScale; dy++) {
+					size_t y = style.cPadding + row * style.nScale + dy;
+					uint8_t* pPixel = pSurface + (y * cx + x0 + col * style.nScale) * 4;
+					for (uint32_t dx = 0; dx < style.nScale; dx++)
+						memcpy(pPixel + dx * 4, ink, 4);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// Finds the columns of each row that are not transparent, which are all
+// Blend has to touch.
+void OverlayCompositor::FindSpans(Widget* pWidget)
+{
+	pWidget->spans.resize(pWidget->cy);
+	for (uint32_t y = 0; y < pWidget->cy; y++) {
+		const uint8_t* pRow = pWidget->surface.data() + (size_t)y * pWidget->cx * 4;
+		RowSpan span = { 0, 0 };
+		for (uint32_t x = 0; x < pWidget->cx; x++) {
+			uint32_t nPixel;
+			memcpy(&nPixel, pRow + (size_t)x * 4, 4);
+			if (nPixel) {
+				if (span.x1 == 0)
+					span.x0 = x;
+				span.x1 = x + 1;
+			}
+		}
+		pWidget->spans[y] = span;
+	}
+}
+
+uint32_t OverlayCompositor::AddWidget(Widget* pWidget)
+{
+	if (!pWidget->cx || !pWidget->cy)
+		return 0;
+	FindSpans(pWidget);
+	pWidget->bVisible = true;
+	pWidget->nVersion = 1;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_widgets.push_back(std::move(*pWidget));
+	return (uint32_t)m_widgets.size();
+}
+
+//-----------------------------------------------------------------------------
+// AddText / AddClock / AddImage
+//-----------------------------------------------------------------------------
+
+uint32_t OverlayCompositor::AddText(const char* pszText, const OverlayTextStyle& style, const OverlayPlacement& placement)
+{
+	Widget widget = Widget();
+	widget.type = WIDGET_TEXT;
+	widget.placement = placement;
+	widget.style = style;
+	widget.style.nScale = style.nScale ? style.nScale : 1;
+	widget.text = pszText ? pszText : "";
+	if (!RenderText(&widget))
+		return 0;
+	return AddWidget(&widget);
+}
+
+static void FormatClock(int32_t nSecondOfDay, bool bSeconds, char* pszText, size_t cchText)
+{
+	if (bSeconds)
+		snprintf(pszText, cchText, "%02d:%02d:%02d", nSecondOfDay / 3600, nSecondOfDay / 60 % 60, nSecondOfDay % 60);
+	else
+		snprintf(pszText, cchText, "%02d:%02d", nSecondOfDay / 3600, nSecondOfDay / 60 % 60);
+}
+
+uint32_t OverlayCompositor::AddClock(bool bSeconds, const OverlayTextStyle& style, const OverlayPlacement& placement)
+{
+	char szText[16];
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		FormatClock(m_nSecondOfDay, bSeconds, szText, sizeof(szText));
+	}
+	Widget widget = Widget();
+	widget.type = WIDGET_CLOCK;
+	widget.placement = placement;
+	widget.bSeconds = bSeconds;
+	widget.style = style;
+	widget.style.nScale = style.nScale ? style.nScale : 1;
+	widget.text = szText;
+	if (!RenderText(&widget))
+		return 0;
+	return AddWidget(&widget);
+}
+
+uint32_t OverlayCompositor::AddImage(const uint8_t* pBGRA, uint32_t cx, uint32_t cy, size_t cbStride, uint8_t nOpacity,
+	const OverlayPlacement& placement)
+{
+	if (!pBGRA || cx > OVERLAY_MAX_WIDGET_SIZE || cy > OVERLAY_MAX_WIDGET_SIZE || cbStride < (size_t)cx * 4)
+		return 0;
+
+	Widget widget = Widget();
+	widget.type = WIDGET_IMAGE;
+	widget.placement = placement;
+	widget.cx = cx;
+	widget.cy = cy;
+	widget.surface.resize((size_t)cx * cy * 4);
+	for (uint32_t y = 0; y < cy; y++) {
+		const uint8_t* pIn = pBGRA + (size_t)y * cbStride;
+		uint8_t* pOut = widget.surface.data() + (size_t)y * cx * 4;
+		for (uint32_t x = 0; x < cx; x++, pIn += 4, pOut += 4) {
+			uint32_t nAlpha = Mul255(pIn[3], nOpacity);
+			for (int c = 0; c < 3; c++)
+				pOut[c] = (uint8_t)Mul255(pIn[c], nAlpha);
+			pOut[3] = (uint8_t)nAlpha;
+		}
+	}
+	return AddWidget(&widget);
+}
+
+//-----------------------------------------------------------------------------
+// SetText / SetPlacement / SetVisible / SetTime
+//
+// Each change bumps the widget's version, which is how Compose finds it.
+//-----------------------------------------------------------------------------
+
+bool OverlayCompositor::SetText(uint32_t nId, const char* pszText)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!nId || nId > m_widgets.size() || m_widgets[nId - 1].type != WIDGET_TEXT)
+		return false;
+	Widget& widget = m_widgets[nId - 1];
+	std::string text = pszText ? pszText : "";
+	if (text == widget.text)
+		return true;
+
+	std::string previous;
+	previous.swap(widget.text);
+	widget.text.swap(text);
+	if (!RenderText(&widget)) {
+		widget.text.swap(previous);
+		return false;
+	}
+	FindSpans(&widget);
+	widget.nVersion++;
+	return true;
+}
+
+bool OverlayCompositor::SetPlacement(uint32_t nId, const OverlayPlacement& placement)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!nId || nId > m_widgets.size())
+		return false;
+	Widget& widget = m_widgets[nId - 1];
+	widget.placement = placement;
+	widget.nVersion++;
+	return true;
+}
+
+bool OverlayCompositor::SetVisible(uint32_t nId, bool bVisible)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!nId || nId > m_widgets.size())
+		return false;
+	Widget& widget = m_widgets[nId - 1];
+	if (widget.bVisible != bVisible) {
+		widget.bVisible = bVisible;
+		widget.nVersion++;
+	}
+	return true;
+}
+
+bool OverlayCompositor::SetTime(int32_t nSecondOfDay)
+{
+	nSecondOfDay %= 24 * 3600;
+	if (nSecondOfDay < 0)
+		nSecondOfDay += 24 * 3600;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_nSecondOfDay = nSecondOfDay;
+	bool bChanged = false;
+	for (size_t i = 0; i < m_widgets.size(); i++) {
+		Widget& widget = m_widgets[i];
+		if (widget.type != WIDGET_CLOCK)
+			continue;
+		char szText[16];
+		FormatClock(nSecondOfDay, widget.bSeconds, szText, sizeof(szText));
+		if (widget.text == szText)
+			continue;
+		// The text keeps its length, so the surface keeps its size.
+		widget.text = szText;
+		RenderText(&widget);
+		FindSpans(&widget);
+		widget.nVersion++;
+		bChanged |= widget.bVisible;
+	}
+	return bChanged;
+}
+
+bool OverlayCompositor::IsEmpty()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (size_t i = 0; i < m_widgets.size(); i++) {
+		if (m_widgets[i].bVisible)
+			return false;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// GetRect
+//
+// The widget's rectangle on a cx x cy output, clipped to it; false if
+// none of it shows.
+//-----------------------------------------------------------------------------
+
+static void GetOrigin(const OverlayPlacement& placement, uint32_t cxWidget, uint32_t cyWidget, uint32_t cx, uint32_t cy,
+	int32_t* px, int32_t* py)
+{
+	bool bRight = placement.anchor == OVERLAY_ANCHOR_TOP_RIGHT || placement.anchor == OVERLAY_ANCHOR_BOTTOM_RIGHT;
+	bool bBottom = placement.anchor == OVERLAY_ANCHOR_BOTTOM_LEFT || placement.anchor == OVERLAY_ANCHOR_BOTTOM_RIGHT;
+	*px = bRight ? (int32_t)cx - placement.x - (int32_t)cxWidget : placement.x;
+	*py = bBottom ? (int32_t)cy - placement.y - (int32_t)cyWidget : placement.y;
+}
+
+bool OverlayCompositor::GetRect(const Widget& widget, uint32_t cx, uint32_t cy, LayoutRect* pRect)
+{
+	int32_t x, y;
+	GetOrigin(widget.placement, widget.cx, widget.cy, cx, cy, &x, &y);
+	pRect->left = x > 0 ? x : 0;
+	pRect->top = y > 0 ? y : 0;
+	pRect->right = x + (int32_t)widget.cx < (int32_t)cx ? x + (int32_t)widget.cx : (int32_t)cx;
+	pRect->bottom = y + (int32_t)widget.cy < (int32_t)cy ? y + (int32_t)widget.cy : (int32_t)cy;
+	return widget.bVisible && widget.cx && pRect->left < pRect->right && pRect->top < pRect->bottom;
+}
+
+// Blends the part of a widget inside rc, row span by row span.
+void OverlayCompositor::Blend(const Widget& widget, const LayoutRect& rc, uint8_t* pPixels, size_t cbStride,
+	uint32_t cx, uint32_t cy)
+{
+	const ColorKernelTable& kernels = GetColorKernels();
+	int32_t xOrigin, yOrigin;
+	GetOrigin(widget.placement, widget.cx, widget.cy, cx, cy, &xOrigin, &yOrigin);
+	for (int32_t y = rc.top; y < rc.bottom; y++) {
+		uint32_t yWidget = (uint32_t)(y - yOrigin);
+		const RowSpan& span = widget.spans[yWidget];
+		int32_t x0 = xOrigin + (int32_t)span.x0, x1 = xOrigin + (int32_t)span.x1;
+		x0 = x0 > rc.left ? x0 : rc.left;
+		x1 = x1 < rc.right ? x1 : rc.right;
+		if (x0 >= x1)
+			continue;
+		const uint8_t* pSrc = widget.surface.data() + ((size_t)yWidget * widget.cx + (uint32_t)(x0 - xOrigin)) * 4;
+		kernels.pfnBlendOver(pSrc, pPixels + (size_t)y * cbStride + (size_t)x0 * 4, (uint32_t)(x1 - x0));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Compose
+//
+// A new frame saves the pixels under every widget and blends them all.
+// Otherwise the widgets whose version moved, plus every widget that
+// overlaps one of them before or after, are put back to the saved pixels
+// and drawn again in order; untouched pixels keep what the last Compose
+// left. After the first frames of a size this allocates nothing.
+//-----------------------------------------------------------------------------
+
+size_t OverlayCompositor::Compose(OverlayTarget* pTarget, uint8_t* pPixels, size_t cbStride, uint32_t cx, uint32_t cy,
+	bool bNewFrame, LayoutRect* pDirty, size_t cMaxDirty)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t cWidgets = m_widgets.size();
+	bool bFull = bNewFrame || pTarget->m_cx != cx || pTarget->m_cy != cy;
+	pTarget->m_cx = cx;
+	pTarget->m_cy = cy;
+	pTarget->m_drawn.resize(cWidgets);
+	pTarget->m_redraw.assign(cWidgets, bFull);
+
+	if (!bFull) {
+		// The changed widgets, then those overlapping them until none joins.
+		LayoutRect rc;
+		for (size_t i = 0; i < cWidgets; i++)
+			pTarget->m_redraw[i] = pTarget->m_drawn[i].nVersion != m_widgets[i].nVersion;
+		for (bool bGrew = true; bGrew; ) {
+			bGrew = false;
+			for (size_t i = 0; i < cWidgets; i++) {
+				const OverlayTarget::Drawn& drawn = pTarget->m_drawn[i];
+				if (pTarget->m_redraw[i] || !drawn.bDrawn)
+					continue;
+				for (size_t j = 0; j < cWidgets && !pTarget->m_redraw[i]; j++) {
+					if (!pTarget->m_redraw[j])
+						continue;
+					const OverlayTarget::Drawn& other = pTarget->m_drawn[j];
+					if ((other.bDrawn && Intersects(drawn.rc, other.rc)) ||
+						(GetRect(m_widgets[j], cx, cy, &rc) && Intersects(drawn.rc, rc))) {
+						pTarget->m_redraw[i] = true;
+						bGrew = true;
+					}
+				}
+			}
+		}
+
+		for (size_t i = 0; i < cWidgets; i++) {
+			OverlayTarget::Drawn& drawn = pTarget->m_drawn[i];
+			if (pTarget->m_redraw[i] && drawn.bDrawn)
+				CopyRect(drawn.rc, pPixels, cbStride, drawn.backing.data(), false);
+		}
+	}
+
+	// Save what is under the widgets to draw before any of them is blended.
+	size_t cDirty = 0;
+	for (size_t i = 0; i < cWidgets; i++) {
+		if (!pTarget->m_redraw[i])
+			continue;
+		OverlayTarget::Drawn& drawn = pTarget->m_drawn[i];
+		bool bWasDrawn = drawn.bDrawn && !bFull;
+		LayoutRect rcOld = drawn.rc;
+		drawn.bDrawn = GetRect(m_widgets[i], cx, cy, &drawn.rc);
+		drawn.nVersion = m_widgets[i].nVersion;
+		if (drawn.bDrawn) {
+			drawn.backing.resize((size_t)(drawn.rc.right - drawn.rc.left) * (drawn.rc.bottom - drawn.rc.top) * 4);
+			CopyRect(drawn.rc, pPixels, cbStride, drawn.backing.data(), true);
+		}
+		if (!bFull && (bWasDrawn || drawn.bDrawn)) {
+			LayoutRect rcDirty = !bWasDrawn ? drawn.rc : drawn.bDrawn ? Union(rcOld, drawn.rc) : rcOld;
+			AddDirty(rcDirty, pDirty, cMaxDirty, &cDirty);
+		}
+	}
+
+	for (size_t i = 0; i < cWidgets; i++) {
+		if (pTarget->m_redraw[i] && pTarget->m_drawn[i].bDrawn)
+			Blend(m_widgets[i], pTarget->m_drawn[i].rc, pPixels, cbStride, cx, cy);
+	}
+
+	if (bFull && cMaxDirty) {
+		LayoutRect rcFrame = { 0, 0, (int32_t)cx, (int32_t)cy };
+		pDirty[cDirty++] = rcFrame;
+	}
+	return cDirty;
+}
+
+
+//********************* Benchmark **********************//
+
+// Elapsed milliseconds since start.
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//-----------------------------------------------------------------------------
+// RunOverlayBench
+//
+// The widgets do not overlap, so a frame-sized layer they were composed
+// into, blended over the whole frame, gives the same pixels as Compose.
+// Copies of the frame between runs are not timed.
+//-----------------------------------------------------------------------------
+
+size_t RunOverlayBench(uint32_t cx, uint32_t cy, uint32_t cFrames, OverlayBenchResult* pResults, size_t cMaxResults)
+{
+	const uint32_t IMAGE_SIZE = 256;
+	const int32_t TIME = 12 * 3600 + 34 * 60;
+	if (cx < IMAGE_SIZE * 2 || cy < IMAGE_SIZE * 2 || !cFrames)
+		return 0;
+
+	size_t cbFrame = (size_t)cx * cy * 4, cbStride = (size_t)cx * 4;
+	std::vector<uint8_t> base(cbFrame), pixels(cbFrame), layer(cbFrame), reference(cbFrame);
+	uint32_t nSeed = 12345;
+	for (size_t i = 0; i < cbFrame; i++) {
+		nSeed = nSeed * 1664525 + 1013904223;
+		base[i] = (uint8_t)(nSeed >> 24);
+	}
+
+	// A round logo fading out to its edge.
+	std::vector<uint8_t> image((size_t)IMAGE_SIZE * IMAGE_SIZE * 4);
+	for (uint32_t y = 0; y < IMAGE_SIZE; y++) {
+		for (uint32_t x = 0; x < IMAGE_SIZE; x++) {
+			int32_t dx = (int32_t)x - IMAGE_SIZE / 2, dy = (int32_t)y - IMAGE_SIZE / 2;
+			int32_t nDistance = (dx * dx + dy * dy) / (IMAGE_SIZE / 2);
+			uint8_t* p = image.data() + ((size_t)y * IMAGE_SIZE + x) * 4;
+			p[0] = (uint8_t)x;
+			p[1] = (uint8_t)y;
+			p[2] = 0xC0;
+			p[3] = (uint8_t)(nDistance < 128 ? 255 : nDistance < 255 ? 255 - (nDistance - 128) * 2 : 0);
+		}
+	}
+
+	OverlayCompositor overlay;
+	OverlayTextStyle style = GetDefaultOverlayTextStyle();
+	OverlayPlacement clock = { OVERLAY_ANCHOR_BOTTOM_RIGHT, 48, 48 };
+	OverlayPlacement text = { OVERLAY_ANCHOR_TOP_LEFT, 48, 48 };
+	OverlayPlacement logo = { OVERLAY_ANCHOR_BOTTOM_LEFT, 48, 48 };
+	overlay.SetTime(TIME);
+	overlay.AddClock(true, style, clock);
+	overlay.AddText("60.0 FPS  CPU 3.5%  DROPPED 0", style, text);
+	overlay.AddImage(image.data(), IMAGE_SIZE, IMAGE_SIZE, (size_t)IMAGE_SIZE * 4, 224, logo);
+
+	const KERNEL_ISA isaSaved = GetKernelIsa();
+	LayoutRect dirty[8];
+	SetKernelIsa(KERNEL_ISA_SCALAR);
+	OverlayTarget layerTarget;
+	overlay.Compose(&layerTarget, layer.data(), cbStride, cx, cy, true, dirty, 8);
+	uint64_t cCovered = 0;
+	for (size_t i = 0; i < cbFrame; i += 4)
+		cCovered += layer[i + 3] != 0;
+
+	memcpy(reference.data(), base.data(), cbFrame);
+	OverlayTarget referenceTarget;
+	overlay.Compose(&referenceTarget, reference.data(), cbStride, cx, cy, true, dirty, 8);
+	size_t cResults = 0;
+
+	for (int i = 0; i < KERNEL_ISA_COUNT && cResults < cMaxResults; i++) {
+		if (!SetKernelIsa((KERNEL_ISA)i))
+			continue;
+		const ColorKernelTable& kernels = GetColorKernels();
+		OverlayBenchResult& result = pResults[cResults++];
+		result.isa = (KERNEL_ISA)i;
+		result.fCoverage = (double)cCovered / ((double)cx * cy);
+
+		OverlayTarget target;
+		double fFrameMs = 0.0;
+		for (uint32_t n = 0; n < cFrames; n++) {
+			memcpy(pixels.data(), base.data(), cbFrame);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			overlay.Compose(&target, pixels.data(), cbStride, cx, cy, true, dirty, 8);
+			fFrameMs += MillisecondsSince(start);
+		}
+		result.bExact = memcmp(pixels.data(), reference.data(), cbFrame) == 0;
+
+		double fTickMs = 0.0;
+		for (uint32_t n = 0; n < cFrames; n++) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			overlay.SetTime(TIME + (int32_t)n + 1);
+			overlay.Compose(&target, pixels.data(), cbStride, cx, cy, false, dirty, 8);
+			fTickMs += MillisecondsSince(start);
+		}
+		overlay.SetTime(TIME);
+
+		double fFullMs = 0.0;
+		for (uint32_t n = 0; n < cFrames; n++) {
+			memcpy(pixels.data(), base.data(), cbFrame);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			kernels.pfnBlendOver(layer.data(), pixels.data(), cx * cy);
+			fFullMs += MillisecondsSince(start);
+		}
+		result.bExact &= memcmp(pixels.data(), reference.data(), cbFrame) == 0;
+
+		result.fFrameMs = fFrameMs / cFrames;
+		result.fTickMs = fTickMs / cFrames;
+		result.fFullMs = fFullMs / cFrames;
+	}
+
+	SetKernelIsa(isaSaved);
+	return cResults;
+}
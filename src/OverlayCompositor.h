@@ -0,0 +1,198 @@
+#pragma once
+#include "ColorKernels.h"
+#include "MonitorLayout.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+const uint32_t	OVERLAY_MAX_WIDGET_SIZE = 4096;		// Widest and tallest widget, in pixels
+const uint32_t	OVERLAY_GLYPH_WIDTH = 5;			// Built-in font cell, before scaling
+const uint32_t	OVERLAY_GLYPH_HEIGHT = 7;
+const uint32_t	OVERLAY_GLYPH_ADVANCE = 6;			// Glyph plus one column of space
+
+enum OVERLAY_ANCHOR
+{
+	OVERLAY_ANCHOR_TOP_LEFT = 0,
+	OVERLAY_ANCHOR_TOP_RIGHT,
+	OVERLAY_ANCHOR_BOTTOM_LEFT,
+	OVERLAY_ANCHOR_BOTTOM_RIGHT
+};
+
+// Where a widget sits on each output: x and y are the distance in pixels
+// from the anchor corner to the widget's nearest corner.
+struct OverlayPlacement
+{
+	OVERLAY_ANCHOR	anchor;
+	int32_t			x;
+	int32_t			y;
+};
+
+// Text in the built-in 5x7 font: digits, A-Z (lower case is drawn upper
+// case), space and ":.%-/+". Colors are 0xAARRGGBB, not premultiplied.
+struct OverlayTextStyle
+{
+	uint32_t	nColor;
+	uint32_t	nBackground;	// Box behind the text; alpha 0 for none
+	uint32_t	nScale;			// Pixels per font pixel, 1 or more
+	uint32_t	cPadding;		// Pixels of background around the text
+};
+
+// Default text: white on a translucent black box, at 3x.
+OverlayTextStyle GetDefaultOverlayTextStyle();
+
+
+//-------------------------------------------------------------------
+//
+// OverlayTarget class
+//
+// What a compositor drew into one output: each widget's rectangle and
+// version, and a copy of the frame's pixels under it. Owned by whoever
+// owns the output's pixels, e.g. one per monitor of a presenter, and
+// used with one compositor.
+//
+//-------------------------------------------------------------------
+
+class OverlayTarget
+{
+public:
+	OverlayTarget() : m_cx(0), m_cy(0) {}
+
+	// Forgets what was drawn; the next Compose treats its frame as new.
+	void Reset() { m_drawn.clear(); m_cx = m_cy = 0; }
+
+private:
+	friend class OverlayCompositor;
+
+	struct Drawn
+	{
+		bool					bDrawn;
+		LayoutRect				rc;			// Clipped to the output
+		uint32_t				nVersion;
+		std::vector<uint8_t>	backing;	// Frame pixels under rc
+	};
+
+	uint32_t			m_cx;
+	uint32_t			m_cy;
+	std::vector<Drawn>	m_drawn;		// Per widget
+	std::vector<bool>	m_redraw;		// Compose's scratch: widgets to draw again
+};
+
+
+//-------------------------------------------------------------------
+//
+// OverlayCompositor class
+//
+// Static widgets over video frames: text, a clock and images, each
+// rasterized once into a premultiplied BGRA surface when it changes and
+// then blended over every frame with the pfnBlendOver kernel of
+// GetKernelIsa(), only over its own rectangle and only the rows and
+// columns it covers.
+//
+// Between frames, e.g. when the clock ticks over a paused or slow clip,
+// Compose redraws only the widgets that changed and those they overlap:
+// it restores the frame's pixels under their old rectangles, blends them
+// at the new ones and returns the rectangles to present again.
+//
+// Widgets are added and changed from any thread; Compose may run at the
+// same time on other threads, for different targets. Widgets are drawn
+// in the order they were added and never removed, only hidden.
+//
+//-------------------------------------------------------------------
+
+class OverlayCompositor
+{
+public:
+	OverlayCompositor();
+
+	// Each returns the new widget's id, or 0 if it has no pixels or is
+	// larger than OVERLAY_MAX_WIDGET_SIZE.
+	uint32_t AddText(const char* pszText, const OverlayTextStyle& style, const OverlayPlacement& placement);
+	uint32_t AddClock(bool bSeconds, const OverlayTextStyle& style, const OverlayPlacement& placement);
+	// Copies a straight-alpha BGRA image, faded to nOpacity.
+	uint32_t AddImage(const uint8_t* pBGRA, uint32_t cx, uint32_t cy, size_t cbStride, uint8_t nOpacity,
+		const OverlayPlacement& placement);
+
+	bool SetText(uint32_t nId, const char* pszText);
+	bool SetPlacement(uint32_t nId, const OverlayPlacement& placement);
+	bool SetVisible(uint32_t nId, bool bVisible);
+
+	// Sets the clocks to a local time; true if any of them shows another
+	// text now.
+	bool SetTime(int32_t nSecondOfDay);
+
+	bool IsEmpty();
+
+	// Draws the widgets into cx x cy BGRA pixels. bNewFrame: the pixels
+	// are a new frame; otherwise they hold what the last Compose into
+	// pTarget left, and only changes are drawn. Writes up to cMaxDirty
+	// rectangles that changed, merging the rest into the last one, and
+	// returns their number.
+	size_t Compose(OverlayTarget* pTarget, uint8_t* pPixels, size_t cbStride, uint32_t cx, uint32_t cy, bool bNewFrame,
+		LayoutRect* pDirty, size_t cMaxDirty);
+
+private:
+	enum WIDGET_TYPE
+	{
+		WIDGET_TEXT,
+		WIDGET_CLOCK,
+		WIDGET_IMAGE
+	};
+
+	// Columns [x0, x1) of a surface row that are not transparent.
+	struct RowSpan
+	{
+		uint32_t	x0;
+		uint32_t	x1;
+	};
+
+	struct Widget
+	{
+		WIDGET_TYPE				type;
+		OverlayPlacement		placement;
+		bool					bVisible;
+		bool					bSeconds;	// Clock shows seconds
+		OverlayTextStyle		style;
+		std::string				text;
+		uint32_t				nVersion;	// Bumped by every change of pixels or place
+		uint32_t				cx;
+		uint32_t				cy;
+		std::vector<uint8_t>	surface;	// Premultiplied BGRA, cx * 4 bytes per row
+		std::vector<RowSpan>	spans;		// Per row
+	};
+
+	uint32_t AddWidget(Widget* pWidget);
+	static bool RenderText(Widget* pWidget);
+	static void FindSpans(Widget* pWidget);
+	static bool GetRect(const Widget& widget, uint32_t cx, uint32_t cy, LayoutRect* pRect);
+	static void Blend(const Widget& widget, const LayoutRect& rc, uint8_t* pPixels, size_t cbStride, uint32_t cx,
+		uint32_t cy);
+
+	std::mutex				m_mutex;
+	std::vector<Widget>		m_widgets;		// Id - 1
+	int32_t					m_nSecondOfDay;
+};
+
+
+//********************* Benchmark **********************//
+
+struct OverlayBenchResult
+{
+	KERNEL_ISA	isa;
+	double		fCoverage;		// Share of the frame's pixels under widgets
+	double		fFrameMs;		// Compose over a new frame
+	double		fTickMs;		// Compose of a clock tick over the last frame
+	double		fFullMs;		// Blend of a full-frame overlay layer instead
+	bool		bExact;			// Compose matches the full-frame blend and the scalar kernel
+};
+
+//-------------------------------------------------------------------
+// RunOverlayBench
+//
+// Composes a clock, a line of text and a 256 x 256 image over a cx x cy
+// frame cFrames times on every supported instruction set, against
+// blending a frame-sized overlay layer over the whole frame. Fills up to
+// cMaxResults results and returns their number.
+//-------------------------------------------------------------------
+
+size_t RunOverlayBench(uint32_t cx, uint32_t cy, uint32_t cFrames, OverlayBenchResult* pResults, size_t cMaxResults);
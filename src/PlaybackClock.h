@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+
+
+// Presentation times are kept in 100-nanosecond units, the same unit as MFTIME,
+// so values can be passed to and from MFPlay without conversion.
+typedef int64_t HNSTIME;
+
+const HNSTIME HNS_PER_SECOND = 10000000;	// One second in hns
+const HNSTIME HNS_PER_MSEC = 10000;			// One msec in hns
+
+
+//-------------------------------------------------------------------
+//
+// IPresentationClock interface
+//
+// Platform-neutral view of the playing clip used by the loop
+// scheduler. The Windows implementation forwards to MFPVideoPlayer
+// and a one-shot window timer; a simulated clock can stand in for it.
+//
+//-------------------------------------------------------------------
+
+class IPresentationClock
+{
+public:
+	virtual ~IPresentationClock() {}
+
+	// Current presentation position of the clip.
+	virtual bool GetPosition(HNSTIME* phnsPosition) = 0;
+
+	// Current playback rate (1.0 = normal speed).
+	virtual float GetRate() = 0;
+
+	// Monotonic wall-clock time, used to measure seek latency.
+	virtual HNSTIME GetSystemTime() = 0;
+
+	// Seeks back to the start of the clip.
+	virtual bool SeekToStart() = 0;
+
+	// Arms a single one-shot wakeup hnsDelay of wall-clock time from now,
+	// replacing any wakeup that is already armed.
+	virtual void ArmWakeup(HNSTIME hnsDelay) = 0;
+	virtual void CancelWakeup() = 0;
+};
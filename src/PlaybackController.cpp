@@ -0,0 +1,141 @@
+#include "PlaybackController.h"
+#include <wchar.h>
+
+
+// Long playlist waits are re-checked this often, so clock changes are noticed.
+static const HNSTIME MAX_PLAYLIST_DELAY = 3600 * HNS_PER_SECOND;
+
+struct ErrorText
+{
+	uint32_t		hr;
+	const wchar_t*	pszText;
+};
+
+static const ErrorText s_errorTexts[] =
+{
+	{ 0x80070002, L"The clip was not found." },									// ERROR_FILE_NOT_FOUND
+	{ 0x80070005, L"The clip cannot be read: access is denied." },				// E_ACCESSDENIED
+	{ 0xC00D36B2, L"The player cannot do this in its current state." },			// MF_E_INVALIDREQUEST
+	{ 0xC00D36B4, L"The clip's media type is not valid." },						// MF_E_INVALIDMEDIATYPE
+	{ 0xC00D36C3, L"Clips cannot be opened from this kind of URL." },			// MF_E_UNSUPPORTED_SCHEME
+	{ 0xC00D36C4, L"The clip's file type is not supported." },					// MF_E_UNSUPPORTED_BYTESTREAM_TYPE
+	{ 0xC00D3E85, L"The player was shut down." },								// MF_E_SHUTDOWN
+	{ 0xC00D5212, L"No decoder is installed for the clip's video format." },	// MF_E_TOPO_CODEC_NOT_FOUND
+	{ 0x887A0005, L"The graphics device was removed or reset." },				// DXGI_ERROR_DEVICE_REMOVED
+};
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+PlaybackController::PlaybackController(LoopScheduler* pLoop, PlaylistScheduler* pPlaylist, IPlaybackTarget* pTarget) :
+	m_pLoop(pLoop), m_pPlaylist(pPlaylist), m_pTarget(pTarget), m_bFirstFrame(false), m_stats()
+{
+}
+
+//-----------------------------------------------------------------------------
+// OnPlayerState
+//
+// A stopped player is played again unless a pause is wanted; one that
+// starts playing while a pause is wanted, as it does after every open,
+// is paused. Playing with a known duration arms the loop.
+//-----------------------------------------------------------------------------
+
+void PlaybackController::OnPlayerState(PLAYER_STATE state, uint64_t fSeen)
+{
+	m_stats.cStates++;
+	if (fSeen & ~(1ull << state)) {
+		m_stats.cSkippedStates++;
+		m_pLoop->Stop();
+	}
+
+	switch (state) {
+	case PLAYER_STATE_STOPPED:
+		m_pLoop->Stop();
+		if (!m_pTarget->IsPauseWanted()) {
+			m_stats.cRestarts++;
+			m_pTarget->Play();
+		}
+		break;
+	case PLAYER_STATE_PLAYING:
+		if (m_pTarget->IsPauseWanted()) {
+			m_stats.cHeldPaused++;
+			m_pTarget->Pause();
+			break;
+		}
+		if (!m_bFirstFrame) {
+			// MFPlay reports PLAYING once the first samples reach the renderer.
+			m_bFirstFrame = true;
+			m_pTarget->OnFirstFrame();
+		}
+		if (!m_pLoop->GetDuration()) {
+			HNSTIME hnsDuration = 0;
+			if (m_pTarget->GetDuration(&hnsDuration))
+				m_pLoop->SetDuration(hnsDuration);
+			m_pTarget->OnClipStarted();
+		}
+		m_pLoop->Start();
+		break;
+	case PLAYER_STATE_PAUSED:
+		m_pLoop->Stop();
+		break;
+	default:
+		break;
+	}
+}
+
+void PlaybackController::ResetLoop()
+{
+	m_pLoop->Stop();
+	m_pLoop->SetDuration(0);
+}
+
+void PlaybackController::OnPrepared(bool bSucceeded, HNSTIME hnsNow)
+{
+	if (bSucceeded)
+		m_pPlaylist->OnPrepared(hnsNow);
+	else
+		m_pPlaylist->OnPrepareFailed(hnsNow);
+}
+
+void PlaybackController::OnPlaylistTimer(HNSTIME hnsNow, int32_t nSecondOfDay)
+{
+	m_pPlaylist->OnTick(hnsNow, nSecondOfDay);
+}
+
+HNSTIME PlaybackController::GetPlaylistDelay(HNSTIME hnsNow) const
+{
+	HNSTIME hnsDeadline = m_pPlaylist->GetDeadline();
+	if (hnsDeadline < 0)
+		return -1;
+
+	HNSTIME hnsDelay = hnsDeadline - hnsNow;
+	if (hnsDelay < 0)
+		hnsDelay = 0;
+	if (hnsDelay > MAX_PLAYLIST_DELAY)
+		hnsDelay = MAX_PLAYLIST_DELAY;
+	return hnsDelay;
+}
+
+
+//********************* Error text **********************//
+
+const wchar_t* GetPlaybackErrorText(uint32_t hr)
+{
+	for (size_t i = 0; i < sizeof(s_errorTexts) / sizeof(s_errorTexts[0]); i++) {
+		if (s_errorTexts[i].hr == hr)
+			return s_errorTexts[i].pszText;
+	}
+	return NULL;
+}
+
+std::wstring FormatPlaybackError(uint32_t hr, const wchar_t* pszSystemText)
+{
+	const wchar_t* pszText = pszSystemText && *pszSystemText ? pszSystemText : GetPlaybackErrorText(hr);
+	wchar_t msg[300];
+	// A description too long for the message is left out.
+	if (!pszText || swprintf(msg, sizeof(msg) / sizeof(msg[0]), L"%ls (hr=0x%X)", pszText, hr) < 0)
+		swprintf(msg, sizeof(msg) / sizeof(msg[0]), L"Playback error! (hr=0x%X)", hr);
+	return msg;
+}
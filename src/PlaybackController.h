@@ -0,0 +1,126 @@
+#pragma once
+#include "LoopScheduler.h"
+#include "Playlist.h"
+#include <string>
+
+
+// Player states, numbered as MFP_MEDIAPLAYER_STATE.
+enum PLAYER_STATE
+{
+	PLAYER_STATE_EMPTY = 0,
+	PLAYER_STATE_STOPPED,
+	PLAYER_STATE_PLAYING,
+	PLAYER_STATE_PAUSED,
+	PLAYER_STATE_SHUTDOWN
+};
+
+struct PlaybackControllerStats
+{
+	uint32_t	cStates;			// State notifications handled
+	uint32_t	cSkippedStates;		// Notifications that passed over other states
+	uint32_t	cRestarts;			// Stopped player played again
+	uint32_t	cHeldPaused;		// Player that started while paused was wanted
+};
+
+
+//-------------------------------------------------------------------
+//
+// IPlaybackTarget interface
+//
+// What the playback controller needs from the app: the player, and
+// whether anything holds playback paused.
+//
+//-------------------------------------------------------------------
+
+class IPlaybackTarget
+{
+public:
+	virtual ~IPlaybackTarget() {}
+
+	virtual bool Play() = 0;
+	virtual bool Pause() = 0;
+
+	// Duration of the clip played, false while it is not known.
+	virtual bool GetDuration(HNSTIME* phnsDuration) = 0;
+
+	// A control command, the governor or the power profile wants
+	// playback paused.
+	virtual bool IsPauseWanted() = 0;
+
+	// The first frame of the process is on screen.
+	virtual void OnFirstFrame() = 0;
+
+	// A clip plays for the first time, so its size and duration are known.
+	virtual void OnClipStarted() = 0;
+};
+
+
+//-------------------------------------------------------------------
+//
+// PlaybackController class
+//
+// Follows the player's state notifications and timers with the loop
+// scheduler and the playlist: loops a playing clip, keeps a stopped one
+// playing and holds one paused while a pause is wanted. Platform
+// neutral, so a simulated player can drive it as well as MFPlay.
+//
+//-------------------------------------------------------------------
+
+class PlaybackController
+{
+public:
+	PlaybackController(LoopScheduler* pLoop, PlaylistScheduler* pPlaylist, IPlaybackTarget* pTarget);
+
+	// The player reported state; fSeen has bit (1 << state) for every state
+	// it reported since the last call. If it passed through another state,
+	// the loop deadline armed belongs to playback stopped in between.
+	void OnPlayerState(PLAYER_STATE state, uint64_t fSeen);
+
+	void OnPlaybackEnded() { m_pLoop->OnPlaybackEnded(); }
+	void OnRateChanged() { m_pLoop->OnRateChanged(); }
+
+	// The loop wakeup is one-shot: the scheduler arms the next one.
+	void OnLoopTimer() { m_pLoop->OnWakeup(); }
+
+	// Another clip replaces the one playing; its duration is read again
+	// once it plays.
+	void ResetLoop();
+
+	// The clip prepared by the playlist is ready, or failed to open.
+	void OnPrepared(bool bSucceeded, HNSTIME hnsNow);
+	void OnPlaylistTimer(HNSTIME hnsNow, int32_t nSecondOfDay);
+
+	// Delay of the next playlist tick, -1 = none. Long waits are cut to an
+	// hour, so a change of the wall clock is noticed.
+	HNSTIME GetPlaylistDelay(HNSTIME hnsNow) const;
+
+	bool IsFirstFrameShown() const { return m_bFirstFrame; }
+	const PlaybackControllerStats& GetStats() const { return m_stats; }
+
+private:
+	LoopScheduler*		m_pLoop;
+	PlaylistScheduler*	m_pPlaylist;
+	IPlaybackTarget*	m_pTarget;
+	bool				m_bFirstFrame;
+	PlaybackControllerStats	m_stats;
+};
+
+
+//-------------------------------------------------------------------
+// GetPlaybackErrorText
+//
+// Description of the Media Foundation and file errors a clip commonly
+// fails to play with, or NULL for others.
+//-------------------------------------------------------------------
+
+const wchar_t* GetPlaybackErrorText(uint32_t hr);
+
+//-------------------------------------------------------------------
+// FormatPlaybackError
+//
+// Message shown for a playback error: the system's description if there
+// is one (pszSystemText, NULL = none), else the known description, with
+// the code.
+//-------------------------------------------------------------------
+
+std::wstring FormatPlaybackError(uint32_t hr, const wchar_t* pszSystemText);
@@ -0,0 +1,115 @@
+#include "PlaybackGovernor.h"
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+PlaybackGovernor::PlaybackGovernor(const GovernorConfig& config) : m_config(config)
+{
+	for (int i = 0; i < GOVERNOR_SIGNAL_COUNT; i++)
+		m_bSignals[i] = false;
+	Reset(0);
+}
+
+void PlaybackGovernor::Reset(HNSTIME hnsNow)
+{
+	m_mode = GOVERNOR_MODE_PLAY;
+	m_pending = GOVERNOR_MODE_PLAY;
+	m_hnsPendingSince = hnsNow;
+	m_hnsModeSince = hnsNow;
+	for (int i = 0; i < GOVERNOR_MODE_COUNT; i++)
+		m_hnsInMode[i] = 0;
+	m_cTransitions = 0;
+
+	// Signals that are already active take effect right away.
+	GOVERNOR_MODE mode = Evaluate();
+	m_mode = m_pending = mode;
+}
+
+bool PlaybackGovernor::OnEvent(const GovernorEvent& event)
+{
+	if ((int)event.signal < 0 || event.signal >= GOVERNOR_SIGNAL_COUNT)
+		return false;
+	m_bSignals[event.signal] = event.bActive;
+	return Update(event.hnsTime);
+}
+
+bool PlaybackGovernor::Advance(HNSTIME hnsNow)
+{
+	return Update(hnsNow);
+}
+
+//-----------------------------------------------------------------------------
+// Evaluate
+//
+// The mode the current signals ask for, without hysteresis.
+//-----------------------------------------------------------------------------
+
+GOVERNOR_MODE PlaybackGovernor::Evaluate() const
+{
+	if (m_bSignals[GOVERNOR_SIGNAL_SESSION_LOCKED] || m_bSignals[GOVERNOR_SIGNAL_OCCLUDED] ||
+		m_bSignals[GOVERNOR_SIGNAL_FULLSCREEN])
+		return GOVERNOR_MODE_PAUSE;
+	if (m_bSignals[GOVERNOR_SIGNAL_ON_BATTERY] || m_bSignals[GOVERNOR_SIGNAL_BATTERY_SAVER])
+		return GOVERNOR_MODE_DOWNCLOCK;
+	return GOVERNOR_MODE_PLAY;
+}
+
+HNSTIME PlaybackGovernor::GetDeadline() const
+{
+	if (m_pending == m_mode)
+		return -1;
+
+	HNSTIME hnsDelay = m_pending > m_mode ? m_config.hnsEnterDelay : m_config.hnsResumeDelay;
+	HNSTIME hnsDeadline = m_hnsPendingSince + hnsDelay;
+	if (m_cTransitions > 0 && hnsDeadline < m_hnsModeSince + m_config.hnsMinDwell)
+		hnsDeadline = m_hnsModeSince + m_config.hnsMinDwell;
+	return hnsDeadline;
+}
+
+//-----------------------------------------------------------------------------
+// Update
+//
+// Tracks since when the wanted mode differs from the current one, and
+// switches once that has lasted past the deadline.
+//-----------------------------------------------------------------------------
+
+bool PlaybackGovernor::Update(HNSTIME hnsNow)
+{
+	GOVERNOR_MODE desired = Evaluate();
+	if (desired != m_pending) {
+		m_pending = desired;
+		m_hnsPendingSince = hnsNow;
+	}
+	if (m_pending == m_mode)
+		return false;
+	if (hnsNow < GetDeadline())
+		return false;
+
+	SetMode(m_pending, hnsNow);
+	return true;
+}
+
+void PlaybackGovernor::SetMode(GOVERNOR_MODE mode, HNSTIME hnsNow)
+{
+	m_hnsInMode[m_mode] += hnsNow - m_hnsModeSince;
+	m_hnsModeSince = hnsNow;
+	m_mode = mode;
+	m_cTransitions++;
+}
+
+HNSTIME PlaybackGovernor::GetTimeInMode(GOVERNOR_MODE mode, HNSTIME hnsNow) const
+{
+	HNSTIME hnsTime = m_hnsInMode[mode];
+	if (mode == m_mode)
+		hnsTime += hnsNow - m_hnsModeSince;
+	return hnsTime;
+}
+
+double PlaybackGovernor::GetCpuSecondsSaved(HNSTIME hnsNow) const
+{
+	double paused = (double)GetTimeInMode(GOVERNOR_MODE_PAUSE, hnsNow) / HNS_PER_SECOND;
+	double downclocked = (double)GetTimeInMode(GOVERNOR_MODE_DOWNCLOCK, hnsNow) / HNS_PER_SECOND;
+	return m_config.fPlayCpuLoad * (paused + downclocked * (1.0 - m_config.fDownclockRatio));
+}
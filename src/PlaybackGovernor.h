@@ -0,0 +1,100 @@
+#pragma once
+#include "PlaybackClock.h"
+
+
+// Inputs of the playback governor. Each one is either active or not.
+enum GOVERNOR_SIGNAL
+{
+	GOVERNOR_SIGNAL_OCCLUDED = 0,		// Every monitor is covered by a window
+	GOVERNOR_SIGNAL_SESSION_LOCKED,		// Session locked or disconnected
+	GOVERNOR_SIGNAL_FULLSCREEN,			// Foreground app is fullscreen
+	GOVERNOR_SIGNAL_ON_BATTERY,			// Running on DC power
+	GOVERNOR_SIGNAL_BATTERY_SAVER,		// Battery saver is on
+	GOVERNOR_SIGNAL_COUNT
+};
+
+// Playback modes, ordered from the most to the least CPU spent.
+enum GOVERNOR_MODE
+{
+	GOVERNOR_MODE_PLAY = 0,			// Full frame rate
+	GOVERNOR_MODE_DOWNCLOCK,		// Reduced frame rate
+	GOVERNOR_MODE_PAUSE,
+	GOVERNOR_MODE_COUNT
+};
+
+struct GovernorEvent
+{
+	HNSTIME			hnsTime;
+	GOVERNOR_SIGNAL	signal;
+	bool			bActive;
+};
+
+struct GovernorConfig
+{
+	HNSTIME	hnsEnterDelay;		// A saving mode must be wanted this long before it is entered
+	HNSTIME	hnsResumeDelay;		// A less saving mode must be wanted this long before it is resumed
+	HNSTIME	hnsMinDwell;		// Minimum time between two mode changes
+	float	fPlayCpuLoad;		// CPU-seconds per second of full-rate playback
+	float	fDownclockRatio;	// Share of the full-rate cost left when downclocked
+
+	GovernorConfig() : hnsEnterDelay(500 * HNS_PER_MSEC), hnsResumeDelay(2 * HNS_PER_SECOND),
+		hnsMinDwell(HNS_PER_SECOND), fPlayCpuLoad(0.05f), fDownclockRatio(0.5f)
+	{
+	}
+};
+
+
+//-------------------------------------------------------------------
+//
+// PlaybackGovernor class
+//
+// Pure state machine deciding whether the wallpaper plays, plays at a
+// reduced frame rate or pauses, from a stream of timestamped signal
+// changes. Any covering signal (occluded, locked, fullscreen) pauses;
+// battery signals downclock.
+//
+// Hysteresis: a new mode has to be wanted for the enter or resume delay
+// before it is applied, and two changes are at least hnsMinDwell apart.
+// Pending changes are applied by Advance() at GetDeadline().
+//
+//-------------------------------------------------------------------
+
+class PlaybackGovernor
+{
+public:
+	explicit PlaybackGovernor(const GovernorConfig& config);
+
+	void Reset(HNSTIME hnsNow);
+
+	// Feeds one signal change. Returns true if the mode changed.
+	bool OnEvent(const GovernorEvent& event);
+
+	// Applies a pending change that is due. Returns true if the mode changed.
+	bool Advance(HNSTIME hnsNow);
+
+	GOVERNOR_MODE GetMode() const { return m_mode; }
+	bool IsSignalActive(GOVERNOR_SIGNAL signal) const { return m_bSignals[signal]; }
+
+	// Time at which a pending change becomes due, or -1 if none is pending.
+	HNSTIME GetDeadline() const;
+
+	uint32_t GetTransitionCount() const { return m_cTransitions; }
+	HNSTIME GetTimeInMode(GOVERNOR_MODE mode, HNSTIME hnsNow) const;
+
+	// Expected CPU-seconds saved up to hnsNow against playing at full rate.
+	double GetCpuSecondsSaved(HNSTIME hnsNow) const;
+
+private:
+	GOVERNOR_MODE Evaluate() const;
+	bool Update(HNSTIME hnsNow);
+	void SetMode(GOVERNOR_MODE mode, HNSTIME hnsNow);
+
+	GovernorConfig	m_config;
+	bool			m_bSignals[GOVERNOR_SIGNAL_COUNT];
+	GOVERNOR_MODE	m_mode;
+	GOVERNOR_MODE	m_pending;
+	HNSTIME			m_hnsPendingSince;
+	HNSTIME			m_hnsModeSince;
+	HNSTIME			m_hnsInMode[GOVERNOR_MODE_COUNT];
+	uint32_t		m_cTransitions;
+};
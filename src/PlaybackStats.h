@@ -0,0 +1,367 @@
+#pragma once
+#include "PlaybackClock.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <atomic>
+#include <string>
+
+
+// Sampled metrics. Times are in 100 ns units.
+enum STATS_METRIC
+{
+	STATS_METRIC_DECODE_TIME = 0,		// Decode start to decoded frame
+	STATS_METRIC_PRESENT_LATENESS,		// Presentation time past the frame's due time
+	STATS_METRIC_SEEK_LATENCY,			// Loop seek to playback resuming
+	STATS_METRIC_TIMER_LATENESS,		// Loop wakeup past its deadline
+	STATS_METRIC_CPU_LOAD,				// Process CPU, per mille of one core
+	STATS_METRIC_WORKING_SET,			// Process working set, KiB
+	STATS_METRIC_EVENT_LATENCY,			// Player event posted to taken by the app's thread
+	STATS_METRIC_COUNT
+};
+
+enum STATS_COUNTER
+{
+	STATS_COUNTER_FRAMES_PRESENTED = 0,
+	STATS_COUNTER_FRAMES_DROPPED,		// Decoded but never presented
+	STATS_COUNTER_FRAMES_LATE,			// Presented more than the late threshold past due
+	STATS_COUNTER_LOOPS,
+	STATS_COUNTER_MISSED_LOOPS,			// End of the clip reached before the loop wrap
+	STATS_COUNTER_PLAYER_EVENTS,
+	STATS_COUNTER_PLAYER_ERRORS,
+	STATS_COUNTER_COUNT
+};
+
+struct StatsSummary
+{
+	uint64_t	cSamples;
+	int64_t		nMin;
+	int64_t		nMax;
+	int64_t		nMean;
+	int64_t		nP50;		// Percentiles are bucket upper bounds, within 1/8 of the value
+	int64_t		nP99;
+};
+
+
+//-------------------------------------------------------------------
+//
+// PlaybackStats class
+//
+// Lock-free collector of playback timings. Any thread may record; each
+// metric keeps a ring of its recent samples and a log-linear histogram
+// of all samples since the last reset, and counters count events.
+//
+// The first WRITER_COUNT - 1 threads that record get a private copy of
+// every ring, histogram and counter and update it with plain relaxed
+// stores; later threads share the last copy and use atomic read-modify-
+// writes. Queries merge the copies. A disabled collector returns after
+// one relaxed load, so recording calls can stay in hot paths.
+//
+//-------------------------------------------------------------------
+
+class PlaybackStats
+{
+public:
+	static const size_t RING_SIZE = 256;		// Recent samples per metric and writer, power of 2
+	static const int WRITER_COUNT = 4;
+	static const int SUB_BUCKET_BITS = 3;		// 8 buckets per power of 2
+	static const int BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+	PlaybackStats() : m_bEnabled(false), m_hnsLateThreshold(HNS_PER_SECOND / 60)
+	{
+		Reset();
+	}
+
+	void Enable(bool bEnable) { m_bEnabled.store(bEnable, std::memory_order_relaxed); }
+	bool IsEnabled() const { return m_bEnabled.load(std::memory_order_relaxed); }
+
+	// Frames presented later than this count as late.
+	void SetLateThreshold(HNSTIME hnsThreshold) { m_hnsLateThreshold = hnsThreshold; }
+
+	void Record(STATS_METRIC metric, int64_t nValue)
+	{
+		if (!IsEnabled())
+			return;
+		if (nValue < 0)
+			nValue = 0;
+
+		int nWriter = GetWriter();
+		bool bShared = nWriter == WRITER_COUNT - 1;
+		Series& m = m_series[metric][nWriter];
+		uint64_t n = Add(m.nWrite, (uint64_t)1, bShared);
+		m.ring[n & (RING_SIZE - 1)].store(nValue, std::memory_order_relaxed);
+		Add(m.buckets[GetBucket(nValue)], (uint64_t)1, bShared);
+		Add(m.nSum, nValue, bShared);
+
+		int64_t nOld = m.nMax.load(std::memory_order_relaxed);
+		if (nValue > nOld) {
+			if (!bShared)
+				m.nMax.store(nValue, std::memory_order_relaxed);
+			else while (nValue > nOld && !m.nMax.compare_exchange_weak(nOld, nValue, std::memory_order_relaxed)) {
+			}
+		}
+		nOld = m.nMin.load(std::memory_order_relaxed);
+		if (nValue < nOld) {
+			if (!bShared)
+				m.nMin.store(nValue, std::memory_order_relaxed);
+			else while (nValue < nOld && !m.nMin.compare_exchange_weak(nOld, nValue, std::memory_order_relaxed)) {
+			}
+		}
+	}
+
+	void Count(STATS_COUNTER counter, uint64_t n = 1)
+	{
+		if (!IsEnabled())
+			return;
+		int nWriter = GetWriter();
+		Add(m_counters[counter][nWriter], n, nWriter == WRITER_COUNT - 1);
+	}
+
+	// One frame: decoded between hnsDecodeStart and hnsDecoded, due at
+	// hnsDue, presented at hnsPresented (-1 if dropped). All system times.
+	void RecordFrame(HNSTIME hnsDecodeStart, HNSTIME hnsDecoded, HNSTIME hnsDue, HNSTIME hnsPresented)
+	{
+		if (!IsEnabled())
+			return;
+		Record(STATS_METRIC_DECODE_TIME, hnsDecoded - hnsDecodeStart);
+		if (hnsPresented < 0) {
+			Count(STATS_COUNTER_FRAMES_DROPPED);
+			return;
+		}
+		Count(STATS_COUNTER_FRAMES_PRESENTED);
+		Record(STATS_METRIC_PRESENT_LATENESS, hnsPresented - hnsDue);
+		if (hnsPresented - hnsDue > m_hnsLateThreshold)
+			Count(STATS_COUNTER_FRAMES_LATE);
+	}
+
+	uint64_t GetCounter(STATS_COUNTER counter) const
+	{
+		uint64_t n = 0;
+		for (int i = 0; i < WRITER_COUNT; i++)
+			n += m_counters[counter][i].load(std::memory_order_relaxed);
+		return n;
+	}
+
+	// Summary of all samples since the last reset. Returns false if there
+	// are none. Concurrent recording may make it off by a sample.
+	bool Query(STATS_METRIC metric, StatsSummary* pSummary) const
+	{
+		uint64_t counts[BUCKET_COUNT] = {};
+		uint64_t cSamples = 0;
+		int64_t nSum = 0, nMin = INT64_MAX, nMax = 0;
+		for (int w = 0; w < WRITER_COUNT; w++) {
+			const Series& m = m_series[metric][w];
+			for (int i = 0; i < BUCKET_COUNT; i++) {
+				uint64_t c = m.buckets[i].load(std::memory_order_relaxed);
+				counts[i] += c;
+				cSamples += c;
+			}
+			nSum += m.nSum.load(std::memory_order_relaxed);
+			int64_t n = m.nMin.load(std::memory_order_relaxed);
+			if (n < nMin)
+				nMin = n;
+			n = m.nMax.load(std::memory_order_relaxed);
+			if (n > nMax)
+				nMax = n;
+		}
+
+		*pSummary = StatsSummary();
+		if (!cSamples)
+			return false;
+
+		pSummary->cSamples = cSamples;
+		pSummary->nMin = nMin;
+		pSummary->nMax = nMax;
+		pSummary->nMean = nSum / (int64_t)cSamples;
+		pSummary->nP50 = Percentile(counts, cSamples, 50, nMax);
+		pSummary->nP99 = Percentile(counts, cSamples, 99, nMax);
+		return true;
+	}
+
+	// Copies up to cMax recent samples: those of each writer in turn,
+	// oldest first.
+	size_t GetRecent(STATS_METRIC metric, int64_t* pValues, size_t cMax) const
+	{
+		size_t cCopied = 0;
+		for (int w = 0; w < WRITER_COUNT && cCopied < cMax; w++) {
+			const Series& m = m_series[metric][w];
+			uint64_t nEnd = m.nWrite.load(std::memory_order_relaxed);
+			uint64_t cAvailable = nEnd < (uint64_t)RING_SIZE ? nEnd : (uint64_t)RING_SIZE;
+			size_t c = cMax - cCopied < cAvailable ? cMax - cCopied : (size_t)cAvailable;
+			for (size_t i = 0; i < c; i++)
+				pValues[cCopied++] = m.ring[(nEnd - c + i) & (RING_SIZE - 1)].load(std::memory_order_relaxed);
+		}
+		return cCopied;
+	}
+
+	// Not safe against concurrent recording; call while recording is idle.
+	void Reset()
+	{
+		for (int i = 0; i < STATS_METRIC_COUNT; i++) {
+			for (int w = 0; w < WRITER_COUNT; w++) {
+				Series& m = m_series[i][w];
+				m.nWrite.store(0, std::memory_order_relaxed);
+				m.nSum.store(0, std::memory_order_relaxed);
+				m.nMin.store(INT64_MAX, std::memory_order_relaxed);
+				m.nMax.store(0, std::memory_order_relaxed);
+				for (size_t j = 0; j < RING_SIZE; j++)
+					m.ring[j].store(0, std::memory_order_relaxed);
+				for (int j = 0; j < BUCKET_COUNT; j++)
+					m.buckets[j].store(0, std::memory_order_relaxed);
+			}
+		}
+		for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+			for (int w = 0; w < WRITER_COUNT; w++)
+				m_counters[i][w].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	// Values below 8 get a bucket each; above, every power of 2 is split
+	// into 8 buckets.
+	static int GetBucket(int64_t nValue)
+	{
+		uint64_t v = (uint64_t)nValue;
+		if (v < (1u << SUB_BUCKET_BITS))
+			return (int)v;
+		int nLog = 0;
+		for (int nShift = 32; nShift; nShift >>= 1) {
+			if (v >> (nLog + nShift))
+				nLog += nShift;
+		}
+		int nSub = (int)(v >> (nLog - SUB_BUCKET_BITS)) & ((1 << SUB_BUCKET_BITS) - 1);
+		return ((nLog - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) + nSub;
+	}
+
+	// Largest value of a bucket.
+	static int64_t GetBucketLimit(int nBucket)
+	{
+		if (nBucket < (1 << SUB_BUCKET_BITS))
+			return nBucket;
+		int nLog = (nBucket >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+		uint64_t nSub = (uint64_t)(nBucket & ((1 << SUB_BUCKET_BITS) - 1));
+		uint64_t nStep = 1ull << (nLog - SUB_BUCKET_BITS);
+		return (int64_t)((1ull << nLog) + (nSub + 1) * nStep - 1);
+	}
+
+private:
+	struct Series
+	{
+		std::atomic<uint64_t>	nWrite;
+		std::atomic<int64_t>	nSum;
+		std::atomic<int64_t>	nMin;
+		std::atomic<int64_t>	nMax;
+		std::atomic<int64_t>	ring[RING_SIZE];
+		std::atomic<uint64_t>	buckets[BUCKET_COUNT];
+	};
+
+	// Writer slot of the calling thread, numbered process-wide in the
+	// order threads first record.
+	static int GetWriter()
+	{
+		static std::atomic<int> s_cWriters(0);
+		static thread_local int t_nWriter = -1;
+		if (t_nWriter < 0) {
+			int n = s_cWriters.fetch_add(1, std::memory_order_relaxed);
+			t_nWriter = n < WRITER_COUNT - 1 ? n : WRITER_COUNT - 1;
+		}
+		return t_nWriter;
+	}
+
+	// Adds n and returns the previous value.
+	template <class T>
+	static T Add(std::atomic<T>& a, T n, bool bShared)
+	{
+		if (bShared)
+			return a.fetch_add(n, std::memory_order_relaxed);
+		T nOld = a.load(std::memory_order_relaxed);
+		a.store(nOld + n, std::memory_order_relaxed);
+		return nOld;
+	}
+
+	static int64_t Percentile(const uint64_t* pCounts, uint64_t cSamples, int nPercent, int64_t nMax)
+	{
+		uint64_t nRank = (cSamples * nPercent + 99) / 100;
+		uint64_t nSeen = 0;
+		for (int i = 0; i < BUCKET_COUNT; i++) {
+			nSeen += pCounts[i];
+			if (nSeen >= nRank) {
+				int64_t nLimit = GetBucketLimit(i);
+				return nLimit < nMax ? nLimit : nMax;
+			}
+		}
+		return nMax;
+	}
+
+	std::atomic<bool>		m_bEnabled;
+	HNSTIME					m_hnsLateThreshold;
+	Series					m_series[STATS_METRIC_COUNT][WRITER_COUNT];
+	std::atomic<uint64_t>	m_counters[STATS_COUNTER_COUNT][WRITER_COUNT];
+};
+
+
+inline const char* GetStatsMetricName(STATS_METRIC metric)
+{
+	static const char* const s_names[STATS_METRIC_COUNT] = {
+		"decode_time", "present_lateness", "seek_latency", "timer_lateness", "cpu_load", "working_set",
+		"event_latency"
+	};
+	return s_names[metric];
+}
+
+inline const char* GetStatsCounterName(STATS_COUNTER counter)
+{
+	static const char* const s_names[STATS_COUNTER_COUNT] = {
+		"frames_presented", "frames_dropped", "frames_late", "loops", "missed_loops",
+		"player_events", "player_errors"
+	};
+	return s_names[counter];
+}
+
+//-------------------------------------------------------------------
+// FormatStatsCsv / FormatStatsJson
+//
+// Text dumps of the summaries and counters. The CSV has one row per
+// metric and counter: name,samples,min,mean,p50,p99,max (counters fill
+// the samples column only).
+//-------------------------------------------------------------------
+
+inline void FormatStatsCsv(const PlaybackStats& stats, std::string* pText)
+{
+	char line[256];
+	pText->assign("name,samples,min,mean,p50,p99,max\n");
+	for (int i = 0; i < STATS_METRIC_COUNT; i++) {
+		StatsSummary s;
+		stats.Query((STATS_METRIC)i, &s);
+		snprintf(line, sizeof(line), "%s,%llu,%lld,%lld,%lld,%lld,%lld\n", GetStatsMetricName((STATS_METRIC)i),
+			(unsigned long long)s.cSamples, (long long)s.nMin, (long long)s.nMean, (long long)s.nP50,
+			(long long)s.nP99, (long long)s.nMax);
+		pText->append(line);
+	}
+	for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+		snprintf(line, sizeof(line), "%s,%llu,,,,,\n", GetStatsCounterName((STATS_COUNTER)i),
+			(unsigned long long)stats.GetCounter((STATS_COUNTER)i));
+		pText->append(line);
+	}
+}
+
+inline void FormatStatsJson(const PlaybackStats& stats, std::string* pText)
+{
+	char line[256];
+	pText->assign("{\n  \"metrics\": {\n");
+	for (int i = 0; i < STATS_METRIC_COUNT; i++) {
+		StatsSummary s;
+		stats.Query((STATS_METRIC)i, &s);
+		snprintf(line, sizeof(line),
+			"    \"%s\": { \"samples\": %llu, \"min\": %lld, \"mean\": %lld, \"p50\": %lld, \"p99\": %lld, \"max\": %lld }%s\n",
+			GetStatsMetricName((STATS_METRIC)i), (unsigned long long)s.cSamples, (long long)s.nMin,
+			(long long)s.nMean, (long long)s.nP50, (long long)s.nP99, (long long)s.nMax,
+			i + 1 < STATS_METRIC_COUNT ? "," : "");
+		pText->append(line);
+	}
+	pText->append("  },\n  \"counters\": {\n");
+	for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+		snprintf(line, sizeof(line), "    \"%s\": %llu%s\n", GetStatsCounterName((STATS_COUNTER)i),
+			(unsigned long long)stats.GetCounter((STATS_COUNTER)i), i + 1 < STATS_COUNTER_COUNT ? "," : "");
+		pText->append(line);
+	}
+	pText->append("  }\n}\n");
+}
@@ -0,0 +1,60 @@
+#include "PlayerEventQueue.h"
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+PlayerEventQueue::PlayerEventQueue(EventLoop* pLoop, uint32_t nWakeEvent) : m_pLoop(pLoop),
+m_nWakeEvent(nWakeEvent), m_pStats(nullptr), m_cPosted(0), m_cDropped(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Post
+//
+// The record is in the queue before the loop is woken, so the batch the
+// wakeup takes has it. A dropped record still wakes the loop, which then
+// learns of the drop.
+//-----------------------------------------------------------------------------
+
+void PlayerEventQueue::Post(PLAYER_EVENT type, uint32_t nState, int32_t hr, uint32_t caps)
+{
+	PlayerEvent event;
+	event.nType = (uint32_t)type;
+	event.nState = nState;
+	event.hr = hr;
+	event.caps = caps;
+	event.hnsPosted = m_pLoop->GetTime();
+
+	m_cPosted.fetch_add(1, std::memory_order_relaxed);
+	if (!m_queue.Push(event))
+		m_cDropped.fetch_add(1, std::memory_order_relaxed);
+	m_pLoop->Post(m_nWakeEvent);
+}
+
+bool PlayerEventQueue::TakeBatch(PlayerEventBatch* pBatch)
+{
+	pBatch->fTypes = 0;
+	pBatch->fStates = 0;
+	pBatch->cDropped = m_cDropped.exchange(0, std::memory_order_relaxed);
+
+	size_t cRecords = m_queue.Drain(m_records, CAPACITY);
+	pBatch->cEvents = (uint32_t)cRecords;
+	HNSTIME hnsNow = cRecords && m_pStats ? m_pLoop->GetTime() : 0;
+	for (size_t i = 0; i < cRecords; i++) {
+		const PlayerEvent& event = m_records[i];
+		if (event.nType >= PLAYER_EVENT_COUNT)
+			continue;
+		pBatch->fTypes |= 1u << event.nType;
+		pBatch->latest[event.nType] = event;
+		if (event.nType == PLAYER_EVENT_STATE)
+			pBatch->fStates |= 1ull << (event.nState & 63);
+		if (m_pStats)
+			m_pStats->Record(STATS_METRIC_EVENT_LATENCY, hnsNow - event.hnsPosted);
+	}
+
+	if (cRecords == CAPACITY)
+		m_pLoop->Post(m_nWakeEvent);
+	return cRecords || pBatch->cDropped;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "EventLoop.h"
+#include "EventQueue.h"
+#include "PlaybackStats.h"
+
+
+// Events a player posts to the application, from any thread. The
+// application takes them in batches and handles each type once per
+// batch, in type order, so the state comes after the events that led
+// to it.
+enum PLAYER_EVENT
+{
+	PLAYER_EVENT_ERROR = 0,		// hr = the error
+	PLAYER_EVENT_ENDED,			// Playback reached the end
+	PLAYER_EVENT_RATE,			// The playback rate changed
+	PLAYER_EVENT_PREPARED,		// hr = result of opening the prepared media item
+	PLAYER_EVENT_STATE,			// nState = MFP_MEDIAPLAYER_STATE, caps = the clip's characteristics
+	PLAYER_EVENT_COUNT
+};
+
+// Record of one event, as the player posted it.
+struct PlayerEvent
+{
+	uint32_t	nType;			// PLAYER_EVENT
+	uint32_t	nState;
+	int32_t		hr;
+	uint32_t	caps;			// MFP_MEDIAITEM_CHARACTERISTICS, 0 if the player does not know them
+	HNSTIME		hnsPosted;		// Event loop time it was posted at
+};
+
+// Records of one drain, folded per type.
+struct PlayerEventBatch
+{
+	uint32_t	fTypes;							// Bit (1 << type) for every type posted
+	PlayerEvent	latest[PLAYER_EVENT_COUNT];		// Latest record of each type posted
+	uint64_t	fStates;						// Bit (1 << nState) for every state posted
+	uint32_t	cEvents;						// Records taken
+	uint64_t	cDropped;						// Records lost to a full queue since the last batch
+};
+
+
+//-------------------------------------------------------------------
+//
+// PlayerEventQueue class
+//
+// Carries a player's events to the thread of the application's event
+// loop. Players post typed records into a preallocated EventQueue from
+// their callback threads and post one coalesced loop event, so a burst
+// of records costs a single wakeup; the loop's thread takes them all in
+// one batch. Posting takes no lock and allocates nothing.
+//
+// A post that finds the queue full is counted as dropped, and the next
+// batch reports it, so the application can read the player's state
+// instead of trusting the records.
+//
+//-------------------------------------------------------------------
+
+class PlayerEventQueue
+{
+public:
+	static const size_t CAPACITY = 256;
+
+	// Posts of a record wake pLoop with nWakeEvent.
+	PlayerEventQueue(EventLoop* pLoop, uint32_t nWakeEvent);
+
+	// Optional collector of the time records wait to be taken.
+	void SetStats(PlaybackStats* pStats) { m_pStats = pStats; }
+
+	// Thread-safe.
+	void Post(PLAYER_EVENT type, uint32_t nState = 0, int32_t hr = 0, uint32_t caps = 0);
+
+	// Loop thread only. Takes the records posted so far and folds them
+	// into *pBatch; false if there were none and none were dropped. A
+	// batch takes at most CAPACITY records and wakes the loop again if
+	// more are waiting, so a flood cannot hold its thread.
+	bool TakeBatch(PlayerEventBatch* pBatch);
+
+	uint64_t GetPosted() const { return m_cPosted.load(std::memory_order_relaxed); }
+
+private:
+	PlayerEventQueue(const PlayerEventQueue&);
+	PlayerEventQueue& operator=(const PlayerEventQueue&);
+
+	EventLoop*								m_pLoop;
+	uint32_t								m_nWakeEvent;
+	PlaybackStats*							m_pStats;
+	std::atomic<uint64_t>					m_cPosted;
+	std::atomic<uint64_t>					m_cDropped;		// Not reported in a batch yet
+	EventQueue<PlayerEvent, CAPACITY>		m_queue;
+	PlayerEvent								m_records[CAPACITY];	// Batch being folded
+};
@@ -0,0 +1,336 @@
+#include "Playlist.h"
+#include <string.h>
+
+
+static const HNSTIME HNS_PER_DAY = (HNSTIME)SECONDS_PER_DAY * HNS_PER_SECOND;
+
+// A switch this much past its deadline counts as late.
+static const HNSTIME LATE_SWITCH_TOLERANCE = 50 * HNS_PER_MSEC;
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+PlaylistScheduler::PlaylistScheduler(IClipPlayer* pPlayer, const PlaylistConfig& config) :
+m_pPlayer(pPlayer), m_config(config), m_nOrder(0), m_nCurrent(0), m_nNext(0), m_bRunning(false),
+m_bTimeOfDay(false), m_bPreparing(false), m_hnsSwitch(-1), m_hnsMidnight(0),
+m_nRandom(config.nSeed ? config.nSeed : 1)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void PlaylistScheduler::SetConfig(const PlaylistConfig& config)
+{
+	m_config = config;
+	m_nRandom = config.nSeed ? config.nSeed : 1;
+}
+
+void PlaylistScheduler::SetItems(const std::vector<PlaylistItem>& items)
+{
+	m_items = items;
+	m_failed.assign(m_items.size(), 0);
+	m_bTimeOfDay = false;
+	for (size_t i = 0; i < m_items.size(); i++) {
+		if (m_items[i].nStartOfDay >= 0)
+			m_bTimeOfDay = true;
+	}
+	m_order.clear();
+	m_nOrder = 0;
+}
+
+size_t PlaylistScheduler::Start(HNSTIME hnsNow, int32_t nSecondOfDay)
+{
+	m_bRunning = true;
+	m_hnsMidnight = hnsNow - (HNSTIME)nSecondOfDay * HNS_PER_SECOND;
+	m_nCurrent = 0;
+
+	if (m_bTimeOfDay) {
+		m_nCurrent = ItemForTimeOfDay(hnsNow);
+	}
+	else if (m_config.order == PLAYLIST_SHUFFLE && !m_items.empty()) {
+		Reshuffle();
+		m_nCurrent = m_order[m_nOrder++];
+	}
+
+	ScheduleSwitch(hnsNow);
+	return m_nCurrent;
+}
+
+void PlaylistScheduler::Stop()
+{
+	m_bRunning = false;
+	m_hnsSwitch = -1;
+	if (m_bPreparing) {
+		m_pPlayer->CancelPrepared();
+		m_bPreparing = false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// GetDeadline
+//
+// Before the next clip is being prepared the deadline is the prefetch
+// time, afterwards the switch itself.
+//-----------------------------------------------------------------------------
+
+HNSTIME PlaylistScheduler::GetDeadline() const
+{
+	if (!m_bRunning || m_hnsSwitch < 0)
+		return -1;
+	if (!m_bPreparing)
+		return m_hnsSwitch - m_config.hnsPrefetch;
+	return m_hnsSwitch;
+}
+
+void PlaylistScheduler::OnTick(HNSTIME hnsNow, int32_t nSecondOfDay)
+{
+	if (!m_bRunning || m_hnsSwitch < 0)
+		return;
+
+	// Follow changes of the local clock (DST, time zone, manual changes).
+	// A clock moved past a start switches to that clip at once.
+	HNSTIME hnsMidnight = hnsNow - (HNSTIME)nSecondOfDay * HNS_PER_SECOND;
+	if (m_bTimeOfDay && (hnsMidnight - m_hnsMidnight > HNS_PER_SECOND ||
+		m_hnsMidnight - hnsMidnight > HNS_PER_SECOND)) {
+		m_hnsMidnight = hnsMidnight;
+		if (m_bPreparing) {
+			m_pPlayer->CancelPrepared();
+			m_bPreparing = false;
+		}
+		size_t nItem = ItemForTimeOfDay(hnsNow);
+		if (nItem != m_nCurrent && !m_failed[nItem]) {
+			m_nNext = nItem;
+			m_hnsSwitch = hnsNow;
+		}
+		else {
+			ScheduleSwitch(hnsNow);
+		}
+		return;
+	}
+
+	if (!m_bPreparing && hnsNow >= m_hnsSwitch - m_config.hnsPrefetch)
+		PrepareNext(hnsNow);
+
+	if (m_bPreparing && hnsNow >= m_hnsSwitch && m_pPlayer->IsPrepared())
+		Switch(hnsNow);
+}
+
+void PlaylistScheduler::OnPrepared(HNSTIME hnsNow)
+{
+	if (m_bRunning && m_bPreparing && m_hnsSwitch >= 0 && hnsNow >= m_hnsSwitch)
+		Switch(hnsNow);
+}
+
+void PlaylistScheduler::OnPrepareFailed(HNSTIME hnsNow)
+{
+	if (!m_bPreparing)
+		return;
+	m_bPreparing = false;
+	SkipNext(hnsNow);
+}
+
+void PlaylistScheduler::Next(HNSTIME hnsNow)
+{
+	if (!m_bRunning || m_items.size() < 2)
+		return;
+	if (m_hnsSwitch < 0) {
+		m_nNext = PickNext();
+	}
+	m_hnsSwitch = hnsNow;
+	if (!m_bPreparing)
+		PrepareNext(hnsNow);
+	if (m_bPreparing && m_pPlayer->IsPrepared())
+		Switch(hnsNow);
+}
+
+//-----------------------------------------------------------------------------
+// ScheduleSwitch
+//
+// Picks the next clip and the time to switch to it.
+//-----------------------------------------------------------------------------
+
+void PlaylistScheduler::ScheduleSwitch(HNSTIME hnsNow)
+{
+	m_hnsSwitch = -1;
+	if (m_items.size() < 2)
+		return;
+
+	if (m_bTimeOfDay) {
+		m_hnsSwitch = NextTimeOfDaySwitch(hnsNow, &m_nNext);
+		if (m_nNext == m_nCurrent)
+			m_hnsSwitch = -1;
+	}
+	else if (m_config.hnsInterval > 0) {
+		m_nNext = PickNext();
+		if (m_nNext != m_nCurrent)
+			m_hnsSwitch = hnsNow + m_config.hnsInterval;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// PickNext
+//
+// The clip after the current one that has not failed, or the current one
+// if every other clip has.
+//-----------------------------------------------------------------------------
+
+size_t PlaylistScheduler::PickNext()
+{
+	size_t cItems = m_items.size();
+	if (m_config.order != PLAYLIST_SHUFFLE) {
+		for (size_t i = 1; i < cItems; i++) {
+			size_t n = (m_nCurrent + i) % cItems;
+			if (!m_failed[n])
+				return n;
+		}
+		return m_nCurrent;
+	}
+
+	// Two rounds hold every other clip at least once.
+	for (size_t cDrawn = 0; cDrawn < 2 * cItems; cDrawn++) {
+		if (m_nOrder >= m_order.size()) {
+			Reshuffle();
+			// Never play the same clip twice in a row across rounds.
+			if (cItems > 1 && m_order[0] == m_nCurrent) {
+				m_order[0] = m_order[cItems - 1];
+				m_order[cItems - 1] = m_nCurrent;
+			}
+		}
+		size_t n = m_order[m_nOrder++];
+		if (n != m_nCurrent && !m_failed[n])
+			return n;
+	}
+	return m_nCurrent;
+}
+
+//-----------------------------------------------------------------------------
+// Reshuffle
+//
+// Fisher-Yates over a xorshift32 sequence, so a seed replays the same
+// rotation.
+//-----------------------------------------------------------------------------
+
+void PlaylistScheduler::Reshuffle()
+{
+	size_t cItems = m_items.size();
+	m_order.resize(cItems);
+	for (size_t i = 0; i < cItems; i++)
+		m_order[i] = i;
+	for (size_t i = cItems; i > 1; i--) {
+		m_nRandom ^= m_nRandom << 13;
+		m_nRandom ^= m_nRandom >> 17;
+		m_nRandom ^= m_nRandom << 5;
+		size_t j = m_nRandom % i;
+		size_t t = m_order[i - 1];
+		m_order[i - 1] = m_order[j];
+		m_order[j] = t;
+	}
+	m_nOrder = 0;
+}
+
+//-----------------------------------------------------------------------------
+// ItemForTimeOfDay
+//
+// The timed clip whose start is the latest one at or before hnsNow,
+// wrapping around midnight.
+//-----------------------------------------------------------------------------
+
+size_t PlaylistScheduler::ItemForTimeOfDay(HNSTIME hnsNow) const
+{
+	HNSTIME hnsOfDay = (hnsNow - m_hnsMidnight) % HNS_PER_DAY;
+	if (hnsOfDay < 0)
+		hnsOfDay += HNS_PER_DAY;
+
+	size_t nBest = 0;
+	HNSTIME hnsBest = -1;
+	for (size_t i = 0; i < m_items.size(); i++) {
+		if (m_items[i].nStartOfDay < 0)
+			continue;
+		HNSTIME hnsAgo = hnsOfDay - (HNSTIME)m_items[i].nStartOfDay * HNS_PER_SECOND;
+		if (hnsAgo < 0)
+			hnsAgo += HNS_PER_DAY;
+		if (hnsBest < 0 || hnsAgo < hnsBest) {
+			hnsBest = hnsAgo;
+			nBest = i;
+		}
+	}
+	return nBest;
+}
+
+//-----------------------------------------------------------------------------
+// NextTimeOfDaySwitch
+//
+// Monotonic time of the next timed start after hnsNow, and its clip.
+//-----------------------------------------------------------------------------
+
+HNSTIME PlaylistScheduler::NextTimeOfDaySwitch(HNSTIME hnsNow, size_t* pnItem) const
+{
+	HNSTIME hnsOfDay = (hnsNow - m_hnsMidnight) % HNS_PER_DAY;
+	if (hnsOfDay < 0)
+		hnsOfDay += HNS_PER_DAY;
+
+	HNSTIME hnsBest = -1;
+	*pnItem = m_nCurrent;
+	for (size_t i = 0; i < m_items.size(); i++) {
+		if (m_items[i].nStartOfDay < 0 || m_failed[i])
+			continue;
+		HNSTIME hnsAhead = (HNSTIME)m_items[i].nStartOfDay * HNS_PER_SECOND - hnsOfDay;
+		if (hnsAhead <= HNS_PER_MSEC)
+			hnsAhead += HNS_PER_DAY;
+		if (hnsBest < 0 || hnsAhead < hnsBest) {
+			hnsBest = hnsAhead;
+			*pnItem = i;
+		}
+	}
+	return hnsBest < 0 ? -1 : hnsNow + hnsBest;
+}
+
+void PlaylistScheduler::PrepareNext(HNSTIME hnsNow)
+{
+	m_bPreparing = m_pPlayer->Prepare(m_items[m_nNext].path);
+	if (!m_bPreparing)
+		SkipNext(hnsNow);
+}
+
+//-----------------------------------------------------------------------------
+// SkipNext
+//
+// Passes over the next clip, which cannot be opened. Its successor is
+// switched to at the same deadline, so it is prepared on the next tick;
+// a timed clip's successor is the next timed start.
+//-----------------------------------------------------------------------------
+
+void PlaylistScheduler::SkipNext(HNSTIME hnsNow)
+{
+	m_stats.cFailed++;
+	m_failed[m_nNext] = 1;
+	if (m_bTimeOfDay) {
+		ScheduleSwitch(hnsNow);
+		return;
+	}
+	m_nNext = PickNext();
+	if (m_nNext == m_nCurrent)
+		m_hnsSwitch = -1;
+}
+
+void PlaylistScheduler::Switch(HNSTIME hnsNow)
+{
+	HNSTIME hnsDelay = hnsNow - m_hnsSwitch;
+	m_bPreparing = false;
+
+	if (!m_pPlayer->SwitchToPrepared()) {
+		SkipNext(hnsNow);
+		return;
+	}
+
+	m_nCurrent = m_nNext;
+	m_stats.cSwitches++;
+	m_stats.hnsLastSwitchDelay = hnsDelay;
+	if (hnsDelay > m_stats.hnsMaxSwitchDelay)
+		m_stats.hnsMaxSwitchDelay = hnsDelay;
+	if (hnsDelay > LATE_SWITCH_TOLERANCE)
+		m_stats.cLateSwitches++;
+
+	ScheduleSwitch(hnsNow);
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include "PlaybackClock.h"
+#include <string>
+#include <vector>
+
+
+const int32_t SECONDS_PER_DAY = 24 * 60 * 60;
+
+// Order in which the clips rotate.
+enum PLAYLIST_ORDER
+{
+	PLAYLIST_SEQUENTIAL = 0,
+	PLAYLIST_SHUFFLE			// Every clip once per round, in random order
+};
+
+struct PlaylistItem
+{
+	std::wstring	path;
+	int32_t			nStartOfDay;	// Local second of day the clip starts at, -1 = none
+};
+
+struct PlaylistConfig
+{
+	PLAYLIST_ORDER	order;
+	HNSTIME			hnsInterval;	// Rotation interval, 0 = no interval rotation
+	HNSTIME			hnsPrefetch;	// The next clip is prepared this long before the switch
+	uint32_t		nSeed;			// Shuffle seed
+
+	PlaylistConfig() : order(PLAYLIST_SEQUENTIAL), hnsInterval(0), hnsPrefetch(5 * HNS_PER_SECOND),
+		nSeed(1)
+	{
+	}
+};
+
+struct PlaylistStats
+{
+	uint32_t	cSwitches;
+	uint32_t	cLateSwitches;		// Next clip was not prepared at the deadline
+	uint32_t	cFailed;			// Prepare or switch failed
+	HNSTIME		hnsMaxSwitchDelay;	// Worst deadline-to-switch delay
+	HNSTIME		hnsLastSwitchDelay;
+};
+
+
+//-------------------------------------------------------------------
+//
+// IClipPlayer interface
+//
+// What the playlist needs from the player: open the next clip in the
+// background, and swap to it once it is ready.
+//
+//-------------------------------------------------------------------
+
+class IClipPlayer
+{
+public:
+	virtual ~IClipPlayer() {}
+
+	// Starts opening a clip without showing it.
+	virtual bool Prepare(const std::wstring& path) = 0;
+
+	// The prepared clip is ready to be switched to.
+	virtual bool IsPrepared() = 0;
+
+	// Shows the prepared clip in place of the current one.
+	virtual bool SwitchToPrepared() = 0;
+
+	virtual void CancelPrepared() = 0;
+};
+
+
+//-------------------------------------------------------------------
+//
+// PlaylistScheduler class
+//
+// Rotates a list of clips on an interval or at times of day, in order
+// or shuffled. The next clip is prepared hnsPrefetch ahead of its switch
+// so the player only has to swap media items at the deadline.
+//
+// Driven by OnTick() with monotonic time plus the local second of day;
+// GetDeadline() tells when the next tick is due.
+//
+// A clip that fails to open is passed over until the items are set again;
+// rotation stops only when no other clip is left.
+//
+//-------------------------------------------------------------------
+
+class PlaylistScheduler
+{
+public:
+	PlaylistScheduler(IClipPlayer* pPlayer, const PlaylistConfig& config);
+
+	void SetConfig(const PlaylistConfig& config);
+	void SetItems(const std::vector<PlaylistItem>& items);
+	size_t GetItemCount() const { return m_items.size(); }
+
+	// Index of the clip that should play first. Call before opening it.
+	size_t Start(HNSTIME hnsNow, int32_t nSecondOfDay);
+	void Stop();
+
+	// Prepares and switches when due.
+	void OnTick(HNSTIME hnsNow, int32_t nSecondOfDay);
+
+	// The prepared clip became ready; switches at once if the deadline passed.
+	void OnPrepared(HNSTIME hnsNow);
+
+	// The clip being prepared cannot be opened; it is skipped from now on
+	// and the one after it takes its place.
+	void OnPrepareFailed(HNSTIME hnsNow);
+
+	// Skips to the next clip now, preparing it first if needed.
+	void Next(HNSTIME hnsNow);
+
+	// Time of the next prefetch or switch, -1 if nothing is scheduled.
+	HNSTIME GetDeadline() const;
+
+	size_t GetCurrent() const { return m_nCurrent; }
+	const PlaylistStats& GetStats() const { return m_stats; }
+
+private:
+	size_t PickNext();
+	size_t ItemForTimeOfDay(HNSTIME hnsNow) const;
+	HNSTIME NextTimeOfDaySwitch(HNSTIME hnsNow, size_t* pnItem) const;
+	void PrepareNext(HNSTIME hnsNow);
+	void SkipNext(HNSTIME hnsNow);
+	void Switch(HNSTIME hnsNow);
+	void ScheduleSwitch(HNSTIME hnsNow);
+	void Reshuffle();
+
+	IClipPlayer*				m_pPlayer;
+	PlaylistConfig				m_config;
+	std::vector<PlaylistItem>	m_items;
+	std::vector<size_t>			m_order;		// Shuffle round
+	std::vector<uint8_t>		m_failed;		// Per item: could not be opened, passed over
+	size_t						m_nOrder;		// Position in m_order
+	size_t						m_nCurrent;
+	size_t						m_nNext;
+	bool						m_bRunning;
+	bool						m_bTimeOfDay;	// Items have start times
+	bool						m_bPreparing;
+	HNSTIME						m_hnsSwitch;	// Switch deadline, -1 = none
+	HNSTIME						m_hnsMidnight;	// Monotonic time of the last local midnight
+	uint32_t					m_nRandom;
+	PlaylistStats				m_stats;
+};
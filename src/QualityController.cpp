@@ -0,0 +1,144 @@
+#include "QualityController.h"
+
+
+std::vector<QualityRung> GetDefaultQualityLadder(bool bPrescaled)
+{
+	// Costs of a 60 fps clip decoded at desktop size; decode and scaling
+	// cost about per pixel, with a fixed share per frame.
+	static const QualityRung s_capped[] = {
+		{ 0.0f, 1, 1.0f },
+		{ 30.0f, 1, 0.55f },
+		{ 20.0f, 1, 0.4f },
+		{ 15.0f, 1, 0.3f },
+		{ 10.0f, 1, 0.22f },
+	};
+	static const QualityRung s_prescaled[] = {
+		{ 0.0f, 1, 1.0f },
+		{ 30.0f, 1, 0.55f },
+		{ 30.0f, 2, 0.2f },
+		{ 15.0f, 2, 0.12f },
+		{ 15.0f, 4, 0.05f },
+	};
+	if (bPrescaled)
+		return std::vector<QualityRung>(s_prescaled, s_prescaled + sizeof(s_prescaled) / sizeof(s_prescaled[0]));
+	return std::vector<QualityRung>(s_capped, s_capped + sizeof(s_capped) / sizeof(s_capped[0]));
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+QualityController::QualityController(const QualityConfig& config) : m_config(config)
+{
+	if (m_config.rungs.empty())
+		m_config.rungs = GetDefaultQualityLadder(false);
+	Reset(0);
+}
+
+void QualityController::Reset(HNSTIME hnsNow)
+{
+	m_nRung = 0;
+	m_fBad = 0.0f;
+	m_fLoad = 0.0f;
+	m_fProcessLoad = 0.0f;
+	m_bPrimed = false;
+	m_hnsPressureSince = -1;
+	m_hnsHeadroomSince = -1;
+	m_hnsRungSince = hnsNow;
+	m_hnsLastUp = -1;
+	m_upDelays.assign(m_config.rungs.size(), m_config.hnsUpDelay);
+	m_timeAtRung.assign(m_config.rungs.size(), 0);
+	m_cTransitions = 0;
+}
+
+//-----------------------------------------------------------------------------
+// OnSample
+//
+// A period without frames, e.g. while paused, says nothing about the
+// rung and restarts the pressure and headroom timers.
+//-----------------------------------------------------------------------------
+
+bool QualityController::OnSample(const QualitySample& sample)
+{
+	HNSTIME hnsNow = sample.hnsTime;
+	uint64_t cFrames = sample.cPresented + sample.cDropped;
+	if (!cFrames) {
+		m_hnsPressureSince = -1;
+		m_hnsHeadroomSince = -1;
+		return false;
+	}
+
+	uint64_t cBad = sample.cDropped + sample.cLate;
+	float fBad = cBad < cFrames ? (float)cBad / cFrames : 1.0f;
+	float fWeight = m_bPrimed ? m_config.fSmoothing : 1.0f;
+	m_fBad += (fBad - m_fBad) * fWeight;
+	m_fLoad += (sample.fSystemLoad - m_fLoad) * fWeight;
+	m_fProcessLoad += (sample.fProcessLoad - m_fProcessLoad) * fWeight;
+	m_bPrimed = true;
+
+	// A step up that held through the probe window earns the base delay back.
+	if (m_hnsLastUp >= 0 && hnsNow - m_hnsLastUp >= m_config.hnsProbeWindow) {
+		m_upDelays[m_nRung] = m_config.hnsUpDelay;
+		m_hnsLastUp = -1;
+	}
+
+	bool bPressure = m_fBad > m_config.fBadStepDown || m_fLoad > m_config.fLoadStepDown;
+	bool bHeadroom = false;
+	if (!bPressure && m_nRung > 0 && m_fBad < m_config.fBadStepUp) {
+		// What the player would add to the load one rung up.
+		const QualityRung& current = m_config.rungs[m_nRung];
+		const QualityRung& better = m_config.rungs[m_nRung - 1];
+		float fExtra = current.fCost > 0.0f ? m_fProcessLoad * (better.fCost / current.fCost - 1.0f) : 0.0f;
+		bHeadroom = m_fLoad + fExtra < m_config.fLoadStepUp;
+	}
+
+	if (!bPressure)
+		m_hnsPressureSince = -1;
+	else if (m_hnsPressureSince < 0)
+		m_hnsPressureSince = hnsNow;
+	if (!bHeadroom)
+		m_hnsHeadroomSince = -1;
+	else if (m_hnsHeadroomSince < 0)
+		m_hnsHeadroomSince = hnsNow;
+
+	if (hnsNow - m_hnsRungSince < m_config.hnsMinDwell)
+		return false;
+
+	if (bPressure && m_nRung + 1 < m_config.rungs.size() &&
+		hnsNow - m_hnsPressureSince >= m_config.hnsDownDelay) {
+		if (m_hnsLastUp >= 0 && hnsNow - m_hnsLastUp < m_config.hnsProbeWindow) {
+			HNSTIME hnsDelay = m_upDelays[m_nRung] * 2;
+			m_upDelays[m_nRung] = hnsDelay < m_config.hnsMaxUpDelay ? hnsDelay : m_config.hnsMaxUpDelay;
+		}
+		m_hnsLastUp = -1;
+		SetRung(m_nRung + 1, hnsNow);
+		return true;
+	}
+	if (bHeadroom && hnsNow - m_hnsHeadroomSince >= m_upDelays[m_nRung - 1]) {
+		m_hnsLastUp = hnsNow;
+		SetRung(m_nRung - 1, hnsNow);
+		return true;
+	}
+	return false;
+}
+
+void QualityController::SetRung(size_t nRung, HNSTIME hnsNow)
+{
+	m_timeAtRung[m_nRung] += hnsNow - m_hnsRungSince;
+	m_hnsRungSince = hnsNow;
+	m_nRung = nRung;
+	m_hnsPressureSince = -1;
+	m_hnsHeadroomSince = -1;
+	m_cTransitions++;
+}
+
+HNSTIME QualityController::GetTimeAtRung(size_t nRung, HNSTIME hnsNow) const
+{
+	if (nRung >= m_timeAtRung.size())
+		return 0;
+	HNSTIME hnsTime = m_timeAtRung[nRung];
+	if (nRung == m_nRung)
+		hnsTime += hnsNow - m_hnsRungSince;
+	return hnsTime;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "PlaybackClock.h"
+#include <stddef.h>
+#include <vector>
+
+
+// One step of the quality ladder.
+struct QualityRung
+{
+	float		fMaxFps;		// Frame rate cap, 0 = none
+	uint32_t	nScaleDown;		// Variant at 1/n of the desktop size, 1 = the clip as is
+	float		fCost;			// CPU cost against the top rung, which is 1
+};
+
+// One measurement period of the played clip and the machine.
+struct QualitySample
+{
+	HNSTIME		hnsTime;
+	uint64_t	cPresented;		// Frames presented in the period
+	uint64_t	cDropped;		// Frames decoded but never presented
+	uint64_t	cLate;			// Frames presented past the late threshold
+	float		fSystemLoad;	// Busy share of all cores, 0 to 1
+	float		fProcessLoad;	// Share of all cores the player used, 0 to 1
+};
+
+struct QualityConfig
+{
+	std::vector<QualityRung>	rungs;	// Best first
+	float	fBadStepDown;		// Share of bad (dropped or late) frames that steps down
+	float	fBadStepUp;			// Share of bad frames below which a step up is considered
+	float	fLoadStepDown;		// System load that steps down
+	float	fLoadStepUp;		// System load, with the next rung's extra cost, that allows a step up
+	float	fSmoothing;			// Weight of a new sample in the smoothed averages, 1 = none
+	HNSTIME	hnsDownDelay;		// Pressure must last this long before a step down
+	HNSTIME	hnsUpDelay;			// Headroom must last this long before a step up
+	HNSTIME	hnsMinDwell;		// Minimum time between two steps
+	HNSTIME	hnsProbeWindow;		// A step down this soon after a step up failed the step up
+	HNSTIME	hnsMaxUpDelay;		// Longest up delay that failed step ups back off to
+
+	QualityConfig() : fBadStepDown(0.1f), fBadStepUp(0.02f), fLoadStepDown(0.9f), fLoadStepUp(0.75f),
+		fSmoothing(0.5f), hnsDownDelay(2 * HNS_PER_SECOND), hnsUpDelay(10 * HNS_PER_SECOND),
+		hnsMinDwell(3 * HNS_PER_SECOND), hnsProbeWindow(20 * HNS_PER_SECOND), hnsMaxUpDelay(160 * HNS_PER_SECOND)
+	{
+	}
+};
+
+// Ladder of frame rate caps and pre-scaled variants. Without
+// bPrescaled the rungs only cap the frame rate.
+std::vector<QualityRung> GetDefaultQualityLadder(bool bPrescaled);
+
+
+//-------------------------------------------------------------------
+//
+// QualityController class
+//
+// Pure state machine picking a rung of the quality ladder from periodic
+// samples of frame drops and system load. Bad frames or a loaded system
+// step down one rung; a clean playback with room for the next rung's
+// extra cost steps back up one.
+//
+// Hysteresis: pressure or headroom has to last the down or up delay
+// before a step, and two steps are at least hnsMinDwell apart. A step up
+// that has to be taken back within hnsProbeWindow doubles the up delay
+// of that rung, up to hnsMaxUpDelay, so a machine that cannot hold a
+// rung is not probed every few seconds. The same samples always give
+// the same steps.
+//
+//-------------------------------------------------------------------
+
+class QualityController
+{
+public:
+	explicit QualityController(const QualityConfig& config);
+
+	void Reset(HNSTIME hnsNow);
+
+	// Feeds one sample. Returns true if the rung changed.
+	bool OnSample(const QualitySample& sample);
+
+	size_t GetRung() const { return m_nRung; }
+	const QualityRung& GetRungInfo() const { return m_config.rungs[m_nRung]; }
+	size_t GetRungCount() const { return m_config.rungs.size(); }
+
+	// Smoothed share of bad frames and system load.
+	float GetBadShare() const { return m_fBad; }
+	float GetLoad() const { return m_fLoad; }
+
+	uint32_t GetTransitionCount() const { return m_cTransitions; }
+	HNSTIME GetTimeAtRung(size_t nRung, HNSTIME hnsNow) const;
+
+private:
+	void SetRung(size_t nRung, HNSTIME hnsNow);
+
+	QualityConfig			m_config;
+	size_t					m_nRung;
+	float					m_fBad;
+	float					m_fLoad;
+	float					m_fProcessLoad;
+	bool					m_bPrimed;			// Averages hold a sample
+	HNSTIME					m_hnsPressureSince;	// -1 = no pressure
+	HNSTIME					m_hnsHeadroomSince;	// -1 = no headroom
+	HNSTIME					m_hnsRungSince;
+	HNSTIME					m_hnsLastUp;		// Time of the last step up, -1 = none
+	std::vector<HNSTIME>	m_upDelays;			// Up delay into each rung, backed off
+	std::vector<HNSTIME>	m_timeAtRung;
+	uint32_t				m_cTransitions;
+};
@@ -0,0 +1,215 @@
+#include "QualitySimulator.h"
+#include "FileUtil.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//-----------------------------------------------------------------------------
+// LoadLoadTrace
+//-----------------------------------------------------------------------------
+
+bool LoadLoadTrace(const std::wstring& path, LoadTrace* pTrace)
+{
+	FILE* fp = FileOpen(path, "r");
+	if (!fp)
+		return false;
+
+	pTrace->name = ToUtf8(path);
+	pTrace->points.clear();
+	bool bValid = true;
+	char line[256];
+	while (bValid && fgets(line, sizeof(line), fp)) {
+		char* pszComment = strchr(line, '#');
+		if (pszComment)
+			*pszComment = '\0';
+		char* pszEnd = NULL;
+		double fSeconds = strtod(line, &pszEnd);
+		if (pszEnd == line) {
+			// Blank or comment only.
+			while (*pszEnd == ' ' || *pszEnd == '\t' || *pszEnd == '\r' || *pszEnd == '\n')
+				pszEnd++;
+			bValid = *pszEnd == '\0';
+			continue;
+		}
+		char* pszLoad = pszEnd;
+		double fLoad = strtod(pszLoad, &pszEnd);
+		LoadPoint point;
+		point.hnsTime = (HNSTIME)(fSeconds * HNS_PER_SECOND);
+		point.fLoad = (float)fLoad;
+		bValid = pszEnd != pszLoad && fSeconds >= 0.0 && fLoad >= 0.0 && fLoad <= 1.0 &&
+			(pTrace->points.empty() || point.hnsTime >= pTrace->points.back().hnsTime);
+		if (bValid)
+			pTrace->points.push_back(point);
+	}
+	fclose(fp);
+	return bValid && pTrace->points.size() >= 2;
+}
+
+static LoadTrace MakeTrace(const char* pszName, const float (*pPoints)[2], size_t cPoints)
+{
+	LoadTrace trace;
+	trace.name = pszName;
+	for (size_t i = 0; i < cPoints; i++) {
+		LoadPoint point;
+		point.hnsTime = (HNSTIME)pPoints[i][0] * HNS_PER_SECOND;
+		point.fLoad = pPoints[i][1];
+		trace.points.push_back(point);
+	}
+	return trace;
+}
+
+std::vector<LoadTrace> GetBuiltInLoadTraces()
+{
+	// A parallel build takes every core for two minutes.
+	static const float s_build[][2] = {
+		{ 0, 0.05f }, { 30, 0.97f }, { 150, 0.05f }, { 300, 0.05f },
+	};
+	// A video call keeps most of the machine busy for a few minutes.
+	static const float s_call[][2] = {
+		{ 0, 0.05f }, { 20, 0.8f }, { 200, 0.1f }, { 320, 0.1f },
+	};
+	// Quiet spells a little longer than the up delay, which tempt a step up
+	// just before the next burst.
+	static const float s_bursts[][2] = {
+		{ 0, 0.05f }, { 20, 0.97f }, { 35, 0.1f }, { 50, 0.97f }, { 65, 0.1f }, { 80, 0.97f },
+		{ 95, 0.1f }, { 110, 0.97f }, { 125, 0.1f }, { 140, 0.97f }, { 155, 0.1f }, { 400, 0.1f },
+	};
+
+	std::vector<LoadTrace> traces;
+	traces.push_back(MakeTrace("build", s_build, sizeof(s_build) / sizeof(s_build[0])));
+	traces.push_back(MakeTrace("call", s_call, sizeof(s_call) / sizeof(s_call[0])));
+	traces.push_back(MakeTrace("bursts", s_bursts, sizeof(s_bursts) / sizeof(s_bursts[0])));
+	return traces;
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+QualitySimulator::QualitySimulator(const QualityConfig& config, const QualityModel& model) :
+	m_config(config),
+	m_model(model)
+{
+	if (m_config.rungs.empty())
+		m_config.rungs = GetDefaultQualityLadder(false);
+}
+
+//-----------------------------------------------------------------------------
+// Run
+//
+// Frame counts are kept fractional and rounded on their running totals,
+// so the controller sees whole frames without losing any to rounding.
+//-----------------------------------------------------------------------------
+
+QualitySimResult QualitySimulator::Run(const LoadTrace& trace, bool bFixed, std::string* pTimeline)
+{
+	QualitySimResult result = QualitySimResult();
+	result.secondsAtRung.assign(m_config.rungs.size(), 0.0);
+	if (trace.points.size() < 2 || m_model.hnsStep <= 0 || m_model.cCores == 0)
+		return result;
+
+	QualityController controller(m_config);
+	const HNSTIME hnsStart = trace.points.front().hnsTime;
+	const HNSTIME hnsEnd = trace.points.back().hnsTime;
+	const double fCores = m_model.cCores;
+	controller.Reset(hnsStart);
+
+	size_t nPoint = 0;
+	uint64_t cPresented = 0, cDropped = 0, cLate = 0;
+	for (HNSTIME hnsTime = hnsStart; hnsTime < hnsEnd; hnsTime += m_model.hnsStep) {
+		while (nPoint + 2 < trace.points.size() && trace.points[nPoint + 1].hnsTime <= hnsTime)
+			nPoint++;
+		HNSTIME hnsStep = hnsEnd - hnsTime < m_model.hnsStep ? hnsEnd - hnsTime : m_model.hnsStep;
+		double fSeconds = (double)hnsStep / HNS_PER_SECOND;
+		size_t nRung = bFixed ? 0 : controller.GetRung();
+		const QualityRung& rung = m_config.rungs[nRung];
+
+		double fOthers = trace.points[nPoint].fLoad * fCores;
+		double fDemand = m_model.fFullCost * rung.fCost;
+		double fGot = fDemand;
+		if (fOthers + fDemand > fCores)
+			fGot = fDemand * fCores / (fOthers + fDemand);
+		double fLoad = (fOthers + fDemand) / fCores;
+		if (fLoad > 1.0)
+			fLoad = 1.0;
+
+		double fFps = rung.fMaxFps > 0.0f && rung.fMaxFps < m_model.fSourceFps ? rung.fMaxFps : m_model.fSourceFps;
+		double fFrames = fFps * fSeconds;
+		double fPresented = fDemand > 0.0 ? fFrames * fGot / fDemand : fFrames;
+		double fLate = 0.0;
+		if (fLoad > m_model.fLateLoad && m_model.fLateLoad < 1.0f)
+			fLate = fPresented * 0.5 * (fLoad - m_model.fLateLoad) / (1.0 - m_model.fLateLoad);
+
+		result.fPresented += fPresented;
+		result.fDropped += fFrames - fPresented;
+		result.fLate += fLate;
+		result.fCpuSeconds += fGot * fSeconds;
+		result.secondsAtRung[nRung] += fSeconds;
+
+		if (pTimeline) {
+			char line[160];
+			snprintf(line, sizeof(line), "%.1f,%.2f,%u,%.0f,%u,%.3f,%.1f,%.1f,%.1f\n",
+				(double)(hnsTime - hnsStart) / HNS_PER_SECOND, trace.points[nPoint].fLoad, (unsigned)nRung, fFps,
+				rung.nScaleDown, fGot, fPresented, fFrames - fPresented, fLate);
+			*pTimeline += line;
+		}
+
+		QualitySample sample;
+		sample.hnsTime = hnsTime + hnsStep;
+		sample.cPresented = (uint64_t)llround(result.fPresented) - cPresented;
+		sample.cDropped = (uint64_t)llround(result.fDropped) - cDropped;
+		sample.cLate = (uint64_t)llround(result.fLate) - cLate;
+		sample.fSystemLoad = (float)fLoad;
+		sample.fProcessLoad = (float)(fGot / fCores);
+		cPresented += sample.cPresented;
+		cDropped += sample.cDropped;
+		cLate += sample.cLate;
+		if (!bFixed)
+			controller.OnSample(sample);
+	}
+	result.cTransitions = controller.GetTransitionCount();
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+// Report
+//-----------------------------------------------------------------------------
+
+std::string QualitySimulator::Report(const LoadTrace& trace, bool bTimeline)
+{
+	std::string timeline;
+	QualitySimResult adaptive = Run(trace, false, bTimeline ? &timeline : NULL);
+	QualitySimResult fixed = Run(trace, true, NULL);
+
+	char line[256];
+	double fSeconds = trace.points.size() >= 2 ?
+		(double)(trace.points.back().hnsTime - trace.points.front().hnsTime) / HNS_PER_SECOND : 0.0;
+	snprintf(line, sizeof(line), "trace %s: %.0f s on %u cores, top rung %.2f cores at %.0f fps\n",
+		trace.name.c_str(), fSeconds, (unsigned)m_model.cCores, m_model.fFullCost, m_model.fSourceFps);
+	std::string report(line);
+
+	const QualitySimResult* pResults[] = { &adaptive, &fixed };
+	const char* pszNames[] = { "adaptive", "fixed" };
+	for (int i = 0; i < 2; i++) {
+		const QualitySimResult& r = *pResults[i];
+		double fFrames = r.fPresented + r.fDropped;
+		snprintf(line, sizeof(line), "  %-8s  %6.1f core-s  %5.1f%% dropped  %5.1f%% late  %u steps\n", pszNames[i],
+			r.fCpuSeconds, fFrames > 0.0 ? 100.0 * r.fDropped / fFrames : 0.0,
+			fFrames > 0.0 ? 100.0 * r.fLate / fFrames : 0.0, (unsigned)r.cTransitions);
+		report += line;
+	}
+	for (size_t i = 0; i < m_config.rungs.size(); i++) {
+		const QualityRung& rung = m_config.rungs[i];
+		snprintf(line, sizeof(line), "  rung %u (%.0f fps, 1/%u size): %.0f s\n", (unsigned)i,
+			rung.fMaxFps > 0.0f && rung.fMaxFps < m_model.fSourceFps ? rung.fMaxFps : m_model.fSourceFps,
+			rung.nScaleDown, adaptive.secondsAtRung[i]);
+		report += line;
+	}
+	if (bTimeline) {
+		report += "seconds,load,rung,fps,scale,cores,presented,dropped,late\n";
+		report += timeline;
+	}
+	return report;
+}
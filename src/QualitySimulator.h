@@ -0,0 +1,86 @@
+#pragma once
+#include "QualityController.h"
+#include <string>
+#include <vector>
+
+
+// From hnsTime on, other processes keep fLoad of all cores busy.
+struct LoadPoint
+{
+	HNSTIME		hnsTime;
+	float		fLoad;
+};
+
+// Load of a machine over time. The last point only ends the trace.
+struct LoadTrace
+{
+	std::string				name;
+	std::vector<LoadPoint>	points;
+};
+
+// Machine the simulated player runs on.
+struct QualityModel
+{
+	uint32_t	cCores;
+	float		fFullCost;		// Cores the top rung needs
+	float		fSourceFps;		// Frame rate of the clip
+	float		fLateLoad;		// System load past which scheduling delays make frames late
+	HNSTIME		hnsStep;		// Sample period
+
+	QualityModel() : cCores(4), fFullCost(0.8f), fSourceFps(60.0f), fLateLoad(0.85f), hnsStep(HNS_PER_SECOND)
+	{
+	}
+};
+
+// Totals of one replay.
+struct QualitySimResult
+{
+	double		fPresented;
+	double		fDropped;
+	double		fLate;
+	double		fCpuSeconds;	// Core-seconds the player used
+	uint32_t	cTransitions;
+	std::vector<double>	secondsAtRung;
+};
+
+// Reads a trace of "SECONDS LOAD" lines, LOAD from 0 to 1; '#' starts
+// a comment. Times must not go backwards.
+bool LoadLoadTrace(const std::wstring& path, LoadTrace* pTrace);
+
+// Traces of a build, a video call and a load that comes and goes.
+std::vector<LoadTrace> GetBuiltInLoadTraces();
+
+
+//-------------------------------------------------------------------
+//
+// QualitySimulator class
+//
+// Replays a load trace through a QualityController on a modelled
+// machine, step by step in simulated time, so thresholds and ladders
+// can be tried without a Windows desktop.
+//
+// Each step the player asks for the cores of its rung and the other
+// processes for theirs; when they ask for more than there are, each
+// gets its share, and the frames the player has no CPU for are dropped.
+// Past fLateLoad, scheduling delays make a growing share of the frames
+// late, up to half of them at full load. The model is deterministic.
+//
+//-------------------------------------------------------------------
+
+class QualitySimulator
+{
+public:
+	QualitySimulator(const QualityConfig& config, const QualityModel& model);
+
+	// Replays a trace with the controller, or holding the top rung with
+	// bFixed. Appends a CSV line per step to pTimeline if not NULL.
+	QualitySimResult Run(const LoadTrace& trace, bool bFixed, std::string* pTimeline);
+
+	// Replays a trace adaptive and fixed and reports both, with the
+	// timeline of the adaptive run if bTimeline.
+	std::string Report(const LoadTrace& trace, bool bTimeline);
+
+private:
+	QualityConfig	m_config;
+	QualityModel	m_model;
+};
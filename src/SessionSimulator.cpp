@@ -0,0 +1,453 @@
+#include "SessionSimulator.h"
+#include <wchar.h>
+
+
+// Posted player events, handled in this order like the app's event ids.
+enum SIM_EVENT
+{
+	SIM_EVENT_ENDED = 0,
+	SIM_EVENT_RATE,
+	SIM_EVENT_PREPARED,
+	SIM_EVENT_STATE
+};
+
+// MFPlay callback to the app's thread handling the posted events.
+static const HNSTIME EVENT_LATENCY = HNS_PER_MSEC;
+
+static const HNSTIME HNS_PER_MINUTE = 60 * HNS_PER_SECOND;
+static const HNSTIME HNS_PER_HOUR = 60 * HNS_PER_MINUTE;
+
+
+//-----------------------------------------------------------------------------
+// GetBuiltInSessions
+//-----------------------------------------------------------------------------
+
+static void AddSignal(SessionScenario* pScenario, HNSTIME hnsTime, GOVERNOR_SIGNAL signal, bool bActive)
+{
+	GovernorEvent event;
+	event.hnsTime = hnsTime;
+	event.signal = signal;
+	event.bActive = bActive;
+	pScenario->signals.push_back(event);
+}
+
+std::vector<SessionScenario> GetBuiltInSessions()
+{
+	std::vector<SessionScenario> sessions;
+
+	// One clip looped through a working day.
+	SessionScenario loop;
+	loop.name = "loop-8h";
+	loop.hnsLength = 8 * HNS_PER_HOUR;
+	loop.clips.push_back(12 * HNS_PER_SECOND);
+	sessions.push_back(loop);
+
+	// A clip shorter than the default lead time allows for.
+	SessionScenario shortLoop;
+	shortLoop.name = "short-loop-8h";
+	shortLoop.hnsLength = 8 * HNS_PER_HOUR;
+	shortLoop.clips.push_back(2500 * HNS_PER_MSEC);
+	shortLoop.hnsSeekLatency = 80 * HNS_PER_MSEC;
+	sessions.push_back(shortLoop);
+
+	// Shuffled clips rotated every 10 minutes from 08:00, a game played
+	// fullscreen in the afternoon, unplugged in the evening and locked
+	// overnight.
+	SessionScenario day;
+	day.name = "playlist-24h";
+	day.hnsLength = 24 * HNS_PER_HOUR;
+	day.nStartOfDay = 8 * 3600;
+	day.clips.push_back(30 * HNS_PER_SECOND);
+	day.clips.push_back(20 * HNS_PER_SECOND);
+	day.clips.push_back(45 * HNS_PER_SECOND);
+	day.clips.push_back(8 * HNS_PER_SECOND);
+	day.playlist.order = PLAYLIST_SHUFFLE;
+	day.playlist.hnsInterval = 10 * HNS_PER_MINUTE;
+	day.playlist.nSeed = 7;
+	AddSignal(&day, 6 * HNS_PER_HOUR, GOVERNOR_SIGNAL_FULLSCREEN, true);
+	AddSignal(&day, 8 * HNS_PER_HOUR, GOVERNOR_SIGNAL_FULLSCREEN, false);
+	AddSignal(&day, 11 * HNS_PER_HOUR, GOVERNOR_SIGNAL_ON_BATTERY, true);
+	AddSignal(&day, 13 * HNS_PER_HOUR, GOVERNOR_SIGNAL_ON_BATTERY, false);
+	AddSignal(&day, 15 * HNS_PER_HOUR, GOVERNOR_SIGNAL_SESSION_LOCKED, true);
+	AddSignal(&day, 23 * HNS_PER_HOUR, GOVERNOR_SIGNAL_SESSION_LOCKED, false);
+	sessions.push_back(day);
+
+	// Windows covering the desktop every other minute and the rate changed
+	// three times an hour.
+	SessionScenario busy;
+	busy.name = "busy-4h";
+	busy.hnsLength = 4 * HNS_PER_HOUR;
+	busy.clips.push_back(10 * HNS_PER_SECOND);
+	for (HNSTIME hnsTime = HNS_PER_MINUTE; hnsTime < busy.hnsLength; hnsTime += 2 * HNS_PER_MINUTE) {
+		AddSignal(&busy, hnsTime, GOVERNOR_SIGNAL_OCCLUDED, true);
+		AddSignal(&busy, hnsTime + 40 * HNS_PER_SECOND, GOVERNOR_SIGNAL_OCCLUDED, false);
+	}
+	static const float rates[] = { 1.5f, 0.5f, 1.0f };
+	for (int i = 0; i < 12; i++) {
+		RatePoint rate;
+		rate.hnsTime = i * 20 * HNS_PER_MINUTE + 7 * HNS_PER_MINUTE + 30 * HNS_PER_SECOND;
+		rate.fRate = rates[i % 3];
+		busy.rates.push_back(rate);
+	}
+	sessions.push_back(busy);
+
+	return sessions;
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+SessionSimulator::SessionSimulator() : m_pScenario(NULL), m_pController(NULL), m_pLoop(NULL), m_pPlaylist(NULL),
+	m_pGovernor(NULL), m_result(), m_hnsNow(0), m_nRandom(1), m_state(PLAYER_STATE_EMPTY), m_nClip(-1),
+	m_hnsPosition(0), m_hnsPositionTime(0), m_fRate(1.0f), m_hnsOpenDone(-1), m_nOpening(-1), m_nPreparing(-1),
+	m_hnsPrepareDone(-1), m_nPrepared(-1), m_hnsLoopDue(-1), m_hnsPlaylistDue(-1), m_hnsEventsDue(-1),
+	m_fPending(0), m_fSeen(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Run
+//
+// Steps from one due item to the next: the player reaching a state or
+// the end of the clip, a batch of posted events, a timer, or a signal
+// or command. Items due at the same time are handled one per step, the
+// player's first.
+//-----------------------------------------------------------------------------
+
+SessionSimResult SessionSimulator::Run(const SessionScenario& scenario)
+{
+	LoopScheduler loop(this);
+	PlaylistScheduler playlist(this, scenario.playlist);
+	PlaybackController controller(&loop, &playlist, this);
+	PlaybackGovernor governor = PlaybackGovernor(GovernorConfig());
+
+	m_pScenario = &scenario;
+	m_pController = &controller;
+	m_pLoop = &loop;
+	m_pPlaylist = &playlist;
+	m_pGovernor = &governor;
+	m_result = SessionSimResult();
+	m_hnsNow = 0;
+	m_nRandom = 12345;
+	m_state = PLAYER_STATE_EMPTY;
+	m_nClip = -1;
+	m_hnsPosition = m_hnsPositionTime = 0;
+	m_fRate = 1.0f;
+	m_hnsOpenDone = m_hnsPrepareDone = -1;
+	m_nOpening = m_nPreparing = m_nPrepared = -1;
+	m_hnsLoopDue = m_hnsPlaylistDue = m_hnsEventsDue = -1;
+	m_fPending = 0;
+	m_fSeen = 0;
+
+	governor.Reset(0);
+	if (!scenario.clips.empty()) {
+		std::vector<PlaylistItem> items(scenario.clips.size());
+		for (size_t i = 0; i < items.size(); i++) {
+			items[i].path = std::to_wstring(i);
+			items[i].nStartOfDay = -1;
+		}
+		playlist.SetItems(items);
+		m_nOpening = (int)playlist.Start(0, GetSecondOfDay());
+		m_hnsOpenDone = scenario.hnsOpenLatency;
+		ArmPlaylistTimer();
+	}
+
+	size_t nSignal = 0, nRate = 0;
+	for (;;) {
+		enum { DUE_OPEN, DUE_PREPARE, DUE_END, DUE_EVENTS, DUE_LOOP, DUE_PLAYLIST, DUE_GOVERNOR, DUE_SIGNAL, DUE_RATE, DUE_COUNT };
+		HNSTIME due[DUE_COUNT];
+		due[DUE_OPEN] = m_hnsOpenDone;
+		due[DUE_PREPARE] = m_hnsPrepareDone;
+		due[DUE_END] = GetEndTime();
+		due[DUE_EVENTS] = m_hnsEventsDue;
+		due[DUE_LOOP] = m_hnsLoopDue;
+		due[DUE_PLAYLIST] = m_hnsPlaylistDue;
+		due[DUE_GOVERNOR] = governor.GetDeadline();
+		due[DUE_SIGNAL] = nSignal < scenario.signals.size() ? scenario.signals[nSignal].hnsTime : -1;
+		due[DUE_RATE] = nRate < scenario.rates.size() ? scenario.rates[nRate].hnsTime : -1;
+
+		int nDue = -1;
+		for (int i = 0; i < DUE_COUNT; i++) {
+			if (due[i] >= 0 && (nDue < 0 || due[i] < due[nDue]))
+				nDue = i;
+		}
+		if (nDue < 0 || due[nDue] >= scenario.hnsLength)
+			break;
+
+		HNSTIME hnsTime = due[nDue] > m_hnsNow ? due[nDue] : m_hnsNow;
+		if (m_state == PLAYER_STATE_PLAYING)
+			m_result.hnsPlaying += hnsTime - m_hnsNow;
+		m_hnsNow = hnsTime;
+
+		switch (nDue) {
+		case DUE_OPEN:
+			// The media item is set, and played at once like MFPlay's.
+			m_hnsOpenDone = -1;
+			m_nClip = m_nOpening;
+			m_nOpening = -1;
+			m_hnsPosition = 0;
+			m_hnsPositionTime = m_hnsNow;
+			m_state = PLAYER_STATE_STOPPED;
+			PostState();
+			m_state = PLAYER_STATE_PLAYING;
+			PostState();
+			break;
+		case DUE_PREPARE:
+			m_hnsPrepareDone = -1;
+			m_nPrepared = m_nPreparing;
+			m_nPreparing = -1;
+			Post(SIM_EVENT_PREPARED);
+			break;
+		case DUE_END:
+			m_hnsPosition = 0;
+			m_hnsPositionTime = m_hnsNow;
+			m_state = PLAYER_STATE_STOPPED;
+			Post(SIM_EVENT_ENDED);
+			PostState();
+			break;
+		case DUE_EVENTS:
+			m_result.cWakeups++;
+			m_result.cEventWakeups++;
+			DispatchEvents();
+			break;
+		case DUE_LOOP:
+			m_result.cWakeups++;
+			m_result.cTimerWakeups++;
+			m_hnsLoopDue = -1;
+			controller.OnLoopTimer();
+			break;
+		case DUE_PLAYLIST:
+			m_result.cWakeups++;
+			m_result.cTimerWakeups++;
+			m_hnsPlaylistDue = -1;
+			controller.OnPlaylistTimer(m_hnsNow, GetSecondOfDay());
+			ArmPlaylistTimer();
+			break;
+		case DUE_GOVERNOR:
+			m_result.cWakeups++;
+			m_result.cTimerWakeups++;
+			if (governor.Advance(m_hnsNow))
+				ApplyGovernorMode();
+			break;
+		case DUE_SIGNAL:
+			m_result.cWakeups++;
+			m_result.cInputWakeups++;
+			if (governor.OnEvent(scenario.signals[nSignal++]))
+				ApplyGovernorMode();
+			break;
+		case DUE_RATE:
+			m_result.cWakeups++;
+			m_result.cInputWakeups++;
+			m_hnsPosition = GetCurrentPosition();
+			m_hnsPositionTime = m_hnsNow > m_hnsPositionTime ? m_hnsNow : m_hnsPositionTime;
+			m_fRate = scenario.rates[nRate++].fRate;
+			Post(SIM_EVENT_RATE);
+			PostState();
+			break;
+		}
+	}
+
+	if (m_state == PLAYER_STATE_PLAYING)
+		m_result.hnsPlaying += scenario.hnsLength - m_hnsNow;
+	m_result.hnsSimulated = scenario.hnsLength;
+	m_result.cLoops = loop.GetLoopCount();
+	m_result.cMissedLoops = loop.GetMissedCount();
+	m_result.cSwitches = playlist.GetStats().cSwitches;
+	m_result.cModeChanges = governor.GetTransitionCount();
+
+	m_pScenario = NULL;
+	m_pController = NULL;
+	m_pLoop = NULL;
+	m_pPlaylist = NULL;
+	m_pGovernor = NULL;
+	return m_result;
+}
+
+
+//********************* Player model **********************//
+
+HNSTIME SessionSimulator::GetCurrentPosition() const
+{
+	HNSTIME hnsPosition = m_hnsPosition;
+	if (m_state == PLAYER_STATE_PLAYING && m_hnsNow > m_hnsPositionTime)
+		hnsPosition += (HNSTIME)((m_hnsNow - m_hnsPositionTime) * (double)m_fRate);
+	if (m_nClip >= 0 && hnsPosition > m_pScenario->clips[m_nClip])
+		hnsPosition = m_pScenario->clips[m_nClip];
+	return hnsPosition;
+}
+
+// Time the clip playing reaches its end, -1 if it is not playing.
+HNSTIME SessionSimulator::GetEndTime() const
+{
+	if (m_state != PLAYER_STATE_PLAYING || m_nClip < 0 || m_fRate <= 0.0f)
+		return -1;
+	HNSTIME hnsStart = m_hnsPositionTime > m_hnsNow ? m_hnsPositionTime : m_hnsNow;
+	HNSTIME hnsRemaining = m_pScenario->clips[m_nClip] - GetCurrentPosition();
+	return hnsStart + (HNSTIME)(hnsRemaining / (double)m_fRate);
+}
+
+bool SessionSimulator::GetPosition(HNSTIME* phnsPosition)
+{
+	if (m_nClip < 0)
+		return false;
+	*phnsPosition = GetCurrentPosition();
+	return true;
+}
+
+bool SessionSimulator::GetDuration(HNSTIME* phnsDuration)
+{
+	if (m_nClip < 0)
+		return false;
+	*phnsDuration = m_pScenario->clips[m_nClip];
+	return true;
+}
+
+bool SessionSimulator::SeekToStart()
+{
+	if (m_nClip < 0)
+		return false;
+	m_hnsPosition = 0;
+	m_hnsPositionTime = m_hnsNow + m_pScenario->hnsSeekLatency;
+	PostState();
+	return true;
+}
+
+bool SessionSimulator::Play()
+{
+	// A clip being set plays once it is set.
+	if (m_hnsOpenDone >= 0)
+		return true;
+	if (m_nClip < 0)
+		return false;
+	if (m_state != PLAYER_STATE_PLAYING) {
+		m_state = PLAYER_STATE_PLAYING;
+		if (m_hnsPositionTime < m_hnsNow)
+			m_hnsPositionTime = m_hnsNow;
+		PostState();
+	}
+	return true;
+}
+
+bool SessionSimulator::Pause()
+{
+	if (m_nClip < 0 || m_hnsOpenDone >= 0)
+		return false;
+	if (m_state != PLAYER_STATE_PAUSED) {
+		m_hnsPosition = GetCurrentPosition();
+		m_hnsPositionTime = m_hnsNow;
+		m_state = PLAYER_STATE_PAUSED;
+		PostState();
+	}
+	return true;
+}
+
+bool SessionSimulator::Prepare(const std::wstring& path)
+{
+	int nClip = (int)wcstol(path.c_str(), NULL, 10);
+	if (nClip < 0 || (size_t)nClip >= m_pScenario->clips.size())
+		return false;
+	m_nPreparing = nClip;
+	m_nPrepared = -1;
+	m_hnsPrepareDone = m_hnsNow + m_pScenario->hnsOpenLatency;
+	return true;
+}
+
+// Setting the prepared item stops the clip playing; the new one plays
+// once its decoders have started.
+bool SessionSimulator::SwitchToPrepared()
+{
+	if (m_nPrepared < 0)
+		return false;
+	m_pController->ResetLoop();
+	m_nOpening = m_nPrepared;
+	m_nPrepared = -1;
+	m_hnsPosition = GetCurrentPosition();
+	m_state = PLAYER_STATE_STOPPED;
+	m_hnsOpenDone = m_hnsNow + m_pScenario->hnsSeekLatency;
+	return true;
+}
+
+void SessionSimulator::CancelPrepared()
+{
+	m_nPreparing = m_nPrepared = -1;
+	m_hnsPrepareDone = -1;
+}
+
+
+//********************* App model **********************//
+
+void SessionSimulator::ArmWakeup(HNSTIME hnsDelay)
+{
+	m_hnsLoopDue = m_hnsNow + (hnsDelay > 0 ? hnsDelay : 0) + GetTimerLateness();
+}
+
+HNSTIME SessionSimulator::GetTimerLateness()
+{
+	if (m_pScenario->hnsTimerLateness <= 0)
+		return 0;
+	m_nRandom = m_nRandom * 1664525 + 1013904223;
+	return (HNSTIME)((m_nRandom >> 8) % (uint32_t)(m_pScenario->hnsTimerLateness + 1));
+}
+
+// MFPlay raises an event for every change, each reporting the state.
+void SessionSimulator::PostState()
+{
+	m_fSeen |= 1ull << m_state;
+	Post(SIM_EVENT_STATE);
+}
+
+void SessionSimulator::Post(uint32_t nEvent)
+{
+	m_result.cEvents++;
+	m_fPending |= 1u << nEvent;
+	if (m_hnsEventsDue < 0)
+		m_hnsEventsDue = m_hnsNow + EVENT_LATENCY;
+}
+
+// Events posted while the batch is handled come in the next one.
+void SessionSimulator::DispatchEvents()
+{
+	uint32_t fPending = m_fPending;
+	uint64_t fSeen = m_fSeen;
+	PLAYER_STATE state = m_state;
+	m_fPending = 0;
+	m_fSeen = 0;
+	m_hnsEventsDue = -1;
+
+	if (fPending & (1u << SIM_EVENT_ENDED))
+		m_pController->OnPlaybackEnded();
+	if (fPending & (1u << SIM_EVENT_RATE))
+		m_pController->OnRateChanged();
+	if (fPending & (1u << SIM_EVENT_PREPARED)) {
+		m_pController->OnPrepared(true, m_hnsNow);
+		ArmPlaylistTimer();
+	}
+	if (fPending & (1u << SIM_EVENT_STATE))
+		m_pController->OnPlayerState(state, fSeen);
+}
+
+void SessionSimulator::ArmPlaylistTimer()
+{
+	HNSTIME hnsDelay = m_pController->GetPlaylistDelay(m_hnsNow);
+	m_hnsPlaylistDue = hnsDelay < 0 ? -1 : m_hnsNow + hnsDelay + GetTimerLateness();
+}
+
+bool SessionSimulator::IsPauseWanted()
+{
+	return m_pGovernor->GetMode() == GOVERNOR_MODE_PAUSE;
+}
+
+void SessionSimulator::ApplyGovernorMode()
+{
+	if (IsPauseWanted())
+		Pause();
+	else
+		Play();
+}
+
+int32_t SessionSimulator::GetSecondOfDay() const
+{
+	return (int32_t)((m_pScenario->nStartOfDay + m_hnsNow / HNS_PER_SECOND) % SECONDS_PER_DAY);
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include "PlaybackController.h"
+#include "PlaybackGovernor.h"
+#include <string>
+#include <vector>
+
+
+// Playback rate set by a control command at hnsTime.
+struct RatePoint
+{
+	HNSTIME		hnsTime;
+	float		fRate;
+};
+
+// Playback session to replay: a playlist of clips played for hnsLength,
+// with governor signal changes and rate commands along the way.
+struct SessionScenario
+{
+	std::string					name;
+	HNSTIME						hnsLength;			// Simulated wall-clock time
+	int32_t						nStartOfDay;		// Local second of day the session starts at
+	std::vector<HNSTIME>		clips;				// Durations of the clips
+	PlaylistConfig				playlist;
+	std::vector<GovernorEvent>	signals;			// In time order
+	std::vector<RatePoint>		rates;				// In time order
+	HNSTIME						hnsSeekLatency;		// Seek to start until playback resumes
+	HNSTIME						hnsOpenLatency;		// Opening or preparing a clip
+	HNSTIME						hnsTimerLateness;	// Timers fire up to this late
+
+	SessionScenario() : hnsLength(HNS_PER_SECOND * 3600), nStartOfDay(9 * 3600),
+		hnsSeekLatency(30 * HNS_PER_MSEC), hnsOpenLatency(200 * HNS_PER_MSEC), hnsTimerLateness(2 * HNS_PER_MSEC)
+	{
+	}
+};
+
+// Totals of one replay.
+struct SessionSimResult
+{
+	HNSTIME		hnsSimulated;
+	HNSTIME		hnsPlaying;			// Time the player was playing
+	uint64_t	cWakeups;			// Times the app's thread woke: timers, event batches, input
+	uint64_t	cTimerWakeups;
+	uint64_t	cEventWakeups;		// Batches of player events
+	uint64_t	cInputWakeups;		// Signal changes and control commands
+	uint64_t	cEvents;			// Player events posted, before coalescing
+	uint32_t	cLoops;
+	uint32_t	cMissedLoops;
+	uint32_t	cSwitches;
+	uint32_t	cModeChanges;		// Governor mode changes
+};
+
+// Sessions of hours of looping, a day of playlist rotation with the
+// screen locked overnight, and frequent pauses and rate changes.
+std::vector<SessionScenario> GetBuiltInSessions();
+
+
+//-------------------------------------------------------------------
+//
+// SessionSimulator class
+//
+// Replays a session through the app's playback logic, the playback
+// controller, loop scheduler, playlist and governor, against a modelled
+// MFPlay player in simulated time, so hours of playback take
+// milliseconds and the wakeups they cost can be counted on any machine.
+//
+// The player advances its position at the rate while playing, resumes
+// hnsSeekLatency after a seek, reaches the end of a clip unless the loop
+// wraps it first, and posts its events like MFPlay: each one with its
+// state, coalesced until the app's thread handles them. The model is
+// deterministic.
+//
+//-------------------------------------------------------------------
+
+class SessionSimulator : private IPresentationClock, private IClipPlayer, private IPlaybackTarget
+{
+public:
+	SessionSimulator();
+
+	SessionSimResult Run(const SessionScenario& scenario);
+
+private:
+	SessionSimulator(const SessionSimulator&);
+	SessionSimulator& operator=(const SessionSimulator&);
+
+	// IPresentationClock
+	bool GetPosition(HNSTIME* phnsPosition) override;
+	float GetRate() override { return m_fRate; }
+	HNSTIME GetSystemTime() override { return m_hnsNow; }
+	bool SeekToStart() override;
+	void ArmWakeup(HNSTIME hnsDelay) override;
+	void CancelWakeup() override { m_hnsLoopDue = -1; }
+
+	// IClipPlayer
+	bool Prepare(const std::wstring& path) override;
+	bool IsPrepared() override { return m_nPrepared >= 0; }
+	bool SwitchToPrepared() override;
+	void CancelPrepared() override;
+
+	// IPlaybackTarget
+	bool Play() override;
+	bool Pause() override;
+	bool GetDuration(HNSTIME* phnsDuration) override;
+	bool IsPauseWanted() override;
+	void OnFirstFrame() override {}
+	void OnClipStarted() override {}
+
+	HNSTIME GetCurrentPosition() const;
+	HNSTIME GetEndTime() const;
+	HNSTIME GetTimerLateness();
+	void PostState();
+	void Post(uint32_t nEvent);
+	void DispatchEvents();
+	void ArmPlaylistTimer();
+	void ApplyGovernorMode();
+	int32_t GetSecondOfDay() const;
+
+	const SessionScenario*	m_pScenario;
+	PlaybackController*	m_pController;
+	LoopScheduler*		m_pLoop;
+	PlaylistScheduler*	m_pPlaylist;
+	PlaybackGovernor*	m_pGovernor;
+	SessionSimResult	m_result;
+	HNSTIME				m_hnsNow;
+	uint32_t			m_nRandom;
+
+	// Player
+	PLAYER_STATE		m_state;
+	int					m_nClip;			// Clip set, -1 = none
+	HNSTIME				m_hnsPosition;		// Position at m_hnsPositionTime
+	HNSTIME				m_hnsPositionTime;	// Playback advances from here; later while seeking
+	float				m_fRate;
+	HNSTIME				m_hnsOpenDone;		// Clip being set is playing, -1 = none
+	int					m_nOpening;
+	int					m_nPreparing;		// Clip being prepared, -1 = none
+	HNSTIME				m_hnsPrepareDone;
+	int					m_nPrepared;		// Clip prepared, -1 = none
+
+	// App
+	HNSTIME				m_hnsLoopDue;		// -1 = not armed
+	HNSTIME				m_hnsPlaylistDue;
+	HNSTIME				m_hnsEventsDue;		// Batch of posted events is handled, -1 = none
+	uint32_t			m_fPending;			// Posted events not handled yet
+	uint64_t			m_fSeen;			// States posted since the last batch
+};
@@ -0,0 +1,370 @@
+#include "pch.h"
+#include "LiveWallpaper.h"
+#include "SharedFramePlayer.h"
+#include "FrameBroker.h"
+#include <chrono>
+#include <new>
+
+// Longest the present thread sleeps, which also paces lease renewals and
+// retries; and the poll interval once a frame is due but not out yet.
+static const HNSTIME SHARED_IDLE_INTERVAL = 100 * HNS_PER_MSEC;
+static const HNSTIME SHARED_POLL_INTERVAL = 2 * HNS_PER_MSEC;
+
+
+//-----------------------------------------------------------------------------
+// CreateInstance
+//-----------------------------------------------------------------------------
+
+HRESULT SharedFramePlayer::CreateInstance(PlayerEventQueue* pEvents, HWND hwndVideo, SharedFramePlayer** ppPlayer)
+{
+	SharedFramePlayer* pPlayer = new (std::nothrow)SharedFramePlayer(pEvents, hwndVideo);
+	if (!pPlayer)
+		return E_OUTOFMEMORY;
+	*ppPlayer = pPlayer;
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+SharedFramePlayer::SharedFramePlayer(PlayerEventQueue* pEvents, HWND hwndVideo) : m_cRef(1), m_pEvents(pEvents),
+m_pStats(nullptr), m_presenter(hwndVideo), m_state(MFP_MEDIAPLAYER_STATE_EMPTY), m_bRedraw(false),
+m_bFirstFrame(false), m_bStop(false), m_hnsMinInterval(0), m_hnsPosition(0), m_cSkipped(0)
+{
+	m_szVideo.cx = 0;
+	m_szVideo.cy = 0;
+	m_thread = std::thread(&SharedFramePlayer::PresentThread, this);
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+
+SharedFramePlayer::~SharedFramePlayer()
+{
+	Shutdown();
+}
+
+ULONG SharedFramePlayer::AddRef()
+{
+	return InterlockedIncrement(&m_cRef);
+}
+
+ULONG SharedFramePlayer::Release()
+{
+	ULONG uCount = InterlockedDecrement(&m_cRef);
+	if (uCount == 0)
+	{
+		delete this;
+	}
+	return uCount;
+}
+
+//-----------------------------------------------------------------------------
+// OpenRing
+//
+// Looks for the clip's ring in the global namespace, where a broker
+// serving every session puts it, then in this session's.
+//-----------------------------------------------------------------------------
+
+HRESULT SharedFramePlayer::OpenRing(const WCHAR* sURL, std::unique_ptr<SharedRing>* ppRing)
+{
+	std::unique_ptr<SharedRing> pRing(new (std::nothrow) SharedRing());
+	if (!pRing)
+		return E_OUTOFMEMORY;
+	if (!pRing->memory.Open(FrameBroker::GetRingName(sURL, true)) &&
+		!pRing->memory.Open(FrameBroker::GetRingName(sURL, false)))
+		return HRESULT_FROM_WIN32(ERROR_PIPE_NOT_CONNECTED);
+	if (!pRing->reader.Attach(pRing->memory.GetData(), pRing->memory.GetSize(), GetCurrentProcessId()) ||
+		!pRing->reader.IsWriterAlive())
+		return HRESULT_FROM_WIN32(ERROR_PIPE_NOT_CONNECTED);
+	pRing->hnsAttached = GetRingTime();
+	*ppRing = std::move(pRing);
+	return S_OK;
+}
+
+HRESULT SharedFramePlayer::OpenURL(const WCHAR* sURL)
+{
+	std::unique_ptr<SharedRing> pRing;
+	HRESULT hr = OpenRing(sURL, &pRing);
+	if (FAILED(hr))
+		return hr;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pPending = std::move(pRing);
+		m_state = MFP_MEDIAPLAYER_STATE_PLAYING;
+		m_bFirstFrame = true;
+	}
+	m_cv.notify_all();
+	return S_OK;
+}
+
+// Attaching is a few page mappings, so the clip is ready when this returns.
+HRESULT SharedFramePlayer::PrepareURL(const WCHAR* sURL)
+{
+	std::unique_ptr<SharedRing> pRing;
+	HRESULT hr = OpenRing(sURL, &pRing);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pPrepared = std::move(pRing);
+	}
+	NotifyPrepared(hr);
+	return S_OK;
+}
+
+bool SharedFramePlayer::IsPrepared()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pPrepared != nullptr;
+}
+
+HRESULT SharedFramePlayer::SwitchToPrepared()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_pPrepared)
+			return MF_E_INVALIDREQUEST;
+		m_pPending = std::move(m_pPrepared);
+		m_bFirstFrame = true;
+	}
+	m_cv.notify_all();
+	return S_OK;
+}
+
+void SharedFramePlayer::CancelPrepared()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pPrepared.reset();
+}
+
+HRESULT SharedFramePlayer::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStop = true;
+		m_state = MFP_MEDIAPLAYER_STATE_SHUTDOWN;
+		m_pPending.reset();
+		m_pPrepared.reset();
+	}
+	m_cv.notify_all();
+	if (m_thread.joinable())
+		m_thread.join();
+	m_pRing.reset();
+	return S_OK;
+}
+
+MFP_MEDIAPLAYER_STATE SharedFramePlayer::GetState() noexcept
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_state;
+}
+
+bool SharedFramePlayer::Play() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_state == MFP_MEDIAPLAYER_STATE_EMPTY || m_state == MFP_MEDIAPLAYER_STATE_SHUTDOWN)
+			return false;
+		m_state = MFP_MEDIAPLAYER_STATE_PLAYING;
+	}
+	m_cv.notify_all();
+	NotifyState(MFP_MEDIAPLAYER_STATE_PLAYING);
+	return true;
+}
+
+// The broker keeps publishing; a paused player only stops presenting.
+bool SharedFramePlayer::Pause() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_state == MFP_MEDIAPLAYER_STATE_EMPTY || m_state == MFP_MEDIAPLAYER_STATE_SHUTDOWN)
+			return false;
+		m_state = MFP_MEDIAPLAYER_STATE_PAUSED;
+	}
+	NotifyState(MFP_MEDIAPLAYER_STATE_PAUSED);
+	return true;
+}
+
+bool SharedFramePlayer::Stop() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_state == MFP_MEDIAPLAYER_STATE_EMPTY || m_state == MFP_MEDIAPLAYER_STATE_SHUTDOWN)
+			return false;
+		m_state = MFP_MEDIAPLAYER_STATE_STOPPED;
+	}
+	NotifyState(MFP_MEDIAPLAYER_STATE_STOPPED);
+	return true;
+}
+
+HRESULT SharedFramePlayer::SetMaxFrameRate(float fFps)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_hnsMinInterval = fFps > 0.0f ? (HNSTIME)(HNS_PER_SECOND / fFps) : 0;
+	return S_OK;
+}
+
+// The broker owns the clip's timeline.
+HRESULT SharedFramePlayer::CanSeek(BOOL* pbCanSeek)
+{
+	*pbCanSeek = FALSE;
+	return S_OK;
+}
+
+HRESULT SharedFramePlayer::GetCurrentPosition(MFTIME* phnsPosition)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_state == MFP_MEDIAPLAYER_STATE_EMPTY)
+		return MF_E_INVALIDREQUEST;
+	*phnsPosition = m_hnsPosition;
+	return S_OK;
+}
+
+HRESULT SharedFramePlayer::GetVideoSize(SIZE* pszVideo)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_szVideo.cx == 0)
+		return MF_E_INVALIDREQUEST;
+	*pszVideo = m_szVideo;
+	return S_OK;
+}
+
+HRESULT SharedFramePlayer::SetViewports(const Viewport* pViewports, size_t cViewports, const SIZE& szSource)
+{
+	if (szSource.cx <= 0 || szSource.cy <= 0)
+		return E_INVALIDARG;
+	m_presenter.SetViewports(pViewports, cViewports);
+	UpdateVideo();
+	return S_OK;
+}
+
+void SharedFramePlayer::UpdateVideo()
+{
+	m_presenter.Invalidate();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bRedraw = true;
+	}
+	m_cv.notify_all();
+}
+
+// The frame on screen is drawn again, with the overlay.
+HRESULT SharedFramePlayer::SetOverlay(OverlayCompositor* pOverlay)
+{
+	m_presenter.SetOverlay(pOverlay);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bRedraw = true;
+	}
+	m_cv.notify_all();
+	return S_OK;
+}
+
+
+//********************* Present thread **********************//
+
+//-----------------------------------------------------------------------------
+// PresentNext
+//
+// Scales the newest frame out of the ring into the window. A frame the
+// broker overwrote meanwhile may have shown torn pixels for one frame
+// time; the next, newer frame follows at once.
+//-----------------------------------------------------------------------------
+
+bool SharedFramePlayer::PresentNext(SharedRing* pRing, bool bRepeat)
+{
+	RingFrame ring;
+	if (!pRing->reader.BeginRead(&ring, bRepeat))
+		return false;
+
+	FrameBuffer frame = {};
+	frame.hnsTime = ring.hnsTime;
+	frame.hnsDuration = ring.hnsDuration;
+	frame.pData = (uint8_t*)ring.pData;
+	frame.cx = ring.cx;
+	frame.cy = ring.cy;
+	frame.cbStride = ring.cbStride;
+	m_presenter.Present(&frame);
+	if (!pRing->reader.EndRead(ring))
+		return false;
+
+	HNSTIME hnsNow = GetRingTime();
+	FrameRingReaderStats stats = pRing->reader.GetStats();
+	if (m_pStats && !bRepeat) {
+		m_pStats->Count(STATS_COUNTER_FRAMES_PRESENTED);
+		m_pStats->Count(STATS_COUNTER_FRAMES_DROPPED, stats.cSkipped - m_cSkipped);
+		m_pStats->Record(STATS_METRIC_PRESENT_LATENESS, hnsNow - ring.hnsPublished);
+	}
+	m_cSkipped = stats.cSkipped;
+
+	bool bFirstFrame = false;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_szVideo.cx = (LONG)ring.cx;
+		m_szVideo.cy = (LONG)ring.cy;
+		m_hnsPosition = ring.hnsTime;
+		bFirstFrame = m_bFirstFrame;
+		m_bFirstFrame = false;
+	}
+	if (bFirstFrame)
+		NotifyState(MFP_MEDIAPLAYER_STATE_PLAYING);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// PresentThread
+//
+// Sleeps until the next frame is due by the broker's schedule, then polls
+// briefly for it. The reader's lease is renewed on every pass, paused or
+// not, so the broker keeps counting this session.
+//-----------------------------------------------------------------------------
+
+void SharedFramePlayer::PresentThread()
+{
+	HNSTIME hnsShown = 0;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_bStop) {
+		if (m_pPending) {
+			m_pRing = std::move(m_pPending);
+			m_cSkipped = 0;
+			hnsShown = 0;
+		}
+		bool bPlaying = m_state == MFP_MEDIAPLAYER_STATE_PLAYING;
+		bool bRedraw = m_bRedraw;
+		m_bRedraw = false;
+		HNSTIME hnsMinInterval = m_hnsMinInterval;
+		lock.unlock();
+
+		HNSTIME hnsWait = SHARED_IDLE_INTERVAL;
+		if (m_pRing) {
+			FrameRingReader& reader = m_pRing->reader;
+			HNSTIME hnsNow = GetRingTime();
+			if (!reader.IsAttached() && hnsNow - m_pRing->hnsAttached >= SHARED_IDLE_INTERVAL) {
+				// A new broker laid the ring out for another frame size.
+				reader.Attach(m_pRing->memory.GetData(), m_pRing->memory.GetSize(), GetCurrentProcessId());
+				m_pRing->hnsAttached = hnsNow;
+			}
+			reader.Heartbeat();
+
+			if (bPlaying && hnsNow - hnsShown >= hnsMinInterval) {
+				if (PresentNext(m_pRing.get(), bRedraw))
+					hnsShown = hnsNow;
+				HNSTIME hnsDue = reader.GetNextDue();
+				if (hnsMinInterval > 0 && hnsShown + hnsMinInterval > hnsDue)
+					hnsDue = hnsShown + hnsMinInterval;
+				hnsNow = GetRingTime();
+				hnsWait = hnsDue > hnsNow ? hnsDue - hnsNow : SHARED_POLL_INTERVAL;
+				if (!reader.IsWriterAlive() || hnsWait > SHARED_IDLE_INTERVAL)
+					hnsWait = SHARED_IDLE_INTERVAL;
+			}
+			else if (bRedraw) {
+				PresentNext(m_pRing.get(), true);
+			}
+		}
+
+		lock.lock();
+		if (!m_bStop && !m_bRedraw && !m_pPending)
+			m_cv.wait_for(lock, std::chrono::microseconds(hnsWait / 10));
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "WallpaperPlayer.h"
+#include "GdiFramePresenter.h"
+#include "FrameRing.h"
+#include "FileUtil.h"
+
+
+// A shared frame ring attached for one clip.
+struct SharedRing
+{
+	SharedMemory	memory;
+	FrameRingReader	reader;
+	HNSTIME			hnsAttached;	// Last attach attempt, to retry a ring laid out anew
+};
+
+
+//-------------------------------------------------------------------
+//
+// SharedFramePlayer class
+//
+// IWallpaperPlayer that decodes nothing: it presents the frames a broker
+// process (LiveWallpaper.exe --broker) publishes for the clip into a
+// shared FrameRing, so any number of sessions on a host share one
+// decode. Frames are scaled out of the ring and drawn with GDI.
+//
+// The broker paces and loops the clip; this player follows it, so it
+// cannot seek or change the rate, and never reports the end of a clip.
+// If the broker goes away the last frame stays up until a new broker
+// takes the ring over.
+//
+//-------------------------------------------------------------------
+
+class SharedFramePlayer : public IWallpaperPlayer
+{
+public:
+	static HRESULT CreateInstance(PlayerEventQueue* pEvents, HWND hwndVideo, SharedFramePlayer** ppPlayer);
+
+	STDMETHODIMP_(ULONG) AddRef() override;
+	STDMETHODIMP_(ULONG) Release() override;
+
+	// Attaches to the ring of a clip; fails if no broker has published it.
+	HRESULT OpenURL(const WCHAR* sURL) override;
+	HRESULT OpenSource(IMFMediaSource*, const WCHAR*) override { return E_NOTIMPL; }
+
+	// The broker reads, caches and indexes the clips.
+	void SetLoopCacheBudget(size_t) override {}
+	void SetClipCache(ClipCache*) override {}
+	void SetIndexDirectory(const WCHAR*) override {}
+
+	void SetStats(PlaybackStats* pStats) override { m_pStats = pStats; }
+
+	HRESULT PrepareURL(const WCHAR* sURL) override;
+	bool IsPrepared() override;
+	HRESULT SwitchToPrepared() override;
+	void CancelPrepared() override;
+
+	HRESULT Shutdown() override;
+	MFP_MEDIAPLAYER_STATE GetState() noexcept override;
+	bool Play() noexcept override;
+	bool Pause() noexcept override;
+	bool Stop() noexcept override;
+	float GetVolume() noexcept override { return 0.0f; }
+	bool SetVolume(float fVolume) noexcept override { return fVolume == 0.0f; }
+	bool GetMute() noexcept override { return true; }
+	bool SetMute(bool bMute) noexcept override { return bMute; }
+	float GetRate() noexcept override { return 1.0f; }
+	bool SetRate(float fRate) noexcept override { return fRate == 1.0f; }
+
+	// Skips published frames to present at most fFps.
+	HRESULT SetMaxFrameRate(float fFps) override;
+
+	// Seeking
+	HRESULT GetDuration(MFTIME*) override { return MF_E_INVALIDREQUEST; }
+	HRESULT CanSeek(BOOL* pbCanSeek) override;
+	HRESULT GetCurrentPosition(MFTIME *phnsPosition) override;
+	HRESULT SetPosition(MFTIME) override { return MF_E_INVALIDREQUEST; }
+
+	// Video
+	HRESULT GetVideoSize(SIZE* pszVideo) override;
+	HRESULT SetViewports(const Viewport* pViewports, size_t cViewports, const SIZE& szSource) override;
+	void UpdateVideo() override;
+	HRESULT SetOverlay(OverlayCompositor* pOverlay) override;
+	void UpdateOverlay() override { m_presenter.PresentOverlay(); }
+
+protected:
+	SharedFramePlayer(PlayerEventQueue* pEvents, HWND hwndVideo);
+	virtual ~SharedFramePlayer();
+
+	// NotifyState: Notifies the application when the state changes.
+	void NotifyState(MFP_MEDIAPLAYER_STATE state)
+	{
+		m_pEvents->Post(PLAYER_EVENT_STATE, (uint32_t)state);
+	}
+
+	// NotifyPrepared: Notifies the application when the prepared clip is ready or failed.
+	void NotifyPrepared(HRESULT hr)
+	{
+		m_pEvents->Post(PLAYER_EVENT_PREPARED, 0, hr);
+	}
+
+private:
+	HRESULT OpenRing(const WCHAR* sURL, std::unique_ptr<SharedRing>* ppRing);
+	void PresentThread();
+	bool PresentNext(SharedRing* pRing, bool bRepeat);
+
+	long						m_cRef;			// Reference count
+	PlayerEventQueue*			m_pEvents;		// App queue to receive events.
+	PlaybackStats*				m_pStats;
+	GdiFramePresenter			m_presenter;
+
+	// Guarded by m_mutex.
+	std::mutex					m_mutex;
+	std::condition_variable		m_cv;
+	std::unique_ptr<SharedRing>	m_pPending;		// Ring for the present thread to switch to
+	std::unique_ptr<SharedRing>	m_pPrepared;
+	MFP_MEDIAPLAYER_STATE		m_state;
+	bool						m_bRedraw;		// Present the current frame again
+	bool						m_bFirstFrame;	// Report PLAYING at the next frame shown
+	bool						m_bStop;
+	HNSTIME						m_hnsMinInterval;	// From the frame rate cap, 0 = none
+	SIZE						m_szVideo;		// Of the last frame shown
+	HNSTIME						m_hnsPosition;
+
+	// Present thread only.
+	std::unique_ptr<SharedRing>	m_pRing;
+	uint64_t					m_cSkipped;		// Reader's skipped count already counted as dropped
+
+	std::thread					m_thread;
+};
@@ -0,0 +1,703 @@
+#include "SoftwarePlayer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+
+// Default decode threads: one per core, up to this many. Real-time
+// playback of a wallpaper clip never needs every core.
+static const uint32_t MAX_DECODE_THREADS = 4;
+
+// The render thread sleeps this long with nothing queued.
+static const HNSTIME RENDER_IDLE_WAIT = 100 * HNS_PER_MSEC;
+
+// Media items at a time: playing, prepared, and one replaced that a
+// decode thread still reads.
+static const size_t MEDIA_ITEM_SLOTS = 3;
+
+static uint32_t GetCoreCount()
+{
+	uint32_t cCores = std::thread::hardware_concurrency();
+	return cCores ? cCores : 1;
+}
+
+static uint32_t ThreadsForConfig(const SoftwarePlayerConfig& config)
+{
+	if (config.cDecodeThreads)
+		return config.cDecodeThreads;
+	uint32_t cCores = GetCoreCount();
+	return cCores < MAX_DECODE_THREADS ? cCores : MAX_DECODE_THREADS;
+}
+
+// Each decode thread holds a frame while it converts; the rest are the
+// queue and the shown frame.
+static uint32_t GetPoolSize(const SoftwarePlayerConfig& config)
+{
+	return ThreadsForConfig(config) + config.cQueuedFrames + 1;
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+SoftwarePlayer::SoftwarePlayer(ISoftwarePlayerHost* pHost, const SoftwarePlayerConfig& config) : m_pHost(pHost),
+	m_pool(GetPoolSize(config), 0), m_sink(&m_pool), m_arena(1024), m_items(&m_arena, MEDIA_ITEM_SLOTS),
+	m_pItem(nullptr), m_pPrepared(nullptr), m_nNextFrame(0), m_nNextTicket(0), m_nNextQueue(0), m_nEpoch(0),
+	m_nOpen(0), m_bPreparing(false), m_bOpenRequested(false), m_bEndOfStream(false), m_bStop(false),
+	m_bRedraw(false), m_bFirstFrame(false), m_bEndedSent(false), m_state(SOFTWARE_PLAYER_EMPTY), m_cbLoopCache(0)
+{
+	m_maxRate = FrameRate();
+	memset(&m_itemStats, 0, sizeof(m_itemStats));
+
+	uint32_t cThreads = ThreadsForConfig(config);
+	for (uint32_t i = 0; i < cThreads; i++)
+		m_decodeThreads.push_back(std::thread(&SoftwarePlayer::DecodeThread, this));
+	m_renderThread = std::thread(&SoftwarePlayer::RenderThread, this);
+	m_openThread = std::thread(&SoftwarePlayer::OpenThread, this);
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+
+SoftwarePlayer::~SoftwarePlayer()
+{
+	Shutdown();
+}
+
+bool SoftwarePlayer::Open(const std::wstring& path)
+{
+	MediaItem* pItem = OpenItem(path);
+	if (!pItem)
+		return false;
+	SetClip(pItem);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Prepare
+//
+// Opening indexes the whole file, which takes a read per frame; the open
+// thread does it while the current clip keeps playing. A newer request
+// replaces one the thread has not started.
+//-----------------------------------------------------------------------------
+
+void SoftwarePlayer::Prepare(const std::wstring& path)
+{
+	CancelPrepared();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bStop)
+			return;
+		m_openPath = path;
+		m_bOpenRequested = true;
+		m_bPreparing = true;
+		++m_nOpen;
+	}
+	m_cvOpen.notify_one();
+}
+
+bool SoftwarePlayer::IsPrepared()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pPrepared != nullptr;
+}
+
+bool SoftwarePlayer::SwitchToPrepared()
+{
+	MediaItem* pItem = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		pItem = m_pPrepared;
+		m_pPrepared = nullptr;
+	}
+	if (!pItem)
+		return false;
+	SetClip(pItem);
+	return true;
+}
+
+void SoftwarePlayer::CancelPrepared()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_bPreparing) {
+		m_nOpen++;		// Drops the open in flight
+		m_bPreparing = false;
+		m_bOpenRequested = false;
+	}
+	RetireItem(m_pPrepared);
+	m_pPrepared = nullptr;
+}
+
+void SoftwarePlayer::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bStop)
+			return;
+		m_bStop = true;
+		m_nOpen++;
+	}
+	m_cvDecode.notify_all();
+	m_cvTurn.notify_all();
+	m_cvOpen.notify_all();
+	m_sink.Abort();
+
+	for (size_t i = 0; i < m_decodeThreads.size(); i++)
+		m_decodeThreads[i].join();
+	m_decodeThreads.clear();
+	if (m_renderThread.joinable())
+		m_renderThread.join();
+	if (m_openThread.joinable())
+		m_openThread.join();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	RetireItem(m_pItem);
+	RetireItem(m_pPrepared);
+	m_pItem = nullptr;
+	m_pPrepared = nullptr;
+}
+
+SOFTWARE_PLAYER_STATE SoftwarePlayer::GetState()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_state;
+}
+
+bool SoftwarePlayer::Play()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bStop || !m_pItem)
+			return false;
+		m_state = SOFTWARE_PLAYER_PLAYING;
+	}
+	m_sink.Start(Now());
+	m_pHost->OnStateChanged(SOFTWARE_PLAYER_PLAYING);
+	return true;
+}
+
+bool SoftwarePlayer::Pause()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bStop || !m_pItem)
+			return false;
+		m_state = SOFTWARE_PLAYER_PAUSED;
+	}
+	m_sink.Pause(Now());
+	m_pHost->OnStateChanged(SOFTWARE_PLAYER_PAUSED);
+	return true;
+}
+
+bool SoftwarePlayer::Stop()
+{
+	m_sink.Pause(Now());
+	if (!SetPosition(0))
+		return false;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_state = SOFTWARE_PLAYER_STOPPED;
+	}
+	m_pHost->OnStateChanged(SOFTWARE_PLAYER_STOPPED);
+	return true;
+}
+
+// Frames are only decoded forward.
+bool SoftwarePlayer::SetRate(float fRate)
+{
+	if (fRate <= 0.0f)
+		return false;
+	m_sink.SetRate(fRate, Now());
+	return true;
+}
+
+void SoftwarePlayer::SetMaxFrameRate(const FrameRate& rate)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_maxRate = rate;
+	if (m_pItem) {
+		m_pacer.SetRates(m_pItem->pSource->GetFormat().rate, m_maxRate);
+		m_sink.SetRates(m_pItem->pSource->GetFormat().rate, m_maxRate);
+	}
+}
+
+bool SoftwarePlayer::GetDuration(HNSTIME* phnsDuration)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_pItem)
+		return false;
+	*phnsDuration = m_pItem->pSource->GetDuration();
+	return true;
+}
+
+bool SoftwarePlayer::GetPosition(HNSTIME* phnsPosition)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_pItem)
+			return false;
+	}
+	*phnsPosition = m_sink.GetPosition(Now());
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// SetPosition
+//
+// Any frame can be decoded directly, so a seek only moves the read
+// position; frames already taken from before the seek are dropped by the
+// sink by their epoch.
+//-----------------------------------------------------------------------------
+
+bool SoftwarePlayer::SetPosition(HNSTIME hnsPosition)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bStop || !m_pItem)
+			return false;
+		m_nNextFrame = m_pItem->pSource->GetFrameAt(hnsPosition);
+		m_nEpoch = m_sink.Flush(hnsPosition);
+		m_bEndOfStream = false;
+		m_bEndedSent = false;
+	}
+	m_cvDecode.notify_all();
+	return true;
+}
+
+bool SoftwarePlayer::GetVideoSize(uint32_t* pcx, uint32_t* pcy)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_pItem)
+		return false;
+	*pcx = m_pItem->pSource->GetFormat().cx;
+	*pcy = m_pItem->pSource->GetFormat().cy;
+	return true;
+}
+
+void SoftwarePlayer::Redraw()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bRedraw = true;
+	}
+	m_sink.Wake();
+}
+
+HNSTIME SoftwarePlayer::Now()
+{
+	return (HNSTIME)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count() * 10;
+}
+
+ArenaStats SoftwarePlayer::GetItemArenaStats()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_itemStats;
+}
+
+void SoftwarePlayer::SetLoopCacheBudget(size_t cbBudget)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cbLoopCache = cbBudget;
+}
+
+FrameStoreStats SoftwarePlayer::GetLoopCacheStats()
+{
+	FrameStoreStats stats;
+	memset(&stats, 0, sizeof(stats));
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_pItem && m_pItem->pStore) {
+		std::lock_guard<std::mutex> storeLock(m_pItem->storeMutex);
+		stats = m_pItem->pStore->GetStats();
+	}
+	return stats;
+}
+
+//-----------------------------------------------------------------------------
+// OpenItem
+//
+// The item is the caller's until it is published, so the file is opened
+// and indexed without the lock.
+//-----------------------------------------------------------------------------
+
+SoftwarePlayer::MediaItem* SoftwarePlayer::OpenItem(const std::wstring& path)
+{
+	MediaItem* pItem = nullptr;
+	size_t cbLoopCache = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bStop)
+			return nullptr;
+		pItem = m_items.New();
+		cbLoopCache = m_cbLoopCache;
+	}
+	if (!pItem)
+		return nullptr;
+
+	pItem->pSource = pItem->arena.New<Y4MSource>(&pItem->arena);
+	if (pItem->pSource && pItem->pSource->Open(path)) {
+		if (cbLoopCache > 0 && pItem->pSource->GetFrameCount() <= UINT32_MAX) {
+			pItem->pStore = pItem->arena.New<FrameStore>(cbLoopCache, FRAMESTORE_KEEP_PREFIX);
+			if (pItem->pStore)
+				pItem->pStore->SetFrameCount((uint32_t)pItem->pSource->GetFrameCount());
+		}
+		return pItem;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	RetireItem(pItem);
+	return nullptr;
+}
+
+//-----------------------------------------------------------------------------
+// RetireItem
+//
+// Called with m_mutex held. The item goes back to the pool now, or when
+// its last decode thread is done with it; its arena closes the source and
+// releases the frame table in one go.
+//-----------------------------------------------------------------------------
+
+void SoftwarePlayer::RetireItem(MediaItem* pItem)
+{
+	if (!pItem)
+		return;
+	pItem->bRetired = true;
+	if (pItem->cReaders)
+		return;
+
+	pItem->arena.Release();
+	ArenaStats stats = pItem->arena.GetStats();
+	m_itemStats.cbReserved += stats.cbReserved;
+	m_itemStats.cChunks += stats.cChunks;
+	m_itemStats.cResets += stats.cResets;
+	m_itemStats.cOverruns += stats.cOverruns;
+	m_itemStats.cLeaks += stats.cLeaks;
+	m_itemStats.cBadDeletes += stats.cBadDeletes;
+	m_items.Delete(pItem);
+}
+
+//-----------------------------------------------------------------------------
+// SetClip
+//
+// The flush drops the frames of the old clip still queued; the shown
+// frame stays until the first frame of the new clip replaces it.
+//-----------------------------------------------------------------------------
+
+void SoftwarePlayer::SetClip(MediaItem* pItem)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bStop) {
+			RetireItem(pItem);
+			return;
+		}
+		RetireItem(m_pItem);
+		m_pItem = pItem;
+		m_nNextFrame = 0;
+		m_nEpoch = m_sink.Flush(0);
+		m_pacer.SetRates(pItem->pSource->GetFormat().rate, m_maxRate);
+		m_sink.SetRates(pItem->pSource->GetFormat().rate, m_maxRate);
+		m_bEndOfStream = false;
+		m_bFirstFrame = true;
+		m_bEndedSent = false;
+		m_state = SOFTWARE_PLAYER_PLAYING;
+		m_sink.Start(Now());
+	}
+	m_cvDecode.notify_all();
+}
+
+//-----------------------------------------------------------------------------
+// DecodeThread
+//
+// Takes a free frame first and a frame number second, so every ticket
+// holder can finish without waiting on the pool. The thread reads its
+// media item outside the lock, so it counts itself as a reader and the
+// item outlives a switch until the frame is done. Frames the rate cap
+// skips are stepped over rather than decoded for the sink to drop. Frames
+// are converted in parallel and handed to the sink in ticket order; the
+// end of the stream is a ticket of its own, queued after the last frame.
+//-----------------------------------------------------------------------------
+
+void SoftwarePlayer::DecodeThread()
+{
+	std::vector<uint8_t> raw;
+
+	for (;;) {
+		FrameBuffer* pFrame = m_sink.BeginFrame();
+		if (!pFrame)
+			break;
+
+		MediaItem* pItem = nullptr;
+		uint64_t nFrame = 0, nTicket = 0;
+		uint32_t nEpoch = 0;
+		bool bEnd = false;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cvDecode.wait(lock, [this] { return m_bStop || (m_pItem && !m_bEndOfStream); });
+			if (m_bStop) {
+				lock.unlock();
+				m_sink.CancelFrame(pFrame);
+				break;
+			}
+			pItem = m_pItem;
+			pItem->cReaders++;
+			nEpoch = m_nEpoch;
+			nTicket = m_nNextTicket++;
+			nFrame = m_nNextFrame + m_pacer.GetStride(m_nNextFrame) - 1;
+			bEnd = nFrame >= pItem->pSource->GetFrameCount();
+			if (bEnd)
+				m_bEndOfStream = true;
+			else
+				m_nNextFrame = nFrame + 1;
+		}
+
+		Y4MSource* pClip = pItem->pSource;
+		bool bDecoded = false;
+		if (!bEnd) {
+			pFrame->hnsDecodeStart = Now();
+			bDecoded = DecodeFrame(pItem, nFrame, pFrame, &raw);
+			pFrame->hnsDecoded = Now();
+			pFrame->nEpoch = nEpoch;
+			pFrame->hnsTime = pClip->GetFrameTime(nFrame);
+			pFrame->hnsDuration = pClip->GetFrameTime(nFrame + 1) - pFrame->hnsTime;
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cvTurn.wait(lock, [this, nTicket] { return m_bStop || m_nNextQueue == nTicket; });
+			if (--pItem->cReaders == 0 && pItem->bRetired)
+				RetireItem(pItem);
+			if (m_bStop) {
+				lock.unlock();
+				m_sink.CancelFrame(pFrame);
+				break;
+			}
+			if (!bEnd && !bDecoded && nEpoch == m_nEpoch)
+				m_bEndOfStream = true;		// A read error ends the clip
+		}
+
+		if (bDecoded)
+			m_sink.QueueFrame(pFrame);
+		else
+			m_sink.CancelFrame(pFrame);
+		if (!bDecoded)
+			m_sink.EndOfStream(nEpoch);
+		if (!bEnd && !bDecoded)
+			m_pHost->OnError();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_nNextQueue++;
+		}
+		m_cvTurn.notify_all();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// DecodeFrame
+//
+// A frame in the loop cache is converted straight out of it; any other
+// is read and converted, and offered to the cache if it has room. The
+// cache keeps a clip's prefix and evicts nothing while the clip plays,
+// so a stored frame stays put for a decode thread holding the item, and
+// a frame it is offered is read into a buffer the cache then adopts.
+// The item's lock only covers the lookups, so decode threads share the
+// store without waiting on each other's copies.
+//-----------------------------------------------------------------------------
+
+bool SoftwarePlayer::DecodeFrame(MediaItem* pItem, uint64_t nFrame, FrameBuffer* pFrame, std::vector<uint8_t>* pRaw)
+{
+	Y4MSource* pClip = pItem->pSource;
+	const Y4MFormat& format = pClip->GetFormat();
+	size_t cbStride = (size_t)format.cx * 4;
+	size_t cbImage = cbStride * format.cy;
+	if (!m_pool.GrowFrame(pFrame, cbImage))
+		return false;
+	pFrame->cx = format.cx;
+	pFrame->cy = format.cy;
+	pFrame->cbStride = cbStride;
+
+	const uint8_t* pData = nullptr;
+	bool bOffer = false;
+	if (pItem->pStore) {
+		std::lock_guard<std::mutex> lock(pItem->storeMutex);
+		const StoredFrame* pStored = pItem->pStore->Lookup((uint32_t)nFrame);
+		if (pStored && pStored->cbData == format.cbFrame)
+			pData = pStored->pData;
+		else
+			bOffer = !pStored && pItem->pStore->HasRoom((uint32_t)nFrame, format.cbFrame);
+	}
+
+	uint8_t* pOffered = nullptr;
+	if (!pData) {
+		pOffered = bOffer ? (uint8_t*)malloc(format.cbFrame) : nullptr;
+		if (!pOffered && pRaw->size() < format.cbFrame)
+			pRaw->resize(format.cbFrame);
+		uint8_t* pRead = pOffered ? pOffered : pRaw->data();
+		if (!pClip->ReadFrame(nFrame, pRead)) {
+			free(pOffered);
+			return false;
+		}
+		pData = pRead;
+	}
+
+	YCbCrImage image;
+	pClip->GetImage(pData, &image);
+	ConvertYCbCrToBGRA(image, 0, format.cy, pFrame->pData, cbStride);
+
+	if (pOffered) {
+		std::lock_guard<std::mutex> lock(pItem->storeMutex);
+		pItem->pStore->Adopt((uint32_t)nFrame, pClip->GetFrameTime(nFrame), 0, pOffered, format.cbFrame);
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// OpenThread
+//
+// Opens the clips Prepare asks for. The path is copied into a string
+// the thread keeps, so requests reuse its buffer.
+//-----------------------------------------------------------------------------
+
+void SoftwarePlayer::OpenThread()
+{
+	std::wstring path;
+
+	for (;;) {
+		uint32_t nOpen = 0;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cvOpen.wait(lock, [this] { return m_bStop || m_bOpenRequested; });
+			if (m_bStop)
+				break;
+			path.assign(m_openPath);
+			m_bOpenRequested = false;
+			nOpen = m_nOpen;
+		}
+
+		MediaItem* pItem = OpenItem(path);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (nOpen != m_nOpen || m_bStop) {
+				RetireItem(pItem);
+				continue;
+			}
+			m_bPreparing = false;
+			m_pPrepared = pItem;
+		}
+		m_pHost->OnPrepared(pItem != nullptr);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// RenderThread
+//
+// Hands each frame to the host when it falls due and repaints on request.
+//-----------------------------------------------------------------------------
+
+void SoftwarePlayer::RenderThread()
+{
+	for (;;) {
+		bool bRedraw = false;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_bStop)
+				break;
+			bRedraw = m_bRedraw;
+			m_bRedraw = false;
+		}
+
+		FrameBuffer* pFrame = m_sink.Update(Now());
+		FrameBuffer* pShow = pFrame ? pFrame : bRedraw ? m_sink.GetCurrent() : NULL;
+		if (pShow)
+			m_pHost->PresentFrame(pShow);
+		if (pFrame) {
+			m_sink.OnPresented(Now());
+
+			bool bFirstFrame = false;
+			SOFTWARE_PLAYER_STATE state;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				bFirstFrame = m_bFirstFrame;
+				m_bFirstFrame = false;
+				state = m_state;
+			}
+			if (bFirstFrame)
+				m_pHost->OnStateChanged(state);
+		}
+
+		if (m_sink.IsEnded(Now())) {
+			bool bSend = false;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				bSend = !m_bEndedSent;
+				m_bEndedSent = true;
+			}
+			if (bSend)
+				m_pHost->OnEnded();
+		}
+
+		HNSTIME hnsNow = Now();
+		HNSTIME hnsDeadline = m_sink.GetNextDeadline(hnsNow);
+		m_sink.Wait(hnsDeadline < 0 ? RENDER_IDLE_WAIT : hnsDeadline - hnsNow);
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// RunDecodeBench
+//
+// Times the same read and conversion the player's decode threads do,
+// without the sink, so the result is the decoder's throughput alone.
+//-----------------------------------------------------------------------------
+
+bool RunDecodeBench(const std::wstring& path, uint32_t cThreads, uint32_t cPasses, DecodeBenchResult* pResult)
+{
+	Y4MSource clip;
+	if (!clip.Open(path))
+		return false;
+	if (!cThreads)
+		cThreads = GetCoreCount();
+	if (!cPasses)
+		cPasses = 1;
+
+	const Y4MFormat& format = clip.GetFormat();
+	const uint64_t cClipFrames = clip.GetFrameCount();
+	const uint64_t cFrames = cClipFrames * cPasses;
+	std::atomic<uint64_t> nNext(0);
+	std::atomic<bool> bFailed(false);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (uint32_t i = 0; i < cThreads; i++) {
+		threads.push_back(std::thread([&] {
+			std::vector<uint8_t> raw(format.cbFrame);
+			std::vector<uint8_t> pixels((size_t)format.cx * format.cy * 4);
+			for (uint64_t n = nNext++; n < cFrames; n = nNext++) {
+				if (!clip.ReadFrame(n % cClipFrames, raw.data())) {
+					bFailed = true;
+					break;
+				}
+				YCbCrImage image;
+				clip.GetImage(raw.data(), &image);
+				ConvertYCbCrToBGRA(image, 0, format.cy, pixels.data(), (size_t)format.cx * 4);
+			}
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	if (bFailed)
+		return false;
+
+	uint32_t cCores = GetCoreCount();
+	*pResult = DecodeBenchResult();
+	pResult->cFrames = cFrames;
+	pResult->cThreads = cThreads;
+	pResult->fSeconds = elapsed.count();
+	pResult->fFramesPerSecond = elapsed.count() > 0.0 ? cFrames / elapsed.count() : 0.0;
+	pResult->fFramesPerSecondPerCore = pResult->fFramesPerSecond / (cThreads < cCores ? cThreads : cCores);
+	return true;
+}
@@ -0,0 +1,214 @@
+#pragma once
+#include "Y4MSource.h"
+#include "FrameSink.h"
+#include "FrameStore.h"
+#include "Arena.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+enum SOFTWARE_PLAYER_STATE
+{
+	SOFTWARE_PLAYER_EMPTY = 0,
+	SOFTWARE_PLAYER_STOPPED,
+	SOFTWARE_PLAYER_PLAYING,
+	SOFTWARE_PLAYER_PAUSED
+};
+
+struct SoftwarePlayerConfig
+{
+	uint32_t	cDecodeThreads;		// 0 = one per core, up to 4
+	uint32_t	cQueuedFrames;		// Decoded frames waiting to be shown
+
+	SoftwarePlayerConfig() : cDecodeThreads(0), cQueuedFrames(2) {}
+};
+
+
+//-------------------------------------------------------------------
+//
+// ISoftwarePlayerHost interface
+//
+// Receives the frames and events of a SoftwarePlayer. Frames come from
+// the render thread; events may come from any of the player's threads or
+// from the control call that caused them, so hosts only record or post
+// them.
+//
+//-------------------------------------------------------------------
+
+class ISoftwarePlayerHost
+{
+public:
+	virtual ~ISoftwarePlayerHost() {}
+
+	// Shows a frame: pFrame->pData holds pFrame->cx x pFrame->cy BGRA
+	// pixels, pFrame->cbStride bytes per row. The frame stays valid until
+	// the call returns.
+	virtual void PresentFrame(const FrameBuffer* pFrame) = 0;
+
+	// The state changed; PLAYING follows the first frame of a new clip.
+	virtual void OnStateChanged(SOFTWARE_PLAYER_STATE state) = 0;
+
+	virtual void OnEnded() = 0;
+	virtual void OnError() = 0;
+	virtual void OnPrepared(bool bSucceeded) = 0;
+};
+
+
+//-------------------------------------------------------------------
+//
+// SoftwarePlayer class
+//
+// Platform-neutral player that decodes on the CPU into in-memory BGRA
+// framebuffers. Y4M frames are independent, so decode threads each take
+// the next frame, convert it in parallel and queue the frames to the
+// FrameSink in order. A render thread hands each frame to the host
+// when it is due.
+//
+// Needs no window or GPU: a host that only inspects the frames runs the
+// whole playback loop headless, including seeks, clip switches and the
+// frame rate cap.
+//
+// Each clip is a media item from a pool, and its source and frame table
+// are carved from the item's arena, so replacing a clip releases its
+// state at once when the last decode thread lets go of it. Playback and
+// looping allocate nothing once the threads' buffers have grown.
+//
+// With a loop cache budget, each clip also keeps its raw frames in a
+// FrameStore as the first pass reads them, and later passes convert the
+// stored frames instead of reading them again. Raw 4:2:0 frames take 1.5
+// bytes a pixel against the 4 of converted ones. The store keeps a
+// prefix of the clip when the whole clip does not fit.
+//
+//-------------------------------------------------------------------
+
+class SoftwarePlayer
+{
+public:
+	SoftwarePlayer(ISoftwarePlayerHost* pHost, const SoftwarePlayerConfig& config);
+	~SoftwarePlayer();
+
+	void SetStats(PlaybackStats* pStats) { m_sink.SetStats(pStats); }
+
+	// Bytes of raw frames each clip opened from now on may keep for its
+	// next passes; 0, the default, reads every pass from the file.
+	void SetLoopCacheBudget(size_t cbBudget);
+
+	// Opens a clip and plays it from the start.
+	bool Open(const std::wstring& path);
+
+	// Opens the next clip on the open thread; OnPrepared reports the result.
+	void Prepare(const std::wstring& path);
+	bool IsPrepared();
+	bool SwitchToPrepared();
+	void CancelPrepared();
+
+	// Stops the threads; the player cannot be used afterwards.
+	void Shutdown();
+
+	SOFTWARE_PLAYER_STATE GetState();
+	bool Play();
+	bool Pause();
+	bool Stop();
+	float GetRate() const { return m_sink.GetRate(); }
+	bool SetRate(float fRate);
+	void SetMaxFrameRate(const FrameRate& rate);
+
+	bool GetDuration(HNSTIME* phnsDuration);
+	bool GetPosition(HNSTIME* phnsPosition);
+	bool SetPosition(HNSTIME hnsPosition);
+	bool GetVideoSize(uint32_t* pcx, uint32_t* pcy);
+
+	// Presents the current frame again.
+	void Redraw();
+
+	uint32_t GetDecodeThreadCount() const { return (uint32_t)m_decodeThreads.size(); }
+	FrameSinkStats GetSinkStats() const { return m_sink.GetStats(); }
+
+	// Totals of the arenas of the media items released so far.
+	ArenaStats GetItemArenaStats();
+
+	// Loop cache of the playing clip; all zero without one.
+	FrameStoreStats GetLoopCacheStats();
+
+	static HNSTIME Now();
+
+private:
+	// A clip and all that was opened for it.
+	struct MediaItem
+	{
+		Arena		arena;
+		Y4MSource*	pSource;		// In arena
+		FrameStore*	pStore;			// In arena; NULL without a loop cache
+		std::mutex	storeMutex;		// Guards pStore
+		uint32_t	cReaders;		// Decode threads using the clip
+		bool		bRetired;		// Replaced; its last reader releases it
+
+		MediaItem() : pSource(nullptr), pStore(nullptr), cReaders(0), bRetired(false) {}
+	};
+
+	MediaItem* OpenItem(const std::wstring& path);
+	void RetireItem(MediaItem* pItem);
+	void SetClip(MediaItem* pItem);
+	void DecodeThread();
+	void RenderThread();
+	void OpenThread();
+	bool DecodeFrame(MediaItem* pItem, uint64_t nFrame, FrameBuffer* pFrame, std::vector<uint8_t>* pRaw);
+
+	ISoftwarePlayerHost*		m_pHost;
+	FramePool					m_pool;
+	FrameSink					m_sink;
+
+	// Guarded by m_mutex.
+	std::mutex					m_mutex;
+	std::condition_variable		m_cvDecode;		// Work for the decode threads
+	std::condition_variable		m_cvTurn;		// m_nNextQueue moved
+	std::condition_variable		m_cvOpen;		// Work for the open thread
+	Arena						m_arena;		// Slots of the media items
+	ObjectPool<MediaItem>		m_items;
+	ArenaStats					m_itemStats;	// Of the items released
+	MediaItem*					m_pItem;		// Playing
+	MediaItem*					m_pPrepared;
+	std::wstring				m_openPath;		// Next clip for the open thread
+	uint64_t					m_nNextFrame;	// Next frame to decode
+	uint64_t					m_nNextTicket;	// Decode order of the next frame taken
+	uint64_t					m_nNextQueue;	// Ticket whose frame goes to the sink next
+	uint32_t					m_nEpoch;		// Sink epoch of the current read position
+	uint32_t					m_nOpen;		// Prepare request number, to drop superseded ones
+	bool						m_bPreparing;
+	bool						m_bOpenRequested;	// m_openPath waits for the open thread
+	bool						m_bEndOfStream;	// Every frame of the clip was taken
+	bool						m_bStop;
+	bool						m_bRedraw;
+	bool						m_bFirstFrame;	// Report PLAYING at the next shown frame
+	bool						m_bEndedSent;
+	SOFTWARE_PLAYER_STATE		m_state;
+	FrameRate					m_maxRate;
+	FramePacer					m_pacer;		// The sink's rates: frames the cap skips are never read
+	size_t						m_cbLoopCache;	// Of the clips opened next, 0 = off
+
+	std::vector<std::thread>	m_decodeThreads;
+	std::thread					m_renderThread;
+	std::thread					m_openThread;
+};
+
+
+struct DecodeBenchResult
+{
+	uint64_t	cFrames;
+	uint32_t	cThreads;
+	double		fSeconds;
+	double		fFramesPerSecond;
+	double		fFramesPerSecondPerCore;
+};
+
+//-------------------------------------------------------------------
+// RunDecodeBench
+//
+// Decodes every frame of a Y4M clip cPasses times on cThreads threads
+// (0 = one per core), as fast as possible, and reports the throughput.
+// Returns false if the clip cannot be read.
+//-------------------------------------------------------------------
+
+bool RunDecodeBench(const std::wstring& path, uint32_t cThreads, uint32_t cPasses, DecodeBenchResult* pResult);
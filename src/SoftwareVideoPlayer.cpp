@@ -0,0 +1,212 @@
+#include "pch.h"
+#include "LiveWallpaper.h"
+#include "SoftwareVideoPlayer.h"
+#include <new>
+
+
+//-----------------------------------------------------------------------------
+// CreateInstance
+//-----------------------------------------------------------------------------
+
+HRESULT SoftwareVideoPlayer::CreateInstance(PlayerEventQueue* pEvents, HWND hwndVideo, SoftwareVideoPlayer** ppPlayer)
+{
+	SoftwareVideoPlayer* pPlayer = new (std::nothrow)SoftwareVideoPlayer(pEvents, hwndVideo);
+	if (!pPlayer)
+		return E_OUTOFMEMORY;
+	*ppPlayer = pPlayer;
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+SoftwareVideoPlayer::SoftwareVideoPlayer(PlayerEventQueue* pEvents, HWND hwndVideo) : m_cRef(1), m_pEvents(pEvents),
+m_pStats(nullptr), m_bShutdown(false), m_presenter(hwndVideo), m_player(this, SoftwarePlayerConfig())
+{
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+
+SoftwareVideoPlayer::~SoftwareVideoPlayer()
+{
+	m_player.Shutdown();
+}
+
+ULONG SoftwareVideoPlayer::AddRef()
+{
+	return InterlockedIncrement(&m_cRef);
+}
+
+ULONG SoftwareVideoPlayer::Release()
+{
+	ULONG uCount = InterlockedDecrement(&m_cRef);
+	if (uCount == 0)
+	{
+		delete this;
+	}
+	return uCount;
+}
+
+HRESULT SoftwareVideoPlayer::OpenURL(const WCHAR* sURL)
+{
+	return m_player.Open(sURL) ? S_OK : MF_E_UNSUPPORTED_FORMAT;
+}
+
+void SoftwareVideoPlayer::SetStats(PlaybackStats* pStats)
+{
+	m_pStats = pStats;
+	m_player.SetStats(pStats);
+}
+
+HRESULT SoftwareVideoPlayer::PrepareURL(const WCHAR* sURL)
+{
+	m_player.Prepare(sURL);
+	return S_OK;
+}
+
+HRESULT SoftwareVideoPlayer::SwitchToPrepared()
+{
+	return m_player.SwitchToPrepared() ? S_OK : MF_E_INVALIDREQUEST;
+}
+
+HRESULT SoftwareVideoPlayer::Shutdown()
+{
+	m_player.Shutdown();
+	m_bShutdown = true;
+	return S_OK;
+}
+
+MFP_MEDIAPLAYER_STATE SoftwareVideoPlayer::GetState() noexcept
+{
+	if (m_bShutdown)
+		return MFP_MEDIAPLAYER_STATE_SHUTDOWN;
+	switch (m_player.GetState()) {
+	case SOFTWARE_PLAYER_STOPPED:
+		return MFP_MEDIAPLAYER_STATE_STOPPED;
+	case SOFTWARE_PLAYER_PLAYING:
+		return MFP_MEDIAPLAYER_STATE_PLAYING;
+	case SOFTWARE_PLAYER_PAUSED:
+		return MFP_MEDIAPLAYER_STATE_PAUSED;
+	}
+	return MFP_MEDIAPLAYER_STATE_EMPTY;
+}
+
+bool SoftwareVideoPlayer::SetRate(float fRate) noexcept
+{
+	if (!m_player.SetRate(fRate))
+		return false;
+	NotifyRate();
+	return true;
+}
+
+HRESULT SoftwareVideoPlayer::SetMaxFrameRate(float fFps)
+{
+	m_player.SetMaxFrameRate(fFps > 0.0f ? FrameRateFromDouble(fFps) : FrameRate());
+	return S_OK;
+}
+
+HRESULT SoftwareVideoPlayer::GetDuration(MFTIME* phnsDuration)
+{
+	HNSTIME hnsDuration = 0;
+	if (!m_player.GetDuration(&hnsDuration))
+		return MF_E_INVALIDREQUEST;
+	*phnsDuration = hnsDuration;
+	return S_OK;
+}
+
+// Every frame of a Y4M clip can be read directly.
+HRESULT SoftwareVideoPlayer::CanSeek(BOOL* pbCanSeek)
+{
+	HNSTIME hnsDuration = 0;
+	if (!m_player.GetDuration(&hnsDuration))
+		return MF_E_INVALIDREQUEST;
+	*pbCanSeek = TRUE;
+	return S_OK;
+}
+
+HRESULT SoftwareVideoPlayer::GetCurrentPosition(MFTIME* phnsPosition)
+{
+	HNSTIME hnsPosition = 0;
+	if (!m_player.GetPosition(&hnsPosition))
+		return MF_E_INVALIDREQUEST;
+	*phnsPosition = hnsPosition;
+	return S_OK;
+}
+
+HRESULT SoftwareVideoPlayer::SetPosition(MFTIME hnsPosition)
+{
+	return m_player.SetPosition(hnsPosition) ? S_OK : MF_E_INVALIDREQUEST;
+}
+
+HRESULT SoftwareVideoPlayer::GetVideoSize(SIZE* pszVideo)
+{
+	uint32_t cx = 0, cy = 0;
+	if (!m_player.GetVideoSize(&cx, &cy))
+		return MF_E_INVALIDREQUEST;
+	pszVideo->cx = (LONG)cx;
+	pszVideo->cy = (LONG)cy;
+	return S_OK;
+}
+
+HRESULT SoftwareVideoPlayer::SetViewports(const Viewport* pViewports, size_t cViewports, const SIZE& szSource)
+{
+	if (szSource.cx <= 0 || szSource.cy <= 0)
+		return E_INVALIDARG;
+	m_presenter.SetViewports(pViewports, cViewports);
+	m_player.Redraw();
+	return S_OK;
+}
+
+void SoftwareVideoPlayer::UpdateVideo()
+{
+	m_presenter.Invalidate();
+	m_player.Redraw();
+}
+
+HRESULT SoftwareVideoPlayer::SetOverlay(OverlayCompositor* pOverlay)
+{
+	m_presenter.SetOverlay(pOverlay);
+	m_player.Redraw();
+	return S_OK;
+}
+
+
+//********************* ISoftwarePlayerHost methods **********************//
+
+void SoftwareVideoPlayer::PresentFrame(const FrameBuffer* pFrame)
+{
+	m_presenter.Present(pFrame);
+}
+
+void SoftwareVideoPlayer::OnStateChanged(SOFTWARE_PLAYER_STATE state)
+{
+	switch (state) {
+	case SOFTWARE_PLAYER_STOPPED:
+		NotifyState(MFP_MEDIAPLAYER_STATE_STOPPED);
+		break;
+	case SOFTWARE_PLAYER_PLAYING:
+		NotifyState(MFP_MEDIAPLAYER_STATE_PLAYING);
+		break;
+	case SOFTWARE_PLAYER_PAUSED:
+		NotifyState(MFP_MEDIAPLAYER_STATE_PAUSED);
+		break;
+	}
+}
+
+void SoftwareVideoPlayer::OnEnded()
+{
+	NotifyEnded();
+}
+
+void SoftwareVideoPlayer::OnError()
+{
+	NotifyError(MF_E_INVALID_FILE_FORMAT);
+}
+
+void SoftwareVideoPlayer::OnPrepared(bool bSucceeded)
+{
+	NotifyPrepared(bSucceeded ? S_OK : MF_E_UNSUPPORTED_FORMAT);
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include "WallpaperPlayer.h"
+#include "SoftwarePlayer.h"
+#include "GdiFramePresenter.h"
+
+
+//-------------------------------------------------------------------
+//
+// SoftwareVideoPlayer class
+//
+// IWallpaperPlayer over the portable SoftwarePlayer: Y4M clips decoded
+// on the CPU, scaled to each viewport with BGRAScaler and copied into
+// the video window with GDI. Needs neither Media Foundation decoders
+// nor a GPU.
+//
+// Video only; volume and mute are fixed at silent.
+//
+//-------------------------------------------------------------------
+
+class SoftwareVideoPlayer : public IWallpaperPlayer, public ISoftwarePlayerHost
+{
+public:
+	static HRESULT CreateInstance(PlayerEventQueue* pEvents, HWND hwndVideo, SoftwareVideoPlayer** ppPlayer);
+
+	STDMETHODIMP_(ULONG) AddRef() override;
+	STDMETHODIMP_(ULONG) Release() override;
+
+	HRESULT OpenURL(const WCHAR* sURL) override;
+	HRESULT OpenSource(IMFMediaSource*, const WCHAR*) override { return E_NOTIMPL; }
+
+	// Keeps raw frames for the next passes rather than file bytes.
+	void SetLoopCacheBudget(size_t cbBudget) override { m_player.SetLoopCacheBudget(cbBudget); }
+
+	void SetStats(PlaybackStats* pStats) override;
+
+	// Y4M clips are raw frames; there is nothing to transcode.
+	void SetClipCache(ClipCache*) override {}
+
+	// Every Y4M frame is a keyframe at a computed offset.
+	void SetIndexDirectory(const WCHAR*) override {}
+
+	HRESULT PrepareURL(const WCHAR* sURL) override;
+	bool IsPrepared() override { return m_player.IsPrepared(); }
+	HRESULT SwitchToPrepared() override;
+	void CancelPrepared() override { m_player.CancelPrepared(); }
+
+	HRESULT Shutdown() override;
+	MFP_MEDIAPLAYER_STATE GetState() noexcept override;
+	bool Play() noexcept override { return m_player.Play(); }
+	bool Pause() noexcept override { return m_player.Pause(); }
+	bool Stop() noexcept override { return m_player.Stop(); }
+	float GetVolume() noexcept override { return 0.0f; }
+	bool SetVolume(float fVolume) noexcept override { return fVolume == 0.0f; }
+	bool GetMute() noexcept override { return true; }
+	bool SetMute(bool bMute) noexcept override { return bMute; }
+	float GetRate() noexcept override { return m_player.GetRate(); }
+	bool SetRate(float fRate) noexcept override;
+
+	HRESULT SetMaxFrameRate(float fFps) override;
+
+	// Seeking
+	HRESULT GetDuration(MFTIME *phnsDuration) override;
+	HRESULT CanSeek(BOOL *pbCanSeek) override;
+	HRESULT GetCurrentPosition(MFTIME *phnsPosition) override;
+	HRESULT SetPosition(MFTIME hnsPosition) override;
+
+	// Video
+	HRESULT GetVideoSize(SIZE* pszVideo) override;
+	HRESULT SetViewports(const Viewport* pViewports, size_t cViewports, const SIZE& szSource) override;
+	void UpdateVideo() override;
+	HRESULT SetOverlay(OverlayCompositor* pOverlay) override;
+	void UpdateOverlay() override { m_presenter.PresentOverlay(); }
+
+	// ISoftwarePlayerHost methods
+	void PresentFrame(const FrameBuffer* pFrame) override;
+	void OnStateChanged(SOFTWARE_PLAYER_STATE state) override;
+	void OnEnded() override;
+	void OnError() override;
+	void OnPrepared(bool bSucceeded) override;
+
+protected:
+	SoftwareVideoPlayer(PlayerEventQueue* pEvents, HWND hwndVideo);
+	virtual ~SoftwareVideoPlayer();
+
+	// NotifyState: Notifies the application when the state changes.
+	void NotifyState(MFP_MEDIAPLAYER_STATE state)
+	{
+		m_pEvents->Post(PLAYER_EVENT_STATE, (uint32_t)state);
+	}
+
+	// NotifyError: Notifies the application when an error occurs.
+	void NotifyError(HRESULT hr)
+	{
+		if (m_pStats)
+			m_pStats->Count(STATS_COUNTER_PLAYER_ERRORS);
+		m_pEvents->Post(PLAYER_EVENT_ERROR, 0, hr);
+	}
+
+	// NotifyEnded: Notifies the application when playback reached the end.
+	void NotifyEnded()
+	{
+		m_pEvents->Post(PLAYER_EVENT_ENDED);
+	}
+
+	// NotifyRate: Notifies the application when the playback rate changed.
+	void NotifyRate()
+	{
+		m_pEvents->Post(PLAYER_EVENT_RATE);
+	}
+
+	// NotifyPrepared: Notifies the application when the prepared clip is ready or failed.
+	void NotifyPrepared(HRESULT hr)
+	{
+		m_pEvents->Post(PLAYER_EVENT_PREPARED, 0, hr);
+	}
+
+private:
+	long					m_cRef;			// Reference count
+	PlayerEventQueue*		m_pEvents;		// App queue to receive events.
+	PlaybackStats*			m_pStats;
+	bool					m_bShutdown;
+
+	GdiFramePresenter		m_presenter;
+	SoftwarePlayer			m_player;		// Last, so its threads stop first
+};
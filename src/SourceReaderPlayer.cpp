@@ -0,0 +1,1290 @@
+#include "pch.h"
+#include "LiveWallpaper.h"
+#include "SourceReaderPlayer.h"
+#include "ClipCache.h"
+#include "ContainerIndex.h"
+#include <mfapi.h>
+#include <math.h>
+#include <new>
+
+#pragma comment(lib, "d3d11.lib")
+#pragma comment(lib, "dxgi.lib")
+#pragma comment(lib, "mfplat.lib")
+#pragma comment(lib, "mfreadwrite.lib")
+#pragma comment(lib, "mfuuid.lib")
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Decoded samples in flight: the shown frame plus two queued. The decoder
+// allocates only a few surfaces beyond its references, so holding more
+// would stall it.
+static const uint32_t FRAME_POOL_SIZE = 3;
+
+// Frames of the next loop decoded ahead. With the shown frame they fill
+// the pool, so the tail of the clip has drained before the last one.
+static const uint32_t MAX_PREROLL_FRAMES = FRAME_POOL_SIZE - 1;
+
+// Input views are cached per decoder surface; the decoder reuses a small
+// set, so the cache is only flushed if it keeps growing.
+static const size_t MAX_INPUT_VIEWS = 64;
+
+// The render thread sleeps this long with nothing queued.
+static const HNSTIME RENDER_IDLE_WAIT = 100 * HNS_PER_MSEC;
+
+// Waits on the frame sink are only as exact as the system timer tick;
+// the last part of a wait for a deadline uses a high-resolution timer.
+static const HNSTIME COARSE_WAIT_SLACK = 20 * HNS_PER_MSEC;
+
+
+//-----------------------------------------------------------------------------
+// CreateInstance
+//
+// Creates the player and starts its decode and render threads.
+//-----------------------------------------------------------------------------
+
+HRESULT SourceReaderPlayer::CreateInstance(PlayerEventQueue* pEvents, HWND hwndVideo, SourceReaderPlayer** ppPlayer)
+{
+	HRESULT hr = S_OK;
+
+	SourceReaderPlayer* pPlayer = new (std::nothrow)SourceReaderPlayer(pEvents, hwndVideo);
+	if (!pPlayer)
+		return E_OUTOFMEMORY;
+
+	hr = pPlayer->Initialize();
+	if (SUCCEEDED(hr)) {
+		*ppPlayer = pPlayer;
+		(*ppPlayer)->AddRef();
+	}
+
+	SafeRelease(&pPlayer);
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+SourceReaderPlayer::SourceReaderPlayer(PlayerEventQueue* pEvents, HWND hwndVideo) : m_cRef(1), m_pEvents(pEvents),
+m_hwndVideo(hwndVideo), m_bStarted(false), m_cbLoopCache(0), m_pStats(nullptr), m_pClipCache(nullptr), m_pDevice(nullptr), m_pContext(nullptr),
+m_pVideoDevice(nullptr), m_pVideoContext(nullptr), m_pDeviceManager(nullptr), m_pSwapChain(nullptr), m_pTarget(nullptr),
+m_pProcessorEnum(nullptr), m_pProcessor(nullptr), m_pOutputView(nullptr), m_cxBuffer(0), m_cyBuffer(0), m_cxInput(0),
+m_cyInput(0), m_pool(FRAME_POOL_SIZE, 0), m_sink(&m_pool), m_bPreparing(false), m_bStop(false), m_bSeekPending(false),
+m_hnsSeek(0), m_nSeekEpoch(0), m_bEndOfStream(false), m_prerollState(PREROLL_NONE), m_bPrerollTaken(false), m_bRedraw(false), m_bFirstFrame(false), m_bEndedSent(false),
+m_state(MFP_MEDIAPLAYER_STATE_EMPTY), m_nOpen(0)
+{
+	m_clip = Clip();
+	m_pendingClip = Clip();
+	m_preparedClip = Clip();
+	m_maxRate = FrameRate();
+	m_szDraw = SIZE();
+
+	// A frame going back to the pool lets go of its decoder sample, which
+	// returns the surface to the decoder.
+	m_pool.SetRecycle([](FrameBuffer* pFrame) {
+		((IMFSample*)pFrame->pSurface)->Release();
+	});
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+
+SourceReaderPlayer::~SourceReaderPlayer()
+{
+	Shutdown();
+
+	ReleaseInputViews();
+	SafeRelease(&m_pOutputView);
+	SafeRelease(&m_pProcessor);
+	SafeRelease(&m_pProcessorEnum);
+	SafeRelease(&m_pTarget);
+	SafeRelease(&m_pSwapChain);
+	SafeRelease(&m_pDeviceManager);
+	SafeRelease(&m_pVideoContext);
+	SafeRelease(&m_pVideoDevice);
+	SafeRelease(&m_pContext);
+	SafeRelease(&m_pDevice);
+	if (m_bStarted)
+		MFShutdown();
+}
+
+//------------------------------------------------------------------------------
+//  Initialize
+//  Creates the D3D11 device shared with the decoder and starts the threads.
+//  The swap chain is created by the render thread with the first frame.
+//------------------------------------------------------------------------------
+
+HRESULT SourceReaderPlayer::Initialize()
+{
+	HRESULT hr = MFStartup(MF_VERSION, MFSTARTUP_LITE);
+	if (FAILED(hr))
+		return hr;
+	m_bStarted = true;
+
+	ID3D10Multithread* pMultithread = NULL;
+	UINT uToken = 0;
+
+	hr = D3D11CreateDevice(NULL, D3D_DRIVER_TYPE_HARDWARE, NULL,
+		D3D11_CREATE_DEVICE_VIDEO_SUPPORT | D3D11_CREATE_DEVICE_BGRA_SUPPORT,
+		NULL, 0, D3D11_SDK_VERSION, &m_pDevice, NULL, &m_pContext);
+
+	// The decoder and the render thread share the immediate context.
+	if (SUCCEEDED(hr))
+		hr = m_pDevice->QueryInterface(IID_PPV_ARGS(&pMultithread));
+	if (SUCCEEDED(hr))
+		pMultithread->SetMultithreadProtected(TRUE);
+	if (SUCCEEDED(hr))
+		hr = m_pDevice->QueryInterface(IID_PPV_ARGS(&m_pVideoDevice));
+	if (SUCCEEDED(hr))
+		hr = m_pContext->QueryInterface(IID_PPV_ARGS(&m_pVideoContext));
+	if (SUCCEEDED(hr))
+		hr = MFCreateDXGIDeviceManager(&uToken, &m_pDeviceManager);
+	if (SUCCEEDED(hr))
+		hr = m_pDeviceManager->ResetDevice(m_pDevice, uToken);
+
+	SafeRelease(&pMultithread);
+	if (FAILED(hr))
+		return hr;
+
+	m_decodeThread = std::thread(&SourceReaderPlayer::DecodeThread, this);
+	m_renderThread = std::thread(&SourceReaderPlayer::RenderThread, this);
+	return S_OK;
+}
+
+
+//***************************** IUnknown methods *****************************//
+
+//------------------------------------------------------------------------------
+//  AddRef
+//------------------------------------------------------------------------------
+
+ULONG SourceReaderPlayer::AddRef()
+{
+	return InterlockedIncrement(&m_cRef);
+}
+
+//------------------------------------------------------------------------------
+//  Release
+//------------------------------------------------------------------------------
+
+ULONG SourceReaderPlayer::Release()
+{
+	ULONG uCount = InterlockedDecrement(&m_cRef);
+	if (uCount == 0)
+	{
+		delete this;
+	}
+	return uCount;
+}
+
+
+//*************************** Opening clips ***************************//
+
+//-----------------------------------------------------------------------------
+// OpenURL
+//
+// Resolves and opens the clip on a helper thread; the decoder switches to
+// it once it is open, and PLAYING is notified with its first frame.
+//-----------------------------------------------------------------------------
+
+HRESULT SourceReaderPlayer::OpenURL(const WCHAR* sURL)
+{
+	StartOpen(sURL, false);
+	return S_OK;
+}
+
+HRESULT SourceReaderPlayer::OpenSource(IMFMediaSource* pSource, const WCHAR* sURL)
+{
+	Clip clip = Clip();
+	HRESULT hr = CreateClip(pSource, &clip);
+	if (FAILED(hr)) {
+		pSource->Shutdown();
+		return hr;
+	}
+	if (sURL)
+		ReadClipIndex(sURL, &clip);
+	SetPendingClip(&clip);
+	return S_OK;
+}
+
+void SourceReaderPlayer::SetIndexDirectory(const WCHAR* pszDirectory)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_indexDirectory = pszDirectory ? pszDirectory : L"";
+}
+
+//-----------------------------------------------------------------------------
+// ReadClipIndex
+//
+// From the clip's container index, if it has one: the frames of the first
+// GOP, up to what the pool can hold, if the clip starts at a keyframe,
+// and whether every frame is a keyframe. The index is built on the first
+// open of a clip and only mapped after that.
+//-----------------------------------------------------------------------------
+
+void SourceReaderPlayer::ReadClipIndex(const WCHAR* sURL, Clip* pClip)
+{
+	std::wstring directory;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		directory = m_indexDirectory;
+	}
+	pClip->cPreroll = 0;
+	pClip->bIntraOnly = false;
+	ContainerIndex index;
+	if (directory.empty() || !index.Open(sURL, ContainerIndex::GetIndexPath(directory, sURL)) || index.IsEmpty())
+		return;
+	pClip->bIntraOnly = index.GetKeyframeCount() == index.GetFrameCount();
+	if (index.StartsWithKeyframe()) {
+		uint32_t cFrames = index.GetKeyframe(0).cFrames;
+		pClip->cPreroll = cFrames < MAX_PREROLL_FRAMES ? cFrames : MAX_PREROLL_FRAMES;
+	}
+}
+
+void SourceReaderPlayer::SetStats(PlaybackStats* pStats)
+{
+	m_pStats = pStats;
+	m_sink.SetStats(pStats);
+}
+
+//-----------------------------------------------------------------------------
+// PrepareURL
+//
+// Opens the next clip while the current one keeps playing. The decoder of
+// the prepared clip is created up front, so the switch only waits for its
+// first frame.
+//-----------------------------------------------------------------------------
+
+HRESULT SourceReaderPlayer::PrepareURL(const WCHAR* sURL)
+{
+	CancelPrepared();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bPreparing = true;
+	}
+	StartOpen(sURL, true);
+	return S_OK;
+}
+
+bool SourceReaderPlayer::IsPrepared()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_preparedClip.pReader != NULL;
+}
+
+HRESULT SourceReaderPlayer::SwitchToPrepared()
+{
+	Clip clip = Clip();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_preparedClip.pReader)
+			return MF_E_INVALIDREQUEST;
+		clip = m_preparedClip;
+		m_preparedClip = Clip();
+	}
+	SetPendingClip(&clip);
+	return S_OK;
+}
+
+void SourceReaderPlayer::CancelPrepared()
+{
+	Clip clip = Clip();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bPreparing) {
+			m_nOpen++;		// Drops the open in flight
+			m_bPreparing = false;
+		}
+		clip = m_preparedClip;
+		m_preparedClip = Clip();
+	}
+	ReleaseClip(&clip);
+}
+
+//-----------------------------------------------------------------------------
+// StartOpen
+//
+// One open runs at a time; a new one waits for the previous one, whose
+// result is then dropped if the request was cancelled.
+//-----------------------------------------------------------------------------
+
+void SourceReaderPlayer::StartOpen(const WCHAR* sURL, bool bPrepare)
+{
+	if (m_openThread.joinable())
+		m_openThread.join();
+
+	uint32_t nOpen = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		nOpen = ++m_nOpen;
+	}
+
+	std::wstring url(sURL);
+	m_openThread = std::thread([this, url, bPrepare, nOpen] {
+		HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+		IMFMediaSource* pSource = NULL;
+		Clip clip = Clip();
+		std::wstring path = m_pClipCache ? m_pClipCache->Resolve(url.c_str()) : url;
+		HRESULT hr = MFPVideoPlayer::ResolveSource(path.c_str(), m_cbLoopCache, &pSource);
+		if (SUCCEEDED(hr))
+			hr = CreateClip(pSource, &clip);
+		if (SUCCEEDED(hr))
+			ReadClipIndex(path.c_str(), &clip);
+		if (FAILED(hr) && pSource)
+			pSource->Shutdown();
+		SafeRelease(&pSource);
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (nOpen != m_nOpen || m_bStop) {
+			lock.unlock();
+			ReleaseClip(&clip);
+		}
+		else if (bPrepare) {
+			m_bPreparing = false;
+			if (SUCCEEDED(hr))
+				m_preparedClip = clip;
+			NotifyPrepared(hr);
+		}
+		else if (SUCCEEDED(hr)) {
+			lock.unlock();
+			SetPendingClip(&clip);
+		}
+		else {
+			NotifyError(hr);
+		}
+		if (lock.owns_lock())
+			lock.unlock();
+
+		if (SUCCEEDED(hrCom))
+			CoUninitialize();
+	});
+}
+
+//-----------------------------------------------------------------------------
+// CreateClip
+//
+// The reader decodes the first video stream into NV12 surfaces of the
+// shared device; every other stream is deselected.
+//-----------------------------------------------------------------------------
+
+HRESULT SourceReaderPlayer::CreateClip(IMFMediaSource* pSource, Clip* pClip)
+{
+	IMFAttributes* pAttributes = NULL;
+	IMFSourceReader* pReader = NULL;
+	IMFMediaType* pType = NULL;
+	IMFMediaType* pCurrent = NULL;
+	UINT32 cx = 0, cy = 0;
+	PROPVARIANT var;
+	PropVariantInit(&var);
+
+	HRESULT hr = MFCreateAttributes(&pAttributes, 2);
+	if (SUCCEEDED(hr))
+		hr = pAttributes->SetUnknown(MF_SOURCE_READER_D3D_MANAGER, m_pDeviceManager);
+	if (SUCCEEDED(hr))
+		hr = pAttributes->SetUINT32(MF_READWRITE_ENABLE_HARDWARE_TRANSFORMS, TRUE);
+	if (SUCCEEDED(hr))
+		hr = MFCreateSourceReaderFromMediaSource(pSource, pAttributes, &pReader);
+	if (SUCCEEDED(hr))
+		hr = pReader->SetStreamSelection((DWORD)MF_SOURCE_READER_ALL_STREAMS, FALSE);
+	if (SUCCEEDED(hr))
+		hr = pReader->SetStreamSelection((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, TRUE);
+	if (SUCCEEDED(hr))
+		hr = MFCreateMediaType(&pType);
+	if (SUCCEEDED(hr))
+		hr = pType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+	if (SUCCEEDED(hr))
+		hr = pType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12);
+	if (SUCCEEDED(hr))
+		hr = pReader->SetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, NULL, pType);
+	if (SUCCEEDED(hr))
+		hr = pReader->GetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, &pCurrent);
+	if (SUCCEEDED(hr))
+		hr = MFGetAttributeSize(pCurrent, MF_MT_FRAME_SIZE, &cx, &cy);
+
+	if (SUCCEEDED(hr)) {
+		*pClip = Clip();
+		pClip->szVideo.cx = (LONG)cx;
+		pClip->szVideo.cy = (LONG)cy;
+
+		// The frame rate only drives the cap; a stream without one plays uncapped.
+		UINT32 nNum = 0, nDen = 0;
+		if (SUCCEEDED(MFGetAttributeRatio(pCurrent, MF_MT_FRAME_RATE, &nNum, &nDen))) {
+			pClip->rate.nNum = nNum;
+			pClip->rate.nDen = nDen;
+		}
+
+		if (SUCCEEDED(pReader->GetPresentationAttribute((DWORD)MF_SOURCE_READER_MEDIASOURCE, MF_PD_DURATION, &var)))
+			pClip->hnsDuration = (HNSTIME)var.uhVal.QuadPart;
+		PropVariantClear(&var);
+		if (SUCCEEDED(pReader->GetPresentationAttribute((DWORD)MF_SOURCE_READER_MEDIASOURCE,
+				MF_SOURCE_READER_MEDIASOURCE_CHARACTERISTICS, &var)))
+			pClip->caps = var.ulVal;
+		PropVariantClear(&var);
+
+		pClip->pSource = pSource;
+		pClip->pSource->AddRef();
+		pClip->pReader = pReader;
+		pClip->pReader->AddRef();
+	}
+
+	SafeRelease(&pCurrent);
+	SafeRelease(&pType);
+	SafeRelease(&pReader);
+	SafeRelease(&pAttributes);
+	return hr;
+}
+
+void SourceReaderPlayer::ReleaseClip(Clip* pClip)
+{
+	SafeRelease(&pClip->pReader);
+	if (pClip->pSource)
+		pClip->pSource->Shutdown();
+	SafeRelease(&pClip->pSource);
+}
+
+//-----------------------------------------------------------------------------
+// SetPendingClip
+//
+// Hands an open clip to the decoder. The flush drops the frames of the
+// old clip that are still queued; the shown frame stays on screen until
+// the first frame of the new clip replaces it.
+//-----------------------------------------------------------------------------
+
+void SourceReaderPlayer::SetPendingClip(Clip* pClip)
+{
+	Clip old = Clip();
+	std::vector<FrameBuffer*> preroll;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bStop) {
+			old = *pClip;
+		}
+		else {
+			old = m_pendingClip;
+			m_pendingClip = *pClip;
+			m_nSeekEpoch = m_sink.Flush(0);
+			TakePrerollLocked(&preroll);
+			m_bSeekPending = false;
+			m_bFirstFrame = true;
+			m_bEndedSent = false;
+			m_state = MFP_MEDIAPLAYER_STATE_PLAYING;
+			m_sink.Start(Now());
+		}
+		*pClip = Clip();
+	}
+	m_cvDecode.notify_all();
+	for (size_t i = 0; i < preroll.size(); i++)
+		m_sink.CancelFrame(preroll[i]);
+	ReleaseClip(&old);
+}
+
+// Hands over the pre-rolled frames and ends the pre-roll.
+void SourceReaderPlayer::TakePrerollLocked(std::vector<FrameBuffer*>* pFrames)
+{
+	pFrames->swap(m_preroll);
+	m_preroll.clear();
+	m_prerollState = PREROLL_NONE;
+	m_bPrerollTaken = false;
+}
+
+
+//*************************** Threads ***************************//
+
+//-----------------------------------------------------------------------------
+// DecodeThread
+//
+// Reads samples as fast as the pool lets it. The pool bounds how far the
+// decoder runs ahead; a seek or clip switch drops what it has queued.
+// At the end of a clip that pre-rolls, it rewinds and decodes the start
+// of the next loop. Under a rate cap, a clip of keyframes only skips the
+// frames the cap drops; any other needs them decoded as references.
+//-----------------------------------------------------------------------------
+
+void SourceReaderPlayer::DecodeThread()
+{
+	HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	uint32_t nEpoch = 0;
+
+	for (;;) {
+		IMFSourceReader* pReader = NULL;
+		Clip old = Clip();
+		bool bSeek = false;
+		HNSTIME hnsSeek = 0;
+		PREROLL_STATE preroll = PREROLL_NONE;
+		FramePacer pacer;
+		bool bIntraOnly = false;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cvDecode.wait(lock, [this] {
+				return m_bStop || m_bSeekPending || m_pendingClip.pReader ||
+					(m_clip.pReader && (!m_bEndOfStream ||
+						m_prerollState == PREROLL_REWIND || m_prerollState == PREROLL_FILLING));
+			});
+			if (m_bStop)
+				break;
+
+			if (m_pendingClip.pReader) {
+				old = m_clip;
+				m_clip = m_pendingClip;
+				m_pendingClip = Clip();
+				nEpoch = m_nSeekEpoch;
+				m_bEndOfStream = false;
+				m_pacer.SetRates(m_clip.rate, m_maxRate);
+				m_sink.SetRates(m_clip.rate, m_maxRate);
+			}
+			if (m_bSeekPending) {
+				bSeek = true;
+				hnsSeek = m_hnsSeek;
+				nEpoch = m_nSeekEpoch;
+				m_bSeekPending = false;
+				m_bEndOfStream = false;
+			}
+			if (m_bPrerollTaken) {
+				nEpoch = m_nSeekEpoch;
+				m_bPrerollTaken = false;
+			}
+			if (m_bEndOfStream)
+				preroll = m_prerollState;
+			pReader = m_clip.pReader;
+			if (pReader)
+				pReader->AddRef();
+			pacer = m_pacer;
+			bIntraOnly = m_clip.bIntraOnly;
+		}
+		ReleaseClip(&old);
+		if (!pReader)
+			continue;
+
+		if (preroll == PREROLL_REWIND) {
+			PROPVARIANT var;
+			PropVariantInit(&var);
+			var.vt = VT_I8;
+			var.hVal.QuadPart = 0;
+			HRESULT hrRewind = pReader->SetCurrentPosition(GUID_NULL, var);
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_prerollState == PREROLL_REWIND)
+				m_prerollState = SUCCEEDED(hrRewind) ? PREROLL_FILLING : PREROLL_NONE;
+		}
+		else if (preroll == PREROLL_FILLING) {
+			ReadPrerollFrame(pReader);
+		}
+		if (preroll != PREROLL_NONE) {
+			SafeRelease(&pReader);
+			continue;
+		}
+
+		HRESULT hr = S_OK;
+		if (bSeek) {
+			PROPVARIANT var;
+			PropVariantInit(&var);
+			var.vt = VT_I8;
+			var.hVal.QuadPart = hnsSeek;
+			hr = pReader->SetCurrentPosition(GUID_NULL, var);
+		}
+
+		FrameBuffer* pFrame = SUCCEEDED(hr) ? m_sink.BeginFrame() : NULL;
+		DWORD dwFlags = 0;
+		if (pFrame) {
+			IMFSample* pSample = NULL;
+			LONGLONG llTime = 0;
+			pFrame->hnsDecodeStart = Now();
+			hr = pReader->ReadSample((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, 0, NULL, &dwFlags, &llTime, &pSample);
+			pFrame->hnsDecoded = Now();
+
+			if (SUCCEEDED(hr) && pSample) {
+				LONGLONG llDuration = 0;
+				pSample->GetSampleDuration(&llDuration);
+				pFrame->nEpoch = nEpoch;
+				pFrame->hnsTime = llTime;
+				pFrame->hnsDuration = llDuration;
+				pFrame->pSurface = pSample;		// The pool's recycle callback releases it
+				m_sink.QueueFrame(pFrame);
+				if (bIntraOnly && pacer.IsDecimating())
+					SkipToPresented(pReader, pacer, pacer.GetSourceFrame(llTime) + 1);
+			}
+			else {
+				m_sink.CancelFrame(pFrame);
+			}
+		}
+
+		if (SUCCEEDED(hr) && (dwFlags & MF_SOURCE_READERF_CURRENTMEDIATYPECHANGED)) {
+			IMFMediaType* pType = NULL;
+			UINT32 cx = 0, cy = 0;
+			if (SUCCEEDED(pReader->GetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, &pType)) &&
+				SUCCEEDED(MFGetAttributeSize(pType, MF_MT_FRAME_SIZE, &cx, &cy))) {
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_clip.pReader == pReader) {
+					m_clip.szVideo.cx = (LONG)cx;
+					m_clip.szVideo.cy = (LONG)cy;
+				}
+			}
+			SafeRelease(&pType);
+		}
+
+		if (FAILED(hr) || (dwFlags & (MF_SOURCE_READERF_ENDOFSTREAM | MF_SOURCE_READERF_ERROR))) {
+			{
+				// A clip that ended cleanly can pre-roll its next loop.
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_clip.pReader == pReader && !m_bSeekPending) {
+					m_bEndOfStream = true;
+					if (SUCCEEDED(hr) && !(dwFlags & MF_SOURCE_READERF_ERROR) && m_clip.cPreroll > 0 &&
+						(m_clip.caps & MFMEDIASOURCE_CAN_SEEK) && !m_bPrerollTaken)
+						m_prerollState = PREROLL_REWIND;
+				}
+			}
+			m_sink.EndOfStream(nEpoch);
+			if (FAILED(hr))
+				NotifyError(hr);
+			else if (dwFlags & MF_SOURCE_READERF_ERROR)
+				NotifyError(E_FAIL);
+		}
+		SafeRelease(&pReader);
+	}
+
+	if (SUCCEEDED(hrCom))
+		CoUninitialize();
+}
+
+//-----------------------------------------------------------------------------
+// SkipToPresented
+//
+// Moves the reader of an all-keyframe clip from source frame nFrame on to
+// the next frame the rate cap presents, so the frames in between are
+// never decoded. The seek aims half way into the frame, so it lands on
+// it however the container rounded its timestamp. If the seek fails the
+// reader reads on and the sink drops those frames instead.
+//-----------------------------------------------------------------------------
+
+void SourceReaderPlayer::SkipToPresented(IMFSourceReader* pReader, const FramePacer& pacer, uint64_t nFrame)
+{
+	uint32_t cStride = pacer.GetStride(nFrame);
+	if (cStride <= 1)
+		return;
+	uint64_t nNext = nFrame + cStride - 1;
+	PROPVARIANT var;
+	PropVariantInit(&var);
+	var.vt = VT_I8;
+	var.hVal.QuadPart = (pacer.GetSourceTime(nNext) + pacer.GetSourceTime(nNext + 1)) / 2;
+	pReader->SetCurrentPosition(GUID_NULL, var);
+}
+
+//-----------------------------------------------------------------------------
+// ReadPrerollFrame
+//
+// Decodes one frame of the next loop and keeps it outside the sink. If
+// SetPosition(0) took the pre-roll while the frame was decoded, it is
+// the next frame of the new epoch instead; any other seek or a switch
+// drops it.
+//-----------------------------------------------------------------------------
+
+void SourceReaderPlayer::ReadPrerollFrame(IMFSourceReader* pReader)
+{
+	FrameBuffer* pFrame = m_sink.BeginFrame();
+	if (!pFrame)
+		return;
+
+	IMFSample* pSample = NULL;
+	DWORD dwFlags = 0;
+	LONGLONG llTime = 0;
+	pFrame->hnsDecodeStart = Now();
+	HRESULT hr = pReader->ReadSample((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, 0, NULL, &dwFlags, &llTime, &pSample);
+	pFrame->hnsDecoded = Now();
+	if (SUCCEEDED(hr) && pSample) {
+		LONGLONG llDuration = 0;
+		pSample->GetSampleDuration(&llDuration);
+		pFrame->hnsTime = llTime;
+		pFrame->hnsDuration = llDuration;
+		pFrame->pSurface = pSample;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		bool bEnd = FAILED(hr) || (dwFlags & (MF_SOURCE_READERF_ENDOFSTREAM | MF_SOURCE_READERF_ERROR));
+		if (pFrame->pSurface && m_clip.pReader == pReader) {
+			if (m_prerollState == PREROLL_FILLING) {
+				m_preroll.push_back(pFrame);
+				pFrame = NULL;
+			}
+			else if (m_bPrerollTaken) {
+				// Queued under the lock, so it cannot pass the pre-rolled
+				// frames SetPosition queued.
+				pFrame->nEpoch = m_nSeekEpoch;
+				m_sink.QueueFrame(pFrame);
+				pFrame = NULL;
+			}
+		}
+		if (m_prerollState == PREROLL_FILLING && (bEnd || m_preroll.size() >= m_clip.cPreroll))
+			m_prerollState = PREROLL_READY;
+	}
+	if (pFrame)
+		m_sink.CancelFrame(pFrame);
+}
+
+//-----------------------------------------------------------------------------
+// RenderThread
+//
+// Presents each frame when it falls due and repaints on request. Present
+// blocks on the vertical blank, which aligns the frames with the display.
+//-----------------------------------------------------------------------------
+
+void SourceReaderPlayer::RenderThread()
+{
+	// High-resolution timers are available from Windows 10 1803.
+	HANDLE hTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!hTimer)
+		hTimer = CreateWaitableTimerW(NULL, TRUE, NULL);
+
+	for (;;) {
+		bool bRedraw = false;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_bStop)
+				break;
+			bRedraw = m_bRedraw;
+			m_bRedraw = false;
+			m_drawViewports = m_viewports;
+			m_szDraw = m_clip.szVideo;
+		}
+
+		FrameBuffer* pFrame = m_sink.Update(Now());
+		FrameBuffer* pShow = pFrame ? pFrame : bRedraw ? m_sink.GetCurrent() : NULL;
+		if (pShow) {
+			HRESULT hr = PresentFrame(pShow);
+			if (pFrame)
+				m_sink.OnPresented(Now());
+			if (FAILED(hr)) {
+				// The device is lost or the clip cannot be drawn; the
+				// application closes the player on the error.
+				NotifyError(hr);
+				break;
+			}
+			if (pFrame) {
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_bFirstFrame) {
+					m_bFirstFrame = false;
+					NotifyState(m_state);
+				}
+			}
+		}
+
+		if (m_sink.IsEnded(Now())) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_bEndedSent) {
+				m_bEndedSent = true;
+				NotifyEnded();
+			}
+		}
+
+		HNSTIME hnsNow = Now();
+		HNSTIME hnsDeadline = m_sink.GetNextDeadline(hnsNow);
+		HNSTIME hnsWait = hnsDeadline - hnsNow;
+		if (hnsDeadline < 0)
+			m_sink.Wait(RENDER_IDLE_WAIT);
+		else if (hnsWait > COARSE_WAIT_SLACK || !hTimer)
+			m_sink.Wait(hTimer ? hnsWait - COARSE_WAIT_SLACK : hnsWait);
+		else if (hnsWait > 0) {
+			LARGE_INTEGER due;
+			due.QuadPart = -hnsWait;		// Relative, in 100 ns units
+			if (SetWaitableTimer(hTimer, &due, 0, NULL, NULL, FALSE))
+				WaitForSingleObject(hTimer, INFINITE);
+		}
+	}
+
+	if (hTimer)
+		CloseHandle(hTimer);
+}
+
+//-----------------------------------------------------------------------------
+// PresentFrame
+//
+// Converts and scales the decoder surface into the back buffer with the
+// video processor, one blit per viewport, and presents it.
+//-----------------------------------------------------------------------------
+
+HRESULT SourceReaderPlayer::PresentFrame(FrameBuffer* pFrame)
+{
+	IMFSample* pSample = (IMFSample*)pFrame->pSurface;
+	IMFMediaBuffer* pBuffer = NULL;
+	IMFDXGIBuffer* pDXGIBuffer = NULL;
+	ID3D11Texture2D* pTexture = NULL;
+	ID3D11Texture2D* pBackBuffer = NULL;
+	ID3D11VideoProcessorInputView* pInput = NULL;
+	UINT uSubresource = 0;
+	D3D11_TEXTURE2D_DESC desc;
+
+	HRESULT hr = UpdateSwapChain();
+	if (SUCCEEDED(hr))
+		hr = pSample->GetBufferByIndex(0, &pBuffer);
+
+	// A software decoder hands out system memory buffers; this player
+	// needs a hardware decoder.
+	if (SUCCEEDED(hr) && FAILED(pBuffer->QueryInterface(IID_PPV_ARGS(&pDXGIBuffer))))
+		hr = MF_E_UNSUPPORTED_D3D_TYPE;
+	if (SUCCEEDED(hr))
+		hr = pDXGIBuffer->GetResource(IID_PPV_ARGS(&pTexture));
+	if (SUCCEEDED(hr))
+		hr = pDXGIBuffer->GetSubresourceIndex(&uSubresource);
+	if (SUCCEEDED(hr)) {
+		pTexture->GetDesc(&desc);
+		hr = UpdateVideoProcessor(desc);
+	}
+	if (SUCCEEDED(hr) && !m_pOutputView) {
+		hr = m_pSwapChain->GetBuffer(0, IID_PPV_ARGS(&pBackBuffer));
+		if (SUCCEEDED(hr)) {
+			D3D11_VIDEO_PROCESSOR_OUTPUT_VIEW_DESC viewDesc = {};
+			viewDesc.ViewDimension = D3D11_VPOV_DIMENSION_TEXTURE2D;
+			hr = m_pVideoDevice->CreateVideoProcessorOutputView(pBackBuffer, m_pProcessorEnum, &viewDesc, &m_pOutputView);
+		}
+	}
+	if (SUCCEEDED(hr))
+		hr = GetInputView(pTexture, uSubresource, &pInput);
+
+	if (SUCCEEDED(hr)) {
+		const float black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		m_pContext->ClearRenderTargetView(m_pTarget, black);
+
+		D3D11_VIDEO_PROCESSOR_STREAM stream = {};
+		stream.Enable = TRUE;
+		stream.pInputSurface = pInput;
+
+		RECT rcVideo = { 0, 0, m_szDraw.cx, m_szDraw.cy };
+		if (rcVideo.right <= 0 || rcVideo.bottom <= 0)
+			SetRect(&rcVideo, 0, 0, (int)desc.Width, (int)desc.Height);
+
+		if (m_drawViewports.empty()) {
+			RECT rcDest = { 0, 0, (LONG)m_cxBuffer, (LONG)m_cyBuffer };
+			m_pVideoContext->VideoProcessorSetStreamSourceRect(m_pProcessor, 0, TRUE, &rcVideo);
+			m_pVideoContext->VideoProcessorSetStreamDestRect(m_pProcessor, 0, TRUE, &rcDest);
+			m_pVideoContext->VideoProcessorSetOutputTargetRect(m_pProcessor, FALSE, NULL);
+			hr = m_pVideoContext->VideoProcessorBlt(m_pProcessor, m_pOutputView, 0, 1, &stream);
+		}
+
+		for (size_t i = 0; i < m_drawViewports.size() && SUCCEEDED(hr); i++) {
+			const Viewport& view = m_drawViewports[i];
+			RECT rcSource = { (LONG)floor(view.rcSource.left), (LONG)floor(view.rcSource.top),
+				(LONG)ceil(view.rcSource.right), (LONG)ceil(view.rcSource.bottom) };
+			RECT rcDest = { view.rcDest.left, view.rcDest.top, view.rcDest.right, view.rcDest.bottom };
+			RECT rcBuffer = { 0, 0, (LONG)m_cxBuffer, (LONG)m_cyBuffer };
+			if (!IntersectRect(&rcSource, &rcSource, &rcVideo) || !IntersectRect(&rcDest, &rcDest, &rcBuffer))
+				continue;
+
+			// The target rect keeps each blit from clearing the others.
+			m_pVideoContext->VideoProcessorSetStreamSourceRect(m_pProcessor, 0, TRUE, &rcSource);
+			m_pVideoContext->VideoProcessorSetStreamDestRect(m_pProcessor, 0, TRUE, &rcDest);
+			m_pVideoContext->VideoProcessorSetOutputTargetRect(m_pProcessor, TRUE, &rcDest);
+			hr = m_pVideoContext->VideoProcessorBlt(m_pProcessor, m_pOutputView, 0, 1, &stream);
+		}
+	}
+
+	if (SUCCEEDED(hr))
+		hr = m_pSwapChain->Present(1, 0);
+
+	SafeRelease(&pBackBuffer);
+	SafeRelease(&pTexture);
+	SafeRelease(&pDXGIBuffer);
+	SafeRelease(&pBuffer);
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// UpdateSwapChain
+//
+// Creates the swap chain, or resizes it to the client area of the video
+// window. Flip-model presentation lets DWM show the buffer without a copy.
+//-----------------------------------------------------------------------------
+
+HRESULT SourceReaderPlayer::UpdateSwapChain()
+{
+	RECT rc;
+	GetClientRect(m_hwndVideo, &rc);
+	UINT cx = Width(rc) > 0 ? (UINT)Width(rc) : 1;
+	UINT cy = Height(rc) > 0 ? (UINT)Height(rc) : 1;
+	if (m_pSwapChain && cx == m_cxBuffer && cy == m_cyBuffer)
+		return S_OK;
+
+	SafeRelease(&m_pOutputView);
+	SafeRelease(&m_pTarget);
+
+	HRESULT hr = S_OK;
+	if (m_pSwapChain) {
+		hr = m_pSwapChain->ResizeBuffers(0, cx, cy, DXGI_FORMAT_UNKNOWN, 0);
+	}
+	else {
+		IDXGIDevice* pDXGIDevice = NULL;
+		IDXGIAdapter* pAdapter = NULL;
+		IDXGIFactory2* pFactory = NULL;
+
+		hr = m_pDevice->QueryInterface(IID_PPV_ARGS(&pDXGIDevice));
+		if (SUCCEEDED(hr))
+			hr = pDXGIDevice->GetAdapter(&pAdapter);
+		if (SUCCEEDED(hr))
+			hr = pAdapter->GetParent(IID_PPV_ARGS(&pFactory));
+		if (SUCCEEDED(hr)) {
+			DXGI_SWAP_CHAIN_DESC1 desc = {};
+			desc.Width = cx;
+			desc.Height = cy;
+			desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+			desc.SampleDesc.Count = 1;
+			desc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+			desc.BufferCount = 2;
+			desc.Scaling = DXGI_SCALING_STRETCH;
+			desc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+			desc.AlphaMode = DXGI_ALPHA_MODE_IGNORE;
+			hr = pFactory->CreateSwapChainForHwnd(m_pDevice, m_hwndVideo, &desc, NULL, NULL, &m_pSwapChain);
+
+			// FLIP_DISCARD is new in Windows 10.
+			if (FAILED(hr)) {
+				desc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
+				hr = pFactory->CreateSwapChainForHwnd(m_pDevice, m_hwndVideo, &desc, NULL, NULL, &m_pSwapChain);
+			}
+		}
+
+		SafeRelease(&pFactory);
+		SafeRelease(&pAdapter);
+		SafeRelease(&pDXGIDevice);
+	}
+	if (FAILED(hr))
+		return hr;
+
+	m_cxBuffer = cx;
+	m_cyBuffer = cy;
+
+	ID3D11Texture2D* pBackBuffer = NULL;
+	hr = m_pSwapChain->GetBuffer(0, IID_PPV_ARGS(&pBackBuffer));
+	if (SUCCEEDED(hr))
+		hr = m_pDevice->CreateRenderTargetView(pBackBuffer, NULL, &m_pTarget);
+	SafeRelease(&pBackBuffer);
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// UpdateVideoProcessor
+//
+// (Re)creates the video processor when the decoded surface size changes.
+//-----------------------------------------------------------------------------
+
+HRESULT SourceReaderPlayer::UpdateVideoProcessor(const D3D11_TEXTURE2D_DESC& desc)
+{
+	if (m_pProcessor && desc.Width == m_cxInput && desc.Height == m_cyInput)
+		return S_OK;
+
+	ReleaseInputViews();
+	SafeRelease(&m_pOutputView);
+	SafeRelease(&m_pProcessor);
+	SafeRelease(&m_pProcessorEnum);
+
+	FrameRate rate;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		rate = m_clip.rate;
+	}
+
+	D3D11_VIDEO_PROCESSOR_CONTENT_DESC content = {};
+	content.InputFrameFormat = D3D11_VIDEO_FRAME_FORMAT_PROGRESSIVE;
+	content.InputFrameRate.Numerator = rate.nNum;
+	content.InputFrameRate.Denominator = rate.nDen;
+	content.InputWidth = desc.Width;
+	content.InputHeight = desc.Height;
+	content.OutputFrameRate = content.InputFrameRate;
+	content.OutputWidth = m_cxBuffer;
+	content.OutputHeight = m_cyBuffer;
+	content.Usage = D3D11_VIDEO_USAGE_PLAYBACK_NORMAL;
+
+	HRESULT hr = m_pVideoDevice->CreateVideoProcessorEnumerator(&content, &m_pProcessorEnum);
+	if (SUCCEEDED(hr))
+		hr = m_pVideoDevice->CreateVideoProcessor(m_pProcessorEnum, 0, &m_pProcessor);
+	if (FAILED(hr))
+		return hr;
+
+	m_cxInput = desc.Width;
+	m_cyInput = desc.Height;
+
+	// Studio range YCbCr in, full range RGB out; HD clips use BT.709.
+	D3D11_VIDEO_PROCESSOR_COLOR_SPACE inputSpace = {};
+	inputSpace.YCbCr_Matrix = m_cyInput >= 720 ? 1 : 0;
+	inputSpace.Nominal_Range = D3D11_VIDEO_PROCESSOR_NOMINAL_RANGE_16_235;
+	D3D11_VIDEO_PROCESSOR_COLOR_SPACE outputSpace = {};
+	outputSpace.Nominal_Range = D3D11_VIDEO_PROCESSOR_NOMINAL_RANGE_0_255;
+	m_pVideoContext->VideoProcessorSetStreamColorSpace(m_pProcessor, 0, &inputSpace);
+	m_pVideoContext->VideoProcessorSetOutputColorSpace(m_pProcessor, &outputSpace);
+	m_pVideoContext->VideoProcessorSetStreamAutoProcessingMode(m_pProcessor, 0, FALSE);
+	m_pVideoContext->VideoProcessorSetStreamFrameFormat(m_pProcessor, 0, D3D11_VIDEO_FRAME_FORMAT_PROGRESSIVE);
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// GetInputView
+//
+// Returns the cached input view of a decoder surface; the view stays
+// owned by the cache.
+//-----------------------------------------------------------------------------
+
+HRESULT SourceReaderPlayer::GetInputView(ID3D11Texture2D* pTexture, UINT uSubresource, ID3D11VideoProcessorInputView** ppView)
+{
+	for (size_t i = 0; i < m_inputViews.size(); i++) {
+		if (m_inputViews[i].pTexture == pTexture && m_inputViews[i].uSubresource == uSubresource) {
+			*ppView = m_inputViews[i].pView;
+			return S_OK;
+		}
+	}
+
+	if (m_inputViews.size() >= MAX_INPUT_VIEWS)
+		ReleaseInputViews();
+
+	D3D11_VIDEO_PROCESSOR_INPUT_VIEW_DESC viewDesc = {};
+	viewDesc.ViewDimension = D3D11_VPIV_DIMENSION_TEXTURE2D;
+	viewDesc.Texture2D.ArraySlice = uSubresource;
+
+	InputView view;
+	view.pTexture = pTexture;
+	view.uSubresource = uSubresource;
+	view.pView = NULL;
+	HRESULT hr = m_pVideoDevice->CreateVideoProcessorInputView(pTexture, m_pProcessorEnum, &viewDesc, &view.pView);
+	if (FAILED(hr))
+		return hr;
+
+	view.pTexture->AddRef();
+	m_inputViews.push_back(view);
+	*ppView = view.pView;
+	return S_OK;
+}
+
+void SourceReaderPlayer::ReleaseInputViews()
+{
+	for (size_t i = 0; i < m_inputViews.size(); i++) {
+		SafeRelease(&m_inputViews[i].pView);
+		SafeRelease(&m_inputViews[i].pTexture);
+	}
+	m_inputViews.clear();
+}
+
+// System time in 100 ns units, the same scale as MFPLoopClock.
+HNSTIME SourceReaderPlayer::Now()
+{
+	static LARGE_INTEGER freq = {};
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart / freq.QuadPart * HNS_PER_SECOND +
+		now.QuadPart % freq.QuadPart * HNS_PER_SECOND / freq.QuadPart;
+}
+
+
+//*************************** Playback control ***************************//
+
+//-----------------------------------------------------------------------------
+// Shutdown
+//
+// Stops the threads and shuts the sources down. The D3D objects are
+// released with the player.
+//-----------------------------------------------------------------------------
+
+HRESULT SourceReaderPlayer::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bStop)
+			return S_OK;
+		m_bStop = true;
+		m_nOpen++;
+		m_state = MFP_MEDIAPLAYER_STATE_SHUTDOWN;
+	}
+	m_cvDecode.notify_all();
+	m_sink.Abort();
+
+	if (m_openThread.joinable())
+		m_openThread.join();
+	if (m_decodeThread.joinable())
+		m_decodeThread.join();
+	if (m_renderThread.joinable())
+		m_renderThread.join();
+
+	std::vector<FrameBuffer*> preroll;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		TakePrerollLocked(&preroll);
+	}
+	for (size_t i = 0; i < preroll.size(); i++)
+		m_sink.CancelFrame(preroll[i]);
+	ReleaseClip(&m_clip);
+	ReleaseClip(&m_pendingClip);
+	ReleaseClip(&m_preparedClip);
+	return S_OK;
+}
+
+MFP_MEDIAPLAYER_STATE SourceReaderPlayer::GetState() noexcept
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_state;
+}
+
+bool SourceReaderPlayer::Play() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bStop || (!m_clip.pReader && !m_pendingClip.pReader))
+			return false;
+		m_state = MFP_MEDIAPLAYER_STATE_PLAYING;
+	}
+	m_sink.Start(Now());
+	NotifyState(MFP_MEDIAPLAYER_STATE_PLAYING);
+	return true;
+}
+
+bool SourceReaderPlayer::Pause() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bStop || (!m_clip.pReader && !m_pendingClip.pReader))
+			return false;
+		m_state = MFP_MEDIAPLAYER_STATE_PAUSED;
+	}
+	m_sink.Pause(Now());
+	NotifyState(MFP_MEDIAPLAYER_STATE_PAUSED);
+	return true;
+}
+
+bool SourceReaderPlayer::Stop() noexcept
+{
+	m_sink.Pause(Now());
+	if (FAILED(SetPosition(0)))
+		return false;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_state = MFP_MEDIAPLAYER_STATE_STOPPED;
+	}
+	NotifyState(MFP_MEDIAPLAYER_STATE_STOPPED);
+	return true;
+}
+
+float SourceReaderPlayer::GetRate() noexcept
+{
+	return m_sink.GetRate();
+}
+
+// Reverse playback is not supported; the reader only decodes forward.
+bool SourceReaderPlayer::SetRate(float fRate) noexcept
+{
+	if (fRate <= 0.0f)
+		return false;
+	m_sink.SetRate(fRate, Now());
+	NotifyRate();
+	return true;
+}
+
+HRESULT SourceReaderPlayer::SetMaxFrameRate(float fFps)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_maxRate = fFps > 0.0f ? FrameRateFromDouble(fFps) : FrameRate();
+	m_pacer.SetRates(m_clip.rate, m_maxRate);
+	m_sink.SetRates(m_clip.rate, m_maxRate);
+	return S_OK;
+}
+
+HRESULT SourceReaderPlayer::GetDuration(MFTIME* phnsDuration)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_clip.pReader)
+		return MF_E_INVALIDREQUEST;
+	*phnsDuration = m_clip.hnsDuration;
+	return S_OK;
+}
+
+HRESULT SourceReaderPlayer::CanSeek(BOOL* pbCanSeek)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_clip.pReader)
+		return MF_E_INVALIDREQUEST;
+	*pbCanSeek = (m_clip.caps & MFMEDIASOURCE_CAN_SEEK) && !(m_clip.caps & MFMEDIASOURCE_HAS_SLOW_SEEK);
+	return S_OK;
+}
+
+HRESULT SourceReaderPlayer::GetCurrentPosition(MFTIME* phnsPosition)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_clip.pReader)
+			return MF_E_INVALIDREQUEST;
+	}
+	*phnsPosition = m_sink.GetPosition(Now());
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// SetPosition
+//
+// The sink drops the queued frames at once; the decoder seeks before its
+// next read. The shown frame stays until the first one after the seek.
+//
+// A loop to the start with the next loop pre-rolled needs no seek: the
+// pre-rolled frames are queued in the new epoch and the decoder, already
+// past them, goes on reading.
+//-----------------------------------------------------------------------------
+
+HRESULT SourceReaderPlayer::SetPosition(MFTIME hnsPosition)
+{
+	std::vector<FrameBuffer*> preroll;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bStop || (!m_clip.pReader && !m_pendingClip.pReader))
+			return MF_E_INVALIDREQUEST;
+		bool bLoop = hnsPosition == 0 && !m_pendingClip.pReader && !m_preroll.empty() &&
+			(m_prerollState == PREROLL_FILLING || m_prerollState == PREROLL_READY);
+		m_nSeekEpoch = m_sink.Flush(hnsPosition);
+		m_bEndedSent = false;
+		TakePrerollLocked(&preroll);
+		if (bLoop) {
+			for (size_t i = 0; i < preroll.size(); i++) {
+				preroll[i]->nEpoch = m_nSeekEpoch;
+				m_sink.QueueFrame(preroll[i]);
+			}
+			preroll.clear();
+			m_bPrerollTaken = true;
+			m_bSeekPending = false;
+			m_bEndOfStream = false;
+		}
+		else {
+			m_hnsSeek = hnsPosition;
+			m_bSeekPending = true;
+		}
+	}
+	m_cvDecode.notify_all();
+	for (size_t i = 0; i < preroll.size(); i++)
+		m_sink.CancelFrame(preroll[i]);
+	return S_OK;
+}
+
+HRESULT SourceReaderPlayer::GetVideoSize(SIZE* pszVideo)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_clip.pReader)
+		return MF_E_INVALIDREQUEST;
+	*pszVideo = m_clip.szVideo;
+	return S_OK;
+}
+
+HRESULT SourceReaderPlayer::SetViewports(const Viewport* pViewports, size_t cViewports, const SIZE& szSource)
+{
+	if (szSource.cx <= 0 || szSource.cy <= 0)
+		return E_INVALIDARG;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_viewports.assign(pViewports, pViewports + cViewports);
+		m_bRedraw = true;
+	}
+	m_sink.Wake();
+	return S_OK;
+}
+
+void SourceReaderPlayer::UpdateVideo()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bRedraw = true;
+	}
+	m_sink.Wake();
+}
@@ -0,0 +1,243 @@
+#pragma once
+#include <d3d11.h>
+#include <dxgi1_2.h>
+#include <mfidl.h>
+#include <mfreadwrite.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MFPVideoPlayer.h"
+#include "FrameSink.h"
+
+
+//-------------------------------------------------------------------
+//
+// SourceReaderPlayer class
+//
+// IWallpaperPlayer without MFPlay's presenter. A source reader decodes on the GPU into D3D11 surfaces; the
+// decoded samples wait in a FrameSink until they are due, and a video
+// processor blit converts and scales each one straight into the back
+// buffer of a flip-model swap chain. No frame passes through system
+// memory and no buffer is allocated per frame.
+//
+// Decoding and presenting run on threads of their own. Events are posted
+// to the app's PlayerEventQueue as PLAYER_EVENT_* records.
+// Video only: the audio stream is not read.
+//
+//-------------------------------------------------------------------
+
+class SourceReaderPlayer : public IWallpaperPlayer
+{
+public:
+	static HRESULT CreateInstance(PlayerEventQueue* pEvents, HWND hwndVideo, SourceReaderPlayer** ppPlayer);
+
+	STDMETHODIMP_(ULONG) AddRef() override;
+	STDMETHODIMP_(ULONG) Release() override;
+
+	// Opens the clip on a helper thread and plays it once it is open.
+	HRESULT OpenURL(const WCHAR* sURL) override;
+
+	// Plays a source from MFPVideoPlayer::ResolveSource. The player shuts
+	// it down once another clip is set or the player shuts down.
+	HRESULT OpenSource(IMFMediaSource* pSource, const WCHAR* sURL) override;
+
+	void SetLoopCacheBudget(size_t cbBudget) override { m_cbLoopCache = cbBudget; }
+
+	// Optional collector of decode times, frame lateness and errors.
+	void SetStats(PlaybackStats* pStats) override;
+	void SetClipCache(ClipCache* pCache) override { m_pClipCache = pCache; }
+
+	// With an index showing the clip starts at a keyframe, the decoder
+	// rewinds as soon as it reaches the end and decodes the first frames
+	// of the next loop while the last ones play; SetPosition(0) then
+	// queues them without a flush or a decoder restart.
+	void SetIndexDirectory(const WCHAR* pszDirectory) override;
+
+	// Prepared clip: opened in the background while the current one keeps
+	// playing, then swapped in with SwitchToPrepared.
+	HRESULT PrepareURL(const WCHAR* sURL) override;
+	bool IsPrepared() override;
+	HRESULT SwitchToPrepared() override;
+	void CancelPrepared() override;
+
+	HRESULT Shutdown() override;
+	MFP_MEDIAPLAYER_STATE GetState() noexcept override;
+	bool Play() noexcept override;
+	bool Pause() noexcept override;
+	bool Stop() noexcept override;
+	float GetVolume() noexcept override { return 0.0f; }
+	bool SetVolume(float fVolume) noexcept override { return fVolume == 0.0f; }
+	bool GetMute() noexcept override { return true; }
+	bool SetMute(bool bMute) noexcept override { return bMute; }
+	float GetRate() noexcept override;
+	bool SetRate(float fRate) noexcept override;
+
+	// Frame rate cap, 0 = none. Frames the cap skips are decoded but
+	// never converted or presented.
+	HRESULT SetMaxFrameRate(float fFps) override;
+
+	// Seeking
+	HRESULT GetDuration(MFTIME *phnsDuration) override;
+	HRESULT CanSeek(BOOL *pbCanSeek) override;
+	HRESULT GetCurrentPosition(MFTIME *phnsPosition) override;
+	HRESULT SetPosition(MFTIME hnsPosition) override;
+
+	// Video
+	HRESULT GetVideoSize(SIZE* pszVideo) override;
+
+	// Every viewport is drawn from the same decoded frame, one blit each.
+	HRESULT SetViewports(const Viewport* pViewports, size_t cViewports, const SIZE& szSource) override;
+
+	// Presents the current frame again, e.g. after the window was resized.
+	void UpdateVideo() override;
+
+	// Frames go from the decoder to the swap chain on the GPU, out of reach
+	// of an overlay.
+	HRESULT SetOverlay(OverlayCompositor* pOverlay) override { return pOverlay ? E_NOTIMPL : S_OK; }
+	void UpdateOverlay() override {}
+
+protected:
+	SourceReaderPlayer(PlayerEventQueue* pEvents, HWND hwndVideo);
+	virtual ~SourceReaderPlayer();
+
+	// A source and the reader decoding it.
+	struct Clip
+	{
+		IMFMediaSource*		pSource;
+		IMFSourceReader*	pReader;
+		SIZE				szVideo;
+		FrameRate			rate;
+		HNSTIME				hnsDuration;
+		ULONG				caps;		// MFMEDIASOURCE_CHARACTERISTICS
+		uint32_t			cPreroll;	// Frames to decode ahead for the next loop, 0 = none
+		bool				bIntraOnly;	// Every frame a keyframe: frames the cap skips are seeked over
+	};
+
+	enum PREROLL_STATE
+	{
+		PREROLL_NONE = 0,
+		PREROLL_REWIND,		// At the end; the reader goes back to the start next
+		PREROLL_FILLING,	// Decoding the first frames of the next loop
+		PREROLL_READY		// Holding them for SetPosition(0)
+	};
+
+	struct InputView
+	{
+		ID3D11Texture2D*					pTexture;
+		UINT								uSubresource;
+		ID3D11VideoProcessorInputView*		pView;
+	};
+
+	HRESULT Initialize();
+	HRESULT CreateClip(IMFMediaSource* pSource, Clip* pClip);
+	static void ReleaseClip(Clip* pClip);
+	void StartOpen(const WCHAR* sURL, bool bPrepare);
+	void ReadClipIndex(const WCHAR* sURL, Clip* pClip);
+	void SetPendingClip(Clip* pClip);
+	void DecodeThread();
+	void ReadPrerollFrame(IMFSourceReader* pReader);
+	static void SkipToPresented(IMFSourceReader* pReader, const FramePacer& pacer, uint64_t nFrame);
+	void TakePrerollLocked(std::vector<FrameBuffer*>* pFrames);
+	void RenderThread();
+	HRESULT PresentFrame(FrameBuffer* pFrame);
+	HRESULT UpdateSwapChain();
+	HRESULT UpdateVideoProcessor(const D3D11_TEXTURE2D_DESC& desc);
+	HRESULT GetInputView(ID3D11Texture2D* pTexture, UINT uSubresource, ID3D11VideoProcessorInputView** ppView);
+	void ReleaseInputViews();
+	static HNSTIME Now();
+
+	// NotifyState: Notifies the application when the state changes.
+	void NotifyState(MFP_MEDIAPLAYER_STATE state)
+	{
+		m_pEvents->Post(PLAYER_EVENT_STATE, (uint32_t)state);
+	}
+
+	// NotifyError: Notifies the application when an error occurs.
+	void NotifyError(HRESULT hr)
+	{
+		if (m_pStats)
+			m_pStats->Count(STATS_COUNTER_PLAYER_ERRORS);
+		m_pEvents->Post(PLAYER_EVENT_ERROR, 0, hr);
+	}
+
+	// NotifyEnded: Notifies the application when playback reached the end.
+	void NotifyEnded()
+	{
+		m_pEvents->Post(PLAYER_EVENT_ENDED);
+	}
+
+	// NotifyRate: Notifies the application when the playback rate changed.
+	void NotifyRate()
+	{
+		m_pEvents->Post(PLAYER_EVENT_RATE);
+	}
+
+	// NotifyPrepared: Notifies the application when the prepared clip is ready or failed.
+	void NotifyPrepared(HRESULT hr)
+	{
+		m_pEvents->Post(PLAYER_EVENT_PREPARED, 0, hr);
+	}
+
+private:
+	long					m_cRef;			// Reference count
+	PlayerEventQueue*		m_pEvents;		// App queue to receive events.
+	HWND					m_hwndVideo;
+	bool					m_bStarted;		// MFStartup succeeded
+	size_t					m_cbLoopCache;	// Loop cache budget, 0 = off
+	PlaybackStats*			m_pStats;
+	ClipCache*				m_pClipCache;
+	std::wstring			m_indexDirectory;	// Empty = no container indexes
+
+	// Direct3D, used by the render thread and, through the device
+	// manager, by the decoder.
+	ID3D11Device*						m_pDevice;
+	ID3D11DeviceContext*				m_pContext;
+	ID3D11VideoDevice*					m_pVideoDevice;
+	ID3D11VideoContext*					m_pVideoContext;
+	IMFDXGIDeviceManager*				m_pDeviceManager;
+	IDXGISwapChain1*					m_pSwapChain;
+	ID3D11RenderTargetView*				m_pTarget;
+	ID3D11VideoProcessorEnumerator*		m_pProcessorEnum;
+	ID3D11VideoProcessor*				m_pProcessor;
+	ID3D11VideoProcessorOutputView*		m_pOutputView;
+	std::vector<InputView>				m_inputViews;	// Views of the decoder's surfaces
+	UINT								m_cxBuffer;		// Swap chain size
+	UINT								m_cyBuffer;
+	UINT								m_cxInput;		// Video processor input size
+	UINT								m_cyInput;
+	std::vector<Viewport>				m_drawViewports;
+	SIZE								m_szDraw;		// Video size the viewports refer to
+
+	FramePool				m_pool;
+	FrameSink				m_sink;
+
+	// Shared with the threads, guarded by m_mutex.
+	std::mutex				m_mutex;
+	std::condition_variable	m_cvDecode;
+	Clip					m_clip;			// Clip being decoded
+	Clip					m_pendingClip;	// Clip the decoder switches to next
+	Clip					m_preparedClip;
+	bool					m_bPreparing;
+	bool					m_bStop;
+	bool					m_bSeekPending;
+	HNSTIME					m_hnsSeek;
+	uint32_t				m_nSeekEpoch;	// Sink epoch of the pending seek or switch
+	bool					m_bEndOfStream;	// The decoder reached the end of the clip
+	PREROLL_STATE			m_prerollState;
+	std::vector<FrameBuffer*>	m_preroll;	// First frames of the next loop, outside the sink
+	bool					m_bPrerollTaken;	// SetPosition(0) queued them; the decoder goes on in the new epoch
+	bool					m_bRedraw;
+	bool					m_bFirstFrame;	// Notify PLAYING at the next presented frame
+	bool					m_bEndedSent;
+	MFP_MEDIAPLAYER_STATE	m_state;
+	FrameRate				m_maxRate;
+	FramePacer				m_pacer;		// The sink's rates, for the decoder
+	std::vector<Viewport>	m_viewports;
+	uint32_t				m_nOpen;		// Open request number, to drop superseded opens
+
+	std::thread				m_openThread;
+	std::thread				m_decodeThread;
+	std::thread				m_renderThread;
+};
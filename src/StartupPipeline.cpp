@@ -0,0 +1,249 @@
+#include "StartupPipeline.h"
+#include <stdio.h>
+#include <chrono>
+
+
+static HNSTIME SteadyNow()
+{
+	return (HNSTIME)(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count() / 100);
+}
+
+static const char* GetStateName(STARTUP_STAGE_STATE state)
+{
+	switch (state) {
+	case STARTUP_STAGE_DONE:
+		return "done";
+	case STARTUP_STAGE_FAILED:
+		return "failed";
+	case STARTUP_STAGE_SKIPPED:
+		return "skipped";
+	default:
+		return "pending";
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+StartupPipeline::StartupPipeline(HNSTIME (*pfnNow)()) : m_pfnNow(pfnNow ? pfnNow : SteadyNow)
+{
+	m_hnsOrigin = m_pfnNow();
+}
+
+size_t StartupPipeline::AddStage(const char* pszName, STARTUP_THREAD thread, StartupStageFunc func)
+{
+	Stage stage;
+	stage.info.name = pszName;
+	stage.info.thread = thread;
+	stage.info.state = STARTUP_STAGE_PENDING;
+	stage.info.hnsStart = stage.info.hnsEnd = 0;
+	stage.func = func;
+	m_stages.push_back(stage);
+	return m_stages.size() - 1;
+}
+
+void StartupPipeline::AddDependency(size_t nStage, size_t nDependsOn)
+{
+	m_stages[nStage].deps.push_back(nDependsOn);
+}
+
+HNSTIME StartupPipeline::Now() const
+{
+	return m_pfnNow() - m_hnsOrigin;
+}
+
+void StartupPipeline::Mark(const char* pszName)
+{
+	StartupMark mark;
+	mark.name = pszName;
+	mark.hnsTime = Now();
+	m_marks.push_back(mark);
+}
+
+bool StartupPipeline::IsReady(const Stage& stage) const
+{
+	for (size_t i = 0; i < stage.deps.size(); i++) {
+		if (m_stages[stage.deps[i]].info.state != STARTUP_STAGE_DONE)
+			return false;
+	}
+	return true;
+}
+
+bool StartupPipeline::HasFailedDependency(const Stage& stage) const
+{
+	for (size_t i = 0; i < stage.deps.size(); i++) {
+		STARTUP_STAGE_STATE state = m_stages[stage.deps[i]].info.state;
+		if (state == STARTUP_STAGE_FAILED || state == STARTUP_STAGE_SKIPPED)
+			return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// StartWorkers
+//
+// Starts every ready worker stage and skips the stages whose
+// dependencies failed. Called with the lock held, by Run() and by each
+// finishing worker, so workers chain without waiting for the main thread.
+//-----------------------------------------------------------------------------
+
+void StartupPipeline::StartWorkers()
+{
+	for (size_t i = 0; i < m_stages.size(); i++) {
+		Stage& stage = m_stages[i];
+		if (stage.info.state != STARTUP_STAGE_PENDING)
+			continue;
+		if (HasFailedDependency(stage)) {
+			stage.info.state = STARTUP_STAGE_SKIPPED;
+			continue;
+		}
+		if (stage.info.thread == STARTUP_THREAD_WORKER && IsReady(stage)) {
+			stage.info.state = STARTUP_STAGE_RUNNING;
+			stage.info.hnsStart = Now();
+			m_threads.push_back(std::thread(&StartupPipeline::RunStage, this, i));
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Run
+//
+// Runs the first ready main stage with the lock released, over and over;
+// when none is ready it waits for a worker to finish. Stages left
+// pending with no stage running depend on each other and are skipped.
+//-----------------------------------------------------------------------------
+
+bool StartupPipeline::Run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	for (;;) {
+		StartWorkers();
+
+		size_t cRunning = 0;
+		size_t nMain = m_stages.size();
+		bool bPending = false;
+		for (size_t i = 0; i < m_stages.size(); i++) {
+			const Stage& stage = m_stages[i];
+			if (stage.info.state == STARTUP_STAGE_RUNNING)
+				cRunning++;
+			if (stage.info.state != STARTUP_STAGE_PENDING)
+				continue;
+			bPending = true;
+			if (stage.info.thread == STARTUP_THREAD_MAIN && IsReady(stage) && nMain == m_stages.size())
+				nMain = i;
+		}
+
+		if (nMain < m_stages.size()) {
+			Stage& stage = m_stages[nMain];
+			stage.info.state = STARTUP_STAGE_RUNNING;
+			stage.info.hnsStart = Now();
+			lock.unlock();
+			bool bDone = stage.func();
+			lock.lock();
+			stage.info.hnsEnd = Now();
+			stage.info.state = bDone ? STARTUP_STAGE_DONE : STARTUP_STAGE_FAILED;
+			continue;
+		}
+
+		if (!bPending && !cRunning)
+			break;
+		if (!cRunning) {
+			for (size_t i = 0; i < m_stages.size(); i++) {
+				if (m_stages[i].info.state == STARTUP_STAGE_PENDING)
+					m_stages[i].info.state = STARTUP_STAGE_SKIPPED;
+			}
+			break;
+		}
+		m_cvDone.wait(lock);
+	}
+
+	// Nothing runs any more, so no thread is added while joining.
+	lock.unlock();
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i].join();
+	m_threads.clear();
+
+	for (size_t i = 0; i < m_stages.size(); i++) {
+		if (m_stages[i].info.state != STARTUP_STAGE_DONE)
+			return false;
+	}
+	return true;
+}
+
+void StartupPipeline::RunStage(size_t nStage)
+{
+	bool bDone = m_stages[nStage].func();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stages[nStage].info.hnsEnd = Now();
+	m_stages[nStage].info.state = bDone ? STARTUP_STAGE_DONE : STARTUP_STAGE_FAILED;
+	StartWorkers();
+	m_cvDone.notify_all();
+}
+
+//-----------------------------------------------------------------------------
+// GetCriticalPath
+//
+// Walks back from the stage that finished last, each time to the
+// dependency that finished last.
+//-----------------------------------------------------------------------------
+
+HNSTIME StartupPipeline::GetCriticalPath(std::vector<size_t>* pPath) const
+{
+	pPath->clear();
+	size_t nLast = m_stages.size();
+	for (size_t i = 0; i < m_stages.size(); i++) {
+		const StartupStageInfo& info = m_stages[i].info;
+		if (info.state != STARTUP_STAGE_DONE && info.state != STARTUP_STAGE_FAILED)
+			continue;
+		if (nLast == m_stages.size() || info.hnsEnd > m_stages[nLast].info.hnsEnd)
+			nLast = i;
+	}
+	if (nLast == m_stages.size())
+		return 0;
+
+	HNSTIME hnsEnd = m_stages[nLast].info.hnsEnd;
+	for (size_t n = nLast; n < m_stages.size(); ) {
+		pPath->insert(pPath->begin(), n);
+		const std::vector<size_t>& deps = m_stages[n].deps;
+		size_t nNext = m_stages.size();
+		for (size_t i = 0; i < deps.size(); i++) {
+			if (nNext == m_stages.size() || m_stages[deps[i]].info.hnsEnd > m_stages[nNext].info.hnsEnd)
+				nNext = deps[i];
+		}
+		n = nNext;
+	}
+	return hnsEnd;
+}
+
+void StartupPipeline::FormatReport(std::string* pText) const
+{
+	char line[256];
+	pText->assign("stage                 thread   start ms     end ms   time ms  state\n");
+	for (size_t i = 0; i < m_stages.size(); i++) {
+		const StartupStageInfo& info = m_stages[i].info;
+		snprintf(line, sizeof(line), "%-20s  %-6s  %9.2f  %9.2f  %8.2f  %s\n", info.name.c_str(),
+			info.thread == STARTUP_THREAD_MAIN ? "main" : "worker",
+			(double)info.hnsStart / HNS_PER_MSEC, (double)info.hnsEnd / HNS_PER_MSEC,
+			(double)(info.hnsEnd - info.hnsStart) / HNS_PER_MSEC, GetStateName(info.state));
+		pText->append(line);
+	}
+	for (size_t i = 0; i < m_marks.size(); i++) {
+		snprintf(line, sizeof(line), "%-20s  mark    %9.2f\n", m_marks[i].name.c_str(),
+			(double)m_marks[i].hnsTime / HNS_PER_MSEC);
+		pText->append(line);
+	}
+
+	std::vector<size_t> path;
+	GetCriticalPath(&path);
+	pText->append("critical path:");
+	for (size_t i = 0; i < path.size(); i++) {
+		pText->append(i ? " > " : " ");
+		pText->append(m_stages[path[i]].info.name);
+	}
+	pText->append("\n");
+}
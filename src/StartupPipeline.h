@@ -0,0 +1,107 @@
+#pragma once
+#include "PlaybackClock.h"
+#include <stddef.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Where a stage runs.
+enum STARTUP_THREAD
+{
+	STARTUP_THREAD_MAIN = 0,	// The thread calling Run(), e.g. the one owning windows
+	STARTUP_THREAD_WORKER		// A thread of its own
+};
+
+enum STARTUP_STAGE_STATE
+{
+	STARTUP_STAGE_PENDING = 0,
+	STARTUP_STAGE_RUNNING,
+	STARTUP_STAGE_DONE,
+	STARTUP_STAGE_FAILED,
+	STARTUP_STAGE_SKIPPED		// A dependency failed
+};
+
+// A stage returns false if it failed; its dependents are skipped.
+typedef std::function<bool()> StartupStageFunc;
+
+struct StartupStageInfo
+{
+	std::string			name;
+	STARTUP_THREAD		thread;
+	STARTUP_STAGE_STATE	state;
+	HNSTIME				hnsStart;	// Relative to the pipeline's creation
+	HNSTIME				hnsEnd;
+};
+
+struct StartupMark
+{
+	std::string	name;
+	HNSTIME		hnsTime;			// Relative to the pipeline's creation
+};
+
+
+//-------------------------------------------------------------------
+//
+// StartupPipeline class
+//
+// Runs startup as a graph of stages. A stage starts as soon as all of
+// its dependencies are done: worker stages on threads of their own,
+// main stages one after another on the calling thread, so slow I/O
+// overlaps with the work that must stay on the main thread.
+//
+// Every stage is timestamped, and Mark() adds later events such as the
+// first frame, for a startup trace.
+//
+//-------------------------------------------------------------------
+
+class StartupPipeline
+{
+public:
+	// pfnNow returns a monotonic time; NULL uses std::chrono::steady_clock.
+	explicit StartupPipeline(HNSTIME (*pfnNow)() = nullptr);
+
+	size_t AddStage(const char* pszName, STARTUP_THREAD thread, StartupStageFunc func);
+	void AddDependency(size_t nStage, size_t nDependsOn);
+
+	// Runs every stage. Returns false if a stage failed or was skipped.
+	bool Run();
+
+	void Mark(const char* pszName);
+	HNSTIME Now() const;
+
+	size_t GetStageCount() const { return m_stages.size(); }
+	const StartupStageInfo& GetStage(size_t nStage) const { return m_stages[nStage].info; }
+	const std::vector<StartupMark>& GetMarks() const { return m_marks; }
+
+	// Chain of stages that decided when the last stage finished, first
+	// to last. Returns its end time.
+	HNSTIME GetCriticalPath(std::vector<size_t>* pPath) const;
+
+	// One line per stage and mark, then the critical path.
+	void FormatReport(std::string* pText) const;
+
+private:
+	struct Stage
+	{
+		StartupStageInfo	info;
+		StartupStageFunc	func;
+		std::vector<size_t>	deps;
+	};
+
+	bool IsReady(const Stage& stage) const;
+	bool HasFailedDependency(const Stage& stage) const;
+	void StartWorkers();
+	void RunStage(size_t nStage);
+
+	HNSTIME						(*m_pfnNow)();
+	HNSTIME						m_hnsOrigin;
+	std::vector<Stage>			m_stages;
+	std::vector<StartupMark>	m_marks;
+	std::vector<std::thread>	m_threads;
+	std::mutex					m_mutex;
+	std::condition_variable		m_cvDone;
+};
@@ -0,0 +1,69 @@
+#include "StateSnapshot.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// State block of the size the players publish: every field holds the
+// version, so a read mixing two versions shows.
+struct BenchState
+{
+	uint64_t	fields[8];
+};
+
+
+bool RunSnapshotBench(uint32_t cReaders, HNSTIME hnsDuration, SnapshotBenchResult* pResult)
+{
+	if (hnsDuration <= 0)
+		return false;
+
+	StateSnapshot<BenchState>* pSnapshot = new StateSnapshot<BenchState>();
+	std::atomic<bool> bStop(false);
+	std::vector<uint64_t> cReads(cReaders, 0), cTorn(cReaders, 0);
+	std::vector<std::thread> readers;
+	for (uint32_t i = 0; i < cReaders; i++) {
+		readers.push_back(std::thread([pSnapshot, &bStop, &cReads, &cTorn, i]() {
+			uint64_t cThreadReads = 0, cThreadTorn = 0;
+			BenchState state;
+			while (!bStop.load(std::memory_order_relaxed)) {
+				if (!pSnapshot->Read(&state))
+					continue;
+				for (size_t f = 1; f < sizeof(state.fields) / sizeof(state.fields[0]); f++) {
+					if (state.fields[f] != state.fields[0]) {
+						cThreadTorn++;
+						break;
+					}
+				}
+				cThreadReads++;
+			}
+			cReads[i] = cThreadReads;
+			cTorn[i] = cThreadTorn;
+		}));
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point end = start + std::chrono::microseconds(hnsDuration / 10);
+	uint64_t cWrites = 0;
+	BenchState state;
+	while ((cWrites & 1023) != 0 || std::chrono::steady_clock::now() < end) {
+		cWrites++;
+		for (size_t f = 0; f < sizeof(state.fields) / sizeof(state.fields[0]); f++)
+			state.fields[f] = cWrites;
+		pSnapshot->Publish(state);
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	bStop.store(true, std::memory_order_relaxed);
+	for (size_t i = 0; i < readers.size(); i++)
+		readers[i].join();
+	delete pSnapshot;
+
+	pResult->cReaders = cReaders;
+	pResult->fWritesPerSecond = elapsed.count() > 0.0 ? cWrites / elapsed.count() : 0.0;
+	uint64_t cAllReads = 0;
+	pResult->cTorn = 0;
+	for (uint32_t i = 0; i < cReaders; i++) {
+		cAllReads += cReads[i];
+		pResult->cTorn += cTorn[i];
+	}
+	pResult->fReadsPerSecond = elapsed.count() > 0.0 ? cAllReads / elapsed.count() : 0.0;
+	return true;
+}
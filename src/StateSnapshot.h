@@ -0,0 +1,125 @@
+#pragma once
+#include "PlaybackClock.h"
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+
+//-------------------------------------------------------------------
+//
+// StateSnapshot class
+//
+// Latest value of a small trivially copyable struct, published by one
+// writer thread and read by any number of threads without a lock.
+//
+// Every publish goes to the next of SLOTS copies, each a seqlock: the
+// slot's sequence is odd while the writer fills it. A reader copies the
+// slot of the latest version and checks that its sequence did not move,
+// so it only retries if the writer came round to that slot again during
+// the copy, which takes SLOTS - 1 further publishes. Readers never write
+// shared memory and do not slow the writer or each other.
+//
+// The copies are held as atomic words, stored with release and loaded
+// with acquire: a reader that saw any word of a newer write also sees
+// the odd sequence before it. A torn read is discarded rather than
+// being a data race, and no fences are needed, which ThreadSanitizer
+// does not model. On x86 these are plain moves.
+//
+//-------------------------------------------------------------------
+
+template <typename T, size_t SLOTS = 4>
+class StateSnapshot
+{
+	static_assert(std::is_trivially_copyable<T>::value, "StateSnapshot needs a trivially copyable type");
+	static_assert(SLOTS >= 2, "StateSnapshot needs two slots or more");
+
+public:
+	StateSnapshot() : m_nVersion(0)
+	{
+		for (size_t i = 0; i < SLOTS; i++) {
+			m_slots[i].nSeq.store(0, std::memory_order_relaxed);
+			for (size_t w = 0; w < WORDS; w++)
+				m_slots[i].words[w].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	// Publishes value as the next version. Only one thread may publish.
+	void Publish(const T& value)
+	{
+		uint64_t words[WORDS] = {};
+		memcpy(words, &value, sizeof(T));
+
+		uint64_t nVersion = m_nVersion.load(std::memory_order_relaxed) + 1;
+		Slot& slot = m_slots[nVersion % SLOTS];
+		slot.nSeq.store(nVersion * 2 - 1, std::memory_order_relaxed);
+		for (size_t w = 0; w < WORDS; w++)
+			slot.words[w].store(words[w], std::memory_order_release);
+		slot.nSeq.store(nVersion * 2, std::memory_order_release);
+		m_nVersion.store(nVersion, std::memory_order_release);
+	}
+
+	// Copies the latest version to *pValue and returns its number, or
+	// returns 0 and leaves *pValue alone if nothing was published yet.
+	uint64_t Read(T* pValue) const
+	{
+		uint64_t words[WORDS];
+		for (;;) {
+			uint64_t nVersion = m_nVersion.load(std::memory_order_acquire);
+			if (nVersion == 0)
+				return 0;
+			const Slot& slot = m_slots[nVersion % SLOTS];
+			if (slot.nSeq.load(std::memory_order_acquire) != nVersion * 2)
+				continue;
+			for (size_t w = 0; w < WORDS; w++)
+				words[w] = slot.words[w].load(std::memory_order_acquire);
+			if (slot.nSeq.load(std::memory_order_relaxed) != nVersion * 2)
+				continue;
+			memcpy(pValue, words, sizeof(T));
+			return nVersion;
+		}
+	}
+
+	// Number of the latest version, 0 = none yet.
+	uint64_t GetVersion() const { return m_nVersion.load(std::memory_order_acquire); }
+
+private:
+	StateSnapshot(const StateSnapshot&);
+	StateSnapshot& operator=(const StateSnapshot&);
+
+	static const size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	// Slots are padded to whole 64 byte lines, so a reader of one slot
+	// mostly does not share a cache line with the slot being written.
+	static const size_t LINE_WORDS = 64 / sizeof(uint64_t);
+	static const size_t SLOT_WORDS = (WORDS + LINE_WORDS) / LINE_WORDS * LINE_WORDS;
+
+	struct Slot
+	{
+		std::atomic<uint64_t>	nSeq;		// Version * 2, minus 1 while being written
+		std::atomic<uint64_t>	words[SLOT_WORDS - 1];
+	};
+
+	std::atomic<uint64_t>	m_nVersion;		// Latest published version
+	uint64_t				m_padding[LINE_WORDS - 1];
+	Slot					m_slots[SLOTS];
+};
+
+
+struct SnapshotBenchResult
+{
+	uint32_t	cReaders;
+	double		fWritesPerSecond;
+	double		fReadsPerSecond;		// All readers together
+	uint64_t	cTorn;					// Reads that saw fields of two versions; must be 0
+};
+
+//-------------------------------------------------------------------
+// RunSnapshotBench
+//
+// Publishes a player-sized state block from one thread as fast as it
+// can while cReaders threads read it, for hnsDuration of wall-clock
+// time, and checks every read for a mix of two versions.
+//-------------------------------------------------------------------
+
+bool RunSnapshotBench(uint32_t cReaders, HNSTIME hnsDuration, SnapshotBenchResult* pResult);
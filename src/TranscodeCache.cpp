@@ -0,0 +1,316 @@
+#include "TranscodeCache.h"
+#include <string.h>
+
+// Index file layout version; older or newer files are treated as missing.
+static const uint32_t INDEX_MAGIC = 0x4943574C;		// "LWCI"
+static const uint32_t INDEX_VERSION = 1;
+static const uint32_t MAX_INDEX_FRAMES = 1 << 24;
+static const uint32_t MAX_SOURCE_CHARS = 32768;
+
+
+static bool SameTarget(const CacheTarget& a, const CacheTarget& b)
+{
+	return a.cxDesktop == b.cxDesktop && a.cyDesktop == b.cyDesktop && a.maxRate.nNum == b.maxRate.nNum &&
+		a.maxRate.nDen == b.maxRate.nDen && a.nGopFrames == b.nGopFrames;
+}
+
+static void HashBytes(uint64_t* pHash, const void* pData, size_t cb)
+{
+	const uint8_t* p = (const uint8_t*)pData;
+	for (size_t i = 0; i < cb; i++) {
+		*pHash ^= p[i];
+		*pHash *= 0x100000001B3ull;
+	}
+}
+
+static uint32_t Checksum(const uint8_t* pData, size_t cb)
+{
+	uint32_t nHash = 0x811C9DC5;
+	for (size_t i = 0; i < cb; i++) {
+		nHash ^= pData[i];
+		nHash *= 0x01000193;
+	}
+	return nHash;
+}
+
+
+//********************* Entry files **********************//
+
+//-----------------------------------------------------------------------------
+// GetEntryPath
+//
+// <directory>/<16 hex digits of FNV-1a over the path and target><ext>.
+//-----------------------------------------------------------------------------
+
+std::wstring TranscodeCache::GetEntryPath(const std::wstring& source, const CacheTarget& target,
+	const wchar_t* pszExtension) const
+{
+	uint64_t nHash = 0xCBF29CE484222325ull;
+	std::wstring normal = NormalizePath(source);
+	for (size_t i = 0; i < normal.size(); i++) {
+		uint16_t c = (uint16_t)normal[i];
+		HashBytes(&nHash, &c, sizeof(c));
+	}
+	uint32_t fields[5] = { target.cxDesktop, target.cyDesktop, target.maxRate.nNum, target.maxRate.nDen, target.nGopFrames };
+	HashBytes(&nHash, fields, sizeof(fields));
+
+	static const wchar_t s_hex[] = L"0123456789abcdef";
+	std::wstring path(m_directory);
+	if (!path.empty() && path[path.size() - 1] != L'\\' && path[path.size() - 1] != L'/')
+#ifdef _WIN32
+		path += L'\\';
+#else
+		path += L'/';
+#endif
+	for (int i = 60; i >= 0; i -= 4)
+		path += s_hex[(nHash >> i) & 0xF];
+	path += pszExtension;
+	return path;
+}
+
+std::wstring TranscodeCache::GetMediaPath(const std::wstring& source, const CacheTarget& target) const
+{
+	return GetEntryPath(source, target, L".mp4");
+}
+
+std::wstring TranscodeCache::GetIndexPath(const std::wstring& source, const CacheTarget& target) const
+{
+	return GetEntryPath(source, target, L".lwi");
+}
+
+// Keeps the .mp4 extension, which picks the container of the writer.
+std::wstring TranscodeCache::GetTempPath(const std::wstring& source, const CacheTarget& target) const
+{
+	return GetEntryPath(source, target, L".part.mp4");
+}
+
+bool TranscodeCache::FindFresh(const std::wstring& source, const CacheTarget& target, CacheIndex* pIndex) const
+{
+	if (!IsEnabled())
+		return false;
+
+	CacheIndex index;
+	FileInfo sourceInfo, mediaInfo;
+	if (!ReadIndex(GetIndexPath(source, target), &index) ||
+		NormalizePath(index.source) != NormalizePath(source) || !SameTarget(index.target, target))
+		return false;
+	if (!GetFileInfo(source, &sourceInfo) || sourceInfo.cbSize != index.sourceInfo.cbSize ||
+		sourceInfo.nModified != index.sourceInfo.nModified)
+		return false;
+	if (!GetFileInfo(GetMediaPath(source, target), &mediaInfo) || mediaInfo.cbSize != index.cbMedia)
+		return false;
+
+	*pIndex = index;
+	return true;
+}
+
+bool TranscodeCache::Commit(const std::wstring& tempMedia, CacheIndex* pIndex)
+{
+	FileInfo mediaInfo;
+	if (!IsEnabled() || !GetFileInfo(tempMedia, &mediaInfo) || pIndex->frames.empty())
+		return false;
+	pIndex->cbMedia = mediaInfo.cbSize;
+
+	// The old index goes first, so it never describes the new media.
+	std::wstring indexPath = GetIndexPath(pIndex->source, pIndex->target);
+	std::wstring tempIndex = indexPath + L".part";
+	RemoveFile(indexPath);
+	if (!MoveFileReplace(tempMedia, GetMediaPath(pIndex->source, pIndex->target)))
+		return false;
+	if (!WriteIndex(tempIndex, *pIndex) || !MoveFileReplace(tempIndex, indexPath)) {
+		RemoveFile(tempIndex);
+		return false;
+	}
+	return true;
+}
+
+void TranscodeCache::Remove(const std::wstring& source, const CacheTarget& target)
+{
+	RemoveFile(GetIndexPath(source, target));
+	RemoveFile(GetMediaPath(source, target));
+}
+
+
+//********************* Index file **********************//
+
+static void Put32(std::vector<uint8_t>* pData, uint32_t n)
+{
+	for (int i = 0; i < 4; i++)
+		pData->push_back((uint8_t)(n >> (8 * i)));
+}
+
+static void Put64(std::vector<uint8_t>* pData, uint64_t n)
+{
+	Put32(pData, (uint32_t)n);
+	Put32(pData, (uint32_t)(n >> 32));
+}
+
+// Reads little-endian fields; any read past the end fails the whole parse.
+struct IndexReader
+{
+	const uint8_t*	p;
+	const uint8_t*	pEnd;
+	bool			bOk;
+
+	uint32_t Get32()
+	{
+		if (pEnd - p < 4) {
+			bOk = false;
+			return 0;
+		}
+		uint32_t n = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+		p += 4;
+		return n;
+	}
+
+	uint64_t Get64()
+	{
+		uint64_t nLow = Get32();
+		return nLow | (uint64_t)Get32() << 32;
+	}
+};
+
+//-----------------------------------------------------------------------------
+// WriteIndex
+//
+// Little-endian fields, paths as UTF-16, and an FNV-1a checksum of all
+// bytes before it at the end.
+//-----------------------------------------------------------------------------
+
+bool TranscodeCache::WriteIndex(const std::wstring& path, const CacheIndex& index)
+{
+	std::vector<uint8_t> data;
+	Put32(&data, INDEX_MAGIC);
+	Put32(&data, INDEX_VERSION);
+	Put32(&data, (uint32_t)index.source.size());
+	for (size_t i = 0; i < index.source.size(); i++) {
+		data.push_back((uint8_t)index.source[i]);
+		data.push_back((uint8_t)((uint16_t)index.source[i] >> 8));
+	}
+	Put64(&data, index.sourceInfo.cbSize);
+	Put64(&data, (uint64_t)index.sourceInfo.nModified);
+	Put32(&data, index.target.cxDesktop);
+	Put32(&data, index.target.cyDesktop);
+	Put32(&data, index.target.maxRate.nNum);
+	Put32(&data, index.target.maxRate.nDen);
+	Put32(&data, index.target.nGopFrames);
+	Put32(&data, index.cx);
+	Put32(&data, index.cy);
+	Put32(&data, index.rate.nNum);
+	Put32(&data, index.rate.nDen);
+	Put64(&data, index.cbMedia);
+	Put32(&data, (uint32_t)index.frames.size());
+	for (size_t i = 0; i < index.frames.size(); i++) {
+		Put64(&data, (uint64_t)index.frames[i].hnsTime);
+		Put64(&data, (uint64_t)index.frames[i].hnsDuration);
+		Put32(&data, index.frames[i].bKeyframe ? 1 : 0);
+	}
+	Put32(&data, Checksum(data.data(), data.size()));
+
+	FILE* fp = FileOpen(path, "wb");
+	if (!fp)
+		return false;
+	bool bOk = fwrite(data.data(), 1, data.size(), fp) == data.size();
+	bOk = fclose(fp) == 0 && bOk;
+	return bOk;
+}
+
+bool TranscodeCache::ReadIndex(const std::wstring& path, CacheIndex* pIndex)
+{
+	FILE* fp = FileOpen(path, "rb");
+	if (!fp)
+		return false;
+	std::vector<uint8_t> data;
+	uint8_t buffer[4096];
+	for (size_t cb; (cb = fread(buffer, 1, sizeof(buffer), fp)) > 0; )
+		data.insert(data.end(), buffer, buffer + cb);
+	fclose(fp);
+
+	if (data.size() < 8)
+		return false;
+	IndexReader tail = { data.data() + data.size() - 4, data.data() + data.size(), true };
+	if (tail.Get32() != Checksum(data.data(), data.size() - 4))
+		return false;
+
+	IndexReader reader = { data.data(), data.data() + data.size() - 4, true };
+	if (reader.Get32() != INDEX_MAGIC || reader.Get32() != INDEX_VERSION)
+		return false;
+
+	CacheIndex index;
+	uint32_t cchSource = reader.Get32();
+	if (cchSource > MAX_SOURCE_CHARS || (size_t)(reader.pEnd - reader.p) < (size_t)cchSource * 2)
+		return false;
+	for (uint32_t i = 0; i < cchSource; i++, reader.p += 2)
+		index.source.push_back((wchar_t)(reader.p[0] | reader.p[1] << 8));
+	index.sourceInfo.cbSize = reader.Get64();
+	index.sourceInfo.nModified = (int64_t)reader.Get64();
+	index.target.cxDesktop = reader.Get32();
+	index.target.cyDesktop = reader.Get32();
+	index.target.maxRate.nNum = reader.Get32();
+	index.target.maxRate.nDen = reader.Get32();
+	index.target.nGopFrames = reader.Get32();
+	index.cx = reader.Get32();
+	index.cy = reader.Get32();
+	index.rate.nNum = reader.Get32();
+	index.rate.nDen = reader.Get32();
+	index.cbMedia = reader.Get64();
+
+	uint32_t cFrames = reader.Get32();
+	if (!reader.bOk || cFrames > MAX_INDEX_FRAMES || (size_t)(reader.pEnd - reader.p) != (size_t)cFrames * 20)
+		return false;
+	index.frames.resize(cFrames);
+	for (uint32_t i = 0; i < cFrames; i++) {
+		index.frames[i].hnsTime = (HNSTIME)reader.Get64();
+		index.frames[i].hnsDuration = (HNSTIME)reader.Get64();
+		index.frames[i].bKeyframe = reader.Get32() != 0;
+	}
+	if (!reader.bOk)
+		return false;
+
+	*pIndex = index;
+	return true;
+}
+
+
+//********************* Geometry and seeking **********************//
+
+void GetCacheFrameSize(uint32_t cxSource, uint32_t cySource, const CacheTarget& target, uint32_t* pcx, uint32_t* pcy)
+{
+	uint64_t cx = cxSource, cy = cySource;
+
+	// Smallest scale that covers the desktop, cx / cxSource = max(ratios).
+	if (target.cxDesktop && target.cyDesktop && cxSource && cySource) {
+		if ((uint64_t)target.cxDesktop * cySource >= (uint64_t)target.cyDesktop * cxSource) {
+			cx = target.cxDesktop;
+			cy = ((uint64_t)cySource * target.cxDesktop + cxSource - 1) / cxSource;
+		}
+		else {
+			cy = target.cyDesktop;
+			cx = ((uint64_t)cxSource * target.cyDesktop + cySource - 1) / cySource;
+		}
+		if (cx > cxSource || cy > cySource) {
+			cx = cxSource;
+			cy = cySource;
+		}
+	}
+	*pcx = cx > 2 ? (uint32_t)(cx & ~1ull) : 2;
+	*pcy = cy > 2 ? (uint32_t)(cy & ~1ull) : 2;
+}
+
+size_t FindKeyframe(const CacheIndex& index, HNSTIME hnsTime)
+{
+	const std::vector<CacheFrame>& frames = index.frames;
+
+	// Last frame starting at or before hnsTime.
+	size_t nLow = 0, nHigh = frames.size();
+	while (nHigh - nLow > 1) {
+		size_t nMid = (nLow + nHigh) / 2;
+		if (frames[nMid].hnsTime <= hnsTime)
+			nLow = nMid;
+		else
+			nHigh = nMid;
+	}
+	while (nLow > 0 && !frames[nLow].bKeyframe)
+		nLow--;
+	return nLow;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "PlaybackClock.h"
+#include "FramePacer.h"
+#include "FileUtil.h"
+#include <string>
+#include <vector>
+
+
+const uint32_t	DEFAULT_CACHE_GOP_FRAMES = 15;	// Keyframe every half second at 30 fps
+const double	DEFAULT_CACHE_MAX_FPS = 30.0;
+
+// What a cached variant is made for. Part of the cache key: another
+// desktop size or cap makes a separate entry.
+struct CacheTarget
+{
+	uint32_t	cxDesktop;
+	uint32_t	cyDesktop;
+	FrameRate	maxRate;		// Zero = keep the source rate
+	uint32_t	nGopFrames;		// Frames per keyframe interval, 1 = all-intra
+
+	CacheTarget() : cxDesktop(0), cyDesktop(0), maxRate(FrameRateFromDouble(DEFAULT_CACHE_MAX_FPS)),
+		nGopFrames(DEFAULT_CACHE_GOP_FRAMES) {}
+};
+
+// One frame of the cached variant.
+struct CacheFrame
+{
+	HNSTIME		hnsTime;
+	HNSTIME		hnsDuration;
+	bool		bKeyframe;
+};
+
+// Index file of a cache entry: what it was made from and of, and its
+// frames in presentation order.
+struct CacheIndex
+{
+	std::wstring			source;
+	FileInfo				sourceInfo;		// Source size and time when transcoded
+	CacheTarget				target;
+	uint32_t				cx;				// Frame size of the cached variant
+	uint32_t				cy;
+	FrameRate				rate;			// Frame rate of the cached variant
+	uint64_t				cbMedia;		// Size of the media file, to catch a lost or cut file
+	std::vector<CacheFrame>	frames;
+
+	CacheIndex() : sourceInfo(), cx(0), cy(0), rate(), cbMedia(0) {}
+};
+
+
+//-------------------------------------------------------------------
+//
+// TranscodeCache class
+//
+// Directory of clips transcoded for looping playback on this desktop.
+// An entry is a media file and an index file named after a hash of the
+// source path and the target, so a source that changed overwrites its
+// old entry instead of piling up next to it.
+//
+// An entry is fresh while the source still has the size and time stored
+// in its index and the media file is complete. Entries are published
+// media first, index last, each moved into place in one step, so a
+// reader never sees an index without its media.
+//
+// Only file names and metadata: the transcoding itself is done by the
+// caller. Thread-safe as long as one entry is written at a time.
+//
+//-------------------------------------------------------------------
+
+class TranscodeCache
+{
+public:
+	TranscodeCache() {}
+	explicit TranscodeCache(const std::wstring& directory) : m_directory(directory) {}
+
+	void SetDirectory(const std::wstring& directory) { m_directory = directory; }
+	const std::wstring& GetDirectory() const { return m_directory; }
+	bool IsEnabled() const { return !m_directory.empty(); }
+
+	// Files of the entry for a source and target.
+	std::wstring GetMediaPath(const std::wstring& source, const CacheTarget& target) const;
+	std::wstring GetIndexPath(const std::wstring& source, const CacheTarget& target) const;
+
+	// File to transcode into before Commit, next to the entry.
+	std::wstring GetTempPath(const std::wstring& source, const CacheTarget& target) const;
+
+	// Loads the index of the entry if it is fresh.
+	bool FindFresh(const std::wstring& source, const CacheTarget& target, CacheIndex* pIndex) const;
+
+	// Publishes an entry: moves the finished media file into place and
+	// writes the index. index.cbMedia is filled in here.
+	bool Commit(const std::wstring& tempMedia, CacheIndex* pIndex);
+
+	// Removes the entry of a source and target, if any.
+	void Remove(const std::wstring& source, const CacheTarget& target);
+
+	static bool WriteIndex(const std::wstring& path, const CacheIndex& index);
+	static bool ReadIndex(const std::wstring& path, CacheIndex* pIndex);
+
+private:
+	std::wstring GetEntryPath(const std::wstring& source, const CacheTarget& target, const wchar_t* pszExtension) const;
+
+	std::wstring	m_directory;
+};
+
+
+// Frame size of the cached variant of a cxSource x cySource clip: scaled
+// down just enough to still cover the desktop, never up, rounded down
+// to even sizes.
+void GetCacheFrameSize(uint32_t cxSource, uint32_t cySource, const CacheTarget& target, uint32_t* pcx, uint32_t* pcy);
+
+// Last frame at or before hnsTime that starts a keyframe interval, where
+// a seek can start decoding. 0 for an empty index.
+size_t FindKeyframe(const CacheIndex& index, HNSTIME hnsTime);
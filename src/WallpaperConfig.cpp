@@ -0,0 +1,568 @@
+#include "WallpaperConfig.h"
+#include "FileUtil.h"
+#include "JsonReader.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <wctype.h>
+
+
+// Names of the enumerations in the file, in enumeration order.
+static const char* const s_layoutNames[] = { "span", "span-physical", "clone" };
+static const char* const s_scaleNames[] = { "fit", "fill", "stretch" };
+static const char* const s_powerNames[] = { "ac", "battery", "saver" };
+
+const double MAX_CONFIG_FPS = 1000.0;
+const double MAX_CONFIG_INTERVAL = 365.0 * SECONDS_PER_DAY;
+const int32_t MAX_CONFIG_MONITOR = 255;
+
+
+WallpaperConfig::WallpaperConfig() : fMaxFps(0.0f), layout(LAYOUT_SPAN), scale(SCALE_FIT), fVolume(1.0f),
+	bMute(true), bAdaptive(false)
+{
+	for (int i = 0; i < POWER_STATE_COUNT; i++) {
+		power[i].fMaxFps = i == POWER_STATE_AC ? 0.0f : DEFAULT_BATTERY_FPS;
+		power[i].bPause = false;
+	}
+}
+
+
+//-------------------------------------------------------------------
+//
+// ConfigParser class
+//
+// Maps the tokens of a JsonReader onto a WallpaperConfig. Strings are
+// resolved into a fixed buffer, so only the values kept allocate.
+//
+//-------------------------------------------------------------------
+
+class ConfigParser
+{
+public:
+	ConfigParser(const char* pText, size_t cchText, ConfigError* pError) :
+		m_reader(pText, cchText),
+		m_pError(pError),
+		m_cchText(0)
+	{
+		m_text[0] = '\0';
+	}
+
+	bool Parse(WallpaperConfig* pConfig);
+
+private:
+	bool ParseClips(std::vector<PlaylistItem>* pClips);
+	bool ParseClip(PlaylistItem* pItem);
+	bool ParsePower(PowerProfile* pProfiles);
+	bool ParseProfile(PowerProfile* pProfile);
+	bool ParseMonitors(std::vector<MonitorConfig>* pMonitors);
+	bool ParseMonitor(MonitorConfig* pMonitor);
+
+	bool ReadNumber(double fMin, double fMax, double* pfValue);
+	bool ReadBool(bool* pbValue);
+	bool ReadText();
+	bool ReadPath(std::wstring* pPath);
+	bool ReadName(const char* const* ppszNames, size_t cNames, int32_t* pnValue);
+	bool ReadTimeOfDay(int32_t* pnSecond);
+	bool Expect(JSON_TOKEN token, const char* pszError);
+	bool Fail(const char* pszMessage);
+
+	JsonReader		m_reader;
+	ConfigError*	m_pError;
+	char			m_text[4096];	// Last string read, UTF-8
+	size_t			m_cchText;
+};
+
+bool ConfigParser::Parse(WallpaperConfig* pConfig)
+{
+	if (!Expect(JSON_TOKEN_BEGIN_OBJECT, "expected an object"))
+		return false;
+
+	while (m_reader.Next() == JSON_TOKEN_KEY) {
+		double fValue = 0.0;
+		int32_t nValue = 0;
+		if (m_reader.IsKey("clips")) {
+			if (!ParseClips(&pConfig->clips))
+				return false;
+		}
+		else if (m_reader.IsKey("interval")) {
+			if (!ReadNumber(0.0, MAX_CONFIG_INTERVAL, &fValue))
+				return false;
+			pConfig->playlist.hnsInterval = (HNSTIME)(fValue * HNS_PER_SECOND);
+		}
+		else if (m_reader.IsKey("shuffle")) {
+			bool bShuffle = false;
+			if (!ReadBool(&bShuffle))
+				return false;
+			pConfig->playlist.order = bShuffle ? PLAYLIST_SHUFFLE : PLAYLIST_SEQUENTIAL;
+		}
+		else if (m_reader.IsKey("max-fps")) {
+			if (!ReadNumber(0.0, MAX_CONFIG_FPS, &fValue))
+				return false;
+			pConfig->fMaxFps = (float)fValue;
+		}
+		else if (m_reader.IsKey("layout")) {
+			if (!ReadName(s_layoutNames, sizeof(s_layoutNames) / sizeof(s_layoutNames[0]), &nValue))
+				return false;
+			pConfig->layout = (LAYOUT_MODE)nValue;
+		}
+		else if (m_reader.IsKey("scale")) {
+			if (!ReadName(s_scaleNames, sizeof(s_scaleNames) / sizeof(s_scaleNames[0]), &nValue))
+				return false;
+			pConfig->scale = (SCALE_MODE)nValue;
+		}
+		else if (m_reader.IsKey("volume")) {
+			if (!ReadNumber(0.0, 1.0, &fValue))
+				return false;
+			pConfig->fVolume = (float)fValue;
+		}
+		else if (m_reader.IsKey("mute")) {
+			if (!ReadBool(&pConfig->bMute))
+				return false;
+		}
+		else if (m_reader.IsKey("adaptive")) {
+			if (!ReadBool(&pConfig->bAdaptive))
+				return false;
+		}
+		else if (m_reader.IsKey("power")) {
+			if (!ParsePower(pConfig->power))
+				return false;
+		}
+		else if (m_reader.IsKey("monitors")) {
+			if (!ParseMonitors(&pConfig->monitors))
+				return false;
+		}
+		else if (!m_reader.Skip()) {
+			return Fail(NULL);
+		}
+	}
+	if (m_reader.GetToken() != JSON_TOKEN_END_OBJECT)
+		return Fail("expected a key");
+	return Expect(JSON_TOKEN_END, "text after the config");
+}
+
+// A list replaces the clips of the command line as a whole.
+bool ConfigParser::ParseClips(std::vector<PlaylistItem>* pClips)
+{
+	if (!Expect(JSON_TOKEN_BEGIN_ARRAY, "clips must be a list"))
+		return false;
+	pClips->clear();
+	while (m_reader.Next() != JSON_TOKEN_END_ARRAY) {
+		PlaylistItem item;
+		item.nStartOfDay = -1;
+		if (m_reader.GetToken() == JSON_TOKEN_STRING) {
+			if (!ReadPath(&item.path))
+				return false;
+		}
+		else if (m_reader.GetToken() != JSON_TOKEN_BEGIN_OBJECT) {
+			return Fail("a clip must be a path or an object");
+		}
+		else if (!ParseClip(&item)) {
+			return false;
+		}
+		pClips->push_back(item);
+	}
+	if (pClips->empty())
+		return Fail("clips must not be empty");
+	return true;
+}
+
+bool ConfigParser::ParseClip(PlaylistItem* pItem)
+{
+	while (m_reader.Next() == JSON_TOKEN_KEY) {
+		if (m_reader.IsKey("path")) {
+			if (m_reader.Next() != JSON_TOKEN_STRING)
+				return Fail("path must be a string");
+			if (!ReadPath(&pItem->path))
+				return false;
+		}
+		else if (m_reader.IsKey("at")) {
+			if (!ReadTimeOfDay(&pItem->nStartOfDay))
+				return false;
+		}
+		else if (!m_reader.Skip()) {
+			return Fail(NULL);
+		}
+	}
+	if (m_reader.GetToken() != JSON_TOKEN_END_OBJECT)
+		return Fail("expected a key");
+	if (pItem->path.empty())
+		return Fail("clip has no path");
+	return true;
+}
+
+bool ConfigParser::ParsePower(PowerProfile* pProfiles)
+{
+	if (!Expect(JSON_TOKEN_BEGIN_OBJECT, "power must be an object"))
+		return false;
+	while (m_reader.Next() == JSON_TOKEN_KEY) {
+		int nState = 0;
+		while (nState < POWER_STATE_COUNT && !m_reader.IsKey(s_powerNames[nState]))
+			nState++;
+		if (nState == POWER_STATE_COUNT) {
+			if (!m_reader.Skip())
+				return Fail(NULL);
+			continue;
+		}
+		if (!ParseProfile(&pProfiles[nState]))
+			return false;
+	}
+	if (m_reader.GetToken() != JSON_TOKEN_END_OBJECT)
+		return Fail("expected a key");
+	return true;
+}
+
+bool ConfigParser::ParseProfile(PowerProfile* pProfile)
+{
+	if (!Expect(JSON_TOKEN_BEGIN_OBJECT, "a power profile must be an object"))
+		return false;
+	while (m_reader.Next() == JSON_TOKEN_KEY) {
+		if (m_reader.IsKey("max-fps")) {
+			double fValue = 0.0;
+			if (!ReadNumber(0.0, MAX_CONFIG_FPS, &fValue))
+				return false;
+			pProfile->fMaxFps = (float)fValue;
+		}
+		else if (m_reader.IsKey("pause")) {
+			if (!ReadBool(&pProfile->bPause))
+				return false;
+		}
+		else if (!m_reader.Skip()) {
+			return Fail(NULL);
+		}
+	}
+	if (m_reader.GetToken() != JSON_TOKEN_END_OBJECT)
+		return Fail("expected a key");
+	return true;
+}
+
+bool ConfigParser::ParseMonitors(std::vector<MonitorConfig>* pMonitors)
+{
+	if (!Expect(JSON_TOKEN_BEGIN_ARRAY, "monitors must be a list"))
+		return false;
+	pMonitors->clear();
+	while (m_reader.Next() != JSON_TOKEN_END_ARRAY) {
+		if (m_reader.GetToken() != JSON_TOKEN_BEGIN_OBJECT)
+			return Fail("a monitor must be an object");
+		MonitorConfig monitor;
+		if (!ParseMonitor(&monitor))
+			return false;
+		pMonitors->push_back(monitor);
+	}
+	return true;
+}
+
+bool ConfigParser::ParseMonitor(MonitorConfig* pMonitor)
+{
+	while (m_reader.Next() == JSON_TOKEN_KEY) {
+		if (m_reader.IsKey("device")) {
+			if (m_reader.Next() != JSON_TOKEN_STRING)
+				return Fail("device must be a string");
+			if (!ReadPath(&pMonitor->device))
+				return false;
+		}
+		else if (m_reader.IsKey("index")) {
+			double fIndex = 0.0;
+			if (!ReadNumber(0.0, MAX_CONFIG_MONITOR, &fIndex))
+				return false;
+			if (fIndex != (int32_t)fIndex)
+				return Fail("index must be a whole number");
+			pMonitor->nIndex = (int32_t)fIndex;
+		}
+		else if (m_reader.IsKey("enabled")) {
+			if (!ReadBool(&pMonitor->bEnabled))
+				return false;
+		}
+		else if (m_reader.IsKey("scale")) {
+			if (!ReadName(s_scaleNames, sizeof(s_scaleNames) / sizeof(s_scaleNames[0]), &pMonitor->nScale))
+				return false;
+		}
+		else if (!m_reader.Skip()) {
+			return Fail(NULL);
+		}
+	}
+	if (m_reader.GetToken() != JSON_TOKEN_END_OBJECT)
+		return Fail("expected a key");
+	if (pMonitor->device.empty() && pMonitor->nIndex < 0)
+		return Fail("monitor needs a device or an index");
+	return true;
+}
+
+bool ConfigParser::ReadNumber(double fMin, double fMax, double* pfValue)
+{
+	if (m_reader.Next() != JSON_TOKEN_NUMBER || !m_reader.GetNumber(pfValue))
+		return Fail("expected a number");
+	if (!(*pfValue >= fMin && *pfValue <= fMax))
+		return Fail("number out of range");
+	return true;
+}
+
+bool ConfigParser::ReadBool(bool* pbValue)
+{
+	JSON_TOKEN token = m_reader.Next();
+	if (token != JSON_TOKEN_TRUE && token != JSON_TOKEN_FALSE)
+		return Fail("expected true or false");
+	*pbValue = token == JSON_TOKEN_TRUE;
+	return true;
+}
+
+// Resolves the current string into m_text.
+bool ConfigParser::ReadText()
+{
+	if (!m_reader.GetString(m_text, sizeof(m_text), &m_cchText))
+		return Fail("string too long");
+	return true;
+}
+
+bool ConfigParser::ReadPath(std::wstring* pPath)
+{
+	if (!ReadText())
+		return false;
+	*pPath = FromUtf8(m_text, m_cchText);
+	return true;
+}
+
+bool ConfigParser::ReadName(const char* const* ppszNames, size_t cNames, int32_t* pnValue)
+{
+	if (m_reader.Next() != JSON_TOKEN_STRING)
+		return Fail("expected a name");
+	if (!ReadText())
+		return false;
+	for (size_t i = 0; i < cNames; i++) {
+		if (strcmp(m_text, ppszNames[i]) == 0) {
+			*pnValue = (int32_t)i;
+			return true;
+		}
+	}
+	return Fail("unknown name");
+}
+
+// "HH:MM", local time.
+bool ConfigParser::ReadTimeOfDay(int32_t* pnSecond)
+{
+	int nHour = 0, nMinute = 0;
+	char cExtra = 0;
+	if (m_reader.Next() != JSON_TOKEN_STRING || !ReadText() ||
+		sscanf(m_text, "%d:%d%c", &nHour, &nMinute, &cExtra) != 2 ||
+		nHour < 0 || nHour >= 24 || nMinute < 0 || nMinute >= 60)
+		return Fail("time must be \"HH:MM\"");
+	*pnSecond = (nHour * 60 + nMinute) * 60;
+	return true;
+}
+
+bool ConfigParser::Expect(JSON_TOKEN token, const char* pszError)
+{
+	return m_reader.Next() == token || Fail(pszError);
+}
+
+// Errors of the document itself win over the one of the parser.
+bool ConfigParser::Fail(const char* pszMessage)
+{
+	if (m_reader.GetToken() == JSON_TOKEN_ERROR || !pszMessage)
+		pszMessage = m_reader.GetError() ? m_reader.GetError() : "malformed document";
+	m_pError->nLine = m_reader.GetLine();
+	m_pError->nColumn = m_reader.GetColumn();
+	m_pError->pszMessage = pszMessage;
+	return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// ParseWallpaperConfig
+//-----------------------------------------------------------------------------
+
+bool ParseWallpaperConfig(const char* pText, size_t cchText, const WallpaperConfig& base,
+	WallpaperConfig* pConfig, ConfigError* pError)
+{
+	*pConfig = base;
+	ConfigParser parser(pText, cchText, pError);
+	return parser.Parse(pConfig);
+}
+
+//-----------------------------------------------------------------------------
+// DiffWallpaperConfig
+//-----------------------------------------------------------------------------
+
+uint32_t DiffWallpaperConfig(const WallpaperConfig& from, const WallpaperConfig& to)
+{
+	uint32_t nChanges = 0;
+
+	bool bSameClips = from.clips.size() == to.clips.size();
+	for (size_t i = 0; bSameClips && i < from.clips.size(); i++) {
+		bSameClips = from.clips[i].path == to.clips[i].path &&
+			from.clips[i].nStartOfDay == to.clips[i].nStartOfDay;
+	}
+	if (!bSameClips)
+		nChanges |= CONFIG_CHANGE_CLIPS;
+	if (from.playlist.order != to.playlist.order || from.playlist.hnsInterval != to.playlist.hnsInterval ||
+		from.playlist.hnsPrefetch != to.playlist.hnsPrefetch)
+		nChanges |= CONFIG_CHANGE_ROTATION;
+
+	if (from.fMaxFps != to.fMaxFps)
+		nChanges |= CONFIG_CHANGE_FRAME_RATE;
+	for (int i = 0; i < POWER_STATE_COUNT; i++) {
+		if (from.power[i].fMaxFps != to.power[i].fMaxFps || from.power[i].bPause != to.power[i].bPause)
+			nChanges |= CONFIG_CHANGE_POWER;
+	}
+	if (from.bAdaptive != to.bAdaptive)
+		nChanges |= CONFIG_CHANGE_ADAPTIVE;
+
+	if (from.layout != to.layout || from.scale != to.scale)
+		nChanges |= CONFIG_CHANGE_LAYOUT;
+	bool bSameMonitors = from.monitors.size() == to.monitors.size();
+	for (size_t i = 0; bSameMonitors && i < from.monitors.size(); i++) {
+		const MonitorConfig& a = from.monitors[i];
+		const MonitorConfig& b = to.monitors[i];
+		bSameMonitors = a.device == b.device && a.nIndex == b.nIndex && a.bEnabled == b.bEnabled &&
+			a.nScale == b.nScale;
+	}
+	if (!bSameMonitors)
+		nChanges |= CONFIG_CHANGE_MONITORS;
+
+	if (from.fVolume != to.fVolume || from.bMute != to.bMute)
+		nChanges |= CONFIG_CHANGE_AUDIO;
+	return nChanges;
+}
+
+//-----------------------------------------------------------------------------
+// ApplyWallpaperConfig
+//
+// The frame rate goes before the adaptive ladder, so a ladder turned on
+// or off steps from the new cap.
+//-----------------------------------------------------------------------------
+
+uint32_t ApplyWallpaperConfig(const WallpaperConfig& from, const WallpaperConfig& to, IConfigTarget* pTarget)
+{
+	uint32_t nChanges = DiffWallpaperConfig(from, to);
+	if (nChanges & (CONFIG_CHANGE_CLIPS | CONFIG_CHANGE_ROTATION))
+		pTarget->SetPlaylist(to.clips, to.playlist);
+	if (nChanges & (CONFIG_CHANGE_FRAME_RATE | CONFIG_CHANGE_POWER))
+		pTarget->SetFrameRate(to.fMaxFps, to.power);
+	if (nChanges & CONFIG_CHANGE_ADAPTIVE)
+		pTarget->SetAdaptive(to.bAdaptive);
+	if (nChanges & (CONFIG_CHANGE_LAYOUT | CONFIG_CHANGE_MONITORS))
+		pTarget->SetLayout(to.layout, to.scale, to.monitors);
+	if (nChanges & CONFIG_CHANGE_AUDIO)
+		pTarget->SetAudio(to.fVolume, to.bMute);
+	return nChanges;
+}
+
+//-----------------------------------------------------------------------------
+// FindMonitorConfig
+//
+// Device names are compared without case, as Windows reports them.
+//-----------------------------------------------------------------------------
+
+MonitorConfig FindMonitorConfig(const std::vector<MonitorConfig>& configs, size_t nIndex, const std::wstring& device)
+{
+	for (size_t i = configs.size(); i-- > 0; ) {
+		const MonitorConfig& config = configs[i];
+		bool bMatch;
+		if (!config.device.empty()) {
+			bMatch = config.device.size() == device.size();
+			for (size_t c = 0; bMatch && c < device.size(); c++)
+				bMatch = towupper(config.device[c]) == towupper(device[c]);
+		}
+		else {
+			bMatch = config.nIndex == (int32_t)nIndex;
+		}
+		if (bMatch)
+			return config;
+	}
+	return MonitorConfig();
+}
+
+//-----------------------------------------------------------------------------
+// SolveConfiguredLayout
+//-----------------------------------------------------------------------------
+
+bool SolveConfiguredLayout(const LayoutParams& params, const MonitorDesc* pMonitors, const std::wstring* pDevices,
+	size_t cMonitors, const std::vector<MonitorConfig>& configs, std::vector<Viewport>* pViewports)
+{
+	std::vector<MonitorDesc> enabled;
+	std::vector<uint32_t> indices;
+	std::vector<int32_t> scales;
+	for (int nPass = 0; nPass < 2 && enabled.empty(); nPass++) {
+		for (size_t i = 0; i < cMonitors; i++) {
+			MonitorConfig config = FindMonitorConfig(configs, i, pDevices[i]);
+			if (!config.bEnabled && nPass == 0)
+				continue;
+			enabled.push_back(pMonitors[i]);
+			indices.push_back((uint32_t)i);
+			scales.push_back(config.nScale);
+		}
+	}
+
+	pViewports->clear();
+	std::vector<Viewport> viewports;
+	if (params.layout != LAYOUT_CLONE) {
+		if (!SolveMonitorLayout(params, enabled.data(), enabled.size(), &viewports))
+			return false;
+		for (size_t i = 0; i < viewports.size(); i++) {
+			viewports[i].nMonitor = indices[viewports[i].nMonitor];
+			pViewports->push_back(viewports[i]);
+		}
+		return true;
+	}
+
+	for (size_t i = 0; i < enabled.size(); i++) {
+		LayoutParams monitorParams = params;
+		if (scales[i] >= 0)
+			monitorParams.scale = (SCALE_MODE)scales[i];
+		if (!SolveMonitorLayout(monitorParams, &enabled[i], 1, &viewports))
+			return false;
+		for (size_t j = 0; j < viewports.size(); j++) {
+			viewports[j].nMonitor = indices[i];
+			pViewports->push_back(viewports[j]);
+		}
+	}
+	return true;
+}
+
+
+//********************* Benchmark **********************//
+
+std::string MakeBenchConfig(size_t cClips)
+{
+	char line[256];
+	std::string text = "// Generated for the config benchmark\n{\n  \"clips\": [\n";
+	for (size_t c = 0; c < cClips; c++) {
+		snprintf(line, sizeof(line),
+			"    { \"path\": \"C:\\\\Users\\\\Public\\\\Videos\\\\clip%06u.mp4\", \"at\": \"%02u:%02u\" }%s\n",
+			(unsigned)c, (unsigned)(c / 60 % 24), (unsigned)(c % 60), c + 1 < cClips ? "," : "");
+		text += line;
+	}
+	text += "  ],\n  \"interval\": 600, \"shuffle\": true, \"max-fps\": 30, \"volume\": 0.25,\n"
+		"  \"power\": { \"battery\": { \"max-fps\": 15 }, \"saver\": { \"pause\": true } },\n"
+		"  \"monitors\": [ { \"index\": 0, \"scale\": \"fill\" }, { \"index\": 1, \"enabled\": false } ]\n}\n";
+	return text;
+}
+
+bool RunConfigBench(const std::string& text, const WallpaperConfig& base, uint32_t cPasses, ConfigBenchResult* pResult)
+{
+	typedef std::chrono::steady_clock Clock;
+	pResult->cbText = text.size();
+	pResult->error = ConfigError();
+	bool bParsed = true;
+	Clock::time_point start = Clock::now();
+	for (uint32_t nPass = 0; bParsed && nPass < cPasses; nPass++) {
+		WallpaperConfig config;
+		bParsed = ParseWallpaperConfig(text.data(), text.size(), base, &config, &pResult->error);
+	}
+	Clock::time_point parsed = Clock::now();
+	if (!bParsed)
+		return false;
+
+	size_t cTokens = 0;
+	for (uint32_t nPass = 0; nPass < cPasses; nPass++) {
+		JsonReader reader(text.data(), text.size());
+		for (JSON_TOKEN token = reader.Next(); token != JSON_TOKEN_END && token != JSON_TOKEN_ERROR;
+			token = reader.Next())
+			cTokens++;
+	}
+	Clock::time_point scanned = Clock::now();
+
+	pResult->cTokens = cPasses ? (uint32_t)(cTokens / cPasses) : 0;
+	pResult->fParseMs = cPasses ? std::chrono::duration<double, std::milli>(parsed - start).count() / cPasses : 0.0;
+	pResult->fScanMs = cPasses ? std::chrono::duration<double, std::milli>(scanned - parsed).count() / cPasses : 0.0;
+	return true;
+}
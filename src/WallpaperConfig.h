@@ -0,0 +1,174 @@
+#pragma once
+#include "MonitorLayout.h"
+#include "Playlist.h"
+#include <string>
+#include <vector>
+
+
+// Power sources with a profile of their own.
+enum POWER_STATE
+{
+	POWER_STATE_AC = 0,
+	POWER_STATE_BATTERY,
+	POWER_STATE_SAVER,			// Battery saver is on
+	POWER_STATE_COUNT
+};
+
+// Frame rate cap on battery unless the config sets one.
+const float DEFAULT_BATTERY_FPS = 15.0f;
+
+struct PowerProfile
+{
+	float	fMaxFps;		// Frame rate cap, 0 = none
+	bool	bPause;			// No playback at all
+};
+
+// Settings of one monitor, found by device name or by position.
+struct MonitorConfig
+{
+	std::wstring	device;		// Display device name, e.g. \\.\DISPLAY2; empty = match nIndex
+	int32_t			nIndex;		// Position in the monitor enumeration, -1 = match device
+	bool			bEnabled;	// The video is drawn on this monitor
+	int32_t			nScale;		// SCALE_MODE of this monitor in clone layout, -1 = the global one
+
+	MonitorConfig() : nIndex(-1), bEnabled(true), nScale(-1)
+	{
+	}
+};
+
+// Everything a config file can set. Settings the file leaves out keep
+// the values given on the command line.
+struct WallpaperConfig
+{
+	std::vector<PlaylistItem>	clips;
+	PlaylistConfig	playlist;
+	float			fMaxFps;		// 0 = no cap
+	LAYOUT_MODE		layout;
+	SCALE_MODE		scale;
+	float			fVolume;		// 0 to 1
+	bool			bMute;
+	bool			bAdaptive;
+	PowerProfile	power[POWER_STATE_COUNT];
+	std::vector<MonitorConfig>	monitors;
+
+	WallpaperConfig();
+};
+
+// Where a config file failed to parse.
+struct ConfigError
+{
+	uint32_t	nLine;
+	uint32_t	nColumn;
+	const char*	pszMessage;
+};
+
+//-------------------------------------------------------------------
+// ParseWallpaperConfig
+//
+// Reads a config file, JSON with comments, in one pass over the text:
+//
+//   {
+//     "clips": [ "C:\\Clips\\sea.mp4", { "path": "D:\\night.mp4", "at": "21:00" } ],
+//     "interval": 600, "shuffle": true,
+//     "max-fps": 30, "layout": "clone", "scale": "fill",
+//     "volume": 0.5, "mute": false, "adaptive": true,
+//     "power": { "battery": { "max-fps": 10 }, "saver": { "pause": true } },
+//     "monitors": [ { "device": "\\\\.\\DISPLAY2", "enabled": false },
+//                   { "index": 0, "scale": "fit" } ]
+//   }
+//
+// Every member is optional and starts from base. Unknown members are
+// skipped, so files stay readable by older versions. Returns false and
+// fills pError on the first error; *pConfig is then undefined.
+//-------------------------------------------------------------------
+
+bool ParseWallpaperConfig(const char* pText, size_t cchText, const WallpaperConfig& base,
+	WallpaperConfig* pConfig, ConfigError* pError);
+
+
+// Parts of the config that changed, as a bit mask.
+enum CONFIG_CHANGE
+{
+	CONFIG_CHANGE_CLIPS = 0x01,
+	CONFIG_CHANGE_ROTATION = 0x02,		// Interval or order
+	CONFIG_CHANGE_FRAME_RATE = 0x04,
+	CONFIG_CHANGE_POWER = 0x08,
+	CONFIG_CHANGE_ADAPTIVE = 0x10,
+	CONFIG_CHANGE_LAYOUT = 0x20,		// Layout or scale
+	CONFIG_CHANGE_MONITORS = 0x40,
+	CONFIG_CHANGE_AUDIO = 0x80
+};
+
+uint32_t DiffWallpaperConfig(const WallpaperConfig& from, const WallpaperConfig& to);
+
+
+//-------------------------------------------------------------------
+//
+// IConfigTarget interface
+//
+// What a new config is applied to. Each method is only called when its
+// part of the config changed.
+//
+//-------------------------------------------------------------------
+
+class IConfigTarget
+{
+public:
+	virtual ~IConfigTarget() {}
+
+	// The clips or their rotation changed.
+	virtual void SetPlaylist(const std::vector<PlaylistItem>& clips, const PlaylistConfig& playlist) = 0;
+	virtual void SetAdaptive(bool bAdaptive) = 0;
+	virtual void SetFrameRate(float fMaxFps, const PowerProfile* pProfiles) = 0;
+	virtual void SetLayout(LAYOUT_MODE layout, SCALE_MODE scale, const std::vector<MonitorConfig>& monitors) = 0;
+	virtual void SetAudio(float fVolume, bool bMute) = 0;
+};
+
+//-------------------------------------------------------------------
+// ApplyWallpaperConfig
+//
+// Applies what differs between the config in effect and a new one, so
+// an edit of one setting does not disturb the others: only a change of
+// the clips can switch the clip played. Returns the CONFIG_CHANGE mask.
+//-------------------------------------------------------------------
+
+uint32_t ApplyWallpaperConfig(const WallpaperConfig& from, const WallpaperConfig& to, IConfigTarget* pTarget);
+
+//-------------------------------------------------------------------
+// SolveConfiguredLayout
+//
+// SolveMonitorLayout with the monitor settings of a config. Disabled
+// monitors get no viewport; a span covers the enabled ones. In clone
+// layout each monitor is scaled with its own mode. pDevices holds the
+// device name of each monitor. If no monitor is enabled, all are.
+//-------------------------------------------------------------------
+
+bool SolveConfiguredLayout(const LayoutParams& params, const MonitorDesc* pMonitors, const std::wstring* pDevices,
+	size_t cMonitors, const std::vector<MonitorConfig>& configs, std::vector<Viewport>* pViewports);
+
+// Settings of a monitor: the last entry that matches it, or the defaults.
+MonitorConfig FindMonitorConfig(const std::vector<MonitorConfig>& configs, size_t nIndex, const std::wstring& device);
+
+
+struct ConfigBenchResult
+{
+	size_t		cbText;
+	uint32_t	cTokens;		// JSON tokens in the text
+	double		fParseMs;		// Per ParseWallpaperConfig
+	double		fScanMs;		// Per pass of a JsonReader over the tokens alone
+	ConfigError	error;			// Of the parse, if it failed
+};
+
+// A config of cClips clips, each with a start time, and of every other
+// setting, as the config benchmark parses.
+std::string MakeBenchConfig(size_t cClips);
+
+//-------------------------------------------------------------------
+// RunConfigBench
+//
+// Parses a config cPasses times over base, then scans it as many times
+// for tokens only, and reports the time of each pass. False, with the
+// error, if the config does not parse.
+//-------------------------------------------------------------------
+
+bool RunConfigBench(const std::string& text, const WallpaperConfig& base, uint32_t cPasses, ConfigBenchResult* pResult);
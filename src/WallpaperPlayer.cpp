@@ -0,0 +1,55 @@
+#include "pch.h"
+#include "LiveWallpaper.h"
+#include "WallpaperPlayer.h"
+#include "MFPVideoPlayer.h"
+#include "SourceReaderPlayer.h"
+#include "SoftwareVideoPlayer.h"
+#include "SharedFramePlayer.h"
+#include "GenerativePlayer.h"
+
+
+//-----------------------------------------------------------------------------
+// CreateWallpaperPlayer
+//
+// Creates the player of a backend. *ppPlayer holds one reference.
+//-----------------------------------------------------------------------------
+
+HRESULT CreateWallpaperPlayer(PLAYER_BACKEND backend, PlayerEventQueue* pEvents, HWND hwndVideo, IWallpaperPlayer** ppPlayer)
+{
+	HRESULT hr = E_INVALIDARG;
+	*ppPlayer = NULL;
+
+	switch (backend) {
+	case PLAYER_BACKEND_MFPLAY: {
+		MFPVideoPlayer* pPlayer = NULL;
+		hr = MFPVideoPlayer::CreateInstance(pEvents, hwndVideo, &pPlayer);
+		*ppPlayer = pPlayer;
+		break;
+	}
+	case PLAYER_BACKEND_SOURCE_READER: {
+		SourceReaderPlayer* pPlayer = NULL;
+		hr = SourceReaderPlayer::CreateInstance(pEvents, hwndVideo, &pPlayer);
+		*ppPlayer = pPlayer;
+		break;
+	}
+	case PLAYER_BACKEND_SOFTWARE: {
+		SoftwareVideoPlayer* pPlayer = NULL;
+		hr = SoftwareVideoPlayer::CreateInstance(pEvents, hwndVideo, &pPlayer);
+		*ppPlayer = pPlayer;
+		break;
+	}
+	case PLAYER_BACKEND_SHARED: {
+		SharedFramePlayer* pPlayer = NULL;
+		hr = SharedFramePlayer::CreateInstance(pEvents, hwndVideo, &pPlayer);
+		*ppPlayer = pPlayer;
+		break;
+	}
+	case PLAYER_BACKEND_GENERATIVE: {
+		GenerativePlayer* pPlayer = NULL;
+		hr = GenerativePlayer::CreateInstance(pEvents, hwndVideo, &pPlayer);
+		*ppPlayer = pPlayer;
+		break;
+	}
+	}
+	return hr;
+}
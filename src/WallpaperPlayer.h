@@ -0,0 +1,118 @@
+#pragma once
+#include <mfplay.h>
+#include <mferror.h>
+#include "MonitorLayout.h"
+#include "PlaybackStats.h"
+#include "PlayerEventQueue.h"
+
+class ClipCache;
+class OverlayCompositor;
+
+
+// Implementation behind IWallpaperPlayer.
+enum PLAYER_BACKEND
+{
+	PLAYER_BACKEND_MFPLAY = 0,		// MFPlay and its presenter (MFPVideoPlayer)
+	PLAYER_BACKEND_SOURCE_READER,	// GPU decode presented with the video processor (SourceReaderPlayer)
+	PLAYER_BACKEND_SOFTWARE,		// CPU decode of Y4M clips drawn with GDI (SoftwareVideoPlayer)
+	PLAYER_BACKEND_SHARED,			// Frames of a broker process in shared memory drawn with GDI (SharedFramePlayer)
+	PLAYER_BACKEND_GENERATIVE		// Animations rendered on the CPU drawn with GDI (GenerativePlayer)
+};
+
+
+//-------------------------------------------------------------------
+//
+// IWallpaperPlayer interface
+//
+// Video player the application drives. Every implementation posts the
+// PLAYER_EVENT_* events to the application's PlayerEventQueue and draws
+// into its video window; the application does not know which one it
+// talks to.
+//
+//-------------------------------------------------------------------
+
+class IWallpaperPlayer
+{
+public:
+	virtual ULONG STDMETHODCALLTYPE AddRef() = 0;
+	virtual ULONG STDMETHODCALLTYPE Release() = 0;
+
+	virtual HRESULT OpenURL(const WCHAR* sURL) = 0;
+
+	// Plays a source from MFPVideoPlayer::ResolveSource. The player shuts it
+	// down once another clip is set or the player shuts down. Players that
+	// read their clips themselves return E_NOTIMPL and leave it alone.
+	// sURL is the clip the source was resolved from, or NULL.
+	virtual HRESULT OpenSource(IMFMediaSource* pSource, const WCHAR* sURL) = 0;
+
+	// Loop cache. The Media Foundation players read clips of up to cbBudget
+	// bytes into memory once and demux and decode them from there on every
+	// pass; it saves file reads only. The software player keeps up to
+	// cbBudget bytes of raw frames from the start of the clip and converts
+	// them instead of reading them again. 0 disables it (the default).
+	virtual void SetLoopCacheBudget(size_t cbBudget) = 0;
+
+	// Optional collector of player events, errors and frame timings.
+	virtual void SetStats(PlaybackStats* pStats) = 0;
+
+	// Optional cache of wallpaper-optimized copies: OpenURL and PrepareURL
+	// open the cached copy of a clip when there is a fresh one.
+	virtual void SetClipCache(ClipCache* pCache) = 0;
+
+	// Directory the player keeps container indexes of its clips in, see
+	// ContainerIndex. NULL, the default, keeps none.
+	virtual void SetIndexDirectory(const WCHAR* pszDirectory) = 0;
+
+	// Prepared clip: opened in the background while the current one keeps
+	// playing, then swapped in with SwitchToPrepared.
+	virtual HRESULT PrepareURL(const WCHAR* sURL) = 0;
+	virtual bool IsPrepared() = 0;
+	virtual HRESULT SwitchToPrepared() = 0;
+	virtual void CancelPrepared() = 0;
+
+	virtual HRESULT Shutdown() = 0;
+	virtual MFP_MEDIAPLAYER_STATE GetState() noexcept = 0;
+	virtual bool Play() noexcept = 0;
+	virtual bool Pause() noexcept = 0;
+	virtual bool Stop() noexcept = 0;
+	virtual float GetVolume() noexcept = 0;
+	virtual bool SetVolume(float fVolume) noexcept = 0;
+	virtual bool GetMute() noexcept = 0;
+	virtual bool SetMute(bool bMute) noexcept = 0;
+	virtual float GetRate() noexcept = 0;
+	virtual bool SetRate(float fRate) noexcept = 0;
+
+	// Frame rate cap, 0 = none. E_NOTIMPL if the player cannot decimate.
+	virtual HRESULT SetMaxFrameRate(float fFps) = 0;
+
+	// Seeking
+	virtual HRESULT GetDuration(MFTIME *phnsDuration) = 0;
+	virtual HRESULT CanSeek(BOOL *pbCanSeek) = 0;
+	virtual HRESULT GetCurrentPosition(MFTIME *phnsPosition) = 0;
+	virtual HRESULT SetPosition(MFTIME hnsPosition) = 0;
+
+	// Video
+	virtual HRESULT GetVideoSize(SIZE* pszVideo) = 0;
+
+	// Shows the viewports of a monitor layout in the video window. E_NOTIMPL
+	// if the player cannot show this layout.
+	virtual HRESULT SetViewports(const Viewport* pViewports, size_t cViewports, const SIZE& szSource) = 0;
+
+	// Presents the current frame again, e.g. after the window was resized.
+	virtual void UpdateVideo() = 0;
+
+	// Draws the widgets of pOverlay over every frame; nullptr for none. It
+	// must outlive the player. E_NOTIMPL if the frames never reach the CPU.
+	virtual HRESULT SetOverlay(OverlayCompositor* pOverlay) = 0;
+
+	// Draws the overlay's changes, e.g. a clock tick, over the frame shown.
+	virtual void UpdateOverlay() = 0;
+
+protected:
+	virtual ~IWallpaperPlayer() {}
+};
+
+
+// Creates a player of the given backend that posts its events to
+// pEvents and draws into hwndVideo.
+HRESULT CreateWallpaperPlayer(PLAYER_BACKEND backend, PlayerEventQueue* pEvents, HWND hwndVideo, IWallpaperPlayer** ppPlayer);
@@ -0,0 +1,252 @@
+#include "Y4MSource.h"
+#include "FileUtil.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Longest header or FRAME line accepted.
+static const size_t MAX_LINE = 4096;
+
+
+// Reads a line into pszLine of MAX_LINE + 1 chars, without the newline.
+static bool ReadLine(FILE* fp, char* pszLine, size_t* pcch)
+{
+	size_t cch = 0;
+	for (;;) {
+		int c = getc(fp);
+		if (c == EOF)
+			return false;
+		if (c == '\n')
+			break;
+		if (cch >= MAX_LINE)
+			return false;
+		pszLine[cch++] = (char)c;
+	}
+	pszLine[cch] = 0;
+	*pcch = cch;
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+Y4MSource::Y4MSource(Arena* pArena) : m_fp(NULL), m_pArena(pArena ? pArena : &m_arena), m_pOffsets(NULL), m_cFrames(0)
+{
+	m_format = Y4MFormat();
+}
+
+//-----------------------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------------------
+
+Y4MSource::~Y4MSource()
+{
+	Close();
+}
+
+bool Y4MSource::Open(const std::wstring& path)
+{
+	Close();
+	m_fp = FileOpen(path, "rb");
+	if (!m_fp)
+		return false;
+	if (!ParseHeader() || !IndexFrames()) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void Y4MSource::Close()
+{
+	if (m_fp)
+		fclose(m_fp);
+	m_fp = NULL;
+	m_format = Y4MFormat();
+	m_pOffsets = NULL;
+	m_cFrames = 0;
+	if (m_pArena == &m_arena)
+		m_arena.Reset();
+}
+
+HNSTIME Y4MSource::GetFrameTime(uint64_t nFrame) const
+{
+	const FrameRate& rate = m_format.rate;
+	return (HNSTIME)(nFrame * rate.nDen * (uint64_t)HNS_PER_SECOND / rate.nNum);
+}
+
+uint64_t Y4MSource::GetFrameAt(HNSTIME hnsPosition) const
+{
+	if (hnsPosition <= 0)
+		return 0;
+	const FrameRate& rate = m_format.rate;
+	uint64_t nFrame = (uint64_t)hnsPosition * rate.nNum / ((uint64_t)rate.nDen * HNS_PER_SECOND);
+	return nFrame < m_cFrames ? nFrame : m_cFrames;
+}
+
+bool Y4MSource::ReadFrame(uint64_t nFrame, uint8_t* pRaw)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_fp || nFrame >= m_cFrames || !Seek(m_pOffsets[nFrame]))
+		return false;
+	return fread(pRaw, 1, m_format.cbFrame, m_fp) == m_format.cbFrame;
+}
+
+void Y4MSource::GetImage(const uint8_t* pRaw, YCbCrImage* pImage) const
+{
+	const Y4MFormat& format = m_format;
+	size_t cbLuma = (size_t)format.cx * format.cy;
+	size_t cbChroma = (size_t)format.cxChroma * format.cyChroma;
+
+	*pImage = YCbCrImage();
+	pImage->pY = pRaw;
+	pImage->pCb = format.chroma != Y4M_CHROMA_MONO ? pRaw + cbLuma : NULL;
+	pImage->pCr = format.chroma != Y4M_CHROMA_MONO ? pRaw + cbLuma + cbChroma : NULL;
+	pImage->cbStrideY = format.cx;
+	pImage->cbStrideC = format.cxChroma;
+	pImage->cx = format.cx;
+	pImage->cy = format.cy;
+	pImage->nShiftX = format.nShiftX;
+	pImage->nShiftY = format.nShiftY;
+	pImage->matrix = format.cy >= 720 ? COLOR_MATRIX_BT709 : COLOR_MATRIX_BT601;
+	pImage->bFullRange = format.bFullRange;
+}
+
+//-----------------------------------------------------------------------------
+// ParseHeader
+//
+// "YUV4MPEG2 W<w> H<h> F<num>:<den> [I..] [A..] [C<chroma>] [X..]". Only
+// 8-bit progressive chroma layouts are supported.
+//-----------------------------------------------------------------------------
+
+bool Y4MSource::ParseHeader()
+{
+	char szLine[MAX_LINE + 1];
+	size_t cchLine = 0;
+	if (!ReadLine(m_fp, szLine, &cchLine) || strncmp(szLine, "YUV4MPEG2 ", 10) != 0)
+		return false;
+
+	Y4MFormat format = Y4MFormat();
+	format.rate.nNum = 25;
+	format.rate.nDen = 1;
+
+	// Tokens are cut in place.
+	char* pszToken = szLine + 10;
+	while (pszToken < szLine + cchLine) {
+		char* pszSpace = strchr(pszToken, ' ');
+		if (pszSpace)
+			*pszSpace = 0;
+		else
+			pszSpace = szLine + cchLine;
+		char chTag = *pszToken;
+		const char* psz = pszToken + 1;
+		pszToken = pszSpace + 1;
+		if (!chTag)
+			continue;
+
+		switch (chTag) {
+		case 'W':
+			format.cx = (uint32_t)strtoul(psz, NULL, 10);
+			break;
+		case 'H':
+			format.cy = (uint32_t)strtoul(psz, NULL, 10);
+			break;
+		case 'F': {
+			char* pszEnd = NULL;
+			uint32_t nNum = (uint32_t)strtoul(psz, &pszEnd, 10);
+			uint32_t nDen = *pszEnd == ':' ? (uint32_t)strtoul(pszEnd + 1, NULL, 10) : 0;
+			if (!nNum || !nDen)
+				return false;
+			format.rate.nNum = nNum;
+			format.rate.nDen = nDen;
+			break;
+		}
+		case 'I':
+			if (*psz != 'p' && *psz != '?')
+				return false;
+			break;
+		case 'C':
+			if (strncmp(psz, "420", 3) == 0 && (psz[3] == 0 || strcmp(psz + 3, "jpeg") == 0 ||
+				strcmp(psz + 3, "mpeg2") == 0 || strcmp(psz + 3, "paldv") == 0))
+				format.chroma = Y4M_CHROMA_420;
+			else if (strcmp(psz, "422") == 0)
+				format.chroma = Y4M_CHROMA_422;
+			else if (strcmp(psz, "444") == 0)
+				format.chroma = Y4M_CHROMA_444;
+			else if (strcmp(psz, "mono") == 0)
+				format.chroma = Y4M_CHROMA_MONO;
+			else
+				return false;
+			break;
+		case 'X':
+			if (strcmp(psz, "COLORRANGE=FULL") == 0)
+				format.bFullRange = true;
+			break;
+		}
+	}
+	if (!format.cx || !format.cy)
+		return false;
+
+	format.nShiftX = format.chroma == Y4M_CHROMA_420 || format.chroma == Y4M_CHROMA_422 ? 1 : 0;
+	format.nShiftY = format.chroma == Y4M_CHROMA_420 ? 1 : 0;
+	format.cxChroma = (format.cx + (1 << format.nShiftX) - 1) >> format.nShiftX;
+	format.cyChroma = (format.cy + (1 << format.nShiftY) - 1) >> format.nShiftY;
+	format.cbFrame = (size_t)format.cx * format.cy;
+	if (format.chroma != Y4M_CHROMA_MONO)
+		format.cbFrame += 2 * (size_t)format.cxChroma * format.cyChroma;
+	m_format = format;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// IndexFrames
+//
+// FRAME lines may carry parameters, so the planes do not sit at a fixed
+// stride; each header is read once here. A truncated last frame is left
+// out.
+//-----------------------------------------------------------------------------
+
+bool Y4MSource::IndexFrames()
+{
+	char szLine[MAX_LINE + 1];
+	size_t cchLine = 0;
+	uint64_t nOffset = (uint64_t)ftell(m_fp);
+
+	// Every frame takes at least "FRAME\n" and its planes, which bounds
+	// the table by the file size.
+	if (fseek(m_fp, 0, SEEK_END) != 0)
+		return false;
+#ifdef _WIN32
+	uint64_t cbFile = (uint64_t)_ftelli64(m_fp);
+#else
+	uint64_t cbFile = (uint64_t)ftello(m_fp);
+#endif
+	uint64_t cMaxFrames = cbFile > nOffset ? (cbFile - nOffset) / (m_format.cbFrame + 6) : 0;
+	if (!cMaxFrames)
+		return false;
+	m_pOffsets = m_pArena->NewArray<uint64_t>((size_t)cMaxFrames);
+	if (!m_pOffsets)
+		return false;
+
+	m_cFrames = 0;
+	while (m_cFrames < cMaxFrames) {
+		if (!Seek(nOffset) || !ReadLine(m_fp, szLine, &cchLine) || strncmp(szLine, "FRAME", 5) != 0)
+			break;
+		nOffset += cchLine + 1;
+		if (!Seek(nOffset + m_format.cbFrame - 1) || getc(m_fp) == EOF)
+			break;
+		m_pOffsets[m_cFrames++] = nOffset;
+		nOffset += m_format.cbFrame;
+	}
+	return m_cFrames != 0;
+}
+
+bool Y4MSource::Seek(uint64_t nOffset)
+{
+#ifdef _WIN32
+	return _fseeki64(m_fp, (__int64)nOffset, SEEK_SET) == 0;
+#else
+	return fseeko(m_fp, (off_t)nOffset, SEEK_SET) == 0;
+#endif
+}
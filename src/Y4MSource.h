@@ -0,0 +1,88 @@
+#pragma once
+#include "PlaybackClock.h"
+#include "FramePacer.h"
+#include "ColorConvert.h"
+#include "Arena.h"
+#include <stdio.h>
+#include <mutex>
+#include <string>
+
+
+// Chroma layout of a Y4M stream.
+enum Y4M_CHROMA
+{
+	Y4M_CHROMA_420 = 0,
+	Y4M_CHROMA_422,
+	Y4M_CHROMA_444,
+	Y4M_CHROMA_MONO
+};
+
+struct Y4MFormat
+{
+	uint32_t	cx;
+	uint32_t	cy;
+	FrameRate	rate;
+	Y4M_CHROMA	chroma;
+	uint32_t	nShiftX;	// Chroma subsampling
+	uint32_t	nShiftY;
+	uint32_t	cxChroma;
+	uint32_t	cyChroma;
+	bool		bFullRange;	// XCOLORRANGE=FULL
+	size_t		cbFrame;	// Raw planes of one frame
+};
+
+
+//-------------------------------------------------------------------
+//
+// Y4MSource class
+//
+// Reads YUV4MPEG2 clips: a text header, then raw 8-bit planar frames,
+// each behind a FRAME line. The frames are independent, so any frame
+// can be read directly and several can be decoded in parallel.
+//
+// Opening indexes the frame offsets into a table carved from the arena
+// the source is given, so a media item's source, table and all go with
+// its arena; without one the source uses an arena of its own. Reads are
+// serialized on the file and thread-safe.
+//
+//-------------------------------------------------------------------
+
+class Y4MSource
+{
+public:
+	// Reopening carves a new table from pArena, which keeps the old one
+	// until it resets.
+	explicit Y4MSource(Arena* pArena = nullptr);
+	~Y4MSource();
+
+	bool Open(const std::wstring& path);
+	void Close();
+
+	const Y4MFormat& GetFormat() const { return m_format; }
+	uint64_t GetFrameCount() const { return m_cFrames; }
+	HNSTIME GetDuration() const { return GetFrameTime(GetFrameCount()); }
+	HNSTIME GetFrameTime(uint64_t nFrame) const;
+
+	// Frame shown at hnsPosition.
+	uint64_t GetFrameAt(HNSTIME hnsPosition) const;
+
+	// Reads the planes of frame nFrame, Y then Cb and Cr, into pRaw of
+	// GetFormat().cbFrame bytes.
+	bool ReadFrame(uint64_t nFrame, uint8_t* pRaw);
+
+	// Describes raw planes read by ReadFrame for the color converter.
+	void GetImage(const uint8_t* pRaw, YCbCrImage* pImage) const;
+
+private:
+	bool ParseHeader();
+	bool IndexFrames();
+	bool Seek(uint64_t nOffset);
+
+	FILE*					m_fp;
+	Y4MFormat				m_format;
+	Arena					m_arena;		// Used without an arena of the owner's
+	Arena*					m_pArena;
+	uint64_t*				m_pOffsets;		// File offset of each frame's planes
+	uint64_t				m_cFrames;
+	std::mutex				m_mutex;
+};
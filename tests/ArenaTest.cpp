@@ -0,0 +1,169 @@
+//-------------------------------------------------------------------
+//
+// ArenaTest
+//
+// Allocations of an Arena must be aligned and disjoint, a reset must run
+// the destructors newest first and make the next fill of the same size
+// without touching the heap, and a checked arena must catch a write past
+// an allocation. An ObjectPool must reuse deleted slots and, checked,
+// count deletes of dead objects and objects never deleted.
+//
+//-------------------------------------------------------------------
+
+#include "Arena.h"
+#include "CountingAllocator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+// Fills an arena with blocks of mixed sizes and alignments, stamped with
+// their number, and checks each one.
+static bool FillArena(Arena* pArena, uint32_t cBlocks)
+{
+	static const size_t ALIGNS[] = { 1, 8, 16, 32, 64 };
+	uint8_t* pBlocks[64];
+	size_t cbBlocks[64];
+	if (cBlocks > sizeof(pBlocks) / sizeof(pBlocks[0]))
+		return false;
+
+	bool bPassed = true;
+	for (uint32_t i = 0; i < cBlocks; i++) {
+		size_t cbAlign = ALIGNS[i % (sizeof(ALIGNS) / sizeof(ALIGNS[0]))];
+		cbBlocks[i] = 1 + (i * 977) % 3000;
+		pBlocks[i] = (uint8_t*)pArena->Allocate(cbBlocks[i], cbAlign);
+		bPassed &= pBlocks[i] && ((uintptr_t)pBlocks[i] & (cbAlign - 1)) == 0;
+		if (pBlocks[i])
+			memset(pBlocks[i], (int)i, cbBlocks[i]);
+	}
+	for (uint32_t i = 0; bPassed && i < cBlocks; i++) {
+		for (size_t n = 0; n < cbBlocks[i]; n++)
+			bPassed &= pBlocks[i][n] == (uint8_t)i;
+	}
+	return bPassed;
+}
+
+static bool CheckAllocate()
+{
+	Arena arena(4096);
+	uint64_t cAllocations = GetAllocationCount();
+	bool bPassed = FillArena(&arena, 40) && arena.GetStats().cChunks > 1;
+	bPassed &= GetAllocationCount() - cAllocations == arena.GetStats().cChunks;		// One per chunk
+	bPassed &= arena.Allocate(16, 3) == nullptr && arena.Allocate(16, 128) == nullptr;
+	bPassed &= arena.NewArray<uint64_t>((size_t)-1 / 4) == nullptr;
+	uint32_t* pZeroed = arena.NewArray<uint32_t>(100);
+	for (int i = 0; pZeroed && i < 100; i++)
+		bPassed &= pZeroed[i] == 0;
+	return Report("allocate", bPassed && pZeroed);
+}
+
+// After the first fill, fills of the same size come from the chunk the
+// reset made.
+static bool CheckReuse()
+{
+	Arena arena(4096);
+	bool bPassed = FillArena(&arena, 40);
+	arena.Reset();
+	uint64_t cChunks = arena.GetStats().cChunks;
+	uint64_t cAllocations = GetAllocationCount();
+	for (int nFill = 0; nFill < 10; nFill++) {
+		bPassed &= FillArena(&arena, 40);
+		arena.Reset();
+	}
+	ArenaStats stats = arena.GetStats();
+	bPassed &= stats.cChunks == cChunks && GetAllocationCount() == cAllocations && stats.cbUsed == 0;
+	arena.Release();
+	bPassed &= arena.GetStats().cbReserved == 0;
+	return Report("reuse", bPassed);
+}
+
+struct Tracked
+{
+	Tracked(int nId, int* pOrder, int* pcDestroyed) : nId(nId), pOrder(pOrder), pcDestroyed(pcDestroyed) {}
+	~Tracked() { pOrder[(*pcDestroyed)++] = nId; }
+
+	int		nId;
+	int*	pOrder;
+	int*	pcDestroyed;
+};
+
+static bool CheckDestructors()
+{
+	int order[8] = {};
+	int cDestroyed = 0;
+	bool bPassed = true;
+	{
+		Arena arena;
+		for (int i = 0; i < 4; i++)
+			bPassed &= arena.New<Tracked>(i, order, &cDestroyed) != nullptr;
+		bPassed &= arena.New<uint64_t>(7ull) != nullptr && cDestroyed == 0;
+		arena.Reset();
+		bPassed &= cDestroyed == 4 && order[0] == 3 && order[3] == 0;
+		arena.New<Tracked>(9, order, &cDestroyed);
+	}
+	bPassed &= cDestroyed == 5 && order[4] == 9;
+	return Report("destructors", bPassed);
+}
+
+static bool CheckOverrun()
+{
+	Arena checked;
+	bool bPassed = checked.SetChecking(true);
+	uint8_t* p = (uint8_t*)checked.Allocate(10);
+	checked.Allocate(20);
+	bPassed &= checked.Check() && !checked.SetChecking(false);
+	p[10] = 0;
+	bPassed &= !checked.Check() && checked.GetStats().cOverruns == 1;
+	checked.Reset();
+	bPassed &= checked.GetStats().cOverruns == 2 && checked.Check();
+
+	// Unchecked arenas pack allocations without guards.
+	Arena plain;
+	plain.SetChecking(false);
+	uint8_t* pFirst = (uint8_t*)plain.Allocate(16, 16);
+	uint8_t* pSecond = (uint8_t*)plain.Allocate(16, 16);
+	bPassed &= pSecond == pFirst + 16 && plain.Check();
+	return Report("overrun", bPassed);
+}
+
+static bool CheckPool()
+{
+	int order[128] = {};
+	int cDestroyed = 0;
+	Arena arena;
+	arena.SetChecking(true);
+	bool bPassed = true;
+	{
+		ObjectPool<Tracked> pool(&arena, 4);
+		Tracked* pObjects[4];
+		for (int i = 0; i < 4; i++)
+			pObjects[i] = pool.New(i, order, &cDestroyed);
+		uint64_t cChunks = arena.GetStats().cChunks;
+		for (int nRound = 0; nRound < 100; nRound++) {
+			pool.Delete(pObjects[nRound % 4]);
+			pObjects[nRound % 4] = pool.New(nRound, order, &cDestroyed);
+		}
+		bPassed &= pool.GetSlotCount() == 4 && pool.GetLiveCount() == 4 && arena.GetStats().cChunks == cChunks;
+
+		pool.Delete(pObjects[0]);
+		pool.Delete(pObjects[0]);
+		bPassed &= arena.GetStats().cBadDeletes == 1 && pool.GetLiveCount() == 3;
+	}
+	bPassed &= arena.GetStats().cLeaks == 3;
+	return Report("pool", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckAllocate();
+	bPassed &= CheckReuse();
+	bPassed &= CheckDestructors();
+	bPassed &= CheckOverrun();
+	bPassed &= CheckPool();
+	return bPassed ? 0 : 1;
+}
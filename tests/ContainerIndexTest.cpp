@@ -0,0 +1,430 @@
+//-------------------------------------------------------------------
+//
+// ContainerIndexTest
+//
+// Writes MP4 files with the sample table layouts encoders produce and
+// checks the keyframes indexed from each: stsz and stz2 at 4, 8 and 16
+// bits, 32 and 64-bit chunk offsets, and no stss, where every sample is
+// a keyframe. Fragmented files must not be indexed, and files cut short
+// or with a box or table that overruns its parent must fail to build;
+// run under ASan to see that nothing is read past them. An index file
+// must be rebuilt when its source changes, or when it is cut short or
+// its header is damaged.
+//
+//-------------------------------------------------------------------
+
+#include "ContainerIndex.h"
+#include "Mp4Writer.h"
+#include "TestFiles.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const uint32_t CLIP_TIMESCALE = 30000;
+static const uint32_t CLIP_FRAME_TICKS = 1000;		// 30 fps
+static const uint32_t CHUNK_SAMPLES = 4;			// Not a multiple of any GOP, so GOPs span chunks
+static const uint64_t CHUNK_STRIDE = 1 << 20;
+static const int64_t SOURCE_TIME = 1500000000;
+static const wchar_t SOURCE_PATH[] = L"container_index_test.mp4";
+
+struct ClipSpec
+{
+	uint32_t	cFrames;
+	uint32_t	nGop;			// Frames per GOP; 0 writes no stss
+	uint32_t	nSizeBits;		// 32 writes stsz; 4, 8 or 16 write stz2
+	bool		b64;			// co64, with chunks past 4 GB
+	bool		bFragmented;	// An mvex in the moov
+	uint32_t	nSizeSeed;		// Varies the sample sizes, not the file size
+};
+
+// A box of the written file, by type and offset.
+struct BoxAt
+{
+	char	type[5];
+	size_t	nAt;
+};
+
+static ClipSpec MakeSpec(uint32_t cFrames, uint32_t nGop, uint32_t nSizeBits, bool b64)
+{
+	ClipSpec spec = { cFrames, nGop, nSizeBits, b64, false, 1 };
+	return spec;
+}
+
+// Sizes that need all the bits of the field.
+static uint32_t GetSampleSize(const ClipSpec& spec, uint32_t nFrame)
+{
+	uint32_t nMax = spec.nSizeBits < 32 ? (1u << spec.nSizeBits) - 1 : 200000;
+	return 1 + (nFrame * 7919 + spec.nSizeSeed * 104729) % nMax;
+}
+
+static uint64_t GetChunkOffset(const ClipSpec& spec, uint32_t nChunk)
+{
+	return (spec.b64 ? 5ull << 30 : 4096) + nChunk * CHUNK_STRIDE;
+}
+
+static HNSTIME GetFrameTime(uint32_t nFrame)
+{
+	return (HNSTIME)nFrame * CLIP_FRAME_TICKS * HNS_PER_SECOND / CLIP_TIMESCALE;
+}
+
+static size_t Begin(std::vector<uint8_t>* pOut, const char* pszType, std::vector<BoxAt>* pBoxes, bool bFull = false)
+{
+	BoxAt box;
+	memcpy(box.type, pszType, 5);
+	box.nAt = BeginBox(pOut, pszType, bFull);
+	pBoxes->push_back(box);
+	return box.nAt;
+}
+
+//-----------------------------------------------------------------------------
+// MakeClip
+//
+// ftyp, an empty mdat, then the moov with the tables of one video track,
+// so that any cut of the file loses part of the tables. Samples are
+// CHUNK_SAMPLES to a chunk, the last chunk takes what is left, and the
+// chunks lie CHUNK_STRIDE apart; the media data is never read.
+//-----------------------------------------------------------------------------
+
+static void MakeClip(const ClipSpec& spec, std::vector<uint8_t>* pFile, std::vector<BoxAt>* pBoxes)
+{
+	std::vector<uint8_t>& out = *pFile;
+	out.clear();
+	pBoxes->clear();
+	size_t nBox = Begin(&out, "ftyp", pBoxes);
+	out.insert(out.end(), "isom", "isom" + 4);
+	PutBE32(&out, 0x200);
+	out.insert(out.end(), "isomavc1", "isomavc1" + 8);
+	EndBox(&out, nBox);
+	EndBox(&out, Begin(&out, "mdat", pBoxes));
+
+	size_t nMoov = Begin(&out, "moov", pBoxes);
+	size_t nTrak = Begin(&out, "trak", pBoxes);
+	size_t nMdia = Begin(&out, "mdia", pBoxes);
+	nBox = Begin(&out, "mdhd", pBoxes, true);
+	PutBE32(&out, 0);
+	PutBE32(&out, 0);
+	PutBE32(&out, CLIP_TIMESCALE);
+	PutBE32(&out, spec.cFrames * CLIP_FRAME_TICKS);
+	PutBE32(&out, 0x55C40000);		// Language und
+	EndBox(&out, nBox);
+	nBox = Begin(&out, "hdlr", pBoxes, true);
+	PutBE32(&out, 0);
+	out.insert(out.end(), "vide", "vide" + 4);
+	for (int i = 0; i < 4; i++)
+		PutBE32(&out, 0);
+	EndBox(&out, nBox);
+	size_t nMinf = Begin(&out, "minf", pBoxes);
+	size_t nStbl = Begin(&out, "stbl", pBoxes);
+
+	nBox = Begin(&out, "stts", pBoxes, true);
+	PutBE32(&out, 1);
+	PutBE32(&out, spec.cFrames);
+	PutBE32(&out, CLIP_FRAME_TICKS);
+	EndBox(&out, nBox);
+	if (spec.nGop) {
+		uint32_t cGops = (spec.cFrames + spec.nGop - 1) / spec.nGop;
+		nBox = Begin(&out, "stss", pBoxes, true);
+		PutBE32(&out, cGops);
+		for (uint32_t g = 0; g < cGops; g++)
+			PutBE32(&out, g * spec.nGop + 1);
+		EndBox(&out, nBox);
+	}
+	if (spec.nSizeBits == 32) {
+		nBox = Begin(&out, "stsz", pBoxes, true);
+		PutBE32(&out, 0);
+		PutBE32(&out, spec.cFrames);
+		for (uint32_t n = 0; n < spec.cFrames; n++)
+			PutBE32(&out, GetSampleSize(spec, n));
+	}
+	else {
+		nBox = Begin(&out, "stz2", pBoxes, true);
+		PutBE32(&out, spec.nSizeBits);
+		PutBE32(&out, spec.cFrames);
+		for (uint32_t n = 0; n < spec.cFrames; n++) {
+			uint32_t cb = GetSampleSize(spec, n);
+			if (spec.nSizeBits == 16) {
+				out.push_back((uint8_t)(cb >> 8));
+				out.push_back((uint8_t)cb);
+			}
+			else if (spec.nSizeBits == 8)
+				out.push_back((uint8_t)cb);
+			else if (n & 1)
+				out.back() |= (uint8_t)cb;
+			else
+				out.push_back((uint8_t)(cb << 4));
+		}
+	}
+	EndBox(&out, nBox);
+	uint32_t cChunks = (spec.cFrames + CHUNK_SAMPLES - 1) / CHUNK_SAMPLES;
+	nBox = Begin(&out, "stsc", pBoxes, true);
+	PutBE32(&out, spec.cFrames % CHUNK_SAMPLES ? 2 : 1);
+	PutBE32(&out, 1);
+	PutBE32(&out, CHUNK_SAMPLES);
+	PutBE32(&out, 1);
+	if (spec.cFrames % CHUNK_SAMPLES) {
+		PutBE32(&out, cChunks);
+		PutBE32(&out, spec.cFrames % CHUNK_SAMPLES);
+		PutBE32(&out, 1);
+	}
+	EndBox(&out, nBox);
+	nBox = Begin(&out, spec.b64 ? "co64" : "stco", pBoxes, true);
+	PutBE32(&out, cChunks);
+	for (uint32_t c = 0; c < cChunks; c++) {
+		if (spec.b64)
+			PutBE64(&out, GetChunkOffset(spec, c));
+		else
+			PutBE32(&out, (uint32_t)GetChunkOffset(spec, c));
+	}
+	EndBox(&out, nBox);
+
+	EndBox(&out, nStbl);
+	EndBox(&out, nMinf);
+	EndBox(&out, nMdia);
+	EndBox(&out, nTrak);
+	if (spec.bFragmented) {
+		size_t nMvex = Begin(&out, "mvex", pBoxes);
+		nBox = Begin(&out, "trex", pBoxes, true);
+		PutBE32(&out, 1);
+		for (int i = 0; i < 4; i++)
+			PutBE32(&out, 0);
+		EndBox(&out, nBox);
+		EndBox(&out, nMvex);
+	}
+	EndBox(&out, nMoov);
+}
+
+static bool WriteClip(const ClipSpec& spec)
+{
+	std::vector<uint8_t> file;
+	std::vector<BoxAt> boxes;
+	MakeClip(spec, &file, &boxes);
+	return WriteTestFile(SOURCE_PATH, file) && SetFileModified(SOURCE_PATH, SOURCE_TIME);
+}
+
+// The keyframes the tables of spec describe, worked out sample by sample.
+static std::vector<IndexKeyframe> GetExpectedKeyframes(const ClipSpec& spec)
+{
+	std::vector<IndexKeyframe> keyframes;
+	uint64_t nOffset = 0;
+	for (uint32_t n = 0; n < spec.cFrames; n++) {
+		if (n % CHUNK_SAMPLES == 0)
+			nOffset = GetChunkOffset(spec, n / CHUNK_SAMPLES);
+		uint64_t nEnd = nOffset + GetSampleSize(spec, n);
+		if (spec.nGop == 0 || n % spec.nGop == 0) {
+			IndexKeyframe keyframe = { GetFrameTime(n), nOffset, nEnd, n, 0 };
+			keyframes.push_back(keyframe);
+		}
+		IndexKeyframe& gop = keyframes.back();
+		gop.cFrames++;
+		if (nEnd > gop.nEndOffset)
+			gop.nEndOffset = nEnd;
+		nOffset = nEnd;
+	}
+	return keyframes;
+}
+
+static bool IsIndexOf(const ContainerIndex& index, const ClipSpec& spec)
+{
+	std::vector<IndexKeyframe> expected = GetExpectedKeyframes(spec);
+	if (index.GetKeyframeCount() != expected.size() || index.GetFrameCount() != spec.cFrames ||
+		index.GetDuration() != GetFrameTime(spec.cFrames) || !index.StartsWithKeyframe())
+		return false;
+	for (size_t i = 0; i < expected.size(); i++) {
+		const IndexKeyframe& k = index.GetKeyframe(i);
+		const IndexKeyframe& e = expected[i];
+		if (k.hnsTime != e.hnsTime || k.nOffset != e.nOffset || k.nEndOffset != e.nEndOffset ||
+			k.nFrame != e.nFrame || k.cFrames != e.cFrames || index.FindKeyframe(e.hnsTime) != i)
+			return false;
+	}
+	return true;
+}
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+// Every sample size field width gives the same keyframes as the tables
+// describe, whether a GOP fills its chunks or spans them.
+static bool CheckSampleSizes()
+{
+	const uint32_t bits[] = { 32, 16, 8, 4 };
+	bool bPassed = true;
+	for (size_t b = 0; b < sizeof(bits) / sizeof(bits[0]); b++) {
+		const uint32_t frames[] = { 60, 61, 63 };
+		for (size_t f = 0; f < sizeof(frames) / sizeof(frames[0]); f++) {
+			ClipSpec spec = MakeSpec(frames[f], 10, bits[b], false);
+			ContainerIndex index;
+			bPassed &= WriteClip(spec) && index.Build(SOURCE_PATH) && IsIndexOf(index, spec);
+		}
+	}
+	return Report("stsz and stz2 sample sizes", bPassed);
+}
+
+// co64 chunk offsets past 4 GB come through whole.
+static bool CheckChunkOffsets64()
+{
+	ClipSpec spec = MakeSpec(45, 12, 32, true);
+	ContainerIndex index;
+	bool bPassed = WriteClip(spec) && index.Build(SOURCE_PATH) && IsIndexOf(index, spec) &&
+		index.GetKeyframe(0).nOffset > 0xFFFFFFFFull;
+	spec = MakeSpec(45, 12, 8, true);
+	bPassed &= WriteClip(spec) && index.Build(SOURCE_PATH) && IsIndexOf(index, spec);
+	return Report("co64 chunk offsets", bPassed);
+}
+
+// Without stss every sample is a keyframe of a GOP of one.
+static bool CheckNoSyncTable()
+{
+	ClipSpec spec = MakeSpec(30, 0, 16, false);
+	ContainerIndex index;
+	bool bPassed = WriteClip(spec) && index.Build(SOURCE_PATH) && IsIndexOf(index, spec) &&
+		index.GetKeyframeCount() == index.GetFrameCount() && index.GetKeyframe(29).cFrames == 1;
+	return Report("no stss", bPassed);
+}
+
+// A fragmented file has no samples in its tables and gets no index, not
+// even an empty one written.
+static bool CheckFragmented()
+{
+	ClipSpec spec = MakeSpec(30, 10, 32, false);
+	spec.bFragmented = true;
+	std::wstring indexPath = ContainerIndex::GetIndexPath(L".", SOURCE_PATH);
+	RemoveFile(indexPath);
+	ContainerIndex index;
+	FileInfo info;
+	bool bPassed = WriteClip(spec) && !index.Build(SOURCE_PATH) && index.IsEmpty() &&
+		!index.Open(SOURCE_PATH, indexPath) && !GetFileInfo(indexPath, &info);
+	return Report("fragmented file rejected", bPassed);
+}
+
+//-----------------------------------------------------------------------------
+// CheckMalformed
+//
+// The file cut to every shorter length, every box grown past its parent,
+// and tables whose counts overrun them or whose field width is not one
+// stz2 allows: none of them builds.
+//-----------------------------------------------------------------------------
+
+static bool BuildsFrom(const std::vector<uint8_t>& file)
+{
+	ContainerIndex index;
+	return WriteTestFile(SOURCE_PATH, file) && index.Build(SOURCE_PATH);
+}
+
+static void PutBE32At(std::vector<uint8_t>* pFile, size_t nAt, uint32_t n)
+{
+	for (int i = 0; i < 4; i++)
+		(*pFile)[nAt + i] = (uint8_t)(n >> (24 - 8 * i));
+}
+
+static bool CheckMalformed()
+{
+	const uint32_t bits[] = { 32, 4 };
+	bool bPassed = true;
+	for (size_t b = 0; b < sizeof(bits) / sizeof(bits[0]); b++) {
+		ClipSpec spec = MakeSpec(30, 10, bits[b], b > 0);
+		std::vector<uint8_t> file, bad;
+		std::vector<BoxAt> boxes;
+		MakeClip(spec, &file, &boxes);
+		bPassed &= BuildsFrom(file);
+
+		size_t cCut = 0;
+		for (size_t cb = 0; cb < file.size(); cb++) {
+			bad.assign(file.begin(), file.begin() + cb);
+			cCut += BuildsFrom(bad);
+		}
+		bPassed &= cCut == 0;
+
+		for (size_t i = 0; i < boxes.size(); i++) {
+			bad = file;
+			PutBE32At(&bad, boxes[i].nAt, 0x7FFFFFF0);
+			bPassed &= !BuildsFrom(bad);
+		}
+
+		// Entry counts one past the table, in the word after the version.
+		for (size_t i = 0; i < boxes.size(); i++) {
+			size_t nCountAt = boxes[i].nAt + 12;
+			if (!strcmp(boxes[i].type, "stsz") || !strcmp(boxes[i].type, "stz2"))
+				nCountAt += 4;
+			else if (strcmp(boxes[i].type, "stts") && strcmp(boxes[i].type, "stsc") &&
+				strcmp(boxes[i].type, "stco") && strcmp(boxes[i].type, "co64"))
+				continue;
+			bad = file;
+			PutBE32At(&bad, nCountAt, spec.cFrames + 1);
+			bPassed &= !BuildsFrom(bad);
+			if (!strcmp(boxes[i].type, "stz2")) {
+				bad = file;
+				PutBE32At(&bad, boxes[i].nAt + 12, 12);
+				bPassed &= !BuildsFrom(bad);
+			}
+		}
+	}
+	return Report("truncated and oversized boxes", bPassed);
+}
+
+//-----------------------------------------------------------------------------
+// CheckRebuild
+//
+// Open builds and saves an index the first time and maps it after that.
+// A source written again with the same size is told apart by its time;
+// an index file cut short or with a header byte changed is rebuilt.
+//-----------------------------------------------------------------------------
+
+static bool OpensBuilt(const std::wstring& indexPath, const ClipSpec& spec)
+{
+	ContainerIndex index;
+	return index.Open(SOURCE_PATH, indexPath) && !index.IsMapped() && IsIndexOf(index, spec);
+}
+
+static bool OpensMapped(const std::wstring& indexPath, const ClipSpec& spec)
+{
+	ContainerIndex index;
+	return index.Open(SOURCE_PATH, indexPath) && index.IsMapped() && IsIndexOf(index, spec);
+}
+
+static bool CheckRebuild()
+{
+	std::wstring indexPath = ContainerIndex::GetIndexPath(L".", SOURCE_PATH);
+	RemoveFile(indexPath);
+	ClipSpec first = MakeSpec(40, 8, 16, false);
+	ClipSpec second = first;
+	second.nSizeSeed = 2;
+	bool bPassed = WriteClip(first) && OpensBuilt(indexPath, first) && OpensMapped(indexPath, first);
+
+	FileInfo before, after;
+	bPassed &= GetFileInfo(SOURCE_PATH, &before) && WriteClip(second) &&
+		SetFileModified(SOURCE_PATH, SOURCE_TIME + 60) && GetFileInfo(SOURCE_PATH, &after) &&
+		after.cbSize == before.cbSize;
+	bPassed &= OpensBuilt(indexPath, second) && OpensMapped(indexPath, second);
+
+	std::vector<uint8_t> saved, bad;
+	bPassed &= ReadTestFile(indexPath, &saved) && saved.size() > 16;
+	for (size_t i = 0; bPassed && i < 16; i++) {
+		bad = saved;
+		bad[i] ^= 0x40;
+		bPassed &= WriteTestFile(indexPath, bad) && OpensBuilt(indexPath, second) && OpensMapped(indexPath, second);
+	}
+	bad.assign(saved.begin(), saved.end() - 1);
+	bPassed &= WriteTestFile(indexPath, bad) && OpensBuilt(indexPath, second) && OpensMapped(indexPath, second);
+	bad = saved;
+	bad.push_back(0);
+	bPassed &= WriteTestFile(indexPath, bad) && OpensBuilt(indexPath, second) && OpensMapped(indexPath, second);
+
+	RemoveFile(indexPath);
+	return Report("stale and corrupt index rebuilt", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckSampleSizes();
+	bPassed &= CheckChunkOffsets64();
+	bPassed &= CheckNoSyncTable();
+	bPassed &= CheckFragmented();
+	bPassed &= CheckMalformed();
+	bPassed &= CheckRebuild();
+	RemoveFile(SOURCE_PATH);
+	return bPassed ? 0 : 1;
+}
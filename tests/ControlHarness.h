@@ -0,0 +1,210 @@
+#pragma once
+#include "ControlProtocol.h"
+#include <stdint.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+//-------------------------------------------------------------------
+//
+// OwnerThread class
+//
+// Stands in for the window thread: dispatches posted calls one by one,
+// each after a set delay, and refuses posts when told to.
+//
+//-------------------------------------------------------------------
+
+class OwnerThread : public IControlOwner
+{
+public:
+	explicit OwnerThread(IControlTarget* pTarget) : m_dispatcher(pTarget), m_nDelayMs(0), m_bRefuse(false),
+		m_bStop(false), m_thread(&OwnerThread::Run, this)
+	{
+	}
+
+	// Dispatches whatever is still queued before it returns.
+	~OwnerThread()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_bStop = true;
+		}
+		m_posted.notify_one();
+		m_thread.join();
+	}
+
+	void SetDelay(uint32_t nDelayMs) { m_nDelayMs = nDelayMs; }
+	void SetRefuse(bool bRefuse) { m_bRefuse = bRefuse; }
+
+	bool Post(ControlCall* pCall) override
+	{
+		if (m_bRefuse)
+			return false;
+		pCall->AddRef();
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_calls.push_back(pCall);
+		}
+		m_posted.notify_one();
+		return true;
+	}
+
+private:
+	void Run()
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		for (;;) {
+			m_posted.wait(lock, [this] { return m_bStop || !m_calls.empty(); });
+			if (m_calls.empty())
+				return;
+			ControlCall* pCall = m_calls.front();
+			m_calls.pop_front();
+			lock.unlock();
+
+			if (m_nDelayMs)
+				std::this_thread::sleep_for(std::chrono::milliseconds((uint32_t)m_nDelayMs));
+			ControlMessage reply;
+			m_dispatcher.Dispatch(pCall->GetRequest(), &reply);
+			pCall->Complete(reply);
+			pCall->Release();
+			lock.lock();
+		}
+	}
+
+	ControlDispatcher			m_dispatcher;
+	std::atomic<uint32_t>		m_nDelayMs;
+	std::atomic<bool>			m_bRefuse;
+	std::mutex					m_lock;
+	std::condition_variable		m_posted;
+	std::deque<ControlCall*>	m_calls;
+	bool						m_bStop;
+	std::thread					m_thread;
+};
+
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Writes all of pData, or fails if the peer is gone.
+inline bool SendControlBytes(int fd, const uint8_t* pData, size_t cbData)
+{
+	while (cbData > 0) {
+		ssize_t cbSent = send(fd, pData, cbData, MSG_NOSIGNAL);
+		if (cbSent <= 0)
+			return false;
+		pData += cbSent;
+		cbData -= (size_t)cbSent;
+	}
+	return true;
+}
+
+
+//-------------------------------------------------------------------
+//
+// ControlSocketServer class
+//
+// Serves one client over a Unix-domain socket pair as the control pipe
+// serves it on Windows: a transport thread reads what the client sends,
+// runs it through a ControlConnection and writes the replies, until
+// the client shuts down its side or sends a malformed stream.
+//
+//-------------------------------------------------------------------
+
+class ControlSocketServer
+{
+public:
+	ControlSocketServer(IControlOwner* pOwner, uint32_t nTimeoutMs) : m_connection(pOwner, nTimeoutMs),
+		m_bValid(true)
+	{
+		m_fds[0] = m_fds[1] = -1;
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, m_fds) == 0)
+			m_thread = std::thread(&ControlSocketServer::Serve, this);
+	}
+
+	~ControlSocketServer()
+	{
+		Stop();
+		if (m_fds[1] >= 0)
+			close(m_fds[1]);
+	}
+
+	// The client's end, or -1 if the pair could not be created.
+	int GetClient() const { return m_fds[1]; }
+
+	// Ends the client's stream and waits for the transport thread to
+	// serve what was sent before it.
+	void Stop()
+	{
+		if (!m_thread.joinable())
+			return;
+		shutdown(m_fds[1], SHUT_WR);
+		m_thread.join();
+		close(m_fds[0]);
+		m_fds[0] = -1;
+	}
+
+	// After Stop.
+	uint32_t GetTimeoutCount() const { return m_connection.GetTimeoutCount(); }
+	bool IsStreamValid() const { return m_bValid; }
+
+private:
+	void Serve()
+	{
+		std::vector<uint8_t> replies;
+		uint8_t buffer[4096];
+		for (ssize_t cbRead; (cbRead = recv(m_fds[0], buffer, sizeof(buffer), 0)) > 0; ) {
+			replies.clear();
+			m_bValid = m_connection.OnReceive(buffer, (size_t)cbRead, &replies);
+			if (!SendControlBytes(m_fds[0], replies.data(), replies.size()) || !m_bValid)
+				break;
+		}
+		shutdown(m_fds[0], SHUT_WR);
+	}
+
+	ControlConnection	m_connection;
+	bool				m_bValid;
+	int					m_fds[2];
+	std::thread			m_thread;
+};
+
+// Client side: sends the stream cbChunk bytes per write.
+inline bool SendControlStream(int fd, const std::vector<uint8_t>& stream, size_t cbChunk)
+{
+	for (size_t i = 0; i < stream.size(); i += cbChunk) {
+		size_t cb = stream.size() - i < cbChunk ? stream.size() - i : cbChunk;
+		if (!SendControlBytes(fd, stream.data() + i, cb))
+			return false;
+	}
+	return true;
+}
+
+// Client side: reads until cReplies replies have been decoded. Returns
+// false if the server closed the stream first or sent a malformed one.
+inline bool ReceiveControlReplies(int fd, ControlDecoder* pDecoder, size_t cReplies,
+	std::vector<ControlMessage>* pReplies)
+{
+	ControlMessage reply;
+	uint8_t buffer[4096];
+	while (pReplies->size() < cReplies) {
+		CONTROL_DECODE result = CONTROL_DECODE_NEED_MORE;
+		while (pReplies->size() < cReplies && (result = pDecoder->Next(&reply)) == CONTROL_DECODE_MESSAGE)
+			pReplies->push_back(reply);
+		if (pReplies->size() == cReplies)
+			break;
+		if (result == CONTROL_DECODE_ERROR)
+			return false;
+		ssize_t cbRead = recv(fd, buffer, sizeof(buffer), 0);
+		if (cbRead <= 0)
+			return false;
+		pDecoder->Feed(buffer, (size_t)cbRead);
+	}
+	return true;
+}
@@ -0,0 +1,335 @@
+//-------------------------------------------------------------------
+//
+// ControlProtocolTest
+//
+// Round-trips every command through the codec, whole and split into
+// chunks of a few bytes, rejects malformed streams, and serves requests
+// over a Unix-domain socket pair through a ControlConnection to an owner
+// thread, as the control pipe does. A request the owner answers after
+// the connection gave up on it must get a timeout reply, and its late
+// completion must not touch the connection; run under ASan to see that.
+//
+//-------------------------------------------------------------------
+
+#include "ControlProtocol.h"
+#include "ControlHarness.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+class FakeTarget : public IControlTarget
+{
+public:
+	FakeTarget() : m_bPaused(false), m_hnsPosition(0), m_fRate(1.0f), m_fVolume(1.0f), m_cCommands(0) {}
+
+	int32_t Open(const std::wstring& path) override { m_path = path; return Count(); }
+	int32_t Pause() override { m_bPaused = true; return Count(); }
+	int32_t Resume() override { m_bPaused = false; return Count(); }
+	int32_t Seek(HNSTIME hnsPosition) override { m_hnsPosition = hnsPosition; return Count(); }
+	int32_t SetRate(float fRate) override { m_fRate = fRate; return Count(); }
+	int32_t SetVolume(float fVolume) override { m_fVolume = fVolume; return Count(); }
+	int32_t QueryStats(ControlStats* pStats) override
+	{
+		pStats->nState = m_bPaused ? CONTROL_STATE_PAUSED : CONTROL_STATE_PLAYING;
+		pStats->hnsPosition = m_hnsPosition;
+		pStats->fRate = m_fRate;
+		pStats->fVolume = m_fVolume;
+		pStats->cClips = 1;
+		return Count();
+	}
+
+	std::wstring	m_path;
+	bool			m_bPaused;
+	HNSTIME			m_hnsPosition;
+	float			m_fRate;
+	float			m_fVolume;
+	uint32_t		m_cCommands;
+
+private:
+	int32_t Count() { m_cCommands++; return CONTROL_S_OK; }
+};
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+static ControlMessage MakeRequest(CONTROL_COMMAND command, uint32_t nSeq)
+{
+	ControlMessage msg;
+	msg.command = command;
+	msg.nSeq = nSeq;
+	return msg;
+}
+
+// One request of every command, with values that survive the wire exactly.
+static std::vector<ControlMessage> MakeRequests()
+{
+	std::vector<ControlMessage> requests;
+	ControlMessage msg = MakeRequest(CONTROL_COMMAND_OPEN, 1);
+	msg.text = L"C:\\Clips\\M\u00FCnchen \U0001F30A.mp4";
+	requests.push_back(msg);
+	requests.push_back(MakeRequest(CONTROL_COMMAND_PAUSE, 2));
+	requests.push_back(MakeRequest(CONTROL_COMMAND_RESUME, 3));
+	msg = MakeRequest(CONTROL_COMMAND_SEEK, 4);
+	msg.hnsValue = 12345678901LL;
+	requests.push_back(msg);
+	msg = MakeRequest(CONTROL_COMMAND_SET_RATE, 5);
+	msg.fValue = 1.5f;
+	requests.push_back(msg);
+	msg = MakeRequest(CONTROL_COMMAND_SET_VOLUME, 6);
+	msg.fValue = 0.25f;
+	requests.push_back(msg);
+	requests.push_back(MakeRequest(CONTROL_COMMAND_QUERY_STATS, 7));
+	return requests;
+}
+
+static ControlMessage MakeStatsReply()
+{
+	ControlMessage msg = MakeRequest(CONTROL_COMMAND_QUERY_STATS, 9);
+	msg.bReply = true;
+	msg.stats.nState = CONTROL_STATE_PAUSED;
+	msg.stats.nMode = 2;
+	msg.stats.hnsPosition = 5 * HNS_PER_SECOND;
+	msg.stats.hnsDuration = 30 * HNS_PER_SECOND;
+	msg.stats.fRate = 0.5f;
+	msg.stats.fVolume = 0.75f;
+	msg.stats.cLoops = 42;
+	msg.stats.cMissedLoops = 3;
+	msg.stats.hnsSeekLatency = 40 * HNS_PER_MSEC;
+	msg.stats.nClip = 4;
+	msg.stats.cClips = 6;
+	return msg;
+}
+
+static bool IsSameMessage(const ControlMessage& a, const ControlMessage& b)
+{
+	const ControlStats& s = a.stats;
+	const ControlStats& t = b.stats;
+	return a.command == b.command && a.nSeq == b.nSeq && a.bReply == b.bReply && a.nStatus == b.nStatus &&
+		a.hnsValue == b.hnsValue && a.fValue == b.fValue && a.text == b.text &&
+		s.nState == t.nState && s.nMode == t.nMode && s.hnsPosition == t.hnsPosition &&
+		s.hnsDuration == t.hnsDuration && s.fRate == t.fRate && s.fVolume == t.fVolume &&
+		s.cLoops == t.cLoops && s.cMissedLoops == t.cMissedLoops && s.hnsSeekLatency == t.hnsSeekLatency &&
+		s.nClip == t.nClip && s.cClips == t.cClips;
+}
+
+// Feeds the stream cbChunk bytes at a time and decodes all of it.
+static bool Decode(const std::vector<uint8_t>& stream, size_t cbChunk, std::vector<ControlMessage>* pMessages)
+{
+	ControlDecoder decoder;
+	ControlMessage msg;
+	CONTROL_DECODE result = CONTROL_DECODE_NEED_MORE;
+	for (size_t i = 0; i < stream.size(); i += cbChunk) {
+		decoder.Feed(stream.data() + i, stream.size() - i < cbChunk ? stream.size() - i : cbChunk);
+		while ((result = decoder.Next(&msg)) == CONTROL_DECODE_MESSAGE)
+			pMessages->push_back(msg);
+		if (result == CONTROL_DECODE_ERROR)
+			return false;
+	}
+	return decoder.GetBufferedSize() == 0;
+}
+
+// Every command and a stats reply come back as they were sent, whether
+// the stream arrives whole or a few bytes at a time.
+static bool CheckRoundTrip()
+{
+	std::vector<ControlMessage> messages = MakeRequests();
+	messages.push_back(MakeStatsReply());
+	std::vector<uint8_t> stream;
+	for (size_t i = 0; i < messages.size(); i++)
+		EncodeControlMessage(messages[i], &stream);
+
+	bool bPassed = true;
+	const size_t chunks[] = { stream.size(), 1, 3, 7, 13 };
+	for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+		std::vector<ControlMessage> decoded;
+		bPassed &= Decode(stream, chunks[c], &decoded) && decoded.size() == messages.size();
+		for (size_t i = 0; bPassed && i < decoded.size(); i++)
+			bPassed &= IsSameMessage(decoded[i], messages[i]);
+	}
+	return Report("codec round trip", bPassed);
+}
+
+// A body over the limit or of the wrong size for its command breaks the
+// stream for good; an unknown command is skipped past.
+static bool CheckMalformed()
+{
+	std::vector<uint8_t> stream;
+	EncodeControlMessage(MakeRequest(CONTROL_COMMAND_PAUSE, 1), &stream);
+	stream[0] = 0xFF;
+	stream[1] = 0xFF;
+	stream[2] = 0xFF;
+	std::vector<ControlMessage> decoded;
+	bool bPassed = !Decode(stream, stream.size(), &decoded);
+
+	ControlMessage seek = MakeRequest(CONTROL_COMMAND_SEEK, 2);
+	stream.clear();
+	EncodeControlMessage(seek, &stream);
+	stream[0] = 4;
+	stream.resize(stream.size() - 4);
+	EncodeControlMessage(seek, &stream);
+	decoded.clear();
+	bPassed &= !Decode(stream, stream.size(), &decoded) && decoded.empty();
+
+	stream.clear();
+	EncodeControlMessage(MakeRequest((CONTROL_COMMAND)99, 3), &stream);
+	EncodeControlMessage(MakeRequest(CONTROL_COMMAND_PAUSE, 4), &stream);
+	decoded.clear();
+	bPassed &= Decode(stream, 5, &decoded) && decoded.size() == 2 && decoded[1].nSeq == 4;
+
+	FakeTarget target;
+	ControlDispatcher dispatcher(&target);
+	ControlMessage reply;
+	dispatcher.Dispatch(decoded[0], &reply);
+	bPassed &= reply.bReply && reply.nSeq == 3 && reply.nStatus == CONTROL_E_NOTIMPL;
+	return Report("malformed streams", bPassed);
+}
+
+// Out of range values are rejected before they reach the target.
+static bool CheckInvalidArguments()
+{
+	FakeTarget target;
+	ControlDispatcher dispatcher(&target);
+	std::vector<ControlMessage> requests;
+	requests.push_back(MakeRequest(CONTROL_COMMAND_OPEN, 1));
+	ControlMessage msg = MakeRequest(CONTROL_COMMAND_SEEK, 2);
+	msg.hnsValue = -1;
+	requests.push_back(msg);
+	msg = MakeRequest(CONTROL_COMMAND_SET_RATE, 3);
+	msg.fValue = NAN;
+	requests.push_back(msg);
+	msg = MakeRequest(CONTROL_COMMAND_SET_VOLUME, 4);
+	msg.fValue = 1.5f;
+	requests.push_back(msg);
+	msg = MakeRequest(CONTROL_COMMAND_PAUSE, 5);
+	msg.bReply = true;
+	requests.push_back(msg);
+
+	bool bPassed = true;
+	for (size_t i = 0; i < requests.size(); i++) {
+		ControlMessage reply;
+		dispatcher.Dispatch(requests[i], &reply);
+		bPassed &= reply.nStatus == CONTROL_E_INVALIDARG && reply.nSeq == requests[i].nSeq;
+	}
+	bPassed &= target.m_cCommands == 0 && dispatcher.GetDispatchCount() == requests.size();
+	return Report("invalid arguments", bPassed);
+}
+
+// Requests sent in chunks over the socket run on the owner thread in
+// order, and each gets its reply.
+static bool CheckConnection()
+{
+	FakeTarget target;
+	std::vector<ControlMessage> requests = MakeRequests();
+	std::vector<uint8_t> stream;
+	for (size_t i = 0; i < requests.size(); i++)
+		EncodeControlMessage(requests[i], &stream);
+
+	ControlDecoder decoder;
+	std::vector<ControlMessage> decoded;
+	bool bPassed = true;
+	{
+		OwnerThread owner(&target);
+		ControlSocketServer server(&owner, 5000);
+		bPassed &= SendControlStream(server.GetClient(), stream, 5) &&
+			ReceiveControlReplies(server.GetClient(), &decoder, requests.size(), &decoded);
+		server.Stop();
+		bPassed &= server.IsStreamValid() && server.GetTimeoutCount() == 0;
+	}
+
+	bPassed &= decoded.size() == requests.size();
+	for (size_t i = 0; bPassed && i < decoded.size(); i++) {
+		bPassed &= decoded[i].bReply && decoded[i].command == requests[i].command &&
+			decoded[i].nSeq == requests[i].nSeq && decoded[i].nStatus == CONTROL_S_OK;
+	}
+	bPassed &= target.m_cCommands == requests.size() && target.m_path == requests[0].text &&
+		target.m_hnsPosition == requests[3].hnsValue && target.m_fRate == 1.5f && target.m_fVolume == 0.25f;
+	bPassed = bPassed && decoded.back().stats.hnsPosition == requests[3].hnsValue &&
+		decoded.back().stats.nState == CONTROL_STATE_PLAYING;
+	return Report("connection to owner thread", bPassed);
+}
+
+// A malformed stream is replied up to where it breaks, then the server
+// closes the connection.
+static bool CheckMalformedConnection()
+{
+	FakeTarget target;
+	std::vector<uint8_t> stream;
+	EncodeControlMessage(MakeRequest(CONTROL_COMMAND_PAUSE, 1), &stream);
+	size_t cbFirst = stream.size();
+	EncodeControlMessage(MakeRequest(CONTROL_COMMAND_RESUME, 2), &stream);
+	stream[cbFirst] = stream[cbFirst + 1] = stream[cbFirst + 2] = 0xFF;
+
+	ControlDecoder decoder;
+	std::vector<ControlMessage> decoded;
+	bool bPassed = true;
+	{
+		OwnerThread owner(&target);
+		ControlSocketServer server(&owner, 5000);
+		bPassed &= SendControlStream(server.GetClient(), stream, stream.size()) &&
+			!ReceiveControlReplies(server.GetClient(), &decoder, 2, &decoded);
+		server.Stop();
+		bPassed &= !server.IsStreamValid();
+	}
+	bPassed &= decoded.size() == 1 && decoded[0].nSeq == 1 && decoded[0].nStatus == CONTROL_S_OK &&
+		target.m_bPaused && target.m_cCommands == 1;
+	return Report("malformed stream closes the connection", bPassed);
+}
+
+// An owner slower than the timeout gets the request replied with a
+// timeout; it still runs the command later, on a call of its own. An
+// owner that takes no calls fails them.
+static bool CheckTimeoutAndRefusal()
+{
+	FakeTarget target;
+	std::vector<uint8_t> stream;
+	ControlMessage seek = MakeRequest(CONTROL_COMMAND_SEEK, 1);
+	seek.hnsValue = HNS_PER_SECOND;
+	EncodeControlMessage(seek, &stream);
+	EncodeControlMessage(MakeRequest(CONTROL_COMMAND_PAUSE, 2), &stream);
+
+	bool bPassed = true;
+	std::vector<ControlMessage> decoded;
+	{
+		OwnerThread owner(&target);
+		owner.SetDelay(200);
+		{
+			ControlDecoder decoder;
+			ControlSocketServer server(&owner, 10);
+			bPassed &= SendControlStream(server.GetClient(), stream, stream.size()) &&
+				ReceiveControlReplies(server.GetClient(), &decoder, 2, &decoded);
+			server.Stop();
+			bPassed &= server.GetTimeoutCount() == 2;
+		}
+	}
+	bPassed &= decoded.size() == 2;
+	for (size_t i = 0; bPassed && i < decoded.size(); i++)
+		bPassed &= decoded[i].nStatus == CONTROL_E_TIMEOUT && decoded[i].nSeq == i + 1;
+	bPassed &= target.m_cCommands == 2 && target.m_hnsPosition == HNS_PER_SECOND && target.m_bPaused;
+
+	decoded.clear();
+	{
+		OwnerThread owner(&target);
+		owner.SetRefuse(true);
+		ControlDecoder decoder;
+		ControlSocketServer server(&owner, 10);
+		bPassed &= SendControlStream(server.GetClient(), stream, stream.size()) &&
+			ReceiveControlReplies(server.GetClient(), &decoder, 2, &decoded);
+	}
+	bPassed &= decoded.size() == 2 && decoded[0].nStatus == CONTROL_E_FAIL && decoded[1].nStatus == CONTROL_E_FAIL &&
+		target.m_cCommands == 2;
+	return Report("timeout and refusal", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckRoundTrip();
+	bPassed &= CheckMalformed();
+	bPassed &= CheckInvalidArguments();
+	bPassed &= CheckConnection();
+	bPassed &= CheckMalformedConnection();
+	bPassed &= CheckTimeoutAndRefusal();
+	return bPassed ? 0 : 1;
+}
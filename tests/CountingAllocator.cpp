@@ -0,0 +1,45 @@
+#include "CountingAllocator.h"
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+static std::atomic<uint64_t> g_cAllocations(0);
+static std::atomic<uint64_t> g_cbAllocated(0);
+
+static void* CountedAlloc(size_t cb)
+{
+	g_cAllocations.fetch_add(1, std::memory_order_relaxed);
+	g_cbAllocated.fetch_add(cb, std::memory_order_relaxed);
+	return malloc(cb ? cb : 1);
+}
+
+static void* CountedNew(size_t cb)
+{
+	void* p = CountedAlloc(cb);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+// The nothrow forms too: arenas and new (std::nothrow) allocate through
+// them, and the library's would hand free() memory it did not malloc.
+void* operator new(size_t cb) { return CountedNew(cb); }
+void* operator new[](size_t cb) { return CountedNew(cb); }
+void* operator new(size_t cb, const std::nothrow_t&) noexcept { return CountedAlloc(cb); }
+void* operator new[](size_t cb, const std::nothrow_t&) noexcept { return CountedAlloc(cb); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+uint64_t GetAllocationCount()
+{
+	return g_cAllocations.load(std::memory_order_relaxed);
+}
+
+uint64_t GetAllocatedBytes()
+{
+	return g_cbAllocated.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+
+
+//-------------------------------------------------------------------
+// Counting allocator
+//
+// Linking CountingAllocator.cpp replaces the global operator new and
+// delete, every form of them, with ones that count the heap allocations
+// of all threads. Tests and benchmarks read the counts before and after
+// the work they check and compare the difference.
+//-------------------------------------------------------------------
+
+// Allocations since the program started.
+uint64_t GetAllocationCount();
+
+// Bytes those allocations asked for.
+uint64_t GetAllocatedBytes();
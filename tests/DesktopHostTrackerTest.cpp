@@ -0,0 +1,228 @@
+//-------------------------------------------------------------------
+//
+// DesktopHostTrackerTest
+//
+// Tracks the wallpaper host in a fake window tree of thousands of
+// top-level windows, laid out as the shell does before and after
+// Windows 11 24H2, with an empty WorkerW in front as a decoy. Checks
+// that the host is found, that checks while it lives only ask whether
+// two windows are alive, and that when Explorer restarts the tracker
+// backs off while no shell is up and then re-attaches to the new host.
+//
+//-------------------------------------------------------------------
+
+#include "DesktopHostTracker.h"
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static const HNSTIME MS = HNS_PER_MSEC;
+static const size_t OTHER_WINDOW_COUNT = 5000;
+
+class FakeWindowTree : public IWindowTree
+{
+public:
+	explicit FakeWindowTree(bool bWorkerInProgman) : m_bWorkerInProgman(bWorkerInProgman), m_cVisited(0),
+		m_cAliveCalls(0), m_cSpawns(0)
+	{
+		for (size_t i = 0; i < OTHER_WINDOW_COUNT; i++)
+			m_zorder.push_back(Create(0, i % 3 ? L"Chrome_WidgetWin_1" : L"ApplicationFrameWindow", false));
+		m_zorder.insert(m_zorder.begin(), Create(0, L"WorkerW", false));
+		StartShell();
+	}
+
+	HostWindow FindClass(HostWindow hParent, HostWindow hAfter, const wchar_t* pszClass) override
+	{
+		std::vector<HostWindow>::iterator it = m_zorder.begin();
+		if (hAfter)
+			it = std::find(m_zorder.begin(), m_zorder.end(), hAfter) + 1;
+		for (; it < m_zorder.end(); ++it) {
+			m_cVisited++;
+			const Window& window = m_windows[*it - 1];
+			if (window.hParent == hParent && window.cls == pszClass)
+				return *it;
+		}
+		return 0;
+	}
+
+	bool IsAlive(HostWindow hWnd) override
+	{
+		m_cAliveCalls++;
+		return hWnd && hWnd <= m_windows.size() && m_windows[hWnd - 1].bAlive;
+	}
+
+	// As Progman does on message 0x052C: creates the WorkerW once, inside
+	// Progman since 24H2, before that as a top-level window right behind
+	// a new WorkerW the desktop icons move into.
+	void SpawnWorker(HostWindow hProgman) override
+	{
+		m_cSpawns++;
+		if (m_hWorker || !IsAlive(hProgman))
+			return;
+		if (m_bWorkerInProgman) {
+			m_hWorker = Create(hProgman, L"WorkerW");
+			m_zorder.push_back(m_hWorker);
+			return;
+		}
+		HostWindow hIcons = Create(0, L"WorkerW");
+		m_windows[m_hDefView - 1].hParent = hIcons;
+		m_hWorker = Create(0, L"WorkerW");
+		m_zorder.insert(m_zorder.begin() + 1, hIcons);
+		m_zorder.insert(m_zorder.begin() + 2, m_hWorker);
+	}
+
+	// Explorer exits: its windows are destroyed.
+	void StopShell()
+	{
+		for (size_t i = 0; i < m_windows.size(); i++) {
+			if (m_windows[i].bShell) {
+				m_windows[i].bAlive = false;
+				m_zorder.erase(std::find(m_zorder.begin(), m_zorder.end(), (HostWindow)(i + 1)));
+			}
+		}
+		m_hWorker = 0;
+	}
+
+	// Explorer starts: a new Progman holding the desktop icons.
+	void StartShell()
+	{
+		HostWindow hProgman = Create(0, L"Progman");
+		m_hDefView = Create(hProgman, L"SHELLDLL_DefView");
+		m_zorder.push_back(hProgman);
+		m_zorder.push_back(m_hDefView);
+		m_hWorker = 0;
+	}
+
+	HostWindow GetWorker() const { return m_hWorker; }
+	size_t GetVisited() const { return m_cVisited; }
+	size_t GetAliveCalls() const { return m_cAliveCalls; }
+	size_t GetSpawns() const { return m_cSpawns; }
+
+private:
+	struct Window
+	{
+		HostWindow		hParent;
+		std::wstring	cls;
+		bool			bAlive;
+		bool			bShell;
+	};
+
+	// bShell windows are Explorer's, destroyed when it exits.
+	HostWindow Create(HostWindow hParent, const wchar_t* pszClass, bool bShell = true)
+	{
+		Window window = { hParent, pszClass, true, bShell };
+		m_windows.push_back(window);
+		return m_windows.size();
+	}
+
+	bool						m_bWorkerInProgman;
+	std::vector<Window>			m_windows;		// Handle n is m_windows[n - 1]
+	std::vector<HostWindow>		m_zorder;		// All live windows, children too
+	HostWindow					m_hDefView;
+	HostWindow					m_hWorker;
+	size_t						m_cVisited;		// Windows FindClass went past
+	size_t						m_cAliveCalls;
+	size_t						m_cSpawns;
+};
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+// Attaches, then checks a thousand times without looking the host up
+// again: each check asks about the host and Progman and nothing else.
+static bool CheckAttach(bool bWorkerInProgman)
+{
+	FakeWindowTree tree(bWorkerInProgman);
+	DesktopHostTracker tracker(&tree, HostTrackerConfig());
+	bool bPassed = tracker.Attach(true) && tracker.GetHost() == tree.GetWorker() && tracker.GetHost() != 0;
+
+	size_t cVisited = tree.GetVisited(), cAlive = tree.GetAliveCalls();
+	for (int i = 0; i < 1000; i++)
+		bPassed &= tracker.Check(i * 100 * MS) == HOST_OK;
+	bPassed &= tree.GetVisited() == cVisited && tree.GetAliveCalls() - cAlive == 2000 &&
+		tracker.GetStats().cResolves == 1 && tracker.GetDeadline() < 0;
+
+	// The lookup makes a few queries by class, not one per window.
+	bPassed &= tracker.GetStats().cQueries <= 8;
+	return Report(bWorkerInProgman ? "attach inside progman" : "attach behind icons", bPassed);
+}
+
+// Explorer restarts: the destroyed host invalidates the cache, lookups
+// back off while there is no Progman, and the new host is taken once
+// the shell is back.
+static bool CheckRestart(bool bWorkerInProgman)
+{
+	HostTrackerConfig config;
+	FakeWindowTree tree(bWorkerInProgman);
+	DesktopHostTracker tracker(&tree, config);
+	bool bPassed = tracker.Attach(true);
+	HostWindow hOld = tracker.GetHost();
+
+	tree.StopShell();
+	tracker.OnWindowDestroyed(hOld);
+	HNSTIME hnsNow = 1000 * MS;
+	bPassed &= tracker.Check(hnsNow) == HOST_LOST && tracker.GetDeadline() == hnsNow + config.hnsMinRetry;
+
+	// Before the deadline the tree is left alone; at each deadline the
+	// delay doubles up to the maximum.
+	size_t cVisited = tree.GetVisited();
+	bPassed &= tracker.Check(hnsNow + config.hnsMinRetry - MS) == HOST_LOST && tree.GetVisited() == cVisited;
+	HNSTIME hnsDelay = config.hnsMinRetry;
+	for (int i = 0; i < 8; i++) {
+		hnsNow = tracker.GetDeadline();
+		hnsDelay = std::min(hnsDelay * 2, config.hnsMaxRetry);
+		bPassed &= tracker.Check(hnsNow) == HOST_LOST && tracker.GetDeadline() == hnsNow + hnsDelay;
+	}
+	bPassed &= hnsDelay == config.hnsMaxRetry;
+
+	tree.StartShell();
+	bPassed &= tracker.Check(tracker.GetDeadline()) == HOST_CHANGED && tracker.GetHost() == tree.GetWorker() &&
+		tracker.GetHost() != hOld && tracker.GetDeadline() < 0 && tracker.GetStats().cReattaches == 1;
+	bPassed &= tracker.Check(tracker.GetDeadline() + 100 * MS) == HOST_OK;
+	return Report(bWorkerInProgman ? "shell restart inside progman" : "shell restart behind icons", bPassed);
+}
+
+// TaskbarCreated invalidates: the lookup finds the same host, so nothing
+// moves. Other windows being destroyed do not invalidate.
+static bool CheckInvalidate()
+{
+	FakeWindowTree tree(false);
+	DesktopHostTracker tracker(&tree, HostTrackerConfig());
+	bool bPassed = tracker.Attach(true);
+	HostWindow hHost = tracker.GetHost();
+
+	tracker.OnWindowDestroyed(hHost + 1000);
+	bPassed &= tracker.Check(0) == HOST_OK && tracker.GetStats().cResolves == 1;
+	tracker.Invalidate();
+	bPassed &= tracker.Check(0) == HOST_OK && tracker.GetHost() == hHost && tracker.GetStats().cResolves == 2 &&
+		tracker.GetStats().cReattaches == 0;
+	return Report("invalidate", bPassed);
+}
+
+// A host found dead without a destroy notice is looked up again too.
+static bool CheckSilentLoss()
+{
+	FakeWindowTree tree(true);
+	DesktopHostTracker tracker(&tree, HostTrackerConfig());
+	bool bPassed = tracker.Attach(false) == false && tree.GetSpawns() == 0;
+	bPassed &= tracker.Check(0) == HOST_CHANGED && tree.GetSpawns() == 1;
+	tree.StopShell();
+	tree.StartShell();
+	bPassed &= tracker.Check(MS) == HOST_CHANGED && tracker.GetHost() == tree.GetWorker();
+	return Report("silent loss", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckAttach(false);
+	bPassed &= CheckAttach(true);
+	bPassed &= CheckRestart(false);
+	bPassed &= CheckRestart(true);
+	bPassed &= CheckInvalidate();
+	bPassed &= CheckSilentLoss();
+	return bPassed ? 0 : 1;
+}
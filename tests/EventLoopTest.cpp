@@ -0,0 +1,296 @@
+//-------------------------------------------------------------------
+//
+// EventLoopTest
+//
+// Runs an EventLoop against a recording handler: posts coalesce into
+// one event with the latest value and the values passed over, also
+// when producer threads post while the loop runs; timers due within
+// each other's tolerance share a wakeup and fire earliest first; a
+// periodic timer skips the periods it missed; waitable objects wake
+// the loop until removed; and Quit from a handler ends Run.
+//
+//-------------------------------------------------------------------
+
+#include "EventLoop.h"
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+static const HNSTIME MS = HNS_PER_MSEC;
+static const uint32_t PRODUCER_COUNT = 4;
+static const uint64_t POST_COUNT = 20000;		// Per producer
+
+struct HandledEvent
+{
+	uint32_t	nEvent;
+	uint64_t	nValue;
+	uint64_t	fSeen;
+};
+
+class RecordingHandler : public IEventHandler
+{
+public:
+	explicit RecordingHandler(EventLoop* pLoop) : m_pLoop(pLoop), m_nQuitEvent(EVENT_LOOP_MAX_EVENTS) {}
+
+	void OnEvent(uint32_t nEvent, uint64_t nValue, uint64_t fSeen) override
+	{
+		HandledEvent event = { nEvent, nValue, fSeen };
+		m_events.push_back(event);
+		if (nEvent == m_nQuitEvent)
+			m_pLoop->Quit((int)nValue);
+	}
+
+	void OnHandle(EVENT_HANDLE hObject) override
+	{
+		m_handles.push_back(hObject);
+#ifdef _WIN32
+		ResetEvent((HANDLE)hObject);
+#else
+		uint64_t nCount;
+		if (read((int)hObject, &nCount, sizeof(nCount)) < 0)
+			return;
+#endif
+	}
+
+	void OnTimer(uint32_t nTimer) override
+	{
+		m_timers.push_back(nTimer);
+		m_timerTimes.push_back(m_pLoop->GetTime());
+	}
+
+	void OnInput() override {}
+
+	EventLoop*					m_pLoop;
+	uint32_t					m_nQuitEvent;	// Event that quits with its value as the code
+	std::vector<HandledEvent>	m_events;
+	std::vector<EVENT_HANDLE>	m_handles;
+	std::vector<uint32_t>		m_timers;
+	std::vector<HNSTIME>		m_timerTimes;
+};
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+// Posts before the loop runs, even before Initialize, are handled on its
+// first wakeup: once per event, with the latest value and the seen bits
+// of all values.
+static bool CheckCoalescing()
+{
+	EventLoop loop;
+	RecordingHandler handler(&loop);
+	loop.SetHandler(&handler);
+	loop.Post(3, 1);
+	bool bPassed = loop.Initialize();
+	loop.Post(3, 2);
+	loop.Post(3, 65);
+	loop.Post(1, 7);
+	loop.RunOnce(-1);
+
+	bPassed = bPassed && handler.m_events.size() == 2 && handler.m_events[0].nEvent == 1 &&
+		handler.m_events[0].nValue == 7 && handler.m_events[1].nEvent == 3 && handler.m_events[1].nValue == 65 &&
+		handler.m_events[1].fSeen == ((1ull << 1) | (1ull << 2));	// 65 is bit 1 again
+	EventLoopStats stats;
+	loop.GetStats(&stats);
+	bPassed &= stats.cWakeups == 1 && stats.cPosts == 4 && stats.cEvents == 2 && stats.cPostWakeups == 1;
+
+	// Nothing pending: the next wait times out idle.
+	loop.RunOnce(MS);
+	loop.GetStats(&stats);
+	bPassed &= handler.m_events.size() == 2 && stats.cIdleWakeups == 1;
+	return Report("coalescing", bPassed);
+}
+
+// Producers post rising values to events of their own while the loop
+// runs: each event's values arrive rising, the last one arrives, and the
+// loop wakes far less often than it is posted to.
+static bool CheckConcurrentPosts()
+{
+	EventLoop loop;
+	RecordingHandler handler(&loop);
+	loop.SetHandler(&handler);
+	bool bPassed = loop.Initialize();
+
+	std::vector<std::thread> producers;
+	for (uint32_t i = 0; i < PRODUCER_COUNT; i++) {
+		producers.push_back(std::thread([&loop, i]() {
+			for (uint64_t n = 1; n <= POST_COUNT; n++)
+				loop.Post(i, n);
+		}));
+	}
+	uint64_t nLast[PRODUCER_COUNT] = {};
+	size_t nHandled = 0;
+	bool bRising = true;
+	for (;;) {
+		loop.RunOnce(10 * MS);
+		for (; nHandled < handler.m_events.size(); nHandled++) {
+			const HandledEvent& event = handler.m_events[nHandled];
+			bRising &= event.nEvent < PRODUCER_COUNT && event.nValue >= nLast[event.nEvent];
+			nLast[event.nEvent] = event.nValue;
+		}
+		bool bDone = true;
+		for (uint32_t i = 0; i < PRODUCER_COUNT; i++)
+			bDone &= nLast[i] == POST_COUNT;
+		if (bDone)
+			break;
+	}
+	for (size_t i = 0; i < producers.size(); i++)
+		producers[i].join();
+
+	EventLoopStats stats;
+	loop.GetStats(&stats);
+	bPassed &= bRising && stats.cPosts == PRODUCER_COUNT * POST_COUNT && stats.cWakeups < stats.cPosts / 2;
+	return Report("concurrent posts", bPassed);
+}
+
+// Timer 0 due at 10 ms may wait 20 ms, so it shares the wakeup of timer
+// 1 at 25 ms; without tolerance each takes a wakeup of its own.
+static bool CheckTolerance()
+{
+	EventLoop loop;
+	RecordingHandler handler(&loop);
+	loop.SetHandler(&handler);
+	bool bPassed = loop.Initialize();
+
+	HNSTIME hnsStart = loop.GetTime();
+	loop.SetTimer(1, 25 * MS);
+	loop.SetTimer(0, 10 * MS, 20 * MS);
+	while (loop.IsTimerSet(0) || loop.IsTimerSet(1))
+		loop.RunOnce(-1);
+	EventLoopStats stats;
+	loop.GetStats(&stats);
+	bPassed &= handler.m_timers.size() == 2 && handler.m_timers[0] == 0 && handler.m_timers[1] == 1 &&
+		stats.cTimerWakeups == 1 && stats.cTimers == 2 && handler.m_timerTimes[0] >= hnsStart + 25 * MS;
+
+	loop.ResetStats();
+	handler.m_timers.clear();
+	loop.SetTimer(2, 10 * MS);
+	loop.SetTimer(3, 25 * MS);
+	while (loop.IsTimerSet(2) || loop.IsTimerSet(3))
+		loop.RunOnce(-1);
+	loop.GetStats(&stats);
+	bPassed &= handler.m_timers.size() == 2 && handler.m_timers[0] == 2 && stats.cTimerWakeups == 2;
+
+	// A killed timer does not fire.
+	loop.SetTimer(4, MS);
+	loop.KillTimer(4);
+	loop.RunOnce(5 * MS);
+	bPassed &= !loop.IsTimerSet(4) && handler.m_timers.size() == 2;
+	return Report("timer tolerance", bPassed);
+}
+
+// A periodic timer fires each period; when the loop stalls for several
+// periods it fires once, not once per missed period, and the next comes
+// within a period.
+static bool CheckPeriodic()
+{
+	EventLoop loop;
+	RecordingHandler handler(&loop);
+	loop.SetHandler(&handler);
+	bool bPassed = loop.Initialize();
+
+	HNSTIME hnsStart = loop.GetTime();
+	loop.SetPeriodicTimer(5, 10 * MS);
+	while (handler.m_timers.size() < 5)
+		loop.RunOnce(-1);
+	for (size_t i = 0; i < handler.m_timerTimes.size(); i++)
+		bPassed &= handler.m_timerTimes[i] >= hnsStart + (HNSTIME)(i + 1) * 10 * MS;
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(55));
+	loop.RunOnce(0);
+	bPassed &= handler.m_timers.size() == 6 && loop.IsTimerSet(5);
+	HNSTIME hnsNext = loop.GetTime();
+	loop.RunOnce(-1);
+	bPassed &= handler.m_timers.size() == 7 && handler.m_timerTimes.back() - hnsNext <= 10 * MS + 20 * MS;
+	return Report("periodic timer", bPassed);
+}
+
+// A signaled object wakes the loop and is handed over; removed, it no
+// longer does.
+static bool CheckHandles()
+{
+	EventLoop loop;
+	RecordingHandler handler(&loop);
+	loop.SetHandler(&handler);
+	bool bPassed = loop.Initialize();
+#ifdef _WIN32
+	EVENT_HANDLE hObject = (EVENT_HANDLE)CreateEventW(NULL, TRUE, FALSE, NULL);
+#else
+	EVENT_HANDLE hObject = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#endif
+	bPassed &= loop.AddHandle(hObject);
+
+	std::thread signaler([hObject]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+#ifdef _WIN32
+		SetEvent((HANDLE)hObject);
+#else
+		uint64_t nCount = 1;
+		if (write((int)hObject, &nCount, sizeof(nCount)) < 0)
+			return;
+#endif
+	});
+	loop.RunOnce(-1);
+	signaler.join();
+	EventLoopStats stats;
+	loop.GetStats(&stats);
+	bPassed &= handler.m_handles.size() == 1 && handler.m_handles[0] == hObject && stats.cHandleWakeups == 1;
+
+	loop.RemoveHandle(hObject);
+#ifdef _WIN32
+	SetEvent((HANDLE)hObject);
+#else
+	uint64_t nCount = 1;
+	bPassed &= write((int)hObject, &nCount, sizeof(nCount)) == sizeof(nCount);
+#endif
+	loop.RunOnce(5 * MS);
+	loop.GetStats(&stats);
+	bPassed &= handler.m_handles.size() == 1 && stats.cIdleWakeups == 1;
+#ifdef _WIN32
+	CloseHandle((HANDLE)hObject);
+#else
+	close((int)hObject);
+#endif
+	return Report("waitable objects", bPassed);
+}
+
+// Run returns the code of the Quit a posted event makes, while a timer
+// keeps it waking.
+static bool CheckQuit()
+{
+	EventLoop loop;
+	RecordingHandler handler(&loop);
+	handler.m_nQuitEvent = 9;
+	loop.SetHandler(&handler);
+	bool bPassed = loop.Initialize();
+
+	loop.SetPeriodicTimer(0, MS);
+	std::thread poster([&loop]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		loop.Post(9, 42);
+	});
+	bPassed &= loop.Run() == 42 && loop.IsQuitting();
+	poster.join();
+	bPassed &= handler.m_events.size() == 1 && !handler.m_timers.empty();
+	return Report("quit", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckCoalescing();
+	bPassed &= CheckConcurrentPosts();
+	bPassed &= CheckTolerance();
+	bPassed &= CheckPeriodic();
+	bPassed &= CheckHandles();
+	bPassed &= CheckQuit();
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+//-------------------------------------------------------------------
+//
+// EventQueueTest
+//
+// Producer threads push numbered records through a small EventQueue,
+// so it is full often, while one consumer checks that each producer's
+// records arrive once and in order. Then players' records go through a
+// PlayerEventQueue and a real event loop, which must take them all in
+// fewer wakeups than posts. Pushing and popping must not allocate.
+//
+//-------------------------------------------------------------------
+
+#include "EventQueue.h"
+#include "CountingAllocator.h"
+#include "PlayerEventQueue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+static const uint64_t PUSH_COUNT = 500000;		// Per producer
+static const uint32_t PRODUCER_COUNT = 4;
+static const uint32_t PLAYER_POST_COUNT = 100000;	// Per producer
+
+struct TestRecord
+{
+	uint32_t	nProducer;
+	uint32_t	nCheck;			// nSeq folded, so a torn record shows
+	uint64_t	nSeq;
+};
+
+static bool StressQueue()
+{
+	EventQueue<TestRecord, 64>* pQueue = new EventQueue<TestRecord, 64>();
+	std::atomic<uint64_t> cFull(0);
+	std::vector<std::thread> producers;
+	for (uint32_t i = 0; i < PRODUCER_COUNT; i++) {
+		producers.push_back(std::thread([pQueue, &cFull, i]() {
+			uint64_t cThreadFull = 0;
+			for (uint64_t n = 1; n <= PUSH_COUNT; n++) {
+				TestRecord record = { i, (uint32_t)(n * 2654435761u), n };
+				while (!pQueue->Push(record)) {
+					cThreadFull++;
+					std::this_thread::yield();
+				}
+			}
+			cFull += cThreadFull;
+		}));
+	}
+
+	uint64_t nLast[PRODUCER_COUNT] = {};
+	uint64_t cTaken = 0, cBad = 0;
+	TestRecord batch[16];
+	while (cTaken < PUSH_COUNT * PRODUCER_COUNT && cBad == 0) {
+		size_t cItems = pQueue->Drain(batch, sizeof(batch) / sizeof(batch[0]));
+		if (!cItems)
+			std::this_thread::yield();
+		for (size_t n = 0; n < cItems; n++) {
+			const TestRecord& record = batch[n];
+			if (record.nProducer >= PRODUCER_COUNT || record.nSeq != nLast[record.nProducer] + 1 ||
+				record.nCheck != (uint32_t)(record.nSeq * 2654435761u))
+				cBad++;
+			else
+				nLast[record.nProducer] = record.nSeq;
+		}
+		cTaken += cItems;
+	}
+	for (size_t i = 0; i < producers.size(); i++)
+		producers[i].join();
+
+	TestRecord extra;
+	bool bPassed = cBad == 0 && !pQueue->Pop(&extra);
+	printf("queue: %llu records from %u producers, %llu pushes found it full, %llu bad: %s\n",
+		(unsigned long long)cTaken, PRODUCER_COUNT, (unsigned long long)cFull.load(), (unsigned long long)cBad,
+		bPassed ? "ok" : "FAILED");
+	delete pQueue;
+	return bPassed;
+}
+
+// Capacity, wraparound and no allocation on one thread.
+static bool CheckSingleThread()
+{
+	EventQueue<TestRecord, 4>* pQueue = new EventQueue<TestRecord, 4>();
+	uint64_t cAllocations = GetAllocationCount();
+	bool bPassed = true;
+	for (uint64_t nLap = 0; nLap < 10; nLap++) {
+		for (uint64_t n = 0; n < 4; n++) {
+			TestRecord record = { 0, 0, nLap * 4 + n };
+			bPassed &= pQueue->Push(record);
+		}
+		TestRecord record = {};
+		bPassed &= !pQueue->Push(record);
+		TestRecord items[8];
+		bPassed &= pQueue->Drain(items, 8) == 4 && items[0].nSeq == nLap * 4 && items[3].nSeq == nLap * 4 + 3;
+		bPassed &= !pQueue->Pop(&record);
+	}
+	bPassed &= GetAllocationCount() == cAllocations;
+	delete pQueue;
+	printf("single thread: %s\n", bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+class BatchCounter : public IEventHandler
+{
+public:
+	BatchCounter(PlayerEventQueue* pQueue) : m_pQueue(pQueue), cBatches(0), cEvents(0), cDropped(0), nLastState(0)
+	{
+	}
+
+	void OnEvent(uint32_t, uint64_t, uint64_t) override
+	{
+		PlayerEventBatch batch;
+		while (m_pQueue->TakeBatch(&batch)) {
+			cBatches++;
+			cEvents += batch.cEvents;
+			cDropped += batch.cDropped;
+			if (batch.fTypes & (1u << PLAYER_EVENT_STATE))
+				nLastState = batch.latest[PLAYER_EVENT_STATE].nState;
+		}
+	}
+	void OnHandle(EVENT_HANDLE) override {}
+	void OnTimer(uint32_t) override {}
+	void OnInput() override {}
+
+	PlayerEventQueue*	m_pQueue;
+	uint64_t			cBatches;
+	uint64_t			cEvents;
+	uint64_t			cDropped;
+	uint32_t			nLastState;
+};
+
+static bool CheckPlayerEvents()
+{
+	EventLoop* pLoop = new EventLoop();
+	PlayerEventQueue* pQueue = new PlayerEventQueue(pLoop, 0);
+	BatchCounter counter(pQueue);
+	pLoop->SetHandler(&counter);
+	if (!pLoop->Initialize()) {
+		printf("player events: event loop: FAILED\n");
+		return false;
+	}
+
+	// One producer posts states, the others errors; the queue may drop
+	// some of them, but none of the state posted once they are done.
+	std::atomic<uint32_t> cRunning(PRODUCER_COUNT);
+	std::vector<std::thread> producers;
+	for (uint32_t i = 0; i < PRODUCER_COUNT; i++) {
+		producers.push_back(std::thread([pQueue, &cRunning, i]() {
+			for (uint32_t n = 1; n <= PLAYER_POST_COUNT; n++) {
+				if (i + 1 == PRODUCER_COUNT)
+					pQueue->Post(PLAYER_EVENT_STATE, n % 4);
+				else
+					pQueue->Post(PLAYER_EVENT_ERROR, 0, -(int32_t)n);
+			}
+			cRunning--;
+		}));
+	}
+	while (cRunning.load() > 0)
+		pLoop->RunOnce(10 * HNS_PER_MSEC);
+	for (size_t i = 0; i < producers.size(); i++)
+		producers[i].join();
+	pQueue->Post(PLAYER_EVENT_STATE, 3);
+	pLoop->RunOnce(0);
+
+	EventLoopStats stats;
+	pLoop->GetStats(&stats);
+	uint64_t cPosted = (uint64_t)PLAYER_POST_COUNT * PRODUCER_COUNT + 1;
+	bool bPassed = counter.cEvents + counter.cDropped == cPosted && pQueue->GetPosted() == cPosted &&
+		counter.nLastState == 3 && stats.cPostWakeups < cPosted;
+	printf("player events: %llu posted, %llu taken in %llu batches on %llu wakeups, %llu dropped: %s\n",
+		(unsigned long long)cPosted, (unsigned long long)counter.cEvents, (unsigned long long)counter.cBatches,
+		(unsigned long long)stats.cPostWakeups, (unsigned long long)counter.cDropped, bPassed ? "ok" : "FAILED");
+	delete pQueue;
+	delete pLoop;
+	return bPassed;
+}
+
+int main()
+{
+	bool bPassed = CheckSingleThread();
+	bPassed &= StressQueue();
+	bPassed &= CheckPlayerEvents();
+
+	EventQueueBenchResult result;
+	if (!RunEventQueueBench(2, HNS_PER_SECOND / 5, &result) || result.cLost) {
+		printf("bench: FAILED\n");
+		bPassed = false;
+	}
+	return bPassed ? 0 : 1;
+}
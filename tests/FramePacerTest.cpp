@@ -0,0 +1,188 @@
+//-------------------------------------------------------------------
+//
+// FramePacerTest
+//
+// Checks the decimation cadence of FramePacer for common source and
+// target rates: which source frames are presented, the gaps between
+// them, that each presented frame is the one nearest to its output
+// tick, and that the pattern does not drift over an hour of frames.
+//
+//-------------------------------------------------------------------
+
+#include "FramePacer.h"
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+static FrameRate MakeRate(uint32_t nNum, uint32_t nDen)
+{
+	FrameRate rate = { nNum, nDen };
+	return rate;
+}
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+// Source frames presented among the first cFrames, in order.
+static std::vector<uint64_t> GetPresented(const FramePacer& pacer, uint64_t cFrames)
+{
+	std::vector<uint64_t> presented;
+	for (uint64_t n = 0; n < cFrames; n++) {
+		if (pacer.ShouldPresent(n))
+			presented.push_back(n);
+	}
+	return presented;
+}
+
+// The presented frames are the ones GetFrameForTick gives tick by tick,
+// each within half a source frame of its tick's time, and GetStride and
+// GetOutputTick agree with them. A frame is the nearest to its tick, so
+// it may come just before it.
+static bool IsConsistent(const FramePacer& pacer, const std::vector<uint64_t>& presented)
+{
+	double fFramesPerTick = FrameRateToDouble(pacer.GetSourceRate()) / FrameRateToDouble(pacer.GetTargetRate());
+	for (size_t k = 0; k < presented.size(); k++) {
+		uint64_t nTick = pacer.GetOutputTick(presented[k]);
+		if (pacer.GetFrameForTick(k) != presented[k] || (nTick != k && nTick + 1 != k))
+			return false;
+		if (fabs((double)presented[k] - k * fFramesPerTick) > 0.5 + 1e-9)
+			return false;
+		if (k > 0 && pacer.GetStride(presented[k - 1] + 1) != presented[k] - presented[k - 1])
+			return false;
+	}
+	return true;
+}
+
+// Gaps between consecutive presented frames.
+static std::vector<uint64_t> GetGaps(const std::vector<uint64_t>& presented)
+{
+	std::vector<uint64_t> gaps;
+	for (size_t i = 1; i < presented.size(); i++)
+		gaps.push_back(presented[i] - presented[i - 1]);
+	return gaps;
+}
+
+// 60 -> 30 keeps every second frame.
+static bool CheckHalving()
+{
+	FramePacer pacer;
+	pacer.SetRates(MakeRate(60, 1), MakeRate(30, 1));
+	std::vector<uint64_t> presented = GetPresented(pacer, 600);
+	bool bPassed = pacer.IsDecimating() && presented.size() == 300 && IsConsistent(pacer, presented);
+	for (size_t i = 0; bPassed && i < presented.size(); i++)
+		bPassed &= presented[i] == 2 * i;
+	return Report("60 -> 30", bPassed);
+}
+
+// 59.94 -> 24 steps 2 or 3 frames, 2.4975 on average, never two 3s in a
+// row.
+static bool CheckNtscToFilm()
+{
+	FramePacer pacer;
+	pacer.SetRates(FrameRateFromDouble(59.94), MakeRate(24, 1));
+	std::vector<uint64_t> presented = GetPresented(pacer, 60000);
+	std::vector<uint64_t> gaps = GetGaps(presented);
+	bool bPassed = pacer.IsDecimating() && IsConsistent(pacer, presented);
+	uint64_t cThrees = 0;
+	for (size_t i = 0; bPassed && i < gaps.size(); i++) {
+		bPassed &= gaps[i] == 2 || gaps[i] == 3;
+		bPassed &= !(i > 0 && gaps[i] == 3 && gaps[i - 1] == 3);
+		cThrees += gaps[i] == 3;
+	}
+	double fMean = (double)(presented.back() - presented.front()) / gaps.size();
+	bPassed &= fabs(fMean - 60000.0 / 1001.0 / 24.0) < 0.001 && cThrees > 0;
+	return Report("59.94 -> 24", bPassed);
+}
+
+// 50 -> 20 alternates 3 and 2.
+static bool CheckAlternating()
+{
+	FramePacer pacer;
+	pacer.SetRates(MakeRate(50, 1), MakeRate(20, 1));
+	std::vector<uint64_t> presented = GetPresented(pacer, 500);
+	std::vector<uint64_t> gaps = GetGaps(presented);
+	bool bPassed = pacer.IsDecimating() && presented.size() == 200 && IsConsistent(pacer, presented);
+	for (size_t i = 0; bPassed && i < gaps.size(); i++)
+		bPassed &= gaps[i] == (i % 2 == 0 ? 3u : 2u);
+	return Report("50 -> 20", bPassed);
+}
+
+// An hour of 59.94 fps shown at 30 presents one frame per output tick of
+// the hour, to the frame: integer ratios do not drift.
+static bool CheckNoDrift()
+{
+	FramePacer pacer;
+	pacer.SetRates(MakeRate(60000, 1001), MakeRate(30, 1));
+	const uint64_t cFrames = 3600ull * 60000 / 1001;
+	uint64_t cPresented = 0;
+	for (uint64_t n = pacer.GetStride(0) - 1; n < cFrames; n += pacer.GetStride(n + 1))
+		cPresented++;
+	bool bPassed = pacer.GetFrameForTick(cPresented - 1) < cFrames && pacer.GetFrameForTick(cPresented) >= cFrames;
+	bPassed &= fabs((double)cPresented - 3600.0 * 30) <= 1.0;
+	return Report("no drift over an hour", bPassed);
+}
+
+// No target, or one at or above the source, presents every frame.
+static bool CheckPassThrough()
+{
+	FramePacer pacer;
+	bool bPassed = !pacer.IsDecimating() && pacer.ShouldPresent(7) && pacer.GetStride(7) == 1;
+	pacer.SetRates(MakeRate(24, 1), MakeRate(60, 1));
+	bPassed &= !pacer.IsDecimating() && pacer.GetFrameForTick(5) == 5;
+	pacer.SetRates(MakeRate(30, 1), MakeRate(0, 1));
+	bPassed &= !pacer.IsDecimating() && GetPresented(pacer, 30).size() == 30;
+	pacer.SetRates(MakeRate(30000, 1001), MakeRate(30000, 1001));
+	bPassed &= !pacer.IsDecimating();
+	return Report("pass through", bPassed);
+}
+
+// Frame times map back to their frames, also rounded to a millisecond
+// as containers store them, and a frame rate cap skips GetStride - 1
+// frames from any frame on.
+static bool CheckSourceTimes()
+{
+	FramePacer pacer;
+	bool bPassed = pacer.GetSourceFrame(HNS_PER_SECOND) == 0 && pacer.GetSourceTime(30) == 0;
+	pacer.SetRates(MakeRate(30000, 1001), MakeRate(24, 1));
+	for (uint64_t n = 0; n < 100000; n += 7) {
+		HNSTIME hnsTime = pacer.GetSourceTime(n);
+		HNSTIME hnsRounded = (hnsTime + HNS_PER_MSEC / 2) / HNS_PER_MSEC * HNS_PER_MSEC;
+		bPassed &= pacer.GetSourceFrame(hnsTime) == n && pacer.GetSourceFrame(hnsRounded) == n;
+		uint32_t cStride = pacer.GetStride(n);
+		bPassed &= pacer.ShouldPresent(n + cStride - 1);
+		for (uint32_t i = 0; i + 1 < cStride; i++)
+			bPassed &= !pacer.ShouldPresent(n + i);
+	}
+	bPassed &= pacer.GetSourceFrame(-HNS_PER_SECOND) == 0 && pacer.GetSourceTime(30000) == 1001 * HNS_PER_SECOND;
+	return Report("source times", bPassed);
+}
+
+// Rates given in fps come back as exact ratios.
+static bool CheckRateFromDouble()
+{
+	struct { double fps; uint32_t nNum, nDen; } cases[] = {
+		{ 59.94, 60000, 1001 }, { 29.97, 30000, 1001 }, { 23.976, 24000, 1001 }, { 30.0, 30, 1 },
+		{ 12.5, 25, 2 }, { 0.0, 0, 1 },
+	};
+	bool bPassed = true;
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		FrameRate rate = FrameRateFromDouble(cases[i].fps);
+		bPassed &= rate.nNum == cases[i].nNum && rate.nDen == cases[i].nDen;
+	}
+	return Report("rates from fps", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckHalving();
+	bPassed &= CheckNtscToFilm();
+	bPassed &= CheckAlternating();
+	bPassed &= CheckNoDrift();
+	bPassed &= CheckPassThrough();
+	bPassed &= CheckSourceTimes();
+	bPassed &= CheckRateFromDouble();
+	return bPassed ? 0 : 1;
+}
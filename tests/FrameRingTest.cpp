@@ -0,0 +1,294 @@
+//-------------------------------------------------------------------
+//
+// FrameRingTest
+//
+// Drives a frame ring in named shared memory as the broker and its
+// sessions do, with readers in processes of their own forked from the
+// test. Checks that BeginRead and EndRead hand out each frame once and
+// count the skipped ones, that a read the writer overtakes is rejected,
+// that no reader process ever accepts a frame mixing two publishes, and
+// that a crashed writer's lease and a crashed reader's registration run
+// out so a new writer takes the ring over and carries on its frames.
+//
+// Takes a few seconds: the crash check waits out the real leases.
+//
+//-------------------------------------------------------------------
+
+#include "FrameRing.h"
+#include "FileUtil.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+static const FrameRingConfig SMALL_RING = { 2, 64, 32 };
+static const int FORKED_READERS = 4;
+static const int FORKED_MS = 1000;
+static const HNSTIME FRAME_DURATION = HNS_PER_SECOND / 60;
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+static std::wstring GetTestRingName(const char* pszCheck)
+{
+	std::string clip = "frame_ring_test/" + std::to_string(getpid()) + "/" + pszCheck;
+	return GetFrameRingName(FromUtf8(clip.data(), clip.size()));
+}
+
+static void SleepMs(int nMs)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(nMs));
+}
+
+// Opens the next frame with every pixel holding its number, so a frame
+// mixing two publishes does not sum to its number times its pixels.
+static uint8_t* Fill(FrameRingWriter* pWriter, uint32_t cx, uint32_t cy)
+{
+	size_t cbStride;
+	uint8_t* pData = pWriter->BeginFrame(&cbStride);
+	if (!pData)
+		return NULL;
+	uint32_t nValue = (uint32_t)(pWriter->GetPublishedCount() + 1);
+	for (uint32_t y = 0; y < cy; y++) {
+		uint32_t* pRow = (uint32_t*)(pData + y * cbStride);
+		for (uint32_t x = 0; x < cx; x++)
+			pRow[x] = nValue;
+	}
+	return pData;
+}
+
+static bool Publish(FrameRingWriter* pWriter, uint32_t cx, uint32_t cy)
+{
+	HNSTIME hnsTime = (HNSTIME)pWriter->GetPublishedCount() * FRAME_DURATION;
+	return Fill(pWriter, cx, cy) && pWriter->EndFrame(cx, cy, hnsTime, FRAME_DURATION);
+}
+
+static bool IsWhole(const RingFrame& frame)
+{
+	uint64_t nSum = 0;
+	for (uint32_t y = 0; y < frame.cy; y++) {
+		const uint32_t* pRow = (const uint32_t*)(frame.pData + y * frame.cbStride);
+		for (uint32_t x = 0; x < frame.cx; x++)
+			nSum += pRow[x];
+	}
+	return nSum == (uint64_t)(uint32_t)frame.nFrame * frame.cx * frame.cy;
+}
+
+// Each frame is read once, bRepeat reads it again, frames published
+// between two reads count as skipped, and the next frame is due one
+// duration after the last was published. A ring laid out anew in
+// another shape ends the reader's attachment.
+static bool CheckSequence()
+{
+	SharedMemory memory;
+	if (!memory.Create(GetTestRingName("sequence"), GetFrameRingSize(SMALL_RING)))
+		return false;
+	FrameRingWriter writer;
+	FrameRingReader reader;
+	RingFrame frame;
+	bool bPassed = writer.Attach(memory.GetData(), memory.GetSize(), SMALL_RING, 1) &&
+		reader.Attach(memory.GetData(), memory.GetSize(), 2) && reader.GetSlotCount() == SMALL_RING.cSlots;
+	bPassed &= !reader.BeginRead(&frame) && reader.GetNextDue() == 0 && reader.IsWriterAlive();
+
+	bPassed &= Publish(&writer, 16, 8) && reader.BeginRead(&frame) && frame.nFrame == 1 && frame.cx == 16 &&
+		frame.cy == 8 && IsWhole(frame) && reader.EndRead(frame) &&
+		reader.GetNextDue() == frame.hnsPublished + FRAME_DURATION;
+	bPassed &= !reader.BeginRead(&frame) && reader.BeginRead(&frame, true) && frame.nFrame == 1 &&
+		reader.EndRead(frame) && reader.GetStats().cFrames == 1;
+
+	for (int i = 0; i < 3; i++)
+		bPassed &= Publish(&writer, 16, 8);
+	bPassed &= reader.BeginRead(&frame) && frame.nFrame == 4 && frame.hnsTime == 3 * FRAME_DURATION &&
+		reader.EndRead(frame);
+	FrameRingReaderStats stats = reader.GetStats();
+	bPassed &= stats.nReaderId == 2 && stats.cFrames == 2 && stats.cSkipped == 2 && stats.cTorn == 0;
+
+	// Sizes past the shape are clipped to it, and EndFrame wants a frame
+	// begun.
+	bPassed &= Publish(&writer, 16, 8) && !writer.EndFrame(16, 8, 0, FRAME_DURATION);
+	bPassed &= Fill(&writer, SMALL_RING.cxMax, SMALL_RING.cyMax) && writer.EndFrame(1000, 1000, 0, FRAME_DURATION) &&
+		reader.BeginRead(&frame) && frame.nFrame == 6 && frame.cx == SMALL_RING.cxMax &&
+		frame.cy == SMALL_RING.cyMax && IsWhole(frame) && reader.EndRead(frame) && reader.GetStats().cSkipped == 3;
+
+	FrameRingReaderStats readers[4];
+	bPassed &= writer.GetReaders(readers, 4) == 1 && readers[0].nReaderId == 2;
+
+	// Another shape: the writer lays the ring out again and the reader
+	// lets go of it.
+	FrameRingConfig smaller = { 3, 32, 16 };
+	writer.Detach();
+	bPassed &= !reader.IsWriterAlive() && writer.Attach(memory.GetData(), memory.GetSize(), smaller, 1) &&
+		!reader.BeginRead(&frame, true) && !reader.IsAttached();
+	bPassed &= reader.Attach(memory.GetData(), memory.GetSize(), 2) && reader.GetSlotCount() == 3 &&
+		Publish(&writer, 32, 16) && reader.BeginRead(&frame) && frame.nFrame == 7 && reader.EndRead(frame);
+	return bPassed;
+}
+
+// A read is rejected once the writer starts on its slot, and once it
+// has published over it; each rejection counts as torn and leaves the
+// last frame read as it was.
+static bool CheckTornRead()
+{
+	SharedMemory memory;
+	if (!memory.Create(GetTestRingName("torn"), GetFrameRingSize(SMALL_RING)))
+		return false;
+	FrameRingWriter writer;
+	FrameRingReader reader;
+	RingFrame frame;
+	bool bPassed = writer.Attach(memory.GetData(), memory.GetSize(), SMALL_RING, 1) &&
+		reader.Attach(memory.GetData(), memory.GetSize(), 2);
+
+	// Frame 1 is in slot 1; frame 2 goes to slot 0 and frame 3 back to 1.
+	bPassed &= Publish(&writer, 16, 8) && reader.BeginRead(&frame) && frame.nFrame == 1;
+	bPassed &= Publish(&writer, 16, 8) && reader.EndRead(frame);
+	bPassed &= Fill(&writer, 16, 8) != NULL && !reader.EndRead(frame);
+	bPassed &= writer.EndFrame(16, 8, 2 * FRAME_DURATION, FRAME_DURATION) && !reader.EndRead(frame) &&
+		reader.GetStats().cTorn == 2 && reader.GetStats().cFrames == 1;
+
+	// Reading goes on with the newest frame.
+	bPassed &= reader.BeginRead(&frame) && frame.nFrame == 3 && IsWhole(frame) && reader.EndRead(frame);
+	FrameRingReaderStats stats = reader.GetStats();
+	bPassed &= stats.cFrames == 2 && stats.cSkipped == 1 && stats.cTorn == 2;
+
+	// The frame before the one being written stays readable.
+	bPassed &= Fill(&writer, 16, 8) != NULL && reader.BeginRead(&frame, true) && frame.nFrame == 3 &&
+		IsWhole(frame) && reader.EndRead(frame);
+	return bPassed;
+}
+
+// A forked reader: opens the ring by name and reads until the writer
+// lets go of it. Exits 0 if it read frames and accepted none that mixed
+// two publishes.
+static void RunReaderProcess(const std::wstring& name, uint32_t nReaderId)
+{
+	SharedMemory memory;
+	FrameRingReader reader;
+	if (!memory.Open(name) || !reader.Attach(memory.GetData(), memory.GetSize(), nReaderId))
+		_exit(2);
+	uint64_t cMixed = 0;
+	while (reader.IsWriterAlive()) {
+		RingFrame frame;
+		if (reader.BeginRead(&frame)) {
+			bool bWhole = IsWhole(frame);
+			if (reader.EndRead(frame) && !bWhole)
+				cMixed++;
+		}
+		else
+			std::this_thread::yield();
+		reader.Heartbeat();
+	}
+	_exit(cMixed == 0 && reader.GetStats().cFrames > 0 ? 0 : 1);
+}
+
+// Reader processes read while the writer publishes as fast as it can
+// into two slots, so they are overtaken often; none accepts a frame the
+// writer overwrote during the read.
+static bool CheckForkedReaders()
+{
+	std::wstring name = GetTestRingName("forked");
+	SharedMemory memory;
+	FrameRingWriter writer;
+	if (!memory.Create(name, GetFrameRingSize(SMALL_RING)) ||
+		!writer.Attach(memory.GetData(), memory.GetSize(), SMALL_RING, 1))
+		return false;
+	pid_t pids[FORKED_READERS];
+	for (int i = 0; i < FORKED_READERS; i++) {
+		pids[i] = fork();
+		if (pids[i] == 0)
+			RunReaderProcess(name, 100 + i);
+	}
+
+	bool bPassed = true;
+	auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(FORKED_MS);
+	while (bPassed && std::chrono::steady_clock::now() < end)
+		bPassed = Publish(&writer, SMALL_RING.cxMax, SMALL_RING.cyMax);
+	FrameRingReaderStats readers[FORKED_READERS + 1];
+	bPassed &= writer.GetReaders(readers, FORKED_READERS + 1) == FORKED_READERS;
+	uint64_t cPublished = writer.GetPublishedCount();
+	writer.Detach();
+
+	for (int i = 0; i < FORKED_READERS; i++) {
+		int nStatus = 0;
+		bPassed &= pids[i] > 0 && waitpid(pids[i], &nStatus, 0) == pids[i] && WIFEXITED(nStatus) &&
+			WEXITSTATUS(nStatus) == 0;
+	}
+	printf("  %llu frames published to %d reader processes\n", (unsigned long long)cPublished, FORKED_READERS);
+	return bPassed;
+}
+
+// A writer and a reader process exit without detaching, as if they
+// crashed. Nobody takes the ring while the writer's lease runs; once it
+// has run out a new writer takes over and carries on the frame numbers,
+// and a reader attached before reads on. The crashed reader stays
+// registered until its own lease runs out.
+static bool CheckCrashRecovery()
+{
+	std::wstring name = GetTestRingName("crash");
+	SharedMemory memory;
+	if (!memory.Create(name, GetFrameRingSize(SMALL_RING)))
+		return false;
+	HNSTIME hnsStart = GetRingTime();
+	pid_t nWriter = fork();
+	if (nWriter == 0) {
+		SharedMemory child;
+		FrameRingWriter writer;
+		bool bOk = child.Open(name) && writer.Attach(child.GetData(), child.GetSize(), SMALL_RING, 1);
+		for (int i = 0; bOk && i < 3; i++)
+			bOk = Publish(&writer, 16, 8);
+		_exit(bOk ? 0 : 1);
+	}
+	int nStatus = 0;
+	bool bPassed = waitpid(nWriter, &nStatus, 0) == nWriter && WIFEXITED(nStatus) && WEXITSTATUS(nStatus) == 0;
+
+	pid_t nReader = fork();
+	if (nReader == 0) {
+		SharedMemory child;
+		FrameRingReader reader;
+		RingFrame frame;
+		bool bOk = child.Open(name) && reader.Attach(child.GetData(), child.GetSize(), 7) &&
+			reader.BeginRead(&frame) && reader.EndRead(frame);
+		_exit(bOk ? 0 : 1);
+	}
+	bPassed &= waitpid(nReader, &nStatus, 0) == nReader && WIFEXITED(nStatus) && WEXITSTATUS(nStatus) == 0;
+
+	FrameRingWriter writer;
+	FrameRingReader reader;
+	RingFrame frame;
+	bPassed &= reader.Attach(memory.GetData(), memory.GetSize(), 9) && reader.IsWriterAlive() &&
+		reader.BeginRead(&frame) && frame.nFrame == 3 && reader.EndRead(frame);
+	bPassed &= !writer.Attach(memory.GetData(), memory.GetSize(), SMALL_RING, 2);
+
+	// The crashed writer renewed its lease last when it attached.
+	HNSTIME hnsWait = hnsStart + RING_WRITER_TIMEOUT + HNS_PER_SECOND / 4 - GetRingTime();
+	SleepMs(hnsWait > 0 ? (int)(hnsWait / HNS_PER_MSEC) : 0);
+	reader.Heartbeat();
+	bPassed &= !reader.IsWriterAlive() && writer.Attach(memory.GetData(), memory.GetSize(), SMALL_RING, 2) &&
+		Publish(&writer, 16, 8) && writer.GetPublishedCount() == 4;
+	bPassed &= reader.IsWriterAlive() && reader.BeginRead(&frame) && frame.nFrame == 4 && IsWhole(frame) &&
+		reader.EndRead(frame) && reader.GetStats().cSkipped == 0;
+
+	FrameRingReaderStats readers[4];
+	bPassed &= writer.GetReaders(readers, 4) == 2;
+
+	hnsWait = hnsStart + RING_READER_TIMEOUT + HNS_PER_SECOND / 4 - GetRingTime();
+	SleepMs(hnsWait > 0 ? (int)(hnsWait / HNS_PER_MSEC) : 0);
+	reader.Heartbeat();
+	bPassed &= writer.Heartbeat() && writer.GetReaders(readers, 4) == 1 && readers[0].nReaderId == 9 &&
+		readers[0].cFrames == 2;
+	return bPassed;
+}
+
+int main()
+{
+	bool bPassed = true;
+	bPassed &= Report("sequence", CheckSequence());
+	bPassed &= Report("torn read", CheckTornRead());
+	bPassed &= Report("forked readers", CheckForkedReaders());
+	bPassed &= Report("crash recovery", CheckCrashRecovery());
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,412 @@
+//-------------------------------------------------------------------
+//
+// FrameSinkTest
+//
+// Feeds a FrameSink from a software frame source, whose frame n has
+// every pixel set to n, and presents it against a simulated clock, the
+// decoder and presenter taking turns on one thread. Checks that frames
+// overtaken by the clock are dropped late and stale ones when queued,
+// that a flush for a seek or a clip switch drops the old epoch and shows
+// the first new frame at once, that the frame rate cap drops exactly
+// the frames FramePacer skips, that rate changes and pauses move the
+// deadlines, and that the pool bounds the frames in flight, blocks and
+// wakes the decoder, and recycles every frame and surface. Once warmed
+// up, none of this allocates.
+//
+//-------------------------------------------------------------------
+
+#include "FrameSink.h"
+#include "CountingAllocator.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static const uint32_t FRAME_WIDTH = 16;
+static const uint32_t FRAME_HEIGHT = 8;
+static const size_t FRAME_BYTES = FRAME_WIDTH * FRAME_HEIGHT * 4;
+static const uint32_t POOL_SLOTS = 4;
+static const FrameRate NO_CAP = { 0, 0 };
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+static FrameRate MakeRate(uint32_t nNum, uint32_t nDen)
+{
+	FrameRate rate = { nNum, nDen };
+	return rate;
+}
+
+// Decodes frames of a clip at a fixed rate into the sink as the software
+// player's decode threads do, without a file: frame n is all n.
+class TestSource
+{
+public:
+	TestSource(FramePool* pPool, FrameSink* pSink, const FrameRate& rate) : m_pPool(pPool), m_pSink(pSink),
+		m_rate(rate), m_pSurface(NULL)
+	{
+	}
+
+	HNSTIME GetFrameTime(uint64_t nFrame) const
+	{
+		return (HNSTIME)(nFrame * HNS_PER_SECOND * m_rate.nDen / m_rate.nNum);
+	}
+
+	// Surface each frame carries from now on, NULL for none.
+	void SetSurface(void* pSurface) { m_pSurface = pSurface; }
+
+	// Queues frame nFrame as decoded in epoch nEpoch. False, without
+	// waiting, if the pool has no free frame.
+	bool Queue(uint64_t nFrame, uint32_t nEpoch)
+	{
+		if (m_pPool->GetFreeCount() == 0)
+			return false;
+		FrameBuffer* pFrame = m_pSink->BeginFrame();
+		if (!pFrame || !m_pPool->GrowFrame(pFrame, FRAME_BYTES))
+			return false;
+		memset(pFrame->pData, (int)(nFrame & 0xFF), FRAME_BYTES);
+		pFrame->cx = FRAME_WIDTH;
+		pFrame->cy = FRAME_HEIGHT;
+		pFrame->cbStride = FRAME_WIDTH * 4;
+		pFrame->nEpoch = nEpoch;
+		pFrame->hnsTime = GetFrameTime(nFrame);
+		pFrame->hnsDuration = GetFrameTime(nFrame + 1) - pFrame->hnsTime;
+		pFrame->pSurface = m_pSurface;
+		m_pSink->QueueFrame(pFrame);
+		return true;
+	}
+
+	void SetRate(const FrameRate& rate) { m_rate = rate; }
+
+private:
+	FramePool*	m_pPool;
+	FrameSink*	m_pSink;
+	FrameRate	m_rate;
+	void*		m_pSurface;
+};
+
+// Number of the frame in pFrame, from its pixels; -1 for none.
+static int GetShown(const FrameBuffer* pFrame)
+{
+	return pFrame ? pFrame->pData[0] : -1;
+}
+
+static FrameBuffer* Present(FrameSink* pSink, HNSTIME hnsNow)
+{
+	FrameBuffer* pFrame = pSink->Update(hnsNow);
+	if (pFrame)
+		pSink->OnPresented(hnsNow);
+	return pFrame;
+}
+
+// Decodes frames nFirst.. of the source, cFrames of them, in epoch
+// nEpoch and presents each at its deadline as the render thread does.
+// Adds the frames shown to pShown, if given, and returns their count.
+static uint32_t Play(TestSource* pSource, FrameSink* pSink, uint64_t nFirst, uint64_t cFrames, uint32_t nEpoch,
+	HNSTIME* phnsNow, std::vector<int>* pShown)
+{
+	uint32_t cShown = 0;
+	for (uint64_t n = nFirst; n < nFirst + cFrames; n++) {
+		if (!pSource->Queue(n, nEpoch))
+			return cShown;
+		HNSTIME hnsDue = pSink->GetNextDeadline(*phnsNow);
+		if (hnsDue < 0)
+			continue;
+		*phnsNow = hnsDue;
+		FrameBuffer* pFrame = Present(pSink, *phnsNow);
+		cShown += pFrame != NULL;
+		if (pFrame && pShown)
+			pShown->push_back(GetShown(pFrame));
+	}
+	return cShown;
+}
+
+// Frames whose time has passed by the next Update are dropped late, all
+// but the last; a frame of an old epoch, or ending before the position
+// a seek moved to, is dropped when queued. Every drop goes back to the
+// pool.
+static bool CheckLateAndStale()
+{
+	FramePool pool(POOL_SLOTS, FRAME_BYTES);
+	FrameSink sink(&pool);
+	TestSource source(&pool, &sink, MakeRate(30, 1));
+	sink.SetRates(MakeRate(30, 1), NO_CAP);
+	sink.Start(0);
+
+	bool bPassed = true;
+	for (uint64_t n = 0; n < 4; n++)
+		bPassed &= source.Queue(n, 0);
+	bPassed &= pool.GetFreeCount() == 0 && !source.Queue(4, 0);
+	bPassed &= GetShown(Present(&sink, 0)) == 0 && sink.GetPosition(0) == 0;
+
+	HNSTIME hnsNow = source.GetFrameTime(3);
+	bPassed &= sink.GetNextDeadline(hnsNow) == hnsNow && GetShown(Present(&sink, hnsNow)) == 3;
+	FrameSinkStats stats = sink.GetStats();
+	bPassed &= stats.cLate == 2 && stats.cShown == 2 && pool.GetFreeCount() == POOL_SLOTS - 1;
+
+	// A seek to frame 10: frame 12 was decoded before it, frame 5 after
+	// it but ends before the target.
+	uint32_t nEpoch = sink.Flush(source.GetFrameTime(10));
+	bPassed &= nEpoch == 1 && sink.GetEpoch() == 1;
+	bPassed &= source.Queue(12, 0) && source.Queue(5, nEpoch) && sink.GetNextDeadline(hnsNow) == -1;
+	stats = sink.GetStats();
+	bPassed &= stats.cFlushed == 2 && stats.cQueued == 4 && pool.GetFreeCount() == POOL_SLOTS - 1;
+	bPassed &= source.Queue(10, nEpoch) && GetShown(Present(&sink, hnsNow)) == 10 &&
+		sink.GetPosition(hnsNow) == source.GetFrameTime(10) && pool.GetFreeCount() == POOL_SLOTS - 1;
+	return bPassed;
+}
+
+// A seek drops the queued frames and moves the epoch; the shown frame
+// stays until the first frame of the new epoch, which shows at once,
+// even paused. A clip switch is a flush to 0 with the new clip's rates;
+// the old clip's end of stream no longer counts, the new one's does
+// once its last frame has run.
+static bool CheckFlushEpochs()
+{
+	FramePool pool(POOL_SLOTS, FRAME_BYTES);
+	FrameSink sink(&pool);
+	TestSource source(&pool, &sink, MakeRate(30, 1));
+	sink.SetRates(MakeRate(30, 1), NO_CAP);
+	sink.Start(0);
+
+	bool bPassed = source.Queue(0, 0) && source.Queue(1, 0) && source.Queue(2, 0);
+	bPassed &= GetShown(Present(&sink, 0)) == 0;
+
+	HNSTIME hnsNow = source.GetFrameTime(1) / 2;
+	uint32_t nEpoch = sink.Flush(source.GetFrameTime(20));
+	sink.Pause(hnsNow);
+	bPassed &= sink.GetStats().cFlushed == 2 && GetShown(sink.GetCurrent()) == 0 &&
+		pool.GetFreeCount() == POOL_SLOTS - 1 && sink.GetNextDeadline(hnsNow) == -1 && !sink.Update(hnsNow);
+	bPassed &= source.Queue(20, nEpoch) && sink.GetNextDeadline(hnsNow) == hnsNow &&
+		GetShown(Present(&sink, hnsNow)) == 20 && !sink.IsRunning() &&
+		sink.GetPosition(hnsNow + HNS_PER_SECOND) == source.GetFrameTime(20);
+
+	// The old epoch ends: nothing happens.
+	sink.EndOfStream(nEpoch - 1);
+	bPassed &= !sink.IsEnded(hnsNow + HNS_PER_SECOND);
+
+	// Switch to a 25 fps clip of two frames.
+	source.SetRate(MakeRate(25, 1));
+	sink.SetRates(MakeRate(25, 1), NO_CAP);
+	nEpoch = sink.Flush(0);
+	sink.Start(hnsNow);
+	bPassed &= source.Queue(0, nEpoch) && source.Queue(1, nEpoch);
+	sink.EndOfStream(nEpoch - 1);
+	sink.EndOfStream(nEpoch);
+	bPassed &= !sink.IsEnded(hnsNow) && GetShown(Present(&sink, hnsNow)) == 0 && !sink.IsEnded(hnsNow);
+	HNSTIME hnsLast = hnsNow + source.GetFrameTime(1);
+	bPassed &= sink.GetNextDeadline(hnsNow) == hnsLast && GetShown(Present(&sink, hnsLast)) == 1;
+	bPassed &= !sink.IsEnded(hnsLast) && sink.IsEnded(hnsNow + source.GetFrameTime(2));
+	bPassed &= sink.GetStats().cFlushed == 2 && pool.GetFreeCount() == POOL_SLOTS - 1;
+	return bPassed;
+}
+
+// Under a cap the sink drops, when they are queued, exactly the frames
+// FramePacer does not present, so the presenter only sees the others
+// and none of them late.
+static bool CheckDecimation()
+{
+	static const FrameRate RATES[][2] = {
+		{ { 60, 1 }, { 30, 1 } },
+		{ { 60000, 1001 }, { 24, 1 } },
+		{ { 50, 1 }, { 20, 1 } },
+	};
+	static const uint64_t FRAMES = 600;
+	bool bPassed = true;
+	for (size_t r = 0; r < sizeof(RATES) / sizeof(RATES[0]); r++) {
+		FramePool pool(POOL_SLOTS, FRAME_BYTES);
+		FrameSink sink(&pool);
+		TestSource source(&pool, &sink, RATES[r][0]);
+		sink.SetRates(RATES[r][0], RATES[r][1]);
+		sink.Start(0);
+		FramePacer pacer;
+		pacer.SetRates(RATES[r][0], RATES[r][1]);
+
+		HNSTIME hnsNow = 0;
+		std::vector<int> shown;
+		Play(&source, &sink, 0, FRAMES, 0, &hnsNow, &shown);
+		std::vector<int> expected;
+		for (uint64_t n = 0; n < FRAMES; n++) {
+			if (pacer.ShouldPresent(n))
+				expected.push_back((int)(n & 0xFF));
+		}
+		FrameSinkStats stats = sink.GetStats();
+		bPassed &= shown == expected && stats.cDecimated == FRAMES - expected.size() && stats.cLate == 0 &&
+			stats.cQueued == expected.size() && pool.GetFreeCount() == POOL_SLOTS - 1;
+	}
+	return bPassed;
+}
+
+// True if the next frame is due at hnsDue, give or take the tick its
+// deadline is rounded up by, and shows then but not a tick before.
+static bool IsDueAt(FrameSink* pSink, HNSTIME hnsNow, HNSTIME hnsDue, int nFrame)
+{
+	HNSTIME hnsDeadline = pSink->GetNextDeadline(hnsNow);
+	return hnsDeadline >= hnsDue && hnsDeadline <= hnsDue + 1 && !pSink->Update(hnsDeadline - 1) &&
+		GetShown(Present(pSink, hnsDeadline)) == nFrame;
+}
+
+// Faster rates bring deadlines closer from the position the clock had
+// at the change; a zero rate and a pause hold the clock and show
+// nothing new, and resuming carries on from where it held.
+static bool CheckRateChanges()
+{
+	FramePool pool(POOL_SLOTS, FRAME_BYTES);
+	FrameSink sink(&pool);
+	TestSource source(&pool, &sink, MakeRate(30, 1));
+	sink.SetRates(MakeRate(30, 1), NO_CAP);
+	sink.Start(0);
+
+	bool bPassed = source.Queue(0, 0) && GetShown(Present(&sink, 0)) == 0 && source.Queue(1, 0);
+	bPassed &= sink.GetNextDeadline(0) == source.GetFrameTime(1);
+
+	// Double speed from the start: frame 1 is due at half its time.
+	sink.SetRate(2.0f, 0);
+	bPassed &= sink.GetRate() == 2.0f && IsDueAt(&sink, 0, source.GetFrameTime(1) / 2, 1);
+
+	// Stopped by a zero rate, the clock holds and frame 2 waits.
+	HNSTIME hnsNow = source.GetFrameTime(1) / 2 + 1;
+	bPassed &= source.Queue(2, 0);
+	sink.SetRate(0.0f, hnsNow);
+	HNSTIME hnsHeld = sink.GetPosition(hnsNow);
+	bPassed &= hnsHeld >= source.GetFrameTime(1) && sink.GetNextDeadline(hnsNow) == -1 &&
+		!sink.Update(hnsNow + HNS_PER_SECOND) && sink.GetPosition(hnsNow + HNS_PER_SECOND) == hnsHeld;
+
+	// Half speed from a second later.
+	hnsNow += HNS_PER_SECOND;
+	sink.SetRate(0.5f, hnsNow);
+	HNSTIME hnsDue = hnsNow + (source.GetFrameTime(2) - hnsHeld) * 2;
+	bPassed &= IsDueAt(&sink, hnsNow, hnsDue, 2);
+
+	// Paused, the clock holds and the next frame waits for Start.
+	bPassed &= source.Queue(3, 0);
+	sink.Pause(hnsDue);
+	hnsHeld = sink.GetPosition(hnsDue);
+	bPassed &= !sink.IsRunning() && sink.GetNextDeadline(hnsDue) == -1 && !sink.Update(hnsDue + HNS_PER_SECOND);
+	hnsNow = hnsDue + HNS_PER_SECOND;
+	sink.Start(hnsNow);
+	hnsDue = hnsNow + (source.GetFrameTime(3) - hnsHeld) * 2;
+	bPassed &= sink.IsRunning() && sink.GetPosition(hnsNow) == hnsHeld && IsDueAt(&sink, hnsNow, hnsDue, 3);
+
+	// Minutes into a clip, deadlines still land on the tick.
+	bPassed &= source.Queue(9000, 0);
+	hnsNow = hnsDue;
+	sink.SetRate(1.0f, hnsNow);
+	hnsDue = hnsNow + (source.GetFrameTime(9000) - sink.GetPosition(hnsNow));
+	bPassed &= IsDueAt(&sink, hnsNow, hnsDue, 9000 & 0xFF) && sink.GetStats().cLate == 0;
+	return bPassed;
+}
+
+// The pool bounds the frames in flight: a decoder that runs ahead waits
+// in BeginFrame until the presenter lets a frame go, and Abort wakes it
+// with none. Every frame goes back, its surface through the recycle
+// callback, and the pool cannot be reconfigured while one is out.
+static bool CheckPoolRecycling()
+{
+	FramePool pool(3, FRAME_BYTES);
+	uint32_t cRecycled = 0;
+	pool.SetRecycle([&cRecycled](FrameBuffer*) { cRecycled++; });
+	FrameSink sink(&pool);
+	TestSource source(&pool, &sink, MakeRate(30, 1));
+	sink.SetRates(MakeRate(30, 1), NO_CAP);
+	sink.Start(0);
+	int nSurface = 0;
+	source.SetSurface(&nSurface);
+
+	bool bPassed = source.Queue(0, 0) && source.Queue(1, 0) && source.Queue(2, 0);
+	bPassed &= pool.GetFreeCount() == 0 && pool.Acquire() == NULL && !pool.Configure(3, FRAME_BYTES);
+
+	// The decoder waits until the late frame 1 and the shown frame 0 go back.
+	std::atomic<FrameBuffer*> pWoken(NULL);
+	std::thread decoder([&]() { pWoken = sink.BeginFrame(); });
+	bPassed &= GetShown(Present(&sink, 0)) == 0 && cRecycled == 0;
+	bPassed &= GetShown(Present(&sink, source.GetFrameTime(2))) == 2;
+	decoder.join();
+	FrameBuffer* pFrame = pWoken;
+	bPassed &= pFrame != NULL && pFrame->pSurface == NULL && pFrame->cbData >= FRAME_BYTES && cRecycled == 2 &&
+		pool.GetFreeCount() == 1;
+	bPassed &= source.Queue(3, 0) && pool.GetFreeCount() == 0;
+
+	// Abort wakes a waiting decoder with nothing and takes every frame
+	// back but the one the decoder holds.
+	std::thread aborted([&]() { pWoken = sink.BeginFrame(); });
+	sink.Abort();
+	aborted.join();
+	bPassed &= pWoken == NULL && pool.GetFreeCount() == 2 && sink.GetCurrent() == NULL && cRecycled == 4;
+	sink.CancelFrame(pFrame);
+	bPassed &= pool.GetFreeCount() == 3 && sink.BeginFrame() == NULL;
+
+	pool.Resume();
+	FramePoolStats stats = pool.GetStats();
+	bPassed &= stats.cPeakInUse == 3 && stats.cAcquired == 5 && pool.Configure(2, FRAME_BYTES) &&
+		pool.GetSlotCount() == 2 && pool.GetFreeCount() == 2;
+	pFrame = sink.BeginFrame();
+	bPassed &= pFrame != NULL && pFrame->pSurface == NULL;
+	sink.CancelFrame(pFrame);
+	return bPassed;
+}
+
+// Once the pool's buffers and the sink's queue have grown, playing,
+// dropping late, decimating, seeking and switching clips allocate
+// nothing per frame, surfaces and their recycle callback included.
+static bool CheckNoAllocation()
+{
+	FramePool pool(POOL_SLOTS, 0);
+	uint32_t cRecycled = 0;
+	pool.SetRecycle([&cRecycled](FrameBuffer*) { cRecycled++; });
+	FrameSink sink(&pool);
+	TestSource source(&pool, &sink, MakeRate(60, 1));
+	int nSurface = 0;
+	source.SetSurface(&nSurface);
+	sink.SetRates(MakeRate(60, 1), MakeRate(30, 1));
+	sink.Start(0);
+
+	HNSTIME hnsNow = 0;
+	uint32_t cShown = 0;
+	uint64_t cAllocations = 0;
+	for (int nPass = 0; nPass < 2; nPass++) {
+		if (nPass == 1)
+			cAllocations = GetAllocationCount();
+		uint32_t nEpoch = sink.Flush(0);
+		cShown += Play(&source, &sink, 0, 120, nEpoch, &hnsNow, NULL);
+
+		// A late burst: three frames queued at once, presented together.
+		for (uint64_t n = 120; n < 126; n += 2)
+			source.Queue(n, nEpoch);
+		hnsNow += HNS_PER_SECOND;
+		cShown += Present(&sink, hnsNow) != NULL;
+
+		// Seek, then switch to an uncapped clip and back.
+		nEpoch = sink.Flush(source.GetFrameTime(60));
+		cShown += Play(&source, &sink, 60, 60, nEpoch, &hnsNow, NULL);
+		sink.SetRates(MakeRate(60, 1), NO_CAP);
+		nEpoch = sink.Flush(0);
+		cShown += Play(&source, &sink, 0, 30, nEpoch, &hnsNow, NULL);
+		sink.EndOfStream(nEpoch);
+		sink.SetRates(MakeRate(60, 1), MakeRate(30, 1));
+		sink.SetRate(1.5f, hnsNow);
+		sink.SetRate(1.0f, hnsNow);
+	}
+	uint64_t cPassAllocations = GetAllocationCount() - cAllocations;
+	FrameSinkStats stats = sink.GetStats();
+	printf("  %u frames shown, %llu late, %llu decimated, %llu flushed, %u surfaces recycled: "
+		"%llu allocations\n", cShown, (unsigned long long)stats.cLate, (unsigned long long)stats.cDecimated,
+		(unsigned long long)stats.cFlushed, cRecycled, (unsigned long long)cPassAllocations);
+	return cPassAllocations == 0 && stats.cLate > 0 && stats.cDecimated > 0 && cShown > 0;
+}
+
+int main()
+{
+	bool bPassed = true;
+	bPassed &= Report("late and stale drops", CheckLateAndStale());
+	bPassed &= Report("flush epochs", CheckFlushEpochs());
+	bPassed &= Report("decimation", CheckDecimation());
+	bPassed &= Report("rate changes", CheckRateChanges());
+	bPassed &= Report("pool recycling", CheckPoolRecycling());
+	bPassed &= Report("no allocation", CheckNoAllocation());
+	return bPassed ? 0 : 1;
+}
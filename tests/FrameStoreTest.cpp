@@ -0,0 +1,274 @@
+//-------------------------------------------------------------------
+//
+// FrameStoreTest
+//
+// Fills FrameStores the way the loop cache does, a frame per number on
+// the first pass and lookups on the next ones, with budgets that hold
+// the clip, part of it and almost nothing. The bytes held, the frame
+// table included, must never pass the budget. A store keeping its
+// prefix must refuse frames once full and hit budget / clip size of
+// each later pass, where LRU evicts every frame before it comes round
+// again; LRU must evict the least recently looked up frame first, and
+// a shrinking budget must evict down to it. A looked-up frame's data
+// must stay put while other frames come and go.
+//
+//-------------------------------------------------------------------
+
+#include "FrameStore.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static const uint32_t CLIP_FRAMES = 120;
+static const size_t FRAME_BYTES = 4096;
+static const uint32_t LOOP_PASSES = 4;
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+// Frame n is FRAME_BYTES bytes of n, so a frame that moved or was
+// overwritten shows.
+static std::vector<uint8_t> MakeFrame(uint32_t nFrame, size_t cbData = FRAME_BYTES)
+{
+	return std::vector<uint8_t>(cbData, (uint8_t)(nFrame * 7 + 1));
+}
+
+static bool IsFrame(const StoredFrame* pStored, uint32_t nFrame, size_t cbData = FRAME_BYTES)
+{
+	if (!pStored || pStored->cbData != cbData || pStored->hnsTime != (HNSTIME)nFrame * HNS_PER_MSEC)
+		return false;
+	std::vector<uint8_t> expected = MakeFrame(nFrame, cbData);
+	return memcmp(pStored->pData, expected.data(), cbData) == 0;
+}
+
+static bool InsertFrame(FrameStore* pStore, uint32_t nFrame, size_t cbData = FRAME_BYTES)
+{
+	std::vector<uint8_t> data = MakeFrame(nFrame, cbData);
+	return pStore->Insert(nFrame, (HNSTIME)nFrame * HNS_PER_MSEC, 0, data.data(), cbData);
+}
+
+// Bytes a store of the whole clip takes, frames and table.
+static size_t GetClipCost()
+{
+	return CLIP_FRAMES * FrameStore::GetFrameCost(FRAME_BYTES) + FrameStore::GetTableCost(CLIP_FRAMES);
+}
+
+// Plays the loop cache: each pass looks every frame up and stores the
+// ones it misses. Returns the hits of the passes after the first, over
+// their lookups, and checks the budget after every step.
+static double PlayLoops(FrameStore* pStore, bool* pbWithinBudget)
+{
+	*pbWithinBudget = true;
+	for (uint32_t nPass = 0; nPass < LOOP_PASSES; nPass++) {
+		if (nPass == 1)
+			pStore->ResetCounters();
+		for (uint32_t n = 0; n < CLIP_FRAMES; n++) {
+			if (!pStore->Lookup(n))
+				InsertFrame(pStore, n);
+			const FrameStoreStats& stats = pStore->GetStats();
+			*pbWithinBudget &= stats.cbInUse <= pStore->GetBudget() && stats.cbPeak <= pStore->GetBudget();
+		}
+	}
+	const FrameStoreStats& stats = pStore->GetStats();
+	return (double)stats.cHits / ((LOOP_PASSES - 1) * CLIP_FRAMES);
+}
+
+// A store holding the clip hits every frame after the first pass; one
+// holding half of it keeps the first half and hits half of each pass,
+// where LRU evicts each frame just before it is needed and hits none.
+static bool CheckHitRate()
+{
+	bool bPassed = true;
+	bool bWithinBudget = false;
+
+	FrameStore whole(GetClipCost(), FRAMESTORE_KEEP_PREFIX);
+	whole.SetFrameCount(CLIP_FRAMES);
+	bPassed &= PlayLoops(&whole, &bWithinBudget) == 1.0 && bWithinBudget && whole.IsComplete();
+	bPassed &= whole.GetStats().cbInUse == GetClipCost() && whole.GetStats().cMisses == 0;
+
+	size_t cbHalf = GetClipCost() - CLIP_FRAMES / 2 * FrameStore::GetFrameCost(FRAME_BYTES);
+	FrameStore prefix(cbHalf, FRAMESTORE_KEEP_PREFIX);
+	prefix.SetFrameCount(CLIP_FRAMES);
+	double fPrefix = PlayLoops(&prefix, &bWithinBudget);
+	bPassed &= fPrefix == 0.5 && bWithinBudget && !prefix.IsComplete() && prefix.Contains(0) &&
+		prefix.Contains(CLIP_FRAMES / 2 - 1) && !prefix.Contains(CLIP_FRAMES / 2);
+	bPassed &= prefix.GetStats().cRejected == (LOOP_PASSES - 1) * CLIP_FRAMES / 2;
+
+	FrameStore lru(cbHalf, FRAMESTORE_EVICT_LRU);
+	lru.SetFrameCount(CLIP_FRAMES);
+	double fLru = PlayLoops(&lru, &bWithinBudget);
+	bPassed &= fLru == 0.0 && bWithinBudget && lru.GetStats().cEvictions > 0 && lru.GetStats().cRejected == 0;
+
+	printf("  hit rate of later passes: whole clip 100%%, half budget keeping the prefix %.0f%%, LRU %.0f%%\n",
+		fPrefix * 100, fLru * 100);
+	return bPassed;
+}
+
+// Frames of mixed sizes at scattered numbers, with and without a known
+// frame count, under both policies and budgets down to nothing: the
+// bytes held never pass the budget, the table included.
+static bool CheckPeakWithinBudget()
+{
+	static const size_t BUDGETS[] = { 0, 1000, 64 << 10, 1 << 20 };
+	bool bPassed = true;
+	for (size_t b = 0; b < sizeof(BUDGETS) / sizeof(BUDGETS[0]); b++) {
+		for (int nPolicy = 0; nPolicy < 2; nPolicy++) {
+			for (int bKnown = 0; bKnown < 2; bKnown++) {
+				FrameStore store(BUDGETS[b], (FRAMESTORE_POLICY)nPolicy);
+				if (bKnown)
+					store.SetFrameCount(5000);
+				uint64_t nState = 1;
+				for (uint32_t i = 0; i < 2000; i++) {
+					nState = nState * 6364136223846793005ull + 1442695040888963407ull;
+					uint32_t nFrame = (uint32_t)(nState >> 33) % 5000;
+					size_t cbData = (size_t)(nState >> 13) % 20000;
+					if (store.Lookup(nFrame) == NULL)
+						InsertFrame(&store, nFrame, cbData);
+				}
+				const FrameStoreStats& stats = store.GetStats();
+				bPassed &= stats.cbPeak <= BUDGETS[b] && stats.cbInUse <= stats.cbPeak;
+			}
+		}
+	}
+
+	// A frame far past the others would grow the table beyond the budget.
+	FrameStore store(1 << 20, FRAMESTORE_EVICT_LRU);
+	bPassed &= InsertFrame(&store, 0, 16) && !store.HasRoom(10000000, 16) && !InsertFrame(&store, 10000000, 16) &&
+		store.GetStats().cRejected == 1 && store.GetStats().cbPeak <= store.GetBudget();
+
+	// A known frame count sizes the table once, charged with the first frame.
+	FrameStore sized(1 << 20, FRAMESTORE_KEEP_PREFIX);
+	sized.SetFrameCount(CLIP_FRAMES);
+	bPassed &= InsertFrame(&sized, 3) &&
+		sized.GetStats().cbInUse == FrameStore::GetFrameCost(FRAME_BYTES) + FrameStore::GetTableCost(CLIP_FRAMES);
+	bPassed &= InsertFrame(&sized, CLIP_FRAMES - 1) &&
+		sized.GetStats().cbInUse == 2 * FrameStore::GetFrameCost(FRAME_BYTES) + FrameStore::GetTableCost(CLIP_FRAMES);
+	return bPassed;
+}
+
+// With room for four frames, looking frame 0 up makes frame 1 the least
+// recently used, so it goes first, then 2.
+static bool CheckLruOrder()
+{
+	size_t cbBudget = 4 * FrameStore::GetFrameCost(FRAME_BYTES) + FrameStore::GetTableCost(8);
+	FrameStore store(cbBudget, FRAMESTORE_EVICT_LRU);
+	store.SetFrameCount(8);
+	bool bPassed = true;
+	for (uint32_t n = 0; n < 4; n++)
+		bPassed &= InsertFrame(&store, n);
+	bPassed &= store.Lookup(0) != NULL && InsertFrame(&store, 4);
+	bPassed &= store.Contains(0) && !store.Contains(1) && store.Contains(2) && store.GetStats().cEvictions == 1;
+	bPassed &= InsertFrame(&store, 5) && !store.Contains(2) && store.Contains(3);
+
+	// A frame the size of two evicts the two least recent.
+	bPassed &= InsertFrame(&store, 6, 2 * FRAME_BYTES) && !store.Contains(3) && !store.Contains(0) &&
+		store.Contains(4) && store.Contains(5) && store.GetStats().cFrames == 3 &&
+		store.GetStats().cbInUse <= cbBudget;
+
+	// One that cannot fit even in an empty store evicts nothing.
+	bPassed &= !InsertFrame(&store, 7, cbBudget) && store.GetStats().cFrames == 3 &&
+		store.GetStats().cRejected == 1;
+	return bPassed;
+}
+
+// Once full, a store keeping its prefix refuses new frames and counts
+// them, and keeps what it has; a frame stored already is not counted.
+static bool CheckKeepPrefixRefusal()
+{
+	size_t cbBudget = 3 * FrameStore::GetFrameCost(FRAME_BYTES) + FrameStore::GetTableCost(10);
+	FrameStore store(cbBudget, FRAMESTORE_KEEP_PREFIX);
+	store.SetFrameCount(10);
+	bool bPassed = InsertFrame(&store, 0) && InsertFrame(&store, 1) && InsertFrame(&store, 2);
+	bPassed &= !store.HasRoom(3, FRAME_BYTES) && store.HasRoom(3, 0) && !InsertFrame(&store, 3) &&
+		store.GetStats().cRejected == 1;
+	bPassed &= !InsertFrame(&store, 1) && store.GetStats().cRejected == 1;
+	bPassed &= store.GetStats().cEvictions == 0 && store.GetStats().cFrames == 3 && IsFrame(store.Lookup(0), 0) &&
+		IsFrame(store.Lookup(2), 2) && store.Lookup(3) == NULL;
+
+	// Adopt frees the buffer it refuses.
+	uint8_t* pBuffer = (uint8_t*)malloc(FRAME_BYTES);
+	bPassed &= !store.Adopt(4, 0, 0, pBuffer, FRAME_BYTES) && store.GetStats().cRejected == 2;
+	return bPassed;
+}
+
+// Shrinking evicts the newest frames of a prefix and the least recent
+// ones under LRU until the store fits; at 0 the table goes too.
+static bool CheckShrink()
+{
+	bool bPassed = true;
+	for (int nPolicy = 0; nPolicy < 2; nPolicy++) {
+		FrameStore store(GetClipCost(), (FRAMESTORE_POLICY)nPolicy);
+		store.SetFrameCount(CLIP_FRAMES);
+		for (uint32_t n = 0; n < 10; n++)
+			bPassed &= InsertFrame(&store, n);
+		if (nPolicy == FRAMESTORE_EVICT_LRU)
+			bPassed &= store.Lookup(0) != NULL;
+
+		size_t cbFour = 4 * FrameStore::GetFrameCost(FRAME_BYTES) + FrameStore::GetTableCost(CLIP_FRAMES);
+		store.SetBudget(cbFour);
+		const FrameStoreStats& stats = store.GetStats();
+		bPassed &= stats.cFrames == 4 && stats.cbInUse == cbFour && stats.cEvictions == 6;
+		if (nPolicy == FRAMESTORE_KEEP_PREFIX)
+			bPassed &= store.Contains(0) && store.Contains(3) && !store.Contains(4);
+		else
+			bPassed &= store.Contains(0) && store.Contains(9) && store.Contains(7) && !store.Contains(6);
+
+		store.SetBudget(0);
+		bPassed &= stats.cFrames == 0 && stats.cbInUse == 0;
+		store.SetBudget(GetClipCost());
+		bPassed &= InsertFrame(&store, 5) && IsFrame(store.Lookup(5), 5);
+		store.Clear();
+		bPassed &= stats.cFrames == 0 && stats.cbInUse == 0 && store.Lookup(5) == NULL;
+	}
+	return bPassed;
+}
+
+// A looked-up frame's data stays where it is, unchanged, while the
+// table grows and other frames come in, until the frame is evicted.
+// Adopt stores the caller's buffer itself.
+static bool CheckLookupPointer()
+{
+	FrameStore store(2 * GetClipCost(), FRAMESTORE_KEEP_PREFIX);
+	bool bPassed = InsertFrame(&store, 0);
+	const StoredFrame* pStored = store.Lookup(0);
+	bPassed &= IsFrame(pStored, 0);
+	const uint8_t* pData = pStored ? pStored->pData : NULL;
+
+	// Frame numbers one by one, without a known count, regrow the table.
+	for (uint32_t n = 1; n < CLIP_FRAMES; n++)
+		bPassed &= InsertFrame(&store, n);
+	pStored = store.Lookup(0);
+	bPassed &= IsFrame(pStored, 0) && pStored->pData == pData && store.IsComplete() == false;
+	std::vector<uint8_t> expected = MakeFrame(0);
+	bPassed &= memcmp(pData, expected.data(), FRAME_BYTES) == 0;
+
+	std::vector<uint8_t> data = MakeFrame(CLIP_FRAMES);
+	uint8_t* pBuffer = (uint8_t*)malloc(FRAME_BYTES);
+	memcpy(pBuffer, data.data(), FRAME_BYTES);
+	bPassed &= store.HasRoom(CLIP_FRAMES, FRAME_BYTES) &&
+		store.Adopt(CLIP_FRAMES, (HNSTIME)CLIP_FRAMES * HNS_PER_MSEC, 0, pBuffer, FRAME_BYTES);
+	pStored = store.Lookup(CLIP_FRAMES);
+	bPassed &= IsFrame(pStored, CLIP_FRAMES) && pStored->pData == pBuffer;
+
+	// An adopted frame stored already is freed and refused.
+	pBuffer = (uint8_t*)malloc(FRAME_BYTES);
+	bPassed &= !store.Adopt(0, 0, 0, pBuffer, FRAME_BYTES) && IsFrame(store.Lookup(0), 0) &&
+		store.GetStats().cRejected == 0;
+	return bPassed;
+}
+
+int main()
+{
+	bool bPassed = true;
+	bPassed &= Report("hit rate", CheckHitRate());
+	bPassed &= Report("peak within budget", CheckPeakWithinBudget());
+	bPassed &= Report("LRU order", CheckLruOrder());
+	bPassed &= Report("keep prefix refusal", CheckKeepPrefixRefusal());
+	bPassed &= Report("shrink", CheckShrink());
+	bPassed &= Report("lookup pointer", CheckLookupPointer());
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+//-------------------------------------------------------------------
+//
+// GenerativeTest
+//
+// The plasma kernel of every instruction set must match the scalar one.
+// Each effect, rendered frame after frame on several threads with the
+// best kernels, must leave the same pixels as a fresh single-threaded
+// scalar render of the last frame's time; every pixel that changed must
+// lie in the dirty rectangles; a repeated time must render nothing, and
+// rendering must allocate nothing after Init.
+//
+//-------------------------------------------------------------------
+
+#include "GenerativeRenderer.h"
+#include "CountingAllocator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Odd sizes, so the right and bottom tiles are partial.
+static const uint32_t FRAME_WIDTH = 333;
+static const uint32_t FRAME_HEIGHT = 201;
+static const uint32_t TEST_FRAMES = 45;
+static const uint32_t TEST_THREADS = 3;
+static const size_t MAX_DIRTY = 16;
+static const HNSTIME FRAME_TIME = HNS_PER_SECOND / GENERATIVE_DEFAULT_FPS;
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+static std::vector<uint8_t> MakeNoise(size_t cb, uint32_t nSeed)
+{
+	std::vector<uint8_t> noise(cb);
+	for (size_t i = 0; i < cb; i++) {
+		nSeed = nSeed * 1664525 + 1013904223;
+		noise[i] = (uint8_t)(nSeed >> 24);
+	}
+	return noise;
+}
+
+static GenerativeConfig MakeConfig(GENERATIVE_EFFECT effect, uint32_t cThreads)
+{
+	GenerativeConfig config;
+	config.effect = effect;
+	config.cx = FRAME_WIDTH;
+	config.cy = FRAME_HEIGHT;
+	config.cThreads = cThreads;
+	config.nSeed = 7;
+	return config;
+}
+
+// The frame at hnsTime from a new renderer, on one thread with the
+// scalar kernels.
+static std::vector<uint8_t> RenderFresh(GENERATIVE_EFFECT effect, HNSTIME hnsTime)
+{
+	KERNEL_ISA isa = GetKernelIsa();
+	SetKernelIsa(KERNEL_ISA_SCALAR);
+	GenerativeRenderer renderer;
+	renderer.Init(MakeConfig(effect, 1));
+	renderer.Render(hnsTime);
+	SetKernelIsa(isa);
+	return std::vector<uint8_t>(renderer.GetPixels(), renderer.GetPixels() + (size_t)FRAME_WIDTH * FRAME_HEIGHT * 4);
+}
+
+// Every pixel that differs between before and after lies in a rectangle.
+static bool IsCovered(const std::vector<uint8_t>& before, const uint8_t* pAfter, const LayoutRect* pDirty, size_t cDirty)
+{
+	for (uint32_t y = 0; y < FRAME_HEIGHT; y++) {
+		for (uint32_t x = 0; x < FRAME_WIDTH; x++) {
+			size_t i = ((size_t)y * FRAME_WIDTH + x) * 4;
+			if (memcmp(&before[i], pAfter + i, 4) == 0)
+				continue;
+			bool bCovered = false;
+			for (size_t n = 0; n < cDirty && !bCovered; n++) {
+				bCovered = (int32_t)x >= pDirty[n].left && (int32_t)x < pDirty[n].right && (int32_t)y >= pDirty[n].top &&
+					(int32_t)y < pDirty[n].bottom;
+			}
+			if (!bCovered)
+				return false;
+		}
+	}
+	return true;
+}
+
+static bool CheckKernel()
+{
+	// Rows of every length up to 48, then long ones; a is read from offset n.
+	const uint32_t cCases = 64, cxMax = 1000 + cCases - 1;
+	std::vector<uint8_t> a = MakeNoise(cCases + cxMax, 1), b = MakeNoise(cxMax, 2);
+	std::vector<uint8_t> reference((cxMax + 1) * 4), output(reference.size());	// And a guard pixel
+	const KERNEL_ISA isaSaved = GetKernelIsa();
+	bool bPassed = true;
+	for (uint32_t n = 0; n < cCases && bPassed; n++) {
+		uint32_t cx = n < 48 ? n : 1000 + n;
+		PlasmaPalette palette = { { (uint16_t)(n * 37 % 512), (uint16_t)(n * 101 % 512), (uint16_t)(511 - n) } };
+		uint32_t nBase = n * 13 % 256;
+		PlasmaRowScalar(a.data() + n, b.data(), nBase, palette, cx, reference.data());
+
+		// The wave peaks at 255 and clamps to 0 at its foot.
+		for (uint32_t x = 0; x < cx && bPassed; x++) {
+			int v2 = 2 * (a[n + x] + b[x] + (int)nBase);
+			int w = ((v2 + palette.nPhase[1]) & 511) - 256;
+			int nExpected = 255 - (w < 0 ? -w : w);
+			bPassed = reference[x * 4 + 1] == (nExpected < 0 ? 0 : nExpected) && reference[x * 4 + 3] == 255;
+		}
+
+		for (int i = 0; i < KERNEL_ISA_COUNT && bPassed; i++) {
+			if (!SetKernelIsa((KERNEL_ISA)i))
+				continue;
+			memset(output.data(), 0xCD, output.size());
+			GetColorKernels().pfnPlasmaRow(a.data() + n, b.data(), nBase, palette, cx, output.data());
+			bPassed = memcmp(output.data(), reference.data(), (size_t)cx * 4) == 0 && output[(size_t)cx * 4] == 0xCD;
+		}
+	}
+	SetKernelIsa(isaSaved);
+	return Report("plasma kernel", bPassed);
+}
+
+static bool CheckNames()
+{
+	GENERATIVE_EFFECT effect = GENERATIVE_EFFECT_COUNT;
+	bool bPassed = FindGenerativeEffect(L"Particles", &effect) && effect == GENERATIVE_EFFECT_PARTICLES;
+	bPassed &= FindGenerativeEffect(L"plasma", &effect) && effect == GENERATIVE_EFFECT_PLASMA;
+	bPassed &= !FindGenerativeEffect(L"plasm", &effect) && !FindGenerativeEffect(L"noises", &effect) &&
+		!FindGenerativeEffect(L"", &effect);
+	for (int i = 0; i < GENERATIVE_EFFECT_COUNT; i++) {
+		const char* psz = GetGenerativeEffectName((GENERATIVE_EFFECT)i);
+		bPassed &= FindGenerativeEffect(std::wstring(psz, psz + strlen(psz)), &effect) && effect == i;
+	}
+	return Report("names", bPassed);
+}
+
+//-----------------------------------------------------------------------------
+// CheckEffect
+//
+// Renders TEST_FRAMES frames, at frame times and with a few skipped and
+// repeated, comparing each against the frame before and every few
+// against a fresh render.
+//-----------------------------------------------------------------------------
+
+static bool CheckEffect(GENERATIVE_EFFECT effect, double* pfDirtyShare)
+{
+	GenerativeRenderer renderer;
+	bool bPassed = renderer.Init(MakeConfig(effect, TEST_THREADS)) && renderer.GetThreadCount() == TEST_THREADS;
+	const size_t cbFrame = (size_t)FRAME_WIDTH * FRAME_HEIGHT * 4;
+	std::vector<uint8_t> last(cbFrame);
+	LayoutRect dirty[MAX_DIRTY];
+	uint64_t cDirtyTiles = 0;
+	HNSTIME hnsTime = 0;
+
+	bPassed &= renderer.Render(0) == renderer.GetFrameStats().cTiles;
+	for (uint32_t n = 1; n <= TEST_FRAMES && bPassed; n++) {
+		memcpy(last.data(), renderer.GetPixels(), cbFrame);
+		if (n % 11 == 0) {
+			// A repeated time changes nothing.
+			bPassed &= renderer.Render(hnsTime) == 0 && renderer.GetDirtyRects(dirty, MAX_DIRTY) == 0 &&
+				memcmp(last.data(), renderer.GetPixels(), cbFrame) == 0;
+			continue;
+		}
+		hnsTime += n % 7 == 0 ? 10 * FRAME_TIME : FRAME_TIME;
+		uint32_t cRendered = renderer.Render(hnsTime);
+		cDirtyTiles += cRendered;
+		size_t cDirty = renderer.GetDirtyRects(dirty, MAX_DIRTY);
+		bPassed &= (cRendered == 0) == (cDirty == 0);
+		bPassed &= IsCovered(last, renderer.GetPixels(), dirty, cDirty);
+		if (n % 5 == 0 || n == TEST_FRAMES)
+			bPassed &= memcmp(RenderFresh(effect, hnsTime).data(), renderer.GetPixels(), cbFrame) == 0;
+	}
+
+	*pfDirtyShare = (double)cDirtyTiles / ((double)renderer.GetFrameStats().cTiles * TEST_FRAMES);
+	printf("  %-9s %5.1f%% of the tiles rendered per frame\n", GetGenerativeEffectName(effect), *pfDirtyShare * 100);
+	return bPassed;
+}
+
+static bool CheckEffects()
+{
+	bool bPassed = true;
+	double shares[GENERATIVE_EFFECT_COUNT] = {};
+	for (int i = 0; i < GENERATIVE_EFFECT_COUNT; i++)
+		bPassed &= CheckEffect((GENERATIVE_EFFECT)i, &shares[i]);
+
+	// Plasma and noise change everywhere; the gradient and the particles
+	// skip most tiles.
+	bPassed &= shares[GENERATIVE_EFFECT_PLASMA] > 0.85 && shares[GENERATIVE_EFFECT_NOISE] > 0.85;
+	bPassed &= shares[GENERATIVE_EFFECT_GRADIENT] < 0.75 && shares[GENERATIVE_EFFECT_PARTICLES] < 0.75;
+	return Report("effects", bPassed);
+}
+
+static bool CheckDirtyRects()
+{
+	// A full frame is one rectangle; a cap merges the rest into the last.
+	GenerativeRenderer renderer;
+	renderer.Init(MakeConfig(GENERATIVE_EFFECT_PLASMA, 1));
+	renderer.Render(0);
+	LayoutRect dirty[MAX_DIRTY];
+	bool bPassed = renderer.GetDirtyRects(dirty, MAX_DIRTY) == 1 && dirty[0].left == 0 && dirty[0].top == 0 &&
+		dirty[0].right == (int32_t)FRAME_WIDTH && dirty[0].bottom == (int32_t)FRAME_HEIGHT;
+
+	GenerativeConfig config = MakeConfig(GENERATIVE_EFFECT_PARTICLES, 1);
+	config.cx = 1280;
+	config.cy = 720;
+	renderer.Init(config);
+	renderer.Render(0);
+	renderer.Render(FRAME_TIME);
+	size_t cAll = renderer.GetDirtyRects(dirty, MAX_DIRTY);
+	LayoutRect capped[2];
+	bPassed &= cAll > 2 && renderer.GetDirtyRects(capped, 2) == 2 && memcmp(&capped[0], &dirty[0], sizeof(LayoutRect)) == 0;
+	for (size_t i = 1; i < cAll; i++) {
+		bPassed &= dirty[i].left >= capped[1].left && dirty[i].top >= capped[1].top && dirty[i].right <= capped[1].right &&
+			dirty[i].bottom <= capped[1].bottom;
+	}
+	return Report("dirty rects", bPassed);
+}
+
+static bool CheckAllocations()
+{
+	bool bPassed = true;
+	for (int i = 0; i < GENERATIVE_EFFECT_COUNT; i++) {
+		GenerativeRenderer renderer;
+		renderer.Init(MakeConfig((GENERATIVE_EFFECT)i, TEST_THREADS));
+		renderer.Render(0);
+		uint64_t cAllocations = GetAllocationCount();
+		for (uint32_t n = 1; n <= 20; n++)
+			renderer.Render(n * FRAME_TIME);
+		bPassed &= GetAllocationCount() == cAllocations;
+	}
+	return Report("allocations", bPassed);
+}
+
+static bool CheckBench()
+{
+	bool bPassed = true;
+	for (int i = 0; i < GENERATIVE_EFFECT_COUNT; i++) {
+		GenerativeBenchResult one, two;
+		bPassed &= RunGenerativeBench((GENERATIVE_EFFECT)i, 640, 360, 1, 3, &one) &&
+			RunGenerativeBench((GENERATIVE_EFFECT)i, 640, 360, 2, 3, &two);
+		bPassed &= one.nChecksum == two.nChecksum && one.cThreads == 1 && two.cThreads == 2;
+		printf("  %-9s 640x360 %.3f ms/frame on 1 thread, %.3f ms/frame on 2\n", GetGenerativeEffectName(one.effect),
+			one.fFrameMs, two.fFrameMs);
+	}
+	return Report("bench", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckKernel();
+	bPassed &= CheckNames();
+	bPassed &= CheckEffects();
+	bPassed &= CheckDirtyRects();
+	bPassed &= CheckAllocations();
+	bPassed &= CheckBench();
+	return bPassed ? 0 : 1;
+}
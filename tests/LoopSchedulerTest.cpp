@@ -0,0 +1,217 @@
+//-------------------------------------------------------------------
+//
+// LoopSchedulerTest
+//
+// Loops clips through a LoopScheduler against a simulated presentation
+// clock whose seeks take a set time, during which the tail of the clip
+// keeps playing, and whose wakeups fire up to a timer slack late. The
+// picture must wrap within one frame of the clip's end once the seek
+// latency is learned, never drop more than the lead time's few frames,
+// and hold the last frame instead of dropping the tail when seeks are
+// slower than that.
+//
+//-------------------------------------------------------------------
+
+#include "LoopScheduler.h"
+#include <stdio.h>
+#include <vector>
+
+static const HNSTIME TIMER_SLACK = 16 * HNS_PER_MSEC;
+
+class SimClock : public IPresentationClock
+{
+public:
+	SimClock(HNSTIME hnsDuration) : m_hnsDuration(hnsDuration), m_hnsSeekLatency(0), m_hnsNow(0), m_hnsBase(0),
+		m_hnsBaseTime(0), m_hnsSeekDone(-1), m_hnsWakeup(-1), m_nRandom(7)
+	{
+	}
+
+	void SetSeekLatency(HNSTIME hnsLatency) { m_hnsSeekLatency = hnsLatency; }
+
+	// Positions the picture wrapped at, in order.
+	const std::vector<HNSTIME>& GetWraps() const { return m_wraps; }
+
+	bool GetPosition(HNSTIME* phnsPosition) override
+	{
+		*phnsPosition = Position();
+		return true;
+	}
+	float GetRate() override { return 1.0f; }
+	HNSTIME GetSystemTime() override { return m_hnsNow; }
+	bool SeekToStart() override
+	{
+		if (m_hnsSeekDone < 0)
+			m_hnsSeekDone = m_hnsNow + m_hnsSeekLatency;
+		return true;
+	}
+	void ArmWakeup(HNSTIME hnsDelay) override
+	{
+		m_nRandom ^= m_nRandom << 13;
+		m_nRandom ^= m_nRandom >> 17;
+		m_nRandom ^= m_nRandom << 5;
+		m_hnsWakeup = m_hnsNow + hnsDelay + (HNSTIME)(m_nRandom % (uint32_t)(TIMER_SLACK + 1));
+	}
+	void CancelWakeup() override { m_hnsWakeup = -1; }
+
+	// Plays until the picture wrapped cLoops more times.
+	void Run(LoopScheduler* pLoop, size_t cLoops)
+	{
+		size_t cWraps = m_wraps.size() + cLoops;
+		while (m_wraps.size() < cWraps) {
+			// While seeking the clip plays on to its end and holds there.
+			HNSTIME hnsEnd = m_hnsSeekDone < 0 && Position() < m_hnsDuration ?
+				m_hnsBaseTime + m_hnsDuration - m_hnsBase : -1;
+			HNSTIME hnsNext = m_hnsSeekDone;
+			if (hnsNext < 0 || (hnsEnd >= 0 && hnsEnd < hnsNext))
+				hnsNext = hnsEnd;
+			if (hnsNext < 0 || (m_hnsWakeup >= 0 && m_hnsWakeup < hnsNext))
+				hnsNext = m_hnsWakeup;
+			if (hnsNext < 0)
+				return;
+			m_hnsNow = hnsNext;
+
+			if (hnsNext == m_hnsSeekDone) {
+				m_wraps.push_back(Position());
+				m_hnsSeekDone = -1;
+				m_hnsBase = 0;
+				m_hnsBaseTime = m_hnsNow;
+			}
+			else if (hnsNext == hnsEnd) {
+				m_hnsBase = m_hnsDuration;
+				m_hnsBaseTime = m_hnsNow;
+				pLoop->OnPlaybackEnded();
+			}
+			else {
+				m_hnsWakeup = -1;
+				pLoop->OnWakeup();
+			}
+		}
+	}
+
+private:
+	HNSTIME Position() const
+	{
+		HNSTIME hnsPosition = m_hnsBase + m_hnsNow - m_hnsBaseTime;
+		return hnsPosition < m_hnsDuration ? hnsPosition : m_hnsDuration;
+	}
+
+	HNSTIME					m_hnsDuration;
+	HNSTIME					m_hnsSeekLatency;
+	HNSTIME					m_hnsNow;
+	HNSTIME					m_hnsBase;		// Position at m_hnsBaseTime
+	HNSTIME					m_hnsBaseTime;
+	HNSTIME					m_hnsSeekDone;	// The seek issued completes, -1 = none
+	HNSTIME					m_hnsWakeup;	// Fires, -1 = none
+	uint32_t				m_nRandom;
+	std::vector<HNSTIME>	m_wraps;
+};
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+// Most of the clip's end dropped by the wraps from nFirst on.
+static HNSTIME GetMaxDropped(const SimClock& clock, HNSTIME hnsDuration, size_t nFirst)
+{
+	HNSTIME hnsMax = 0;
+	for (size_t i = nFirst; i < clock.GetWraps().size(); i++) {
+		if (hnsDuration - clock.GetWraps()[i] > hnsMax)
+			hnsMax = hnsDuration - clock.GetWraps()[i];
+	}
+	return hnsMax;
+}
+
+// Seeks of a steady latency: after a few loops to learn it, every wrap
+// is within a frame of the end, and none is missed.
+static bool CheckSteady(const char* pszName, HNSTIME hnsDuration, HNSTIME hnsFrame, HNSTIME hnsSeekLatency)
+{
+	SimClock clock(hnsDuration);
+	clock.SetSeekLatency(hnsSeekLatency);
+	LoopScheduler loop(&clock);
+	loop.SetTimerSlack(TIMER_SLACK);
+	loop.SetFrameDuration(hnsFrame);
+	loop.SetDuration(hnsDuration);
+	loop.Start();
+	clock.Run(&loop, 100);
+
+	bool bPassed = clock.GetWraps().size() == 100 && loop.GetMissedCount() == 0;
+	bPassed &= GetMaxDropped(clock, hnsDuration, 0) <= 3 * hnsFrame;
+	bPassed &= GetMaxDropped(clock, hnsDuration, 10) <= hnsFrame;
+	return Report(pszName, bPassed);
+}
+
+// Seeks slower than the lead let the clip end and hold its last frame;
+// once they are fast again, no more than the lead is ever dropped and
+// the wraps come back to within a frame of the end.
+static bool CheckSlowSeeks()
+{
+	const HNSTIME hnsDuration = 4 * HNS_PER_SECOND, hnsFrame = HNS_PER_SECOND / 30;
+	SimClock clock(hnsDuration);
+	LoopScheduler loop(&clock);
+	loop.SetTimerSlack(TIMER_SLACK);
+	loop.SetFrameDuration(hnsFrame);
+	loop.SetDuration(hnsDuration);
+	loop.Start();
+
+	clock.SetSeekLatency(400 * HNS_PER_MSEC);
+	clock.Run(&loop, 10);
+	bool bPassed = GetMaxDropped(clock, hnsDuration, 0) == 0;
+	bPassed &= loop.GetLeadTime() <= 3 * hnsFrame;
+
+	clock.SetSeekLatency(20 * HNS_PER_MSEC);
+	clock.Run(&loop, 40);
+	bPassed &= GetMaxDropped(clock, hnsDuration, 10) <= 3 * hnsFrame;
+	bPassed &= GetMaxDropped(clock, hnsDuration, 30) <= hnsFrame;
+	return Report("slow seeks", bPassed);
+}
+
+// Ends reached before the wrap widen the lead up to its few frames, not
+// past them.
+static bool CheckMissedEnds()
+{
+	const HNSTIME hnsDuration = 2 * HNS_PER_SECOND, hnsFrame = HNS_PER_SECOND / 30;
+	SimClock clock(hnsDuration);
+	LoopScheduler loop(&clock);
+	loop.SetTimerSlack(TIMER_SLACK);
+	loop.SetFrameDuration(hnsFrame);
+	loop.SetDuration(hnsDuration);
+	loop.Start();
+	HNSTIME hnsLead = loop.GetLeadTime();
+	loop.OnPlaybackEnded();
+	bool bPassed = loop.GetLeadTime() > hnsLead;
+	for (int i = 0; i < 20; i++)
+		loop.OnPlaybackEnded();
+	bPassed &= loop.GetMissedCount() == 21 && loop.GetSeekLatency() <= 3 * hnsFrame &&
+		loop.GetLeadTime() == 3 * hnsFrame;
+	return Report("missed ends", bPassed);
+}
+
+// A clip of a few frames leads by a quarter of itself at most.
+static bool CheckShortClip()
+{
+	const HNSTIME hnsDuration = 200 * HNS_PER_MSEC, hnsFrame = HNS_PER_SECOND / 30;
+	SimClock clock(hnsDuration);
+	clock.SetSeekLatency(30 * HNS_PER_MSEC);
+	LoopScheduler loop(&clock);
+	loop.SetTimerSlack(TIMER_SLACK);
+	loop.SetFrameDuration(hnsFrame);
+	loop.SetDuration(hnsDuration);
+	loop.Start();
+	clock.Run(&loop, 200);
+	bool bPassed = loop.GetLeadTime() <= hnsDuration / 4 && GetMaxDropped(clock, hnsDuration, 0) <= hnsDuration / 4;
+	bPassed &= GetMaxDropped(clock, hnsDuration, 10) <= hnsFrame;
+	return Report("short clip", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckSteady("30 fps, 50 ms seeks", 10 * HNS_PER_SECOND, HNS_PER_SECOND / 30, 50 * HNS_PER_MSEC);
+	bPassed &= CheckSteady("24 fps, 20 ms seeks", 3 * HNS_PER_SECOND, HNS_PER_SECOND / 24, 20 * HNS_PER_MSEC);
+	bPassed &= CheckSteady("60 fps, 10 ms seeks", 2 * HNS_PER_SECOND, HNS_PER_SECOND / 60, 10 * HNS_PER_MSEC);
+	bPassed &= CheckSlowSeeks();
+	bPassed &= CheckMissedEnds();
+	bPassed &= CheckShortClip();
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+//-------------------------------------------------------------------
+//
+// MonitorLayoutTest
+//
+// Solves monitor layouts for single, side-by-side, mixed-DPI, portrait
+// and negative-origin monitor setups in each layout and scale mode, and
+// checks every viewport's destination pixels and source rectangle: that
+// spans are seamless across monitors, that fit letterboxes and fill
+// crops, and that monitors the picture misses get no viewport.
+//
+//-------------------------------------------------------------------
+
+#include "MonitorLayout.h"
+#include <math.h>
+#include <stdio.h>
+
+static MonitorDesc MakeMonitor(int32_t left, int32_t top, int32_t cx, int32_t cy, uint32_t nDpi)
+{
+	MonitorDesc monitor;
+	monitor.rcMonitor.left = left;
+	monitor.rcMonitor.top = top;
+	monitor.rcMonitor.right = left + cx;
+	monitor.rcMonitor.bottom = top + cy;
+	monitor.nDpi = nDpi;
+	return monitor;
+}
+
+static LayoutParams MakeParams(uint32_t cx, uint32_t cy, LAYOUT_MODE layout, SCALE_MODE scale)
+{
+	LayoutParams params;
+	params.cxSource = cx;
+	params.cySource = cy;
+	params.layout = layout;
+	params.scale = scale;
+	return params;
+}
+
+static bool IsDest(const Viewport& vp, int32_t left, int32_t top, int32_t right, int32_t bottom)
+{
+	return vp.rcDest.left == left && vp.rcDest.top == top && vp.rcDest.right == right && vp.rcDest.bottom == bottom;
+}
+
+static bool IsNear(double a, double b)
+{
+	return fabs(a - b) < 1e-6;
+}
+
+static bool IsSource(const Viewport& vp, double left, double top, double right, double bottom)
+{
+	return IsNear(vp.rcSource.left, left) && IsNear(vp.rcSource.top, top) && IsNear(vp.rcSource.right, right) &&
+		IsNear(vp.rcSource.bottom, bottom);
+}
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+// One monitor of the clip's size shows the whole clip in every mode.
+static bool CheckSingle()
+{
+	MonitorDesc monitor = MakeMonitor(0, 0, 1920, 1080, 96);
+	bool bPassed = true;
+	for (int layout = LAYOUT_SPAN; layout <= LAYOUT_CLONE; layout++) {
+		for (int scale = SCALE_FIT; scale <= SCALE_STRETCH; scale++) {
+			std::vector<Viewport> viewports;
+			bPassed &= SolveMonitorLayout(MakeParams(1920, 1080, (LAYOUT_MODE)layout, (SCALE_MODE)scale),
+				&monitor, 1, &viewports) && viewports.size() == 1 && viewports[0].nMonitor == 0 &&
+				IsDest(viewports[0], 0, 0, 1920, 1080) && IsSource(viewports[0], 0, 0, 1920, 1080);
+		}
+	}
+	return Report("single monitor", bPassed);
+}
+
+// Two 1080p monitors side by side: stretch splits the clip in halves, fit
+// letterboxes it into the middle, fill crops its top and bottom.
+static bool CheckSpan()
+{
+	MonitorDesc monitors[] = { MakeMonitor(0, 0, 1920, 1080, 96), MakeMonitor(1920, 0, 1920, 1080, 96) };
+	std::vector<Viewport> vps;
+	bool bPassed = SolveMonitorLayout(MakeParams(1920, 1080, LAYOUT_SPAN, SCALE_STRETCH), monitors, 2, &vps) &&
+		vps.size() == 2 && IsDest(vps[0], 0, 0, 1920, 1080) && IsSource(vps[0], 0, 0, 960, 1080) &&
+		IsDest(vps[1], 1920, 0, 3840, 1080) && IsSource(vps[1], 960, 0, 1920, 1080);
+
+	bPassed &= SolveMonitorLayout(MakeParams(1920, 1080, LAYOUT_SPAN, SCALE_FIT), monitors, 2, &vps) &&
+		vps.size() == 2 && IsDest(vps[0], 960, 0, 1920, 1080) && IsSource(vps[0], 0, 0, 960, 1080) &&
+		IsDest(vps[1], 1920, 0, 2880, 1080) && IsSource(vps[1], 960, 0, 1920, 1080);
+
+	bPassed &= SolveMonitorLayout(MakeParams(1920, 1080, LAYOUT_SPAN, SCALE_FILL), monitors, 2, &vps) &&
+		vps.size() == 2 && IsDest(vps[0], 0, 0, 1920, 1080) && IsSource(vps[0], 0, 270, 960, 810) &&
+		IsDest(vps[1], 1920, 0, 3840, 1080) && IsSource(vps[1], 960, 270, 1920, 810);
+	return Report("span", bPassed);
+}
+
+// A portrait clip fit over three monitors only reaches the middle one.
+static bool CheckUncovered()
+{
+	MonitorDesc monitors[] = { MakeMonitor(0, 0, 1920, 1080, 96), MakeMonitor(1920, 0, 1920, 1080, 96),
+		MakeMonitor(3840, 0, 1920, 1080, 96) };
+	std::vector<Viewport> vps;
+	bool bPassed = SolveMonitorLayout(MakeParams(1080, 1920, LAYOUT_SPAN, SCALE_FIT), monitors, 3, &vps) &&
+		vps.size() == 1 && vps[0].nMonitor == 1 && vps[0].rcDest.top == 0 && vps[0].rcDest.bottom == 1080 &&
+		vps[0].rcDest.left == 2576 && vps[0].rcDest.right == 3184;
+	return Report("uncovered monitors", bPassed);
+}
+
+// A 4K monitor at 200% next to a 1080p one at 100% spans by physical
+// size: each shows half the clip, and the seam between them matches.
+static bool CheckPhysical()
+{
+	MonitorDesc monitors[] = { MakeMonitor(0, 0, 1920, 1080, 96), MakeMonitor(1920, 0, 3840, 2160, 192) };
+	std::vector<Viewport> vps;
+	bool bPassed = SolveMonitorLayout(MakeParams(3840, 1080, LAYOUT_SPAN_PHYSICAL, SCALE_STRETCH), monitors, 2,
+		&vps) && vps.size() == 2 && IsDest(vps[0], 0, 0, 1920, 1080) && IsSource(vps[0], 0, 0, 1920, 1080) &&
+		IsDest(vps[1], 1920, 0, 5760, 2160) && IsSource(vps[1], 1920, 0, 3840, 1080);
+
+	// In pixels the 4K monitor would take two thirds of the clip instead.
+	bPassed &= SolveMonitorLayout(MakeParams(3840, 1080, LAYOUT_SPAN, SCALE_STRETCH), monitors, 2, &vps) &&
+		vps.size() == 2 && IsSource(vps[0], 0, 0, 1280, 540) && IsSource(vps[1], 1280, 0, 3840, 1080);
+	return Report("span physical", bPassed);
+}
+
+// Clone fits the whole clip on each monitor, letterboxed on a portrait one.
+static bool CheckClone()
+{
+	MonitorDesc monitors[] = { MakeMonitor(0, 0, 1920, 1080, 96), MakeMonitor(1920, 0, 1080, 1920, 96) };
+	std::vector<Viewport> vps;
+	bool bPassed = SolveMonitorLayout(MakeParams(1920, 1080, LAYOUT_CLONE, SCALE_FIT), monitors, 2, &vps) &&
+		vps.size() == 2 && IsDest(vps[0], 0, 0, 1920, 1080) && IsSource(vps[0], 0, 0, 1920, 1080) &&
+		IsDest(vps[1], 1920, 656, 3000, 1264);
+	bPassed = bPassed && IsNear(vps[1].rcSource.left, 0) && IsNear(vps[1].rcSource.right, 1920) &&
+		fabs(vps[1].rcSource.top) < 1 && fabs(vps[1].rcSource.bottom - 1080) < 1;
+	return Report("clone", bPassed);
+}
+
+// With a monitor left of and above the primary, destinations keep the
+// desktop's negative coordinates, each lies within its monitor, and
+// neighbouring monitors meet on the same source column.
+static bool CheckNegativeOrigin()
+{
+	MonitorDesc monitors[] = { MakeMonitor(-1280, -200, 1280, 1024, 96), MakeMonitor(0, 0, 2560, 1440, 96) };
+	std::vector<Viewport> vps;
+	bool bPassed = SolveMonitorLayout(MakeParams(1920, 1080, LAYOUT_SPAN, SCALE_FILL), monitors, 2, &vps) &&
+		vps.size() == 2;
+	for (size_t i = 0; bPassed && i < vps.size(); i++) {
+		const LayoutRect& m = monitors[vps[i].nMonitor].rcMonitor;
+		bPassed &= vps[i].rcDest.left >= m.left && vps[i].rcDest.top >= m.top && vps[i].rcDest.right <= m.right &&
+			vps[i].rcDest.bottom <= m.bottom;
+		bPassed &= vps[i].rcSource.left >= -1e-6 && vps[i].rcSource.right <= 1920 + 1e-6 &&
+			vps[i].rcSource.top >= -1e-6 && vps[i].rcSource.bottom <= 1080 + 1e-6;
+	}
+	bPassed = bPassed && IsNear(vps[0].rcSource.right, vps[1].rcSource.left) && vps[0].rcDest.left == -1280 &&
+		vps[1].rcDest.right == 2560;
+	LayoutRect bounds = GetMonitorBounds(monitors, 2);
+	bPassed &= bounds.left == -1280 && bounds.top == -200 && bounds.right == 2560 && bounds.bottom == 1440;
+	return Report("negative origin", bPassed);
+}
+
+// Empty geometry is refused.
+static bool CheckEmpty()
+{
+	MonitorDesc monitor = MakeMonitor(0, 0, 1920, 1080, 96);
+	MonitorDesc empty = MakeMonitor(0, 0, 0, 0, 96);
+	std::vector<Viewport> vps;
+	bool bPassed = !SolveMonitorLayout(MakeParams(0, 1080, LAYOUT_SPAN, SCALE_FIT), &monitor, 1, &vps);
+	bPassed &= !SolveMonitorLayout(MakeParams(1920, 1080, LAYOUT_SPAN, SCALE_FIT), &monitor, 0, &vps);
+	bPassed &= !SolveMonitorLayout(MakeParams(1920, 1080, LAYOUT_SPAN, SCALE_FIT), &empty, 1, &vps) && vps.empty();
+	return Report("empty geometry", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckSingle();
+	bPassed &= CheckSpan();
+	bPassed &= CheckUncovered();
+	bPassed &= CheckPhysical();
+	bPassed &= CheckClone();
+	bPassed &= CheckNegativeOrigin();
+	bPassed &= CheckEmpty();
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+
+//-------------------------------------------------------------------
+// MP4 writer
+//
+// Builds MP4 boxes in memory, for the tests and benchmarks that write
+// the sample tables they index.
+//-------------------------------------------------------------------
+
+inline void PutBE32(std::vector<uint8_t>* pOut, uint32_t n)
+{
+	const uint8_t bytes[] = { (uint8_t)(n >> 24), (uint8_t)(n >> 16), (uint8_t)(n >> 8), (uint8_t)n };
+	pOut->insert(pOut->end(), bytes, bytes + 4);
+}
+
+inline void PutBE64(std::vector<uint8_t>* pOut, uint64_t n)
+{
+	PutBE32(pOut, (uint32_t)(n >> 32));
+	PutBE32(pOut, (uint32_t)n);
+}
+
+// Starts a box whose size EndBox fills in; a full box gets its version
+// and flags word too.
+inline size_t BeginBox(std::vector<uint8_t>* pOut, const char* pszType, bool bFull = false)
+{
+	size_t nAt = pOut->size();
+	PutBE32(pOut, 0);
+	pOut->insert(pOut->end(), pszType, pszType + 4);
+	if (bFull)
+		PutBE32(pOut, 0);
+	return nAt;
+}
+
+inline void EndBox(std::vector<uint8_t>* pOut, size_t nAt)
+{
+	uint32_t cb = (uint32_t)(pOut->size() - nAt);
+	for (int i = 0; i < 4; i++)
+		(*pOut)[nAt + i] = (uint8_t)(cb >> (24 - 8 * i));
+}
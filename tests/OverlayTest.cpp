@@ -0,0 +1,262 @@
+//-------------------------------------------------------------------
+//
+// OverlayTest
+//
+// The blend kernels of every instruction set must match the scalar one,
+// which must round exactly. Text must land on the pixels of its glyphs.
+// Redrawing only what changed, after a clock tick, a move, a hidden
+// widget or a widget under another one, must leave the same pixels as
+// composing the frame anew, report every changed pixel as dirty, and
+// allocate nothing once the widgets kept their size.
+//
+//-------------------------------------------------------------------
+
+#include "OverlayCompositor.h"
+#include "CountingAllocator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const uint32_t FRAME_WIDTH = 320;
+static const uint32_t FRAME_HEIGHT = 200;
+static const size_t MAX_DIRTY = 8;
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+static std::vector<uint8_t> MakeNoise(size_t cb, uint32_t nSeed)
+{
+	std::vector<uint8_t> noise(cb);
+	for (size_t i = 0; i < cb; i++) {
+		nSeed = nSeed * 1664525 + 1013904223;
+		noise[i] = (uint8_t)(nSeed >> 24);
+	}
+	return noise;
+}
+
+// Straight-alpha image with an alpha ramp, transparent in its corners.
+static std::vector<uint8_t> MakeImage(uint32_t cx, uint32_t cy)
+{
+	std::vector<uint8_t> image((size_t)cx * cy * 4);
+	for (uint32_t y = 0; y < cy; y++) {
+		for (uint32_t x = 0; x < cx; x++) {
+			uint8_t* p = image.data() + ((size_t)y * cx + x) * 4;
+			p[0] = (uint8_t)(x * 7);
+			p[1] = (uint8_t)(y * 5);
+			p[2] = 0x90;
+			p[3] = (uint8_t)((x < 4 && y < 4) ? 0 : (x + y) * 255 / (cx + cy));
+		}
+	}
+	return image;
+}
+
+static OverlayPlacement Place(OVERLAY_ANCHOR anchor, int32_t x, int32_t y)
+{
+	OverlayPlacement placement = { anchor, x, y };
+	return placement;
+}
+
+// Composes a copy of base as a new frame.
+static std::vector<uint8_t> ComposeFresh(OverlayCompositor* pOverlay, const std::vector<uint8_t>& base)
+{
+	std::vector<uint8_t> pixels = base;
+	OverlayTarget target;
+	LayoutRect dirty[MAX_DIRTY];
+	pOverlay->Compose(&target, pixels.data(), FRAME_WIDTH * 4, FRAME_WIDTH, FRAME_HEIGHT, true, dirty, MAX_DIRTY);
+	return pixels;
+}
+
+// Every pixel that differs between before and after lies in a dirty
+// rectangle.
+static bool IsCovered(const std::vector<uint8_t>& before, const std::vector<uint8_t>& after, const LayoutRect* pDirty,
+	size_t cDirty)
+{
+	for (uint32_t y = 0; y < FRAME_HEIGHT; y++) {
+		for (uint32_t x = 0; x < FRAME_WIDTH; x++) {
+			size_t i = ((size_t)y * FRAME_WIDTH + x) * 4;
+			if (memcmp(&before[i], &after[i], 4) == 0)
+				continue;
+			bool bCovered = false;
+			for (size_t n = 0; n < cDirty && !bCovered; n++)
+				bCovered = (int32_t)x >= pDirty[n].left && (int32_t)x < pDirty[n].right &&
+					(int32_t)y >= pDirty[n].top && (int32_t)y < pDirty[n].bottom;
+			if (!bCovered)
+				return false;
+		}
+	}
+	return true;
+}
+
+static bool CheckKernels()
+{
+	bool bPassed = true;
+	for (uint32_t nAlpha = 0; nAlpha < 256; nAlpha++) {
+		for (uint32_t d = 0; d < 256; d++) {
+			uint8_t src[4] = { 0, 0, 0, (uint8_t)nAlpha }, dst[4] = { (uint8_t)d, 0, 0, 0 };
+			BlendOverScalar(src, dst, 1);
+			bPassed &= dst[0] == (d * (255 - nAlpha) * 2 + 255) / 510;
+		}
+	}
+
+	// Premultiplied sources with runs of clear and opaque pixels, at every
+	// length around the vector widths.
+	std::vector<uint8_t> src = MakeNoise(4 * 1024, 7), under = MakeNoise(4 * 1024, 8);
+	for (size_t i = 0; i < src.size(); i += 4) {
+		uint32_t nAlpha = (i / 64) % 3 == 0 ? 0 : (i / 64) % 3 == 1 ? 255 : src[i + 3];
+		for (int c = 0; c < 3; c++)
+			src[i + c] = (uint8_t)(src[i + c] * nAlpha / 255);
+		src[i + 3] = (uint8_t)nAlpha;
+	}
+	std::vector<uint8_t> reference, output;
+	for (uint32_t cx = 0; cx < 40; cx++) {
+		uint32_t nOffset = cx * 3;
+		reference = under;
+		BlendOverScalar(src.data() + nOffset * 4, reference.data(), 1024 - nOffset);
+		for (int i = 0; i < KERNEL_ISA_COUNT; i++) {
+			if (!SetKernelIsa((KERNEL_ISA)i))
+				continue;
+			output = under;
+			GetColorKernels().pfnBlendOver(src.data() + nOffset * 4, output.data(), 1024 - nOffset);
+			bPassed &= output == reference;
+		}
+	}
+	SetKernelIsa(KERNEL_ISA_SCALAR);
+	return Report("kernels", bPassed);
+}
+
+static bool CheckGlyphs()
+{
+	OverlayCompositor overlay;
+	OverlayTextStyle style = { 0xFFFFFFFF, 0, 2, 0 };
+	bool bPassed = overlay.AddText("1", style, Place(OVERLAY_ANCHOR_TOP_LEFT, 10, 20)) != 0;
+	bPassed &= overlay.AddText(std::string(1000, '8').c_str(), style, Place(OVERLAY_ANCHOR_TOP_LEFT, 0, 0)) == 0;
+
+	std::vector<uint8_t> pixels((size_t)FRAME_WIDTH * FRAME_HEIGHT * 4, 0);
+	pixels = ComposeFresh(&overlay, pixels);
+	// "1" has its top pixel in column 2 and columns 1 to 3 in its bottom row.
+	const uint8_t* p = pixels.data();
+	bPassed &= p[((size_t)20 * FRAME_WIDTH + 10 + 4) * 4] == 255 && p[((size_t)21 * FRAME_WIDTH + 10 + 5) * 4 + 1] == 255;
+	bPassed &= p[((size_t)20 * FRAME_WIDTH + 10) * 4] == 0 && p[((size_t)20 * FRAME_WIDTH + 10 + 6) * 4] == 0;
+	for (uint32_t x = 0; x < 10; x++)
+		bPassed &= p[((size_t)33 * FRAME_WIDTH + 10 + x) * 4 + 2] == (x >= 2 && x < 8 ? 255 : 0);
+	bPassed &= p[((size_t)34 * FRAME_WIDTH + 13) * 4] == 0;
+
+	// A translucent black box halves a gray frame.
+	OverlayCompositor box;
+	OverlayTextStyle boxStyle = { 0xFFFFFFFF, 0x80000000, 1, 4 };
+	box.AddText(" ", boxStyle, Place(OVERLAY_ANCHOR_BOTTOM_RIGHT, 0, 0));
+	std::vector<uint8_t> gray((size_t)FRAME_WIDTH * FRAME_HEIGHT * 4, 200);
+	gray = ComposeFresh(&box, gray);
+	const uint8_t* pCorner = gray.data() + gray.size() - 4;
+	bPassed &= pCorner[0] == 100 && pCorner[2] == 100 && pCorner[3] == 228 && gray[0] == 200;
+	return Report("glyphs", bPassed);
+}
+
+// A clock over an image over text, with a second text elsewhere.
+static void AddWidgets(OverlayCompositor* pOverlay, uint32_t* pnText, uint32_t* pnImage, uint32_t* pnClock)
+{
+	OverlayTextStyle style = GetDefaultOverlayTextStyle();
+	style.nScale = 2;
+	std::vector<uint8_t> image = MakeImage(60, 50);
+	*pnText = pOverlay->AddText("CPU 3%", style, Place(OVERLAY_ANCHOR_TOP_LEFT, 5, 5));
+	*pnImage = pOverlay->AddImage(image.data(), 60, 50, 60 * 4, 200, Place(OVERLAY_ANCHOR_TOP_LEFT, 40, 10));
+	*pnClock = pOverlay->AddClock(true, style, Place(OVERLAY_ANCHOR_TOP_LEFT, 80, 40));
+	pOverlay->AddText("fps 60", style, Place(OVERLAY_ANCHOR_BOTTOM_RIGHT, -10, 4));
+}
+
+static bool CheckUpdates()
+{
+	OverlayCompositor overlay;
+	uint32_t nText, nImage, nClock;
+	AddWidgets(&overlay, &nText, &nImage, &nClock);
+	overlay.SetTime(3600 + 59);
+	bool bPassed = nText && nImage && nClock;
+
+	const std::vector<uint8_t> base = MakeNoise((size_t)FRAME_WIDTH * FRAME_HEIGHT * 4, 1);
+	std::vector<uint8_t> pixels = base, before;
+	OverlayTarget target;
+	LayoutRect dirty[MAX_DIRTY];
+	size_t cDirty = overlay.Compose(&target, pixels.data(), FRAME_WIDTH * 4, FRAME_WIDTH, FRAME_HEIGHT, true, dirty, MAX_DIRTY);
+	bPassed &= cDirty == 1 && dirty[0].right == (int32_t)FRAME_WIDTH && pixels == ComposeFresh(&overlay, base);
+	bPassed &= overlay.Compose(&target, pixels.data(), FRAME_WIDTH * 4, FRAME_WIDTH, FRAME_HEIGHT, false, dirty, MAX_DIRTY) == 0;
+
+	// Each change, redrawn in place, against the frame composed anew.
+	for (int nStep = 0; nStep < 6; nStep++) {
+		switch (nStep) {
+		case 0: bPassed &= overlay.SetTime(3600 + 60); break;
+		case 1: bPassed &= overlay.SetText(nText, "CPU 12.5%"); break;
+		case 2: bPassed &= overlay.SetPlacement(nImage, Place(OVERLAY_ANCHOR_BOTTOM_LEFT, 30, 20)); break;
+		case 3: bPassed &= overlay.SetPlacement(nClock, Place(OVERLAY_ANCHOR_TOP_LEFT, 50, 60)); break;
+		case 4: bPassed &= overlay.SetVisible(nText, false); break;
+		default: bPassed &= overlay.SetVisible(nText, true) && !overlay.SetTime(3600 + 60); break;
+		}
+		before = pixels;
+		cDirty = overlay.Compose(&target, pixels.data(), FRAME_WIDTH * 4, FRAME_WIDTH, FRAME_HEIGHT, false, dirty, MAX_DIRTY);
+		bPassed &= cDirty > 0 && pixels == ComposeFresh(&overlay, base) && IsCovered(before, pixels, dirty, cDirty);
+	}
+
+	// With one dirty rectangle the changes merge into it.
+	overlay.SetTime(7200);
+	overlay.SetText(nText, "CPU 1%");
+	before = pixels;
+	cDirty = overlay.Compose(&target, pixels.data(), FRAME_WIDTH * 4, FRAME_WIDTH, FRAME_HEIGHT, false, dirty, 1);
+	bPassed &= cDirty == 1 && IsCovered(before, pixels, dirty, cDirty);
+
+	// Hiding everything gives the frame back.
+	for (uint32_t nId = 1; nId <= 4; nId++)
+		overlay.SetVisible(nId, false);
+	overlay.Compose(&target, pixels.data(), FRAME_WIDTH * 4, FRAME_WIDTH, FRAME_HEIGHT, false, dirty, MAX_DIRTY);
+	bPassed &= pixels == base && overlay.IsEmpty();
+	return Report("updates", bPassed);
+}
+
+static bool CheckAllocations()
+{
+	OverlayCompositor overlay;
+	uint32_t nText, nImage, nClock;
+	AddWidgets(&overlay, &nText, &nImage, &nClock);
+	std::vector<uint8_t> base = MakeNoise((size_t)FRAME_WIDTH * FRAME_HEIGHT * 4, 2), pixels = base;
+	OverlayTarget target;
+	LayoutRect dirty[MAX_DIRTY];
+	overlay.Compose(&target, pixels.data(), FRAME_WIDTH * 4, FRAME_WIDTH, FRAME_HEIGHT, true, dirty, MAX_DIRTY);
+
+	uint64_t cAllocations = GetAllocationCount();
+	for (int32_t n = 0; n < 100; n++) {
+		overlay.SetTime(n * 37);
+		overlay.Compose(&target, pixels.data(), FRAME_WIDTH * 4, FRAME_WIDTH, FRAME_HEIGHT, false, dirty, MAX_DIRTY);
+		if (n % 10 == 0) {
+			memcpy(pixels.data(), base.data(), base.size());
+			overlay.Compose(&target, pixels.data(), FRAME_WIDTH * 4, FRAME_WIDTH, FRAME_HEIGHT, true, dirty, MAX_DIRTY);
+		}
+	}
+	return Report("allocations", GetAllocationCount() == cAllocations);
+}
+
+static bool CheckBench()
+{
+	OverlayBenchResult results[KERNEL_ISA_COUNT];
+	size_t cResults = RunOverlayBench(1280, 720, 2, results, KERNEL_ISA_COUNT);
+	bool bPassed = cResults > 0;
+	for (size_t i = 0; i < cResults; i++) {
+		printf("  %-6s coverage %.1f%%, new frame %.3f ms, clock tick %.3f ms, full-frame blend %.3f ms\n",
+			GetKernelIsaName(results[i].isa), results[i].fCoverage * 100, results[i].fFrameMs, results[i].fTickMs,
+			results[i].fFullMs);
+		bPassed &= results[i].bExact && results[i].fCoverage > 0.0 && results[i].fCoverage < 0.5;
+	}
+	return Report("bench", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckKernels();
+	bPassed &= CheckGlyphs();
+	bPassed &= CheckUpdates();
+	bPassed &= CheckAllocations();
+	bPassed &= CheckBench();
+	return bPassed ? 0 : 1;
+}
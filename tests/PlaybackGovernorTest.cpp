@@ -0,0 +1,178 @@
+//-------------------------------------------------------------------
+//
+// PlaybackGovernorTest
+//
+// Replays traces of timestamped signal changes through a
+// PlaybackGovernor, advancing it at each deadline it reports as the
+// app's timer would, and checks the modes it enters and when: the
+// enter and resume delays, the minimum dwell between changes, signals
+// that flicker faster than the delays, and the time and CPU accounted
+// to each mode.
+//
+//-------------------------------------------------------------------
+
+#include "PlaybackGovernor.h"
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+static const HNSTIME MS = HNS_PER_MSEC;
+
+struct ModeChange
+{
+	HNSTIME			hnsTime;
+	GOVERNOR_MODE	mode;
+};
+
+static GovernorEvent MakeEvent(HNSTIME hnsTime, GOVERNOR_SIGNAL signal, bool bActive)
+{
+	GovernorEvent event;
+	event.hnsTime = hnsTime;
+	event.signal = signal;
+	event.bActive = bActive;
+	return event;
+}
+
+// Feeds the events in order and advances the governor at every deadline
+// up to hnsEnd. Returns the mode changes made.
+static std::vector<ModeChange> Replay(PlaybackGovernor* pGovernor, const std::vector<GovernorEvent>& events,
+	HNSTIME hnsEnd)
+{
+	std::vector<ModeChange> changes;
+	for (size_t i = 0; i <= events.size(); i++) {
+		HNSTIME hnsNext = i < events.size() ? events[i].hnsTime : hnsEnd;
+		for (HNSTIME hnsDeadline = pGovernor->GetDeadline(); hnsDeadline >= 0 && hnsDeadline <= hnsNext;
+			hnsDeadline = pGovernor->GetDeadline()) {
+			if (!pGovernor->Advance(hnsDeadline))
+				break;
+			ModeChange change = { hnsDeadline, pGovernor->GetMode() };
+			changes.push_back(change);
+		}
+		if (i < events.size() && pGovernor->OnEvent(events[i])) {
+			ModeChange change = { events[i].hnsTime, pGovernor->GetMode() };
+			changes.push_back(change);
+		}
+	}
+	return changes;
+}
+
+static bool IsTrace(const std::vector<ModeChange>& changes, const ModeChange* pExpected, size_t cExpected)
+{
+	if (changes.size() != cExpected)
+		return false;
+	for (size_t i = 0; i < cExpected; i++) {
+		if (changes[i].hnsTime != pExpected[i].hnsTime || changes[i].mode != pExpected[i].mode)
+			return false;
+	}
+	return true;
+}
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+// Locked for a few seconds: paused after the enter delay, playing again
+// after the resume delay, with the time paused accounted.
+static bool CheckLockUnlock()
+{
+	GovernorConfig config;
+	PlaybackGovernor governor(config);
+	std::vector<GovernorEvent> events;
+	events.push_back(MakeEvent(0, GOVERNOR_SIGNAL_SESSION_LOCKED, true));
+	events.push_back(MakeEvent(3000 * MS, GOVERNOR_SIGNAL_SESSION_LOCKED, false));
+	std::vector<ModeChange> changes = Replay(&governor, events, 10000 * MS);
+
+	const ModeChange expected[] = { { 500 * MS, GOVERNOR_MODE_PAUSE }, { 5000 * MS, GOVERNOR_MODE_PLAY } };
+	bool bPassed = IsTrace(changes, expected, 2) && governor.GetTransitionCount() == 2;
+	bPassed &= governor.GetTimeInMode(GOVERNOR_MODE_PAUSE, 10000 * MS) == 4500 * MS &&
+		governor.GetTimeInMode(GOVERNOR_MODE_PLAY, 10000 * MS) == 5500 * MS;
+	bPassed &= fabs(governor.GetCpuSecondsSaved(10000 * MS) - config.fPlayCpuLoad * 4.5) < 1e-6;
+	return Report("lock and unlock", bPassed);
+}
+
+// A window flickering over the desktop faster than the enter delay never
+// pauses playback.
+static bool CheckFlicker()
+{
+	PlaybackGovernor governor((GovernorConfig()));
+	std::vector<GovernorEvent> events;
+	for (int i = 0; i < 20; i++)
+		events.push_back(MakeEvent(i * 200 * MS, GOVERNOR_SIGNAL_OCCLUDED, i % 2 == 0));
+	std::vector<ModeChange> changes = Replay(&governor, events, 10000 * MS);
+	bool bPassed = changes.empty() && governor.GetMode() == GOVERNOR_MODE_PLAY && governor.GetDeadline() < 0;
+	return Report("flicker", bPassed);
+}
+
+// Battery downclocks, a fullscreen app on top pauses, and each step back
+// waits for the resume delay: downclocked again, then playing on AC.
+static bool CheckBatteryAndFullscreen()
+{
+	GovernorConfig config;
+	PlaybackGovernor governor(config);
+	std::vector<GovernorEvent> events;
+	events.push_back(MakeEvent(0, GOVERNOR_SIGNAL_ON_BATTERY, true));
+	events.push_back(MakeEvent(1000 * MS, GOVERNOR_SIGNAL_FULLSCREEN, true));
+	events.push_back(MakeEvent(2000 * MS, GOVERNOR_SIGNAL_FULLSCREEN, false));
+	events.push_back(MakeEvent(5000 * MS, GOVERNOR_SIGNAL_ON_BATTERY, false));
+	std::vector<ModeChange> changes = Replay(&governor, events, 10000 * MS);
+
+	// The pause is wanted from 1.0 s but the dwell after the downclock at
+	// 0.5 s holds it to 1.5 s.
+	const ModeChange expected[] = {
+		{ 500 * MS, GOVERNOR_MODE_DOWNCLOCK },
+		{ 1500 * MS, GOVERNOR_MODE_PAUSE },
+		{ 4000 * MS, GOVERNOR_MODE_DOWNCLOCK },
+		{ 7000 * MS, GOVERNOR_MODE_PLAY },
+	};
+	bool bPassed = IsTrace(changes, expected, 4);
+	double fSaved = config.fPlayCpuLoad * (2.5 + 4.0 * (1.0 - config.fDownclockRatio));
+	bPassed &= fabs(governor.GetCpuSecondsSaved(10000 * MS) - fSaved) < 1e-6;
+	return Report("battery and fullscreen", bPassed);
+}
+
+// With short delays the minimum dwell decides when the next change may
+// happen.
+static bool CheckDwell()
+{
+	GovernorConfig config;
+	config.hnsEnterDelay = 100 * MS;
+	config.hnsResumeDelay = 100 * MS;
+	config.hnsMinDwell = 1000 * MS;
+	PlaybackGovernor governor(config);
+	std::vector<GovernorEvent> events;
+	events.push_back(MakeEvent(0, GOVERNOR_SIGNAL_OCCLUDED, true));
+	events.push_back(MakeEvent(200 * MS, GOVERNOR_SIGNAL_OCCLUDED, false));
+	events.push_back(MakeEvent(1500 * MS, GOVERNOR_SIGNAL_BATTERY_SAVER, true));
+	std::vector<ModeChange> changes = Replay(&governor, events, 5000 * MS);
+
+	const ModeChange expected[] = {
+		{ 100 * MS, GOVERNOR_MODE_PAUSE },
+		{ 1100 * MS, GOVERNOR_MODE_PLAY },
+		{ 2100 * MS, GOVERNOR_MODE_DOWNCLOCK },
+	};
+	return Report("minimum dwell", IsTrace(changes, expected, 3));
+}
+
+// Signals already active when the governor is reset apply at once.
+static bool CheckReset()
+{
+	PlaybackGovernor governor((GovernorConfig()));
+	governor.OnEvent(MakeEvent(0, GOVERNOR_SIGNAL_BATTERY_SAVER, true));
+	governor.Reset(100 * MS);
+	bool bPassed = governor.GetMode() == GOVERNOR_MODE_DOWNCLOCK && governor.GetDeadline() < 0 &&
+		governor.GetTransitionCount() == 0 && governor.IsSignalActive(GOVERNOR_SIGNAL_BATTERY_SAVER);
+	bPassed &= !governor.OnEvent(MakeEvent(200 * MS, GOVERNOR_SIGNAL_COUNT, true));
+	return Report("reset with active signals", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckLockUnlock();
+	bPassed &= CheckFlicker();
+	bPassed &= CheckBatteryAndFullscreen();
+	bPassed &= CheckDwell();
+	bPassed &= CheckReset();
+	return bPassed ? 0 : 1;
+}
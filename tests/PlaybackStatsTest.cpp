@@ -0,0 +1,168 @@
+//-------------------------------------------------------------------
+//
+// PlaybackStatsTest
+//
+// Records from more threads than PlaybackStats has writer slots, so the
+// first ones write private copies and the rest share the last, and
+// checks that the merged counters and summaries lose no sample. Then
+// checks the summaries, histogram buckets, recent-sample rings and
+// frame accounting on known values, and that a disabled collector
+// records nothing.
+//
+//-------------------------------------------------------------------
+
+#include "PlaybackStats.h"
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+static const uint32_t THREAD_COUNT = 8;			// Twice the writer slots
+static const uint32_t SAMPLE_COUNT = 100000;	// Per thread
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+// A disabled collector ignores everything.
+static bool CheckDisabled()
+{
+	PlaybackStats stats;
+	stats.Record(STATS_METRIC_DECODE_TIME, 5);
+	stats.Count(STATS_COUNTER_LOOPS);
+	stats.RecordFrame(0, 10, 20, 30);
+	StatsSummary summary;
+	int64_t nRecent;
+	bool bPassed = !stats.IsEnabled() && !stats.Query(STATS_METRIC_DECODE_TIME, &summary) &&
+		summary.cSamples == 0 && stats.GetCounter(STATS_COUNTER_LOOPS) == 0 &&
+		stats.GetCounter(STATS_COUNTER_FRAMES_PRESENTED) == 0 &&
+		stats.GetRecent(STATS_METRIC_DECODE_TIME, &nRecent, 1) == 0;
+	return Report("disabled", bPassed);
+}
+
+// Thread t records 1..SAMPLE_COUNT plus t * SAMPLE_COUNT and counts each
+// sample. The totals, sum, minimum and maximum must come out exact:
+// private slots are written by their thread only and the shared slot's
+// read-modify-writes lose nothing.
+static bool CheckWriterSlots()
+{
+	PlaybackStats stats;
+	stats.Enable(true);
+	std::vector<std::thread> threads;
+	for (uint32_t t = 0; t < THREAD_COUNT; t++) {
+		threads.push_back(std::thread([&stats, t]() {
+			for (uint32_t n = 1; n <= SAMPLE_COUNT; n++) {
+				stats.Record(STATS_METRIC_EVENT_LATENCY, (int64_t)t * SAMPLE_COUNT + n);
+				stats.Count(STATS_COUNTER_PLAYER_EVENTS);
+			}
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	const uint64_t cTotal = (uint64_t)THREAD_COUNT * SAMPLE_COUNT;
+	StatsSummary summary;
+	bool bPassed = stats.Query(STATS_METRIC_EVENT_LATENCY, &summary) && summary.cSamples == cTotal &&
+		stats.GetCounter(STATS_COUNTER_PLAYER_EVENTS) == cTotal;
+	// The samples are 1..cTotal, so the mean is (cTotal + 1) / 2.
+	bPassed &= summary.nMin == 1 && summary.nMax == (int64_t)cTotal && summary.nMean == (int64_t)(cTotal + 1) / 2;
+
+	// Each slot's ring holds its latest RING_SIZE samples.
+	std::vector<int64_t> recent(PlaybackStats::RING_SIZE * PlaybackStats::WRITER_COUNT);
+	bPassed &= stats.GetRecent(STATS_METRIC_EVENT_LATENCY, recent.data(), recent.size()) == recent.size();
+	return Report("writer slots", bPassed);
+}
+
+// 1..1000: exact min, max and mean; percentiles within a bucket.
+static bool CheckSummary()
+{
+	PlaybackStats stats;
+	stats.Enable(true);
+	for (int64_t n = 1000; n >= 1; n--)
+		stats.Record(STATS_METRIC_SEEK_LATENCY, n);
+	stats.Record(STATS_METRIC_CPU_LOAD, -5);
+
+	StatsSummary s;
+	bool bPassed = stats.Query(STATS_METRIC_SEEK_LATENCY, &s) && s.cSamples == 1000 && s.nMin == 1 &&
+		s.nMax == 1000 && s.nMean == 500;
+	bPassed &= s.nP50 >= 500 && s.nP50 <= 500 + 500 / 8 && s.nP99 >= 990 && s.nP99 <= 1000;
+	// Negative samples count as zero.
+	bPassed &= stats.Query(STATS_METRIC_CPU_LOAD, &s) && s.nMin == 0 && s.nMax == 0;
+
+	stats.Reset();
+	bPassed &= !stats.Query(STATS_METRIC_SEEK_LATENCY, &s);
+	return Report("summary", bPassed);
+}
+
+// Every value falls in a bucket whose limit is at least the value and
+// within an eighth above it, and buckets grow with the value.
+static bool CheckBuckets()
+{
+	bool bPassed = true;
+	int nLast = -1;
+	for (int64_t v = 0; v < (1 << 16); v++) {
+		int nBucket = PlaybackStats::GetBucket(v);
+		int64_t nLimit = PlaybackStats::GetBucketLimit(nBucket);
+		bPassed &= nBucket >= nLast && nBucket < PlaybackStats::BUCKET_COUNT && nLimit >= v && nLimit <= v + v / 8;
+		nLast = nBucket;
+	}
+	int nTop = PlaybackStats::GetBucket(INT64_MAX);
+	bPassed &= nTop < PlaybackStats::BUCKET_COUNT && PlaybackStats::GetBucketLimit(nTop) == INT64_MAX;
+	return Report("histogram buckets", bPassed);
+}
+
+// The ring keeps the last RING_SIZE samples of a writer, oldest first.
+static bool CheckRecent()
+{
+	PlaybackStats stats;
+	stats.Enable(true);
+	const int64_t cSamples = PlaybackStats::RING_SIZE + 10;
+	for (int64_t n = 0; n < cSamples; n++)
+		stats.Record(STATS_METRIC_TIMER_LATENESS, n);
+
+	std::vector<int64_t> recent(PlaybackStats::RING_SIZE * 2);
+	size_t cRecent = stats.GetRecent(STATS_METRIC_TIMER_LATENESS, recent.data(), recent.size());
+	bool bPassed = cRecent == PlaybackStats::RING_SIZE;
+	for (size_t i = 0; bPassed && i < cRecent; i++)
+		bPassed &= recent[i] == cSamples - (int64_t)cRecent + (int64_t)i;
+	bPassed &= stats.GetRecent(STATS_METRIC_TIMER_LATENESS, recent.data(), 3) == 3 && recent[0] == cSamples - 3;
+	return Report("recent samples", bPassed);
+}
+
+// Frames: presented on time, late past the threshold, and dropped.
+static bool CheckFrames()
+{
+	PlaybackStats stats;
+	stats.Enable(true);
+	stats.SetLateThreshold(10);
+	stats.RecordFrame(0, 4, 100, 105);
+	stats.RecordFrame(100, 103, 200, 215);
+	stats.RecordFrame(200, 206, 300, -1);
+
+	StatsSummary s;
+	bool bPassed = stats.GetCounter(STATS_COUNTER_FRAMES_PRESENTED) == 2 &&
+		stats.GetCounter(STATS_COUNTER_FRAMES_LATE) == 1 && stats.GetCounter(STATS_COUNTER_FRAMES_DROPPED) == 1;
+	bPassed &= stats.Query(STATS_METRIC_DECODE_TIME, &s) && s.cSamples == 3 && s.nMin == 3 && s.nMax == 6;
+	bPassed &= stats.Query(STATS_METRIC_PRESENT_LATENESS, &s) && s.cSamples == 2 && s.nMin == 5 && s.nMax == 15;
+
+	std::string csv, json;
+	FormatStatsCsv(stats, &csv);
+	FormatStatsJson(stats, &json);
+	bPassed &= csv.find("decode_time,3,3,4,") != std::string::npos &&
+		csv.find("frames_dropped,1,") != std::string::npos &&
+		json.find("\"frames_late\": 1") != std::string::npos;
+	return Report("frame accounting", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckDisabled();
+	bPassed &= CheckWriterSlots();
+	bPassed &= CheckSummary();
+	bPassed &= CheckBuckets();
+	bPassed &= CheckRecent();
+	bPassed &= CheckFrames();
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,294 @@
+//-------------------------------------------------------------------
+//
+// PlaylistTest
+//
+// Drives a PlaylistScheduler in simulated time against a fake player
+// whose clips can fail to open, at once or when they are being
+// prepared. A clip that fails must be passed over for the one after it
+// and rotation must go on, until no other clip is left. Shuffled
+// rotation must play every clip once per round, replayably from its
+// seed, and timed clips must start on time through a day and after the
+// local clock jumps.
+//
+//-------------------------------------------------------------------
+
+#include "Playlist.h"
+#include <stdio.h>
+#include <set>
+#include <string>
+#include <vector>
+
+static const HNSTIME INTERVAL = 60 * HNS_PER_SECOND;
+static const HNSTIME TICK = HNS_PER_SECOND / 2;
+
+// How a clip that cannot be opened fails.
+enum FAKE_FAILURE
+{
+	FAIL_ON_PREPARE = 0,	// Prepare returns false
+	FAIL_WHILE_PREPARING	// Prepare starts, then OnPrepareFailed reports it
+};
+
+class FakeClipPlayer : public IClipPlayer
+{
+public:
+	FakeClipPlayer(FAKE_FAILURE failure) : m_failure(failure), m_bPending(false), m_bReady(false), m_bBad(false) {}
+
+	void SetBad(const std::wstring& path) { m_bad.insert(path); }
+
+	bool Prepare(const std::wstring& path) override
+	{
+		m_bBad = m_bad.count(path) != 0;
+		if (m_bBad && m_failure == FAIL_ON_PREPARE)
+			return false;
+		m_path = path;
+		m_bPending = true;
+		m_bReady = false;
+		return true;
+	}
+	bool IsPrepared() override { return m_bReady; }
+	bool SwitchToPrepared() override
+	{
+		if (!m_bReady)
+			return false;
+		m_bReady = false;
+		m_shown.push_back(m_path);
+		return true;
+	}
+	void CancelPrepared() override { m_bPending = m_bReady = false; }
+
+	// Finishes the prepare started last, as the player's event would.
+	void Complete(PlaylistScheduler* pPlaylist, HNSTIME hnsNow)
+	{
+		if (!m_bPending)
+			return;
+		m_bPending = false;
+		if (m_bBad) {
+			pPlaylist->OnPrepareFailed(hnsNow);
+			return;
+		}
+		m_bReady = true;
+		pPlaylist->OnPrepared(hnsNow);
+	}
+
+	const std::vector<std::wstring>& GetShown() const { return m_shown; }
+
+private:
+	FAKE_FAILURE				m_failure;
+	std::set<std::wstring>		m_bad;
+	std::wstring				m_path;
+	bool						m_bPending;
+	bool						m_bReady;
+	bool						m_bBad;
+	std::vector<std::wstring>	m_shown;	// Clips switched to, in order
+};
+
+static std::vector<PlaylistItem> MakeItems(size_t cItems)
+{
+	std::vector<PlaylistItem> items(cItems);
+	for (size_t i = 0; i < cItems; i++) {
+		items[i].path = L"clip" + std::to_wstring(i);
+		items[i].nStartOfDay = -1;
+	}
+	return items;
+}
+
+// Ticks the playlist every TICK from hnsFrom to hnsTo, completing each
+// prepare on the tick after it started. The local clock is nClockOffset
+// seconds ahead of monotonic time.
+static void RunClock(PlaylistScheduler* pPlaylist, FakeClipPlayer* pPlayer, HNSTIME hnsFrom, HNSTIME hnsTo,
+	int32_t nClockOffset)
+{
+	for (HNSTIME hnsNow = hnsFrom; hnsNow <= hnsTo; hnsNow += TICK) {
+		pPlayer->Complete(pPlaylist, hnsNow);
+		pPlaylist->OnTick(hnsNow, (int32_t)((hnsNow / HNS_PER_SECOND + nClockOffset) % SECONDS_PER_DAY));
+	}
+}
+
+static void Run(PlaylistScheduler* pPlaylist, FakeClipPlayer* pPlayer, HNSTIME hnsDuration)
+{
+	RunClock(pPlaylist, pPlayer, 0, hnsDuration, 0);
+}
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+static PlaylistConfig MakeConfig(PLAYLIST_ORDER order)
+{
+	PlaylistConfig config;
+	config.order = order;
+	config.hnsInterval = INTERVAL;
+	return config;
+}
+
+// Of three clips in order, the second cannot be opened: the first and the
+// third alternate, each on time, and the bad clip is only tried once.
+static bool CheckSkipFailed(FAKE_FAILURE failure)
+{
+	FakeClipPlayer player(failure);
+	player.SetBad(L"clip1");
+	PlaylistScheduler playlist(&player, MakeConfig(PLAYLIST_SEQUENTIAL));
+	playlist.SetItems(MakeItems(3));
+	bool bPassed = playlist.Start(0, 0) == 0;
+	Run(&playlist, &player, 10 * INTERVAL);
+
+	const std::vector<std::wstring>& shown = player.GetShown();
+	bPassed &= shown.size() == 10 && playlist.GetStats().cFailed == 1 && playlist.GetDeadline() >= 0;
+	for (size_t i = 0; bPassed && i < shown.size(); i++)
+		bPassed &= shown[i] == (i % 2 == 0 ? L"clip2" : L"clip0");
+	bPassed &= playlist.GetStats().cLateSwitches == 0;
+	return Report(failure == FAIL_ON_PREPARE ? "skip clip failing to prepare" : "skip clip failing while preparing",
+		bPassed);
+}
+
+// With every other clip bad, the one playing stays and nothing is scheduled.
+static bool CheckAllOthersFailed()
+{
+	FakeClipPlayer player(FAIL_WHILE_PREPARING);
+	player.SetBad(L"clip1");
+	player.SetBad(L"clip2");
+	PlaylistScheduler playlist(&player, MakeConfig(PLAYLIST_SEQUENTIAL));
+	playlist.SetItems(MakeItems(3));
+	playlist.Start(0, 0);
+	Run(&playlist, &player, 4 * INTERVAL);
+	bool bPassed = player.GetShown().empty() && playlist.GetCurrent() == 0 && playlist.GetStats().cFailed == 2 &&
+		playlist.GetDeadline() < 0;
+	return Report("stop when all others failed", bPassed);
+}
+
+// Shuffled, a bad clip is never switched to and the good ones keep coming.
+static bool CheckShuffleSkipsFailed()
+{
+	FakeClipPlayer player(FAIL_WHILE_PREPARING);
+	player.SetBad(L"clip3");
+	PlaylistScheduler playlist(&player, MakeConfig(PLAYLIST_SHUFFLE));
+	playlist.SetItems(MakeItems(5));
+	playlist.Start(0, 0);
+	Run(&playlist, &player, 40 * INTERVAL);
+	const std::vector<std::wstring>& shown = player.GetShown();
+	bool bPassed = shown.size() == 40 && playlist.GetStats().cFailed == 1;
+	for (size_t i = 0; bPassed && i < shown.size(); i++)
+		bPassed &= shown[i] != L"clip3" && (i == 0 || shown[i] != shown[i - 1]);
+	return Report("shuffle skips failed clip", bPassed);
+}
+
+// Clips shown after the first, as item indexes.
+static std::vector<size_t> GetShownItems(const FakeClipPlayer& player)
+{
+	std::vector<size_t> items;
+	for (size_t i = 0; i < player.GetShown().size(); i++)
+		items.push_back((size_t)std::stoi(player.GetShown()[i].substr(4)));
+	return items;
+}
+
+// Shuffled, the first clip and the ones switched to make up whole rounds,
+// each a permutation of the clips; a seed replays the same rotation and
+// another seed gives another.
+static bool CheckShuffleRounds()
+{
+	const size_t cItems = 5, cRounds = 8;
+	std::vector<size_t> played[2];
+	for (int r = 0; r < 2; r++) {
+		FakeClipPlayer player(FAIL_ON_PREPARE);
+		PlaylistConfig config = MakeConfig(PLAYLIST_SHUFFLE);
+		config.nSeed = 7;
+		PlaylistScheduler playlist(&player, config);
+		playlist.SetItems(MakeItems(cItems));
+		played[r].push_back(playlist.Start(0, 0));
+		Run(&playlist, &player, (HNSTIME)(cItems * cRounds - 1) * INTERVAL);
+		std::vector<size_t> shown = GetShownItems(player);
+		played[r].insert(played[r].end(), shown.begin(), shown.end());
+	}
+
+	bool bPassed = played[0].size() == cItems * cRounds && played[0] == played[1];
+	for (size_t nRound = 0; bPassed && nRound < cRounds; nRound++) {
+		std::set<size_t> round(played[0].begin() + nRound * cItems, played[0].begin() + (nRound + 1) * cItems);
+		bPassed &= round.size() == cItems;
+	}
+	for (size_t i = 1; bPassed && i < played[0].size(); i++)
+		bPassed &= played[0][i] != played[0][i - 1];
+
+	FakeClipPlayer player(FAIL_ON_PREPARE);
+	PlaylistConfig config = MakeConfig(PLAYLIST_SHUFFLE);
+	config.nSeed = 8;
+	PlaylistScheduler playlist(&player, config);
+	playlist.SetItems(MakeItems(cItems));
+	std::vector<size_t> other(1, playlist.Start(0, 0));
+	Run(&playlist, &player, (HNSTIME)(cItems * cRounds - 1) * INTERVAL);
+	std::vector<size_t> shown = GetShownItems(player);
+	other.insert(other.end(), shown.begin(), shown.end());
+	bPassed &= other.size() == played[0].size() && other != played[0];
+	return Report("shuffle rounds", bPassed);
+}
+
+// Clips starting at 06:00, 18:00 and 23:00.
+static std::vector<PlaylistItem> MakeTimedItems()
+{
+	std::vector<PlaylistItem> items = MakeItems(3);
+	items[0].nStartOfDay = 6 * 3600;
+	items[1].nStartOfDay = 18 * 3600;
+	items[2].nStartOfDay = 23 * 3600;
+	return items;
+}
+
+// Started at noon, the 06:00 clip plays first and the others follow at
+// their times, each within a tick; at 02:00 the 23:00 clip of the day
+// before is the one playing.
+static bool CheckTimeOfDay()
+{
+	FakeClipPlayer player(FAIL_ON_PREPARE);
+	PlaylistScheduler playlist(&player, MakeConfig(PLAYLIST_SEQUENTIAL));
+	playlist.SetItems(MakeTimedItems());
+	bool bPassed = playlist.Start(0, 12 * 3600) == 0;
+	RunClock(&playlist, &player, 0, 24 * 3600 * HNS_PER_SECOND, 12 * 3600);
+
+	std::vector<size_t> shown = GetShownItems(player);
+	const size_t expected[] = { 1, 2, 0 };
+	bPassed &= shown == std::vector<size_t>(expected, expected + 3);
+	bPassed &= playlist.GetStats().cLateSwitches == 0 && playlist.GetStats().hnsMaxSwitchDelay <= TICK;
+
+	PlaylistScheduler night(&player, MakeConfig(PLAYLIST_SEQUENTIAL));
+	night.SetItems(MakeTimedItems());
+	bPassed &= night.Start(0, 2 * 3600) == 2 && night.GetDeadline() == 4 * 3600 * HNS_PER_SECOND - 5 * HNS_PER_SECOND;
+	return Report("time of day", bPassed);
+}
+
+// At 17:50 the clock jumps an hour ahead: the 18:00 clip it skipped past
+// starts at once, and the 23:00 one follows at the new local time.
+static bool CheckClockJump()
+{
+	const int32_t nStart = 17 * 3600 + 50 * 60;
+	FakeClipPlayer player(FAIL_ON_PREPARE);
+	PlaylistScheduler playlist(&player, MakeConfig(PLAYLIST_SEQUENTIAL));
+	playlist.SetItems(MakeTimedItems());
+	bool bPassed = playlist.Start(0, nStart) == 0;
+	RunClock(&playlist, &player, 0, 60 * HNS_PER_SECOND, nStart);
+	bPassed &= player.GetShown().empty();
+
+	RunClock(&playlist, &player, 60 * HNS_PER_SECOND + TICK, 70 * HNS_PER_SECOND, nStart + 3600);
+	bPassed &= GetShownItems(player) == std::vector<size_t>(1, 1);
+
+	// 23:00 is 4 h 10 min after 18:50 local, an hour of monotonic time less
+	// than before the jump.
+	HNSTIME hnsEleven = (HNSTIME)(23 * 3600 - nStart - 3600) * HNS_PER_SECOND;
+	RunClock(&playlist, &player, 70 * HNS_PER_SECOND + TICK, hnsEleven - TICK, nStart + 3600);
+	bPassed &= player.GetShown().size() == 1;
+	RunClock(&playlist, &player, hnsEleven, hnsEleven + TICK, nStart + 3600);
+	const size_t expected[] = { 1, 2 };
+	bPassed &= GetShownItems(player) == std::vector<size_t>(expected, expected + 2);
+	return Report("clock jump", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckSkipFailed(FAIL_ON_PREPARE);
+	bPassed &= CheckSkipFailed(FAIL_WHILE_PREPARING);
+	bPassed &= CheckAllOthersFailed();
+	bPassed &= CheckShuffleSkipsFailed();
+	bPassed &= CheckShuffleRounds();
+	bPassed &= CheckTimeOfDay();
+	bPassed &= CheckClockJump();
+	return bPassed ? 0 : 1;
+}
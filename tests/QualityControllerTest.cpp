@@ -0,0 +1,190 @@
+//-------------------------------------------------------------------
+//
+// QualityControllerTest
+//
+// Feeds a QualityController a sample per second from traces of frame
+// drops and system load, unsmoothed so every step time is exact, and
+// checks the rungs it steps to and when: the down and up delays, the
+// minimum dwell, the load headroom a step up needs, the backed-off up
+// delay after a failed probe, and paused periods. Then replays the
+// built-in load traces through the QualitySimulator, which must be
+// deterministic and drop fewer frames than holding the top rung.
+//
+//-------------------------------------------------------------------
+
+#include "QualitySimulator.h"
+#include <stdio.h>
+#include <vector>
+
+static const HNSTIME SECOND = HNS_PER_SECOND;
+
+// From nSecond on, each period has this share of bad frames and load.
+struct TracePhase
+{
+	int		nSecond;
+	float	fBad;
+	float	fSystemLoad;
+	float	fProcessLoad;
+};
+
+struct RungChange
+{
+	int		nSecond;
+	size_t	nRung;
+};
+
+static QualityConfig MakeConfig()
+{
+	QualityConfig config;
+	config.fSmoothing = 1.0f;
+	return config;
+}
+
+// Samples every second from 0 to nEnd; 100 frames per period unless
+// the phase has fBad < 0, which stands for a paused period without
+// frames. Returns the rung changes.
+static std::vector<RungChange> Replay(QualityController* pController, const TracePhase* pPhases, size_t cPhases,
+	int nEnd)
+{
+	std::vector<RungChange> changes;
+	size_t nPhase = 0;
+	for (int nSecond = 0; nSecond <= nEnd; nSecond++) {
+		while (nPhase + 1 < cPhases && pPhases[nPhase + 1].nSecond <= nSecond)
+			nPhase++;
+		const TracePhase& phase = pPhases[nPhase];
+		QualitySample sample = QualitySample();
+		sample.hnsTime = nSecond * SECOND;
+		if (phase.fBad >= 0.0f) {
+			sample.cLate = (uint64_t)(phase.fBad * 100.0f + 0.5f);
+			sample.cPresented = 100;
+		}
+		sample.fSystemLoad = phase.fSystemLoad;
+		sample.fProcessLoad = phase.fProcessLoad;
+		if (pController->OnSample(sample)) {
+			RungChange change = { nSecond, pController->GetRung() };
+			changes.push_back(change);
+		}
+	}
+	return changes;
+}
+
+static bool IsTrace(const std::vector<RungChange>& changes, const RungChange* pExpected, size_t cExpected)
+{
+	if (changes.size() != cExpected)
+		return false;
+	for (size_t i = 0; i < cExpected; i++) {
+		if (changes[i].nSecond != pExpected[i].nSecond || changes[i].nRung != pExpected[i].nRung)
+			return false;
+	}
+	return true;
+}
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+// A fifth of the frames bad steps down a rung every dwell to the bottom;
+// a clean, quiet machine then climbs back a rung every up delay.
+static bool CheckLadder()
+{
+	QualityController controller(MakeConfig());
+	const TracePhase phases[] = { { 0, 0.2f, 0.3f, 0.1f }, { 20, 0.0f, 0.2f, 0.05f } };
+	std::vector<RungChange> changes = Replay(&controller, phases, 2, 100);
+
+	// Down: pressure lasts the 2 s delay from the start, but the 3 s dwell
+	// holds the first step to 3 s; after each step pressure starts over.
+	// Up: headroom from 20 s lasts the 10 s up delay, then starts over the
+	// second after each step.
+	const RungChange expected[] = {
+		{ 3, 1 }, { 6, 2 }, { 9, 3 }, { 12, 4 },
+		{ 30, 3 }, { 41, 2 }, { 52, 1 }, { 63, 0 },
+	};
+	bool bPassed = IsTrace(changes, expected, 8) && controller.GetTransitionCount() == 8;
+	bPassed &= controller.GetTimeAtRung(4, 100 * SECOND) == 18 * SECOND &&
+		controller.GetTimeAtRung(0, 100 * SECOND) == 3 * SECOND + 37 * SECOND;
+	return Report("ladder down and up", bPassed);
+}
+
+// A loaded machine steps down; at 70% load the step back up would cost
+// more than the headroom left, so the rung holds.
+static bool CheckLoadHeadroom()
+{
+	QualityController controller(MakeConfig());
+	const TracePhase phases[] = { { 0, 0.0f, 0.95f, 0.2f }, { 4, 0.0f, 0.7f, 0.3f } };
+	std::vector<RungChange> changes = Replay(&controller, phases, 2, 200);
+	const RungChange expected[] = { { 3, 1 } };
+	bool bPassed = IsTrace(changes, expected, 1);
+
+	// With room for the step, it is taken after the up delay.
+	QualityController relaxed(MakeConfig());
+	const TracePhase quiet[] = { { 0, 0.0f, 0.95f, 0.2f }, { 4, 0.0f, 0.4f, 0.1f } };
+	changes = Replay(&relaxed, quiet, 2, 200);
+	const RungChange expectedQuiet[] = { { 3, 1 }, { 14, 0 } };
+	bPassed &= IsTrace(changes, expectedQuiet, 2);
+	return Report("load headroom", bPassed);
+}
+
+// A step up that fails within the probe window doubles the up delay into
+// that rung; one that holds through it earns the base delay back.
+static bool CheckProbeBackoff()
+{
+	QualityController controller(MakeConfig());
+	const TracePhase phases[] = {
+		{ 0, 0.2f, 0.3f, 0.1f },	// Down at 3
+		{ 4, 0.0f, 0.2f, 0.05f },	// Up at 14
+		{ 15, 0.2f, 0.3f, 0.1f },	// Down at 17, within the probe window
+		{ 18, 0.0f, 0.2f, 0.05f },	// Up after 20 s, at 38
+		{ 60, 0.2f, 0.3f, 0.1f },	// Down at 62, the probe held
+		{ 63, 0.0f, 0.2f, 0.05f },	// Up after 10 s again, at 73
+	};
+	std::vector<RungChange> changes = Replay(&controller, phases, 6, 100);
+	const RungChange expected[] = { { 3, 1 }, { 14, 0 }, { 17, 1 }, { 38, 0 }, { 62, 1 }, { 73, 0 } };
+	return Report("probe backoff", IsTrace(changes, expected, 6));
+}
+
+// Paused periods restart the pressure timer, so pressure broken up by
+// pauses never steps down.
+static bool CheckPaused()
+{
+	QualityController controller(MakeConfig());
+	std::vector<TracePhase> phases;
+	for (int n = 0; n < 60; n++) {
+		TracePhase phase = { n, n % 2 ? -1.0f : 0.5f, 0.3f, 0.1f };
+		phases.push_back(phase);
+	}
+	std::vector<RungChange> changes = Replay(&controller, phases.data(), phases.size(), 59);
+	return Report("paused periods", changes.empty() && controller.GetRung() == 0);
+}
+
+// The built-in traces replay the same every time, and adapting drops no
+// more frames than holding the top rung, fewer where the load bites.
+static bool CheckSimulator()
+{
+	QualitySimulator simulator((QualityConfig()), QualityModel());
+	std::vector<LoadTrace> traces = GetBuiltInLoadTraces();
+	bool bPassed = traces.size() == 3;
+	for (size_t i = 0; i < traces.size(); i++) {
+		std::string timeline, again;
+		QualitySimResult adaptive = simulator.Run(traces[i], false, &timeline);
+		QualitySimResult repeat = simulator.Run(traces[i], false, &again);
+		QualitySimResult fixed = simulator.Run(traces[i], true, NULL);
+		bPassed &= timeline == again && adaptive.cTransitions == repeat.cTransitions && adaptive.cTransitions > 0;
+		bPassed &= adaptive.fDropped <= fixed.fDropped && adaptive.fCpuSeconds < fixed.fCpuSeconds &&
+			fixed.cTransitions == 0;
+		if (traces[i].name == "build")
+			bPassed &= adaptive.fDropped < fixed.fDropped * 0.5;
+	}
+	return Report("simulated traces", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckLadder();
+	bPassed &= CheckLoadHeadroom();
+	bPassed &= CheckProbeBackoff();
+	bPassed &= CheckPaused();
+	bPassed &= CheckSimulator();
+	return bPassed ? 0 : 1;
+}
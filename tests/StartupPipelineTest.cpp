@@ -0,0 +1,174 @@
+//-------------------------------------------------------------------
+//
+// StartupPipelineTest
+//
+// Runs the app's startup graph with each stage sleeping for a simulated
+// latency: shell-window discovery and window creation on the main
+// thread, media open and probing on a worker. Checks that every stage
+// starts after its dependencies end, that the media open overlaps the
+// main-thread stages so startup takes about the critical path rather
+// than the sum of the stages, and that the reported critical path is
+// the media chain. Then checks failed stages, dependency cycles and
+// the trace report.
+//
+//-------------------------------------------------------------------
+
+#include "StartupPipeline.h"
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+static const HNSTIME MS = HNS_PER_MSEC;
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+// A stage that takes nMs and succeeds.
+static StartupStageFunc Sleep(int nMs)
+{
+	return [nMs]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(nMs));
+		return true;
+	};
+}
+
+static bool DependenciesHold(const StartupPipeline& pipeline, size_t nStage, const size_t* pDeps, size_t cDeps)
+{
+	for (size_t i = 0; i < cDeps; i++) {
+		if (pipeline.GetStage(nStage).hnsStart < pipeline.GetStage(pDeps[i]).hnsEnd)
+			return false;
+	}
+	return true;
+}
+
+// The startup graph of the app, its stages' latencies summing to 290 ms
+// and the media chain, the longest, taking 190 ms.
+static bool CheckStartupGraph()
+{
+	StartupPipeline pipeline;
+	size_t nCom = pipeline.AddStage("com_init", STARTUP_THREAD_MAIN, Sleep(5));
+	size_t nShell = pipeline.AddStage("find_worker_wnd", STARTUP_THREAD_MAIN, Sleep(40));
+	size_t nWindow = pipeline.AddStage("create_window", STARTUP_THREAD_MAIN, Sleep(20));
+	size_t nPlayer = pipeline.AddStage("create_player", STARTUP_THREAD_MAIN, Sleep(15));
+	size_t nOpen = pipeline.AddStage("open_media", STARTUP_THREAD_WORKER, Sleep(140));
+	size_t nProbe = pipeline.AddStage("probe_media", STARTUP_THREAD_WORKER, Sleep(40));
+	size_t nPlay = pipeline.AddStage("play", STARTUP_THREAD_MAIN, Sleep(10));
+	pipeline.AddDependency(nWindow, nShell);
+	pipeline.AddDependency(nPlayer, nCom);
+	pipeline.AddDependency(nPlayer, nWindow);
+	pipeline.AddDependency(nProbe, nOpen);
+	pipeline.AddDependency(nPlay, nPlayer);
+	pipeline.AddDependency(nPlay, nProbe);
+
+	bool bPassed = pipeline.Run();
+	pipeline.Mark("first_frame");
+	for (size_t i = 0; i < pipeline.GetStageCount(); i++)
+		bPassed &= pipeline.GetStage(i).state == STARTUP_STAGE_DONE;
+	const size_t playerDeps[] = { nCom, nWindow }, playDeps[] = { nPlayer, nProbe };
+	bPassed &= DependenciesHold(pipeline, nWindow, &nShell, 1) && DependenciesHold(pipeline, nProbe, &nOpen, 1) &&
+		DependenciesHold(pipeline, nPlayer, playerDeps, 2) && DependenciesHold(pipeline, nPlay, playDeps, 2);
+
+	// The media open ran alongside the main-thread stages.
+	bPassed &= pipeline.GetStage(nOpen).hnsStart < pipeline.GetStage(nShell).hnsEnd &&
+		pipeline.GetStage(nWindow).hnsStart < pipeline.GetStage(nOpen).hnsEnd;
+
+	std::vector<size_t> path;
+	HNSTIME hnsEnd = pipeline.GetCriticalPath(&path);
+	const size_t expected[] = { nOpen, nProbe, nPlay };
+	bPassed &= path == std::vector<size_t>(expected, expected + 3) && hnsEnd == pipeline.GetStage(nPlay).hnsEnd;
+	// At least the critical path; well short of the 290 ms run serially.
+	bPassed &= hnsEnd >= 190 * MS && hnsEnd < 260 * MS;
+	bPassed &= pipeline.GetMarks().size() == 1 && pipeline.GetMarks()[0].hnsTime >= hnsEnd;
+	if (!bPassed) {
+		std::string text;
+		pipeline.FormatReport(&text);
+		printf("%s", text.c_str());
+	}
+	return Report("startup graph", bPassed);
+}
+
+// A failed stage skips its dependents, transitively, while independent
+// stages still run; Run reports the failure.
+static bool CheckFailure()
+{
+	std::atomic<int> cRan(0);
+	StartupPipeline pipeline;
+	size_t nOpen = pipeline.AddStage("open_media", STARTUP_THREAD_WORKER, []() { return false; });
+	size_t nProbe = pipeline.AddStage("probe_media", STARTUP_THREAD_WORKER, [&cRan]() { cRan++; return true; });
+	size_t nPlay = pipeline.AddStage("play", STARTUP_THREAD_MAIN, [&cRan]() { cRan++; return true; });
+	size_t nWindow = pipeline.AddStage("create_window", STARTUP_THREAD_MAIN, [&cRan]() { cRan += 10; return true; });
+	pipeline.AddDependency(nProbe, nOpen);
+	pipeline.AddDependency(nPlay, nProbe);
+	pipeline.AddDependency(nPlay, nWindow);
+
+	bool bPassed = !pipeline.Run() && cRan == 10;
+	bPassed &= pipeline.GetStage(nOpen).state == STARTUP_STAGE_FAILED &&
+		pipeline.GetStage(nProbe).state == STARTUP_STAGE_SKIPPED &&
+		pipeline.GetStage(nPlay).state == STARTUP_STAGE_SKIPPED &&
+		pipeline.GetStage(nWindow).state == STARTUP_STAGE_DONE;
+	return Report("failed stage", bPassed);
+}
+
+// Stages waiting on each other are skipped instead of hanging Run.
+static bool CheckCycle()
+{
+	StartupPipeline pipeline;
+	size_t nA = pipeline.AddStage("a", STARTUP_THREAD_MAIN, Sleep(0));
+	size_t nB = pipeline.AddStage("b", STARTUP_THREAD_WORKER, Sleep(0));
+	size_t nC = pipeline.AddStage("c", STARTUP_THREAD_WORKER, Sleep(5));
+	pipeline.AddDependency(nA, nB);
+	pipeline.AddDependency(nB, nA);
+	bool bPassed = !pipeline.Run() && pipeline.GetStage(nA).state == STARTUP_STAGE_SKIPPED &&
+		pipeline.GetStage(nB).state == STARTUP_STAGE_SKIPPED && pipeline.GetStage(nC).state == STARTUP_STAGE_DONE;
+	return Report("dependency cycle", bPassed);
+}
+
+// With a simulated clock the trace shows exact times: a chain of main
+// stages, each advancing the clock, and the critical path through it.
+static HNSTIME g_hnsNow = 0;
+
+static HNSTIME SimulatedNow()
+{
+	return g_hnsNow;
+}
+
+static StartupStageFunc Advance(HNSTIME hnsLatency)
+{
+	return [hnsLatency]() {
+		g_hnsNow += hnsLatency;
+		return true;
+	};
+}
+
+static bool CheckReport()
+{
+	StartupPipeline pipeline(SimulatedNow);
+	size_t nShell = pipeline.AddStage("find_worker_wnd", STARTUP_THREAD_MAIN, Advance(30 * MS));
+	size_t nWindow = pipeline.AddStage("create_window", STARTUP_THREAD_MAIN, Advance(12 * MS));
+	pipeline.AddDependency(nWindow, nShell);
+	bool bPassed = pipeline.Run();
+	g_hnsNow += 8 * MS;
+	pipeline.Mark("first_frame");
+
+	bPassed &= pipeline.GetStage(nWindow).hnsStart == 30 * MS && pipeline.GetStage(nWindow).hnsEnd == 42 * MS &&
+		pipeline.GetMarks()[0].hnsTime == 50 * MS;
+	std::string text;
+	pipeline.FormatReport(&text);
+	bPassed &= text.find("create_window         main        30.00      42.00     12.00  done") != std::string::npos &&
+		text.find("first_frame           mark        50.00") != std::string::npos &&
+		text.find("critical path: find_worker_wnd > create_window\n") != std::string::npos;
+	return Report("trace report", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckStartupGraph();
+	bPassed &= CheckFailure();
+	bPassed &= CheckCycle();
+	bPassed &= CheckReport();
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+//-------------------------------------------------------------------
+//
+// StateSnapshotTest
+//
+// One thread publishes versions of a state block while readers check
+// that every read is one whole version, never older than the last one
+// they saw. Run under ThreadSanitizer too (LW_SANITIZE=thread); the
+// snapshot holds its copies in atomics, so it must report nothing.
+//
+//-------------------------------------------------------------------
+
+#include "StateSnapshot.h"
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+static const uint64_t PUBLISH_COUNT = 1000000;
+static const int READER_COUNT = 4;
+
+// Odd size, so the last word of a slot is only partly used.
+struct TestState
+{
+	uint64_t	nVersion;
+	int32_t		nHalf;
+	float		fLow;
+	uint64_t	multiples[5];
+	uint8_t		nByte;
+};
+
+static TestState MakeState(uint64_t nVersion)
+{
+	TestState state = {};
+	state.nVersion = nVersion;
+	state.nHalf = (int32_t)(nVersion / 2);
+	state.fLow = (float)(nVersion & 0xFFFF);
+	for (int i = 0; i < 5; i++)
+		state.multiples[i] = nVersion * (i + 2);
+	state.nByte = (uint8_t)nVersion;
+	return state;
+}
+
+static bool IsWhole(const TestState& state)
+{
+	TestState expected = MakeState(state.nVersion);
+	bool bWhole = state.nHalf == expected.nHalf && state.fLow == expected.fLow && state.nByte == expected.nByte;
+	for (int i = 0; i < 5; i++)
+		bWhole = bWhole && state.multiples[i] == expected.multiples[i];
+	return bWhole;
+}
+
+template <size_t SLOTS>
+static bool StressSnapshot()
+{
+	StateSnapshot<TestState, SLOTS>* pSnapshot = new StateSnapshot<TestState, SLOTS>();
+	std::atomic<bool> bStop(false);
+	std::atomic<uint64_t> cReads(0), cTorn(0), cBackwards(0);
+	std::vector<std::thread> readers;
+	for (int i = 0; i < READER_COUNT; i++) {
+		readers.push_back(std::thread([&]() {
+			uint64_t nLast = 0, cThreadReads = 0;
+			TestState state;
+			while (!bStop.load(std::memory_order_relaxed)) {
+				uint64_t nVersion = pSnapshot->Read(&state);
+				if (!nVersion)
+					continue;
+				if (nVersion != state.nVersion || !IsWhole(state))
+					cTorn++;
+				if (nVersion < nLast)
+					cBackwards++;
+				nLast = nVersion;
+				cThreadReads++;
+			}
+			cReads += cThreadReads;
+		}));
+	}
+
+	for (uint64_t n = 1; n <= PUBLISH_COUNT; n++)
+		pSnapshot->Publish(MakeState(n));
+	bStop = true;
+	for (size_t i = 0; i < readers.size(); i++)
+		readers[i].join();
+
+	TestState last;
+	bool bPassed = pSnapshot->Read(&last) == PUBLISH_COUNT && last.nVersion == PUBLISH_COUNT && IsWhole(last) &&
+		cTorn == 0 && cBackwards == 0;
+	printf("%u slots: %llu reads, %llu torn, %llu backwards: %s\n", (unsigned)SLOTS,
+		(unsigned long long)cReads.load(), (unsigned long long)cTorn.load(),
+		(unsigned long long)cBackwards.load(), bPassed ? "ok" : "FAILED");
+	delete pSnapshot;
+	return bPassed;
+}
+
+int main()
+{
+	bool bPassed = true;
+
+	StateSnapshot<uint8_t> empty;
+	uint8_t nValue = 7;
+	if (empty.Read(&nValue) != 0 || nValue != 7 || empty.GetVersion() != 0) {
+		printf("read before the first publish: FAILED\n");
+		bPassed = false;
+	}
+	empty.Publish(3);
+	if (empty.Read(&nValue) != 1 || nValue != 3) {
+		printf("read of the first publish: FAILED\n");
+		bPassed = false;
+	}
+
+	bPassed &= StressSnapshot<2>();
+	bPassed &= StressSnapshot<4>();
+
+	SnapshotBenchResult result;
+	if (!RunSnapshotBench(2, HNS_PER_SECOND / 5, &result) || result.cTorn) {
+		printf("bench: FAILED\n");
+		bPassed = false;
+	}
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "FileUtil.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <sys/types.h>
+#include <sys/utime.h>
+#else
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+
+//-------------------------------------------------------------------
+// Test files
+//
+// Whole-file reads and writes for tests that build the files they
+// check, corrupt them byte by byte, or make them look changed.
+//-------------------------------------------------------------------
+
+inline bool ReadTestFile(const std::wstring& path, std::vector<uint8_t>* pData)
+{
+	FILE* fp = FileOpen(path, "rb");
+	if (!fp)
+		return false;
+	pData->clear();
+	uint8_t buffer[4096];
+	for (size_t cb; (cb = fread(buffer, 1, sizeof(buffer), fp)) > 0; )
+		pData->insert(pData->end(), buffer, buffer + cb);
+	fclose(fp);
+	return true;
+}
+
+inline bool WriteTestFile(const std::wstring& path, const std::vector<uint8_t>& data)
+{
+	FILE* fp = FileOpen(path, "wb");
+	if (!fp)
+		return false;
+	bool bOk = data.empty() || fwrite(data.data(), 1, data.size(), fp) == data.size();
+	return fclose(fp) == 0 && bOk;
+}
+
+// Sets the modification time GetFileInfo reports, in seconds since 1970.
+inline bool SetFileModified(const std::wstring& path, int64_t nModified)
+{
+#ifdef _WIN32
+	struct __utimbuf64 times = { nModified, nModified };
+	return _wutime64(path.c_str(), &times) == 0;
+#else
+	struct utimbuf times = { (time_t)nModified, (time_t)nModified };
+	return utime(ToUtf8(path).c_str(), &times) == 0;
+#endif
+}
+
+// Removes an empty directory.
+inline bool RemoveTestDirectory(const std::wstring& path)
+{
+#ifdef _WIN32
+	return _wrmdir(path.c_str()) == 0;
+#else
+	return rmdir(ToUtf8(path).c_str()) == 0;
+#endif
+}
@@ -0,0 +1,399 @@
+//-------------------------------------------------------------------
+//
+// TranscodeCacheTest
+//
+// Writes cache entries for a source file in a scratch directory, as the
+// clip cache does after a transcode, and checks that an index reads back
+// as written, that any cut or changed byte of it is rejected, and that an
+// entry stops being fresh when the source's size or time changes, when
+// it is asked for another target, or when its media file is cut or gone.
+// Commits that fail half way, on the media or on the index, must never
+// leave an index that describes other media. Also checks the keyframe a
+// seek starts from and the frame size of the cached variant at the edges.
+//
+//-------------------------------------------------------------------
+
+#include "TranscodeCache.h"
+#include "TestFiles.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+static const wchar_t CACHE_DIR[] = L"transcode_cache_test_files";
+static const uint32_t CLIP_FRAMES = 90;
+static const uint32_t GOP_FRAMES = 15;
+static const int64_t SOURCE_TIME = 1500000000;
+static const size_t SOURCE_BYTES = 1000;
+static const size_t MEDIA_BYTES = 5000;
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+static std::wstring GetCachePath(const wchar_t* pszName)
+{
+	return std::wstring(CACHE_DIR) + L"/" + pszName;
+}
+
+static CacheTarget MakeTarget(uint32_t cxDesktop, uint32_t cyDesktop)
+{
+	CacheTarget target;
+	target.cxDesktop = cxDesktop;
+	target.cyDesktop = cyDesktop;
+	return target;
+}
+
+// cFrames at 30 fps with a keyframe every nGopFrames, as the transcoder
+// writes them.
+static CacheIndex MakeIndex(const std::wstring& source, const CacheTarget& target, uint32_t cFrames,
+	uint32_t nGopFrames)
+{
+	CacheIndex index;
+	index.source = source;
+	index.sourceInfo.cbSize = SOURCE_BYTES;
+	index.sourceInfo.nModified = SOURCE_TIME;
+	index.target = target;
+	index.cx = 1920;
+	index.cy = 1080;
+	index.rate.nNum = 30;
+	index.rate.nDen = 1;
+	for (uint32_t n = 0; n < cFrames; n++) {
+		CacheFrame frame = { (HNSTIME)n * HNS_PER_SECOND / 30, HNS_PER_SECOND / 30, n % nGopFrames == 0 };
+		index.frames.push_back(frame);
+	}
+	return index;
+}
+
+static bool SameIndex(const CacheIndex& a, const CacheIndex& b)
+{
+	if (a.source != b.source || a.sourceInfo.cbSize != b.sourceInfo.cbSize ||
+		a.sourceInfo.nModified != b.sourceInfo.nModified || a.target.cxDesktop != b.target.cxDesktop ||
+		a.target.cyDesktop != b.target.cyDesktop || a.target.maxRate.nNum != b.target.maxRate.nNum ||
+		a.target.maxRate.nDen != b.target.maxRate.nDen || a.target.nGopFrames != b.target.nGopFrames ||
+		a.cx != b.cx || a.cy != b.cy || a.rate.nNum != b.rate.nNum || a.rate.nDen != b.rate.nDen ||
+		a.cbMedia != b.cbMedia || a.frames.size() != b.frames.size())
+		return false;
+	for (size_t i = 0; i < a.frames.size(); i++) {
+		if (a.frames[i].hnsTime != b.frames[i].hnsTime || a.frames[i].hnsDuration != b.frames[i].hnsDuration ||
+			a.frames[i].bKeyframe != b.frames[i].bKeyframe)
+			return false;
+	}
+	return true;
+}
+
+// Stores the FNV-1a checksum of an edited index over its last four
+// bytes, so only the edit itself can get it rejected.
+static void Resign(std::vector<uint8_t>* pData)
+{
+	uint32_t nHash = 0x811C9DC5;
+	for (size_t i = 0; i + 4 < pData->size(); i++) {
+		nHash ^= (*pData)[i];
+		nHash *= 0x01000193;
+	}
+	for (int i = 0; i < 4; i++)
+		(*pData)[pData->size() - 4 + i] = (uint8_t)(nHash >> (8 * i));
+}
+
+static void Put32(std::vector<uint8_t>* pData, size_t nOffset, uint32_t n)
+{
+	for (int i = 0; i < 4; i++)
+		(*pData)[nOffset + i] = (uint8_t)(n >> (8 * i));
+}
+
+// True if ReadIndex rejects the bytes and leaves pIndex alone.
+static bool IsRejected(const std::wstring& path, const std::vector<uint8_t>& data)
+{
+	CacheIndex index;
+	index.cx = 12345;
+	return WriteTestFile(path, data) && !TranscodeCache::ReadIndex(path, &index) && index.cx == 12345;
+}
+
+// A source file of SOURCE_BYTES and SOURCE_TIME, with one byte changed
+// to nVersion so a rewrite of the same size still differs.
+static bool WriteSource(const std::wstring& path, size_t cbSource, uint8_t nVersion)
+{
+	std::vector<uint8_t> data(cbSource, 0x5A);
+	data[0] = nVersion;
+	return WriteTestFile(path, data) && SetFileModified(path, SOURCE_TIME);
+}
+
+// Transcodes, as far as the cache can tell: writes cbMedia bytes to the
+// entry's temp file and commits it with an index for the source as it
+// is on disk.
+static bool CommitEntry(TranscodeCache* pCache, const std::wstring& source, const CacheTarget& target,
+	size_t cbMedia, uint32_t cx, CacheIndex* pIndex)
+{
+	*pIndex = MakeIndex(source, target, CLIP_FRAMES, GOP_FRAMES);
+	pIndex->cx = cx;
+	return GetFileInfo(source, &pIndex->sourceInfo) &&
+		WriteTestFile(pCache->GetTempPath(source, target), std::vector<uint8_t>(cbMedia, 0xC3)) &&
+		pCache->Commit(pCache->GetTempPath(source, target), pIndex);
+}
+
+static bool IsFresh(const TranscodeCache& cache, const std::wstring& source, const CacheTarget& target,
+	const CacheIndex& expected)
+{
+	CacheIndex index;
+	return cache.FindFresh(source, target, &index) && SameIndex(index, expected);
+}
+
+static bool Exists(const std::wstring& path)
+{
+	FileInfo info;
+	return GetFileInfo(path, &info);
+}
+
+static bool HasSize(const std::wstring& path, uint64_t cbSize)
+{
+	FileInfo info;
+	return GetFileInfo(path, &info) && info.cbSize == cbSize;
+}
+
+// Every field survives a write and read, paths outside ASCII and sizes
+// past 4 GB included, and so does an index without frames.
+static bool CheckIndexRoundTrip()
+{
+	std::wstring path = GetCachePath(L"round_trip.lwi");
+	CacheIndex written = MakeIndex(L"C:\\Clips\\\u00e9t\u00e9 \u6f22\u5b57.mp4", MakeTarget(5120, 1440), CLIP_FRAMES,
+		GOP_FRAMES);
+	written.sourceInfo.cbSize = 0x123456789ull;
+	written.sourceInfo.nModified = -86400;
+	written.target.maxRate.nNum = 60000;
+	written.target.maxRate.nDen = 1001;
+	written.cbMedia = 0xFEDCBA9876ull;
+
+	CacheIndex read;
+	bool bPassed = TranscodeCache::WriteIndex(path, written) && TranscodeCache::ReadIndex(path, &read) &&
+		SameIndex(read, written);
+
+	CacheIndex empty;
+	bPassed &= TranscodeCache::WriteIndex(path, empty) && TranscodeCache::ReadIndex(path, &read) &&
+		SameIndex(read, empty);
+	RemoveFile(path);
+	bPassed &= !TranscodeCache::ReadIndex(path, &read);
+	return bPassed;
+}
+
+// Cut to any length, grown by a byte, or with any byte changed, an index
+// is rejected; so is one of another version or with a frame count that
+// does not match its frames, checksum fixed up or not.
+static bool CheckIndexRejection()
+{
+	std::wstring path = GetCachePath(L"rejection.lwi");
+	CacheIndex written = MakeIndex(L"clip.mp4", MakeTarget(1920, 1080), 20, GOP_FRAMES);
+	std::vector<uint8_t> data;
+	if (!TranscodeCache::WriteIndex(path, written) || !ReadTestFile(path, &data) || data.size() < 8)
+		return false;
+	bool bPassed = true;
+
+	for (size_t cb = 0; bPassed && cb < data.size(); cb++)
+		bPassed &= IsRejected(path, std::vector<uint8_t>(data.begin(), data.begin() + cb));
+	std::vector<uint8_t> grown(data);
+	grown.push_back(0);
+	bPassed &= IsRejected(path, grown);
+	Resign(&grown);
+	bPassed &= IsRejected(path, grown);
+	for (size_t i = 0; bPassed && i < data.size(); i++) {
+		std::vector<uint8_t> changed(data);
+		changed[i] ^= 0x10;
+		bPassed &= IsRejected(path, changed);
+	}
+
+	// Layout: magic, version, source length, 8 UTF-16 chars, ..., frame
+	// count, 20 bytes per frame, checksum.
+	std::vector<uint8_t> version(data);
+	Put32(&version, 4, 2);
+	Resign(&version);
+	std::vector<uint8_t> frames(data);
+	Put32(&frames, data.size() - 4 - 20 * 20 - 4, 21);
+	Resign(&frames);
+	std::vector<uint8_t> source(data);
+	Put32(&source, 8, 0x10000000);
+	Resign(&source);
+	bPassed &= IsRejected(path, version) && IsRejected(path, frames) && IsRejected(path, source);
+
+	CacheIndex read;
+	bPassed &= WriteTestFile(path, data) && TranscodeCache::ReadIndex(path, &read) && SameIndex(read, written);
+	RemoveFile(path);
+	return bPassed;
+}
+
+// An entry is fresh for its source as it was transcoded, its target and
+// its whole media file, and for nothing else.
+static bool CheckFreshness()
+{
+	TranscodeCache cache(CACHE_DIR);
+	std::wstring source = GetCachePath(L"source.y4m");
+	CacheTarget target = MakeTarget(1920, 1080);
+	CacheIndex index;
+	bool bPassed = WriteSource(source, SOURCE_BYTES, 1) && !cache.FindFresh(source, target, &index);
+	bPassed &= CommitEntry(&cache, source, target, MEDIA_BYTES, 1920, &index) && index.cbMedia == MEDIA_BYTES &&
+		IsFresh(cache, source, target, index);
+
+	// The source is touched, then rewritten with another size.
+	bPassed &= SetFileModified(source, SOURCE_TIME + 1) && !IsFresh(cache, source, target, index);
+	bPassed &= SetFileModified(source, SOURCE_TIME) && IsFresh(cache, source, target, index);
+	bPassed &= WriteSource(source, SOURCE_BYTES + 1, 1) && !IsFresh(cache, source, target, index);
+	bPassed &= WriteSource(source, SOURCE_BYTES, 1) && IsFresh(cache, source, target, index);
+
+	// Another desktop, cap or keyframe interval is another entry, even
+	// with this entry's files put where that one's go.
+	CacheTarget others[3] = { MakeTarget(2560, 1440), target, target };
+	others[1].maxRate.nNum = 24;
+	others[2].nGopFrames = 1;
+	std::vector<uint8_t> indexData, mediaData;
+	bPassed &= ReadTestFile(cache.GetIndexPath(source, target), &indexData) &&
+		ReadTestFile(cache.GetMediaPath(source, target), &mediaData);
+	for (size_t i = 0; i < 3; i++) {
+		bPassed &= cache.GetIndexPath(source, others[i]) != cache.GetIndexPath(source, target) &&
+			!IsFresh(cache, source, others[i], index);
+		bPassed &= WriteTestFile(cache.GetIndexPath(source, others[i]), indexData) &&
+			WriteTestFile(cache.GetMediaPath(source, others[i]), mediaData) && !IsFresh(cache, source, others[i], index);
+		cache.Remove(source, others[i]);
+	}
+
+	// The media file is cut by a byte, then lost.
+	std::wstring media = cache.GetMediaPath(source, target);
+	bPassed &= WriteTestFile(media, std::vector<uint8_t>(MEDIA_BYTES - 1, 0xC3)) && !IsFresh(cache, source, target, index);
+	bPassed &= RemoveFile(media) && !IsFresh(cache, source, target, index);
+	bPassed &= WriteTestFile(media, mediaData) && IsFresh(cache, source, target, index);
+
+	TranscodeCache disabled;
+	bPassed &= !disabled.IsEnabled() && !disabled.FindFresh(source, target, &index);
+	cache.Remove(source, target);
+	bPassed &= !cache.FindFresh(source, target, &index) && !Exists(media) &&
+		!Exists(cache.GetIndexPath(source, target));
+	RemoveFile(source);
+	return bPassed;
+}
+
+// A commit moves the media into place before it writes the index, and
+// removes the old index first: when the media move fails there is no
+// entry left, and when the index write fails the new media is there
+// without an index. Commits without frames or media change nothing.
+static bool CheckCommitOrder()
+{
+	TranscodeCache cache(CACHE_DIR);
+	std::wstring source = GetCachePath(L"commit.y4m");
+	CacheTarget target = MakeTarget(1280, 720);
+	std::wstring temp = cache.GetTempPath(source, target);
+	std::wstring media = cache.GetMediaPath(source, target);
+	std::wstring indexPath = cache.GetIndexPath(source, target);
+	CacheIndex first, index;
+	bool bPassed = WriteSource(source, SOURCE_BYTES, 1) && CommitEntry(&cache, source, target, MEDIA_BYTES, 1280, &first);
+	bPassed &= !Exists(temp) && !Exists(indexPath + L".part") && IsFresh(cache, source, target, first);
+
+	CacheIndex noFrames = MakeIndex(source, target, 0, GOP_FRAMES);
+	bPassed &= WriteTestFile(temp, std::vector<uint8_t>(MEDIA_BYTES * 2, 0)) && !cache.Commit(temp, &noFrames) &&
+		Exists(temp) && IsFresh(cache, source, target, first);
+	bPassed &= RemoveFile(temp) && !cache.Commit(temp, &index) && IsFresh(cache, source, target, first);
+
+	// The source changed and is transcoded again.
+	bPassed &= WriteSource(source, SOURCE_BYTES, 2) && SetFileModified(source, SOURCE_TIME + 60) &&
+		!IsFresh(cache, source, target, first);
+	bPassed &= CommitEntry(&cache, source, target, MEDIA_BYTES * 2, 1282, &index) &&
+		index.cbMedia == MEDIA_BYTES * 2 && IsFresh(cache, source, target, index) && !Exists(temp);
+
+	// The media cannot be moved into place: a directory is in the way.
+	bPassed &= RemoveFile(media) && CreateDirectories(media);
+	bPassed &= !CommitEntry(&cache, source, target, MEDIA_BYTES, 1284, &index) && !Exists(indexPath) &&
+		!cache.FindFresh(source, target, &index) && Exists(temp);
+	bPassed &= RemoveTestDirectory(media) && RemoveFile(temp);
+
+	// The index cannot be written: the new media is in place, unindexed.
+	bPassed &= CreateDirectories(indexPath + L".part");
+	bPassed &= !CommitEntry(&cache, source, target, MEDIA_BYTES * 3, 1286, &index) && !Exists(indexPath) &&
+		!Exists(temp) && HasSize(media, MEDIA_BYTES * 3) && !cache.FindFresh(source, target, &index);
+	// Commit's cleanup already took it where remove() takes empty directories.
+	RemoveTestDirectory(indexPath + L".part");
+	bPassed &= CommitEntry(&cache, source, target, MEDIA_BYTES * 3, 1288, &index) && IsFresh(cache, source, target, index);
+
+	cache.Remove(source, target);
+	RemoveFile(source);
+	return bPassed;
+}
+
+// A seek starts from the last keyframe at or before its time: at a
+// keyframe, between two, before the first frame, past the last one,
+// with every frame a keyframe, and with no keyframe before the time.
+static bool CheckFindKeyframe()
+{
+	CacheIndex index = MakeIndex(L"clip.mp4", MakeTarget(1920, 1080), CLIP_FRAMES, GOP_FRAMES);
+	HNSTIME hnsFrame = index.frames[1].hnsTime;
+	HNSTIME hnsGop = index.frames[GOP_FRAMES].hnsTime;
+	bool bPassed = FindKeyframe(CacheIndex(), 0) == 0 && FindKeyframe(CacheIndex(), HNS_PER_SECOND) == 0;
+	bPassed &= FindKeyframe(index, -HNS_PER_SECOND) == 0 && FindKeyframe(index, 0) == 0;
+	bPassed &= FindKeyframe(index, hnsGop - 1) == 0 && FindKeyframe(index, hnsGop) == GOP_FRAMES &&
+		FindKeyframe(index, hnsGop + hnsFrame * 3 + 1) == GOP_FRAMES;
+	bPassed &= FindKeyframe(index, index.frames.back().hnsTime + HNS_PER_SECOND * 60) == CLIP_FRAMES - GOP_FRAMES;
+
+	CacheIndex intra = MakeIndex(L"clip.mp4", MakeTarget(1920, 1080), CLIP_FRAMES, 1);
+	for (uint32_t n = 0; n < CLIP_FRAMES; n++)
+		bPassed &= FindKeyframe(intra, intra.frames[n].hnsTime) == n && FindKeyframe(intra, intra.frames[n].hnsTime + 1) == n;
+
+	// A lone frame, and frames cut from the middle of an interval.
+	CacheIndex single = MakeIndex(L"clip.mp4", MakeTarget(1920, 1080), 1, GOP_FRAMES);
+	index.frames.erase(index.frames.begin(), index.frames.begin() + 3);
+	bPassed &= FindKeyframe(single, -1) == 0 && FindKeyframe(single, HNS_PER_SECOND) == 0;
+	bPassed &= FindKeyframe(index, hnsGop - 1) == 0 && FindKeyframe(index, hnsGop) == GOP_FRAMES - 3;
+	return bPassed;
+}
+
+// The cached frame covers the desktop with the least scaling, never
+// larger than the source, in even sizes of at least 2.
+static bool CheckFrameSize()
+{
+	struct SizeCase
+	{
+		uint32_t	cxSource;
+		uint32_t	cySource;
+		uint32_t	cxDesktop;
+		uint32_t	cyDesktop;
+		uint32_t	cx;
+		uint32_t	cy;
+	};
+	static const SizeCase s_cases[] = {
+		{ 3840, 2160, 1920, 1080, 1920, 1080 },		// Same shape
+		{ 1920, 1080, 3840, 2160, 1920, 1080 },		// Never scaled up
+		{ 3840, 2160, 1080, 1920, 3414, 1920 },		// Portrait desktop: cover its height
+		{ 3840, 1600, 1920, 1080, 2592, 1080 },		// Wider source: cover the height
+		{ 1440, 1080, 1920, 1080, 1440, 1080 },		// Covering would scale up
+		{ 4000, 3000, 5760, 1080, 4000, 3000 },		// Spanned desktop wider than the source
+		{ 3841, 2161, 1920, 1080, 1920, 1080 },		// Rounded up to cover, then down to even
+		{ 1921, 1081, 0, 0, 1920, 1080 },			// No desktop: the source, even
+		{ 1, 1, 1920, 1080, 2, 2 },
+		{ 0, 0, 1920, 1080, 2, 2 },
+		{ 100000, 2, 1920, 1080, 100000, 2 },
+	};
+	bool bPassed = true;
+	for (size_t i = 0; i < sizeof(s_cases) / sizeof(s_cases[0]); i++) {
+		const SizeCase& c = s_cases[i];
+		uint32_t cx = 0, cy = 0;
+		GetCacheFrameSize(c.cxSource, c.cySource, MakeTarget(c.cxDesktop, c.cyDesktop), &cx, &cy);
+		if (cx != c.cx || cy != c.cy) {
+			printf("  %ux%u on %ux%u: %ux%u, expected %ux%u\n", c.cxSource, c.cySource, c.cxDesktop, c.cyDesktop,
+				cx, cy, c.cx, c.cy);
+			bPassed = false;
+		}
+	}
+	return bPassed;
+}
+
+int main()
+{
+	if (!CreateDirectories(CACHE_DIR)) {
+		printf("cannot create %s\n", ToUtf8(CACHE_DIR).c_str());
+		return 1;
+	}
+	bool bPassed = true;
+	bPassed &= Report("index round trip", CheckIndexRoundTrip());
+	bPassed &= Report("index rejection", CheckIndexRejection());
+	bPassed &= Report("freshness", CheckFreshness());
+	bPassed &= Report("commit order", CheckCommitOrder());
+	bPassed &= Report("find keyframe", CheckFindKeyframe());
+	bPassed &= Report("frame size", CheckFrameSize());
+	RemoveTestDirectory(CACHE_DIR);
+	return bPassed ? 0 : 1;
+}
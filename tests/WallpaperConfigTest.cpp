@@ -0,0 +1,351 @@
+//-------------------------------------------------------------------
+//
+// WallpaperConfigTest
+//
+// Reads JSON documents token by token with JsonReader: every token
+// kind, comments and trailing commas, escapes down to surrogate pairs,
+// numbers, skipping, the nesting limit, and malformed documents with
+// the line and column of their error. Then parses config files into a
+// WallpaperConfig, applies the changes between two of them to a
+// recording target, and solves layouts with per-monitor settings.
+//
+//-------------------------------------------------------------------
+
+#include "JsonReader.h"
+#include "WallpaperConfig.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static bool Report(const char* pszName, bool bPassed)
+{
+	printf("%s: %s\n", pszName, bPassed ? "ok" : "FAILED");
+	return bPassed;
+}
+
+// Tokens of pszText up to the end or an error, the last included.
+static std::vector<JSON_TOKEN> GetTokens(const char* pszText)
+{
+	JsonReader reader(pszText, strlen(pszText));
+	std::vector<JSON_TOKEN> tokens;
+	JSON_TOKEN token;
+	do {
+		token = reader.Next();
+		tokens.push_back(token);
+	} while (token != JSON_TOKEN_END && token != JSON_TOKEN_ERROR);
+	return tokens;
+}
+
+// Every token kind, with a byte order mark, both kinds of comments and
+// commas before closing brackets.
+static bool CheckTokens()
+{
+	const char* pszText =
+		"\xEF\xBB\xBF// settings\n"
+		"{ \"a\": [1, -2.5e3, \"x\", true, false, null, ],\n"
+		"  /* nested */ \"b\": { \"c\": {} , }, }\n";
+	const JSON_TOKEN expected[] = {
+		JSON_TOKEN_BEGIN_OBJECT, JSON_TOKEN_KEY, JSON_TOKEN_BEGIN_ARRAY, JSON_TOKEN_NUMBER, JSON_TOKEN_NUMBER,
+		JSON_TOKEN_STRING, JSON_TOKEN_TRUE, JSON_TOKEN_FALSE, JSON_TOKEN_NULL, JSON_TOKEN_END_ARRAY,
+		JSON_TOKEN_KEY, JSON_TOKEN_BEGIN_OBJECT, JSON_TOKEN_KEY, JSON_TOKEN_BEGIN_OBJECT, JSON_TOKEN_END_OBJECT,
+		JSON_TOKEN_END_OBJECT, JSON_TOKEN_END_OBJECT, JSON_TOKEN_END,
+	};
+	bool bPassed = GetTokens(pszText) == std::vector<JSON_TOKEN>(expected, expected + sizeof(expected) / sizeof(expected[0]));
+
+	// Depth, position and number value along the way.
+	JsonReader reader(pszText, strlen(pszText));
+	double fValue = 0.0;
+	bPassed &= reader.Next() == JSON_TOKEN_BEGIN_OBJECT && reader.GetDepth() == 1 && reader.GetLine() == 2 &&
+		reader.GetColumn() == 1;
+	bPassed &= reader.Next() == JSON_TOKEN_KEY && reader.IsKey("a") && !reader.IsKey("ab") && reader.GetColumn() == 3;
+	bPassed &= reader.Next() == JSON_TOKEN_BEGIN_ARRAY && reader.GetDepth() == 2;
+	bPassed &= reader.Next() == JSON_TOKEN_NUMBER && reader.Next() == JSON_TOKEN_NUMBER &&
+		reader.GetNumber(&fValue) && fValue == -2500.0 && reader.GetColumn() == 12;
+
+	// The text need not be NUL-terminated: only cchText bytes are read.
+	const char* pszSlice = "[10]0";
+	JsonReader slice(pszSlice, 4);
+	bPassed &= slice.Next() == JSON_TOKEN_BEGIN_ARRAY && slice.Next() == JSON_TOKEN_NUMBER &&
+		slice.GetNumber(&fValue) && fValue == 10.0 && slice.Next() == JSON_TOKEN_END_ARRAY &&
+		slice.Next() == JSON_TOKEN_END;
+	return Report("tokens", bPassed);
+}
+
+static bool IsString(const char* pszJson, const char* pszExpected, size_t cchExpected)
+{
+	JsonReader reader(pszJson, strlen(pszJson));
+	char buffer[64];
+	size_t cch = 0;
+	return reader.Next() == JSON_TOKEN_STRING && reader.GetString(buffer, sizeof(buffer), &cch) &&
+		cch == cchExpected && memcmp(buffer, pszExpected, cch) == 0 && buffer[cch] == '\0';
+}
+
+// Escapes resolve to UTF-8; surrogate pairs join and lone ones become
+// U+FFFD. A buffer too small fails but reports the length.
+static bool CheckStrings()
+{
+	bool bPassed = IsString("\"C:\\\\Clips\\/sea.mp4\"", "C:\\Clips/sea.mp4", 16);
+	bPassed &= IsString("\"\\\"\\b\\f\\n\\r\\t\"", "\"\b\f\n\r\t", 6);
+	bPassed &= IsString("\"\\u00e9\\u20AC\"", "\xC3\xA9\xE2\x82\xAC", 5);
+	bPassed &= IsString("\"\\ud83c\\udf0a\"", "\xF0\x9F\x8C\x8A", 4);
+	bPassed &= IsString("\"\\ud83c-\\udf0a\"", "\xEF\xBF\xBD-\xEF\xBF\xBD", 7);
+	bPassed &= IsString("\"\xE6\xB5\xB7\"", "\xE6\xB5\xB7", 3);
+
+	const char* pszText = "{\"m\\u0061x-fps\": \"abcdefgh\"}";
+	JsonReader reader(pszText, strlen(pszText));
+	char buffer[8];
+	size_t cch = 0;
+	bPassed &= reader.Next() == JSON_TOKEN_BEGIN_OBJECT && reader.Next() == JSON_TOKEN_KEY &&
+		reader.IsKey("max-fps") && !reader.IsKey("m\\u0061x-fps");
+	bPassed &= reader.Next() == JSON_TOKEN_STRING && !reader.GetString(buffer, sizeof(buffer), &cch) && cch == 8;
+	char fits[9];
+	bPassed &= reader.GetString(fits, sizeof(fits), &cch) && strcmp(fits, "abcdefgh") == 0;
+	return Report("strings", bPassed);
+}
+
+// Skip passes over a key's whole value; deep nesting stops at the limit.
+static bool CheckSkip()
+{
+	const char* pszText = "{\"skip\": {\"a\": [1, [2, {\"b\": 3}]]}, \"keep\": 4}";
+	JsonReader reader(pszText, strlen(pszText));
+	double fValue = 0.0;
+	bool bPassed = reader.Next() == JSON_TOKEN_BEGIN_OBJECT && reader.Next() == JSON_TOKEN_KEY && reader.Skip() &&
+		reader.GetDepth() == 1 && reader.Next() == JSON_TOKEN_KEY && reader.IsKey("keep") &&
+		reader.Next() == JSON_TOKEN_NUMBER && reader.GetNumber(&fValue) && fValue == 4.0;
+
+	std::string deep(JSON_MAX_DEPTH, '[');
+	deep.append(JSON_MAX_DEPTH, ']');
+	bPassed &= GetTokens(deep.c_str()).back() == JSON_TOKEN_END;
+	deep = "[" + deep + "]";
+	std::vector<JSON_TOKEN> tokens = GetTokens(deep.c_str());
+	bPassed &= tokens.back() == JSON_TOKEN_ERROR && tokens.size() == JSON_MAX_DEPTH + 1;
+	return Report("skip and depth", bPassed);
+}
+
+// Malformed documents fail where the error is, and stay failed.
+static bool CheckErrors()
+{
+	struct { const char* pszText; uint32_t nLine, nColumn; const char* pszError; } cases[] = {
+		{ "", 1, 1, "unexpected end of document" },
+		{ "{\"a\" 1}", 1, 6, "expected :" },
+		{ "{\"a\": 1 \"b\": 2}", 1, 9, "expected , or }" },
+		{ "[1 2]", 1, 4, "expected , or ]" },
+		{ "[1,\n  01]", 2, 4, "expected , or ]" },
+		{ "{\"a\": [1}", 1, 9, "mismatched bracket" },
+		{ "{\n\"a\": tru}", 2, 6, "expected a value" },
+		{ "[\"abc", 1, 2, "unterminated string" },
+		{ "[\"\\x\"]", 1, 2, "bad escape" },
+		{ "[\"\\u12g4\"]", 1, 2, "bad \\u escape" },
+		{ "[1.]", 1, 2, "bad number" },
+		{ "[-]", 1, 2, "bad number" },
+		{ "[1e]", 1, 2, "bad number" },
+		{ "[1]\n/* open", 2, 1, "unterminated comment" },
+		{ "[,]", 1, 2, "expected a value" },
+		{ "{1: 2}", 1, 2, "expected a key" },
+		{ "{} {}", 1, 4, "text after the document" },
+	};
+	bool bPassed = true;
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		JsonReader reader(cases[i].pszText, strlen(cases[i].pszText));
+		JSON_TOKEN token;
+		while ((token = reader.Next()) != JSON_TOKEN_END && token != JSON_TOKEN_ERROR) {
+		}
+		bool bCase = token == JSON_TOKEN_ERROR && reader.GetLine() == cases[i].nLine &&
+			reader.GetColumn() == cases[i].nColumn && strcmp(reader.GetError(), cases[i].pszError) == 0 &&
+			reader.Next() == JSON_TOKEN_ERROR;
+		if (!bCase) {
+			printf("  \"%s\": %u:%u %s\n", cases[i].pszText, reader.GetLine(), reader.GetColumn(),
+				reader.GetError() ? reader.GetError() : "no error");
+		}
+		bPassed &= bCase;
+	}
+	return Report("malformed documents", bPassed);
+}
+
+static bool Parse(const char* pszText, const WallpaperConfig& base, WallpaperConfig* pConfig, ConfigError* pError)
+{
+	return ParseWallpaperConfig(pszText, strlen(pszText), base, pConfig, pError);
+}
+
+// The example of WallpaperConfig.h, member by member; what it leaves out
+// keeps the base's value and unknown members are skipped.
+static bool CheckParse()
+{
+	const char* pszText =
+		"{\n"
+		"  \"clips\": [ \"C:\\\\Clips\\\\sea.mp4\", { \"path\": \"D:\\\\night.mp4\", \"at\": \"21:00\" } ],\n"
+		"  \"interval\": 600, \"shuffle\": true,\n"
+		"  \"max-fps\": 30, \"layout\": \"clone\", \"scale\": \"fill\",\n"
+		"  \"volume\": 0.5, \"mute\": false, \"adaptive\": true,\n"
+		"  \"power\": { \"battery\": { \"max-fps\": 10 }, \"saver\": { \"pause\": true } },\n"
+		"  \"monitors\": [ { \"device\": \"\\\\\\\\.\\\\DISPLAY2\", \"enabled\": false },\n"
+		"                { \"index\": 0, \"scale\": \"fit\" } ],\n"
+		"  \"future\": { \"option\": [1, 2, { \"x\": null }] }\n"
+		"}\n";
+	WallpaperConfig base;
+	base.playlist.hnsPrefetch = 7 * HNS_PER_SECOND;
+	WallpaperConfig config;
+	ConfigError error = ConfigError();
+	bool bPassed = Parse(pszText, base, &config, &error);
+
+	bPassed = bPassed && config.clips.size() == 2 && config.clips[0].path == L"C:\\Clips\\sea.mp4" &&
+		config.clips[0].nStartOfDay == -1 && config.clips[1].path == L"D:\\night.mp4" &&
+		config.clips[1].nStartOfDay == 21 * 3600;
+	bPassed &= config.playlist.hnsInterval == 600 * HNS_PER_SECOND && config.playlist.order == PLAYLIST_SHUFFLE &&
+		config.playlist.hnsPrefetch == 7 * HNS_PER_SECOND;
+	bPassed &= config.fMaxFps == 30.0f && config.layout == LAYOUT_CLONE && config.scale == SCALE_FILL &&
+		config.fVolume == 0.5f && !config.bMute && config.bAdaptive;
+	bPassed &= config.power[POWER_STATE_AC].fMaxFps == 0.0f && config.power[POWER_STATE_BATTERY].fMaxFps == 10.0f &&
+		!config.power[POWER_STATE_BATTERY].bPause && config.power[POWER_STATE_SAVER].bPause &&
+		config.power[POWER_STATE_SAVER].fMaxFps == DEFAULT_BATTERY_FPS;
+	bPassed = bPassed && config.monitors.size() == 2 && config.monitors[0].device == L"\\\\.\\DISPLAY2" &&
+		!config.monitors[0].bEnabled && config.monitors[0].nIndex == -1 && config.monitors[1].nIndex == 0 &&
+		config.monitors[1].nScale == SCALE_FIT && config.monitors[1].bEnabled;
+
+	// An empty object is the base.
+	bPassed &= Parse("{}", base, &config, &error) && DiffWallpaperConfig(base, config) == 0;
+	return Report("parse config", bPassed);
+}
+
+// Errors name the first problem and where it is.
+static bool CheckParseErrors()
+{
+	struct { const char* pszText; uint32_t nLine, nColumn; const char* pszMessage; } cases[] = {
+		{ "[]", 1, 1, "expected an object" },
+		{ "{\"volume\": 2}", 1, 12, "number out of range" },
+		{ "{\"volume\": \"loud\"}", 1, 12, "expected a number" },
+		{ "{\n  \"layout\": \"tiles\"}", 2, 13, "unknown name" },
+		{ "{\"clips\": []}", 1, 12, "clips must not be empty" },
+		{ "{\"clips\": [{\"at\": \"7:00\"}]}", 1, 25, "clip has no path" },
+		{ "{\"clips\": [{\"path\": \"a\", \"at\": \"25:00\"}]}", 1, 32, "time must be \"HH:MM\"" },
+		{ "{\"monitors\": [{\"enabled\": true}]}", 1, 31, "monitor needs a device or an index" },
+		{ "{\"monitors\": [{\"index\": 1.5}]}", 1, 25, "index must be a whole number" },
+		{ "{\"mute\": 1}", 1, 10, "expected true or false" },
+		{ "{\"other\": [1,}", 1, 14, "expected a value" },
+		{ "{\"shuffle\": true} x", 1, 19, "text after the document" },
+	};
+	WallpaperConfig base, config;
+	bool bPassed = true;
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		ConfigError error = ConfigError();
+		bool bCase = !Parse(cases[i].pszText, base, &config, &error) && error.nLine == cases[i].nLine &&
+			error.nColumn == cases[i].nColumn && strcmp(error.pszMessage, cases[i].pszMessage) == 0;
+		if (!bCase) {
+			printf("  %s: %u:%u %s\n", cases[i].pszText, error.nLine, error.nColumn,
+				error.pszMessage ? error.pszMessage : "no error");
+		}
+		bPassed &= bCase;
+	}
+	return Report("config errors", bPassed);
+}
+
+// Records which setters a config change calls.
+class RecordingTarget : public IConfigTarget
+{
+public:
+	void SetPlaylist(const std::vector<PlaylistItem>&, const PlaylistConfig&) override { m_calls += "playlist "; }
+	void SetAdaptive(bool) override { m_calls += "adaptive "; }
+	void SetFrameRate(float, const PowerProfile*) override { m_calls += "frame-rate "; }
+	void SetLayout(LAYOUT_MODE, SCALE_MODE, const std::vector<MonitorConfig>&) override { m_calls += "layout "; }
+	void SetAudio(float, bool) override { m_calls += "audio "; }
+
+	std::string m_calls;
+};
+
+// Editing one setting applies only that setting.
+static bool CheckApply()
+{
+	WallpaperConfig base, from, to;
+	ConfigError error;
+	bool bPassed = Parse("{\"clips\": [\"a\", \"b\"], \"volume\": 0.5}", base, &from, &error) &&
+		Parse("{\"clips\": [\"a\", \"b\"], \"volume\": 0.25}", base, &to, &error);
+	RecordingTarget target;
+	bPassed &= ApplyWallpaperConfig(from, to, &target) == CONFIG_CHANGE_AUDIO && target.m_calls == "audio ";
+
+	bPassed &= Parse("{\"clips\": [\"a\", \"c\"], \"volume\": 0.5, \"power\": {\"ac\": {\"max-fps\": 24}},"
+		" \"adaptive\": true, \"monitors\": [{\"index\": 1, \"enabled\": false}]}", base, &to, &error);
+	target.m_calls.clear();
+	bPassed &= ApplyWallpaperConfig(from, to, &target) ==
+		(CONFIG_CHANGE_CLIPS | CONFIG_CHANGE_POWER | CONFIG_CHANGE_ADAPTIVE | CONFIG_CHANGE_MONITORS) &&
+		target.m_calls == "playlist frame-rate adaptive layout ";
+
+	target.m_calls.clear();
+	bPassed &= ApplyWallpaperConfig(to, to, &target) == 0 && target.m_calls.empty();
+	return Report("apply changes", bPassed);
+}
+
+static MonitorDesc MakeMonitor(int32_t left, int32_t cx, int32_t cy)
+{
+	MonitorDesc monitor;
+	monitor.rcMonitor.left = left;
+	monitor.rcMonitor.top = 0;
+	monitor.rcMonitor.right = left + cx;
+	monitor.rcMonitor.bottom = cy;
+	monitor.nDpi = 96;
+	return monitor;
+}
+
+// Monitors are matched by device name without case, the last entry
+// winning; disabled ones get no viewport and clone scales each its own
+// way.
+static bool CheckMonitors()
+{
+	WallpaperConfig base, config;
+	ConfigError error;
+	bool bPassed = Parse("{\"monitors\": [{\"index\": 1, \"scale\": \"stretch\"},"
+		" {\"device\": \"\\\\\\\\.\\\\display2\", \"enabled\": false}, {\"index\": 0, \"scale\": \"fill\"}]}",
+		base, &config, &error);
+	const std::wstring devices[] = { L"\\\\.\\DISPLAY1", L"\\\\.\\DISPLAY2" };
+	bPassed &= !FindMonitorConfig(config.monitors, 1, devices[1]).bEnabled &&
+		FindMonitorConfig(config.monitors, 0, devices[0]).nScale == SCALE_FILL &&
+		FindMonitorConfig(config.monitors, 5, L"\\\\.\\DISPLAY9").bEnabled;
+
+	MonitorDesc monitors[] = { MakeMonitor(0, 1920, 1080), MakeMonitor(1920, 1080, 1920) };
+	LayoutParams params;
+	params.cxSource = 1920;
+	params.cySource = 1080;
+	params.layout = LAYOUT_SPAN;
+	params.scale = SCALE_STRETCH;
+	std::vector<Viewport> vps;
+	bPassed &= SolveConfiguredLayout(params, monitors, devices, 2, config.monitors, &vps) && vps.size() == 1 &&
+		vps[0].nMonitor == 0 && vps[0].rcDest.right == 1920 && vps[0].rcSource.right == 1920;
+
+	// Enabled again, in clone layout: the device entry comes after the
+	// index one, so the portrait monitor takes the global fit and is
+	// letterboxed, while the first one fills.
+	config.monitors[1].bEnabled = true;
+	params.layout = LAYOUT_CLONE;
+	params.scale = SCALE_FIT;
+	bPassed &= SolveConfiguredLayout(params, monitors, devices, 2, config.monitors, &vps) && vps.size() == 2 &&
+		vps[0].nMonitor == 0 && vps[0].rcDest.right == 1920 && vps[0].rcDest.bottom == 1080 &&
+		vps[1].nMonitor == 1 && vps[1].rcDest.top == 656 && vps[1].rcDest.bottom == 1264;
+
+	// Dropping the device entry leaves the index one: stretch.
+	config.monitors.erase(config.monitors.begin() + 1);
+	bPassed &= SolveConfiguredLayout(params, monitors, devices, 2, config.monitors, &vps) && vps.size() == 2 &&
+		vps[1].rcDest.top == 0 && vps[1].rcDest.bottom == 1920 && vps[1].rcSource.right == 1920 &&
+		vps[1].rcSource.bottom == 1080;
+
+	// No monitor enabled means all are.
+	std::vector<MonitorConfig> none(2);
+	none[0].nIndex = 0;
+	none[1].nIndex = 1;
+	none[0].bEnabled = none[1].bEnabled = false;
+	params.layout = LAYOUT_SPAN;
+	bPassed &= SolveConfiguredLayout(params, monitors, devices, 2, none, &vps) && vps.size() == 2;
+	return Report("monitor settings", bPassed);
+}
+
+int main()
+{
+	bool bPassed = CheckTokens();
+	bPassed &= CheckStrings();
+	bPassed &= CheckSkip();
+	bPassed &= CheckErrors();
+	bPassed &= CheckParse();
+	bPassed &= CheckParseErrors();
+	bPassed &= CheckApply();
+	bPassed &= CheckMonitors();
+	return bPassed ? 0 : 1;
+}